@@ -0,0 +1,312 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EVALUATION_H_
+#define EVALUATION_H_
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Eigen/Geometry>
+
+#include <dvo_benchmark/groundtruth.h>
+#include <dvo_benchmark/file_reader.h>
+#include <dvo_benchmark/tools.h>
+
+namespace dvo_benchmark
+{
+
+/**
+ * Accuracy of a trajectory against the groundtruth, computed like the evaluate_ate.py and evaluate_rpe.py tools of
+ * the TUM RGB-D benchmark, so the numbers are comparable.
+ */
+struct EvaluationConfig
+{
+  // maximum difference of the timestamps of an estimate and its groundtruth in seconds
+  double MaxTimeDifference;
+
+  // distance of the pose pairs of the relative pose error in seconds
+  double RpeDelta;
+
+  EvaluationConfig() :
+    MaxTimeDifference(0.02),
+    RpeDelta(1.0)
+  {
+  }
+};
+
+struct ErrorStatistics
+{
+  size_t Count;
+  double Rmse, Mean, Median, Max;
+};
+
+struct TrajectoryEvaluation
+{
+  // estimates, and the ones with groundtruth
+  size_t Poses, Associated;
+
+  // absolute translational error in m after aligning the estimates with the groundtruth
+  ErrorStatistics Ate;
+
+  // relative pose error over RpeDelta, in m and degrees
+  ErrorStatistics RpeTranslation, RpeRotation;
+};
+
+static void computeErrorStatistics(std::vector<double>& errors, ErrorStatistics& stats)
+{
+  stats.Count = errors.size();
+  stats.Rmse = stats.Mean = stats.Median = stats.Max = 0.0;
+
+  if(errors.empty()) return;
+
+  double sum = 0.0, squared_sum = 0.0;
+
+  for(std::vector<double>::const_iterator it = errors.begin(); it != errors.end(); ++it)
+  {
+    sum += *it;
+    squared_sum += *it * *it;
+    stats.Max = std::max(stats.Max, *it);
+  }
+
+  stats.Rmse = std::sqrt(squared_sum / errors.size());
+  stats.Mean = sum / errors.size();
+
+  std::nth_element(errors.begin(), errors.begin() + errors.size() / 2, errors.end());
+  stats.Median = errors[errors.size() / 2];
+}
+
+static bool compareTimestamps(const Groundtruth& a, const Groundtruth& b)
+{
+  return a.Timestamp() < b.Timestamp();
+}
+
+static bool equalTimestamps(const Groundtruth& a, const Groundtruth& b)
+{
+  return a.Timestamp() == b.Timestamp();
+}
+
+/**
+ * Evaluates the estimates, in the format of TrajectorySerializer, which is the one of the groundtruth. Returns false if
+ * the groundtruth can't be read or no estimate has groundtruth.
+ */
+static bool evaluateTrajectory(std::vector<Groundtruth> estimates, std::string groundtruth_file, const EvaluationConfig& cfg, TrajectoryEvaluation& result)
+{
+  typedef std::vector<Eigen::Affine3d, Eigen::aligned_allocator<Eigen::Affine3d> > PoseVector;
+
+  std::sort(estimates.begin(), estimates.end(), compareTimestamps);
+  estimates.erase(std::unique(estimates.begin(), estimates.end(), equalTimestamps), estimates.end());
+
+  result.Poses = estimates.size();
+  result.Associated = 0;
+
+  FileReader<Groundtruth> groundtruth_reader(groundtruth_file);
+  groundtruth_reader.skipComments();
+
+  if(!groundtruth_reader.next()) return false;
+
+  std::vector<double> timestamps;
+  PoseVector estimated_poses, true_poses;
+
+  for(std::vector<Groundtruth>::const_iterator it = estimates.begin(); it != estimates.end(); ++it)
+  {
+    if(!findClosestEntry(groundtruth_reader, it->Timestamp())) break;
+
+    if(std::abs((groundtruth_reader.entry().Timestamp() - it->Timestamp()).toSec()) > cfg.MaxTimeDifference) continue;
+
+    Eigen::Affine3d estimated, truth;
+    toPoseEigen(*it, estimated);
+    toPoseEigen(groundtruth_reader.entry(), truth);
+
+    timestamps.push_back(it->Timestamp().toSec());
+    estimated_poses.push_back(estimated);
+    true_poses.push_back(truth);
+  }
+
+  result.Associated = timestamps.size();
+
+  if(timestamps.empty()) return false;
+
+  // ate, rigid alignment of the positions
+  Eigen::Matrix3Xd estimated_positions(3, timestamps.size()), true_positions(3, timestamps.size());
+
+  for(size_t idx = 0; idx < timestamps.size(); ++idx)
+  {
+    estimated_positions.col(idx) = estimated_poses[idx].translation();
+    true_positions.col(idx) = true_poses[idx].translation();
+  }
+
+  const Eigen::Matrix4d alignment = Eigen::umeyama(estimated_positions, true_positions, false);
+
+  std::vector<double> errors(timestamps.size());
+
+  for(size_t idx = 0; idx < timestamps.size(); ++idx)
+    errors[idx] = (alignment.topLeftCorner<3, 3>() * estimated_positions.col(idx) + alignment.topRightCorner<3, 1>() - true_positions.col(idx)).norm();
+
+  computeErrorStatistics(errors, result.Ate);
+
+  // rpe, every pose paired with the first one at least RpeDelta later
+  std::vector<double> translation_errors, rotation_errors;
+
+  for(size_t first = 0, second = 0; first < timestamps.size(); ++first)
+  {
+    while(second < timestamps.size() && timestamps[second] < timestamps[first] + cfg.RpeDelta) ++second;
+
+    if(second == timestamps.size()) break;
+
+    const Eigen::Affine3d error = (true_poses[first].inverse() * true_poses[second]).inverse() * (estimated_poses[first].inverse() * estimated_poses[second]);
+
+    translation_errors.push_back(error.translation().norm());
+    rotation_errors.push_back(Eigen::AngleAxisd(error.rotation()).angle() * 180.0 / M_PI);
+  }
+
+  computeErrorStatistics(translation_errors, result.RpeTranslation);
+  computeErrorStatistics(rotation_errors, result.RpeRotation);
+
+  return true;
+}
+
+static bool evaluateTrajectory(std::string trajectory_file, std::string groundtruth_file, const EvaluationConfig& cfg, TrajectoryEvaluation& result)
+{
+  FileReader<Groundtruth> trajectory_reader(trajectory_file);
+  trajectory_reader.skipComments();
+
+  if(!trajectory_reader.next()) return false;
+
+  std::vector<Groundtruth> estimates;
+  trajectory_reader.readAllEntries(estimates);
+
+  return evaluateTrajectory(estimates, groundtruth_file, cfg, result);
+}
+
+/**
+ * Named results of a run, lower is better for all of them. Stored one per line as
+ *
+ *   <accuracy|timing> <name> <value>
+ *
+ * so the metrics of one run can serve as the baseline of the next.
+ */
+struct Metric
+{
+  enum Kind
+  {
+    Accuracy,
+    Timing
+  };
+
+  Kind Type;
+  double Value;
+};
+typedef std::map<std::string, Metric> MetricMap;
+
+// a metric is a regression if it exceeds the baseline by more than Relative * baseline + Absolute
+struct RegressionTolerance
+{
+  double Relative, Absolute;
+};
+
+struct Regression
+{
+  std::string Name;
+
+  // the value is NaN if the run didn't produce the metric
+  double Baseline, Value;
+};
+
+static void addMetric(MetricMap& metrics, const std::string& name, Metric::Kind type, double value)
+{
+  Metric m;
+  m.Type = type;
+  m.Value = value;
+
+  metrics[name] = m;
+}
+
+static bool writeMetrics(const std::string& file, const MetricMap& metrics)
+{
+  std::ofstream out(file.c_str());
+
+  if(!out.good()) return false;
+
+  out.precision(9);
+
+  for(MetricMap::const_iterator it = metrics.begin(); it != metrics.end(); ++it)
+    out << (it->second.Type == Metric::Timing ? "timing" : "accuracy") << " " << it->first << " " << it->second.Value << std::endl;
+
+  return out.good();
+}
+
+static bool readMetrics(const std::string& file, MetricMap& metrics)
+{
+  std::ifstream in(file.c_str());
+
+  if(!in.good()) return false;
+
+  std::string line;
+
+  while(std::getline(in, line))
+  {
+    line = line.substr(0, line.find('#'));
+
+    std::istringstream tokens(line);
+    std::string type, name;
+    double value;
+
+    if(!(tokens >> type)) continue;
+
+    if(!(tokens >> name >> value) || (type != "timing" && type != "accuracy")) return false;
+
+    addMetric(metrics, name, type == "timing" ? Metric::Timing : Metric::Accuracy, value);
+  }
+
+  return true;
+}
+
+/**
+ * Compares every metric of the baseline with the one of the run, metrics only known to the run are ignored. Returns
+ * true if there are no regressions.
+ */
+static bool findRegressions(const MetricMap& baseline, const MetricMap& metrics, const RegressionTolerance& accuracy, const RegressionTolerance& timing, std::vector<Regression>& regressions)
+{
+  for(MetricMap::const_iterator it = baseline.begin(); it != baseline.end(); ++it)
+  {
+    const RegressionTolerance& tolerance = it->second.Type == Metric::Timing ? timing : accuracy;
+    MetricMap::const_iterator current = metrics.find(it->first);
+
+    Regression r;
+    r.Name = it->first;
+    r.Baseline = it->second.Value;
+    r.Value = current != metrics.end() ? current->second.Value : std::numeric_limits<double>::quiet_NaN();
+
+    // also catches NaNs
+    if(!(r.Value <= r.Baseline + tolerance.Relative * std::abs(r.Baseline) + tolerance.Absolute)) regressions.push_back(r);
+  }
+
+  return regressions.empty();
+}
+
+} /* namespace dvo_benchmark */
+#endif /* EVALUATION_H_ */
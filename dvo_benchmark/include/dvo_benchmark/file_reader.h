@@ -69,13 +69,16 @@ public:
   }
 
   /**
-   * Moves to the next entry in the file. Returns true, if there was a next entry, false otherwise.
+   * Moves to the next entry in the file. Returns true, if there was a next entry, false otherwise. A trailing newline
+   * doesn't count as entry.
    */
   bool next()
   {
-    if(file_stream_.good() && !file_stream_.eof())
+    EntryT entry;
+
+    if(file_stream_.good() && !file_stream_.eof() && (file_stream_ >> entry))
     {
-      file_stream_ >> entry_;
+      entry_ = entry;
       hasEntry_ = true;
 
       return true;
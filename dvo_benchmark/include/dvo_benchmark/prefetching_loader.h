@@ -0,0 +1,145 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PREFETCHING_LOADER_H_
+#define PREFETCHING_LOADER_H_
+
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+#include <dvo/core/rgbd_image.h>
+#include <dvo/util/bounded_queue.h>
+
+#include <dvo_benchmark/rgbd_pair.h>
+
+namespace dvo_benchmark
+{
+
+/**
+ * Decodes the images of a sequence on a background thread, up to lookahead frames ahead of the consumer. The images
+ * are converted directly into pyramids of the given camera, which should pool at least lookahead plus the number of
+ * frames the consumer keeps.
+ */
+class PrefetchingLoader
+{
+public:
+  struct Frame
+  {
+    Frame() : Last(false) {}
+
+    RgbdPair Pair;
+    dvo::core::RgbdImagePyramidPtr Image;
+
+    // no readable frame follows
+    bool Last;
+  };
+
+  PrefetchingLoader(dvo::core::RgbdCameraPyramid& camera, const std::string& folder, const std::vector<RgbdPair>& pairs, size_t lookahead, float depth_scale, bool with_rgb, size_t num_levels = 0) :
+    camera_(camera),
+    folder_(folder),
+    pairs_(pairs),
+    depth_scale_(depth_scale),
+    with_rgb_(with_rgb),
+    num_levels_(num_levels),
+    size_(int(camera.level(0).width()), int(camera.level(0).height())),
+    finished_(false),
+    queue_(lookahead, dvo::util::BoundedQueue<Frame>::Block)
+  {
+    thread_ = boost::thread(&PrefetchingLoader::load, this);
+  }
+
+  ~PrefetchingLoader()
+  {
+    queue_.shutdown();
+    thread_.join();
+  }
+
+  /**
+   * Blocks until the next frame is decoded. Returns false after the last frame. Frames whose images can't be read or
+   * don't match the size of the camera are skipped.
+   */
+  bool next(Frame& frame)
+  {
+    if(finished_) return false;
+
+    if(!queue_.pop(frame) || !frame.Image)
+    {
+      finished_ = true;
+      frame = Frame();
+    }
+
+    return !finished_;
+  }
+private:
+  dvo::core::RgbdCameraPyramid& camera_;
+  std::string folder_;
+  std::vector<RgbdPair> pairs_;
+  float depth_scale_;
+  bool with_rgb_;
+  size_t num_levels_;
+  cv::Size size_;
+  bool finished_;
+
+  dvo::util::BoundedQueue<Frame> queue_;
+  boost::thread thread_;
+
+  void load()
+  {
+    // a frame is only queued once the next readable one is found, so the last one can be marked
+    Frame pending;
+
+    for(std::vector<RgbdPair>::const_iterator it = pairs_.begin(); it != pairs_.end(); ++it)
+    {
+      cv::Mat rgb = cv::imread(folder_ + it->RgbFile(), 1);
+      cv::Mat depth = cv::imread(folder_ + it->DepthFile(), -1);
+
+      if(rgb.empty() || depth.empty() || rgb.size() != size_ || depth.size() != size_)
+      {
+        std::cerr << "Failed to load '" << it->RgbFile() << "' and '" << it->DepthFile() << "', skipping!" << std::endl;
+        continue;
+      }
+
+      Frame frame;
+      frame.Pair = *it;
+      frame.Image = camera_.create(rgb, depth, depth_scale_, with_rgb_);
+
+      if(num_levels_ > 0) frame.Image->build(num_levels_);
+
+      // only fails after shutdown
+      if(pending.Image && !queue_.push(pending)) return;
+
+      pending = frame;
+    }
+
+    if(pending.Image)
+    {
+      pending.Last = true;
+      if(!queue_.push(pending)) return;
+    }
+
+    // end of sequence
+    queue_.push(Frame());
+  }
+};
+
+} /* namespace dvo_benchmark */
+#endif /* PREFETCHING_LOADER_H_ */
@@ -0,0 +1,319 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEQUENCE_FILE_H_
+#define SEQUENCE_FILE_H_
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <opencv2/opencv.hpp>
+
+namespace dvo_benchmark
+{
+
+/**
+ * Packed RGB-D sequence, replaces the TUM folder layout of an association file and one png per image:
+ *
+ *   SequenceHeader | frame data ... | SequenceIndexEntry[NumFrames]
+ *
+ * Every frame stores the 8 bit gray or bgr image followed by the 16 bit raw depth image, rows are not padded and
+ * images start at SequenceAlignment byte boundaries. All values are little endian.
+ */
+static const char SequenceMagic[8] = { 'D', 'V', 'O', 'S', 'E', 'Q', '\0', '\0' };
+static const uint32_t SequenceVersion = 1;
+static const uint64_t SequenceAlignment = 64;
+
+struct SequenceHeader
+{
+  char Magic[8];
+  uint32_t Version;
+
+  uint32_t Width, Height;
+
+  // CV_8UC1 or CV_8UC3
+  uint32_t ColorType;
+
+  // metres per raw depth unit
+  float DepthScale;
+
+  uint32_t NumFrames;
+  uint64_t IndexOffset;
+};
+
+struct SequenceIndexEntry
+{
+  double RgbTimestamp, DepthTimestamp;
+
+  uint64_t ColorOffset, DepthOffset;
+};
+
+/**
+ * Appends frames to a new sequence file, the index is written by close().
+ */
+class SequenceWriter
+{
+public:
+  SequenceWriter(const std::string& file, int width, int height, int color_type, float depth_scale) :
+    out_(file.c_str(), std::ios::binary | std::ios::trunc),
+    offset_(0)
+  {
+    std::memset(&header_, 0, sizeof(header_));
+    std::memcpy(header_.Magic, SequenceMagic, sizeof(SequenceMagic));
+    header_.Version = SequenceVersion;
+    header_.Width = width;
+    header_.Height = height;
+    header_.ColorType = color_type;
+    header_.DepthScale = depth_scale;
+
+    write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+  }
+
+  ~SequenceWriter()
+  {
+    close();
+  }
+
+  bool good() const
+  {
+    return out_.good();
+  }
+
+  // color has to be of the type given to the constructor and depth CV_16UC1, both of the sequence size
+  bool add(double rgb_timestamp, const cv::Mat& color, double depth_timestamp, const cv::Mat& depth)
+  {
+    if(!out_.is_open() || color.type() != int(header_.ColorType) || depth.type() != CV_16UC1 ||
+        color.cols != int(header_.Width) || color.rows != int(header_.Height) || depth.size() != color.size()) return false;
+
+    SequenceIndexEntry entry;
+    entry.RgbTimestamp = rgb_timestamp;
+    entry.DepthTimestamp = depth_timestamp;
+    entry.ColorOffset = writeImage(color);
+    entry.DepthOffset = writeImage(depth);
+
+    index_.push_back(entry);
+
+    return out_.good();
+  }
+
+  bool close()
+  {
+    if(!out_.is_open()) return false;
+
+    align();
+
+    header_.NumFrames = index_.size();
+    header_.IndexOffset = offset_;
+
+    if(!index_.empty()) write(reinterpret_cast<const char*>(&index_[0]), index_.size() * sizeof(SequenceIndexEntry));
+
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+
+    const bool ok = out_.good();
+    out_.close();
+
+    return ok;
+  }
+private:
+  std::ofstream out_;
+  uint64_t offset_;
+
+  SequenceHeader header_;
+  std::vector<SequenceIndexEntry> index_;
+
+  void write(const char* data, size_t size)
+  {
+    out_.write(data, size);
+    offset_ += size;
+  }
+
+  void align()
+  {
+    static const char zeros[SequenceAlignment] = { 0 };
+
+    size_t padding = (SequenceAlignment - offset_ % SequenceAlignment) % SequenceAlignment;
+    write(zeros, padding);
+  }
+
+  uint64_t writeImage(const cv::Mat& img)
+  {
+    align();
+
+    const uint64_t offset = offset_;
+    const size_t row_size = img.cols * img.elemSize();
+
+    for(int y = 0; y < img.rows; ++y)
+      write(img.ptr<char>(y), row_size);
+
+    return offset;
+  }
+};
+
+/**
+ * Memory maps a sequence file. Opening only validates the header and index, the images are handed out as cv::Mat
+ * headers pointing into the mapping, so there is no decoding and no copy. The views must not be written to and are
+ * only valid while the reader exists.
+ */
+class SequenceReader
+{
+public:
+  SequenceReader(const std::string& file) :
+    data_(0),
+    size_(0),
+    header_(0),
+    index_(0)
+  {
+    int fd = ::open(file.c_str(), O_RDONLY);
+
+    if(fd < 0) return;
+
+    struct stat s;
+
+    if(::fstat(fd, &s) == 0 && size_t(s.st_size) >= sizeof(SequenceHeader))
+    {
+      void* data = ::mmap(0, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+      if(data != MAP_FAILED)
+      {
+        data_ = static_cast<const char*>(data);
+        size_ = s.st_size;
+      }
+    }
+
+    ::close(fd);
+
+    if(data_ == 0 || !validate())
+    {
+      unmap();
+      return;
+    }
+
+    ::madvise(const_cast<char*>(data_), size_, MADV_SEQUENTIAL);
+  }
+
+  ~SequenceReader()
+  {
+    unmap();
+  }
+
+  bool good() const
+  {
+    return data_ != 0;
+  }
+
+  size_t size() const
+  {
+    return good() ? header_->NumFrames : 0;
+  }
+
+  int width() const
+  {
+    return header_->Width;
+  }
+
+  int height() const
+  {
+    return header_->Height;
+  }
+
+  float depthScale() const
+  {
+    return header_->DepthScale;
+  }
+
+  const SequenceIndexEntry& entry(size_t idx) const
+  {
+    return index_[idx];
+  }
+
+  void frame(size_t idx, cv::Mat& color, cv::Mat& depth) const
+  {
+    const SequenceIndexEntry& e = index_[idx];
+
+    color = cv::Mat(header_->Height, header_->Width, header_->ColorType, const_cast<char*>(data_ + e.ColorOffset));
+    depth = cv::Mat(header_->Height, header_->Width, CV_16UC1, const_cast<char*>(data_ + e.DepthOffset));
+  }
+
+  /**
+   * Reads the whole file into the page cache and touches every page, so a following replay doesn't wait for the disk.
+   */
+  void preload() const
+  {
+    if(!good()) return;
+
+    ::madvise(const_cast<char*>(data_), size_, MADV_WILLNEED);
+
+    volatile char sum = 0;
+    const long page = ::sysconf(_SC_PAGESIZE);
+
+    for(size_t offset = 0; offset < size_; offset += page)
+      sum += data_[offset];
+  }
+private:
+  const char* data_;
+  size_t size_;
+
+  const SequenceHeader* header_;
+  const SequenceIndexEntry* index_;
+
+  SequenceReader(const SequenceReader&);
+  SequenceReader& operator=(const SequenceReader&);
+
+  bool validate()
+  {
+    header_ = reinterpret_cast<const SequenceHeader*>(data_);
+
+    if(std::memcmp(header_->Magic, SequenceMagic, sizeof(SequenceMagic)) != 0 || header_->Version != SequenceVersion) return false;
+    if(header_->ColorType != CV_8UC1 && header_->ColorType != CV_8UC3) return false;
+    if(header_->IndexOffset + uint64_t(header_->NumFrames) * sizeof(SequenceIndexEntry) > size_) return false;
+
+    index_ = reinterpret_cast<const SequenceIndexEntry*>(data_ + header_->IndexOffset);
+
+    const uint64_t color_size = uint64_t(header_->Width) * header_->Height * CV_ELEM_SIZE(header_->ColorType);
+    const uint64_t depth_size = uint64_t(header_->Width) * header_->Height * sizeof(uint16_t);
+
+    for(size_t idx = 0; idx < header_->NumFrames; ++idx)
+    {
+      if(index_[idx].ColorOffset + color_size > size_ || index_[idx].DepthOffset + depth_size > size_) return false;
+    }
+
+    return true;
+  }
+
+  void unmap()
+  {
+    if(data_ != 0) ::munmap(const_cast<char*>(data_), size_);
+
+    data_ = 0;
+    size_ = 0;
+  }
+};
+
+} /* namespace dvo_benchmark */
+#endif /* SEQUENCE_FILE_H_ */
@@ -0,0 +1,744 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Headless batch benchmark. Runs every dataset of a manifest with every parameter set in parallel, one
+ * KeyframeTracker per job, without visualization and without a ROS master:
+ *
+ *   batch_benchmark [-j parallel_jobs] [-o output_folder] [-b baseline] [-a accuracy_tolerance] [-t timing_tolerance] manifest
+ *
+ * The manifest has one entry per line, '#' starts a comment:
+ *
+ *   # dataset <name> <rgbd pair or .seq file> <fx> <fy> <ox> <oy> [depth scale, default 1/5000]
+ *   dataset fr1_desk /data/rgbd_dataset_freiburg1_desk/assoc.txt 517.3 516.5 318.6 255.3
+ *   dataset fr1_room /data/fr1_room.seq 517.3 516.5 318.6 255.3
+ *
+ *   # config <name> [<parameter>=<value> ...]
+ *   config default
+ *   config coarse first_level=3 last_level=2 max_translational_distance=0.3
+ *
+ *   # groundtruth <dataset name> <file>, defaults to groundtruth.txt next to the rgbd pair file
+ *   groundtruth fr1_room /data/rgbd_dataset_freiburg1_room/groundtruth.txt
+ *
+ * Parameter names are the ones of the dvo_ros and dvo_slam dynamic reconfigure configurations, unset parameters keep
+ * their defaults. Every job writes the online trajectory to <dataset>_<config>_traj.txt and the optimized one to
+ * <dataset>_<config>_opt_traj_final.txt, the timing of all jobs is collected in timing.csv. Images are decoded on a
+ * background thread per job, so load is only the time a tracker waited for its next frame. Sequence files created with
+ * convert_sequence are memory mapped and replayed without decoding, their depth scale is stored in the file.
+ *
+ * Jobs with groundtruth evaluate the ATE and RPE of their optimized trajectory, see dvo_benchmark/evaluation.h. These
+ * and the update time percentiles of every job are written to metrics.txt. With -b the metrics are compared to the ones
+ * of an earlier run, and the exit code is 2 if any of them is worse than the baseline by more than the relative
+ * tolerance, 0.05 for accuracy and 0.2 for timing by default. Parallel jobs compete for the cores, so timing baselines
+ * should be recorded and checked with the same -j.
+ */
+
+#include <dvo/core/intrinsic_matrix.h>
+#include <dvo/core/rgbd_image.h>
+#include <dvo/dense_tracking.h>
+#include <dvo/visualization/visualizer.h>
+#include <dvo/util/instrumentation.h>
+
+#include <dvo_slam/keyframe_tracker.h>
+#include <dvo_slam/serialization/map_serializer.h>
+#include <dvo_slam/KeyframeSlamConfig.h>
+
+#include <dvo_ros/util/configtools.h>
+
+#include <dvo_benchmark/evaluation.h>
+#include <dvo_benchmark/file_reader.h>
+#include <dvo_benchmark/rgbd_pair.h>
+#include <dvo_benchmark/prefetching_loader.h>
+#include <dvo_benchmark/sequence_file.h>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+#include <tbb/atomic.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+struct Dataset
+{
+  std::string Name;
+  std::string RgbdPairFile;
+
+  // empty if there is none
+  std::string GroundtruthFile;
+
+  float Fx, Fy, Ox, Oy;
+  float DepthScale;
+};
+
+struct ParameterSet
+{
+  std::string Name;
+
+  dvo::DenseTracker::Config Tracking;
+  dvo_slam::KeyframeTrackerConfig KeyframeSelection;
+  dvo_slam::KeyframeGraphConfig Mapping;
+};
+
+struct Job
+{
+  const Dataset* dataset;
+  const ParameterSet* parameters;
+};
+
+struct JobResult
+{
+  bool Success;
+  size_t Frames;
+
+  // in seconds
+  double Online, Finish;
+  dvo::util::TimerSummary Load, Update;
+
+  bool Evaluated;
+  dvo_benchmark::TrajectoryEvaluation Evaluation;
+};
+
+typedef std::vector<std::pair<std::string, std::string> > ParameterVector;
+
+// number of frames every job decodes ahead of its tracker
+static const size_t PrefetchFrames = 8;
+
+// converts the parameters known by ConfigType into a reconfigure message, so the generated code takes care of types
+template<typename ConfigType>
+static bool updateConfig(const ParameterVector& parameters, std::vector<bool>& used, ConfigType& cfg)
+{
+  typedef typename ConfigType::AbstractParamDescriptionConstPtr DescriptionPtr;
+  const std::vector<DescriptionPtr>& descriptions = ConfigType::__getParamDescriptions__();
+
+  dynamic_reconfigure::Config msg;
+
+  for(size_t idx = 0; idx < parameters.size(); ++idx)
+  {
+    const std::string& name = parameters[idx].first;
+    const std::string& value = parameters[idx].second;
+
+    for(typename std::vector<DescriptionPtr>::const_iterator it = descriptions.begin(); it != descriptions.end(); ++it)
+    {
+      if((*it)->name != name) continue;
+
+      try
+      {
+        if((*it)->type == "int")
+        {
+          dynamic_reconfigure::IntParameter p;
+          p.name = name;
+          p.value = boost::lexical_cast<int>(value);
+          msg.ints.push_back(p);
+        }
+        else if((*it)->type == "double")
+        {
+          dynamic_reconfigure::DoubleParameter p;
+          p.name = name;
+          p.value = boost::lexical_cast<double>(value);
+          msg.doubles.push_back(p);
+        }
+        else if((*it)->type == "bool")
+        {
+          dynamic_reconfigure::BoolParameter p;
+          p.name = name;
+          p.value = value == "true" || value == "1";
+
+          if(!p.value && value != "false" && value != "0") throw boost::bad_lexical_cast();
+
+          msg.bools.push_back(p);
+        }
+        else
+        {
+          dynamic_reconfigure::StrParameter p;
+          p.name = name;
+          p.value = value;
+          msg.strs.push_back(p);
+        }
+      }
+      catch(boost::bad_lexical_cast&)
+      {
+        std::cerr << "Invalid value '" << value << "' for parameter '" << name << "' of type " << (*it)->type << "!" << std::endl;
+        return false;
+      }
+
+      used[idx] = true;
+      break;
+    }
+  }
+
+  if(!cfg.__fromMessage__(msg)) return false;
+
+  cfg.__clamp__();
+
+  return true;
+}
+
+static bool parseParameterSet(std::istream& line, ParameterSet& parameters)
+{
+  ParameterVector values;
+  std::string token;
+
+  while(line >> token)
+  {
+    size_t pos = token.find('=');
+
+    if(pos == std::string::npos || pos == 0)
+    {
+      std::cerr << "Expected <parameter>=<value>, got '" << token << "'!" << std::endl;
+      return false;
+    }
+
+    values.push_back(std::make_pair(token.substr(0, pos), token.substr(pos + 1)));
+  }
+
+  std::vector<bool> used(values.size(), false);
+
+  dvo_ros::CameraDenseTrackerConfig tracker_cfg = dvo_ros::CameraDenseTrackerConfig::__getDefault__();
+  dvo_slam::KeyframeSlamConfig slam_cfg = dvo_slam::KeyframeSlamConfig::__getDefault__();
+
+  if(!updateConfig(values, used, tracker_cfg) || !updateConfig(values, used, slam_cfg)) return false;
+
+  for(size_t idx = 0; idx < values.size(); ++idx)
+  {
+    if(!used[idx])
+    {
+      std::cerr << "Unknown parameter '" << values[idx].first << "'!" << std::endl;
+      return false;
+    }
+  }
+
+  parameters.Tracking = dvo::DenseTracker::getDefaultConfig();
+  dvo_ros::util::updateConfigFromDynamicReconfigure(tracker_cfg, parameters.Tracking);
+  dvo_slam::updateConfigFromDynamicReconfigure(slam_cfg, parameters.KeyframeSelection, parameters.Mapping);
+
+  return true;
+}
+
+static bool parseManifest(const std::string& file, std::vector<Dataset>& datasets, std::vector<ParameterSet>& parameter_sets)
+{
+  std::ifstream in(file.c_str());
+
+  if(!in.good())
+  {
+    std::cerr << "Failed to open '" << file << "'!" << std::endl;
+    return false;
+  }
+
+  std::string line;
+
+  for(size_t line_number = 1; std::getline(in, line); ++line_number)
+  {
+    line = line.substr(0, line.find('#'));
+
+    std::istringstream tokens(line);
+    std::string type;
+
+    if(!(tokens >> type)) continue;
+
+    bool ok = false;
+
+    if(type == "dataset")
+    {
+      Dataset d;
+
+      if(tokens >> d.Name >> d.RgbdPairFile >> d.Fx >> d.Fy >> d.Ox >> d.Oy)
+      {
+        if(!(tokens >> d.DepthScale)) d.DepthScale = 1.0f / 5000.0f;
+
+        // the layout of the TUM RGB-D benchmark
+        std::string groundtruth_file = d.RgbdPairFile.substr(0, d.RgbdPairFile.find_last_of("/") + 1) + "groundtruth.txt";
+
+        if(std::ifstream(groundtruth_file.c_str()).good()) d.GroundtruthFile = groundtruth_file;
+
+        datasets.push_back(d);
+        ok = true;
+      }
+    }
+    else if(type == "groundtruth")
+    {
+      std::string name, groundtruth_file;
+
+      if(tokens >> name >> groundtruth_file)
+      {
+        for(std::vector<Dataset>::iterator it = datasets.begin(); it != datasets.end(); ++it)
+        {
+          if(it->Name != name) continue;
+
+          it->GroundtruthFile = groundtruth_file;
+          ok = true;
+        }
+      }
+    }
+    else if(type == "config")
+    {
+      ParameterSet p;
+
+      if((tokens >> p.Name) && parseParameterSet(tokens, p))
+      {
+        parameter_sets.push_back(p);
+        ok = true;
+      }
+    }
+
+    if(!ok)
+    {
+      std::cerr << file << ":" << line_number << ": invalid entry '" << line << "'!" << std::endl;
+      return false;
+    }
+  }
+
+  if(parameter_sets.empty())
+  {
+    ParameterSet p;
+    std::istringstream empty;
+
+    p.Name = "default";
+    parseParameterSet(empty, p);
+    parameter_sets.push_back(p);
+  }
+
+  return true;
+}
+
+static void writePose(std::ostream& out, const ros::Time& timestamp, const Eigen::Affine3d& pose)
+{
+  Eigen::Quaterniond q(pose.rotation());
+
+  out
+    << timestamp << " "
+    << pose.translation()(0) << " "
+    << pose.translation()(1) << " "
+    << pose.translation()(2) << " "
+    << q.x() << " "
+    << q.y() << " "
+    << q.z() << " "
+    << q.w() << " "
+    << std::endl;
+}
+
+// replays a memory mapped sequence file, same interface as dvo_benchmark::PrefetchingLoader
+class SequenceLoader
+{
+public:
+  typedef dvo_benchmark::PrefetchingLoader::Frame Frame;
+
+  SequenceLoader(dvo::core::RgbdCameraPyramid& camera, const dvo_benchmark::SequenceReader& sequence, size_t num_levels) :
+    camera_(camera),
+    sequence_(sequence),
+    num_levels_(num_levels),
+    next_(0)
+  {
+  }
+
+  bool next(Frame& frame)
+  {
+    if(next_ >= sequence_.size()) return false;
+
+    const dvo_benchmark::SequenceIndexEntry& entry = sequence_.entry(next_);
+
+    cv::Mat color, depth;
+    sequence_.frame(next_, color, depth);
+
+    frame.Pair.RgbTimestamp(ros::Time(entry.RgbTimestamp));
+    frame.Pair.DepthTimestamp(ros::Time(entry.DepthTimestamp));
+    frame.Image = camera_.create(color, depth, sequence_.depthScale(), false);
+    frame.Image->build(num_levels_);
+
+    next_++;
+    frame.Last = next_ == sequence_.size();
+
+    return true;
+  }
+private:
+  dvo::core::RgbdCameraPyramid& camera_;
+  const dvo_benchmark::SequenceReader& sequence_;
+  size_t num_levels_, next_;
+};
+
+static bool isSequenceFile(const std::string& file)
+{
+  return file.size() > 4 && file.compare(file.size() - 4, 4, ".seq") == 0;
+}
+
+template<typename LoaderType>
+static void track(LoaderType& loader, dvo_slam::KeyframeTracker& keyframe_tracker, std::ostream& trajectory_out, JobResult& result)
+{
+  Eigen::Affine3d trajectory;
+  trajectory.setIdentity();
+
+  keyframe_tracker.init(trajectory);
+
+  dvo::util::Timer load_timer("load"), update_timer("update");
+  typename LoaderType::Frame frame;
+
+  result.Frames = 0;
+
+  const int64_t online_start = dvo::util::Timer::now();
+
+  while(true)
+  {
+    {
+      // only the time the tracker waits for the loader
+      dvo::util::ScopedTimer load_scope(load_timer);
+
+      if(!loader.next(frame)) break;
+    }
+
+    if(frame.Last)
+    {
+      keyframe_tracker.forceKeyframe();
+    }
+
+    {
+      dvo::util::ScopedTimer update_scope(update_timer);
+      keyframe_tracker.update(frame.Image, frame.Pair.RgbTimestamp(), trajectory);
+    }
+
+    writePose(trajectory_out, frame.Pair.RgbTimestamp(), trajectory);
+
+    result.Frames++;
+  }
+
+  result.Online = dvo::util::Timer::seconds(dvo::util::Timer::now() - online_start);
+
+  load_timer.summarize(result.Load);
+  update_timer.summarize(result.Update);
+}
+
+static bool runJob(const Job& job, const std::string& output_folder, JobResult& result)
+{
+  const Dataset& dataset = *job.dataset;
+  const ParameterSet& parameters = *job.parameters;
+  const std::string prefix = output_folder + "/" + dataset.Name + "_" + parameters.Name;
+
+  std::string rgbdpair_file = dataset.RgbdPairFile;
+
+  boost::shared_ptr<dvo_benchmark::SequenceReader> sequence;
+  std::vector<dvo_benchmark::RgbdPair> pairs;
+  std::string folder;
+  cv::Size size;
+
+  if(isSequenceFile(rgbdpair_file))
+  {
+    sequence.reset(new dvo_benchmark::SequenceReader(rgbdpair_file));
+
+    if(!sequence->good() || sequence->size() == 0)
+    {
+      std::cerr << "Failed to open '" << rgbdpair_file << "'!" << std::endl;
+      return false;
+    }
+
+    // replay doesn't touch the disk
+    sequence->preload();
+
+    size = cv::Size(sequence->width(), sequence->height());
+  }
+  else
+  {
+    dvo_benchmark::FileReader<dvo_benchmark::RgbdPair> rgbdpair_reader(rgbdpair_file);
+    rgbdpair_reader.skipComments();
+
+    if(!rgbdpair_reader.next())
+    {
+      std::cerr << "Failed to open '" << rgbdpair_file << "'!" << std::endl;
+      return false;
+    }
+
+    rgbdpair_reader.readAllEntries(pairs);
+
+    folder = rgbdpair_file.substr(0, rgbdpair_file.find_last_of("/") + 1);
+
+    // the image size is taken from the first frame
+    cv::Mat first = cv::imread(folder + pairs.front().RgbFile(), -1);
+
+    if(first.empty())
+    {
+      std::cerr << "Failed to read '" << folder + pairs.front().RgbFile() << "'!" << std::endl;
+      return false;
+    }
+
+    size = first.size();
+  }
+
+  std::ofstream trajectory_out((prefix + "_traj.txt").c_str());
+
+  if(!trajectory_out.good())
+  {
+    std::cerr << "Failed to open '" << prefix << "_traj.txt'!" << std::endl;
+    return false;
+  }
+
+  dvo::core::IntrinsicMatrix intrinsics = dvo::core::IntrinsicMatrix::create(dataset.Fx, dataset.Fy, dataset.Ox, dataset.Oy);
+
+  dvo::core::RgbdCameraPyramid camera(size.width, size.height, intrinsics);
+  camera.build(parameters.Tracking.getNumLevels());
+  camera.setPoolSize(PrefetchFrames + 4);
+
+  // no visualizer, so the keyframe graph doesn't render anything
+  dvo_slam::KeyframeTracker keyframe_tracker;
+  keyframe_tracker.configureTracking(parameters.Tracking);
+  keyframe_tracker.configureKeyframeSelection(parameters.KeyframeSelection);
+  keyframe_tracker.configureMapping(parameters.Mapping);
+
+  if(sequence)
+  {
+    SequenceLoader loader(camera, *sequence, parameters.Tracking.getNumLevels());
+    track(loader, keyframe_tracker, trajectory_out, result);
+  }
+  else
+  {
+    dvo_benchmark::PrefetchingLoader loader(camera, folder, pairs, PrefetchFrames, dataset.DepthScale, false, parameters.Tracking.getNumLevels());
+    track(loader, keyframe_tracker, trajectory_out, result);
+  }
+
+  const int64_t finish_start = dvo::util::Timer::now();
+  keyframe_tracker.finish();
+  result.Finish = dvo::util::Timer::seconds(dvo::util::Timer::now() - finish_start);
+
+  {
+    dvo_slam::serialization::FileSerializer<dvo_slam::serialization::TrajectorySerializer> serializer(prefix + "_opt_traj_final.txt");
+    keyframe_tracker.serializeMap(serializer);
+  }
+
+  result.Evaluated = !dataset.GroundtruthFile.empty() && dvo_benchmark::evaluateTrajectory(prefix + "_opt_traj_final.txt", dataset.GroundtruthFile, dvo_benchmark::EvaluationConfig(), result.Evaluation);
+
+  if(!dataset.GroundtruthFile.empty() && !result.Evaluated)
+  {
+    std::cerr << "Failed to evaluate '" << prefix << "_opt_traj_final.txt' against '" << dataset.GroundtruthFile << "'!" << std::endl;
+  }
+
+  return true;
+}
+
+class BatchRunner
+{
+public:
+  BatchRunner(const std::vector<Job>& jobs, std::vector<JobResult>& results, const std::string& output_folder) :
+    jobs_(jobs),
+    results_(results),
+    output_folder_(output_folder)
+  {
+    next_ = 0;
+  }
+
+  void run(size_t num_threads)
+  {
+    boost::thread_group threads;
+
+    for(size_t idx = 0; idx < num_threads; ++idx)
+      threads.create_thread(boost::bind(&BatchRunner::work, this));
+
+    threads.join_all();
+  }
+private:
+  const std::vector<Job>& jobs_;
+  std::vector<JobResult>& results_;
+  const std::string& output_folder_;
+
+  tbb::atomic<size_t> next_;
+  boost::mutex output_mutex_;
+
+  void work()
+  {
+    for(size_t idx = next_++; idx < jobs_.size(); idx = next_++)
+    {
+      const Job& job = jobs_[idx];
+      JobResult& result = results_[idx];
+
+      result.Evaluated = false;
+      result.Success = runJob(job, output_folder_, result);
+
+      boost::mutex::scoped_lock lock(output_mutex_);
+
+      std::cerr << "[" << (idx + 1) << "/" << jobs_.size() << "] " << job.dataset->Name << " " << job.parameters->Name;
+
+      if(result.Success)
+      {
+        std::cerr << ": " << result.Frames << " frames, " << (result.Frames / result.Online) << " frames/s, update p99 " << result.Update.P99 * 1e3 << " ms";
+
+        if(result.Evaluated)
+          std::cerr << ", ate " << result.Evaluation.Ate.Rmse << " m, rpe " << result.Evaluation.RpeTranslation.Rmse << " m/s";
+
+        std::cerr << std::endl;
+      }
+      else
+        std::cerr << ": failed" << std::endl;
+    }
+  }
+};
+
+static bool writeTiming(const std::string& file, const std::vector<Job>& jobs, const std::vector<JobResult>& results)
+{
+  std::ofstream out(file.c_str());
+
+  if(!out.good()) return false;
+
+  out << "dataset,config,success,frames,online,finish,frames_per_second,load_mean,update_mean,update_p50,update_p90,update_p99,update_max" << std::endl;
+
+  for(size_t idx = 0; idx < jobs.size(); ++idx)
+  {
+    const JobResult& r = results[idx];
+
+    out << jobs[idx].dataset->Name << "," << jobs[idx].parameters->Name << "," << r.Success;
+
+    if(r.Success)
+      out << "," << r.Frames << "," << r.Online << "," << r.Finish << "," << (r.Frames / r.Online) << "," << r.Load.Mean << "," << r.Update.Mean << "," << r.Update.P50 << "," << r.Update.P90 << "," << r.Update.P99 << "," << r.Update.Max;
+
+    out << std::endl;
+  }
+
+  return out.good();
+}
+
+static void collectMetrics(const std::vector<Job>& jobs, const std::vector<JobResult>& results, dvo_benchmark::MetricMap& metrics)
+{
+  using dvo_benchmark::Metric;
+
+  for(size_t idx = 0; idx < jobs.size(); ++idx)
+  {
+    const JobResult& r = results[idx];
+    const std::string prefix = jobs[idx].dataset->Name + "_" + jobs[idx].parameters->Name + "/";
+
+    if(!r.Success) continue;
+
+    dvo_benchmark::addMetric(metrics, prefix + "update_p50", Metric::Timing, r.Update.P50);
+    dvo_benchmark::addMetric(metrics, prefix + "update_p99", Metric::Timing, r.Update.P99);
+    dvo_benchmark::addMetric(metrics, prefix + "finish", Metric::Timing, r.Finish);
+
+    if(!r.Evaluated) continue;
+
+    dvo_benchmark::addMetric(metrics, prefix + "ate_rmse", Metric::Accuracy, r.Evaluation.Ate.Rmse);
+    dvo_benchmark::addMetric(metrics, prefix + "ate_max", Metric::Accuracy, r.Evaluation.Ate.Max);
+    dvo_benchmark::addMetric(metrics, prefix + "rpe_translation_rmse", Metric::Accuracy, r.Evaluation.RpeTranslation.Rmse);
+    dvo_benchmark::addMetric(metrics, prefix + "rpe_rotation_rmse", Metric::Accuracy, r.Evaluation.RpeRotation.Rmse);
+  }
+}
+
+static void usage(const char* name)
+{
+  std::cerr << "usage: " << name << " [-j parallel_jobs] [-o output_folder] [-b baseline] [-a accuracy_tolerance] [-t timing_tolerance] manifest" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  size_t num_threads = std::max(1u, boost::thread::hardware_concurrency());
+  std::string output_folder = ".", manifest, baseline_file;
+
+  // absolute slack of 1 mm or 0.001 degrees, and 1 ms
+  dvo_benchmark::RegressionTolerance accuracy_tolerance = { 0.05, 1e-3 }, timing_tolerance = { 0.2, 1e-3 };
+
+  for(int idx = 1; idx < argc; ++idx)
+  {
+    if(std::strcmp(argv[idx], "-j") == 0 && idx + 1 < argc)
+      num_threads = std::max(1, std::atoi(argv[++idx]));
+    else if(std::strcmp(argv[idx], "-o") == 0 && idx + 1 < argc)
+      output_folder = argv[++idx];
+    else if(std::strcmp(argv[idx], "-b") == 0 && idx + 1 < argc)
+      baseline_file = argv[++idx];
+    else if(std::strcmp(argv[idx], "-a") == 0 && idx + 1 < argc)
+      accuracy_tolerance.Relative = std::atof(argv[++idx]);
+    else if(std::strcmp(argv[idx], "-t") == 0 && idx + 1 < argc)
+      timing_tolerance.Relative = std::atof(argv[++idx]);
+    else if(argv[idx][0] != '-' && manifest.empty())
+      manifest = argv[idx];
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if(manifest.empty())
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<Dataset> datasets;
+  std::vector<ParameterSet> parameter_sets;
+
+  if(!parseManifest(manifest, datasets, parameter_sets)) return 1;
+
+  dvo_benchmark::MetricMap baseline;
+
+  if(!baseline_file.empty() && !dvo_benchmark::readMetrics(baseline_file, baseline))
+  {
+    std::cerr << "Failed to read baseline '" << baseline_file << "'!" << std::endl;
+    return 1;
+  }
+
+  std::vector<Job> jobs;
+
+  for(std::vector<Dataset>::const_iterator d = datasets.begin(); d != datasets.end(); ++d)
+  {
+    for(std::vector<ParameterSet>::const_iterator p = parameter_sets.begin(); p != parameter_sets.end(); ++p)
+    {
+      Job job = { &(*d), &(*p) };
+      jobs.push_back(job);
+    }
+  }
+
+  dvo::visualization::Visualizer::instance()
+    .useExternalWaitKey(false)
+    .enabled(false)
+    .save(false)
+  ;
+
+  std::cerr << jobs.size() << " jobs, " << std::min(num_threads, jobs.size()) << " in parallel" << std::endl;
+
+  std::vector<JobResult> results(jobs.size());
+
+  BatchRunner runner(jobs, results, output_folder);
+  runner.run(std::min(num_threads, jobs.size()));
+
+  if(!writeTiming(output_folder + "/timing.csv", jobs, results))
+  {
+    std::cerr << "Failed to write '" << output_folder << "/timing.csv'!" << std::endl;
+    return 1;
+  }
+
+  dvo_benchmark::MetricMap metrics;
+  collectMetrics(jobs, results, metrics);
+
+  if(!dvo_benchmark::writeMetrics(output_folder + "/metrics.txt", metrics))
+  {
+    std::cerr << "Failed to write '" << output_folder << "/metrics.txt'!" << std::endl;
+    return 1;
+  }
+
+  for(size_t idx = 0; idx < results.size(); ++idx)
+    if(!results[idx].Success) return 1;
+
+  std::vector<dvo_benchmark::Regression> regressions;
+
+  if(!dvo_benchmark::findRegressions(baseline, metrics, accuracy_tolerance, timing_tolerance, regressions))
+  {
+    for(std::vector<dvo_benchmark::Regression>::const_iterator it = regressions.begin(); it != regressions.end(); ++it)
+      std::cerr << "regression " << it->Name << ": " << it->Value << " (baseline " << it->Baseline << ")" << std::endl;
+
+    return 2;
+  }
+
+  if(!baseline.empty()) std::cerr << "no regressions against " << baseline.size() << " baseline metrics" << std::endl;
+
+  return 0;
+}
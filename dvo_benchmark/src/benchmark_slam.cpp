@@ -43,52 +43,7 @@
 #include <dvo_benchmark/rgbd_pair.h>
 #include <dvo_benchmark/groundtruth.h>
 #include <dvo_benchmark/tools.h>
-
-dvo::core::RgbdImagePyramidPtr load(dvo::core::RgbdCameraPyramid& camera, std::string rgb_file, std::string depth_file)
-{
-  cv::Mat rgb, grey, grey_s16, depth, depth_inpainted, depth_mask, depth_mono, depth_float;
-
-  bool rgb_available = false;
-  rgb = cv::imread(rgb_file, 1);
-  depth = cv::imread(depth_file, -1);
-
-  if(rgb.type() != CV_32FC1)
-  {
-    if(rgb.type() == CV_8UC3)
-    {
-      cv::cvtColor(rgb, grey, CV_BGR2GRAY);
-      rgb_available = true;
-    }
-    else
-    {
-      grey = rgb;
-    }
-
-    grey.convertTo(grey_s16, CV_32F);
-  }
-  else
-  {
-    grey_s16 = rgb;
-  }
-
-  if(depth.type() != CV_32FC1)
-  {
-    dvo::core::SurfacePyramid::convertRawDepthImageSse(depth, depth_float, 1.0f / 5000.0f);
-  }
-  else
-  {
-    depth_float = depth;
-  }
-
-  //depth_float.setTo(dvo::core::InvalidDepth, depth_float > 1.2f);
-
-  dvo::core::RgbdImagePyramidPtr result = camera.create(grey_s16, depth_float);
-
-  if(rgb_available)
-    rgb.convertTo(result->level(0).rgb, CV_32FC3);
-
-  return result;
-}
+#include <dvo_benchmark/prefetching_loader.h>
 
 class BenchmarkNode
 {
@@ -110,6 +65,9 @@ public:
 
     bool KeepAlive;
 
+    // number of frames decoded ahead of the tracker
+    int PrefetchFrames;
+
     bool EstimateRequired();
     bool VisualizationRequired();
   };
@@ -236,6 +194,13 @@ bool BenchmarkNode::configure()
 
   nh_private_.param("show_estimate", cfg_.ShowEstimate, false);
   nh_private_.param("keep_alive", cfg_.KeepAlive, cfg_.VisualizationRequired());
+  nh_private_.param("prefetch_frames", cfg_.PrefetchFrames, 8);
+
+  if(cfg_.PrefetchFrames < 1)
+  {
+    std::cerr << "'prefetch_frames' has to be at least 1!" << std::endl;
+    return false;
+  }
 
   return true;
 }
@@ -393,7 +358,18 @@ void BenchmarkNode::run()
   //fr3
   //dvo::core::IntrinsicMatrix intrinsics = dvo::core::IntrinsicMatrix::create(535.4f, 539.2f, 320.1f, 247.6f);
 
-  dvo::core::RgbdCameraPyramid camera(640, 480, intrinsics);
+  std::string folder = cfg_.RgbdPairFile.substr(0, cfg_.RgbdPairFile.find_last_of("/") + 1);
+
+  // the image size is taken from the first frame
+  cv::Mat first = cv::imread(folder + rgbdpair_reader_->entry().RgbFile(), -1);
+
+  if(first.empty())
+  {
+    ROS_ERROR_STREAM("failed to read '" << folder + rgbdpair_reader_->entry().RgbFile() << "'!");
+    return;
+  }
+
+  dvo::core::RgbdCameraPyramid camera(first.cols, first.rows, intrinsics);
 
   // setup tracker configuration
   dvo_ros::CameraDenseTrackerConfig dynreconfg_cfg = dvo_ros::CameraDenseTrackerConfig::__getDefault__();
@@ -401,6 +377,7 @@ void BenchmarkNode::run()
 
   dvo::DenseTracker::Config cfg = dvo::DenseTracker::getDefaultConfig();
   dvo_ros::util::updateConfigFromDynamicReconfigure(dynreconfg_cfg, cfg);
+  cfg.fitLevels(first.cols, first.rows);
 
   dvo_slam::KeyframeSlamConfig dynreconfg_slam_cfg = dvo_slam::KeyframeSlamConfig::__getDefault__();
   dynreconfg_slam_cfg.__fromServer__(nh_private_);
@@ -412,6 +389,8 @@ void BenchmarkNode::run()
   // setup tracker
   //dvo::DenseTracker dense_tracker(intrinsics, cfg);
   camera.build(cfg.getNumLevels());
+  // the prefetched frames and the ones still used by the tracker
+  camera.setPoolSize(cfg_.PrefetchFrames + 4);
 
   dvo_slam::KeyframeTracker keyframe_tracker(graph_visualizer);
   keyframe_tracker.configureTracking(cfg);
@@ -440,18 +419,20 @@ void BenchmarkNode::run()
 
   keyframe_tracker.init(trajectory);
 
-  std::string folder = cfg_.RgbdPairFile.substr(0, cfg_.RgbdPairFile.find_last_of("/") + 1);
-
   std::vector<dvo_benchmark::RgbdPair> pairs;
   rgbdpair_reader_->readAllEntries(pairs);
 
   dvo::core::RgbdImagePyramid::Ptr current;
 
+  // decodes the images in the background, the rgb image is only needed for the point clouds of the visualizer
+  dvo_benchmark::PrefetchingLoader loader(camera, folder, pairs, cfg_.PrefetchFrames, 1.0f / 5000.0f, cfg_.VisualizationRequired(), cfg.getNumLevels());
+  dvo_benchmark::PrefetchingLoader::Frame frame;
+
   dvo::util::stopwatch sw_online("online", 1), sw_postprocess("postprocess", 1);
   sw_online.start();
-  for(std::vector<dvo_benchmark::RgbdPair>::iterator it = pairs.begin(); ros::ok() && it != pairs.end(); ++it)
+  while(ros::ok() && loader.next(frame))
   {
-    current = load(camera, folder + it->RgbFile(), folder + it->DepthFile());
+    current = frame.Image;
 
     // pause in the beginning
     renderWhileSwitchAndNotTerminated(visualizer, pause_switch);
@@ -461,7 +442,7 @@ void BenchmarkNode::run()
     {
       Eigen::Affine3d groundtruth_pose;
 
-      dvo_benchmark::findClosestEntry(*groundtruth_reader_, it->RgbTimestamp());
+      dvo_benchmark::findClosestEntry(*groundtruth_reader_, frame.Pair.RgbTimestamp());
       dvo_benchmark::toPoseEigen(groundtruth_reader_->entry(), groundtruth_pose);
 
       visualizer->trajectory("groundtruth")->
@@ -476,7 +457,7 @@ void BenchmarkNode::run()
 
     if(cfg_.EstimateRequired())
     {
-      if((pairs.end() - it) == 1)
+      if(frame.Last)
       {
         ROS_WARN("forcing keyframe");
         keyframe_tracker.forceKeyframe();
@@ -485,7 +466,7 @@ void BenchmarkNode::run()
       static dvo::util::stopwatch sw_match("match", 100);
       sw_match.start();
       {
-        keyframe_tracker.update(current, it->RgbTimestamp(), trajectory);
+        keyframe_tracker.update(current, frame.Pair.RgbTimestamp(), trajectory);
       }
       sw_match.stopAndPrint();
 
@@ -494,7 +475,7 @@ void BenchmarkNode::run()
         Eigen::Quaterniond q(trajectory.rotation());
 
         (*trajectory_out_)
-            << it->RgbTimestamp() << " "
+            << frame.Pair.RgbTimestamp() << " "
             << trajectory.translation()(0) << " "
             << trajectory.translation()(1) << " "
             << trajectory.translation()(2) << " "
@@ -0,0 +1,128 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Packs a TUM RGB-D sequence into a single sequence file, see dvo_benchmark/sequence_file.h:
+ *
+ *   convert_sequence [-rgb] [-s depth_scale] rgbd_pair_file output_file
+ *
+ * Color images are stored as 8 bit gray unless -rgb is given, depth images are stored as they are. The default depth
+ * scale is the one of the TUM datasets, 1 / 5000 metre per unit.
+ */
+
+#include <dvo_benchmark/file_reader.h>
+#include <dvo_benchmark/rgbd_pair.h>
+#include <dvo_benchmark/sequence_file.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <cstdlib>
+#include <cstring>
+
+static void usage(const char* name)
+{
+  std::cerr << "usage: " << name << " [-rgb] [-s depth_scale] rgbd_pair_file output_file" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  bool with_rgb = false;
+  float depth_scale = 1.0f / 5000.0f;
+  std::vector<std::string> files;
+
+  for(int idx = 1; idx < argc; ++idx)
+  {
+    if(std::strcmp(argv[idx], "-rgb") == 0)
+      with_rgb = true;
+    else if(std::strcmp(argv[idx], "-s") == 0 && idx + 1 < argc)
+      depth_scale = float(std::atof(argv[++idx]));
+    else if(argv[idx][0] != '-')
+      files.push_back(argv[idx]);
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if(files.size() != 2)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  dvo_benchmark::FileReader<dvo_benchmark::RgbdPair> reader(files[0]);
+  reader.skipComments();
+
+  if(!reader.next())
+  {
+    std::cerr << "Failed to open '" << files[0] << "'!" << std::endl;
+    return 1;
+  }
+
+  std::vector<dvo_benchmark::RgbdPair> pairs;
+  reader.readAllEntries(pairs);
+
+  const std::string folder = files[0].substr(0, files[0].find_last_of("/") + 1);
+
+  boost::shared_ptr<dvo_benchmark::SequenceWriter> writer;
+  size_t frames = 0;
+
+  for(std::vector<dvo_benchmark::RgbdPair>::iterator it = pairs.begin(); it != pairs.end(); ++it)
+  {
+    cv::Mat color = cv::imread(folder + it->RgbFile(), with_rgb ? 1 : 0);
+    cv::Mat depth = cv::imread(folder + it->DepthFile(), -1);
+
+    if(color.empty() || depth.type() != CV_16UC1)
+    {
+      std::cerr << "Failed to load '" << it->RgbFile() << "' and '" << it->DepthFile() << "', skipping!" << std::endl;
+      continue;
+    }
+
+    if(!writer)
+    {
+      writer.reset(new dvo_benchmark::SequenceWriter(files[1], color.cols, color.rows, color.type(), depth_scale));
+
+      if(!writer->good())
+      {
+        std::cerr << "Failed to open '" << files[1] << "'!" << std::endl;
+        return 1;
+      }
+    }
+
+    if(!writer->add(it->RgbTimestamp().toSec(), color, it->DepthTimestamp().toSec(), depth))
+    {
+      std::cerr << "Failed to add '" << it->RgbFile() << "' and '" << it->DepthFile() << "', the images have a different size or type!" << std::endl;
+      return 1;
+    }
+
+    frames++;
+  }
+
+  if(!writer || !writer->close())
+  {
+    std::cerr << "Failed to write '" << files[1] << "'!" << std::endl;
+    return 1;
+  }
+
+  std::cerr << "wrote " << frames << " frames to '" << files[1] << "'" << std::endl;
+
+  return 0;
+}
@@ -1,24 +1,69 @@
-
-
-#include <opencv2/opencv.hpp>
-
-#include <vector>
-#include <fstream>
-#include <ros/ros.h>
-
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * All-pairs tracking experiment, e.g. to calibrate the entropy ratio thresholds of the keyframe selection. Matches
+ * every frame of a sequence against every other one and compares the estimates to the groundtruth:
+ *
+ *   experiment [-j threads] [-o output_file] [-d max_frame_distance] [-s frame_step] [-l first_level last_level]
+ *              [-k fx fy ox oy] [-z depth_scale] dataset_folder
+ *
+ * The dataset folder contains assoc.txt and groundtruth.txt, frames without groundtruth are ignored. Every frame is
+ * decoded once into an image pyramid kept in memory, so -s and -d bound the memory and the number of pairs of long
+ * sequences. The pairs are distributed over a pool of trackers, one per thread, and every reference frame's results are
+ * appended to the output as soon as they are complete, one line per pair in no particular order:
+ *
+ *   reference current translation_dist translation_error rotation_error pose_entropy error_entropy constraint_ratio
+ *   log_likelihood frustum_metric
+ *
+ * The first two columns are indices into assoc.txt.
+ */
+
+#include <dvo/core/intrinsic_matrix.h>
 #include <dvo/core/rgbd_image.h>
-#include <dvo/core/surface_pyramid.h>
-#include <dvo/visualization/visualizer.h>
-#include <dvo/util/id_generator.h>
-
 #include <dvo/dense_tracking.h>
-#include <dvo/dense_tracking_impl.h>
+#include <dvo/visualization/visualizer.h>
 
 #include <dvo_benchmark/file_reader.h>
 #include <dvo_benchmark/rgbd_pair.h>
 #include <dvo_benchmark/groundtruth.h>
 #include <dvo_benchmark/tools.h>
 
+#include <opencv2/opencv.hpp>
+
+#include <boost/shared_ptr.hpp>
+#include <tbb/atomic.h>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/mutex.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_scheduler_init.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
 double calculateSampledFrustumMetric(const Eigen::Affine3d& pose, const dvo::core::IntrinsicMatrix& intrinsics)
 {
   Eigen::Matrix<double, 9, 2> pixels;
@@ -54,104 +99,232 @@ double calculateSampledFrustumMetric(const Eigen::Affine3d& pose, const dvo::cor
 
   sum /= points.cols();
 
-  //Eigen::Matrix<double, 4, 3 * 9> diff = transformed - points;
-  // diff.colwise().norm().sum()
-
   return sum;
 }
 
-
-dvo::core::RgbdImagePyramid::Ptr load(std::string rgb_file, std::string depth_file)
+struct FindNearestPosePredicate
 {
-  cv::Mat rgb, grey, grey_s16, depth, depth_inpainted, depth_mask, depth_mono, depth_float;
-
-  bool rgb_available = false;
-  rgb = cv::imread(rgb_file, 1);
-  depth = cv::imread(depth_file, -1);
-
-  if(rgb.type() != CV_32FC1)
+  FindNearestPosePredicate(const dvo_benchmark::RgbdPair& entry) :
+    entry_(entry)
   {
-    if(rgb.type() == CV_8UC3)
-    {
-      cv::cvtColor(rgb, grey, CV_BGR2GRAY);
-      rgb_available = true;
-    }
-    else
-    {
-      grey = rgb;
-    }
-
-    grey.convertTo(grey_s16, CV_32F);
   }
-  else
+
+  bool operator() (const dvo_benchmark::Groundtruth& left, const dvo_benchmark::Groundtruth& right) const
   {
-    grey_s16 = rgb;
+    return left.Timestamp() <= entry_.RgbTimestamp() && right.Timestamp() >= entry_.RgbTimestamp();
   }
+private:
+  const dvo_benchmark::RgbdPair& entry_;
+};
+
+struct Frame
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+  // index into assoc.txt
+  size_t Index;
+  Eigen::Affine3d Pose;
+  dvo::core::RgbdImagePyramidPtr Image;
+};
+typedef std::vector<Frame, Eigen::aligned_allocator<Frame> > FrameVector;
 
-  if(depth.type() != CV_32FC1)
+// decodes every frame once, in parallel
+class LoadFrames
+{
+public:
+  LoadFrames(dvo::core::RgbdCameraPyramid& camera, const std::string& folder, const std::vector<dvo_benchmark::RgbdPair>& pairs, float depth_scale, size_t num_levels, FrameVector& frames) :
+    camera_(camera),
+    folder_(folder),
+    pairs_(pairs),
+    depth_scale_(depth_scale),
+    num_levels_(num_levels),
+    frames_(frames)
   {
-    dvo::core::SurfacePyramid::convertRawDepthImageSse(depth, depth_float, 1.0f / 5000.0f);
   }
-  else
+
+  void operator()(const tbb::blocked_range<size_t>& r) const
   {
-    depth_float = depth;
-  }
+    for(size_t idx = r.begin(); idx != r.end(); ++idx)
+    {
+      Frame& frame = frames_[idx];
+      const dvo_benchmark::RgbdPair& pair = pairs_[frame.Index];
 
-  dvo::core::RgbdImagePyramid::Ptr result(new dvo::core::RgbdImagePyramid(grey_s16, depth_float));
+      cv::Mat color = cv::imread(folder_ + pair.RgbFile(), 1);
+      cv::Mat depth = cv::imread(folder_ + pair.DepthFile(), -1);
 
-  if(rgb_available)
-    rgb.convertTo(result->level(0).rgb, CV_32FC3);
+      if(color.empty() || depth.empty()) continue;
 
-  return result;
-}
+      frame.Image = camera_.create(color, depth, depth_scale_, false);
+      frame.Image->build(num_levels_);
+    }
+  }
+private:
+  dvo::core::RgbdCameraPyramid& camera_;
+  const std::string& folder_;
+  const std::vector<dvo_benchmark::RgbdPair>& pairs_;
+  float depth_scale_;
+  size_t num_levels_;
+  FrameVector& frames_;
+};
 
-struct FindNearestPosePredicate
+typedef tbb::enumerable_thread_specific<boost::shared_ptr<dvo::DenseTracker> > TrackerPool;
+
+// one task per reference frame, which is matched against all frames within the maximum distance
+class MatchAllPairs
 {
-  FindNearestPosePredicate(const dvo_benchmark::RgbdPair& entry) :
-    entry_(entry)
+public:
+  MatchAllPairs(const dvo::DenseTracker::Config& cfg, const dvo::core::IntrinsicMatrix& intrinsics, FrameVector& frames, size_t max_distance, TrackerPool& trackers, std::ostream& out, tbb::mutex& out_mutex, tbb::atomic<size_t>& finished) :
+    cfg_(cfg),
+    intrinsics_(intrinsics),
+    frames_(frames),
+    max_distance_(max_distance),
+    trackers_(trackers),
+    out_(out),
+    out_mutex_(out_mutex),
+    finished_(finished)
   {
   }
 
-  bool operator() (const dvo_benchmark::Groundtruth& left, const dvo_benchmark::Groundtruth& right) const
+  void operator()(const tbb::blocked_range<size_t>& r) const
   {
-    return left.Timestamp() <= entry_.RgbTimestamp() && right.Timestamp() >= entry_.RgbTimestamp();
+    boost::shared_ptr<dvo::DenseTracker>& tracker = trackers_.local();
+
+    if(!tracker) tracker.reset(new dvo::DenseTracker(cfg_));
+
+    for(size_t idx = r.begin(); idx != r.end(); ++idx)
+    {
+      std::ostringstream lines;
+
+      match(*tracker, idx, lines);
+
+      tbb::mutex::scoped_lock lock(out_mutex_);
+
+      out_ << lines.str();
+      out_.flush();
+
+      size_t done = ++finished_;
+
+      if(done % 10 == 0 || done == frames_.size()) std::cerr << "\r" << done << "/" << frames_.size() << " references" << std::flush;
+    }
   }
 private:
-  const dvo_benchmark::RgbdPair& entry_;
-};
+  const dvo::DenseTracker::Config& cfg_;
+  const dvo::core::IntrinsicMatrix& intrinsics_;
+  FrameVector& frames_;
+  size_t max_distance_;
+  TrackerPool& trackers_;
+  std::ostream& out_;
+  tbb::mutex& out_mutex_;
+  tbb::atomic<size_t>& finished_;
+
+  void match(dvo::DenseTracker& tracker, size_t reference_idx, std::ostream& lines) const
+  {
+    Frame& reference = frames_[reference_idx];
 
-// Jensen-Bregman LogDet Divergence
+    if(!reference.Image) return;
 
-template <typename Derived>
-double JenBreLogDetDiv(const Eigen::MatrixBase<Derived>& a, const Eigen::MatrixBase<Derived>& b)
+    const size_t first = max_distance_ > 0 && reference_idx > max_distance_ ? reference_idx - max_distance_ : 0;
+    const size_t last = max_distance_ > 0 ? std::min(reference_idx + max_distance_ + 1, frames_.size()) : frames_.size();
+
+    dvo::DenseTracker::Result result;
+
+    for(size_t idx = first; idx < last; ++idx)
+    {
+      Frame& current = frames_[idx];
+
+      if(idx == reference_idx || !current.Image) continue;
+
+      result.setIdentity();
+      tracker.match(*reference.Image, *current.Image, result);
+
+      const dvo::DenseTracker::LevelStats& level = result.Statistics.Levels.back();
+
+      if(level.Iterations.empty()) continue;
+
+      const dvo::DenseTracker::IterationStats& iteration = level.Iterations.back();
+
+      const Eigen::Affine3d relative_groundtruth = current.Pose.inverse() * reference.Pose;
+      const Eigen::Affine3d error = relative_groundtruth * result.Transformation;
+
+      lines
+        << reference.Index << " "
+        << current.Index << " "
+        << relative_groundtruth.translation().norm() << " "
+        << error.translation().norm() << " "
+        << Eigen::AngleAxisd(error.rotation()).angle() << " "
+        << std::log(result.Information.determinant()) << " "
+        << std::log(iteration.TDistributionPrecision.determinant()) << " "
+        << double(iteration.ValidConstraints) / double(level.ValidPixels) << " "
+        << result.LogLikelihood << " "
+        << calculateSampledFrustumMetric(result.Transformation, intrinsics_)
+        << std::endl;
+    }
+  }
+};
+
+static void usage(const char* name)
 {
-  return std::log(((a + b) / 2.0).determinant()) - 0.5 * std::log((a * b).determinant());
+  std::cerr << "usage: " << name << " [-j threads] [-o output_file] [-d max_frame_distance] [-s frame_step] [-l first_level last_level] [-k fx fy ox oy] [-z depth_scale] dataset_folder" << std::endl;
 }
 
 int main(int argc, char **argv)
 {
-  ros::init(argc, argv, "experiments", ros::init_options::AnonymousName);
+  int num_threads = tbb::task_scheduler_init::automatic;
+  size_t max_distance = 0, step = 1;
+  float fx = 525.0f, fy = 525.0f, ox = 320.0f, oy = 240.0f, depth_scale = 1.0f / 5000.0f;
+  std::string output_file = "experiment.txt", dataset;
+
+  dvo::DenseTracker::Config cfg = dvo::DenseTracker::getDefaultConfig();
+  cfg.UseWeighting = false;
+  cfg.UseInitialEstimate = true;
+  cfg.FirstLevel = 3;
+  cfg.LastLevel = 1;
+  cfg.MaxIterationsPerLevel = 100;
 
-  ros::NodeHandle nh("~");
+  for(int idx = 1; idx < argc; ++idx)
+  {
+    if(std::strcmp(argv[idx], "-j") == 0 && idx + 1 < argc)
+      num_threads = std::max(1, std::atoi(argv[++idx]));
+    else if(std::strcmp(argv[idx], "-o") == 0 && idx + 1 < argc)
+      output_file = argv[++idx];
+    else if(std::strcmp(argv[idx], "-d") == 0 && idx + 1 < argc)
+      max_distance = std::max(0, std::atoi(argv[++idx]));
+    else if(std::strcmp(argv[idx], "-s") == 0 && idx + 1 < argc)
+      step = std::max(1, std::atoi(argv[++idx]));
+    else if(std::strcmp(argv[idx], "-l") == 0 && idx + 2 < argc)
+    {
+      cfg.FirstLevel = std::atoi(argv[++idx]);
+      cfg.LastLevel = std::atoi(argv[++idx]);
+    }
+    else if(std::strcmp(argv[idx], "-k") == 0 && idx + 4 < argc)
+    {
+      fx = std::atof(argv[++idx]);
+      fy = std::atof(argv[++idx]);
+      ox = std::atof(argv[++idx]);
+      oy = std::atof(argv[++idx]);
+    }
+    else if(std::strcmp(argv[idx], "-z") == 0 && idx + 1 < argc)
+      depth_scale = std::atof(argv[++idx]);
+    else if(argv[idx][0] != '-' && dataset.empty())
+      dataset = argv[idx];
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
 
-  std::string dataset;
-  if(!nh.getParam("dataset", dataset))
+  if(dataset.empty() || !cfg.IsSane())
   {
-    std::cerr << "Missing 'dataset' parameter!" << std::endl;
-    return -1;
+    usage(argv[0]);
+    return 1;
   }
 
-  std::string assoc = dataset + "/assoc.txt";
-  std::string groundtruth = dataset + "/groundtruth.txt";
+  std::string folder = dataset + "/", assoc = folder + "assoc.txt", groundtruth = folder + "groundtruth.txt";
 
   std::vector<dvo_benchmark::RgbdPair> pairs;
   std::vector<dvo_benchmark::Groundtruth> poses;
 
-  dvo::visualization::Visualizer::instance()
-    .enabled(true)
-    .useExternalWaitKey(true)
-    .save(true);
-
   dvo_benchmark::FileReader<dvo_benchmark::RgbdPair> pair_reader(assoc);
   pair_reader.skipComments();
   pair_reader.readAllEntries(pairs);
@@ -160,230 +333,72 @@ int main(int argc, char **argv)
   groundtruth_reader.skipComments();
   groundtruth_reader.readAllEntries(poses);
 
-  dvo::core::RgbdImagePyramid::Ptr reference, current;
-  dvo::core::IntrinsicMatrix intrinsics = dvo::core::IntrinsicMatrix::create(525.0f, 525.0f, 320.0f, 240.0f);
+  FrameVector frames;
 
-  dvo::DenseTracker::Config cfg = dvo::DenseTracker::getDefaultConfig();
-  cfg.UseWeighting = false;
-  cfg.UseInitialEstimate = true;
-  cfg.FirstLevel = 3;
-  cfg.LastLevel = 1;
-  cfg.MaxIterationsPerLevel = 100;
-  dvo::DenseTracker tracker(intrinsics, cfg);
-
-  Eigen::Affine3d reference_pose, current_pose, relative_pose;
-  Eigen::Matrix<double, 6, 6> first_info, current_info;
-  Eigen::Matrix2d first_error_precision;
-  /*
-  for (std::vector<dvo_benchmark::RgbdPair>::iterator it = pairs.begin(); it != pairs.end() && ros::ok(); ++it)
+  for(size_t idx = 0; idx < pairs.size(); idx += step)
   {
-    reference = load(dataset + "/" + it->RgbFile(), dataset + "/" + it->DepthFile());
-
-    std::vector<dvo_benchmark::Groundtruth>::iterator nearest = std::adjacent_find(poses.begin(), poses.end(), FindNearestPosePredicate(*it));
+    std::vector<dvo_benchmark::Groundtruth>::iterator nearest = std::adjacent_find(poses.begin(), poses.end(), FindNearestPosePredicate(pairs[idx]));
 
     if(nearest == poses.end()) continue;
-    dvo_benchmark::toPoseEigen(*nearest, reference_pose);
-    relative_pose.setIdentity();
-    bool first = true;
 
-    for (std::vector<dvo_benchmark::RgbdPair>::iterator it_inner = pairs.begin(); it_inner != pairs.end() && ros::ok(); ++it_inner)
-    {
-      std::vector<dvo_benchmark::Groundtruth>::iterator nearest = std::adjacent_find(poses.begin(), poses.end(), FindNearestPosePredicate(*it_inner));
-
-      if(nearest == poses.end()) continue;
-      dvo_benchmark::toPoseEigen(*nearest, current_pose);
-
-      current = load(dataset + "/" + it_inner->RgbFile(), dataset + "/" + it_inner->DepthFile());
-
-      relative_pose = relative_pose.inverse();
+    Frame frame;
+    frame.Index = idx;
+    dvo_benchmark::toPoseEigen(*nearest, frame.Pose);
 
-      tracker.match(*reference, *current, relative_pose);
-
-<<<<<<< HEAD
-  for (std::vector<dvo_benchmark::RgbdPair>::iterator it = pairs.begin() + 49; it != pairs.begin() + 52 && ros::ok(); ++it)
-=======
-      double translation_dist = (current_pose.inverse() * reference_pose).translation().norm();
-      double translation_error = ((current_pose.inverse() * reference_pose) * relative_pose).translation().norm();
-      double error_entropy = std::log(tracker.itctx_.Precision.determinant());
+    frames.push_back(frame);
+  }
 
+  if(frames.empty())
+  {
+    std::cerr << "No frames with groundtruth in '" << dataset << "'!" << std::endl;
+    return 1;
+  }
 
-      std::cout << translation_dist << " " << translation_error << " " << error_entropy << std::endl;
-    }
-    std::cerr << (pairs.end() - it) << " ";
+  // the image size is taken from the first frame
+  cv::Mat first = cv::imread(folder + pairs[frames.front().Index].RgbFile(), -1);
 
-  }
-  */
-  /*
-  for (std::vector<dvo_benchmark::RgbdPair>::iterator it = pairs.begin(); it != pairs.end() && ros::ok(); ++it)
+  if(first.empty())
   {
-    reference = current;
-    current = load(dataset + "/" + it->RgbFile(), dataset + "/" + it->DepthFile());
+    std::cerr << "Failed to read '" << folder + pairs[frames.front().Index].RgbFile() << "'!" << std::endl;
+    return 1;
+  }
 
-    if(!reference) continue;
+  std::ofstream out(output_file.c_str());
 
-    relative_pose.setIdentity();
+  if(!out.good())
+  {
+    std::cerr << "Failed to open '" << output_file << "'!" << std::endl;
+    return 1;
+  }
 
-    tracker.match(*reference, *current, relative_pose);
+  dvo::visualization::Visualizer::instance()
+    .useExternalWaitKey(false)
+    .enabled(false)
+    .save(false)
+  ;
 
+  tbb::task_scheduler_init scheduler(num_threads);
 
-    std::cerr << tracker.itctx_.NumConstraints << " " << tracker.itctx_.Mean(0) << " " << tracker.itctx_.Mean(1) << " " << tracker.itctx_.Precision(0, 0) << " " << tracker.itctx_.Precision(1, 1) << std::endl;
-  }
-  */
+  dvo::core::IntrinsicMatrix intrinsics = dvo::core::IntrinsicMatrix::create(fx, fy, ox, oy);
 
-  for (std::vector<dvo_benchmark::RgbdPair>::iterator it = pairs.begin(); it != pairs.begin() +1 && ros::ok(); ++it)
->>>>>>> b03cf72f26093998d182440c467fe0e5ff327d1c
-  {
-    reference = load(dataset + "/" + it->RgbFile(), dataset + "/" + it->DepthFile());
+  dvo::core::RgbdCameraPyramid camera(first.cols, first.rows, intrinsics);
+  camera.build(cfg.getNumLevels());
 
-    std::vector<dvo_benchmark::Groundtruth>::iterator nearest = std::adjacent_find(poses.begin(), poses.end(), FindNearestPosePredicate(*it));
+  std::cerr << "loading " << frames.size() << " frames" << std::endl;
 
-    if(nearest == poses.end()) continue;
-    dvo_benchmark::toPoseEigen(*nearest, reference_pose);
-    relative_pose.setIdentity();
-    bool first = true;
-    int k = 0;
-<<<<<<< HEAD
-
-    for (std::vector<dvo_benchmark::RgbdPair>::iterator it_inner = pairs.begin(); it_inner != pairs.end() && ros::ok(); ++it_inner, ++k)
-=======
-    for (std::vector<dvo_benchmark::RgbdPair>::iterator it_inner = it + 1; it_inner != pairs.end() && ros::ok(); ++it_inner, ++k)
->>>>>>> b03cf72f26093998d182440c467fe0e5ff327d1c
-    {
-      std::vector<dvo_benchmark::Groundtruth>::iterator nearest = std::adjacent_find(poses.begin(), poses.end(), FindNearestPosePredicate(*it_inner));
-
-      if(nearest == poses.end()) continue;
-      dvo_benchmark::toPoseEigen(*nearest, current_pose);
-
-      current = load(dataset + "/" + it_inner->RgbFile(), dataset + "/" + it_inner->DepthFile());
-
-      relative_pose.setIdentity();
-      tracker.match(*reference, *current, relative_pose);
-
-      if(first)
-      {
-        tracker.getInformationEstimate(first_info);
-        first_error_precision = tracker.itctx_.Precision;
-        first = false;
-      }
-      tracker.getInformationEstimate(current_info);
-
-      double pose_entropy = std::log(current_info.determinant());
-      double loglikelihood = tracker.itctx_.Error;
-      double err_i = tracker.itctx_.Mean(0);
-      double err_z = tracker.itctx_.Mean(1);
-      double translation_error = ((current_pose.inverse() * reference_pose) * relative_pose).translation().norm();
-      double translation_dist = (current_pose.inverse() * reference_pose).translation().norm();
-
-      std::cout
-          << k << " "
-          << pose_entropy << " "
-          //<< loglikelihood << " "
-          //<< err_i << " "
-          //<< err_z << " "
-          << translation_error << " "
-          << translation_dist << " "
-          << std::endl;
-    }
-    std::cerr << (pairs.begin() + 52 - it) << " ";
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, frames.size()), LoadFrames(camera, folder, pairs, depth_scale, cfg.getNumLevels(), frames));
 
-  }
+  out << "# reference current translation_dist translation_error rotation_error pose_entropy error_entropy constraint_ratio log_likelihood frustum_metric" << std::endl;
 
-    /*
-    for (std::vector<dvo_benchmark::RgbdPair>::iterator it_inner = it + 1; it_inner != it + 100 && ros::ok(); ++it_inner, ++k)
-    {
-      std::vector<dvo_benchmark::Groundtruth>::iterator nearest = std::adjacent_find(poses.begin(), poses.end(), FindNearestPosePredicate(*it_inner));
-
-      if(nearest == poses.end()) continue;
-      dvo_benchmark::toPoseEigen(*nearest, current_pose);
-
-      current = load(dataset + "/" + it_inner->RgbFile(), dataset + "/" + it_inner->DepthFile());
-
-      cv::Scalar cur_avg_depth = cv::mean(current->level(0).depth, current->level(0).depth == current->level(0).depth);
-
-      Eigen::Affine3d a1;
-      a1.setIdentity();
-
-      Eigen::Matrix<double, 6, 6> fisher;
-
-      tracker.match(*last, *current, a1);
-      tracker.getInformationEstimate(fisher);
-
-      current_se3 = Sophus::SE3(a1.rotation(), a1.translation());
-      accumulated_odom = accumulated_odom * a1;
-      accumulated_se3 = Sophus::SE3(accumulated_odom.rotation(), accumulated_odom.translation());
-
-      propagated_cov = current_se3.Adj() * propagated_cov * current_se3.Adj().transpose() + fisher.inverse();
-
-      relative_pose = relative_pose.inverse();
-      tracker.match(*reference, *current, relative_pose);
-
-      if(first)
-      {
-        tracker.getInformationEstimate(first_info);
-        first_error_precision = tracker.itctx_.Precision;
-        first = false;
-      }
-      tracker.getInformationEstimate(current_info);
-      keyframe_cov = current_info.inverse();
-
-      current_se3 = Sophus::SE3(relative_pose.rotation(), relative_pose.translation());
-
-      Eigen::Matrix<double, 6, 1> diff = current_se3.log() - accumulated_se3.log();
-
-      double kl_divergence = 0.5 * ((keyframe_cov.inverse() * propagated_cov).trace() + diff.transpose() * keyframe_cov * diff - 2 - std::log(propagated_cov.determinant() / keyframe_cov.determinant()));
-      double constraints = tracker.itctx_.NumConstraints;
-      double pose_entropy = std::log(current_info.determinant());
-      double pose_normalized_entropy = std::log((current_info / constraints).determinant());
-      double error_entropy = std::log(tracker.itctx_.Precision.determinant());
-
-<<<<<<< HEAD
-      double translation_dist = relative_pose.translation().norm();
-      double true_translation_dist = (current_pose.inverse() * reference_pose).translation().norm();
-      double translation_error = ((current_pose.inverse() * reference_pose) * relative_pose).translation().norm();
-
-
-      std::cout
-          << ref_avg_depth(0) << " "
-          << cur_avg_depth(0) << " "
-          << translation_dist << " "
-          << translation_error << " "
-          << constraints << " "
-          << pose_entropy << " "
-          << pose_normalized_entropy << " "
-          << error_entropy << " "
-          << true_translation_dist << " "
-          << kl_divergence << " "
-          << std::endl;
-
-      last = current;
-=======
-      //double param_entropy_ratio = std::log(current_info.determinant()) / std::log(first_info.determinant());
-      double error_entropy_ratio = std::log(tracker.itctx_.Precision.determinant());// / std::log(first_error_precision.determinant());
-      //double param_divergence = JenBreLogDetDiv(first_info, current_info);
-      //double error_divergence = JenBreLogDetDiv(first_error_precision, tracker.itctx_.Precision);
-      double translation_dist = (current_pose.inverse() * reference_pose).translation().norm();
-      double translation_error = ((current_pose.inverse() * reference_pose) * relative_pose).translation().norm();
-      double frustum_metric = calculateSampledFrustumMetric(relative_pose, intrinsics);
-      //std::cerr << (current_pose.inverse() * reference_pose).matrix() << std::endl << std::endl;
-      //std::cerr << relative_pose.matrix() << std::endl << std::endl;
-      //std::cerr << ((current_pose.inverse() * reference_pose) * relative_pose).matrix() << std::endl << std::endl;
-      //
-      //std::string tmp;
-      //std::cin >> tmp;
-
-      //std::cout << k << " " << translation_dist << " " << translation_error << " " << param_entropy_ratio << " " << param_divergence << " " << error_entropy_ratio << " " << error_divergence << std::endl;
-      std::cout << k << " " << translation_dist << " " << translation_error << " " << error_entropy_ratio << " " << tracker.itctx_.Mean(0) << " " << tracker.itctx_.Mean(1) << " " << frustum_metric << std::endl;
->>>>>>> b03cf72f26093998d182440c467fe0e5ff327d1c
-    }
-    std::cerr << (pairs.end() - 100 - it) << " ";
+  TrackerPool trackers;
+  tbb::mutex out_mutex;
+  tbb::atomic<size_t> finished;
+  finished = 0;
 
-  }
-<<<<<<< HEAD
-  */
-=======
+  // a reference per task, they take about the same time
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, frames.size(), 1), MatchAllPairs(cfg, intrinsics, frames, max_distance, trackers, out, out_mutex, finished));
 
->>>>>>> b03cf72f26093998d182440c467fe0e5ff327d1c
   std::cerr << std::endl;
-  //while(true)
-  //  cv::waitKey(10);
+
+  return out.good() ? 0 : 1;
 }
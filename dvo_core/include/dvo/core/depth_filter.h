@@ -0,0 +1,79 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DEPTH_FILTER_H_
+#define DEPTH_FILTER_H_
+
+#include <stdint.h>
+
+#include <opencv2/core/core.hpp>
+
+namespace dvo
+{
+namespace core
+{
+
+/**
+ * Preprocessing of the depth images of a sensor, removes the measurements which would only become invalid or
+ * outlier points in the pyramid. All stages are disabled by default.
+ */
+struct DepthFilterConfig
+{
+  // depths outside of the range become invalid, 0 disables the limit
+  float MinDepth, MaxDepth;
+
+  // a pixel with a 4-neighbour further than MaxDepthJump * depth away is a flying pixel at a depth edge and becomes
+  // invalid, 0 disables
+  float MaxDepthJump;
+
+  // separable bilateral filter, a radius of 0 disables it. the depth sigma is the noise at 1m, it grows with the
+  // squared depth like the one of structured light sensors
+  int BilateralRadius;
+  float BilateralSigmaSpace;
+  float BilateralSigmaDepth;
+
+  // the bilateral filter fills invalid pixels if at least half of the window is valid and agrees on the depth
+  bool FillHoles;
+
+  DepthFilterConfig();
+
+  bool enabled() const;
+
+  // whether the filter needs more than a per pixel pass, i.e., DepthFilter::apply() after the conversion
+  bool requiresNeighbourhood() const;
+};
+
+class DepthFilter
+{
+public:
+  /**
+   * Filters the metric float depth in place, buffer is scratch space and is reused if it has the right size. The
+   * range limit is usually applied by the conversion of the raw depth already, see convertRawRow(), then only the
+   * stages requiring the neighbourhood of a pixel are left.
+   */
+  static void apply(const DepthFilterConfig& cfg, cv::Mat& depth, cv::Mat& buffer);
+
+  // converts a row of raw 16 bit depth to metres, 0 and depths outside of the range of the config become invalid
+  static void convertRawRow(const DepthFilterConfig& cfg, const uint16_t* raw, float* depth, int cols, float scale);
+};
+
+} /* namespace core */
+} /* namespace dvo */
+#endif /* DEPTH_FILTER_H_ */
@@ -80,18 +80,44 @@ public:
   Matrix6x6 A;
   Vector6 b;
 
+  // double sums of the float blocks, only valid after finish() if blockSize() > 0
+  Matrix6d A_sum;
+  Vector6d b_sum;
+
   double error;
   size_t maxnum_constraints, num_constraints;
 
+  NormalEquationsLeastSquares();
   virtual ~NormalEquationsLeastSquares();
 
+  // constraints accumulated in float before they are added to A_sum and b_sum, which bounds the rounding error by the
+  // block size instead of the number of constraints. 0 accumulates everything in float. kept by initialize()
+  void blockSize(size_t block_size);
+  size_t blockSize() const;
+
   virtual void initialize(const size_t maxnum_constraints);
   virtual void update(const Vector6& J, const NumType& res, const NumType& weight = 1.0f);
   virtual void update(const Eigen::Matrix<NumType, 2, 6>& J, const Eigen::Matrix<NumType, 2, 1>& res, const Eigen::Matrix<NumType, 2, 2>& weight);
   virtual void finish();
   virtual void solve(Vector6& x);
 
+  // inlined update() for loops specialized at compile time, Blocked has to be blockSize() > 0
+  template<bool Blocked>
+  void accumulate(const Eigen::Matrix<NumType, 2, 6>& J, const Eigen::Matrix<NumType, 2, 1>& res, const Eigen::Matrix<NumType, 2, 2>& weight)
+  {
+    A_opt.rankUpdate(J, weight);
+    b -= J.transpose() * weight * res;
+
+    num_constraints += 1;
+
+    if(Blocked && ++block_constraints_ >= block_size_) flush();
+  }
+
   void combine(const NormalEquationsLeastSquares& other);
+private:
+  size_t block_size_, block_constraints_;
+
+  void flush();
 };
 
 /**
@@ -132,6 +158,47 @@ private:
   cv::Mat1b mask_;
 };
 
+/**
+ * Precomputed normal equations for the 2d intensity and depth constraints of the inverse compositional DenseTracker.
+ *
+ * The jacobians are computed on the reference image, so the hessian of all constraints is accumulated once. Every
+ * iteration starts from this hessian and only removes the constraints without a valid residual. The robust weights only
+ * enter b, the hessian is scaled by their mean in finish().
+ */
+class PrecomputedNormalEquationsLeastSquares2d
+{
+public:
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+  Matrix6x6 A;
+  Vector6 b;
+
+  double error;
+
+  size_t maxnum_constraints, num_constraints;
+
+  virtual ~PrecomputedNormalEquationsLeastSquares2d();
+
+  virtual void initialize(const size_t maxnum_constraints);
+  // add a jacobian to the cache
+  virtual void addConstraint(const size_t& idx, const Matrix2x6& J);
+
+  // resets internal state created for one iteration, A is set to the hessian of all constraints
+  virtual void reset(const Eigen::Matrix<NumType, 2, 2>& precision);
+
+  virtual void ignoreConstraint(const size_t& idx);
+  virtual void setResidualForConstraint(const size_t& idx, const Eigen::Matrix<NumType, 2, 1>& res, const NumType& weight = 1.0f);
+  virtual void finish();
+  virtual void solve(Vector6& x);
+private:
+  // sum of J.row(i).transpose() * J.row(j)
+  Matrix6x6 hessian_ii_, hessian_id_, hessian_dd_;
+  Eigen::Matrix<NumType, 2, 2> precision_;
+  Eigen::Matrix<NumType, 2, Eigen::Dynamic, Eigen::ColMajor> jacobian_cache_;
+
+  double weight_sum_;
+};
+
 /**
  * Same as NormalEquationsLeastSquares, but solves normal equations with EigenValueDecomposition.
  */
@@ -143,6 +210,67 @@ public:
   virtual void solve(Vector6& x);
 };
 
+/**
+ * Solves A * x = b for a symmetric positive definite A with a Cholesky decomposition of fixed size, which the compiler
+ * unrolls completely. Returns false without changing x if a pivot is smaller than epsilon times the largest diagonal
+ * element, e.g., because the constraints don't determine all degrees of freedom.
+ */
+inline bool solveCholesky6x6(const Matrix6d& A, const Vector6d& b, Vector6d& x, const double epsilon = 1e-12)
+{
+  double L[6][6], y[6];
+
+  const double min_pivot = epsilon * A.diagonal().maxCoeff();
+
+  for(int j = 0; j < 6; ++j)
+  {
+    double d = A(j, j);
+
+    for(int k = 0; k < j; ++k) d -= L[j][k] * L[j][k];
+
+    if(!(d > min_pivot)) return false;
+
+    L[j][j] = std::sqrt(d);
+
+    const double inv = 1.0 / L[j][j];
+
+    for(int i = j + 1; i < 6; ++i)
+    {
+      double s = A(i, j);
+
+      for(int k = 0; k < j; ++k) s -= L[i][k] * L[j][k];
+
+      L[i][j] = s * inv;
+    }
+  }
+
+  // forward and back substitution
+  for(int i = 0; i < 6; ++i)
+  {
+    double s = b(i);
+
+    for(int k = 0; k < i; ++k) s -= L[i][k] * y[k];
+
+    y[i] = s / L[i][i];
+  }
+
+  for(int i = 5; i >= 0; --i)
+  {
+    double s = y[i];
+
+    for(int k = i + 1; k < 6; ++k) s -= L[k][i] * x(k);
+
+    x(i) = s / L[i][i];
+  }
+
+  return true;
+}
+
+/**
+ * Minimum norm solution from the eigen value decomposition of the symmetric A, directions with an eigen value smaller
+ * than rcond times the largest one are left out. Returns the number of left out directions.
+ */
+int solveDegenerate6x6(const Matrix6d& A, const Vector6d& b, Vector6d& x, const double rcond = 1e-6);
+
 class SvdLeastSquares : public LeastSquaresInterface
 {
 public:
@@ -23,6 +23,13 @@
 
 #include <dvo/core/intrinsic_matrix.h>
 #include <dvo/core/rgbd_image.h>
+#include <dvo/core/point_soa.h>
+#include <dvo/core/least_squares.h>
+
+#include <deque>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <tbb/mutex.h>
 
 namespace dvo
 {
@@ -66,6 +73,12 @@ public:
   }
 };
 
+/**
+ * Selects and caches the points of every pyramid level.
+ *
+ * The select methods can be called concurrently, e.g., by several trackers using the same keyframe as reference.
+ * setRgbdImagePyramid, recycle and debug must not be called while other threads use the selection.
+ */
 class PointSelection
 {
 public:
@@ -78,16 +91,46 @@ public:
 
   dvo::core::RgbdImagePyramid& getRgbdImagePyramid();
 
+  // keeps the cached points if the pyramid still holds the images they were selected from, see RgbdImagePyramid::revision
   void setRgbdImagePyramid(dvo::core::RgbdImagePyramid& pyramid);
 
+  // drops the cached points, e.g., after the thresholds of the predicate changed. the memory is kept
+  void invalidate();
+
   size_t getMaximumNumberOfPoints(const size_t& level);
 
+  // upper bound of the points selected per level, 0 selects all points accepted by the predicate. if more points pass
+  // the predicate, the ones with the largest intensity gradients are kept, evenly distributed over a grid
+  void maxPointsPerLevel(size_t max_points);
+  size_t maxPointsPerLevel() const;
+
+  // sorts the selected points of every level along a Morton (Z-order) curve of their pixels instead of raster order,
+  // so consecutive points are interpolated from nearby texels of the current image also under rotation
+  void mortonOrder(bool v);
+  bool mortonOrder() const;
+
   void select(const size_t& level, const dvo::core::IntrinsicMatrix& intrinsics, PointIterator& first_point, PointIterator& last_point);
 
+  // same points as above, but in structure of arrays layout, built once per level from the AoS selection
+  void select(const size_t& level, const dvo::core::IntrinsicMatrix& intrinsics, const PointWithIntensityAndDepthSoa*& points);
+
+  // reference side jacobians of the selected points for inverse compositional tracking, built once per level
+  void select(const size_t& level, const dvo::core::IntrinsicMatrix& intrinsics, PrecomputedNormalEquationsLeastSquares2d*& jacobians);
+
+  /**
+   * Points of other views in the frame of the pyramid, e.g., of frames tracked against it, which the select methods
+   * return after the selected points of the level. They replace the previous additional points of the level and are
+   * dropped together with the selection, e.g., by invalidate(). Unlike select, must not be called concurrently.
+   */
+  void setAdditionalPoints(const size_t& level, const PointVector& points);
+
   void recycle(dvo::core::RgbdImagePyramid& pyramid);
 
   bool getDebugIndex(const size_t& level, cv::Mat& dbg_idx);
 
+  // bytes of the cached points, jacobians and scratch space of all levels, thread-safe
+  size_t memoryUsage() const;
+
   void debug(bool v)
   {
     debug_ = v;
@@ -106,19 +149,50 @@ private:
     PointIterator points_end;
     bool is_cached;
 
+    // points selected from the image, the additional points follow them
+    size_t num_selected;
+
+    PointWithIntensityAndDepthSoa soa_points;
+    bool is_soa_cached;
+
+    boost::shared_ptr<PrecomputedNormalEquationsLeastSquares2d> jacobians;
+    bool is_jacobian_cached;
+
     cv::Mat debug_idx;
 
+    // scratch space of the bucketed selection
+    std::vector<float> scores;
+    std::vector<int> pixels, cells, candidates, cell_offsets, cell_cursor, selected;
+
+    // morton code and index of the selected points, see sortMorton
+    std::vector<uint64_t> order;
+
     Storage();
     void allocate(size_t max_points);
+    size_t memoryUsage() const;
   };
 
   dvo::core::RgbdImagePyramid *pyramid_;
-  std::vector<Storage> storage_;
+  uint64_t revision_;
+  // a deque doesn't move existing levels when new ones are added
+  std::deque<Storage> storage_;
+  mutable tbb::mutex cache_mutex_;
   const PointSelectionPredicate& predicate_;
+  size_t max_points_;
+  bool morton_order_;
 
   bool debug_;
 
+  // builds the point cache of a level if necessary, cache_mutex_ has to be locked
+  Storage& selectStorage(const size_t& level);
+
   PointIterator selectPointsFromImage(const dvo::core::RgbdImage& img, const PointIterator& first_point, const PointIterator& last_point, cv::Mat& debug_idx);
+
+  // like selectPointsFromImage, but keeps at most max_points_ of the accepted points
+  PointIterator selectBucketedPointsFromImage(const dvo::core::RgbdImage& img, Storage& storage);
+
+  // reorders the selected points of a level by the morton code of their pixels
+  void sortMorton(const dvo::core::RgbdImage& img, Storage& storage);
 };
 
 } /* namespace core */
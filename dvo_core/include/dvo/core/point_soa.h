@@ -0,0 +1,107 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef POINT_SOA_H_
+#define POINT_SOA_H_
+
+#include <dvo/core/rgbd_image.h>
+
+namespace dvo
+{
+namespace core
+{
+
+/**
+ * Structure of arrays version of PointWithIntensityAndDepth::VectorType.
+ *
+ * Every channel is a separate 16 byte aligned float array, so kernels can load 4 consecutive points with one instruction
+ * and don't waste bandwidth on the padding of the AoS layout. The arrays are padded to a multiple of Alignment floats,
+ * the padding of the X, Y and Z channels is NaN, so vectorized kernels can process the padding and reject it with the
+ * usual NaN / bounds checks.
+ */
+class PointWithIntensityAndDepthSoa
+{
+public:
+  enum Channel
+  {
+    X = 0,
+    Y,
+    Z,
+    Intensity,
+    Depth,
+    IntensityDx,
+    IntensityDy,
+    DepthDx,
+    DepthDy,
+    NumChannels
+  };
+
+  static const size_t Alignment = 8;
+
+  PointWithIntensityAndDepthSoa();
+  ~PointWithIntensityAndDepthSoa();
+
+  // number of points
+  size_t size() const
+  {
+    return size_;
+  }
+
+  // number of points rounded up to a multiple of Alignment
+  size_t paddedSize() const
+  {
+    return (size_ + Alignment - 1) / Alignment * Alignment;
+  }
+
+  size_t capacity() const
+  {
+    return stride_;
+  }
+
+  // keeps the content if the capacity is sufficient
+  void reserve(size_t num_points);
+
+  // sets size, reserves memory if necessary and resets the padding
+  void resize(size_t num_points);
+
+  float* channel(Channel c)
+  {
+    return &data_[c * stride_];
+  }
+
+  const float* channel(Channel c) const
+  {
+    return &data_[c * stride_];
+  }
+
+  // copies the AoS points into this container
+  void assign(const PointWithIntensityAndDepth::VectorType::const_iterator& first_point, const PointWithIntensityAndDepth::VectorType::const_iterator& last_point);
+private:
+  typedef std::vector<float, Eigen::aligned_allocator<float> > FloatVector;
+
+  size_t size_, stride_;
+  FloatVector data_;
+
+  void pad();
+};
+
+} /* namespace core */
+} /* namespace dvo */
+#endif /* POINT_SOA_H_ */
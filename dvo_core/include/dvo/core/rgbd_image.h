@@ -21,12 +21,16 @@
 #ifndef RGBDIMAGE_H_
 #define RGBDIMAGE_H_
 
+#include <stdint.h>
+
 #include <opencv2/opencv.hpp>
 #include <Eigen/Geometry>
 #include <Eigen/StdVector>
 #include <boost/smart_ptr.hpp>
+#include <tbb/mutex.h>
 
 #include <dvo/core/datatypes.h>
+#include <dvo/core/depth_filter.h>
 #include <dvo/core/intrinsic_matrix.h>
 
 namespace dvo
@@ -52,6 +56,7 @@ struct EIGEN_ALIGN16 PointWithIntensityAndDepth
     float data[8];
     struct
     {
+      // time_interpolation is the row / height of a selected point, see RollingShutterTransforms
       float i, z, idx, idy, zdx, zdy, time_interpolation;
     };
   } IntensityAndDepth;
@@ -111,9 +116,31 @@ public:
   RgbdImagePtr create(const cv::Mat& intensity, const cv::Mat& depth) const;
   RgbdImagePtr create() const;
 
+  // one point per pixel in raster order, written with streaming stores
   void buildPointCloud(const cv::Mat &depth, PointCloud& pointcloud) const;
+
+  // point of the pixel with the given raster index, same as the column of buildPointCloud. allows computing the
+  // points of selected pixels only, without building the whole cloud
+  void buildPoint(size_t idx, float depth, float* point) const
+  {
+    const float* ray = pointcloud_template_.col(idx).data();
+
+    point[0] = ray[0] * depth;
+    point[1] = ray[1] * depth;
+    point[2] = depth;
+    point[3] = 1.0f;
+  }
+
+  // the points are ray * depth with w = 1, columns in raster order
+  const PointCloud& rays() const;
+
+  // static mask of the camera, e.g., of the robot body or the sensor mount. 8 bit, pixels which are 0 are never
+  // used for tracking, empty if all pixels are used. see RgbdCameraPyramid::setMask
+  const cv::Mat& mask() const;
+  void mask(const cv::Mat& mask);
 private:
   size_t width_, height_;
+  cv::Mat mask_;
 
   bool hasSameSize(const cv::Mat& img) const;
 
@@ -132,15 +159,47 @@ public:
 
   ~RgbdCameraPyramid();
 
+  /**
+   * Returns a pyramid for the given images. If pooling is enabled an image pyramid which is no longer referenced
+   * outside of the pool is reset and returned, so its buffers are reused instead of allocating new ones. Thread-safe.
+   */
   RgbdImagePyramidPtr create(const cv::Mat& base_intensity, const cv::Mat& base_depth);
 
+  /**
+   * Like create(), but converts the sensor images directly into the base level buffers of the pyramid,
+   * see RgbdImagePyramid::ingest().
+   */
+  RgbdImagePyramidPtr create(const cv::Mat& color, const cv::Mat& raw_depth, float depth_scale, bool with_rgb);
+
+  // maximum number of image pyramids kept for reuse by create(), 0 (the default) disables pooling
+  void setPoolSize(size_t size);
+
   void build(size_t levels);
 
+  // static mask of the base level, the coarser levels mask every pixel covering a masked one. an empty mask uses all
+  // pixels. must not be called while images of the pyramid are being built
+  void setMask(const cv::Mat& mask);
+
+  // preprocessing of the raw depth converted by create(color, raw_depth, ...), disabled by default. must not be
+  // called while images are being created
+  void setDepthFilter(const DepthFilterConfig& cfg);
+
+  const DepthFilterConfig& depthFilter() const;
+
   const RgbdCamera& level(size_t level);
 
   const RgbdCamera& level(size_t level) const;
 private:
   std::vector<RgbdCameraPtr> levels_;
+  DepthFilterConfig depth_filter_;
+
+  size_t pool_size_;
+  std::vector<RgbdImagePyramidPtr> pool_;
+  tbb::mutex pool_mutex_;
+
+  // pool_mutex_ has to be held
+  RgbdImagePyramidPtr findRecyclable();
+  void addToPool(const RgbdImagePyramidPtr& pyramid);
 };
 
 typedef boost::shared_ptr<RgbdCameraPyramid> RgbdCameraPyramidPtr;
@@ -170,11 +229,19 @@ public:
 
   cv::Mat rgb;
 
+  // per frame mask, e.g., of people segmented in the image. 8 bit, pixels which are 0 are not used for tracking, like
+  // the ones masked by RgbdCamera::mask. see RgbdImagePyramid::setMask
+  cv::Mat mask;
+
   PointCloud pointcloud;
 
   typedef cv::Vec<float, 8> Vec8f;
   cv::Mat_<Vec8f> acceleration;
 
+  // the acceleration structure in half precision, see buildCompactAccelerationStructure
+  typedef cv::Vec<uint16_t, 8> Vec8h;
+  cv::Mat_<Vec8h> acceleration_half;
+
   size_t width, height;
   double timestamp;
 
@@ -184,18 +251,52 @@ public:
 
   void initialize();
 
+  /**
+   * Prepares the image for reuse. Buffers shared with other cv::Mat headers are released, the remaining ones are
+   * overwritten by the next computation. rgb, normals and the timestamp are always cleared.
+   */
+  void recycle();
+
+  // frees all buffers, only the size and the timestamp are kept. needs new images and initialize() to be used again
+  void release();
+
+  // frees the derivatives, normals, point cloud and acceleration structure, they are rebuilt on demand
+  void releaseDerived();
+
+  // bytes of all image buffers and the point cloud. buffers shared with other cv::Mat headers, e.g., the sensor images
+  // or another level, are counted as well
+  size_t memoryUsage() const;
+
   void calculateDerivatives();
   bool calculateIntensityDerivatives();
   void calculateDepthDerivatives();
 
   void calculateNormals();
 
+  // thread-safe, does nothing if the point cloud is already built
   void buildPointCloud();
 
   //void buildPointCloud(const IntrinsicMatrix& intrinsics);
 
+  /**
+   * Interleaves intensity, depth and their derivatives in one Vec8f per pixel. The derivatives are computed directly
+   * into the interleaved layout, intensity_dx etc. are not touched. Thread-safe, only builds it on the first call.
+   * Pixels masked by mask or RgbdCamera::mask get an invalid depth, so the point selection never picks them and the
+   * residual kernels drop every interpolation touching them, without any extra cost per point.
+   */
   void buildAccelerationStructure();
 
+  /**
+   * Half precision copy of the acceleration structure, which the AVX residual kernels convert with F16C while
+   * interpolating, see DenseTracker::Config::UseCompactStorage. Thread-safe, the float version is only built
+   * temporarily if it doesn't exist yet. Returns false if the cpu can't convert half precision values.
+   */
+  bool buildCompactAccelerationStructure();
+
+  // replaces the float acceleration structure with the half precision one, halving its footprint. it is rebuilt on
+  // demand. no other thread may use the image meanwhile
+  bool compactAccelerationStructure();
+
   // inverse warping
   // transformation is the transformation from reference to this image
   void warpIntensity(const AffineTransform& transformation, const PointCloud& reference_pointcloud, const IntrinsicMatrix& intrinsics, RgbdImage& result, PointCloud& transformed_pointcloud);
@@ -212,9 +313,29 @@ public:
 
   void warpDepthForwardAdvanced(const AffineTransform& transformation, const IntrinsicMatrix& intrinsics, RgbdImage& result);
 
+  /**
+   * Forward warps intensity and depth together in float precision, e.g., to render synthetic views. A z-buffer keeps
+   * the point closest to the camera per target pixel, the transformed depth of which is stored. Pixels without a point
+   * get intensity 0 and invalid depth. The z-buffer is resolved in parallel bands of target rows.
+   */
+  void warpForwardSse(const AffineTransform& transformation, const IntrinsicMatrix& intrinsics, RgbdImage& result);
+
   bool inImage(const float& x, const float& y) const;
 private:
-  bool intensity_requires_calculation_, depth_requires_calculation_, pointcloud_requires_build_;
+  bool intensity_requires_calculation_, depth_requires_calculation_, pointcloud_requires_build_, acceleration_requires_build_, acceleration_half_requires_build_;
+
+  // guards the lazy point cloud and acceleration structure builds, several trackers can use the same image. a copy of
+  // the image gets its own mutex
+  struct BuildMutex
+  {
+    tbb::mutex mutex;
+
+    BuildMutex() {}
+    BuildMutex(const BuildMutex&) {}
+    BuildMutex& operator=(const BuildMutex&) { return *this; }
+  };
+
+  BuildMutex build_mutex_;
 
   const RgbdCamera& camera_;
 
@@ -229,6 +350,17 @@ private:
 
   void calculateDerivativeYSseFloat(const cv::Mat& img, cv::Mat& result);
 
+  // dispatches to the widest kernel and applies the masks, build_mutex_ has to be held
+  void buildAccelerationStructureImpl();
+
+  void buildAccelerationStructureSse();
+
+  // 8 pixels per iteration, only called if the cpu supports AVX, see rgbd_image_avx.cpp
+  void buildAccelerationStructureAvx();
+
+  // converts the given float acceleration structure into acceleration_half, see rgbd_image_avx.cpp
+  void convertAccelerationStructureF16c(const cv::Mat_<Vec8f>& in);
+
   enum WarpIntensityOptions
   {
     WithPointCloud,
@@ -246,6 +378,9 @@ public:
 
   RgbdImagePyramid(const RgbdCameraPyramid& camera, const cv::Mat& intensity, const cv::Mat& depth);
 
+  // empty base level, has to be filled with ingest()
+  RgbdImagePyramid(const RgbdCameraPyramid& camera);
+
   virtual ~RgbdImagePyramid();
 
   // deprecated
@@ -253,12 +388,51 @@ public:
 
   void build(const size_t num_levels);
 
+  // starts over with new base images, the buffers of all levels are kept and reused by the next build()
+  void reset(const cv::Mat& intensity, const cv::Mat& depth);
+
+  /**
+   * Starts over with sensor images. 8 bit bgr or mono color is converted to float intensity and 16 bit raw depth to
+   * metres (raw * depth_scale, 0 becomes invalid) in a single pass, writing into the existing base level buffers.
+   * Float intensity and depth images are used without copying, unless the depth filter of the camera is enabled. The
+   * float rgb image is only created if with_rgb is set.
+   */
+  void ingest(const cv::Mat& color, const cv::Mat& raw_depth, float depth_scale, bool with_rgb);
+
+  /**
+   * Per frame mask of the base level, e.g., from a segmentation of moving people. 8 bit, pixels which are 0 are not
+   * used for tracking. build() derives the masks of the coarser levels. Has to be set after reset() or ingest() and
+   * before build(), which drop and use it respectively.
+   */
+  void setMask(const cv::Mat& mask);
+
+  /**
+   * Frees the buffers of the num_levels finest levels, e.g., of rarely used keyframes. The coarser levels stay usable,
+   * the released ones only after the next reset() or ingest().
+   */
+  void release(const size_t num_levels);
+
   RgbdImage& level(size_t idx);
 
+  // bytes of all levels, including released ones that still hold buffers, and the depth filter scratch space
+  size_t memoryUsage() const;
+
   double timestamp() const;
+
+  // changes with every reset() and ingest(), so data derived from the images, e.g., a PointSelection, can tell whether
+  // a pooled pyramid still holds the images it was computed from
+  uint64_t revision() const;
 private:
   const RgbdCameraPyramid& camera_;
   std::vector<RgbdImagePtr> levels_;
+
+  // number of valid levels, levels_ can contain more images after a reset()
+  size_t num_levels_;
+
+  uint64_t revision_;
+
+  // scratch space of the depth filter
+  cv::Mat depth_buffer_;
 };
 
 } /* namespace core */
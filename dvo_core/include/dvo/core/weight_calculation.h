@@ -131,6 +131,10 @@ class InfluenceFunction
 public:
   virtual ~InfluenceFunction() {};
   virtual float value(const float& x) const = 0;
+
+  // weights of n errors, non-finite errors get weight 0. the implementations below evaluate 4 errors per SSE operation
+  virtual void values(const float* x, float* weights, const size_t n) const;
+
   virtual void configure(const float& param) {};
 };
 
@@ -140,6 +144,7 @@ public:
   UnitInfluenceFunction() {};
   virtual ~UnitInfluenceFunction() {};
   virtual inline float value(const float& x) const { return 1.0f; };
+  virtual void values(const float* x, float* weights, const size_t n) const;
 };
 
 /**
@@ -154,6 +159,7 @@ public:
   TukeyInfluenceFunction(const float b = DEFAULT_B);
   virtual ~TukeyInfluenceFunction() {};
   virtual inline float value(const float& x) const;
+  virtual void values(const float* x, float* weights, const size_t n) const;
   virtual void configure(const float& param);
 
   static const float DEFAULT_B;
@@ -167,6 +173,7 @@ public:
   TDistributionInfluenceFunction(const float dof = DEFAULT_DOF);
   virtual ~TDistributionInfluenceFunction() {};
   virtual inline float value(const float& x) const;
+  virtual void values(const float* x, float* weights, const size_t n) const;
   virtual void configure(const float& param);
 
   static const float DEFAULT_DOF;
@@ -181,6 +188,7 @@ public:
   HuberInfluenceFunction(const float k = DEFAULT_K);
   virtual ~HuberInfluenceFunction() {};
   virtual inline float value(const float& x) const;
+  virtual void values(const float* x, float* weights, const size_t n) const;
   virtual void configure(const float& param);
 
   static const float DEFAULT_K;
@@ -213,10 +221,12 @@ public:
 
   float calculateWeight(const float error) const;
 
+  // errors and weights are continuous
   void calculateWeights(const cv::Mat& errors, cv::Mat& weights);
 
   FI_ATTRIBUTE(WeightCalculation, float, scale);
 private:
+  cv::Mat scaled_errors_;
 };
 
 } /* namespace core */
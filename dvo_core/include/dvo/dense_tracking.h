@@ -35,6 +35,10 @@
 
 namespace dvo
 {
+namespace core
+{
+class GpuNormalEquations;
+} /* namespace core */
 
 class DenseTracker
 {
@@ -49,20 +53,95 @@ public:
     bool UseInitialEstimate;
     bool UseWeighting;
 
+    // distribute residual and normal equation computation with tbb
     bool UseParallel;
+    // minimum number of points processed by one task
+    int ParallelGrainSize;
+
+    // use the structure of arrays point layout in the residual, weight and jacobian computation
+    bool UseSoaLayout;
+
+    // compute residuals, weights and normal equations in one pass, weights and normal equations use the scale of the previous iteration
+    // takes precedence over UseSoaLayout
+    bool UseFusedKernel;
+
+    // run the fused kernel on a CUDA device, if the library is built with DVO_WITH_CUDA and there is one, otherwise
+    // UseFusedKernel applies
+    bool UseGpu;
+
+    // inverse compositional updates with jacobians precomputed once per level of the reference PointSelection
+    // takes precedence over UseFusedKernel and UseSoaLayout
+    bool UseInverseCompositional;
+
+    // sum the normal equations in double over blocks of float constraints and solve them with an unrolled Cholesky
+    // decomposition, degenerate systems fall back to an eigen value decomposition
+    bool UseMixedPrecisionSolver;
+
+    // record the stats of every level and iteration in Result::Statistics, otherwise it only contains the last level with
+    // the iteration the result was computed from, and match doesn't allocate memory if the Result is reused
+    bool UseFullStatistics;
+
+    // wall-clock budget of one match call in seconds, 0 disables it. finer levels are skipped and iterations are capped
+    // if a running estimate of the time per iteration says they don't fit anymore, at least one level is processed
+    double MaxMatchTime;
+
+    // skip levels above LastLevel which kept converging in their first iteration, and LastLevel itself while it kept
+    // barely correcting the estimate of a well constrained level above. skipped levels are matched again now and then,
+    // LastLevel also as soon as the entropy of the level above drops. only applies to the single problem match
+    bool UseAdaptiveLevels;
+
+    // interpolate the current image from a half precision acceleration structure, which halves its footprint and the
+    // memory traffic of the residual kernel. only the AVX kernels with F16C read it, so it only applies to the plain
+    // residual computation, not to the SoA, fused, GPU or inverse compositional variants
+    bool UseCompactStorage;
+
+    // time in seconds a rolling shutter camera takes to read out all rows, 0 for global shutter cameras. otherwise every
+    // point is warped with the motion between the capture times of its rows, see RollingShutterTransforms. needs the
+    // image timestamps and replaces the SoA, fused, GPU and inverse compositional variants by a scalar residual kernel
+    double RollingShutterReadoutTime;
 
     dvo::core::InfluenceFunctions::enum_t InfluenceFuntionType;
     float InfluenceFunctionParam;
 
+    // MAD estimates the scale of every iteration in one pass from a histogram of its residuals, see
+    // computeScaleHistogramSse, instead of the t-distribution scale of the previous iteration. the residuals are then
+    // weighted with the Huber function if it is the influence function, otherwise with the t-distribution. it replaces
+    // the SoA, fused and GPU variants
     dvo::core::ScaleEstimators::enum_t ScaleEstimatorType;
     float ScaleEstimatorParam;
 
     float IntensityDerivativeThreshold;
     float DepthDerivativeThreshold;
 
+    // points selected per level of the reference image, 0 selects all points passing the derivative thresholds,
+    // see PointSelection::maxPointsPerLevel
+    int MaxPointsPerLevel;
+
+    // sorts the selected points along a Morton curve of their pixels, so the residual kernels read the current image in
+    // a cache friendly order also under rotation, see PointSelection::mortonOrder
+    bool UseMortonOrder;
+
+    // number of residuals the scale and log likelihood are estimated from once the t-distribution weights are known,
+    // 0 uses all residuals. only the AoS kernels sample, see computeScaleSampled for the error bound
+    int ScaleSampleSize;
+
+    // the first iteration on a level weights the residuals with the t-distribution scale the level converged to in the
+    // previous match of this tracker, instead of starting unweighted. consecutive frames have nearly the same residual
+    // statistics, so this usually saves an iteration per level
+    bool UseWarmStartedScale;
+
+    // choose the levels by their pixel counts instead, so other resolutions than VGA cost about the same, see
+    // fitLevels(). 0 keeps LastLevel and FirstLevel respectively
+    int FinestLevelMaxPixels, CoarsestLevelMinPixels;
+
     Config();
     size_t getNumLevels() const;
 
+    // LastLevel becomes the finest level of a camera of the given size with at most FinestLevelMaxPixels pixels,
+    // FirstLevel the coarsest one with at least CoarsestLevelMinPixels. the levels are halved like RgbdCameraPyramid
+    // does, i.e., odd sizes are rounded down
+    void fitLevels(size_t width, size_t height);
+
     bool UseEstimateSmoothing() const;
 
     bool IsSane() const;
@@ -75,6 +154,7 @@ public:
       IterationsExceeded,
       IncrementTooSmall,
       LogLikelihoodDecreased,
+      DeadlineReached,
       NumCriteria
     };
   };
@@ -122,6 +202,7 @@ public:
     bool isNaN() const;
     void setIdentity();
   };
+  typedef std::vector<Result, Eigen::aligned_allocator<Result> > ResultVector;
 
   static const Config& getDefaultConfig();
 
@@ -137,12 +218,48 @@ public:
 
   void configure(const Config& cfg);
 
+  /**
+   * Allocates the buffers for references with up to max_points points on Config::LastLevel and for num_problems
+   * problems, so matches within these limits don't allocate. The buffers only grow.
+   */
+  void reserve(size_t max_points, size_t num_problems = 1);
+
+  // bytes of the buffers reused by every match, including the selection of pyramid references
+  size_t memoryUsage() const;
+
   bool match(dvo::core::RgbdImagePyramid& reference, dvo::core::RgbdImagePyramid& current, dvo::core::AffineTransformd& transformation);
   bool match(dvo::core::PointSelection& reference, dvo::core::RgbdImagePyramid& current, dvo::core::AffineTransformd& transformation);
 
   bool match(dvo::core::RgbdImagePyramid& reference, dvo::core::RgbdImagePyramid& current, dvo::DenseTracker::Result& result);
   bool match(dvo::core::PointSelection& reference, dvo::core::RgbdImagePyramid& current, dvo::DenseTracker::Result& result);
 
+  /**
+   * Starts on the given level instead of Config::FirstLevel, e.g. if the initial guess is good enough to skip the
+   * coarse levels. The level is clamped to Config::FirstLevel and Config::LastLevel.
+   */
+  bool match(dvo::core::PointSelection& reference, dvo::core::RgbdImagePyramid& current, dvo::DenseTracker::Result& result, int first_level);
+
+  /**
+   * Matches every reference against the same current image, results[i] holds the initial guess for references[i] and
+   * receives its estimate. A reference may be given several times to try several initial guesses.
+   *
+   * All problems advance one pyramid level at a time, so every level of the current image is traversed by all
+   * references back to back while it is still in cache. Each problem gets its own Config::MaxMatchTime budget.
+   */
+  bool matchMany(const std::vector<dvo::core::PointSelection*>& references, dvo::core::RgbdImagePyramid& current, ResultVector& results);
+
+  typedef std::vector<dvo::core::AffineTransformd, Eigen::aligned_allocator<dvo::core::AffineTransformd> > TransformVector;
+
+  /**
+   * Tracks every initial guess on Config::FirstLevel only and continues on the finer levels with the best one. The
+   * guesses are used regardless of Config::UseInitialEstimate. Returns the index of the chosen guess.
+   *
+   * Guesses are scored by the negative log likelihood per valid constraint, the lowest wins. Guesses with less than
+   * half the valid constraints of the best supported one are ignored, as a guess moving the points out of the image is
+   * cheap to explain.
+   */
+  size_t matchHypotheses(dvo::core::PointSelection& reference, dvo::core::RgbdImagePyramid& current, const TransformVector& guesses, dvo::DenseTracker::Result& result);
+
   static inline void computeJacobianOfProjectionAndTransformation(const dvo::core::Vector4& p, dvo::core::Matrix2x6& jacobian);
 
   static inline void compute3rdRowOfJacobianOfTransformation(const dvo::core::Vector4& p, dvo::core::Vector6& j);
@@ -150,6 +267,9 @@ public:
   typedef std::vector<Eigen::Vector2f, Eigen::aligned_allocator<Eigen::Vector2f> > ResidualVectorType;
   typedef std::vector<float> WeightVectorType;
 private:
+  // estimate of one match carried from one pyramid level to the next
+  struct MatchState;
+
   struct IterationContext
   {
     const Config& cfg;
@@ -188,11 +308,131 @@ private:
   dvo::core::ValidPointAndGradientThresholdPredicate selection_predicate_;
 
   dvo::core::PointWithIntensityAndDepth::VectorType points, points_error;
+  dvo::core::PointWithIntensityAndDepthSoa points_error_soa;
 
   ResidualVectorType residuals;
   WeightVectorType weights;
+
+  /**
+   * Normal equations of the first n valid residuals. The loops over the residuals are specialized at compile time for
+   * their layout, the weighting, the float block accumulation and the parallelization, and selected in configure(), so
+   * they don't branch on the configuration.
+   */
+  typedef void (*NormalEquationsKernel)(const dvo::core::PointWithIntensityAndDepth::VectorType::iterator& first_point_error, const dvo::core::PointWithIntensityAndDepthSoa* soa_points_error, const WeightVectorType::iterator& first_weight, const Eigen::Matrix2f& precision, size_t n, size_t grain_size, dvo::core::NormalEquationsLeastSquares& ls);
+
+  // by [SoA layout][weighted], the first iteration on a level is unweighted
+  NormalEquationsKernel normal_equations_kernels_[2][2];
+
+  // buffers reused by every call to match, they only grow
+  struct Scratch
+  {
+    // replace Result::Statistics if Config::UseFullStatistics is false, one per problem of matchMany
+    std::vector<LevelStats> level_stats;
+
+    std::vector<uint8_t> valid_residuals;
+    std::vector<size_t> chunk_valid;
+  };
+
+  Scratch scratch_;
+
+  // only set if Config::UseGpu is true and there is a device
+  boost::shared_ptr<dvo::core::GpuNormalEquations> gpu_;
+
+  // running mean of the seconds per iteration on every level, used by the deadline
+  std::vector<double> iteration_time_;
+
+  // expected seconds per iteration on the given level, 0 if we don't know yet
+  double expectedIterationTime(int level) const;
+  void updateIterationTime(int level, double seconds);
+
+  // convergence history of one level, see Config::UseAdaptiveLevels
+  struct LevelSchedule
+  {
+    // consecutive matches converging in the first iteration, on LastLevel with a negligible correction
+    int streak;
+
+    // matches skipping the level since it was matched last
+    int skipped;
+  };
+
+  std::vector<LevelSchedule> level_schedule_;
+
+  // t-distribution scale of every level at the end of the last match, see Config::UseWarmStartedScale
+  struct LevelScale
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Eigen::Vector2f mean;
+    Eigen::Matrix2f precision;
+    bool valid;
+  };
+
+  std::vector<LevelScale, Eigen::aligned_allocator<LevelScale> > level_scale_;
+
+  void resetLevelScale();
+
+  // LastLevel is skipped, the level above is the last one
+  bool skip_last_level_;
+
+  // entropy of the level above LastLevel when LastLevel was dropped, and its valid constraints in the last match
+  double reference_entropy_;
+  size_t last_level_above_constraints_;
+
+  void resetLevelSchedule();
+
+  // bit mask of the levels the next match skips
+  uint32_t scheduleLevels(int first_level);
+
+  // counts the skip, returns false every few matches to refresh the history of the level
+  bool skipScheduledLevel(LevelSchedule& schedule);
+
+  // correction is the norm of the change of the estimate by matching the level
+  void updateLevelSchedule(int level, const LevelStats& level_stats, int iterations, double correction);
+
+  void beginMatch(dvo::DenseTracker::Result& result, LevelStats& level_stats, int first_level, MatchState& state);
+
+  // runs the iterations on the given level, returns false if the finer levels have to be skipped
+  bool matchLevel(int level, dvo::core::PointSelection& reference, dvo::core::RgbdImagePyramid& current, dvo::DenseTracker::Result& result, MatchState& state);
+
+  bool finishMatch(dvo::DenseTracker::Result& result, MatchState& state);
+
+  // the iteration whose estimate is kept by the match so far
+  const IterationStats& lastIteration(const dvo::DenseTracker::Result& result, const MatchState& state) const;
+
+  void reserveLevelStats(size_t num_problems);
 };
 
+// jacobian computation
+inline void DenseTracker::computeJacobianOfProjectionAndTransformation(const dvo::core::Vector4& p, dvo::core::Matrix2x6& j)
+{
+  dvo::core::NumType z = 1.0f / p(2);
+  dvo::core::NumType z_sqr = 1.0f / (p(2) * p(2));
+
+  j(0, 0) =  z;
+  j(0, 1) =  0.0f;
+  j(0, 2) = -p(0) * z_sqr;
+  j(0, 3) = j(0, 2) * p(1);//j(0, 3) = -p(0) * p(1) * z_sqr;
+  j(0, 4) = 1.0f - j(0, 2) * p(0);//j(0, 4) =  (1.0 + p(0) * p(0) * z_sqr);
+  j(0, 5) = -p(1) * z;
+
+  j(1, 0) =  0.0f;
+  j(1, 1) =  z;
+  j(1, 2) = -p(1) * z_sqr;
+  j(1, 3) = -1.0f + j(1, 2) * p(1); //j(1, 3) = -(1.0 + p(1) * p(1) * z_sqr);
+  j(1, 4) = -j(0, 3); //j(1, 4) =  p(0) * p(1) * z_sqr;
+  j(1, 5) =  p(0) * z;
+}
+
+inline void DenseTracker::compute3rdRowOfJacobianOfTransformation(const dvo::core::Vector4& p, dvo::core::Vector6& j)
+{
+  j(0) = 0.0;
+  j(1) = 0.0;
+  j(2) = 1.0;
+  j(3) = p(1);
+  j(4) = -p(0);
+  j(5) = 0.0;
+}
+
 } /* namespace dvo */
 
 template<typename CharT, typename Traits>
@@ -206,12 +446,30 @@ std::ostream& operator<< (std::basic_ostream<CharT, Traits> &out, const dvo::Den
   << ", Mu = " << config.Mu
   << ", Use Initial Estimate = " << (config.UseInitialEstimate ? "true" : "false")
   << ", Use Weighting = " << (config.UseWeighting ? "true" : "false")
+  << ", Use Parallel = " << (config.UseParallel ? "true" : "false")
+  << ", Parallel Grain Size = " << config.ParallelGrainSize
+  << ", Use SoA Layout = " << (config.UseSoaLayout ? "true" : "false")
+  << ", Use Fused Kernel = " << (config.UseFusedKernel ? "true" : "false")
+  << ", Use GPU = " << (config.UseGpu ? "true" : "false")
+  << ", Use Inverse Compositional = " << (config.UseInverseCompositional ? "true" : "false")
+  << ", Use Mixed Precision Solver = " << (config.UseMixedPrecisionSolver ? "true" : "false")
+  << ", Use Full Statistics = " << (config.UseFullStatistics ? "true" : "false")
+  << ", Max Match Time = " << config.MaxMatchTime
+  << ", Use Adaptive Levels = " << (config.UseAdaptiveLevels ? "true" : "false")
+  << ", Use Compact Storage = " << (config.UseCompactStorage ? "true" : "false")
+  << ", Rolling Shutter Readout Time = " << config.RollingShutterReadoutTime
   << ", Scale Estimator = " << dvo::core::ScaleEstimators::str(config.ScaleEstimatorType)
   << ", Scale Estimator Param = " << config.ScaleEstimatorParam
   << ", Influence Function = " << dvo::core::InfluenceFunctions::str(config.InfluenceFuntionType)
   << ", Influence Function Param = " << config.InfluenceFunctionParam
   << ", Intensity Derivative Threshold = " << config.IntensityDerivativeThreshold
   << ", Depth Derivative Threshold = " << config.DepthDerivativeThreshold
+  << ", Max Points per Level = " << config.MaxPointsPerLevel
+  << ", Use Morton Order = " << (config.UseMortonOrder ? "true" : "false")
+  << ", Scale Sample Size = " << config.ScaleSampleSize
+  << ", Use Warm Started Scale = " << (config.UseWarmStartedScale ? "true" : "false")
+  << ", Finest Level Max Pixels = " << config.FinestLevelMaxPixels
+  << ", Coarsest Level Min Pixels = " << config.CoarsestLevelMinPixels
   ;
 
   return out;
@@ -22,6 +22,11 @@
 #define DENSE_TRACKING_IMPL_H_
 
 #include <dvo/dense_tracking.h>
+#include <dvo/dense_tracking_kernels.h>
+#include <dvo/core/point_soa.h>
+
+#include <algorithm>
+#include <cmath>
 
 namespace dvo
 {
@@ -45,6 +50,48 @@ struct ComputeResidualsResult
   ValidFlagIterator last_valid_flag;
 };
 
+/**
+ * Name of the residual kernel selected at startup from the CPU features ("sse", "avx2", "avx512").
+ * Can be overridden with the DVO_SIMD environment variable.
+ */
+const char* getResidualKernelName();
+
+// whether the selected residual kernel can read RgbdImage::acceleration_half
+bool hasCompactResidualKernel();
+
+/**
+ * Rolling shutter model of computeResidualsRollingShutter. Both images are read out row by row during the readout
+ * time, so a point seen in reference row y and current row v moved for dt + (v - y) / height * readout instead of the
+ * dt between the image timestamps. With constant velocity its transform is T(s) = exp(s * log(T)) with
+ * s = 1 + (v - y) / height * readout / dt. K * T(s) is precomputed for Buckets values of (v - y) / height, every point
+ * is projected once with T to find v and once more with the matrix of its bucket, independent of the number of rows.
+ */
+struct RollingShutterTransforms
+{
+  static const int Buckets = 33;
+
+  typedef Eigen::Matrix<float, 3, 4, Eigen::RowMajor | Eigen::DontAlign> Matrix34;
+
+  Matrix34 KT;
+  Matrix34 BucketKT[Buckets];
+
+  // transform from the reference to the current image, dt = current - reference timestamp in seconds
+  void update(const IntrinsicMatrix& intrinsics, const Eigen::Affine3d& transform, double dt, double readout_time);
+
+  // bucket of the projected row v of a point selected from the reference row fraction y / height, see
+  // PointWithIntensityAndDepth::IntensityAndDepth::time_interpolation
+  const Matrix34& select(float v, float height, float reference_row) const
+  {
+    const int half = Buckets / 2;
+    const int b = half + int(std::floor((v / height - reference_row) * half + 0.5f));
+
+    return BucketKT[std::max(0, std::min(Buckets - 1, b))];
+  }
+};
+
+// reference points have to be selected by PointSelection, which stores their row in time_interpolation
+void computeResidualsRollingShutter(const PointIterator& first_point, const PointIterator& last_point, const RgbdImage& current, const RollingShutterTransforms& transforms, const Vector8f& reference_weight, const Vector8f& current_weight, ComputeResidualsResult& result);
+
 void computeResiduals(const PointIterator& first_point, const PointIterator& last_point, const RgbdImage& current, const IntrinsicMatrix& intrinsics, const Eigen::Affine3f transform, const Vector8f& reference_weight, const Vector8f& current_weight, ComputeResidualsResult& result);
 
 void computeResidualsSse(const PointIterator& first_point, const PointIterator& last_point, const RgbdImage& current, const IntrinsicMatrix& intrinsics, const Eigen::Affine3f transform, const Vector8f& reference_weight, const Vector8f& current_weight, ComputeResidualsResult& result);
@@ -60,9 +107,92 @@ float computeWeightedErrorSse(const ResidualIterator& first_residual, const Resi
 Eigen::Matrix2f computeScale(const ResidualIterator& first_residual, const ResidualIterator& last_residual, const WeightIterator& first_weight, const Eigen::Vector2f& mean);
 Eigen::Matrix2f computeScaleSse(const ResidualIterator& first_residual, const ResidualIterator& last_residual, const WeightIterator& first_weight, const Eigen::Vector2f& mean);
 
+/**
+ * computeScale and computeCompleteDataLogLikelihood on samples residuals drawn uniformly with replacement, the same
+ * seed draws the same residuals. The weights have to be computed with the t-distribution of the previous precision, so
+ * every weighted scatter term satisfies w * d^T * precision * d < 5 + 2. by Hoeffding's inequality the sampled mean of
+ * these terms is then within 7 * sqrt(ln(2 / delta) / (2 * samples)) of the mean over all residuals with probability
+ * 1 - delta, e.g., 8% of its expected value 2 for 8192 samples and delta = 0.001.
+ */
+Eigen::Matrix2f computeScaleSampled(const ResidualIterator& first_residual, const ResidualIterator& last_residual, const WeightIterator& first_weight, const Eigen::Vector2f& mean, const size_t samples, const uint32_t seed);
+float computeCompleteDataLogLikelihoodSampled(const ResidualIterator& first_residual, const ResidualIterator& last_residual, const Eigen::Matrix2f& precision, const size_t samples, const uint32_t seed);
+
+/**
+ * Robust scale in a single pass, without weights from a previous estimate: the absolute intensity and depth residuals
+ * are counted in a histogram with 16 logarithmic bins per octave, the bin is taken from the exponent and mantissa bits
+ * of 4 floats at a time. Returns the diagonal covariance of the median absolute deviations around 0, each scaled by
+ * 1.4826, the median is interpolated inside its bin, which is 4.4% wide.
+ */
+Eigen::Matrix2f computeScaleHistogramSse(const ResidualIterator& first_residual, const ResidualIterator& last_residual);
+
+// Huber weights min(1, k / d) of the mahalanobis distances d, returns the log likelihood like
+// computeCompleteDataLogLikelihood, with the Huber loss instead of the t-distribution one
+float computeWeightsAndLogLikelihoodHuberSse(const ResidualIterator& first_residual, const ResidualIterator& last_residual, const WeightIterator& first_weight, const Eigen::Matrix2f& precision, const float k);
+
 void computeWeights(const ResidualIterator& first_residual, const ResidualIterator& last_residual, const WeightIterator& first_weight, const Eigen::Vector2f& mean, const Eigen::Matrix2f& precision);
 void computeWeightsSse(const ResidualIterator& first_residual, const ResidualIterator& last_residual, const WeightIterator& first_weight, const Eigen::Vector2f& mean, const Eigen::Matrix2f& precision);
 
+// structure of arrays variants, the residuals are stored in the Intensity and Depth channels of points_error
+size_t computeResidualsSoaSse(const PointWithIntensityAndDepthSoa& points, const RgbdImage& current, const IntrinsicMatrix& intrinsics, const Eigen::Affine3f transform, const Vector8f& reference_weight, const Vector8f& current_weight, PointWithIntensityAndDepthSoa& points_error);
+
+float computeCompleteDataLogLikelihoodSoa(const PointWithIntensityAndDepthSoa& points_error, const WeightIterator& first_weight, const Eigen::Vector2f& mean, const Eigen::Matrix2f& precision);
+
+Eigen::Matrix2f computeScaleSoaSse(const PointWithIntensityAndDepthSoa& points_error, const WeightIterator& first_weight, const Eigen::Vector2f& mean);
+
+void computeWeightsSoaSse(const PointWithIntensityAndDepthSoa& points_error, const WeightIterator& first_weight, const Eigen::Vector2f& mean, const Eigen::Matrix2f& precision);
+
+struct ComputeNormalEquationsResult
+{
+  size_t ValidConstraints;
+
+  // sum of weight * (r - mean) * (r - mean)^T, divide by (ValidConstraints - 3) to get the scale
+  Eigen::Matrix2f WeightedScatter;
+
+  // sum of log(1 + 0.2 * r^T * precision * r)
+  double LogLikelihoodErrorSum;
+};
+
+/**
+ * Single pass over the reference points: projects, interpolates, weights and adds each point to the normal equations
+ * without storing any intermediate results. Weights, normal equations and log likelihood are computed with the given
+ * mean and precision, which usually come from the previous iteration. ls has to be initialized by the caller.
+ */
+void computeResidualsAndNormalEquationsSse(const PointIterator& first_point, const PointIterator& last_point, const RgbdImage& current, const IntrinsicMatrix& intrinsics, const Eigen::Affine3f transform, const Vector8f& reference_weight, const Vector8f& current_weight, const Eigen::Vector2f& mean, const Eigen::Matrix2f& precision, NormalEquationsLeastSquares& ls, ComputeNormalEquationsResult& result);
+
+namespace gpu
+{
+struct DeviceLevel;
+} /* namespace gpu */
+
+/**
+ * Runs computeResidualsAndNormalEquationsSse on a CUDA device, see dense_tracking_impl_cuda.cu. The reference points
+ * and the acceleration structure of the current image are uploaded once per level, afterwards every iteration only
+ * copies the 21 + 6 unique values of the normal equations and the scatter and log likelihood sums back.
+ *
+ * Without DVO_WITH_CUDA available() is false and every upload fails.
+ */
+class GpuNormalEquations
+{
+public:
+  // built with CUDA and there is a device
+  static bool available();
+
+  GpuNormalEquations();
+  ~GpuNormalEquations();
+
+  bool upload(const PointIterator& first_point, const PointIterator& last_point, const RgbdImage& current);
+
+  // arguments like computeResidualsAndNormalEquationsSse, sets ls.A and ls.b, and ls.A_sum and ls.b_sum in double,
+  // ls.finish() mustn't be called afterwards
+  bool compute(const IntrinsicMatrix& intrinsics, const Eigen::Affine3f& transform, const Vector8f& reference_weight, const Vector8f& current_weight, const Eigen::Vector2f& mean, const Eigen::Matrix2f& precision, NormalEquationsLeastSquares& ls, ComputeNormalEquationsResult& result);
+private:
+  GpuNormalEquations(const GpuNormalEquations&);
+  GpuNormalEquations& operator=(const GpuNormalEquations&);
+
+  gpu::DeviceLevel* level_;
+  float upper_bound_u_, upper_bound_v_;
+};
+
 void computeMeanScaleAndWeights(const ResidualIterator& first_residual, const ResidualIterator& last_residual, const WeightIterator& first_weight, Eigen::Vector2f& mean, Eigen::Matrix2f& precision);
 
 } /* namespace core */
@@ -0,0 +1,71 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DENSE_TRACKING_KERNELS_H_
+#define DENSE_TRACKING_KERNELS_H_
+
+// interface of the wide residual kernels, which live in translation units compiled with -mavx2 / -mavx512f. only
+// plain data in here, nothing built with these flags may instantiate inline or template code of the rest of the
+// library, the linker could pick the AVX version and break the CPUs the runtime dispatch protects
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace dvo
+{
+namespace core
+{
+
+// same layout as PointWithIntensityAndDepth, checked in dense_tracking_impl.cpp
+struct __attribute__((aligned(16))) ResidualKernelPoint
+{
+  float point[4];
+  float intensity_and_depth[8];
+};
+
+struct ResidualKernelArgs
+{
+  const ResidualKernelPoint* first_point;
+  const ResidualKernelPoint* last_point;
+
+  ResidualKernelPoint* first_point_error;
+  float* first_residual;
+
+  // exactly one of them is set, the half precision one if the current image only has the compact version
+  const float* acceleration;
+  const uint16_t* acceleration_half;
+  int acceleration_stride; // in channels
+
+  float upper_bound_u, upper_bound_v;
+
+  float kt[12]; // K * T, row major 3x4
+  float reference_weight[8];
+  float current_weight[8];
+};
+
+// return the number of valid residuals written
+typedef size_t (*ComputeResidualsKernel)(const ResidualKernelArgs& args);
+
+size_t computeResidualsAvx2(const ResidualKernelArgs& args);
+size_t computeResidualsAvx512(const ResidualKernelArgs& args);
+
+} /* namespace core */
+} /* namespace dvo */
+#endif /* DENSE_TRACKING_KERNELS_H_ */
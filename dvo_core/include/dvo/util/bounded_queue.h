@@ -0,0 +1,134 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOUNDED_QUEUE_H_
+#define BOUNDED_QUEUE_H_
+
+#include <string>
+
+#include <boost/scoped_ptr.hpp>
+
+#include <dvo/util/ring_buffer.h>
+
+namespace dvo
+{
+namespace util
+{
+
+/**
+ * FIFO queue between two pipeline stages. If the queue is full, push() either drops the oldest item, drops the new
+ * item or waits until the consumer catches up. Lock-free on top of RingBuffer, so neither side takes a kernel lock
+ * unless it has to wait. shutdown() wakes up all waiting threads.
+ */
+template<typename T>
+class BoundedQueue
+{
+public:
+  enum DropPolicy
+  {
+    DropOldest,
+    DropNewest,
+    Block
+  };
+
+  static bool parseDropPolicy(const std::string& name, DropPolicy& policy)
+  {
+    if(name == "drop_oldest")
+      policy = DropOldest;
+    else if(name == "drop_newest")
+      policy = DropNewest;
+    else if(name == "block")
+      policy = Block;
+    else
+      return false;
+
+    return true;
+  }
+
+  explicit BoundedQueue(size_t capacity = 1, DropPolicy policy = DropOldest, WaitStrategy strategy = WaitStrategies::Block) :
+    policy_(policy),
+    strategy_(strategy),
+    items_(new RingBuffer<T>(capacity, strategy))
+  {
+  }
+
+  // replaces the buffer and keeps the newest items, must not be called while other threads use the queue
+  void configure(size_t capacity, DropPolicy policy)
+  {
+    policy_ = policy;
+
+    if(capacity == items_->capacity()) return;
+
+    boost::scoped_ptr<RingBuffer<T> > items(new RingBuffer<T>(capacity, strategy_));
+    T item;
+
+    while(items_->tryPop(item)) items->pushDropOldest(item);
+
+    items_.swap(items);
+  }
+
+  size_t capacity() const
+  {
+    return items_->capacity();
+  }
+
+  // returns false if an item was dropped or the queue is shut down
+  bool push(const T& item)
+  {
+    switch(policy_)
+    {
+    case DropOldest:
+      return items_->pushDropOldest(item);
+    case DropNewest:
+      return !items_->isShutdown() && items_->tryPush(item);
+    default:
+      return items_->push(item);
+    }
+  }
+
+  // blocks until an item is available, returns false after shutdown()
+  bool pop(T& item)
+  {
+    return items_->pop(item);
+  }
+
+  void clear()
+  {
+    items_->clear();
+  }
+
+  void shutdown()
+  {
+    items_->shutdown();
+    items_->clear();
+  }
+private:
+  BoundedQueue(const BoundedQueue&);
+  BoundedQueue& operator=(const BoundedQueue&);
+
+  DropPolicy policy_;
+  WaitStrategy strategy_;
+
+  boost::scoped_ptr<RingBuffer<T> > items_;
+};
+
+} /* namespace util */
+} /* namespace dvo */
+#endif /* BOUNDED_QUEUE_H_ */
@@ -0,0 +1,45 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CPU_FEATURES_H_
+#define CPU_FEATURES_H_
+
+namespace dvo
+{
+namespace util
+{
+
+/**
+ * Instruction sets of the CPU the process runs on, which the OS also saves the registers of. The wide kernels are
+ * compiled in their own translation units and selected at runtime with these.
+ *
+ * The environment variable DVO_SIMD limits the selection, "sse" disables all wider kernels, "avx2" the AVX-512 ones.
+ */
+bool hasAvx();
+
+// half precision conversions, needs AVX as well
+bool hasF16c();
+
+bool hasAvx2();
+bool hasAvx512();
+
+} /* namespace util */
+} /* namespace dvo */
+#endif /* CPU_FEATURES_H_ */
@@ -0,0 +1,177 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTRUMENTATION_H_
+#define INSTRUMENTATION_H_
+
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/shared_ptr.hpp>
+#include <tbb/spin_mutex.h>
+
+#include <dvo/util/trace.h>
+
+namespace dvo
+{
+namespace util
+{
+
+struct TimerSummary
+{
+  // full path, e.g. "dense_tracking/match/level/2"
+  std::string Name;
+
+  size_t Count;
+
+  // in seconds
+  double Total, Mean, Min, Max;
+
+  // estimated from a log scale histogram, accurate to about 5%
+  double P50, P90, P99;
+};
+
+/**
+ * Named duration statistics in the instrumentation tree, see Instrumentation. Recording is thread-safe and doesn't
+ * allocate, so references to timers are usually looked up once and kept in a static.
+ */
+class Timer
+{
+public:
+  Timer(const std::string& name);
+  ~Timer();
+
+  // full path of this timer
+  const std::string& name() const;
+
+  void record(double seconds);
+
+  // looks up or creates the child with the given name, thread-safe
+  Timer& child(const std::string& name);
+
+  // child named by the index, e.g. a pyramid level or iteration, cheaper than the lookup by name
+  Timer& child(size_t index);
+
+  void summarize(TimerSummary& summary) const;
+
+  // appends the summaries of this timer, if it recorded anything, and of all children depth first
+  void summarizeAll(std::vector<TimerSummary>& summaries) const;
+
+  // clears the statistics of this timer and all children, the children stay registered
+  void resetAll();
+
+  // ticks of a monotonic clock
+  static int64_t now();
+  static double seconds(int64_t ticks);
+private:
+  static const size_t NumBins = 256;
+
+  Timer(const Timer&);
+  Timer& operator=(const Timer&);
+
+  std::string name_;
+
+  mutable tbb::spin_mutex stats_mutex_;
+  size_t count_;
+  double total_, min_, max_;
+  uint32_t bins_[NumBins];
+
+  mutable tbb::spin_mutex children_mutex_;
+  std::map<std::string, boost::shared_ptr<Timer> > children_;
+  std::vector<Timer*> indexed_children_;
+
+  static size_t bin(double seconds);
+  static double binCenter(size_t bin);
+
+  double percentile(double p) const;
+};
+
+/**
+ * Records the lifetime of the scope in the given timer, and as a span in the Trace if it is enabled. Scopes nest
+ * through child timers:
+ *
+ *   ScopedTimer match_scope(match_timer);
+ *   ...
+ *   ScopedTimer level_scope(match_timer.child("level").child(level));
+ */
+class ScopedTimer
+{
+public:
+  explicit ScopedTimer(Timer& timer) :
+    timer_(timer),
+    begin_(Timer::now())
+  {
+  }
+
+  ~ScopedTimer()
+  {
+    const int64_t end = Timer::now();
+
+    timer_.record(Timer::seconds(end - begin_));
+
+    if(Trace::enabled()) Trace::instance().complete(timer_.name().c_str(), begin_, end);
+  }
+
+  Timer& timer()
+  {
+    return timer_;
+  }
+private:
+  Timer& timer_;
+  int64_t begin_;
+};
+
+/**
+ * Process wide registry of timers. Timers are addressed with '/' separated paths, e.g. "keyframe_graph/new_keyframe",
+ * and are never removed, so references to them stay valid.
+ */
+class Instrumentation
+{
+public:
+  static Instrumentation& instance();
+
+  Timer& root();
+
+  // looks up or creates the timer with the given path
+  Timer& timer(const std::string& path);
+
+  // pull api, summaries of all timers which recorded something
+  void summarize(std::vector<TimerSummary>& summaries) const;
+
+  void reset();
+
+  // one line per timer
+  void print(std::ostream& out) const;
+
+  // csv with a header line, returns false if the file can't be written
+  bool write(const std::string& file) const;
+private:
+  Instrumentation();
+
+  Timer root_;
+};
+
+} /* namespace util */
+} /* namespace dvo */
+#endif /* INSTRUMENTATION_H_ */
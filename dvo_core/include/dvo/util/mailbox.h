@@ -0,0 +1,82 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAILBOX_H_
+#define MAILBOX_H_
+
+#include <tbb/atomic.h>
+
+namespace dvo
+{
+namespace util
+{
+
+/**
+ * Single slot handing the latest value from one thread to another, e.g. a new configuration from the dynamic
+ * reconfigure callback to a pipeline stage. Both sides only exchange a pointer, so the consumer never waits for the
+ * producer. A value which wasn't taken yet is replaced by the next post().
+ */
+template<typename T>
+class Mailbox
+{
+public:
+  Mailbox()
+  {
+    slot_ = 0;
+  }
+
+  ~Mailbox()
+  {
+    delete slot_.fetch_and_store(0);
+  }
+
+  // the copy is made before the exchange, so the consumer never sees a partially written value
+  void post(const T& value)
+  {
+    delete slot_.fetch_and_store(new T(value));
+  }
+
+  // returns false if nothing was posted since the last take()
+  bool take(T& value)
+  {
+    T* posted = slot_.fetch_and_store(0);
+
+    if(posted == 0) return false;
+
+    value = *posted;
+    delete posted;
+
+    return true;
+  }
+
+  bool empty() const
+  {
+    return slot_ == 0;
+  }
+private:
+  Mailbox(const Mailbox&);
+  Mailbox& operator=(const Mailbox&);
+
+  tbb::atomic<T*> slot_;
+};
+
+} /* namespace util */
+} /* namespace dvo */
+#endif /* MAILBOX_H_ */
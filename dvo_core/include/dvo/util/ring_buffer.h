@@ -0,0 +1,474 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RING_BUFFER_H_
+#define RING_BUFFER_H_
+
+#include <algorithm>
+#include <cstddef>
+
+#include <boost/scoped_array.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <tbb/atomic.h>
+
+#include <xmmintrin.h>
+
+namespace dvo
+{
+namespace util
+{
+
+struct WaitStrategies
+{
+  enum Enum
+  {
+    // busy waits, lowest latency but occupies a core
+    Spin,
+    // spins for a while, then yields the core to other threads
+    Yield,
+    // spins and yields for a while, then sleeps until notified
+    Block
+  };
+};
+typedef WaitStrategies::Enum WaitStrategy;
+
+namespace internal
+{
+
+/**
+ * Event count for the ring buffers. A waiting thread takes a token, checks its condition and waits on the token,
+ * notify() wakes it if anything happened in between. notify() only takes the mutex if a thread is actually asleep, so
+ * the fast path of push and pop doesn't enter the kernel.
+ */
+class RingBufferWaiter
+{
+public:
+  typedef size_t Token;
+
+  explicit RingBufferWaiter(WaitStrategy strategy = WaitStrategies::Block) :
+    strategy_(strategy)
+  {
+    epoch_ = 0;
+    sleepers_ = 0;
+  }
+
+  void strategy(WaitStrategy strategy)
+  {
+    strategy_ = strategy;
+  }
+
+  Token prepare() const
+  {
+    return epoch_;
+  }
+
+  // the round-th wait of the caller for the same condition
+  void wait(Token token, size_t round)
+  {
+    static const size_t SpinRounds = 64, YieldRounds = 256;
+
+    if(strategy_ == WaitStrategies::Spin || round < SpinRounds)
+    {
+      _mm_pause();
+    }
+    else if(strategy_ == WaitStrategies::Yield || round < SpinRounds + YieldRounds)
+    {
+      boost::this_thread::yield();
+    }
+    else
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      sleepers_.fetch_and_increment();
+
+      while(epoch_ == token) not_empty_.wait(lock);
+
+      sleepers_.fetch_and_decrement();
+    }
+  }
+
+  void notify()
+  {
+    // a full fence, the sleepers are read after the change the waiters are waiting for is published
+    epoch_.fetch_and_increment();
+
+    if(sleepers_ > 0)
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      not_empty_.notify_all();
+    }
+  }
+private:
+  WaitStrategy strategy_;
+
+  tbb::atomic<size_t> epoch_, sleepers_;
+
+  boost::mutex mutex_;
+  boost::condition_variable not_empty_;
+};
+
+} /* namespace internal */
+
+/**
+ * Bounded lock-free FIFO between exactly one producer and one consumer thread. The blocking push() and pop() wait with
+ * the given strategy.
+ */
+template<typename T>
+class SpscRingBuffer
+{
+public:
+  explicit SpscRingBuffer(size_t capacity, WaitStrategy strategy = WaitStrategies::Block) :
+    capacity_(std::max<size_t>(capacity, 1)),
+    slots_(new T[capacity_]),
+    not_empty_(strategy),
+    not_full_(strategy)
+  {
+    head_ = 0;
+    tail_ = 0;
+    shutdown_ = false;
+  }
+
+  size_t capacity() const
+  {
+    return capacity_;
+  }
+
+  // approximate if called concurrently with push or pop
+  size_t size() const
+  {
+    const size_t head = head_;
+    return tail_ - head;
+  }
+
+  bool empty() const
+  {
+    return size() == 0;
+  }
+
+  // producer only, returns false if the buffer is full
+  bool tryPush(const T& item)
+  {
+    const size_t tail = tail_;
+
+    if(tail - head_ >= capacity_) return false;
+
+    slots_[tail % capacity_] = item;
+    tail_ = tail + 1;
+
+    not_empty_.notify();
+
+    return true;
+  }
+
+  // producer only, waits while the buffer is full, returns false after shutdown()
+  bool push(const T& item)
+  {
+    for(size_t round = 0;; ++round)
+    {
+      internal::RingBufferWaiter::Token token = not_full_.prepare();
+
+      if(shutdown_) return false;
+      if(tryPush(item)) return true;
+
+      not_full_.wait(token, round);
+    }
+  }
+
+  // consumer only, returns false if the buffer is empty
+  bool tryPop(T& item)
+  {
+    const size_t head = head_;
+
+    if(head == tail_) return false;
+
+    T& slot = slots_[head % capacity_];
+    item = slot;
+    // don't keep the item alive until the slot is reused
+    slot = T();
+    head_ = head + 1;
+
+    not_full_.notify();
+
+    return true;
+  }
+
+  // consumer only, waits until an item is available, returns false after shutdown()
+  bool pop(T& item)
+  {
+    for(size_t round = 0;; ++round)
+    {
+      internal::RingBufferWaiter::Token token = not_empty_.prepare();
+
+      if(shutdown_) return false;
+      if(tryPop(item)) return true;
+
+      not_empty_.wait(token, round);
+    }
+  }
+
+  // wakes all waiting threads, push and pop fail afterwards
+  void shutdown()
+  {
+    shutdown_ = true;
+
+    not_empty_.notify();
+    not_full_.notify();
+  }
+
+  bool isShutdown() const
+  {
+    return shutdown_;
+  }
+private:
+  SpscRingBuffer(const SpscRingBuffer&);
+  SpscRingBuffer& operator=(const SpscRingBuffer&);
+
+  const size_t capacity_;
+  boost::scoped_array<T> slots_;
+
+  // written by the consumer and the producer respectively, on their own cache lines
+  char pad0_[64];
+  tbb::atomic<size_t> head_;
+  char pad1_[64];
+  tbb::atomic<size_t> tail_;
+  char pad2_[64];
+
+  tbb::atomic<bool> shutdown_;
+
+  internal::RingBufferWaiter not_empty_, not_full_;
+};
+
+/**
+ * Bounded lock-free FIFO for any number of producers and consumers, after D. Vyukov's bounded MPMC queue. Every slot
+ * carries a sequence number telling whether it is free for the producer or filled for the consumer of a position.
+ *
+ * pushDropOldest() makes room by consuming the oldest item itself, so a slow consumer only ever sees recent items and
+ * the producer never waits.
+ */
+template<typename T>
+class RingBuffer
+{
+public:
+  explicit RingBuffer(size_t capacity, WaitStrategy strategy = WaitStrategies::Block) :
+    capacity_(std::max<size_t>(capacity, 1)),
+    cells_(new Cell[capacity_]),
+    not_empty_(strategy),
+    not_full_(strategy)
+  {
+    for(size_t idx = 0; idx < capacity_; ++idx)
+      cells_[idx].sequence = idx;
+
+    enqueue_ = 0;
+    dequeue_ = 0;
+    shutdown_ = false;
+  }
+
+  size_t capacity() const
+  {
+    return capacity_;
+  }
+
+  // approximate if called concurrently with push or pop
+  size_t size() const
+  {
+    const size_t dequeue = dequeue_;
+    const size_t enqueue = enqueue_;
+
+    return enqueue > dequeue ? enqueue - dequeue : 0;
+  }
+
+  bool empty() const
+  {
+    return size() == 0;
+  }
+
+  // returns false if the buffer is full
+  bool tryPush(const T& item)
+  {
+    size_t pos = enqueue_;
+    Cell* cell;
+
+    for(;;)
+    {
+      cell = &cells_[pos % capacity_];
+
+      const size_t sequence = cell->sequence;
+      const ptrdiff_t diff = ptrdiff_t(sequence) - ptrdiff_t(pos);
+
+      if(diff == 0)
+      {
+        // the slot is free, claim the position
+        if(enqueue_.compare_and_swap(pos + 1, pos) == pos) break;
+
+        pos = enqueue_;
+      }
+      else if(diff < 0)
+      {
+        // the consumer of the previous round didn't take the slot yet
+        return false;
+      }
+      else
+      {
+        pos = enqueue_;
+      }
+    }
+
+    cell->value = item;
+    cell->sequence = pos + 1;
+
+    not_empty_.notify();
+
+    return true;
+  }
+
+  // waits while the buffer is full, returns false after shutdown()
+  bool push(const T& item)
+  {
+    for(size_t round = 0;; ++round)
+    {
+      internal::RingBufferWaiter::Token token = not_full_.prepare();
+
+      if(shutdown_) return false;
+      if(tryPush(item)) return true;
+
+      not_full_.wait(token, round);
+    }
+  }
+
+  // never waits, returns false if an older item was dropped or after shutdown()
+  bool pushDropOldest(const T& item)
+  {
+    bool dropped = false;
+    T oldest;
+
+    while(!shutdown_)
+    {
+      if(tryPush(item)) return !dropped;
+
+      if(tryPop(oldest)) dropped = true;
+    }
+
+    return false;
+  }
+
+  // returns false if the buffer is empty
+  bool tryPop(T& item)
+  {
+    size_t pos = dequeue_;
+    Cell* cell;
+
+    for(;;)
+    {
+      cell = &cells_[pos % capacity_];
+
+      const size_t sequence = cell->sequence;
+      const ptrdiff_t diff = ptrdiff_t(sequence) - ptrdiff_t(pos + 1);
+
+      if(diff == 0)
+      {
+        if(dequeue_.compare_and_swap(pos + 1, pos) == pos) break;
+
+        pos = dequeue_;
+      }
+      else if(diff < 0)
+      {
+        return false;
+      }
+      else
+      {
+        pos = dequeue_;
+      }
+    }
+
+    item = cell->value;
+    cell->value = T();
+    // free for the producer of the next round
+    cell->sequence = pos + capacity_;
+
+    not_full_.notify();
+
+    return true;
+  }
+
+  // waits until an item is available, returns false after shutdown()
+  bool pop(T& item)
+  {
+    for(size_t round = 0;; ++round)
+    {
+      internal::RingBufferWaiter::Token token = not_empty_.prepare();
+
+      if(shutdown_) return false;
+      if(tryPop(item)) return true;
+
+      not_empty_.wait(token, round);
+    }
+  }
+
+  // drops all items
+  void clear()
+  {
+    T item;
+
+    while(tryPop(item));
+  }
+
+  // wakes all waiting threads, push and pop fail afterwards
+  void shutdown()
+  {
+    shutdown_ = true;
+
+    not_empty_.notify();
+    not_full_.notify();
+  }
+
+  bool isShutdown() const
+  {
+    return shutdown_;
+  }
+private:
+  RingBuffer(const RingBuffer&);
+  RingBuffer& operator=(const RingBuffer&);
+
+  struct Cell
+  {
+    tbb::atomic<size_t> sequence;
+    T value;
+  };
+
+  const size_t capacity_;
+  boost::scoped_array<Cell> cells_;
+
+  char pad0_[64];
+  tbb::atomic<size_t> enqueue_;
+  char pad1_[64];
+  tbb::atomic<size_t> dequeue_;
+  char pad2_[64];
+
+  tbb::atomic<bool> shutdown_;
+
+  internal::RingBufferWaiter not_empty_, not_full_;
+};
+
+} /* namespace util */
+} /* namespace dvo */
+#endif /* RING_BUFFER_H_ */
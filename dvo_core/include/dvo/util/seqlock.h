@@ -0,0 +1,119 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SEQLOCK_H_
+#define SEQLOCK_H_
+
+#include <tbb/atomic.h>
+
+#include <xmmintrin.h>
+
+namespace dvo
+{
+namespace util
+{
+
+/**
+ * Latest value written by one thread and read by any number of others without locks. A reader copies the value and
+ * retries if the writer changed it in between, so the writer never waits. Only for small values which are cheap to
+ * copy and safe to copy while they are written, e.g. fixed size Eigen types.
+ */
+template<typename T>
+class Seqlock
+{
+public:
+  Seqlock()
+  {
+    sequence_ = 0;
+  }
+
+  explicit Seqlock(const T& value) :
+    value_(value)
+  {
+    sequence_ = 0;
+  }
+
+  // writer only
+  void store(const T& value)
+  {
+    // odd while the value is written, the increments are full fences
+    sequence_.fetch_and_increment();
+    value_ = value;
+    sequence_.fetch_and_increment();
+  }
+
+  void load(T& value) const
+  {
+    for(;;)
+    {
+      const size_t begin = sequence_;
+
+      if((begin & 1) == 0)
+      {
+        value = value_;
+
+        // the copy completes before the sequence is read again
+        tbb::atomic_fence();
+
+        if(sequence_ == begin) return;
+      }
+
+      _mm_pause();
+    }
+  }
+
+  // same as load(), but gives up after max_attempts, e.g., if the writer is another process which may have died
+  bool tryLoad(T& value, size_t max_attempts) const
+  {
+    for(size_t attempt = 0; attempt < max_attempts; ++attempt)
+    {
+      const size_t begin = sequence_;
+
+      if((begin & 1) == 0)
+      {
+        value = value_;
+
+        tbb::atomic_fence();
+
+        if(sequence_ == begin) return true;
+      }
+
+      _mm_pause();
+    }
+
+    return false;
+  }
+
+  // number of stores so far
+  size_t version() const
+  {
+    return sequence_ / 2;
+  }
+private:
+  Seqlock(const Seqlock&);
+  Seqlock& operator=(const Seqlock&);
+
+  tbb::atomic<size_t> sequence_;
+  T value_;
+};
+
+} /* namespace util */
+} /* namespace dvo */
+#endif /* SEQLOCK_H_ */
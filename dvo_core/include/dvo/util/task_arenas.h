@@ -0,0 +1,83 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TASK_ARENAS_H_
+#define TASK_ARENAS_H_
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <tbb/spin_mutex.h>
+
+namespace dvo
+{
+namespace util
+{
+
+/**
+ * Process wide TBB arenas isolating the parallel work of the frontend, the backend and the visualization, so e.g. a
+ * burst of constraint validations can't take the workers which the odometry waits for. Work submitted to an
+ * unconfigured role runs on the global scheduler, as does all work if TBB is too old for task arenas.
+ */
+class TaskArenas
+{
+public:
+  enum Role
+  {
+    Frontend = 0,
+    Backend,
+    Visualization,
+    NumRoles
+  };
+
+  static TaskArenas& instance();
+
+  /**
+   * Replaces the arena of the role, work already running keeps the old one. A concurrency of 0 uses the global
+   * scheduler. With first_core >= 0 the workers of the arena are pinned to the cores
+   * [first_core, first_core + concurrency), the threads submitting work are never pinned.
+   */
+  void configure(Role role, int concurrency, int first_core = -1);
+
+  // false if the role runs on the global scheduler
+  bool isolated(Role role) const;
+
+  // runs f in the arena of the role, the calling thread takes part and returns once f did
+  void execute(Role role, const boost::function<void()>& f);
+
+  // runs f asynchronously on a worker of the arena of the role
+  void enqueue(Role role, const boost::function<void()>& f);
+private:
+  struct Arena;
+  typedef boost::shared_ptr<Arena> ArenaPtr;
+
+  TaskArenas();
+  TaskArenas(const TaskArenas&);
+  TaskArenas& operator=(const TaskArenas&);
+
+  ArenaPtr arena(Role role) const;
+
+  mutable tbb::spin_mutex arenas_mutex_;
+  ArenaPtr arenas_[NumRoles];
+  int concurrency_[NumRoles], first_core_[NumRoles];
+};
+
+} /* namespace util */
+} /* namespace dvo */
+#endif /* TASK_ARENAS_H_ */
@@ -0,0 +1,104 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <string>
+
+#include <stdint.h>
+
+#include <tbb/atomic.h>
+
+namespace dvo
+{
+namespace util
+{
+
+/**
+ * Timeline of the ScopedTimer spans and of instant events on all threads, written in the Chrome trace event format,
+ * which chrome://tracing and Perfetto open. Every event carries the id of the thread which recorded it, so waiting
+ * between the tracking, the optimization thread and the TBB workers becomes visible.
+ *
+ * Recording is stopped by default and then costs a check of a flag. Started, events are appended to buffers of the
+ * recording thread without a lock until MaxEvents are recorded, later ones are dropped.
+ */
+class Trace
+{
+public:
+  // numeric argument of an instant event, the name has to be a string literal
+  struct Arg
+  {
+    const char* name;
+    double value;
+  };
+
+  static const size_t MaxArgs = 6;
+
+  static Trace& instance();
+
+  static bool enabled()
+  {
+    return enabled_ != 0;
+  }
+
+  // drops the events recorded before, must not be called while events are recorded
+  void start(size_t max_events = 1 << 22);
+
+  // keeps the recorded events, waits for the events being recorded concurrently, so write() can follow
+  void stop();
+
+  // span from begin to end in Timer::now() ticks, the name has to outlive the trace, e.g., the name of a Timer
+  void complete(const char* name, int64_t begin, int64_t end);
+
+  // event at the current time with at most MaxArgs arguments
+  void instant(const char* name, const Arg* args, size_t num_args);
+
+  size_t size() const;
+  size_t dropped() const;
+
+  // json object with the traceEvents array, timestamps in microseconds since start(). returns false if the file can't
+  // be written, must not be called while events are recorded
+  bool write(const std::string& file) const;
+private:
+  Trace();
+  ~Trace();
+
+  Trace(const Trace&);
+  Trace& operator=(const Trace&);
+
+  // events of every thread
+  struct Buffers;
+
+  static tbb::atomic<int> enabled_;
+
+  // threads inside complete() or instant()
+  tbb::atomic<int> recording_;
+
+  Buffers* buffers_;
+
+  tbb::atomic<size_t> size_, dropped_;
+  size_t max_events_;
+  int64_t origin_;
+};
+
+} /* namespace util */
+} /* namespace dvo */
+#endif /* TRACE_H_ */
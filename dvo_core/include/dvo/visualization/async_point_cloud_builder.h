@@ -46,9 +46,15 @@ public:
     dvo::core::RgbdImage image;
     const Eigen::Affine3d pose;
 
-    BuildJob(const dvo::core::RgbdImage& image, const Eigen::Affine3d pose = Eigen::Affine3d::Identity());
+    // only every stride-th pixel in both directions becomes a point
+    const int stride;
 
+    BuildJob(const dvo::core::RgbdImage& image, const Eigen::Affine3d pose = Eigen::Affine3d::Identity(), int stride = 1);
+
+    // points without valid depth are skipped, the cloud returns to a pool of buffers once it isn't referenced anymore
     AsyncPointCloudBuilder::PointCloud::Ptr build();
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
   private:
     AsyncPointCloudBuilder::PointCloud::Ptr cloud_;
   };
@@ -106,6 +106,18 @@ public:
 
   virtual void reset() = 0;
 
+  // whether the cameras show colored point clouds, the float rgb image of a frame is only needed in that case
+  virtual bool requiresRgb() const
+  {
+    return false;
+  }
+
+  // whether anybody receives the visualization, callers can skip preparing updates otherwise
+  virtual bool active() const
+  {
+    return true;
+  }
+
   virtual bool native(void*& native_visualizer)
   {
     native_visualizer = 0;
@@ -123,6 +135,8 @@ public:
   virtual TrajectoryVisualizer::Ptr trajectory(std::string name);
 
   virtual void reset();
+
+  virtual bool active() const;
 };
 
 } /* namespace visualization */
@@ -80,6 +80,8 @@ public:
 
   virtual void reset();
 
+  virtual bool requiresRgb() const;
+
   void bindSwitchToKey(Switch& s, std::string key);
 
   void render(int milliseconds = 15);
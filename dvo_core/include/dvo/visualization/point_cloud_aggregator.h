@@ -33,18 +33,29 @@ namespace internal
   class PointCloudAggregatorImpl;
 } /* namespace internal */
 
+/**
+ * Merges named clouds into one voxel map. Every added cloud is built and integrated once, by the next call to build(),
+ * and removed from the map again if it is replaced or removed. So the cost of build() depends on the clouds changed
+ * since the last call and not on the size of the map. Thread-safe.
+ */
 class PointCloudAggregator
 {
 public:
   typedef boost::function<dvo::visualization::AsyncPointCloudBuilder::PointCloud::Ptr()> PointCloudBuilderCallable;
 
-  PointCloudAggregator();
+  PointCloudAggregator(float leaf_size = 0.01f);
   virtual ~PointCloudAggregator();
 
   void add(const std::string& name, const dvo::visualization::AsyncPointCloudBuilder::PointCloud::Ptr& cloud);
   void add(const std::string& name, const PointCloudBuilderCallable& cloud);
+
+  // the cloud is only re-integrated if the pose moved noticeably since it was integrated, e.g. by the graph optimization,
+  // so the cloud of a name has to stay the same as long as its pose does
+  void add(const std::string& name, const PointCloudBuilderCallable& cloud, const Eigen::Affine3d& pose);
+
   void remove(const std::string& name);
 
+  // one point per voxel, the returned cloud is shared with later calls until the map changes, only change its header
   dvo::visualization::AsyncPointCloudBuilder::PointCloud::Ptr build();
 private:
   boost::scoped_ptr<internal::PointCloudAggregatorImpl> impl_;
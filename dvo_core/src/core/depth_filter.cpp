@@ -0,0 +1,472 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo/core/depth_filter.h>
+#include <dvo/core/datatypes.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <immintrin.h>
+
+namespace dvo
+{
+namespace core
+{
+
+DepthFilterConfig::DepthFilterConfig() :
+    MinDepth(0.0f),
+    MaxDepth(0.0f),
+    MaxDepthJump(0.0f),
+    BilateralRadius(0),
+    BilateralSigmaSpace(1.5f),
+    BilateralSigmaDepth(0.0025f),
+    FillHoles(false)
+{
+}
+
+bool DepthFilterConfig::enabled() const
+{
+  return MinDepth > 0.0f || MaxDepth > 0.0f || requiresNeighbourhood();
+}
+
+bool DepthFilterConfig::requiresNeighbourhood() const
+{
+  return MaxDepthJump > 0.0f || BilateralRadius > 0;
+}
+
+namespace internal
+{
+
+// larger windows don't pay off for the noise of depth sensors, the weights live on the stack
+static const int MaxBilateralRadius = 8;
+
+struct DepthRange
+{
+  float min, max;
+
+  DepthRange(const DepthFilterConfig& cfg) :
+    min(cfg.MinDepth),
+    max(cfg.MaxDepth > 0.0f ? cfg.MaxDepth : std::numeric_limits<float>::infinity())
+  {
+  }
+
+  // NaN stays invalid, the comparisons fail
+  float operator()(float z) const
+  {
+    return z >= min && z <= max ? z : InvalidDepth;
+  }
+
+  __m128 operator()(const __m128& z) const
+  {
+    const __m128 inside = _mm_and_ps(_mm_cmpge_ps(z, _mm_set1_ps(min)), _mm_cmple_ps(z, _mm_set1_ps(max)));
+
+    return _mm_or_ps(_mm_and_ps(inside, z), _mm_andnot_ps(inside, _mm_set1_ps(InvalidDepth)));
+  }
+};
+
+struct BilateralWeights
+{
+  int radius;
+
+  // by the distance to the center
+  float spatial[MaxBilateralRadius + 1];
+
+  // 1 / (3 sigma)^2 at 1m, the range kernel is a biweight with support of three sigma
+  float range;
+
+  bool fill_holes;
+
+  BilateralWeights(const DepthFilterConfig& cfg) :
+    radius(std::min(cfg.BilateralRadius, MaxBilateralRadius)),
+    range(1.0f / (9.0f * cfg.BilateralSigmaDepth * cfg.BilateralSigmaDepth)),
+    fill_holes(cfg.FillHoles)
+  {
+    for(int k = 0; k <= radius; ++k)
+    {
+      spatial[k] = std::exp(-0.5f * k * k / (cfg.BilateralSigmaSpace * cfg.BilateralSigmaSpace));
+    }
+  }
+
+  float total(int first, int last) const
+  {
+    float sum = 0.0f;
+
+    for(int k = first; k <= last; ++k) sum += spatial[std::abs(k)];
+
+    return sum;
+  }
+};
+
+// bilateral filter of a single depth with the taps center[k * step] for k in [first, last]
+static float bilateral(const BilateralWeights& w, const float* center, ptrdiff_t step, int first, int last)
+{
+  const float zc = *center;
+  const bool valid = zc == zc;
+  const float range = w.range / (zc * zc * zc * zc);
+
+  float sum_w = 0.0f, sum_wz = 0.0f, sum_s = 0.0f, sum_sz = 0.0f;
+  float min_z = std::numeric_limits<float>::infinity(), max_z = -std::numeric_limits<float>::infinity();
+
+  for(int k = first; k <= last; ++k)
+  {
+    const float zk = center[k * step];
+
+    if(zk != zk) continue;
+
+    const float s = w.spatial[std::abs(k)];
+
+    if(valid)
+    {
+      const float d = zk - zc;
+      const float r = 1.0f - std::min(d * d * range, 1.0f);
+      const float wk = s * r * r;
+
+      sum_w += wk;
+      sum_wz += wk * zk;
+    }
+
+    sum_s += s;
+    sum_sz += s * zk;
+    min_z = std::min(min_z, zk);
+    max_z = std::max(max_z, zk);
+  }
+
+  if(valid) return sum_wz / sum_w;
+
+  if(!w.fill_holes || !(sum_s >= 0.5f * w.total(first, last))) return InvalidDepth;
+
+  const float mean = sum_sz / sum_s;
+  const float spread = max_z - min_z;
+
+  return spread * spread * w.range < mean * mean * mean * mean ? mean : InvalidDepth;
+}
+
+// same as bilateral() for the four depths starting at center
+static __m128 bilateralSse(const BilateralWeights& w, const float* center, ptrdiff_t step, int first, int last)
+{
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 invalid = _mm_set1_ps(InvalidDepth);
+
+  const __m128 zc = _mm_loadu_ps(center);
+  const __m128 valid = _mm_cmpord_ps(zc, zc);
+  const __m128 zc2 = _mm_mul_ps(zc, zc);
+
+  // NaN for invalid centers, the min below turns it into a weight of 0
+  const __m128 range = _mm_div_ps(_mm_set1_ps(w.range), _mm_mul_ps(zc2, zc2));
+
+  __m128 sum_w = _mm_setzero_ps(), sum_wz = _mm_setzero_ps(), sum_s = _mm_setzero_ps(), sum_sz = _mm_setzero_ps();
+  __m128 min_z = _mm_set1_ps(std::numeric_limits<float>::infinity()), max_z = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+
+  for(int k = first; k <= last; ++k)
+  {
+    const __m128 zk = _mm_loadu_ps(center + k * step);
+    const __m128 vk = _mm_cmpord_ps(zk, zk);
+    const __m128 zk_valid = _mm_and_ps(zk, vk);
+
+    const __m128 s = _mm_set1_ps(w.spatial[std::abs(k)]);
+
+    // min and max return the second operand if the first is NaN
+    const __m128 d = _mm_sub_ps(zk, zc);
+    const __m128 r = _mm_sub_ps(one, _mm_min_ps(_mm_mul_ps(_mm_mul_ps(d, d), range), one));
+    const __m128 wk = _mm_mul_ps(s, _mm_mul_ps(r, r));
+
+    sum_w = _mm_add_ps(sum_w, wk);
+    sum_wz = _mm_add_ps(sum_wz, _mm_mul_ps(wk, zk_valid));
+
+    const __m128 sk = _mm_and_ps(s, vk);
+
+    sum_s = _mm_add_ps(sum_s, sk);
+    sum_sz = _mm_add_ps(sum_sz, _mm_mul_ps(sk, zk_valid));
+    min_z = _mm_min_ps(zk, min_z);
+    max_z = _mm_max_ps(zk, max_z);
+  }
+
+  const __m128 filtered = _mm_div_ps(sum_wz, sum_w);
+
+  __m128 filled = invalid;
+
+  if(w.fill_holes && _mm_movemask_ps(valid) != 0xf)
+  {
+    const __m128 mean = _mm_div_ps(sum_sz, sum_s);
+    const __m128 mean2 = _mm_mul_ps(mean, mean);
+    const __m128 spread = _mm_sub_ps(max_z, min_z);
+
+    const __m128 fill = _mm_and_ps(
+        _mm_cmpge_ps(sum_s, _mm_set1_ps(0.5f * w.total(first, last))),
+        _mm_cmplt_ps(_mm_mul_ps(_mm_mul_ps(spread, spread), _mm_set1_ps(w.range)), _mm_mul_ps(mean2, mean2))
+    );
+
+    filled = _mm_or_ps(_mm_and_ps(fill, mean), _mm_andnot_ps(fill, invalid));
+  }
+
+  return _mm_or_ps(_mm_and_ps(valid, filtered), _mm_andnot_ps(valid, filled));
+}
+
+static inline float flyingPixel(const DepthRange& range, float jump, const float* up, const float* center, const float* down, int x, int cols)
+{
+  const float z = range(center[x]);
+  const float threshold = jump * z;
+
+  const float l = x > 0 ? range(center[x - 1]) : z;
+  const float r = x + 1 < cols ? range(center[x + 1]) : z;
+  const float u = range(up[x]);
+  const float d = range(down[x]);
+
+  // comparisons with invalid neighbours fail, holes alone don't remove a pixel
+  const bool edge = std::abs(l - z) > threshold || std::abs(r - z) > threshold || std::abs(u - z) > threshold || std::abs(d - z) > threshold;
+
+  return edge ? InvalidDepth : z;
+}
+
+static void removeFlyingPixels(const DepthRange& range, float jump, const float* up, const float* center, const float* down, float* out, int cols)
+{
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 jump_ = _mm_set1_ps(jump);
+  const __m128 invalid = _mm_set1_ps(InvalidDepth);
+
+  out[0] = flyingPixel(range, jump, up, center, down, 0, cols);
+
+  int x = 1;
+
+  for(; x + 4 < cols; x += 4)
+  {
+    const __m128 z = range(_mm_loadu_ps(center + x));
+    const __m128 threshold = _mm_mul_ps(jump_, z);
+
+    __m128 edge = _mm_cmpgt_ps(_mm_and_ps(_mm_sub_ps(range(_mm_loadu_ps(center + x - 1)), z), abs_mask), threshold);
+    edge = _mm_or_ps(edge, _mm_cmpgt_ps(_mm_and_ps(_mm_sub_ps(range(_mm_loadu_ps(center + x + 1)), z), abs_mask), threshold));
+    edge = _mm_or_ps(edge, _mm_cmpgt_ps(_mm_and_ps(_mm_sub_ps(range(_mm_loadu_ps(up + x)), z), abs_mask), threshold));
+    edge = _mm_or_ps(edge, _mm_cmpgt_ps(_mm_and_ps(_mm_sub_ps(range(_mm_loadu_ps(down + x)), z), abs_mask), threshold));
+
+    _mm_storeu_ps(out + x, _mm_or_ps(_mm_andnot_ps(edge, z), _mm_and_ps(edge, invalid)));
+  }
+
+  for(; x < cols; ++x)
+  {
+    out[x] = flyingPixel(range, jump, up, center, down, x, cols);
+  }
+}
+
+static void limitRange(const DepthRange& range, const float* in, float* out, int cols)
+{
+  int x = 0;
+
+  for(; x + 4 <= cols; x += 4)
+  {
+    _mm_storeu_ps(out + x, range(_mm_loadu_ps(in + x)));
+  }
+
+  for(; x < cols; ++x)
+  {
+    out[x] = range(in[x]);
+  }
+}
+
+static void bilateralRow(const BilateralWeights& w, const float* in, float* out, int cols)
+{
+  const int r = w.radius;
+  int x = 0;
+
+  // the window is clipped at the borders
+  for(; x < std::min(r, cols); ++x)
+  {
+    out[x] = bilateral(w, in + x, 1, -x, std::min(r, cols - 1 - x));
+  }
+
+  for(; x + 4 + r <= cols; x += 4)
+  {
+    _mm_storeu_ps(out + x, bilateralSse(w, in + x, 1, -r, r));
+  }
+
+  for(; x < cols; ++x)
+  {
+    out[x] = bilateral(w, in + x, 1, -std::min(r, x), std::min(r, cols - 1 - x));
+  }
+}
+
+static void bilateralColumns(const BilateralWeights& w, const float* in, ptrdiff_t step, float* out, int cols, int first, int last)
+{
+  int x = 0;
+
+  for(; x + 4 <= cols; x += 4)
+  {
+    _mm_storeu_ps(out + x, bilateralSse(w, in + x, step, first, last));
+  }
+
+  for(; x < cols; ++x)
+  {
+    out[x] = bilateral(w, in + x, step, first, last);
+  }
+}
+
+/**
+ * First pass, range limit, flying pixels and the horizontal bilateral filter of a row are done while the row is in
+ * the cache.
+ */
+class FilterRows
+{
+public:
+  FilterRows(const DepthFilterConfig& cfg, const cv::Mat& in, cv::Mat& out) :
+    cfg_(cfg),
+    range_(cfg),
+    weights_(cfg),
+    in_(in),
+    out_(out)
+  {
+  }
+
+  void operator()(const tbb::blocked_range<int>& r) const
+  {
+    std::vector<float> row(in_.cols);
+
+    const bool bilateral = weights_.radius > 0;
+
+    for(int y = r.begin(); y < r.end(); ++y)
+    {
+      float* target = bilateral ? &row[0] : out_.ptr<float>(y);
+
+      if(cfg_.MaxDepthJump > 0.0f)
+      {
+        // the rows at the borders are their own vertical neighbours
+        const float* up = in_.ptr<float>(std::max(y - 1, 0));
+        const float* down = in_.ptr<float>(std::min(y + 1, in_.rows - 1));
+
+        removeFlyingPixels(range_, cfg_.MaxDepthJump, up, in_.ptr<float>(y), down, target, in_.cols);
+      }
+      else
+      {
+        limitRange(range_, in_.ptr<float>(y), target, in_.cols);
+      }
+
+      if(bilateral) bilateralRow(weights_, target, out_.ptr<float>(y), in_.cols);
+    }
+  }
+private:
+  const DepthFilterConfig& cfg_;
+  DepthRange range_;
+  BilateralWeights weights_;
+  const cv::Mat& in_;
+  cv::Mat& out_;
+};
+
+// second pass, the vertical bilateral filter
+class FilterColumns
+{
+public:
+  FilterColumns(const DepthFilterConfig& cfg, const cv::Mat& in, cv::Mat& out) :
+    weights_(cfg),
+    in_(in),
+    out_(out)
+  {
+  }
+
+  void operator()(const tbb::blocked_range<int>& r) const
+  {
+    const ptrdiff_t step = in_.step1();
+    const int radius = weights_.radius;
+
+    for(int y = r.begin(); y < r.end(); ++y)
+    {
+      bilateralColumns(weights_, in_.ptr<float>(y), step, out_.ptr<float>(y), in_.cols, -std::min(radius, y), std::min(radius, in_.rows - 1 - y));
+    }
+  }
+private:
+  BilateralWeights weights_;
+  const cv::Mat& in_;
+  cv::Mat& out_;
+};
+
+} /* namespace internal */
+
+void DepthFilter::apply(const DepthFilterConfig& cfg, cv::Mat& depth, cv::Mat& buffer)
+{
+  assert(depth.type() == CV_32FC1);
+
+  if(!cfg.enabled()) return;
+
+  if(!cfg.requiresNeighbourhood())
+  {
+    internal::DepthRange range(cfg);
+
+    for(int y = 0; y < depth.rows; ++y)
+    {
+      internal::limitRange(range, depth.ptr<float>(y), depth.ptr<float>(y), depth.cols);
+    }
+
+    return;
+  }
+
+  buffer.create(depth.size(), CV_32FC1);
+
+  // chunks of rows, the vertical pass reads a few rows of the neighbouring chunks
+  const tbb::blocked_range<int> rows(0, depth.rows, 32);
+
+  tbb::parallel_for(rows, internal::FilterRows(cfg, depth, buffer));
+
+  if(cfg.BilateralRadius > 0)
+  {
+    tbb::parallel_for(rows, internal::FilterColumns(cfg, buffer, depth));
+  }
+  else
+  {
+    std::swap(depth, buffer);
+  }
+}
+
+void DepthFilter::convertRawRow(const DepthFilterConfig& cfg, const uint16_t* raw, float* depth, int cols, float scale)
+{
+  internal::DepthRange range(cfg);
+
+  // raw 0 is below every range, rescaled it stays 0 and fails the lower limit if there is none
+  const __m128 scale_ = _mm_set1_ps(scale);
+  const __m128 min = _mm_set1_ps(std::max(range.min, std::numeric_limits<float>::min()));
+  const __m128 max = _mm_set1_ps(range.max);
+  const __m128 invalid = _mm_set1_ps(InvalidDepth);
+  const __m128i zero = _mm_setzero_si128();
+  int x = 0;
+
+  for(; x + 8 <= cols; x += 8, raw += 8, depth += 8)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*) raw);
+    __m128 lo = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), scale_);
+    __m128 hi = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), scale_);
+
+    __m128 lo_valid = _mm_and_ps(_mm_cmpge_ps(lo, min), _mm_cmple_ps(lo, max));
+    __m128 hi_valid = _mm_and_ps(_mm_cmpge_ps(hi, min), _mm_cmple_ps(hi, max));
+
+    _mm_storeu_ps(depth + 0, _mm_or_ps(_mm_and_ps(lo_valid, lo), _mm_andnot_ps(lo_valid, invalid)));
+    _mm_storeu_ps(depth + 4, _mm_or_ps(_mm_and_ps(hi_valid, hi), _mm_andnot_ps(hi_valid, invalid)));
+  }
+
+  for(; x < cols; ++x, ++raw, ++depth)
+  {
+    *depth = *raw != 0 ? range(float(*raw) * scale) : InvalidDepth;
+  }
+}
+
+} /* namespace core */
+} /* namespace dvo */
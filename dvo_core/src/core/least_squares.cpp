@@ -30,16 +30,48 @@ static const dvo::core::NumType normalizer_inverse = 255.0 * 255.0;
 
 // ------ Normal Equations Cholesky ------
 
+dvo::core::NormalEquationsLeastSquares::NormalEquationsLeastSquares() :
+    block_size_(0),
+    block_constraints_(0)
+{
+}
+
 dvo::core::NormalEquationsLeastSquares::~NormalEquationsLeastSquares() { }
 
+void dvo::core::NormalEquationsLeastSquares::blockSize(size_t block_size)
+{
+  block_size_ = block_size;
+}
+
+size_t dvo::core::NormalEquationsLeastSquares::blockSize() const
+{
+  return block_size_;
+}
+
 void dvo::core::NormalEquationsLeastSquares::initialize(const size_t maxnum_constraints)
 {
   A.setZero();
   A_opt.setZero();
   b.setZero();
+  A_sum.setZero();
+  b_sum.setZero();
   error = 0;
   this->num_constraints = 0;
   this->maxnum_constraints = maxnum_constraints;
+  block_constraints_ = 0;
+}
+
+void dvo::core::NormalEquationsLeastSquares::flush()
+{
+  Matrix6x6 block;
+  A_opt.toEigen(block);
+
+  A_sum += block.cast<double>();
+  b_sum += b.cast<double>();
+
+  A_opt.setZero();
+  b.setZero();
+  block_constraints_ = 0;
 }
 
 void dvo::core::NormalEquationsLeastSquares::update(const dvo::core::Vector6& J, const NumType& res, const NumType& weight)
@@ -53,6 +85,8 @@ void dvo::core::NormalEquationsLeastSquares::update(const dvo::core::Vector6& J,
 
   //error += res * res * factor;
   num_constraints += 1;
+
+  if(block_size_ > 0 && ++block_constraints_ >= block_size_) flush();
 }
 
 void dvo::core::NormalEquationsLeastSquares::update(const Eigen::Matrix<NumType, 2, 6>& J, const Eigen::Matrix<NumType, 2, 1>& res, const Eigen::Matrix<NumType, 2, 2>& weight)
@@ -61,18 +95,38 @@ void dvo::core::NormalEquationsLeastSquares::update(const Eigen::Matrix<NumType,
   b -= J.transpose() * weight * res;
 
   num_constraints += 1;
+
+  if(block_size_ > 0 && ++block_constraints_ >= block_size_) flush();
 }
 
 void dvo::core::NormalEquationsLeastSquares::combine(const dvo::core::NormalEquationsLeastSquares& other)
 {
   A_opt += other.A_opt;
   b += other.b;
+  A_sum += other.A_sum;
+  b_sum += other.b_sum;
   //error += other.error;
   num_constraints += other.num_constraints;
+
+  if(block_size_ > 0)
+  {
+    block_constraints_ += other.block_constraints_;
+
+    if(block_constraints_ >= block_size_) flush();
+  }
 }
 
 void dvo::core::NormalEquationsLeastSquares::finish()
 {
+  if(block_size_ > 0)
+  {
+    flush();
+
+    A = A_sum.cast<NumType>();
+    b = b_sum.cast<NumType>();
+    return;
+  }
+
   A_opt.toEigen(A);
   //A /= (NumType) num_constraints;
   //b /= (NumType) num_constraints;
@@ -113,6 +167,33 @@ void dvo::core::EvdLeastSquares::solve(dvo::core::Vector6& x)
   x = eigenvectors * eigenvalues.asDiagonal() * eigenvectors.transpose() * b;
 }
 
+int dvo::core::solveDegenerate6x6(const dvo::core::Matrix6d& A, const dvo::core::Vector6d& b, dvo::core::Vector6d& x, const double rcond)
+{
+  Eigen::SelfAdjointEigenSolver<dvo::core::Matrix6d> eigensolver(A);
+  dvo::core::Vector6d eigenvalues = eigensolver.eigenvalues();
+
+  // ascending order
+  const double threshold = rcond * std::abs(eigenvalues(5));
+  int dropped = 0;
+
+  for(int i = 0; i < 6; ++i)
+  {
+    if(eigenvalues(i) > threshold)
+    {
+      eigenvalues(i) = 1.0 / eigenvalues(i);
+    }
+    else
+    {
+      eigenvalues(i) = 0.0;
+      dropped++;
+    }
+  }
+
+  x = eigensolver.eigenvectors() * eigenvalues.asDiagonal() * (eigensolver.eigenvectors().transpose() * b);
+
+  return dropped;
+}
+
 // ------ SVD ------
 
 dvo::core::SvdLeastSquares::~SvdLeastSquares() { }
@@ -232,3 +313,69 @@ void dvo::core::PrecomputedNormalEquationsLeastSquares::solve(dvo::core::Vector6
 {
   x = A.ldlt().solve(b);
 }
+
+// ------ Precomputed Normal Equations 2d Cholesky ------
+
+dvo::core::PrecomputedNormalEquationsLeastSquares2d::~PrecomputedNormalEquationsLeastSquares2d() { }
+
+void dvo::core::PrecomputedNormalEquationsLeastSquares2d::initialize(const size_t maxnum_constraints)
+{
+  hessian_ii_.setZero();
+  hessian_id_.setZero();
+  hessian_dd_.setZero();
+  jacobian_cache_.resize(Eigen::NoChange, maxnum_constraints * 6);
+
+  this->num_constraints = 0;
+  this->maxnum_constraints = maxnum_constraints;
+}
+
+void dvo::core::PrecomputedNormalEquationsLeastSquares2d::addConstraint(const size_t& idx, const dvo::core::Matrix2x6& J)
+{
+  hessian_ii_ += J.row(0).transpose() * J.row(0);
+  hessian_id_ += J.row(0).transpose() * J.row(1);
+  hessian_dd_ += J.row(1).transpose() * J.row(1);
+
+  jacobian_cache_.block<2, 6>(0, idx * 6) = J;
+}
+
+void dvo::core::PrecomputedNormalEquationsLeastSquares2d::reset(const Eigen::Matrix<NumType, 2, 2>& precision)
+{
+  precision_ = precision;
+
+  A = precision(0, 0) * hessian_ii_ + precision(0, 1) * (hessian_id_ + hessian_id_.transpose()) + precision(1, 1) * hessian_dd_;
+  b.setZero();
+  error = 0;
+  weight_sum_ = 0;
+
+  num_constraints = 0;
+}
+
+void dvo::core::PrecomputedNormalEquationsLeastSquares2d::ignoreConstraint(const size_t& idx)
+{
+  const Matrix2x6 J = jacobian_cache_.block<2, 6>(0, idx * 6);
+
+  A -= J.transpose() * precision_ * J;
+}
+
+void dvo::core::PrecomputedNormalEquationsLeastSquares2d::setResidualForConstraint(const size_t& idx, const Eigen::Matrix<NumType, 2, 1>& res, const NumType& weight)
+{
+  const Matrix2x6 J = jacobian_cache_.block<2, 6>(0, idx * 6);
+  const Eigen::Matrix<NumType, 2, 1> weighted_res = weight * (precision_ * res);
+
+  b -= J.transpose() * weighted_res;
+
+  error += res.dot(weighted_res);
+  weight_sum_ += weight;
+  num_constraints += 1;
+}
+
+void dvo::core::PrecomputedNormalEquationsLeastSquares2d::finish()
+{
+  if(num_constraints > 0)
+    A *= NumType(weight_sum_ / double(num_constraints));
+}
+
+void dvo::core::PrecomputedNormalEquationsLeastSquares2d::solve(dvo::core::Vector6& x)
+{
+  x = A.ldlt().solve(b);
+}
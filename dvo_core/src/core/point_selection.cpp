@@ -19,6 +19,13 @@
  */
 
 #include <dvo/core/point_selection.h>
+#include <dvo/dense_tracking.h>
+
+#include <algorithm>
+#include <cmath>
+#include <typeinfo>
+
+#include <emmintrin.h>
 
 namespace dvo
 {
@@ -27,14 +34,20 @@ namespace core
 
 PointSelection::PointSelection(const PointSelectionPredicate& predicate) :
     pyramid_(0),
+    revision_(0),
     predicate_(predicate),
+    max_points_(0),
+    morton_order_(false),
     debug_(false)
 {
 }
 
 PointSelection::PointSelection(dvo::core::RgbdImagePyramid& pyramid, const PointSelectionPredicate& predicate) :
     pyramid_(&pyramid),
+    revision_(pyramid.revision()),
     predicate_(predicate),
+    max_points_(0),
+    morton_order_(false),
     debug_(false)
 {
 }
@@ -50,11 +63,21 @@ void PointSelection::recycle(dvo::core::RgbdImagePyramid& pyramid)
 
 void PointSelection::setRgbdImagePyramid(dvo::core::RgbdImagePyramid& pyramid)
 {
+  if(pyramid_ == &pyramid && revision_ == pyramid.revision()) return;
+
   pyramid_ = &pyramid;
+  revision_ = pyramid.revision();
 
+  invalidate();
+}
+
+void PointSelection::invalidate()
+{
   for(size_t idx = 0; idx < storage_.size(); ++idx)
   {
     storage_[idx].is_cached = false;
+    storage_[idx].is_soa_cached = false;
+    storage_[idx].is_jacobian_cached = false;
   }
 }
 
@@ -70,6 +93,33 @@ size_t PointSelection::getMaximumNumberOfPoints(const size_t& level)
   return size_t(pyramid_->level(0).intensity.total() * std::pow(0.25, double(level)));
 }
 
+void PointSelection::maxPointsPerLevel(size_t max_points)
+{
+  if(max_points_ == max_points) return;
+
+  max_points_ = max_points;
+
+  invalidate();
+}
+
+size_t PointSelection::maxPointsPerLevel() const
+{
+  return max_points_;
+}
+
+void PointSelection::mortonOrder(bool v)
+{
+  if(morton_order_ == v) return;
+
+  morton_order_ = v;
+
+  invalidate();
+}
+
+bool PointSelection::mortonOrder() const
+{
+  return morton_order_;
+}
 
 bool PointSelection::getDebugIndex(const size_t& level, cv::Mat& dbg_idx)
 {
@@ -87,6 +137,30 @@ bool PointSelection::getDebugIndex(const size_t& level, cv::Mat& dbg_idx)
 
 
 void PointSelection::select(const size_t& level, const dvo::core::IntrinsicMatrix& intrinsics, PointSelection::PointIterator& first_point, PointSelection::PointIterator& last_point)
+{
+  tbb::mutex::scoped_lock l(cache_mutex_);
+
+  Storage& storage = selectStorage(level);
+
+  first_point = storage.points.begin();
+  last_point = storage.points_end;
+}
+
+size_t PointSelection::memoryUsage() const
+{
+  tbb::mutex::scoped_lock l(cache_mutex_);
+
+  size_t bytes = 0;
+
+  for(std::deque<Storage>::const_iterator it = storage_.begin(); it != storage_.end(); ++it)
+  {
+    bytes += it->memoryUsage();
+  }
+
+  return bytes;
+}
+
+PointSelection::Storage& PointSelection::selectStorage(const size_t& level)
 {
   assert(pyramid_ != 0);
 
@@ -100,46 +174,124 @@ void PointSelection::select(const size_t& level, const dvo::core::IntrinsicMatri
   if(!storage.is_cached || debug_)
   {
     dvo::core::RgbdImage& img = pyramid_->level(level);
-    img.buildPointCloud();
+    // only the points of the selected pixels are computed, the dense cloud is built on demand by whoever needs it
     img.buildAccelerationStructure();
 
     if(debug_)
       storage.debug_idx = cv::Mat::zeros(img.intensity.size(), CV_8UC1);
 
     storage.allocate(img.intensity.total());
-    storage.points_end = selectPointsFromImage(img, storage.points.begin(), storage.points.end(), storage.debug_idx);
+    if(max_points_ > 0)
+      storage.points_end = selectBucketedPointsFromImage(img, storage);
+    else
+      storage.points_end = selectPointsFromImage(img, storage.points.begin(), storage.points.end(), storage.debug_idx);
+
+    if(morton_order_)
+      sortMorton(img, storage);
 
+    storage.num_selected = storage.points_end - storage.points.begin();
     storage.is_cached = true;
+    storage.is_soa_cached = false;
+    storage.is_jacobian_cached = false;
   }
 
-  first_point = storage.points.begin();
-  last_point = storage.points_end;
+  return storage;
 }
 
-PointSelection::PointIterator PointSelection::selectPointsFromImage(const dvo::core::RgbdImage& img, const PointSelection::PointIterator& first_point, const PointSelection::PointIterator& last_point, cv::Mat& debug_idx)
+void PointSelection::select(const size_t& level, const dvo::core::IntrinsicMatrix& intrinsics, const PointWithIntensityAndDepthSoa*& points)
+{
+  tbb::mutex::scoped_lock l(cache_mutex_);
+
+  Storage& storage = selectStorage(level);
+
+  if(!storage.is_soa_cached)
+  {
+    storage.soa_points.assign(storage.points.begin(), storage.points_end);
+    storage.is_soa_cached = true;
+  }
+
+  points = &storage.soa_points;
+}
+
+void PointSelection::select(const size_t& level, const dvo::core::IntrinsicMatrix& intrinsics, PrecomputedNormalEquationsLeastSquares2d*& jacobians)
 {
-  const PointWithIntensityAndDepth::Point *points = (const PointWithIntensityAndDepth::Point *) img.pointcloud.data();
+  tbb::mutex::scoped_lock l(cache_mutex_);
+
+  Storage& storage = selectStorage(level);
+
+  if(!storage.jacobians)
+    storage.jacobians.reset(new PrecomputedNormalEquationsLeastSquares2d());
+
+  if(!storage.is_jacobian_cached)
+  {
+    // same scaling of the derivatives as the residual weights in DenseTracker, but only from the reference image
+    const NumType id_scale_x = intrinsics.fx() / 255.0f, id_scale_y = intrinsics.fy() / 255.0f;
+    const NumType zd_scale_x = intrinsics.fx(), zd_scale_y = intrinsics.fy();
+
+    Matrix2x6 J, Jw;
+    Vector6 Jz;
+
+    storage.jacobians->initialize(storage.points_end - storage.points.begin());
+
+    size_t idx = 0;
+
+    for(PointIterator p_it = storage.points.begin(); p_it != storage.points_end; ++p_it, ++idx)
+    {
+      DenseTracker::computeJacobianOfProjectionAndTransformation(p_it->getPointVec4f(), Jw);
+      DenseTracker::compute3rdRowOfJacobianOfTransformation(p_it->getPointVec4f(), Jz);
+
+      J.row(0) = (id_scale_x * p_it->intensity_and_depth.idx) * Jw.row(0) + (id_scale_y * p_it->intensity_and_depth.idy) * Jw.row(1);
+      J.row(1) = (zd_scale_x * p_it->intensity_and_depth.zdx) * Jw.row(0) + (zd_scale_y * p_it->intensity_and_depth.zdy) * Jw.row(1) - Jz.transpose();
+
+      storage.jacobians->addConstraint(idx, J);
+    }
+
+    storage.is_jacobian_cached = true;
+  }
+
+  jacobians = storage.jacobians.get();
+}
+
+void PointSelection::setAdditionalPoints(const size_t& level, const PointVector& points)
+{
+  tbb::mutex::scoped_lock l(cache_mutex_);
+
+  Storage& storage = selectStorage(level);
+
+  const size_t n = storage.num_selected + points.size();
+
+  if(storage.points.size() < n) storage.points.resize(n);
+
+  std::copy(points.begin(), points.end(), storage.points.begin() + storage.num_selected);
+
+  storage.points_end = storage.points.begin() + n;
+  storage.is_soa_cached = false;
+  storage.is_jacobian_cached = false;
+}
+
+// virtual call per pixel for predicates without a SimdPredicate specialization
+static PointSelection::PointIterator selectPointsFromImageGeneric(const PointSelectionPredicate& predicate, const dvo::core::RgbdImage& img, const PointSelection::PointIterator& first_point, const PointSelection::PointIterator& last_point, const bool debug, cv::Mat& debug_idx)
+{
+  const RgbdCamera& camera = img.camera();
   const PointWithIntensityAndDepth::IntensityAndDepth *intensity_and_depth = img.acceleration.ptr<PointWithIntensityAndDepth::IntensityAndDepth>();
 
   PointWithIntensityAndDepth::VectorType::iterator selected_points_it = first_point;
 
-  //float dt = 1.0f / 30.0f / img.height;
-
   for(int y = 0; y < img.height; ++y)
   {
-    //float time_interpolation = 1 + (y - 0.5f * img.height) * dt;
+    const float row = float(y) / img.height;
 
-    for(int x = 0; x < img.width; ++x, ++points, ++intensity_and_depth)
+    for(int x = 0; x < img.width; ++x, ++intensity_and_depth)
     {
-      if(predicate_.isPointOk(x, y, points->z, intensity_and_depth->idx, intensity_and_depth->idy, intensity_and_depth->zdx, intensity_and_depth->zdy))
+      if(predicate.isPointOk(x, y, intensity_and_depth->z, intensity_and_depth->idx, intensity_and_depth->idy, intensity_and_depth->zdx, intensity_and_depth->zdy))
       {
-        selected_points_it->point = *points;
+        camera.buildPoint(y * img.width + x, intensity_and_depth->z, selected_points_it->point.data);
         selected_points_it->intensity_and_depth = *intensity_and_depth;
-        //selected_points_it->intensity_and_depth.time_interpolation = time_interpolation;
+        selected_points_it->intensity_and_depth.time_interpolation = row;
 
         ++selected_points_it;
 
-        if(debug_)
+        if(debug)
           debug_idx.at<uint8_t>(y, x) = 1;
 
         if(selected_points_it == last_point)
@@ -151,10 +303,341 @@ PointSelection::PointIterator PointSelection::selectPointsFromImage(const dvo::c
   return selected_points_it;
 }
 
+/**
+ * Thresholds of the predicates which can be evaluated by selectPointsFromImageSimd, a pixel is accepted if its point
+ * depth and depth derivatives are valid and |idx|, |idy|, |zdx| or |zdy| exceeds the respective threshold.
+ */
+template<typename TPredicate>
+struct SimdPredicate;
+
+template<>
+struct SimdPredicate<ValidPointPredicate>
+{
+  static __m128 thresholds(const ValidPointPredicate& predicate)
+  {
+    // the absolute value of any valid depth derivative is larger
+    return _mm_set1_ps(-1.0f);
+  }
+};
+
+template<>
+struct SimdPredicate<ValidPointAndGradientThresholdPredicate>
+{
+  static __m128 thresholds(const ValidPointAndGradientThresholdPredicate& predicate)
+  {
+    return _mm_setr_ps(predicate.intensity_threshold, predicate.intensity_threshold, predicate.depth_threshold, predicate.depth_threshold);
+  }
+};
+
+// tests 8 pixels per step with SSE compare masks and stores the accepted ones consecutively, the output range has to
+// hold at least as many points as the image has pixels
+template<typename TPredicate>
+static PointSelection::PointIterator selectPointsFromImageSimd(const TPredicate& predicate, const dvo::core::RgbdImage& img, const PointSelection::PointIterator& first_point, const bool debug, cv::Mat& debug_idx)
+{
+  const float *rays = img.camera().rays().data();
+  const float *intensity_and_depth = img.acceleration.ptr<float>();
+  const int n = img.width * img.height;
+
+  const __m128 thresholds = SimdPredicate<TPredicate>::thresholds(predicate);
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 w = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+
+  PointSelection::PointIterator selected_points_it = first_point;
+
+  int idx = 0;
+
+  for(; idx + 8 <= n; idx += 8)
+  {
+    int mask = 0;
+
+    for(int block = 0; block < 8; block += 4)
+    {
+      const float *ad = intensity_and_depth + (idx + block) * 8;
+
+      // rows: idx, idy, zdx, zdy of 4 pixels
+      __m128 d0 = _mm_loadu_ps(ad +  0 + 2);
+      __m128 d1 = _mm_loadu_ps(ad +  8 + 2);
+      __m128 d2 = _mm_loadu_ps(ad + 16 + 2);
+      __m128 d3 = _mm_loadu_ps(ad + 24 + 2);
+      _MM_TRANSPOSE4_PS(d0, d1, d2, d3);
+
+      // depth of 4 pixels, from the i, z pairs
+      __m128 z01 = _mm_unpacklo_ps(_mm_loadu_ps(ad + 0), _mm_loadu_ps(ad + 8));
+      __m128 z23 = _mm_unpacklo_ps(_mm_loadu_ps(ad + 16), _mm_loadu_ps(ad + 24));
+      __m128 z = _mm_movehl_ps(z23, z01);
+
+      __m128 valid = _mm_and_ps(_mm_cmpord_ps(z, z), _mm_cmpord_ps(d2, d3));
+
+      __m128 gradient = _mm_or_ps(
+          _mm_or_ps(_mm_cmpgt_ps(_mm_and_ps(d0, abs_mask), _mm_shuffle_ps(thresholds, thresholds, _MM_SHUFFLE(0, 0, 0, 0))), _mm_cmpgt_ps(_mm_and_ps(d1, abs_mask), _mm_shuffle_ps(thresholds, thresholds, _MM_SHUFFLE(1, 1, 1, 1)))),
+          _mm_or_ps(_mm_cmpgt_ps(_mm_and_ps(d2, abs_mask), _mm_shuffle_ps(thresholds, thresholds, _MM_SHUFFLE(2, 2, 2, 2))), _mm_cmpgt_ps(_mm_and_ps(d3, abs_mask), _mm_shuffle_ps(thresholds, thresholds, _MM_SHUFFLE(3, 3, 3, 3))))
+      );
+
+      mask |= _mm_movemask_ps(_mm_and_ps(valid, gradient)) << block;
+    }
+
+    // compress store of the accepted pixels
+    while(mask != 0)
+    {
+      const int k = idx + __builtin_ctz(mask);
+      const float *ad = intensity_and_depth + k * 8;
+
+      // the depth of accepted pixels is valid, so w = 0 * z stays 0
+      _mm_store_ps(selected_points_it->point.data, _mm_add_ps(_mm_mul_ps(_mm_load_ps(rays + k * 4), _mm_set1_ps(ad[1])), w));
+      _mm_store_ps(selected_points_it->intensity_and_depth.data, _mm_loadu_ps(ad));
+      _mm_store_ps(selected_points_it->intensity_and_depth.data + 4, _mm_loadu_ps(ad + 4));
+      selected_points_it->intensity_and_depth.time_interpolation = float(k / img.width) / img.height;
+      ++selected_points_it;
+
+      if(debug)
+        debug_idx.at<uint8_t>(k / img.width, k % img.width) = 1;
+
+      mask &= mask - 1;
+    }
+  }
+
+  const PointWithIntensityAndDepth::IntensityAndDepth *tail_intensity_and_depth = img.acceleration.ptr<PointWithIntensityAndDepth::IntensityAndDepth>();
+
+  for(; idx < n; ++idx)
+  {
+    const PointWithIntensityAndDepth::IntensityAndDepth& d = tail_intensity_and_depth[idx];
+
+    if(predicate.TPredicate::isPointOk(idx % img.width, idx / img.width, d.z, d.idx, d.idy, d.zdx, d.zdy))
+    {
+      img.camera().buildPoint(idx, d.z, selected_points_it->point.data);
+      selected_points_it->intensity_and_depth = d;
+      selected_points_it->intensity_and_depth.time_interpolation = float(idx / img.width) / img.height;
+      ++selected_points_it;
+
+      if(debug)
+        debug_idx.at<uint8_t>(idx / img.width, idx % img.width) = 1;
+    }
+  }
+
+  return selected_points_it;
+}
+
+PointSelection::PointIterator PointSelection::selectPointsFromImage(const dvo::core::RgbdImage& img, const PointSelection::PointIterator& first_point, const PointSelection::PointIterator& last_point, cv::Mat& debug_idx)
+{
+  const bool fits = size_t(last_point - first_point) >= size_t(img.width * img.height);
+
+  // exact type comparison, a derived predicate could override isPointOk
+  if(fits && typeid(predicate_) == typeid(ValidPointAndGradientThresholdPredicate))
+    return selectPointsFromImageSimd(static_cast<const ValidPointAndGradientThresholdPredicate&>(predicate_), img, first_point, debug_, debug_idx);
+
+  if(fits && typeid(predicate_) == typeid(ValidPointPredicate))
+    return selectPointsFromImageSimd(static_cast<const ValidPointPredicate&>(predicate_), img, first_point, debug_, debug_idx);
+
+  return selectPointsFromImageGeneric(predicate_, img, first_point, last_point, debug_, debug_idx);
+}
+
+// interleaves the lower 16 bits of x and y, x in the even bits
+static inline uint32_t mortonCode(uint32_t x, uint32_t y)
+{
+  uint32_t v[2] = { x & 0xffff, y & 0xffff };
+
+  for(int i = 0; i < 2; ++i)
+  {
+    v[i] = (v[i] | (v[i] << 8)) & 0x00ff00ff;
+    v[i] = (v[i] | (v[i] << 4)) & 0x0f0f0f0f;
+    v[i] = (v[i] | (v[i] << 2)) & 0x33333333;
+    v[i] = (v[i] | (v[i] << 1)) & 0x55555555;
+  }
+
+  return v[0] | (v[1] << 1);
+}
+
+void PointSelection::sortMorton(const dvo::core::RgbdImage& img, PointSelection::Storage& storage)
+{
+  const IntrinsicMatrix& intrinsics = img.camera().intrinsics();
+  const float fx = intrinsics.fx(), fy = intrinsics.fy(), ox = intrinsics.ox(), oy = intrinsics.oy();
+  const size_t n = storage.points_end - storage.points.begin();
+
+  std::vector<uint64_t>& order = storage.order;
+  order.resize(n);
+
+  // the pixel is recovered from the point, which is its ray scaled by the depth
+  for(size_t idx = 0; idx < n; ++idx)
+  {
+    const float* p = storage.points[idx].point.data;
+    const uint32_t x = uint32_t(p[0] / p[2] * fx + ox + 0.5f), y = uint32_t(p[1] / p[2] * fy + oy + 0.5f);
+
+    order[idx] = (uint64_t(mortonCode(x, y)) << 32) | idx;
+  }
+
+  std::sort(order.begin(), order.end());
+
+  // point idx receives the one at the index in the lower bits of order[idx], the permutation is applied in place by
+  // following its cycles, finished entries point to themselves
+  for(size_t idx = 0; idx < n; ++idx)
+  {
+    size_t j = idx, k = size_t(order[j] & 0xffffffff);
+
+    if(k == idx) continue;
+
+    const PointWithIntensityAndDepth first = storage.points[idx];
+
+    while(k != idx)
+    {
+      storage.points[j] = storage.points[k];
+      order[j] = j;
+      j = k;
+      k = size_t(order[j] & 0xffffffff);
+    }
+
+    storage.points[j] = first;
+    order[j] = j;
+  }
+}
+
+struct ScoreGreater
+{
+  const float* scores;
+
+  ScoreGreater(const float* scores) : scores(scores) {}
+
+  bool operator()(const int& a, const int& b) const
+  {
+    return scores[a] > scores[b];
+  }
+};
+
+PointSelection::PointIterator PointSelection::selectBucketedPointsFromImage(const dvo::core::RgbdImage& img, PointSelection::Storage& storage)
+{
+  const RgbdCamera& camera = img.camera();
+  const PointWithIntensityAndDepth::IntensityAndDepth *intensity_and_depth = img.acceleration.ptr<PointWithIntensityAndDepth::IntensityAndDepth>();
+
+  // about four points per cell if the texture is uniform
+  const int cell_size = std::max(4, int(std::sqrt(4.0 * img.width * img.height / max_points_)));
+  const int cells_x = (img.width + cell_size - 1) / cell_size;
+  const int cells_y = (img.height + cell_size - 1) / cell_size;
+  const int num_cells = cells_x * cells_y;
+
+  std::vector<int> &pixels = storage.pixels, &cells = storage.cells, &candidates = storage.candidates, &selected = storage.selected;
+  std::vector<int> &offsets = storage.cell_offsets, &cursor = storage.cell_cursor;
+  std::vector<float> &scores = storage.scores;
+
+  pixels.clear();
+  cells.clear();
+  scores.clear();
+  selected.clear();
+  offsets.assign(num_cells + 1, 0);
+
+  // accepted points in raster order
+  for(int y = 0, idx = 0; y < img.height; ++y)
+  {
+    const int cell_row = (y / cell_size) * cells_x;
+
+    for(int x = 0; x < img.width; ++x, ++idx)
+    {
+      const PointWithIntensityAndDepth::IntensityAndDepth& d = intensity_and_depth[idx];
+
+      if(predicate_.isPointOk(x, y, d.z, d.idx, d.idy, d.zdx, d.zdy))
+      {
+        const int cell = cell_row + x / cell_size;
+
+        pixels.push_back(idx);
+        cells.push_back(cell);
+        scores.push_back(d.idx * d.idx + d.idy * d.idy);
+        offsets[cell + 1]++;
+      }
+    }
+  }
+
+  if(pixels.size() <= max_points_)
+  {
+    selected.resize(pixels.size());
+
+    for(size_t k = 0; k < pixels.size(); ++k) selected[k] = k;
+  }
+  else
+  {
+    int max_count = 0;
+
+    for(int c = 0; c < num_cells; ++c)
+    {
+      max_count = std::max(max_count, offsets[c + 1]);
+      offsets[c + 1] += offsets[c];
+    }
+
+    // bucket the candidates by cell
+    candidates.resize(pixels.size());
+    cursor.assign(offsets.begin(), offsets.end() - 1);
+
+    for(size_t k = 0; k < pixels.size(); ++k) candidates[cursor[cells[k]]++] = k;
+
+    // smallest quota per cell which fills the budget, cells with less candidates contribute all of them
+    int lo = 1, hi = max_count;
+
+    while(lo < hi)
+    {
+      const int q = (lo + hi) / 2;
+      size_t n = 0;
+
+      for(int c = 0; c < num_cells && n < max_points_; ++c) n += std::min(offsets[c + 1] - offsets[c], q);
+
+      if(n >= max_points_)
+        hi = q;
+      else
+        lo = q + 1;
+    }
+
+    const int quota = lo;
+    ScoreGreater greater(scores.data());
+
+    // every cell keeps its best quota - 1 candidates, the remaining budget goes to the best of the quota-th ones
+    cursor.clear();
+
+    for(int c = 0; c < num_cells; ++c)
+    {
+      std::vector<int>::iterator begin = candidates.begin() + offsets[c], end = candidates.begin() + offsets[c + 1];
+
+      if(end - begin >= quota)
+      {
+        std::nth_element(begin, begin + (quota - 1), end, greater);
+        selected.insert(selected.end(), begin, begin + (quota - 1));
+        cursor.push_back(*(begin + (quota - 1)));
+      }
+      else
+      {
+        selected.insert(selected.end(), begin, end);
+      }
+    }
+
+    const size_t remaining = max_points_ - selected.size();
+
+    if(remaining < cursor.size()) std::nth_element(cursor.begin(), cursor.begin() + remaining, cursor.end(), greater);
+
+    selected.insert(selected.end(), cursor.begin(), cursor.begin() + std::min(remaining, cursor.size()));
+
+    // back to raster order for the memory access pattern of the warping
+    std::sort(selected.begin(), selected.end());
+  }
+
+  PointIterator selected_points_it = storage.points.begin();
+
+  for(std::vector<int>::const_iterator it = selected.begin(); it != selected.end(); ++it, ++selected_points_it)
+  {
+    const int idx = pixels[*it];
+
+    camera.buildPoint(idx, intensity_and_depth[idx].z, selected_points_it->point.data);
+    selected_points_it->intensity_and_depth = intensity_and_depth[idx];
+    selected_points_it->intensity_and_depth.time_interpolation = float(idx / img.width) / img.height;
+
+    if(debug_)
+      storage.debug_idx.at<uint8_t>(idx / img.width, idx % img.width) = 1;
+  }
+
+  return selected_points_it;
+}
+
 PointSelection::Storage::Storage() :
     points(),
     points_end(points.end()),
-    is_cached(false)
+    is_cached(false),
+    num_selected(0),
+    is_soa_cached(false),
+    is_jacobian_cached(false)
 {
 }
 
@@ -166,6 +649,21 @@ void PointSelection::Storage::allocate(size_t max_points)
   }
 }
 
+size_t PointSelection::Storage::memoryUsage() const
+{
+  size_t bytes = points.capacity() * sizeof(PointWithIntensityAndDepth);
+  bytes += soa_points.capacity() * PointWithIntensityAndDepthSoa::NumChannels * sizeof(float);
+
+  if(jacobians) bytes += sizeof(PrecomputedNormalEquationsLeastSquares2d) + jacobians->maxnum_constraints * 12 * sizeof(NumType);
+  if(!debug_idx.empty()) bytes += debug_idx.step[0] * debug_idx.rows;
+
+  bytes += scores.capacity() * sizeof(float);
+  bytes += (pixels.capacity() + cells.capacity() + candidates.capacity() + cell_offsets.capacity() + cell_cursor.capacity() + selected.capacity()) * sizeof(int);
+  bytes += order.capacity() * sizeof(uint64_t);
+
+  return bytes;
+}
+
 
 } /* namespace core */
 } /* namespace dvo */
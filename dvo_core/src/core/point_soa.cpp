@@ -0,0 +1,106 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo/core/point_soa.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace dvo
+{
+namespace core
+{
+
+const size_t PointWithIntensityAndDepthSoa::Alignment;
+
+PointWithIntensityAndDepthSoa::PointWithIntensityAndDepthSoa() :
+    size_(0),
+    stride_(0)
+{
+  resize(0);
+}
+
+PointWithIntensityAndDepthSoa::~PointWithIntensityAndDepthSoa()
+{
+}
+
+void PointWithIntensityAndDepthSoa::reserve(size_t num_points)
+{
+  // never empty, so channel() always returns a valid pointer
+  size_t stride = (std::max(num_points, Alignment) + Alignment - 1) / Alignment * Alignment;
+
+  if(stride <= stride_) return;
+
+  FloatVector data(NumChannels * stride);
+
+  for(size_t c = 0; c < NumChannels; ++c)
+  {
+    std::copy(data_.begin() + c * stride_, data_.begin() + c * stride_ + size_, data.begin() + c * stride);
+  }
+
+  data_.swap(data);
+  stride_ = stride;
+}
+
+void PointWithIntensityAndDepthSoa::resize(size_t num_points)
+{
+  reserve(num_points);
+  size_ = num_points;
+
+  pad();
+}
+
+void PointWithIntensityAndDepthSoa::pad()
+{
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const size_t padded = paddedSize();
+
+  for(size_t c = 0; c < NumChannels; ++c)
+  {
+    float* ptr = channel(Channel(c));
+    std::fill(ptr + size_, ptr + padded, c <= Z ? nan : 0.0f);
+  }
+}
+
+void PointWithIntensityAndDepthSoa::assign(const PointWithIntensityAndDepth::VectorType::const_iterator& first_point, const PointWithIntensityAndDepth::VectorType::const_iterator& last_point)
+{
+  resize(last_point - first_point);
+
+  float *x = channel(X), *y = channel(Y), *z = channel(Z);
+  float *i = channel(Intensity), *d = channel(Depth);
+  float *idx = channel(IntensityDx), *idy = channel(IntensityDy), *zdx = channel(DepthDx), *zdy = channel(DepthDy);
+
+  for(PointWithIntensityAndDepth::VectorType::const_iterator it = first_point; it != last_point; ++it, ++x, ++y, ++z, ++i, ++d, ++idx, ++idy, ++zdx, ++zdy)
+  {
+    *x = it->point.x;
+    *y = it->point.y;
+    *z = it->point.z;
+
+    *i = it->intensity_and_depth.i;
+    *d = it->intensity_and_depth.z;
+    *idx = it->intensity_and_depth.idx;
+    *idy = it->intensity_and_depth.idy;
+    *zdx = it->intensity_and_depth.zdx;
+    *zdy = it->intensity_and_depth.zdy;
+  }
+}
+
+} /* namespace core */
+} /* namespace dvo */
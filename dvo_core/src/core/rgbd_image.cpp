@@ -21,11 +21,22 @@
 #include <dvo/core/rgbd_image.h>
 
 #include <assert.h>
+#include <algorithm>
+#include <limits>
 
 #include <boost/shared_ptr.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/bind.hpp>
+
+#include <tbb/atomic.h>
+#include <tbb/parallel_invoke.h>
+
+#include <immintrin.h>
 
 #include <dvo/core/interpolation.h>
+#include <dvo/util/cpu_features.h>
+
+#include "rgbd_image_acceleration.h"
 
 //#include "../util.h"
 //#include "../stopwatch.h"
@@ -138,12 +149,167 @@ static void pyrDownSubsample(const cv::Mat& in, cv::Mat& out)
   }
 }
 
+// sse versions of the float kernels above, every iteration computes 4 output pixels from 2x8 input pixels
+
+static void pyrDownMeanSmoothSse(const cv::Mat& in, cv::Mat& out)
+{
+  out.create(cv::Size(in.size().width / 2, in.size().height / 2), in.type());
+
+  const __m128 quarter = _mm_set1_ps(0.25f);
+  const int vectorized_cols = out.cols & ~3;
+
+  for(int y = 0; y < out.rows; ++y)
+  {
+    const float *in0 = in.ptr<float>(y * 2), *in1 = in.ptr<float>(y * 2 + 1);
+    float *o = out.ptr<float>(y);
+
+    for(int x = 0; x < vectorized_cols; x += 4, in0 += 8, in1 += 8, o += 4)
+    {
+      // hadd sums horizontally neighbouring pixels
+      __m128 sum0 = _mm_hadd_ps(_mm_loadu_ps(in0), _mm_loadu_ps(in0 + 4));
+      __m128 sum1 = _mm_hadd_ps(_mm_loadu_ps(in1), _mm_loadu_ps(in1 + 4));
+
+      _mm_storeu_ps(o, _mm_mul_ps(_mm_add_ps(sum0, sum1), quarter));
+    }
+
+    for(int x = vectorized_cols; x < out.cols; ++x, in0 += 2, in1 += 2, ++o)
+    {
+      *o = (in0[0] + in0[1] + in1[0] + in1[1]) / 4.0f;
+    }
+  }
+}
+
+static void pyrDownSubsampleSse(const cv::Mat& in, cv::Mat& out)
+{
+  out.create(cv::Size(in.size().width / 2, in.size().height / 2), in.type());
+
+  const int vectorized_cols = out.cols & ~3;
+
+  for(int y = 0; y < out.rows; ++y)
+  {
+    const float *i = in.ptr<float>(y * 2);
+    float *o = out.ptr<float>(y);
+
+    for(int x = 0; x < vectorized_cols; x += 4, i += 8, o += 4)
+    {
+      _mm_storeu_ps(o, _mm_shuffle_ps(_mm_loadu_ps(i), _mm_loadu_ps(i + 4), _MM_SHUFFLE(2, 0, 2, 0)));
+    }
+
+    for(int x = vectorized_cols; x < out.cols; ++x, i += 2, ++o)
+    {
+      *o = *i;
+    }
+  }
+}
+
+// a coarse pixel is masked, i.e., 0, if any of the pixels it covers is
+static void pyrDownMask(const cv::Mat& in, cv::Mat& out)
+{
+  out.create(cv::Size(in.size().width / 2, in.size().height / 2), CV_8UC1);
+
+  for(int y = 0; y < out.rows; ++y)
+  {
+    const uint8_t *i0 = in.ptr<uint8_t>(y * 2), *i1 = in.ptr<uint8_t>(y * 2 + 1);
+    uint8_t *o = out.ptr<uint8_t>(y);
+
+    for(int x = 0; x < out.cols; ++x, i0 += 2, i1 += 2, ++o)
+    {
+      *o = std::min(std::min(i0[0], i0[1]), std::min(i1[0], i1[1]));
+    }
+  }
+}
+
+static void buildIntensityPyramid(std::vector<RgbdImagePtr>& levels, size_t first, size_t last)
+{
+  for(size_t idx = first; idx < last; ++idx)
+  {
+    pyrDownMeanSmoothSse(levels[idx - 1]->intensity, levels[idx]->intensity);
+  }
+}
+
+static void buildDepthPyramid(std::vector<RgbdImagePtr>& levels, size_t first, size_t last)
+{
+  for(size_t idx = first; idx < last; ++idx)
+  {
+    pyrDownSubsampleSse(levels[idx - 1]->depth, levels[idx]->depth);
+  }
+}
+
+// same fixed point weights and rounding as cv::cvtColor(CV_BGR2GRAY), so results don't change
+static const int GrayShift = 14, GrayB = 1868, GrayG = 9617, GrayR = 4899;
+
+static void convertBgrRowToIntensitySse(const uint8_t* bgr, float* intensity, int cols)
+{
+  const __m128i bg_weights = _mm_setr_epi16(GrayB, GrayG, GrayB, GrayG, GrayB, GrayG, GrayB, GrayG);
+  const __m128i r_weights = _mm_setr_epi16(GrayR, 1, GrayR, 1, GrayR, 1, GrayR, 1);
+  const short round = 1 << (GrayShift - 1);
+  int x = 0;
+
+  // SSE2 has no byte shuffle, the channels are gathered into 16 bit pairs with scalar loads
+  for(; x + 4 <= cols; x += 4, bgr += 12, intensity += 4)
+  {
+    __m128i bg = _mm_setr_epi16(bgr[0], bgr[1], bgr[3], bgr[4], bgr[6], bgr[7], bgr[9], bgr[10]);
+    // r * GrayR + round * 1 in one madd
+    __m128i r1 = _mm_setr_epi16(bgr[2], round, bgr[5], round, bgr[8], round, bgr[11], round);
+
+    __m128i gray = _mm_add_epi32(_mm_madd_epi16(bg, bg_weights), _mm_madd_epi16(r1, r_weights));
+    gray = _mm_srai_epi32(gray, GrayShift);
+
+    _mm_storeu_ps(intensity, _mm_cvtepi32_ps(gray));
+  }
+
+  for(; x < cols; ++x, bgr += 3, ++intensity)
+  {
+    *intensity = float((bgr[0] * GrayB + bgr[1] * GrayG + bgr[2] * GrayR + (1 << (GrayShift - 1))) >> GrayShift);
+  }
+}
+
+static void convertMonoRowToIntensitySse(const uint8_t* mono, float* intensity, int cols)
+{
+  const __m128i zero = _mm_setzero_si128();
+  int x = 0;
+
+  for(; x + 16 <= cols; x += 16, mono += 16, intensity += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*) mono);
+    __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+
+    _mm_storeu_ps(intensity +  0, _mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)));
+    _mm_storeu_ps(intensity +  4, _mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)));
+    _mm_storeu_ps(intensity +  8, _mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)));
+    _mm_storeu_ps(intensity + 12, _mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)));
+  }
+
+  for(; x < cols; ++x, ++mono, ++intensity)
+  {
+    *intensity = float(*mono);
+  }
+}
+
+// unique across all pyramids, so a pooled pyramid never repeats the revision of its previous images
+static uint64_t nextRevision()
+{
+  static tbb::atomic<uint64_t> revision;
+
+  return ++revision;
+}
+
 RgbdImagePyramid::RgbdImagePyramid(const RgbdCameraPyramid& camera, const cv::Mat& intensity, const cv::Mat& depth) :
-    camera_(camera)
+    camera_(camera),
+    num_levels_(1),
+    revision_(nextRevision())
 {
   levels_.push_back(camera_.level(0).create(intensity, depth));
 }
 
+RgbdImagePyramid::RgbdImagePyramid(const RgbdCameraPyramid& camera) :
+    camera_(camera),
+    num_levels_(1),
+    revision_(nextRevision())
+{
+  levels_.push_back(camera_.level(0).create());
+}
+
 RgbdImagePyramid::~RgbdImagePyramid()
 {
 }
@@ -155,34 +321,184 @@ void RgbdImagePyramid::compute(const size_t num_levels)
 
 void RgbdImagePyramid::build(const size_t num_levels)
 {
-  if(levels_.size() >= num_levels) return;
+  if(num_levels_ >= num_levels) return;
 
   // if we already have some levels, we just need to compute the coarser levels
-  size_t first = levels_.size();
+  size_t first = num_levels_;
 
-  for(size_t idx = first; idx < num_levels; ++idx)
+  // levels left over from before a reset() are reused
+  for(size_t idx = levels_.size(); idx < num_levels; ++idx)
   {
     levels_.push_back(camera_.level(idx).create());
+  }
 
-    pyrDownMeanSmooth<IntensityType>(levels_[idx - 1]->intensity, levels_[idx]->intensity);
-    //pyrDownMeanSmoothIgnoreInvalid<float>(levels[idx - 1].depth, levels[idx].depth);
-    pyrDownSubsample<float>(levels_[idx - 1]->depth, levels_[idx]->depth);
+  // the intensity and depth pyramids don't depend on each other
+  tbb::parallel_invoke(
+      boost::bind(&buildIntensityPyramid, boost::ref(levels_), first, num_levels),
+      boost::bind(&buildDepthPyramid, boost::ref(levels_), first, num_levels)
+  );
+
+  for(size_t idx = first; idx < num_levels; ++idx)
+  {
     levels_[idx]->initialize();
   }
+
+  for(size_t idx = std::max<size_t>(first, 1); idx < num_levels; ++idx)
+  {
+    if(!levels_[idx - 1]->mask.empty())
+      pyrDownMask(levels_[idx - 1]->mask, levels_[idx]->mask);
+    else
+      levels_[idx]->mask.release();
+  }
+
+  num_levels_ = num_levels;
+}
+
+void RgbdImagePyramid::reset(const cv::Mat& intensity, const cv::Mat& depth)
+{
+  for(size_t idx = 0; idx < levels_.size(); ++idx)
+  {
+    levels_[idx]->recycle();
+  }
+
+  RgbdImage& base = *levels_[0];
+  base.intensity = intensity;
+  base.depth = depth;
+  base.initialize();
+
+  num_levels_ = 1;
+  revision_ = nextRevision();
+}
+
+void RgbdImagePyramid::release(const size_t num_levels)
+{
+  for(size_t idx = 0; idx < std::min(num_levels, levels_.size()); ++idx)
+  {
+    levels_[idx]->release();
+  }
+}
+
+void RgbdImagePyramid::ingest(const cv::Mat& color, const cv::Mat& raw_depth, float depth_scale, bool with_rgb)
+{
+  assert(color.size() == raw_depth.size());
+
+  for(size_t idx = 0; idx < levels_.size(); ++idx)
+  {
+    levels_[idx]->recycle();
+  }
+
+  RgbdImage& base = *levels_[0];
+
+  const bool convert_color = color.type() == CV_8UC3 || color.type() == CV_8UC1;
+  const bool convert_depth = raw_depth.type() == CV_16UC1;
+
+  const DepthFilterConfig& depth_filter = camera_.depthFilter();
+
+  if(convert_color)
+  {
+    base.intensity.create(color.size(), cv::DataType<IntensityType>::type);
+  }
+  else if(color.type() == cv::DataType<IntensityType>::type)
+  {
+    base.intensity = color;
+  }
+  else
+  {
+    color.convertTo(base.intensity, cv::DataType<IntensityType>::type);
+  }
+
+  if(convert_depth)
+  {
+    base.depth.create(raw_depth.size(), cv::DataType<DepthType>::type);
+  }
+  else if(raw_depth.type() == cv::DataType<DepthType>::type)
+  {
+    // the filter works in place
+    if(depth_filter.enabled())
+      raw_depth.copyTo(base.depth);
+    else
+      base.depth = raw_depth;
+  }
+  else
+  {
+    raw_depth.convertTo(base.depth, cv::DataType<DepthType>::type);
+  }
+
+  // color and depth rows are converted together, so both stay in cache
+  for(int y = 0; y < color.rows; ++y)
+  {
+    if(convert_color)
+    {
+      if(color.channels() == 3)
+      {
+        convertBgrRowToIntensitySse(color.ptr<uint8_t>(y), base.intensity.ptr<float>(y), color.cols);
+      }
+      else
+      {
+        convertMonoRowToIntensitySse(color.ptr<uint8_t>(y), base.intensity.ptr<float>(y), color.cols);
+      }
+    }
+
+    if(convert_depth)
+    {
+      // messages usually don't have aligned rows
+      DepthFilter::convertRawRow(depth_filter, raw_depth.ptr<uint16_t>(y), base.depth.ptr<float>(y), raw_depth.cols, depth_scale);
+    }
+  }
+
+  // the conversion already limited the range
+  if(depth_filter.requiresNeighbourhood() || (!convert_depth && depth_filter.enabled()))
+  {
+    DepthFilter::apply(depth_filter, base.depth, depth_buffer_);
+  }
+
+  if(with_rgb && color.channels() == 3)
+  {
+    color.convertTo(base.rgb, CV_32FC3);
+  }
+
+  base.initialize();
+
+  num_levels_ = 1;
+  revision_ = nextRevision();
+}
+
+void RgbdImagePyramid::setMask(const cv::Mat& mask)
+{
+  assert(num_levels_ == 1 && (mask.empty() || (mask.type() == CV_8UC1 && mask.cols == levels_[0]->width && mask.rows == levels_[0]->height)));
+
+  levels_[0]->mask = mask;
 }
 
 RgbdImage& RgbdImagePyramid::level(size_t idx)
 {
-  assert(idx < levels_.size());
+  assert(idx < num_levels_);
 
   return *levels_[idx];
 }
 
+size_t RgbdImagePyramid::memoryUsage() const
+{
+  size_t bytes = depth_buffer_.empty() ? 0 : depth_buffer_.step[0] * depth_buffer_.rows;
+
+  for(std::vector<RgbdImagePtr>::const_iterator it = levels_.begin(); it != levels_.end(); ++it)
+  {
+    bytes += (*it)->memoryUsage();
+  }
+
+  return bytes;
+}
+
 double RgbdImagePyramid::timestamp() const
 {
   return !levels_.empty() ? levels_[0]->timestamp: 0.0;
 }
 
+uint64_t RgbdImagePyramid::revision() const
+{
+  return revision_;
+}
+
 RgbdCamera::RgbdCamera(size_t width, size_t height, const IntrinsicMatrix& intrinsics) :
     width_(width),
     height_(height),
@@ -244,29 +560,64 @@ bool RgbdCamera::hasSameSize(const cv::Mat& img) const
 
 void RgbdCamera::buildPointCloud(const cv::Mat &depth, PointCloud& pointcloud) const
 {
-  assert(hasSameSize(depth));
+  assert(hasSameSize(depth) && depth.isContinuous());
 
   pointcloud.resize(Eigen::NoChange, width_ * height_);
 
+  const __m128 xyz_mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+  const __m128 w = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+
   const float* depth_ptr = depth.ptr<float>();
+  const float* ray = pointcloud_template_.data();
+  float* point = pointcloud.data();
+
+  const int n = width_ * height_;
   int idx = 0;
 
-  for(size_t y = 0; y < height_; ++y)
+  // the cloud is usually read much later, if at all, so it doesn't have to pollute the cache
+  for(; idx + 4 <= n; idx += 4, ray += 16, point += 16)
   {
-    for(size_t x = 0; x < width_; ++x, ++depth_ptr, ++idx)
-    {
-      pointcloud.col(idx) = pointcloud_template_.col(idx) * (*depth_ptr);
-      pointcloud(3, idx) = 1.0;
-    }
+    const __m128 z = _mm_loadu_ps(depth_ptr + idx);
+
+    _mm_stream_ps(point +  0, _mm_or_ps(_mm_and_ps(_mm_mul_ps(_mm_load_ps(ray +  0), _mm_shuffle_ps(z, z, _MM_SHUFFLE(0, 0, 0, 0))), xyz_mask), w));
+    _mm_stream_ps(point +  4, _mm_or_ps(_mm_and_ps(_mm_mul_ps(_mm_load_ps(ray +  4), _mm_shuffle_ps(z, z, _MM_SHUFFLE(1, 1, 1, 1))), xyz_mask), w));
+    _mm_stream_ps(point +  8, _mm_or_ps(_mm_and_ps(_mm_mul_ps(_mm_load_ps(ray +  8), _mm_shuffle_ps(z, z, _MM_SHUFFLE(2, 2, 2, 2))), xyz_mask), w));
+    _mm_stream_ps(point + 12, _mm_or_ps(_mm_and_ps(_mm_mul_ps(_mm_load_ps(ray + 12), _mm_shuffle_ps(z, z, _MM_SHUFFLE(3, 3, 3, 3))), xyz_mask), w));
+  }
+
+  _mm_sfence();
+
+  for(; idx < n; ++idx, point += 4)
+  {
+    buildPoint(idx, depth_ptr[idx], point);
   }
 }
 
-RgbdCameraPyramid::RgbdCameraPyramid(const RgbdCamera& base)
+const PointCloud& RgbdCamera::rays() const
+{
+  return pointcloud_template_;
+}
+
+const cv::Mat& RgbdCamera::mask() const
+{
+  return mask_;
+}
+
+void RgbdCamera::mask(const cv::Mat& mask)
+{
+  assert(mask.empty() || (mask.type() == CV_8UC1 && hasSameSize(mask)));
+
+  mask_ = mask;
+}
+
+RgbdCameraPyramid::RgbdCameraPyramid(const RgbdCamera& base) :
+    pool_size_(0)
 {
   levels_.push_back(boost::make_shared<RgbdCamera>(base));
 }
 
-RgbdCameraPyramid::RgbdCameraPyramid(size_t base_width, size_t base_height, const dvo::core::IntrinsicMatrix& base_intrinsics)
+RgbdCameraPyramid::RgbdCameraPyramid(size_t base_width, size_t base_height, const dvo::core::IntrinsicMatrix& base_intrinsics) :
+    pool_size_(0)
 {
   levels_.push_back(boost::make_shared<RgbdCamera>(base_width, base_height, base_intrinsics));
 }
@@ -277,7 +628,74 @@ RgbdCameraPyramid::~RgbdCameraPyramid()
 
 RgbdImagePyramidPtr RgbdCameraPyramid::create(const cv::Mat& base_intensity, const cv::Mat& base_depth)
 {
-  return boost::make_shared<RgbdImagePyramid>(*this, base_intensity, base_depth);
+  tbb::mutex::scoped_lock l(pool_mutex_);
+
+  RgbdImagePyramidPtr result = findRecyclable();
+
+  if(result)
+  {
+    result->reset(base_intensity, base_depth);
+  }
+  else
+  {
+    result = boost::make_shared<RgbdImagePyramid>(*this, base_intensity, base_depth);
+    addToPool(result);
+  }
+
+  return result;
+}
+
+RgbdImagePyramidPtr RgbdCameraPyramid::create(const cv::Mat& color, const cv::Mat& raw_depth, float depth_scale, bool with_rgb)
+{
+  RgbdImagePyramidPtr result;
+
+  {
+    tbb::mutex::scoped_lock l(pool_mutex_);
+
+    result = findRecyclable();
+
+    if(!result)
+    {
+      result = boost::make_shared<RgbdImagePyramid>(*this);
+      addToPool(result);
+    }
+  }
+
+  // result is referenced by us and the pool, so nobody else can pick it up while we convert
+  result->ingest(color, raw_depth, depth_scale, with_rgb);
+
+  return result;
+}
+
+RgbdImagePyramidPtr RgbdCameraPyramid::findRecyclable()
+{
+  // a pyramid only referenced by the pool can't be used by anybody else
+  for(std::vector<RgbdImagePyramidPtr>::iterator it = pool_.begin(); it != pool_.end(); ++it)
+  {
+    if(it->unique()) return *it;
+  }
+
+  return RgbdImagePyramidPtr();
+}
+
+void RgbdCameraPyramid::addToPool(const RgbdImagePyramidPtr& pyramid)
+{
+  if(pool_.size() < pool_size_)
+  {
+    pool_.push_back(pyramid);
+  }
+}
+
+void RgbdCameraPyramid::setPoolSize(size_t size)
+{
+  tbb::mutex::scoped_lock l(pool_mutex_);
+
+  pool_size_ = size;
+
+  if(pool_.size() > pool_size_)
+  {
+    pool_.resize(pool_size_);
+  }
 }
 
 void RgbdCameraPyramid::build(size_t levels)
@@ -288,13 +706,46 @@ void RgbdCameraPyramid::build(size_t levels)
   {
     RgbdCameraPtr& previous = levels_[idx - 1];
 
+    // odd sizes are rounded down, the pyrDown kernels drop the last row or column instead of resampling, so the pixels
+    // of the coarser level are exactly twice as large
     dvo::core::IntrinsicMatrix intrinsics(previous->intrinsics());
     intrinsics.scale(0.5f);
 
     levels_.push_back(boost::make_shared<RgbdCamera>(previous->width() / 2, previous->height() / 2, intrinsics));
+
+    if(!previous->mask().empty())
+    {
+      cv::Mat mask;
+      pyrDownMask(previous->mask(), mask);
+      levels_.back()->mask(mask);
+    }
+  }
+}
+
+void RgbdCameraPyramid::setMask(const cv::Mat& mask)
+{
+  levels_[0]->mask(mask);
+
+  for(size_t idx = 1; idx < levels_.size(); ++idx)
+  {
+    cv::Mat level_mask;
+
+    if(!levels_[idx - 1]->mask().empty()) pyrDownMask(levels_[idx - 1]->mask(), level_mask);
+
+    levels_[idx]->mask(level_mask);
   }
 }
 
+void RgbdCameraPyramid::setDepthFilter(const DepthFilterConfig& cfg)
+{
+  depth_filter_ = cfg;
+}
+
+const DepthFilterConfig& RgbdCameraPyramid::depthFilter() const
+{
+  return depth_filter_;
+}
+
 const RgbdCamera& RgbdCameraPyramid::level(size_t level)
 {
   build(level + 1);
@@ -322,6 +773,8 @@ RgbdImage::RgbdImage(const RgbdCamera& camera) :
   intensity_requires_calculation_(true),
   depth_requires_calculation_(true),
   pointcloud_requires_build_(true),
+  acceleration_requires_build_(true),
+  acceleration_half_requires_build_(true),
   width(0),
   height(0)
 {
@@ -361,6 +814,90 @@ void RgbdImage::initialize()
   intensity_requires_calculation_ = true;
   depth_requires_calculation_ = true;
   pointcloud_requires_build_ = true;
+  acceleration_requires_build_ = true;
+  acceleration_half_requires_build_ = true;
+}
+
+static inline void releaseIfShared(cv::Mat& m)
+{
+  if(m.refcount != 0 && *m.refcount > 1) m.release();
+}
+
+void RgbdImage::recycle()
+{
+  releaseIfShared(intensity);
+  releaseIfShared(intensity_dx);
+  releaseIfShared(intensity_dy);
+  releaseIfShared(depth);
+  releaseIfShared(depth_dx);
+  releaseIfShared(depth_dy);
+  releaseIfShared(acceleration);
+  releaseIfShared(acceleration_half);
+
+  // not recomputed by initialize(), calculateNormals() only checks for an empty buffer
+  normals.release();
+  angles.release();
+  rgb.release();
+  mask.release();
+
+  timestamp = 0.0;
+}
+
+void RgbdImage::release()
+{
+  intensity.release();
+  intensity_dx.release();
+  intensity_dy.release();
+  depth.release();
+  depth_dx.release();
+  depth_dy.release();
+  normals.release();
+  angles.release();
+  rgb.release();
+  mask.release();
+  acceleration.release();
+  acceleration_half.release();
+  pointcloud.resize(Eigen::NoChange, 0);
+
+  intensity_requires_calculation_ = true;
+  depth_requires_calculation_ = true;
+  pointcloud_requires_build_ = true;
+  acceleration_requires_build_ = true;
+  acceleration_half_requires_build_ = true;
+}
+
+void RgbdImage::releaseDerived()
+{
+  intensity_dx.release();
+  intensity_dy.release();
+  depth_dx.release();
+  depth_dy.release();
+  normals.release();
+  angles.release();
+  acceleration.release();
+  acceleration_half.release();
+  pointcloud.resize(Eigen::NoChange, 0);
+
+  intensity_requires_calculation_ = true;
+  depth_requires_calculation_ = true;
+  pointcloud_requires_build_ = true;
+  acceleration_requires_build_ = true;
+  acceleration_half_requires_build_ = true;
+}
+
+static size_t bytes(const cv::Mat& m)
+{
+  return m.empty() ? 0 : m.step[0] * m.rows;
+}
+
+size_t RgbdImage::memoryUsage() const
+{
+  return
+    bytes(intensity) + bytes(intensity_dx) + bytes(intensity_dy) +
+    bytes(depth) + bytes(depth_dx) + bytes(depth_dy) +
+    bytes(normals) + bytes(angles) + bytes(rgb) + bytes(mask) +
+    bytes(acceleration) + bytes(acceleration_half) +
+    pointcloud.size() * sizeof(float);
 }
 
 bool RgbdImage::hasIntensity() const
@@ -490,6 +1027,8 @@ void RgbdImage::calculateDerivativeY(const cv::Mat& img, cv::Mat& result)
 
 void RgbdImage::buildPointCloud()
 {
+  tbb::mutex::scoped_lock l(build_mutex_.mutex);
+
   if(!pointcloud_requires_build_) return;
 
   assert(hasDepth());
@@ -533,15 +1072,93 @@ void RgbdImage::calculateNormals()
 
 void RgbdImage::buildAccelerationStructure()
 {
-  if(acceleration.total() == 0)
+  tbb::mutex::scoped_lock l(build_mutex_.mutex);
+
+  if(!acceleration_requires_build_) return;
+
+  assert(hasIntensity() && hasDepth());
+
+  buildAccelerationStructureImpl();
+
+  acceleration_requires_build_ = false;
+}
+
+void RgbdImage::buildAccelerationStructureImpl()
+{
+  if(dvo::util::hasAvx())
+    buildAccelerationStructureAvx();
+  else
+    buildAccelerationStructureSse();
+
+  const cv::Mat& static_mask = camera_.mask();
+
+  if(static_mask.empty() && mask.empty()) return;
+
+  const float invalid = std::numeric_limits<float>::quiet_NaN();
+
+  for(int y = 0; y < acceleration.rows; ++y)
   {
-    calculateDerivatives();
-    cv::Mat zeros = cv::Mat::zeros(intensity.size(), intensity.type());
-    cv::Mat channels[8] = { intensity, depth, intensity_dx, intensity_dy, depth_dx, depth_dy, zeros, zeros};
-    cv::merge(channels, 8, acceleration);
+    const uint8_t *s = static_mask.empty() ? 0 : static_mask.ptr<uint8_t>(y);
+    const uint8_t *m = mask.empty() ? 0 : mask.ptr<uint8_t>(y);
+    float *z = acceleration.ptr<float>(y) + 1;
+
+    for(int x = 0; x < acceleration.cols; ++x, z += 8)
+    {
+      if((s != 0 && s[x] == 0) || (m != 0 && m[x] == 0)) *z = invalid;
+    }
   }
 }
 
+void RgbdImage::buildAccelerationStructureAvx()
+{
+  acceleration.create(intensity.size());
+
+  internal::buildAccelerationStructureAvx(intensity.ptr<float>(), int(intensity.step1()), depth.ptr<float>(), int(depth.step1()), intensity.cols, intensity.rows, acceleration.ptr<float>(), int(acceleration.step1()));
+}
+
+void RgbdImage::convertAccelerationStructureF16c(const cv::Mat_<Vec8f>& in)
+{
+  acceleration_half.create(in.size());
+
+  internal::convertAccelerationStructureF16c(in.ptr<float>(), int(in.step1()), in.cols, in.rows, acceleration_half.ptr<uint16_t>(), int(acceleration_half.step1()));
+}
+
+bool RgbdImage::buildCompactAccelerationStructure()
+{
+  if(!dvo::util::hasF16c()) return false;
+
+  tbb::mutex::scoped_lock l(build_mutex_.mutex);
+
+  if(!acceleration_half_requires_build_) return true;
+
+  assert(hasIntensity() && hasDepth());
+
+  // a float version built here is only needed for the conversion, other threads can't have used it yet
+  const bool temporary = acceleration_requires_build_;
+
+  if(temporary) buildAccelerationStructureImpl();
+
+  convertAccelerationStructureF16c(acceleration);
+
+  if(temporary) acceleration.release();
+
+  acceleration_half_requires_build_ = false;
+
+  return true;
+}
+
+bool RgbdImage::compactAccelerationStructure()
+{
+  if(!buildCompactAccelerationStructure()) return false;
+
+  tbb::mutex::scoped_lock l(build_mutex_.mutex);
+
+  acceleration.release();
+  acceleration_requires_build_ = true;
+
+  return true;
+}
+
 void RgbdImage::warpIntensity(const AffineTransform& transformationd, const PointCloud& reference_pointcloud, const IntrinsicMatrix& intrinsics, RgbdImage& result, PointCloud& transformed_pointcloud)
 {
   Eigen::Affine3f transformation = transformationd.cast<float>();
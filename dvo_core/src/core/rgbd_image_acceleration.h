@@ -0,0 +1,46 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RGBD_IMAGE_ACCELERATION_H_
+#define RGBD_IMAGE_ACCELERATION_H_
+
+// the AVX acceleration structure kernels, see rgbd_image_avx.cpp. plain data only, like rgbd_image_warp.h, nothing
+// compiled with -mavx may instantiate the inline or template code of Eigen or OpenCV
+
+#include <stdint.h>
+
+namespace dvo
+{
+namespace core
+{
+namespace internal
+{
+
+// the 8 channels of every pixel from the intensity and depth images, rows are stride floats apart. only call if the
+// cpu supports AVX
+void buildAccelerationStructureAvx(const float* intensity, int intensity_stride, const float* depth, int depth_stride, int width, int height, float* acceleration, int acceleration_stride);
+
+// only call if the cpu supports F16C
+void convertAccelerationStructureF16c(const float* in, int in_stride, int width, int height, uint16_t* out, int out_stride);
+
+} /* namespace internal */
+} /* namespace core */
+} /* namespace dvo */
+#endif /* RGBD_IMAGE_ACCELERATION_H_ */
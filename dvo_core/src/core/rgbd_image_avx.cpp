@@ -0,0 +1,124 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// compiled with -mavx -mf16c, only called after runtime dispatch in rgbd_image.cpp
+
+#include "rgbd_image_acceleration.h"
+
+#include <immintrin.h>
+
+namespace dvo
+{
+namespace core
+{
+namespace internal
+{
+
+// same as in rgbd_image_sse.cpp, the border pixels use the clamped neighbours
+static inline void buildAccelerationStructurePixel(const float* i_prev, const float* i, const float* i_next, const float* z_prev, const float* z, const float* z_next, int x, int cols, float* out)
+{
+  const int prev = x > 0 ? x - 1 : 0;
+  const int next = x + 1 < cols ? x + 1 : cols - 1;
+
+  out[0] = i[x];
+  out[1] = z[x];
+  out[2] = (i[next] - i[prev]) * 0.5f;
+  out[3] = (i_next[x] - i_prev[x]) * 0.5f;
+  out[4] = (z[next] - z[prev]) * 0.5f;
+  out[5] = (z_next[x] - z_prev[x]) * 0.5f;
+  out[6] = 0.0f;
+  out[7] = 0.0f;
+}
+
+void buildAccelerationStructureAvx(const float* intensity, int intensity_stride, const float* depth, int depth_stride, int width, int height, float* acceleration, int acceleration_stride)
+{
+  const __m256 scale = _mm256_set1_ps(0.5f);
+  const __m256 zero = _mm256_setzero_ps();
+
+  for(int y = 0; y < height; ++y)
+  {
+    const int prev = y > 0 ? y - 1 : 0;
+    const int next = y + 1 < height ? y + 1 : height - 1;
+
+    const float *i_prev = intensity + prev * intensity_stride, *i = intensity + y * intensity_stride, *i_next = intensity + next * intensity_stride;
+    const float *z_prev = depth + prev * depth_stride, *z = depth + y * depth_stride, *z_next = depth + next * depth_stride;
+    float *out = acceleration + y * acceleration_stride;
+
+    buildAccelerationStructurePixel(i_prev, i, i_next, z_prev, z, z_next, 0, width, out);
+
+    int x = 1;
+
+    // 8 pixels per iteration, the x derivatives need the pixels left and right of them
+    for(; x + 8 < width; x += 8)
+    {
+      const __m256 iv = _mm256_loadu_ps(i + x);
+      const __m256 zv = _mm256_loadu_ps(z + x);
+      const __m256 idx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(i + x + 1), _mm256_loadu_ps(i + x - 1)), scale);
+      const __m256 idy = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(i_next + x), _mm256_loadu_ps(i_prev + x)), scale);
+      const __m256 zdx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(z + x + 1), _mm256_loadu_ps(z + x - 1)), scale);
+      const __m256 zdy = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(z_next + x), _mm256_loadu_ps(z_prev + x)), scale);
+
+      // 8x8 transpose, the last two channels are zero, so their interleaved halves are too
+      const __m256 t0 = _mm256_unpacklo_ps(iv, zv), t1 = _mm256_unpackhi_ps(iv, zv);
+      const __m256 t2 = _mm256_unpacklo_ps(idx, idy), t3 = _mm256_unpackhi_ps(idx, idy);
+      const __m256 t4 = _mm256_unpacklo_ps(zdx, zdy), t5 = _mm256_unpackhi_ps(zdx, zdy);
+
+      // pixels 0/4, 1/5, 2/6 and 3/7 in the lower and upper lane
+      const __m256 a0 = _mm256_shuffle_ps(t0, t2, 0x44), a1 = _mm256_shuffle_ps(t0, t2, 0xee);
+      const __m256 a2 = _mm256_shuffle_ps(t1, t3, 0x44), a3 = _mm256_shuffle_ps(t1, t3, 0xee);
+      const __m256 b0 = _mm256_shuffle_ps(t4, zero, 0x44), b1 = _mm256_shuffle_ps(t4, zero, 0xee);
+      const __m256 b2 = _mm256_shuffle_ps(t5, zero, 0x44), b3 = _mm256_shuffle_ps(t5, zero, 0xee);
+
+      float *o = out + x * 8;
+      _mm256_storeu_ps(o +  0, _mm256_permute2f128_ps(a0, b0, 0x20));
+      _mm256_storeu_ps(o +  8, _mm256_permute2f128_ps(a1, b1, 0x20));
+      _mm256_storeu_ps(o + 16, _mm256_permute2f128_ps(a2, b2, 0x20));
+      _mm256_storeu_ps(o + 24, _mm256_permute2f128_ps(a3, b3, 0x20));
+      _mm256_storeu_ps(o + 32, _mm256_permute2f128_ps(a0, b0, 0x31));
+      _mm256_storeu_ps(o + 40, _mm256_permute2f128_ps(a1, b1, 0x31));
+      _mm256_storeu_ps(o + 48, _mm256_permute2f128_ps(a2, b2, 0x31));
+      _mm256_storeu_ps(o + 56, _mm256_permute2f128_ps(a3, b3, 0x31));
+    }
+
+    for(; x < width; ++x)
+    {
+      buildAccelerationStructurePixel(i_prev, i, i_next, z_prev, z, z_next, x, width, out + x * 8);
+    }
+  }
+}
+
+void convertAccelerationStructureF16c(const float* in, int in_stride, int width, int height, uint16_t* out, int out_stride)
+{
+  for(int y = 0; y < height; ++y)
+  {
+    const float *src = in + y * in_stride;
+    uint16_t *dst = out + y * out_stride;
+
+    // one pixel per iteration, NaNs stay NaNs
+    for(int x = 0; x < width; ++x, src += 8, dst += 8)
+    {
+      _mm_storeu_si128((__m128i*) dst, _mm256_cvtps_ph(_mm256_loadu_ps(src), _MM_FROUND_TO_NEAREST_INT));
+    }
+  }
+}
+
+} /* namespace internal */
+} /* namespace core */
+} /* namespace dvo */
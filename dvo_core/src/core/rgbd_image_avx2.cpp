@@ -0,0 +1,155 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// compiled with -mavx2, only called after runtime dispatch in rgbd_image_sse.cpp
+
+#include "rgbd_image_warp.h"
+
+#include <immintrin.h>
+
+namespace dvo
+{
+namespace core
+{
+namespace internal
+{
+
+int warpIntensityAvx2(const WarpIntensityArgs& args, int begin, int end)
+{
+  static const int Lanes = 8;
+
+  const int vectorized_end = begin + (end - begin) / Lanes * Lanes;
+
+  const float* t = args.transformation;
+
+  const __m256 t00 = _mm256_set1_ps(t[0]), t01 = _mm256_set1_ps(t[1]), t02 = _mm256_set1_ps(t[2]), t03 = _mm256_set1_ps(t[3]);
+  const __m256 t10 = _mm256_set1_ps(t[4]), t11 = _mm256_set1_ps(t[5]), t12 = _mm256_set1_ps(t[6]), t13 = _mm256_set1_ps(t[7]);
+  const __m256 t20 = _mm256_set1_ps(t[8]), t21 = _mm256_set1_ps(t[9]), t22 = _mm256_set1_ps(t[10]), t23 = _mm256_set1_ps(t[11]);
+
+  const __m256 fx = _mm256_set1_ps(args.fx), fy = _mm256_set1_ps(args.fy);
+  const __m256 ox = _mm256_set1_ps(args.ox), oy = _mm256_set1_ps(args.oy);
+
+  const __m256 zeros = _mm256_setzero_ps();
+  const __m256 ones = _mm256_set1_ps(1.0f);
+  // quiet NaN, without std::numeric_limits, which would be instantiated with -mavx2
+  const __m256 nans = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fc00000));
+  const __m256 width = _mm256_set1_ps(float(args.width)), height = _mm256_set1_ps(float(args.height));
+
+  const __m256i width_i = _mm256_set1_epi32(args.width), height_i = _mm256_set1_epi32(args.height);
+  const __m256i stride = _mm256_set1_epi32(args.stride);
+  const __m256i ones_i = _mm256_set1_epi32(1);
+
+  // points are 4 floats apart
+  const __m256i point_offsets = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+
+  for(int idx = begin; idx < vectorized_end; idx += Lanes)
+  {
+    const float* points = args.points + idx * 4;
+
+    const __m256 x = _mm256_i32gather_ps(points + 0, point_offsets, 4);
+    const __m256 y = _mm256_i32gather_ps(points + 1, point_offsets, 4);
+    const __m256 z = _mm256_i32gather_ps(points + 2, point_offsets, 4);
+    const __m256 w = _mm256_i32gather_ps(points + 3, point_offsets, 4);
+
+    // same order of additions as the horizontal adds of the sse version
+    const __m256 tx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(t00, x), _mm256_mul_ps(t01, y)), _mm256_add_ps(_mm256_mul_ps(t02, z), _mm256_mul_ps(t03, w)));
+    const __m256 ty = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(t10, x), _mm256_mul_ps(t11, y)), _mm256_add_ps(_mm256_mul_ps(t12, z), _mm256_mul_ps(t13, w)));
+    const __m256 tz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(t20, x), _mm256_mul_ps(t21, y)), _mm256_add_ps(_mm256_mul_ps(t22, z), _mm256_mul_ps(t23, w)));
+
+    if(args.transformed_points != 0)
+    {
+      float* tpoints = args.transformed_points + idx * 4;
+
+      // transpose to [x, y, z, 1] per point, each register holds point i in the low and point i + 4 in the high half
+      const __m256 xy_lo = _mm256_unpacklo_ps(tx, ty), xy_hi = _mm256_unpackhi_ps(tx, ty);
+      const __m256 z1_lo = _mm256_unpacklo_ps(tz, ones), z1_hi = _mm256_unpackhi_ps(tz, ones);
+
+      const __m256 p04 = _mm256_shuffle_ps(xy_lo, z1_lo, _MM_SHUFFLE(1, 0, 1, 0));
+      const __m256 p15 = _mm256_shuffle_ps(xy_lo, z1_lo, _MM_SHUFFLE(3, 2, 3, 2));
+      const __m256 p26 = _mm256_shuffle_ps(xy_hi, z1_hi, _MM_SHUFFLE(1, 0, 1, 0));
+      const __m256 p37 = _mm256_shuffle_ps(xy_hi, z1_hi, _MM_SHUFFLE(3, 2, 3, 2));
+
+      _mm_stream_ps(tpoints + 0, _mm256_castps256_ps128(p04));
+      _mm_stream_ps(tpoints + 4, _mm256_castps256_ps128(p15));
+      _mm_stream_ps(tpoints + 8, _mm256_castps256_ps128(p26));
+      _mm_stream_ps(tpoints + 12, _mm256_castps256_ps128(p37));
+      _mm_stream_ps(tpoints + 16, _mm256_extractf128_ps(p04, 1));
+      _mm_stream_ps(tpoints + 20, _mm256_extractf128_ps(p15, 1));
+      _mm_stream_ps(tpoints + 24, _mm256_extractf128_ps(p26, 1));
+      _mm_stream_ps(tpoints + 28, _mm256_extractf128_ps(p37, 1));
+    }
+
+    // projection
+    const __m256 z_rcp = _mm256_rcp_ps(tz);
+    const __m256 u = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(tx, fx), z_rcp), ox);
+    const __m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(ty, fy), z_rcp), oy);
+
+    // check image bounds
+    const __m256 inimage = _mm256_and_ps(
+        _mm256_and_ps(_mm256_cmp_ps(u, zeros, _CMP_GE_OQ), _mm256_cmp_ps(u, width, _CMP_LT_OQ)),
+        _mm256_and_ps(_mm256_cmp_ps(v, zeros, _CMP_GE_OQ), _mm256_cmp_ps(v, height, _CMP_LT_OQ))
+    );
+
+    _mm256_storeu_ps(args.warped_depth + idx, _mm256_blendv_ps(nans, tz, inimage));
+
+    // the interpolation needs the right and lower neighbour
+    const __m256i x0 = _mm256_cvttps_epi32(u), y0 = _mm256_cvttps_epi32(v);
+    const __m256i neighbours_inimage = _mm256_and_si256(
+        _mm256_cmpgt_epi32(width_i, _mm256_add_epi32(x0, ones_i)),
+        _mm256_cmpgt_epi32(height_i, _mm256_add_epi32(y0, ones_i))
+    );
+    const __m256 valid = _mm256_and_ps(inimage, _mm256_castsi256_ps(neighbours_inimage));
+
+    if(_mm256_movemask_ps(valid) == 0)
+    {
+      _mm256_storeu_ps(args.warped_intensity + idx, nans);
+      continue;
+    }
+
+    // masked lanes aren't loaded, zeroing their offsets keeps them harmless anyway
+    const __m256i offset00 = _mm256_and_si256(_mm256_add_epi32(_mm256_mullo_epi32(y0, stride), x0), _mm256_castps_si256(valid));
+    const __m256i offset01 = _mm256_add_epi32(offset00, stride);
+
+    const __m256 i00 = _mm256_mask_i32gather_ps(nans, args.intensity + 0, offset00, valid, 4);
+    const __m256 i10 = _mm256_mask_i32gather_ps(nans, args.intensity + 1, offset00, valid, 4);
+    const __m256 i01 = _mm256_mask_i32gather_ps(nans, args.intensity + 0, offset01, valid, 4);
+    const __m256 i11 = _mm256_mask_i32gather_ps(nans, args.intensity + 1, offset01, valid, 4);
+
+    // weights
+    const __m256 x1w = _mm256_sub_ps(u, _mm256_cvtepi32_ps(x0)), x0w = _mm256_sub_ps(ones, x1w);
+    const __m256 y1w = _mm256_sub_ps(v, _mm256_cvtepi32_ps(y0)), y0w = _mm256_sub_ps(ones, y1w);
+
+    const __m256 w00 = _mm256_mul_ps(x0w, y0w), w10 = _mm256_mul_ps(x1w, y0w);
+    const __m256 w01 = _mm256_mul_ps(x0w, y1w), w11 = _mm256_mul_ps(x1w, y1w);
+
+    const __m256 sum_wi = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(w00, i00), _mm256_mul_ps(w10, i10)), _mm256_add_ps(_mm256_mul_ps(w01, i01), _mm256_mul_ps(w11, i11)));
+    const __m256 sum_w = _mm256_add_ps(_mm256_add_ps(w00, w10), _mm256_add_ps(w01, w11));
+
+    const __m256 notzero = _mm256_and_ps(valid, _mm256_cmp_ps(sum_w, zeros, _CMP_GT_OQ));
+
+    _mm256_storeu_ps(args.warped_intensity + idx, _mm256_blendv_ps(nans, _mm256_div_ps(sum_wi, sum_w), notzero));
+  }
+
+  return vectorized_end;
+}
+
+} /* namespace internal */
+} /* namespace core */
+} /* namespace dvo */
@@ -21,6 +21,14 @@
 #include <dvo/core/datatypes.h>
 #include <dvo/core/rgbd_image.h>
 #include <dvo/core/interpolation.h>
+#include <dvo/util/cpu_features.h>
+
+#include "rgbd_image_warp.h"
+
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 
 #include <immintrin.h>
 #include <pmmintrin.h>
@@ -48,7 +56,7 @@ static const __m128 ZEROS = _mm_setzero_ps();
 static const __m128 ONES = _mm_set1_ps(1.0f);
 static const __m128 NANS = _mm_set1_ps(std::numeric_limits<float>::quiet_NaN());
 
-static inline __m128 interpolateBilinearWithDepthBufferSse(const cv::Mat& intensity, const cv::Mat& depth, const __m128& xyxy_proj, const __m128& zzzz, const __m128& img_upper_bound)
+static inline __m128 interpolateBilinearWithDepthBufferSse(const float* intensity, const float* depth, const int stride, const __m128& xyxy_proj, const __m128& zzzz, const __m128& img_upper_bound)
 {
   ALIGN int address[4];
 
@@ -82,10 +90,10 @@ static inline __m128 interpolateBilinearWithDepthBufferSse(const cv::Mat& intens
 
   _mm_store_si128((__m128i*) address, x0y0i);
 
-  const float* p_intensity1 = intensity.ptr<float>(address[1], address[0]);
-  const float* p_intensity2 = intensity.ptr<float>(address[1] + 1, address[0]);
-  const float* p_depth1 = depth.ptr<float>(address[1], address[0]);
-  const float* p_depth2 = depth.ptr<float>(address[1] + 1, address[0]);
+  const float* p_intensity1 = intensity + address[1] * stride + address[0];
+  const float* p_intensity2 = p_intensity1 + stride;
+  const float* p_depth1 = depth + address[1] * stride + address[0];
+  const float* p_depth2 = p_depth1 + stride;
 
   __m128 p_intensity, p_depth;
 
@@ -107,120 +115,184 @@ static inline __m128 interpolateBilinearWithDepthBufferSse(const cv::Mat& intens
   return _mm_or_ps(_mm_and_ps(notzero, _mm_div_ps(iw, wi)), _mm_andnot_ps(notzero, NANS));
 }
 
-template<int PointCloudOption>
-void RgbdImage::warpIntensitySseImpl(const AffineTransform& transformationx, const PointCloud& reference_pointcloud, const IntrinsicMatrix& intrinsics, RgbdImage& result, PointCloud& transformed_pointcloud)
+namespace internal
 {
-  // prepare transformation
-  Eigen::Transform<float, 3, Eigen::Affine, Eigen::RowMajor> transformation = transformationx.cast<float>();
-
-  // prepare result images
-  cv::Mat warped_image(intensity.size(), intensity.type());
-  cv::Mat warped_depth(depth.size(), depth.type());
 
-  float* warped_intensity_ptr = warped_image.ptr<IntensityType>();
-  float* warped_depth_ptr = warped_depth.ptr<DepthType>();
+// rows of the reference image per task of the inverse warp
+static const int WarpIntensityTileRows = 16;
 
-  if(PointCloudOption == WithPointCloud)
-  {
-    transformed_pointcloud.resize(Eigen::NoChange, width * height);
-  }
-
-  unsigned int rnd_mode = _MM_GET_ROUNDING_MODE();
+void warpIntensitySse(const WarpIntensityArgs& args, int begin, int end)
+{
+  const bool with_pointcloud = args.transformed_points != 0;
 
-  if(rnd_mode != _MM_ROUND_TOWARD_ZERO) _MM_SET_ROUNDING_MODE(_MM_ROUND_TOWARD_ZERO);
+  __m128 point1, point2, xy, uv, zw, xyuv, zwzw, z1w1, zzww, zzww_rcp, xyuv_proj, xyuv_inimage;
 
   // transformation rows
-  const __m128 t1 = _mm_load_ps(transformation.data());
-  const __m128 t2 = _mm_load_ps(transformation.data() + 4);
-  const __m128 t3 = _mm_load_ps(transformation.data() + 8);
+  const __m128 t1 = _mm_load_ps(args.transformation);
+  const __m128 t2 = _mm_load_ps(args.transformation + 4);
+  const __m128 t3 = _mm_load_ps(args.transformation + 8);
 
-  const __m128 fxyxy = _mm_setr_ps(intrinsics.fx(), intrinsics.fy(), intrinsics.fx(), intrinsics.fy()); // [fx, fy, fx, fy]
-  const __m128 oxyxy = _mm_setr_ps(intrinsics.ox(), intrinsics.oy(), intrinsics.ox(), intrinsics.oy()); // [ox, oy, ox, oy]
+  const __m128 fxyxy = _mm_setr_ps(args.fx, args.fy, args.fx, args.fy); // [fx, fy, fx, fy]
+  const __m128 oxyxy = _mm_setr_ps(args.ox, args.oy, args.ox, args.oy); // [ox, oy, ox, oy]
 
   const __m128 img_lower_bound = _mm_setzero_ps();
-  const __m128 img_upper_bound = _mm_set_ps(height, width, height, width);
-
-  __m128 point1, point2, xy, uv, zw, xyuv, zwzw, z1w1, zzww, zzww_rcp, xyuv_proj, xyuv_inimage;
+  const __m128 img_upper_bound = _mm_set_ps(args.height, args.width, args.height, args.width);
 
-  const float* points = reference_pointcloud.data();
-  float* tpoints = transformed_pointcloud.data();
+  const float* points = args.points + begin * 4;
+  float* tpoints = with_pointcloud ? args.transformed_points + begin * 4 : 0;
+  float* warped_intensity_ptr = args.warped_intensity + begin;
+  float* warped_depth_ptr = args.warped_depth + begin;
 
-  for(size_t y = 0; y < height; ++y)
+  // two points per iteration, the second one of the last iteration is a copy of the first one if the number of
+  // points is odd
+  for(int idx = begin; idx < end; idx += 2, warped_intensity_ptr += 2, warped_depth_ptr += 2, points += 8, tpoints += 8)
   {
-    for(size_t x = 0; x < width; x += 2, warped_intensity_ptr += 2, warped_depth_ptr += 2, points += 8, tpoints += 8)
-    {
-      point1 = _mm_load_ps(points + 0);
-      point2 = _mm_load_ps(points + 4);
+    const bool pair = idx + 1 < end;
 
-      // matrix multiply and first horizontal add
-      xy = _mm_hadd_ps(_mm_mul_ps(t1, point1), _mm_mul_ps(t2, point1)); // [x0+1, x2+3, y0+1, y2+3]
-      uv = _mm_hadd_ps(_mm_mul_ps(t1, point2), _mm_mul_ps(t2, point2)); // [u0+1, u2+3, v0+1, v2+3]
-      zw = _mm_hadd_ps(_mm_mul_ps(t3, point1), _mm_mul_ps(t3, point2)); // [z0+1, z2+3, w0+1, w2+3]
+    point1 = _mm_load_ps(points + 0);
+    point2 = pair ? _mm_load_ps(points + 4) : point1;
 
-      // second horizontal add
-      xyuv = _mm_hadd_ps(xy, uv); // [x0+1+2+3, y0+1+2+3, u0+1+2+3, v0+1+2+3]
-      zwzw = _mm_hadd_ps(zw, zw); // [z0+1+2+3, w0+1+2+3, z0+1+2+3, w0+1+2+3]
+    // matrix multiply and first horizontal add
+    xy = _mm_hadd_ps(_mm_mul_ps(t1, point1), _mm_mul_ps(t2, point1)); // [x0+1, x2+3, y0+1, y2+3]
+    uv = _mm_hadd_ps(_mm_mul_ps(t1, point2), _mm_mul_ps(t2, point2)); // [u0+1, u2+3, v0+1, v2+3]
+    zw = _mm_hadd_ps(_mm_mul_ps(t3, point1), _mm_mul_ps(t3, point2)); // [z0+1, z2+3, w0+1, w2+3]
 
-      if(PointCloudOption == WithPointCloud)
-      {
-        // interleave z and w with ones
-        z1w1 = _mm_unpacklo_ps(zwzw, ONES); // [z0+1+2+3, 1, w0+1+2+3, 1]
+    // second horizontal add
+    xyuv = _mm_hadd_ps(xy, uv); // [x0+1+2+3, y0+1+2+3, u0+1+2+3, v0+1+2+3]
+    zwzw = _mm_hadd_ps(zw, zw); // [z0+1+2+3, w0+1+2+3, z0+1+2+3, w0+1+2+3]
 
-        // reorder xyuv and z1w1 into two points
-        point1 = _mm_movelh_ps(xyuv, z1w1); // [x0+1+2+3, y0+1+2+3, z0+1+2+3, 1]
-        point2 = _mm_movehl_ps(z1w1, xyuv); // [u0+1+2+3, v0+1+2+3, w0+1+2+3, 1]
+    if(with_pointcloud)
+    {
+      // interleave z and w with ones
+      z1w1 = _mm_unpacklo_ps(zwzw, ONES); // [z0+1+2+3, 1, w0+1+2+3, 1]
 
-        // store transformed points
-        _mm_stream_ps(tpoints + 0, point1);
-        _mm_stream_ps(tpoints + 4, point2);
-      }
+      // reorder xyuv and z1w1 into two points
+      point1 = _mm_movelh_ps(xyuv, z1w1); // [x0+1+2+3, y0+1+2+3, z0+1+2+3, 1]
+      point2 = _mm_movehl_ps(z1w1, xyuv); // [u0+1+2+3, v0+1+2+3, w0+1+2+3, 1]
+
+      // store transformed points
+      _mm_stream_ps(tpoints + 0, point1);
+      if(pair) _mm_stream_ps(tpoints + 4, point2);
+    }
 
-      // reorder and invert z and w
-      zzww = _mm_unpacklo_ps(zwzw, zwzw); // [z0+1+2+3, z0+1+2+3, w0+1+2+3, w0+1+2+3]
-      zzww_rcp = _mm_rcp_ps(zzww); // 1 / zzww
+    // reorder and invert z and w
+    zzww = _mm_unpacklo_ps(zwzw, zwzw); // [z0+1+2+3, z0+1+2+3, w0+1+2+3, w0+1+2+3]
+    zzww_rcp = _mm_rcp_ps(zzww); // 1 / zzww
 
-      // projection
-      xyuv_proj = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(xyuv, fxyxy), zzww_rcp), oxyxy);
+    // projection
+    xyuv_proj = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(xyuv, fxyxy), zzww_rcp), oxyxy);
 
-      // check image bounds
-      xyuv_inimage = _mm_and_ps(_mm_cmpge_ps(xyuv_proj, img_lower_bound), _mm_cmplt_ps(xyuv_proj, img_upper_bound));
-      xyuv_inimage = _mm_and_ps(xyuv_inimage, _mm_shuffle_ps(xyuv_inimage, xyuv_inimage, _MM_SHUFFLE(2, 3, 0, 1))); // [x && y, y && x, u && v, v && u]
-      xyuv_inimage = _mm_shuffle_ps(xyuv_inimage, xyuv_inimage, _MM_SHUFFLE(0, 0, 2, 0)); // [x && y, u && v, ?, ?]
+    // check image bounds
+    xyuv_inimage = _mm_and_ps(_mm_cmpge_ps(xyuv_proj, img_lower_bound), _mm_cmplt_ps(xyuv_proj, img_upper_bound));
+    xyuv_inimage = _mm_and_ps(xyuv_inimage, _mm_shuffle_ps(xyuv_inimage, xyuv_inimage, _MM_SHUFFLE(2, 3, 0, 1))); // [x && y, y && x, u && v, v && u]
+    xyuv_inimage = _mm_shuffle_ps(xyuv_inimage, xyuv_inimage, _MM_SHUFFLE(0, 0, 2, 0)); // [x && y, u && v, ?, ?]
 
-      // store warped depth
+    // store warped depth
+    if(pair)
       _mm_storel_pi((__m64*) warped_depth_ptr, _mm_or_ps(_mm_and_ps(xyuv_inimage, zwzw), _mm_andnot_ps(xyuv_inimage, NANS)));
+    else
+      _mm_store_ss(warped_depth_ptr, _mm_or_ps(_mm_and_ps(xyuv_inimage, zwzw), _mm_andnot_ps(xyuv_inimage, NANS)));
 
-      int xyuv_inimage_mask = _mm_movemask_ps(xyuv_inimage);
+    int xyuv_inimage_mask = _mm_movemask_ps(xyuv_inimage);
 
-      // point1: only if bit 0 is set the point is in the image!
-      if((xyuv_inimage_mask & 1) == 1)
-      {
-        __m128 zzzz = _mm_shuffle_ps(zzww, zzww, _MM_SHUFFLE(0, 0, 0, 0));
-        __m128 xyxy_proj = _mm_shuffle_ps(xyuv_proj, xyuv_proj, _MM_SHUFFLE(1, 0, 1, 0));
+    // point1: only if bit 0 is set the point is in the image!
+    if((xyuv_inimage_mask & 1) == 1)
+    {
+      __m128 zzzz = _mm_shuffle_ps(zzww, zzww, _MM_SHUFFLE(0, 0, 0, 0));
+      __m128 xyxy_proj = _mm_shuffle_ps(xyuv_proj, xyuv_proj, _MM_SHUFFLE(1, 0, 1, 0));
 
-        _mm_store_ss(warped_intensity_ptr + 0, interpolateBilinearWithDepthBufferSse(intensity, depth, xyxy_proj, zzzz, img_upper_bound));
-      }
-      else
-      {
-        (*(warped_intensity_ptr + 0)) = Invalid;
-      }
+      _mm_store_ss(warped_intensity_ptr + 0, interpolateBilinearWithDepthBufferSse(args.intensity, args.depth, args.stride, xyxy_proj, zzzz, img_upper_bound));
+    }
+    else
+    {
+      (*(warped_intensity_ptr + 0)) = Invalid;
+    }
 
-      // point2: only if bit 1 is set the point is in the image!
-      if((xyuv_inimage_mask & 2) == 2)
-      {
-        __m128 wwww = _mm_shuffle_ps(zzww, zzww, _MM_SHUFFLE(3, 3, 3, 3));
-        __m128 uvuv_proj = _mm_shuffle_ps(xyuv_proj, xyuv_proj, _MM_SHUFFLE(3, 2, 3, 2));
+    if(!pair) break;
 
-        _mm_store_ss(warped_intensity_ptr + 1, interpolateBilinearWithDepthBufferSse(intensity, depth, uvuv_proj, wwww, img_upper_bound));
-      }
-      else
-      {
-        (*(warped_intensity_ptr + 1)) = Invalid;
-      }
+    // point2: only if bit 1 is set the point is in the image!
+    if((xyuv_inimage_mask & 2) == 2)
+    {
+      __m128 wwww = _mm_shuffle_ps(zzww, zzww, _MM_SHUFFLE(3, 3, 3, 3));
+      __m128 uvuv_proj = _mm_shuffle_ps(xyuv_proj, xyuv_proj, _MM_SHUFFLE(3, 2, 3, 2));
+
+      _mm_store_ss(warped_intensity_ptr + 1, interpolateBilinearWithDepthBufferSse(args.intensity, args.depth, args.stride, uvuv_proj, wwww, img_upper_bound));
+    }
+    else
+    {
+      (*(warped_intensity_ptr + 1)) = Invalid;
     }
   }
+}
 
-  if(rnd_mode != _MM_ROUND_TOWARD_ZERO) _MM_SET_ROUNDING_MODE(rnd_mode);
+// a tile of rows of the reference image per task
+class WarpIntensity
+{
+public:
+  WarpIntensity(const WarpIntensityArgs& args) :
+    args_(args),
+    use_avx2_(dvo::util::hasAvx2())
+  {
+  }
+
+  void operator()(const tbb::blocked_range<int>& rows) const
+  {
+    // the rounding mode is per thread
+    unsigned int rnd_mode = _MM_GET_ROUNDING_MODE();
+
+    if(rnd_mode != _MM_ROUND_TOWARD_ZERO) _MM_SET_ROUNDING_MODE(_MM_ROUND_TOWARD_ZERO);
+
+    const int begin = rows.begin() * args_.width, end = rows.end() * args_.width;
+    const int vectorized_end = use_avx2_ ? warpIntensityAvx2(args_, begin, end) : begin;
+
+    warpIntensitySse(args_, vectorized_end, end);
+
+    // the transformed points are streamed
+    _mm_sfence();
+
+    if(rnd_mode != _MM_ROUND_TOWARD_ZERO) _MM_SET_ROUNDING_MODE(rnd_mode);
+  }
+private:
+  const WarpIntensityArgs& args_;
+  bool use_avx2_;
+};
+
+} /* namespace internal */
+
+template<int PointCloudOption>
+void RgbdImage::warpIntensitySseImpl(const AffineTransform& transformationx, const PointCloud& reference_pointcloud, const IntrinsicMatrix& intrinsics, RgbdImage& result, PointCloud& transformed_pointcloud)
+{
+  // prepare transformation
+  Eigen::Transform<float, 3, Eigen::Affine, Eigen::RowMajor> transformation = transformationx.cast<float>();
+
+  // prepare result images
+  cv::Mat warped_image(intensity.size(), intensity.type());
+  cv::Mat warped_depth(depth.size(), depth.type());
+
+  if(PointCloudOption == WithPointCloud)
+  {
+    transformed_pointcloud.resize(Eigen::NoChange, width * height);
+  }
+
+  assert(intensity.step1() == depth.step1());
+
+  internal::WarpIntensityArgs args;
+  args.intensity = intensity.ptr<float>();
+  args.depth = depth.ptr<float>();
+  args.stride = int(intensity.step1());
+  args.width = int(width);
+  args.height = int(height);
+  args.transformation = transformation.data();
+  args.fx = intrinsics.fx();
+  args.fy = intrinsics.fy();
+  args.ox = intrinsics.ox();
+  args.oy = intrinsics.oy();
+  args.points = reference_pointcloud.data();
+  args.transformed_points = PointCloudOption == WithPointCloud ? transformed_pointcloud.data() : 0;
+  args.warped_intensity = warped_image.ptr<IntensityType>();
+  args.warped_depth = warped_depth.ptr<DepthType>();
+
+  tbb::parallel_for(tbb::blocked_range<int>(0, int(height), internal::WarpIntensityTileRows), internal::WarpIntensity(args));
 
   result.intensity = warped_image;
   result.depth = warped_depth;
@@ -242,46 +314,356 @@ void RgbdImage::calculateDerivativeYSseFloat(const cv::Mat& img, cv::Mat& result
 {
   result.create(img.size(), img.type());
 
-  const float *prev_ptr, *next_ptr;
-  float *result_ptr = result.ptr<float>();
+  const __m128 scale = _mm_set1_ps(0.5f);
+
+  // rows of levels with a width which isn't a multiple of 4 aren't aligned, e.g., 106 pixels of a 848x480 camera
+  for(int y = 0; y < img.rows; ++y)
+  {
+    const float *prev_ptr = img.ptr<float>(std::max(y - 1, 0)), *next_ptr = img.ptr<float>(std::min(y + 1, img.rows - 1));
+    float *result_ptr = result.ptr<float>(y);
+
+    int x = 0;
+
+    for(; x + 4 <= img.cols; x += 4)
+    {
+      _mm_storeu_ps(result_ptr + x, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(next_ptr + x), _mm_loadu_ps(prev_ptr + x)), scale));
+    }
+
+    for(; x < img.cols; ++x)
+    {
+      result_ptr[x] = (next_ptr[x] - prev_ptr[x]) * 0.5f;
+    }
+  }
+}
+
+// writes i, z, idx, idy, zdx, zdy, 0, 0 of pixel x with clamped central differences
+static inline void buildAccelerationStructurePixel(const float* i_prev, const float* i, const float* i_next, const float* z_prev, const float* z, const float* z_next, int x, int cols, float* out)
+{
+  const int prev = std::max(x - 1, 0);
+  const int next = std::min(x + 1, cols - 1);
+
+  out[0] = i[x];
+  out[1] = z[x];
+  out[2] = (i[next] - i[prev]) * 0.5f;
+  out[3] = (i_next[x] - i_prev[x]) * 0.5f;
+  out[4] = (z[next] - z[prev]) * 0.5f;
+  out[5] = (z_next[x] - z_prev[x]) * 0.5f;
+  out[6] = 0.0f;
+  out[7] = 0.0f;
+}
+
+void RgbdImage::buildAccelerationStructureSse()
+{
+  acceleration.create(intensity.size());
+
+  const __m128 scale = _mm_set1_ps(0.5f);
+  const int cols = intensity.cols;
+
+  for(int y = 0; y < intensity.rows; ++y)
+  {
+    const int prev = std::max(y - 1, 0);
+    const int next = std::min(y + 1, intensity.rows - 1);
+
+    const float *i_prev = intensity.ptr<float>(prev), *i = intensity.ptr<float>(y), *i_next = intensity.ptr<float>(next);
+    const float *z_prev = depth.ptr<float>(prev), *z = depth.ptr<float>(y), *z_next = depth.ptr<float>(next);
+    float *out = acceleration.ptr<float>(y);
+
+    buildAccelerationStructurePixel(i_prev, i, i_next, z_prev, z, z_next, 0, cols, out);
+
+    int x = 1;
+
+    // 4 pixels per iteration, the x derivatives need the pixels left and right of them
+    for(; x + 4 < cols; x += 4)
+    {
+      __m128 iv = _mm_loadu_ps(i + x);
+      __m128 zv = _mm_loadu_ps(z + x);
+      __m128 idx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(i + x + 1), _mm_loadu_ps(i + x - 1)), scale);
+      __m128 idy = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(i_next + x), _mm_loadu_ps(i_prev + x)), scale);
+      __m128 zdx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(z + x + 1), _mm_loadu_ps(z + x - 1)), scale);
+      __m128 zdy = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(z_next + x), _mm_loadu_ps(z_prev + x)), scale);
+      __m128 zero0 = _mm_setzero_ps(), zero1 = _mm_setzero_ps();
+
+      // afterwards every register holds the channels of one pixel
+      _MM_TRANSPOSE4_PS(iv, zv, idx, idy);
+      _MM_TRANSPOSE4_PS(zdx, zdy, zero0, zero1);
+
+      float *o = out + x * 8;
+      _mm_store_ps(o +  0, iv);
+      _mm_store_ps(o +  4, zdx);
+      _mm_store_ps(o +  8, zv);
+      _mm_store_ps(o + 12, zdy);
+      _mm_store_ps(o + 16, idx);
+      _mm_store_ps(o + 20, zero0);
+      _mm_store_ps(o + 24, idy);
+      _mm_store_ps(o + 28, zero1);
+    }
 
-  prev_ptr = img.ptr<float>(0); // point to row 0 (should point to -1)
-  next_ptr = img.ptr<float>(1); // point to row 1
+    for(; x < cols; ++x)
+    {
+      buildAccelerationStructurePixel(i_prev, i, i_next, z_prev, z, z_next, x, cols, out + x * 8);
+    }
+  }
+}
 
-  const int inc = 4;
+namespace internal
+{
 
-  __m128 scale = _mm_set1_ps(0.5f);
+// rows of the target image per z-buffer band, and of the source image per projection chunk
+static const int ForwardWarpBandRows = 16;
 
-  // special loop for first row
-  for(int x = 0; x < img.cols; x += inc, prev_ptr += inc, next_ptr += inc, result_ptr += inc)
+/**
+ * Projects the points of a chunk of source rows into the target image, storing the target pixel index, -1 if the
+ * point isn't visible, and the transformed depth of every source pixel. Counts the points per target band.
+ */
+class ProjectForward
+{
+public:
+  ProjectForward(const cv::Mat& depth, const Eigen::Matrix<float, 3, 4>& transformation, const IntrinsicMatrix& intrinsics, int* target, float* target_z, int* band_counts, int num_bands) :
+    depth_(depth),
+    transformation_(transformation),
+    intrinsics_(intrinsics),
+    target_(target),
+    target_z_(target_z),
+    band_counts_(band_counts),
+    num_bands_(num_bands)
   {
-    _mm_store_ps(result_ptr, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(next_ptr), _mm_load_ps(prev_ptr)), scale));
-    //_mm_stream_ps(result_ptr + 4, _mm_sub_ps(_mm_load_ps(next_ptr + 4), _mm_load_ps(prev_ptr + 4)));
   }
 
-  // prev_ptr points to row 1  (should point to 0)
-  // next_ptr points to row 2
+  void operator()(const tbb::blocked_range<int>& chunks) const
+  {
+    const int width = depth_.cols, height = depth_.rows;
 
-  prev_ptr -= img.cols; // go 1 row back
+    const float fx = intrinsics_.fx(), fy = intrinsics_.fy(), ox = intrinsics_.ox(), oy = intrinsics_.oy();
+    const Eigen::Matrix<float, 3, 4>& t = transformation_;
 
-  for(int y = 1; y < img.rows - 1; y++)
+    const __m128 inv_fx = _mm_set1_ps(1.0f / fx), inv_fy = _mm_set1_ps(1.0f / fy);
+    const __m128 fx_ = _mm_set1_ps(fx), fy_ = _mm_set1_ps(fy), ox_ = _mm_set1_ps(ox), oy_ = _mm_set1_ps(oy);
+    const __m128 upper_x = _mm_set1_ps(float(width)), upper_y = _mm_set1_ps(float(height));
+    const __m128i width_ = _mm_set1_epi32(width);
+
+    for(int chunk = chunks.begin(); chunk < chunks.end(); ++chunk)
+    {
+      int* counts = band_counts_ + chunk * num_bands_;
+      std::fill(counts, counts + num_bands_, 0);
+
+      const int y_end = std::min(height, (chunk + 1) * ForwardWarpBandRows);
+
+      for(int y = chunk * ForwardWarpBandRows; y < y_end; ++y)
+      {
+        const float* z_ptr = depth_.ptr<float>(y);
+        int* target = target_ + y * width;
+        float* target_z = target_z_ + y * width;
+
+        const __m128 ny = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(float(y)), oy_), inv_fy);
+        int x = 0;
+
+        for(; x + 4 <= width; x += 4)
+        {
+          const __m128 z = _mm_loadu_ps(z_ptr + x);
+          const __m128 nx = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(float(x)), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f)), ox_), inv_fx);
+
+          const __m128 px = _mm_mul_ps(nx, z), py = _mm_mul_ps(ny, z);
+
+          const __m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t(0, 0)), px), _mm_mul_ps(_mm_set1_ps(t(0, 1)), py)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t(0, 2)), z), _mm_set1_ps(t(0, 3))));
+          const __m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t(1, 0)), px), _mm_mul_ps(_mm_set1_ps(t(1, 1)), py)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t(1, 2)), z), _mm_set1_ps(t(1, 3))));
+          const __m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t(2, 0)), px), _mm_mul_ps(_mm_set1_ps(t(2, 1)), py)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t(2, 2)), z), _mm_set1_ps(t(2, 3))));
+
+          const __m128 inv_tz = _mm_div_ps(ONES, tz);
+          const __m128 u = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(tx, inv_tz), fx_), ox_);
+          const __m128 v = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ty, inv_tz), fy_), oy_);
+
+          // NaN depths fail all comparisons
+          __m128 visible = _mm_cmpgt_ps(tz, ZEROS);
+          visible = _mm_and_ps(visible, _mm_and_ps(_mm_cmpge_ps(u, ZEROS), _mm_cmplt_ps(u, upper_x)));
+          visible = _mm_and_ps(visible, _mm_and_ps(_mm_cmpge_ps(v, ZEROS), _mm_cmplt_ps(v, upper_y)));
+
+          // truncation is floor for the visible ones
+          const __m128i ui = _mm_cvttps_epi32(_mm_and_ps(visible, u)), vi = _mm_cvttps_epi32(_mm_and_ps(visible, v));
+          const __m128i idx = _mm_add_epi32(_mm_mullo_epi16(vi, width_), ui);
+          const __m128i idx_hi = _mm_slli_epi32(_mm_mulhi_epu16(vi, width_), 16);
+
+          _mm_storeu_si128((__m128i*) (target + x), _mm_or_si128(_mm_and_si128(_mm_castps_si128(visible), _mm_add_epi32(idx, idx_hi)), _mm_andnot_si128(_mm_castps_si128(visible), _mm_set1_epi32(-1))));
+          _mm_storeu_ps(target_z + x, tz);
+        }
+
+        for(; x < width; ++x)
+        {
+          const float z = z_ptr[x];
+          const float px = (x - ox) / fx * z, py = (y - oy) / fy * z;
+
+          const float tx = t(0, 0) * px + t(0, 1) * py + t(0, 2) * z + t(0, 3);
+          const float ty = t(1, 0) * px + t(1, 1) * py + t(1, 2) * z + t(1, 3);
+          const float tz = t(2, 0) * px + t(2, 1) * py + t(2, 2) * z + t(2, 3);
+
+          const float u = tx / tz * fx + ox, v = ty / tz * fy + oy;
+
+          const bool visible = tz > 0.0f && u >= 0.0f && u < width && v >= 0.0f && v < height;
+
+          target[x] = visible ? int(v) * width + int(u) : -1;
+          target_z[x] = tz;
+        }
+
+        for(x = 0; x < width; ++x)
+        {
+          if(target[x] >= 0) counts[target[x] / (width * ForwardWarpBandRows)]++;
+        }
+      }
+    }
+  }
+private:
+  const cv::Mat& depth_;
+  const Eigen::Matrix<float, 3, 4>& transformation_;
+  const IntrinsicMatrix& intrinsics_;
+  int* target_;
+  float* target_z_;
+  int* band_counts_;
+  int num_bands_;
+};
+
+// sorts the visible source pixels of a chunk into the lists of their target bands, keeping the source order
+class ScatterToBands
+{
+public:
+  ScatterToBands(int width, int height, const int* target, int* band_offsets, int num_bands, int* band_points) :
+    width_(width),
+    height_(height),
+    target_(target),
+    band_offsets_(band_offsets),
+    num_bands_(num_bands),
+    band_points_(band_points)
   {
-    for(int x = 0; x < img.cols; x += inc, prev_ptr += inc, next_ptr += inc, result_ptr += inc)
+  }
+
+  void operator()(const tbb::blocked_range<int>& chunks) const
+  {
+    for(int chunk = chunks.begin(); chunk < chunks.end(); ++chunk)
     {
-      _mm_store_ps(result_ptr, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(next_ptr), _mm_load_ps(prev_ptr)), scale));
-      //_mm_stream_ps(result_ptr + 4, _mm_sub_ps(_mm_load_ps(next_ptr + 4), _mm_load_ps(prev_ptr + 4)));
+      int* offsets = band_offsets_ + chunk * num_bands_;
+
+      const int begin = chunk * ForwardWarpBandRows * width_;
+      const int end = std::min(height_, (chunk + 1) * ForwardWarpBandRows) * width_;
+
+      for(int idx = begin; idx < end; ++idx)
+      {
+        if(target_[idx] >= 0) band_points_[offsets[target_[idx] / (width_ * ForwardWarpBandRows)]++] = idx;
+      }
+    }
+  }
+private:
+  int width_, height_;
+  const int* target_;
+  int* band_offsets_;
+  int num_bands_;
+  int* band_points_;
+};
+
+// resolves the z-buffer of a band of target rows, which only this task writes
+class ResolveBands
+{
+public:
+  ResolveBands(const cv::Mat& intensity, const int* target, const float* target_z, const int* band_begin, const int* band_points, cv::Mat& warped_intensity, cv::Mat& warped_depth) :
+    intensity_(intensity),
+    target_(target),
+    target_z_(target_z),
+    band_begin_(band_begin),
+    band_points_(band_points),
+    warped_intensity_(warped_intensity),
+    warped_depth_(warped_depth)
+  {
+  }
+
+  void operator()(const tbb::blocked_range<int>& bands) const
+  {
+    const int width = intensity_.cols;
+
+    const float* intensity = intensity_.ptr<float>();
+    float* warped_intensity = warped_intensity_.ptr<float>();
+    float* warped_depth = warped_depth_.ptr<float>();
+
+    for(int band = bands.begin(); band < bands.end(); ++band)
+    {
+      const int y_end = std::min(intensity_.rows, (band + 1) * ForwardWarpBandRows);
+
+      std::fill(warped_depth + band * ForwardWarpBandRows * width, warped_depth + y_end * width, std::numeric_limits<float>::infinity());
+      std::fill(warped_intensity + band * ForwardWarpBandRows * width, warped_intensity + y_end * width, 0.0f);
+
+      for(int idx = band_begin_[band]; idx < band_begin_[band + 1]; ++idx)
+      {
+        const int source = band_points_[idx];
+        const int t = target_[source];
+
+        if(target_z_[source] < warped_depth[t])
+        {
+          warped_depth[t] = target_z_[source];
+          warped_intensity[t] = intensity[source];
+        }
+      }
+
+      for(float* z = warped_depth + band * ForwardWarpBandRows * width; z != warped_depth + y_end * width; ++z)
+      {
+        if(*z == std::numeric_limits<float>::infinity()) *z = InvalidDepth;
+      }
     }
   }
+private:
+  const cv::Mat& intensity_;
+  const int* target_;
+  const float* target_z_;
+  const int* band_begin_;
+  const int* band_points_;
+  cv::Mat& warped_intensity_;
+  cv::Mat& warped_depth_;
+};
+
+} /* namespace internal */
+
+void RgbdImage::warpForwardSse(const AffineTransform& transformation, const IntrinsicMatrix& intrinsics, RgbdImage& result)
+{
+  assert(hasIntensity() && hasDepth() && intensity.isContinuous() && depth.isContinuous());
+
+  const int w = int(width), h = int(height);
+  const int num_bands = (h + internal::ForwardWarpBandRows - 1) / internal::ForwardWarpBandRows;
+
+  // source chunks and target bands have the same height
+  const int num_chunks = num_bands;
 
-  // special loop for last row
-  next_ptr -= img.cols; // go 1 row back
+  const Eigen::Matrix<float, 3, 4> t = transformation.cast<float>().matrix().topRows<3>();
 
-  for(int x = 0; x < img.cols; x += inc, prev_ptr += inc, next_ptr += inc, result_ptr += inc)
+  std::vector<int> target(w * h), band_counts(num_chunks * num_bands), band_begin(num_bands + 1);
+  std::vector<float> target_z(w * h);
+
+  tbb::parallel_for(tbb::blocked_range<int>(0, num_chunks), internal::ProjectForward(depth, t, intrinsics, &target[0], &target_z[0], &band_counts[0], num_bands));
+
+  // band major, so the points of a band are contiguous and in source order, the counts become the write offsets
+  int total = 0;
+
+  for(int band = 0; band < num_bands; ++band)
   {
-    _mm_store_ps(result_ptr, _mm_mul_ps(_mm_sub_ps(_mm_load_ps(next_ptr), _mm_load_ps(prev_ptr)), scale));
-    //_mm_stream_ps(result_ptr + 4, _mm_sub_ps(_mm_load_ps(next_ptr + 4), _mm_load_ps(prev_ptr + 4)));
+    band_begin[band] = total;
+
+    for(int chunk = 0; chunk < num_chunks; ++chunk)
+    {
+      const int count = band_counts[chunk * num_bands + band];
+      band_counts[chunk * num_bands + band] = total;
+      total += count;
+    }
   }
+
+  band_begin[num_bands] = total;
+
+  std::vector<int> band_points(std::max(total, 1));
+
+  tbb::parallel_for(tbb::blocked_range<int>(0, num_chunks), internal::ScatterToBands(w, h, &target[0], &band_counts[0], num_bands, &band_points[0]));
+
+  cv::Mat warped_intensity(intensity.size(), intensity.type()), warped_depth(depth.size(), depth.type());
+
+  tbb::parallel_for(tbb::blocked_range<int>(0, num_bands), internal::ResolveBands(intensity, &target[0], &target_z[0], &band_begin[0], &band_points[0], warped_intensity, warped_depth));
+
+  result.intensity = warped_intensity;
+  result.depth = warped_depth;
+  result.initialize();
 }
 
+
 } /* namespace core */
 } /* namespace dvo */
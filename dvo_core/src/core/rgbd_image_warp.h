@@ -0,0 +1,62 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RGBD_IMAGE_WARP_H_
+#define RGBD_IMAGE_WARP_H_
+
+// shared by the SSE and AVX2 inverse warp kernels, see RgbdImage::warpIntensitySse. plain data only, so it can be
+// included from translation units compiled with different instruction sets
+
+namespace dvo
+{
+namespace core
+{
+namespace internal
+{
+
+struct WarpIntensityArgs
+{
+  // the image interpolated from, rows are stride floats apart
+  const float *intensity, *depth;
+  int stride, width, height;
+
+  // rows of the affine transformation, 16 byte aligned
+  const float* transformation;
+  float fx, fy, ox, oy;
+
+  // homogeneous reference points in raster order, the transformed ones are optional
+  const float* points;
+  float* transformed_points;
+
+  // contiguous, one value per point
+  float *warped_intensity, *warped_depth;
+};
+
+// points [begin, end), expects the rounding mode to be set to truncation
+void warpIntensitySse(const WarpIntensityArgs& args, int begin, int end);
+
+// 8 points per iteration with gathers, only call if the cpu supports AVX2, see rgbd_image_avx2.cpp. returns the end
+// of the points it warped, the remaining ones are left for warpIntensitySse
+int warpIntensityAvx2(const WarpIntensityArgs& args, int begin, int end);
+
+} /* namespace internal */
+} /* namespace core */
+} /* namespace dvo */
+#endif /* RGBD_IMAGE_WARP_H_ */
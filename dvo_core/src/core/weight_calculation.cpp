@@ -24,13 +24,68 @@
 #include <dvo/core/weight_calculation.h>
 
 #include <dvo/util/histogram.h>
+
+#ifdef DVO_DEBUG_VISUALIZATION
 #include <dvo/visualization/visualizer.h>
+#endif
+
+#include <emmintrin.h>
 
 namespace dvo
 {
 namespace core
 {
 
+// all bits set for finite values, x - x is NaN for infinity and NaN
+static inline __m128 isFinite(const __m128& x)
+{
+  return _mm_cmpeq_ps(_mm_sub_ps(x, x), _mm_setzero_ps());
+}
+
+// sums the t-distribution terms of the finite values, used by the scale estimators fitting a t-distribution
+static void accumulateTDistributionScale(const float* data, const size_t n, const float lambda, const float dof, float& num, float& sum)
+{
+  const size_t n4 = n - (n % 4);
+
+  const __m128 one4 = _mm_set1_ps(1.0f);
+  const __m128 lambda4 = _mm_set1_ps(lambda);
+  const __m128 dof4 = _mm_set1_ps(dof);
+  const __m128 dof_plus_one4 = _mm_set1_ps(dof + 1.0f);
+
+  __m128 num_acc = _mm_setzero_ps(), sum_acc = _mm_setzero_ps();
+
+  for(size_t idx = 0; idx < n4; idx += 4)
+  {
+    const __m128 x = _mm_loadu_ps(data + idx);
+    const __m128 x_square = _mm_mul_ps(x, x);
+    const __m128 finite = isFinite(x);
+
+    num_acc = _mm_add_ps(num_acc, _mm_and_ps(finite, one4));
+    sum_acc = _mm_add_ps(sum_acc, _mm_and_ps(finite, _mm_div_ps(_mm_mul_ps(x_square, dof_plus_one4), _mm_add_ps(dof4, _mm_mul_ps(lambda4, x_square)))));
+  }
+
+  EIGEN_ALIGN16 float tmp_num[4], tmp_sum[4];
+  _mm_store_ps(tmp_num, num_acc);
+  _mm_store_ps(tmp_sum, sum_acc);
+
+  float tmpnum = num + tmp_num[0] + tmp_num[1] + tmp_num[2] + tmp_num[3];
+  float tmpsum = sum + tmp_sum[0] + tmp_sum[1] + tmp_sum[2] + tmp_sum[3];
+
+  for(size_t idx = n4; idx < n; ++idx)
+  {
+    const float& x = data[idx];
+
+    if(std::isfinite(x))
+    {
+      tmpnum += 1.0f;
+      tmpsum += x * x * ( (dof + 1.0f) / (dof + lambda * x * x) );
+    }
+  }
+
+  num = tmpnum;
+  sum = tmpsum;
+}
+
 const float TDistributionScaleEstimator::INITIAL_SIGMA = 5.0f;
 const float TDistributionScaleEstimator::DEFAULT_DOF = 5.0f;
 
@@ -61,18 +116,7 @@ float TDistributionScaleEstimator::compute(const cv::Mat& errors) const
     initial_lamda = lambda;
     lambda = 0.0f;
 
-    const float* data_ptr = errors.ptr<float>();
-
-    for(size_t idx = 0; idx < errors.size().area(); ++idx, ++data_ptr)
-    {
-      const float& data = *data_ptr;
-
-      if(std::isfinite(data))
-      {
-        num += 1.0f;
-        lambda += data * data * ( (dof + 1.0f) / (dof + initial_lamda * data * data) );
-      }
-    }
+    accumulateTDistributionScale(errors.ptr<float>(), errors.size().area(), initial_lamda, dof, num, lambda);
 
     lambda /= num;
     lambda = 1.0f / lambda;
@@ -105,58 +149,7 @@ struct TDistributionScaleReduction
 
   void operator()(const tbb::blocked_range<size_t>& r)
   {
-    //size_t vectorizable = r.size() / 4;
-    //size_t remaining = r.size() - (vectorizable * 4);
-
-    const float* data_ptr = data + r.begin();
-
-    float tmpnum = num, tmplambda = lambda;
-
-    //float tmpnum4[4], tmplambda4[4];
-    //
-    //__m128 lambda4 = _mm_setzero_ps();
-    //__m128 num4 = _mm_setzero_ps();
-    //__m128 ini4 = _mm_set1_ps(initial_lambda);
-    //__m128 dof4 = _mm_set1_ps(dof);
-    //__m128 ones = _mm_set1_ps(0.0f);
-    //__m128 isnan, data4, data4square;
-    //
-    //for(size_t idx = r.begin(); idx < r.end(); idx += 4, data_ptr += 4)
-    //{
-    //  data4 = _mm_load_ps(data_ptr);
-    //  data4square = _mm_mul_ps(data4, data4);
-    //  isnan = _mm_cmpord_ps(data4, data4);
-    //
-    //  num4 = _mm_add_ps(num4, _mm_and_ps(isnan, ones));
-    //  lambda4 = _mm_add_ps(lambda4, _mm_and_ps(isnan, _mm_mul_ps(data4square, _mm_div_ps(_mm_add_ps(dof4, ones),  _mm_add_ps(dof4, _mm_mul_ps(ini4, data4square))))));
-    //
-    //  //const float& data = *data_ptr;
-    //  //
-    //  //if(std::isfinite(data))
-    //  //{
-    //  //  tmp_num += 1;
-    //  //  tmp_lambda += data * data * ( (dof + 1.0f) / (dof + initial_lambda * data * data) );
-    //  //}
-    //}
-    //_mm_store_ps(tmpnum4, num4);
-    //_mm_store_ps(tmplambda4, lambda4);
-    //
-    //tmpnum += tmpnum4[0] + tmpnum4[1] + tmpnum4[2]+ tmpnum4[3];
-    //tmplambda += tmplambda4[0] + tmplambda4[1] + tmplambda4[2]+ tmplambda4[3];
-
-    for(size_t idx = r.begin(); idx != r.end(); ++idx, ++data_ptr)
-    {
-      const float& data = *data_ptr;
-
-      if(std::isfinite(data))
-      {
-        tmpnum += 1.0f;
-        tmplambda += data * data * ( (dof + 1.0f) / (dof + initial_lambda * data * data));
-      }
-    }
-
-    num = tmpnum;
-    lambda = tmplambda;
+    accumulateTDistributionScale(data + r.begin(), r.size(), initial_lambda, dof, num, lambda);
   }
 
   void join(TDistributionScaleReduction& other)
@@ -297,6 +290,27 @@ ScaleEstimator* ScaleEstimators::get(ScaleEstimators::enum_t type)
   return 0;
 }
 
+void InfluenceFunction::values(const float* x, float* weights, const size_t n) const
+{
+  for(size_t idx = 0; idx < n; ++idx)
+  {
+    weights[idx] = std::isfinite(x[idx]) ? value(x[idx]) : 0.0f;
+  }
+}
+
+void UnitInfluenceFunction::values(const float* x, float* weights, const size_t n) const
+{
+  const size_t n4 = n - (n % 4);
+  const __m128 one4 = _mm_set1_ps(1.0f);
+
+  for(size_t idx = 0; idx < n4; idx += 4)
+  {
+    _mm_storeu_ps(weights + idx, _mm_and_ps(isFinite(_mm_loadu_ps(x + idx)), one4));
+  }
+
+  InfluenceFunction::values(x + n4, weights + n4, n - n4);
+}
+
 const float TukeyInfluenceFunction::DEFAULT_B = 4.6851f;
 
 TukeyInfluenceFunction::TukeyInfluenceFunction(const float b)
@@ -320,6 +334,25 @@ inline float TukeyInfluenceFunction::value(const float& x) const
   }
 }
 
+void TukeyInfluenceFunction::values(const float* x, float* weights, const size_t n) const
+{
+  const size_t n4 = n - (n % 4);
+  const __m128 one4 = _mm_set1_ps(1.0f);
+  const __m128 b_square4 = _mm_set1_ps(b_square);
+
+  for(size_t idx = 0; idx < n4; idx += 4)
+  {
+    const __m128 x4 = _mm_loadu_ps(x + idx);
+    const __m128 x_square = _mm_mul_ps(x4, x4);
+    const __m128 tmp = _mm_sub_ps(one4, _mm_div_ps(x_square, b_square4));
+
+    // the comparison is false for infinity and NaN
+    _mm_storeu_ps(weights + idx, _mm_and_ps(_mm_cmple_ps(x_square, b_square4), _mm_mul_ps(tmp, tmp)));
+  }
+
+  InfluenceFunction::values(x + n4, weights + n4, n - n4);
+}
+
 void TukeyInfluenceFunction::configure(const float& param)
 {
   b_square = param * param;
@@ -338,6 +371,22 @@ inline float TDistributionInfluenceFunction::value(const float & x) const
   return ((dof + 1.0f) / (dof + (x * x)));
 }
 
+void TDistributionInfluenceFunction::values(const float* x, float* weights, const size_t n) const
+{
+  const size_t n4 = n - (n % 4);
+  const __m128 dof4 = _mm_set1_ps(dof);
+  const __m128 dof_plus_one4 = _mm_set1_ps(dof + 1.0f);
+
+  for(size_t idx = 0; idx < n4; idx += 4)
+  {
+    const __m128 x4 = _mm_loadu_ps(x + idx);
+
+    _mm_storeu_ps(weights + idx, _mm_and_ps(isFinite(x4), _mm_div_ps(dof_plus_one4, _mm_add_ps(dof4, _mm_mul_ps(x4, x4)))));
+  }
+
+  InfluenceFunction::values(x + n4, weights + n4, n - n4);
+}
+
 void TDistributionInfluenceFunction::configure(const float& param)
 {
   dof = param;
@@ -365,6 +414,26 @@ inline float HuberInfluenceFunction::value(const float& x) const
   }
 }
 
+void HuberInfluenceFunction::values(const float* x, float* weights, const size_t n) const
+{
+  const size_t n4 = n - (n % 4);
+  const __m128 one4 = _mm_set1_ps(1.0f);
+  const __m128 k4 = _mm_set1_ps(k);
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+  for(size_t idx = 0; idx < n4; idx += 4)
+  {
+    const __m128 x4 = _mm_loadu_ps(x + idx);
+    const __m128 x_abs = _mm_and_ps(x4, abs_mask);
+    const __m128 inlier = _mm_cmplt_ps(x_abs, k4);
+    const __m128 w = _mm_or_ps(_mm_and_ps(inlier, one4), _mm_andnot_ps(inlier, _mm_div_ps(k4, x_abs)));
+
+    _mm_storeu_ps(weights + idx, _mm_and_ps(isFinite(x4), w));
+  }
+
+  InfluenceFunction::values(x + n4, weights + n4, n - n4);
+}
+
 void HuberInfluenceFunction::configure(const float& param)
 {
   k = param;
@@ -442,28 +511,18 @@ void WeightCalculation::calculateWeights(const cv::Mat& errors, cv::Mat& weights
 {
   weights.create(errors.size(), errors.type());
 
-  cv::Mat scaled_errors = errors / scale_;
-  const float* err_ptr = scaled_errors.ptr<float>();
-  float* weight_ptr = weights.ptr<float>();
+  cv::multiply(errors, cv::Scalar(1.0 / scale_), scaled_errors_);
 
-  for(size_t idx = 0; idx < errors.size().area(); ++idx, ++err_ptr, ++weight_ptr)
-  {
-    if(std::isfinite(*err_ptr))
-    {
-      *weight_ptr = influenceFunction_->value(*err_ptr);
-    }
-    else
-    {
-      *weight_ptr = 0.0f;
-    }
-  }
+  influenceFunction_->values(scaled_errors_.ptr<float>(), weights.ptr<float>(), errors.size().area());
 
+#ifdef DVO_DEBUG_VISUALIZATION
   dvo::visualization::Visualizer::instance()
     //.show("residuals", cv::abs(errors))
     //.showHistogram("residuals_histogram", errors, 5.0f, -255.0f, 255.0f)
     .show("weights", weights)
     //.show("weighted_residuals", cv::abs(weights.mul(errors)))
   ;
+#endif
 }
 
 } /* namespace core */
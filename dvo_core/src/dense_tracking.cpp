@@ -28,10 +28,14 @@
 
 #include <Eigen/Core>
 
+#include <tbb/parallel_reduce.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
 #include <dvo/core/datatypes.h>
 #include <dvo/core/point_selection_predicates.h>
 #include <dvo/util/revertable.h>
-#include <dvo/util/stopwatch.h>
+#include <dvo/util/instrumentation.h>
 #include <dvo/util/id_generator.h>
 #include <dvo/util/histogram.h>
 #include <dvo/visualization/visualizer.h>
@@ -47,6 +51,281 @@ static inline bool isfinite(const float& v)
   return std::isfinite(v);
 }
 
+namespace internal
+{
+
+/**
+ * Builds the normal equations from the points with valid residuals, either in AoS or SoA layout. Without weighting
+ * every constraint has the precision as weight, Blocked has to match the block size of the least squares.
+ */
+template<bool UseSoa, bool Weighted, bool Blocked>
+struct NormalEquationsReduction
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+  NormalEquationsReduction(const PointIterator& first_point_error, const PointWithIntensityAndDepthSoa* soa_points_error, const WeightIterator& first_weight, const Eigen::Matrix2f& precision, size_t block_size) :
+    first_point_error(first_point_error),
+    soa_points_error(soa_points_error),
+    first_weight(first_weight),
+    precision(precision)
+  {
+    ls.blockSize(block_size);
+    ls.initialize(1);
+  }
+
+  NormalEquationsReduction(NormalEquationsReduction& other, tbb::split) :
+    first_point_error(other.first_point_error),
+    soa_points_error(other.soa_points_error),
+    first_weight(other.first_weight),
+    precision(other.precision)
+  {
+    ls.blockSize(other.ls.blockSize());
+    ls.initialize(1);
+  }
+
+  void operator()(const tbb::blocked_range<size_t>& r)
+  {
+    Matrix2x6 J, Jw;
+    Vector6 Jz;
+
+    if(UseSoa)
+    {
+      typedef PointWithIntensityAndDepthSoa Soa;
+
+      const float *x = soa_points_error->channel(Soa::X), *y = soa_points_error->channel(Soa::Y), *z = soa_points_error->channel(Soa::Z);
+      const float *ri = soa_points_error->channel(Soa::Intensity), *rd = soa_points_error->channel(Soa::Depth);
+      const float *idx = soa_points_error->channel(Soa::IntensityDx), *idy = soa_points_error->channel(Soa::IntensityDy);
+      const float *zdx = soa_points_error->channel(Soa::DepthDx), *zdy = soa_points_error->channel(Soa::DepthDy);
+
+      Vector4 p;
+      p(3) = 1.0f;
+
+      for(size_t k = r.begin(); k != r.end(); ++k)
+      {
+        p(0) = x[k];
+        p(1) = y[k];
+        p(2) = z[k];
+
+        DenseTracker::computeJacobianOfProjectionAndTransformation(p, Jw);
+        DenseTracker::compute3rdRowOfJacobianOfTransformation(p, Jz);
+
+        J.row(0) = idx[k] * Jw.row(0) + idy[k] * Jw.row(1);
+        J.row(1) = zdx[k] * Jw.row(0) + zdy[k] * Jw.row(1) - Jz.transpose();
+
+        if(Weighted)
+          ls.accumulate<Blocked>(J, Eigen::Vector2f(ri[k], rd[k]), first_weight[k] * precision);
+        else
+          ls.accumulate<Blocked>(J, Eigen::Vector2f(ri[k], rd[k]), precision);
+      }
+    }
+    else
+    {
+      WeightIterator w_it = first_weight + r.begin();
+
+      for(PointIterator e_it = first_point_error + r.begin(); e_it != first_point_error + r.end(); ++e_it, ++w_it)
+      {
+        DenseTracker::computeJacobianOfProjectionAndTransformation(e_it->getPointVec4f(), Jw);
+        DenseTracker::compute3rdRowOfJacobianOfTransformation(e_it->getPointVec4f(), Jz);
+
+        J.row(0) = e_it->getIntensityDerivativeVec2f().transpose() * Jw;
+        J.row(1) = e_it->getDepthDerivativeVec2f().transpose() * Jw - Jz.transpose();
+
+        if(Weighted)
+          ls.accumulate<Blocked>(J, e_it->getIntensityAndDepthVec2f(), (*w_it) * precision);
+        else
+          ls.accumulate<Blocked>(J, e_it->getIntensityAndDepthVec2f(), precision);
+      }
+    }
+  }
+
+  void join(const NormalEquationsReduction& other)
+  {
+    ls.combine(other.ls);
+  }
+
+  PointIterator first_point_error;
+  const PointWithIntensityAndDepthSoa* soa_points_error;
+  WeightIterator first_weight;
+  Eigen::Matrix2f precision;
+
+  NormalEquationsLeastSquares ls;
+};
+
+// DenseTracker::NormalEquationsKernel, the block size is taken from ls
+template<bool UseSoa, bool Weighted, bool Blocked, bool Parallel>
+static void computeNormalEquations(const PointIterator& first_point_error, const PointWithIntensityAndDepthSoa* soa_points_error, const WeightIterator& first_weight, const Eigen::Matrix2f& precision, size_t n, size_t grain_size, NormalEquationsLeastSquares& ls)
+{
+  NormalEquationsReduction<UseSoa, Weighted, Blocked> reduction(first_point_error, soa_points_error, first_weight, precision, ls.blockSize());
+
+  if(Parallel)
+    tbb::parallel_reduce(tbb::blocked_range<size_t>(0, n, grain_size), reduction);
+  else
+    reduction(tbb::blocked_range<size_t>(0, n));
+
+  ls = reduction.ls;
+}
+
+template<bool Blocked, bool Parallel, typename Kernel>
+static void selectNormalEquationsKernels(Kernel (&kernels)[2][2])
+{
+  kernels[0][0] = &computeNormalEquations<false, false, Blocked, Parallel>;
+  kernels[0][1] = &computeNormalEquations<false, true, Blocked, Parallel>;
+  kernels[1][0] = &computeNormalEquations<true, false, Blocked, Parallel>;
+  kernels[1][1] = &computeNormalEquations<true, true, Blocked, Parallel>;
+}
+
+/**
+ * Runs the fused kernel on parts of the reference points and merges normal equations, scatter and log likelihood.
+ */
+struct FusedNormalEquationsReduction
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+  FusedNormalEquationsReduction(const PointIterator& first_point, const RgbdImage& current, const IntrinsicMatrix& intrinsics, const Eigen::Affine3f& transform, const Vector8f& reference_weight, const Vector8f& current_weight, const Eigen::Vector2f& mean, const Eigen::Matrix2f& precision) :
+    first_point(first_point),
+    current(current),
+    intrinsics(intrinsics),
+    transform(transform),
+    reference_weight(reference_weight),
+    current_weight(current_weight),
+    mean(mean),
+    precision(precision)
+  {
+    reset();
+  }
+
+  FusedNormalEquationsReduction(FusedNormalEquationsReduction& other, tbb::split) :
+    first_point(other.first_point),
+    current(other.current),
+    intrinsics(other.intrinsics),
+    transform(other.transform),
+    reference_weight(other.reference_weight),
+    current_weight(other.current_weight),
+    mean(other.mean),
+    precision(other.precision)
+  {
+    ls.blockSize(other.ls.blockSize());
+    reset();
+  }
+
+  void reset()
+  {
+    ls.initialize(1);
+    result.ValidConstraints = 0;
+    result.WeightedScatter.setZero();
+    result.LogLikelihoodErrorSum = 0.0;
+  }
+
+  void operator()(const tbb::blocked_range<size_t>& r)
+  {
+    ComputeNormalEquationsResult part;
+    computeResidualsAndNormalEquationsSse(first_point + r.begin(), first_point + r.end(), current, intrinsics, transform, reference_weight, current_weight, mean, precision, ls, part);
+
+    add(part);
+  }
+
+  void join(const FusedNormalEquationsReduction& other)
+  {
+    ls.combine(other.ls);
+    add(other.result);
+  }
+
+  void add(const ComputeNormalEquationsResult& other)
+  {
+    result.ValidConstraints += other.ValidConstraints;
+    result.WeightedScatter += other.WeightedScatter;
+    result.LogLikelihoodErrorSum += other.LogLikelihoodErrorSum;
+  }
+
+  PointIterator first_point;
+  const RgbdImage& current;
+  const IntrinsicMatrix& intrinsics;
+  const Eigen::Affine3f transform;
+  const Vector8f reference_weight, current_weight;
+  const Eigen::Vector2f mean;
+  const Eigen::Matrix2f precision;
+
+  NormalEquationsLeastSquares ls;
+  ComputeNormalEquationsResult result;
+};
+
+/**
+ * Computes residuals for fixed size chunks of the reference points. The output of each chunk starts at the same
+ * offset as its input, the results are compacted afterwards.
+ */
+struct ChunkedResidualComputation
+{
+  ChunkedResidualComputation(const PointIterator& first_point, const PointIterator& last_point, const RgbdImage& current, const IntrinsicMatrix& intrinsics, const Eigen::Affine3f& transform, const Vector8f& reference_weight, const Vector8f& current_weight, const ComputeResidualsResult& output, size_t chunk_size, std::vector<size_t>& chunk_valid) :
+    first_point(first_point),
+    last_point(last_point),
+    current(current),
+    intrinsics(intrinsics),
+    transform(transform),
+    reference_weight(reference_weight),
+    current_weight(current_weight),
+    output(output),
+    chunk_size(chunk_size),
+    chunk_valid(chunk_valid)
+  {
+  }
+
+  void operator()(const tbb::blocked_range<size_t>& r) const
+  {
+    for(size_t chunk = r.begin(); chunk != r.end(); ++chunk)
+    {
+      const size_t begin = chunk * chunk_size;
+      const size_t end = std::min<size_t>(begin + chunk_size, last_point - first_point);
+
+      ComputeResidualsResult result;
+      result.first_point_error = output.first_point_error + begin;
+      result.first_residual = output.first_residual + begin;
+
+      computeResidualsSse(first_point + begin, first_point + end, current, intrinsics, transform, reference_weight, current_weight, result);
+
+      chunk_valid[chunk] = result.last_residual - result.first_residual;
+    }
+  }
+
+  const PointIterator first_point, last_point;
+  const RgbdImage& current;
+  const IntrinsicMatrix& intrinsics;
+  const Eigen::Affine3f& transform;
+  const Vector8f& reference_weight;
+  const Vector8f& current_weight;
+  const ComputeResidualsResult& output;
+  const size_t chunk_size;
+  std::vector<size_t>& chunk_valid;
+};
+
+static void computeResidualsParallel(const PointIterator& first_point, const PointIterator& last_point, const RgbdImage& current, const IntrinsicMatrix& intrinsics, const Eigen::Affine3f& transform, const Vector8f& reference_weight, const Vector8f& current_weight, ComputeResidualsResult& result, size_t chunk_size, std::vector<size_t>& chunk_valid)
+{
+  if(first_point == last_point)
+  {
+    result.last_point_error = result.first_point_error;
+    result.last_residual = result.first_residual;
+    return;
+  }
+
+  const size_t num_chunks = ((last_point - first_point) + chunk_size - 1) / chunk_size;
+  chunk_valid.assign(num_chunks, 0);
+
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, num_chunks, 1), ChunkedResidualComputation(first_point, last_point, current, intrinsics, transform, reference_weight, current_weight, result, chunk_size, chunk_valid));
+
+  // move the valid results of all chunks together
+  result.last_point_error = result.first_point_error + chunk_valid[0];
+  result.last_residual = result.first_residual + chunk_valid[0];
+
+  for(size_t chunk = 1; chunk < num_chunks; ++chunk)
+  {
+    const size_t begin = chunk * chunk_size;
+
+    result.last_point_error = std::copy(result.first_point_error + begin, result.first_point_error + begin + chunk_valid[chunk], result.last_point_error);
+    result.last_residual = std::copy(result.first_residual + begin, result.first_residual + begin + chunk_valid[chunk], result.last_residual);
+  }
+}
+
+} /* namespace internal */
+
 const DenseTracker::Config& DenseTracker::getDefaultConfig()
 {
   static Config defaultConfig;
@@ -80,8 +359,38 @@ void DenseTracker::configure(const Config& config)
 
   cfg = config;
 
-  selection_predicate_.intensity_threshold = cfg.IntensityDerivativeThreshold;
-  selection_predicate_.depth_threshold = cfg.DepthDerivativeThreshold;
+  for(std::vector<LevelStats>::iterator it = scratch_.level_stats.begin(); it != scratch_.level_stats.end(); ++it)
+    it->Iterations.reserve(cfg.MaxIterationsPerLevel + 1);
+
+  if(iteration_time_.size() != cfg.getNumLevels())
+    iteration_time_.assign(cfg.getNumLevels(), 0.0);
+
+  if(level_schedule_.size() != cfg.getNumLevels() || !cfg.UseAdaptiveLevels)
+    resetLevelSchedule();
+
+  if(level_scale_.size() != cfg.getNumLevels() || !cfg.UseWarmStartedScale)
+    resetLevelScale();
+
+  if(selection_predicate_.intensity_threshold != cfg.IntensityDerivativeThreshold || selection_predicate_.depth_threshold != cfg.DepthDerivativeThreshold)
+  {
+    selection_predicate_.intensity_threshold = cfg.IntensityDerivativeThreshold;
+    selection_predicate_.depth_threshold = cfg.DepthDerivativeThreshold;
+
+    // the reference selection is kept across matches with the same reference pyramid
+    reference_selection_.invalidate();
+  }
+  reference_selection_.maxPointsPerLevel(cfg.MaxPointsPerLevel);
+  reference_selection_.mortonOrder(cfg.UseMortonOrder);
+
+  if(cfg.UseMixedPrecisionSolver)
+    cfg.UseParallel ? internal::selectNormalEquationsKernels<true, true>(normal_equations_kernels_) : internal::selectNormalEquationsKernels<true, false>(normal_equations_kernels_);
+  else
+    cfg.UseParallel ? internal::selectNormalEquationsKernels<false, true>(normal_equations_kernels_) : internal::selectNormalEquationsKernels<false, false>(normal_equations_kernels_);
+
+  if(!cfg.UseGpu)
+    gpu_.reset();
+  else if(!gpu_ && GpuNormalEquations::available())
+    gpu_.reset(new GpuNormalEquations());
 
   if(cfg.UseWeighting)
   {
@@ -101,6 +410,142 @@ void DenseTracker::configure(const Config& config)
   }
 }
 
+double DenseTracker::expectedIterationTime(int level) const
+{
+  if(iteration_time_[level] > 0.0) return iteration_time_[level];
+
+  // nothing measured yet, the next finer level has about 4 times the points
+  if(level + 1 < int(iteration_time_.size())) return 4.0 * iteration_time_[level + 1];
+
+  return 0.0;
+}
+
+void DenseTracker::updateIterationTime(int level, double seconds)
+{
+  double& t = iteration_time_[level];
+
+  t = t > 0.0 ? 0.9 * t + 0.1 * seconds : seconds;
+}
+
+// matches a level converged in its first iteration, before it is skipped
+static const int AdaptiveLevelHistory = 5;
+
+// a skipped level is matched again after this many matches
+static const int AdaptiveProbeInterval = 10;
+
+// LastLevel is negligible if it corrects the estimate by less than this, about a quarter pixel of a 320x240 level
+static const double MaxLastLevelCorrection = 1e-3;
+
+// the level above LastLevel has to be textured enough to replace it
+static const size_t MinLastLevelAboveConstraints = 2000;
+
+// LastLevel is added back once the entropy of the level above drops below the one it was dropped at by this much,
+// i.e., the determinant of the information halves
+static const double MaxLastLevelEntropyDrop = 0.6931471805599453;
+
+// the iteration whose estimate a level keeps
+static const DenseTracker::IterationStats& finalIteration(const DenseTracker::LevelStats& level_stats)
+{
+  const size_t n = level_stats.Iterations.size();
+
+  return level_stats.TerminationCriterion != DenseTracker::TerminationCriteria::LogLikelihoodDecreased || n < 2 ? level_stats.Iterations[n - 1] : level_stats.Iterations[n - 2];
+}
+
+void DenseTracker::resetLevelScale()
+{
+  LevelScale initial;
+  initial.mean.setZero();
+  initial.precision.setZero();
+  initial.valid = false;
+
+  level_scale_.assign(cfg.getNumLevels(), initial);
+}
+
+void DenseTracker::resetLevelSchedule()
+{
+  LevelSchedule initial;
+  initial.streak = 0;
+  initial.skipped = 0;
+
+  level_schedule_.assign(cfg.getNumLevels(), initial);
+  skip_last_level_ = false;
+  reference_entropy_ = 0.0;
+  last_level_above_constraints_ = 0;
+}
+
+bool DenseTracker::skipScheduledLevel(LevelSchedule& schedule)
+{
+  if(schedule.skipped >= AdaptiveProbeInterval)
+  {
+    schedule.skipped = 0;
+    return false;
+  }
+
+  schedule.skipped++;
+  return true;
+}
+
+uint32_t DenseTracker::scheduleLevels(int first_level)
+{
+  uint32_t skipped = 0;
+  int last_level = cfg.LastLevel;
+
+  // the level above takes over as last level
+  if(skip_last_level_ && first_level > cfg.LastLevel && skipScheduledLevel(level_schedule_[cfg.LastLevel]))
+  {
+    skipped |= 1u << cfg.LastLevel;
+    last_level++;
+  }
+
+  // the last level is always matched
+  for(int level = first_level; level > last_level; --level)
+  {
+    LevelSchedule& schedule = level_schedule_[level];
+
+    if(schedule.streak >= AdaptiveLevelHistory && skipScheduledLevel(schedule)) skipped |= 1u << level;
+  }
+
+  return skipped;
+}
+
+void DenseTracker::updateLevelSchedule(int level, const LevelStats& level_stats, int iterations, double correction)
+{
+  LevelSchedule& schedule = level_schedule_[level];
+
+  if(level != cfg.LastLevel)
+  {
+    bool converged = iterations <= 1 && level_stats.TerminationCriterion == TerminationCriteria::IncrementTooSmall;
+    schedule.streak = converged ? schedule.streak + 1 : 0;
+
+    if(level == cfg.LastLevel + 1)
+    {
+      const IterationStats& it = finalIteration(level_stats);
+      double entropy = std::log(it.EstimateInformation.determinant());
+
+      last_level_above_constraints_ = it.ValidConstraints;
+
+      if(!skip_last_level_)
+      {
+        reference_entropy_ = entropy;
+      }
+      else if(!(entropy > reference_entropy_ - MaxLastLevelEntropyDrop))
+      {
+        skip_last_level_ = false;
+        level_schedule_[cfg.LastLevel].streak = 0;
+        level_schedule_[cfg.LastLevel].skipped = 0;
+      }
+    }
+  }
+  else
+  {
+    bool negligible = correction < MaxLastLevelCorrection && last_level_above_constraints_ >= MinLastLevelAboveConstraints;
+    schedule.streak = negligible ? schedule.streak + 1 : 0;
+    schedule.skipped = 0;
+
+    skip_last_level_ = schedule.streak >= AdaptiveLevelHistory;
+  }
+}
+
 bool DenseTracker::match(RgbdImagePyramid& reference, RgbdImagePyramid& current, Eigen::Affine3d& transformation)
 {
   Result result;
@@ -133,30 +578,270 @@ bool DenseTracker::match(dvo::core::RgbdImagePyramid& reference, dvo::core::Rgbd
   return match(reference_selection_, current, result);
 }
 
+struct DenseTracker::MatchState
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
+  // the last increment, applied again as first increment on the next level
+  Sophus::SE3d inc;
+
+  Revertable<Sophus::SE3d> initial;
+  Revertable<Sophus::SE3d> estimate;
+
+  // replaces Result::Statistics if Config::UseFullStatistics is false
+  LevelStats* level_stats;
+
+  // seconds spent in the levels matched so far, the budget of Config::MaxMatchTime
+  double elapsed;
+
+  // the level the match started on
+  int first_level;
+};
+
+void DenseTracker::reserveLevelStats(size_t num_problems)
+{
+  if(scratch_.level_stats.size() >= num_problems) return;
+
+  scratch_.level_stats.resize(num_problems);
+
+  for(std::vector<LevelStats>::iterator it = scratch_.level_stats.begin(); it != scratch_.level_stats.end(); ++it)
+    it->Iterations.reserve(cfg.MaxIterationsPerLevel + 1);
+}
+
+void DenseTracker::reserve(size_t max_points, size_t num_problems)
+{
+  reserveLevelStats(num_problems);
+
+  if(points_error.size() < max_points) points_error.resize(max_points);
+  if(residuals.size() < max_points) residuals.resize(max_points);
+  if(weights.size() < max_points) weights.resize(max_points);
+  if(scratch_.valid_residuals.size() < max_points) scratch_.valid_residuals.resize(max_points);
+
+  points_error_soa.reserve(max_points);
+}
+
+size_t DenseTracker::memoryUsage() const
+{
+  size_t bytes = reference_selection_.memoryUsage();
+
+  bytes += (points.capacity() + points_error.capacity()) * sizeof(dvo::core::PointWithIntensityAndDepth);
+  bytes += points_error_soa.capacity() * dvo::core::PointWithIntensityAndDepthSoa::NumChannels * sizeof(float);
+  bytes += residuals.capacity() * sizeof(Eigen::Vector2f) + weights.capacity() * sizeof(float);
+  bytes += scratch_.valid_residuals.capacity() + scratch_.chunk_valid.capacity() * sizeof(size_t);
+
+  for(std::vector<LevelStats>::const_iterator it = scratch_.level_stats.begin(); it != scratch_.level_stats.end(); ++it)
+    bytes += it->Iterations.capacity() * sizeof(IterationStats);
+
+  return bytes;
+}
+
 bool DenseTracker::match(dvo::core::PointSelection& reference, dvo::core::RgbdImagePyramid& current, dvo::DenseTracker::Result& result)
 {
-  current.compute(cfg.getNumLevels());
+  return match(reference, current, result, cfg.FirstLevel);
+}
 
-  bool success = true;
+bool DenseTracker::match(dvo::core::PointSelection& reference, dvo::core::RgbdImagePyramid& current, dvo::DenseTracker::Result& result, int first_level)
+{
+  static Timer& match_timer = Instrumentation::instance().timer("dense_tracking/match");
+  ScopedTimer match_scope(match_timer);
+
+  current.compute(cfg.getNumLevels());
+  reserveLevelStats(1);
 
   if(!cfg.UseInitialEstimate)
   {
     result.Transformation.setIdentity();
   }
 
+  first_level = std::max(cfg.LastLevel, std::min(cfg.FirstLevel, first_level));
+
+  const uint32_t skipped_levels = cfg.UseAdaptiveLevels ? scheduleLevels(first_level) : 0;
+
+  // the match starts on the coarsest level which isn't skipped
+  while(skipped_levels & (1u << first_level)) first_level--;
+
+  MatchState state;
+  beginMatch(result, scratch_.level_stats[0], first_level, state);
+
+  for(int level = first_level; level >= cfg.LastLevel; --level)
+  {
+    if(skipped_levels & (1u << level))
+    {
+      static Timer& skipped_level_counter = Instrumentation::instance().timer("dense_tracking/match/skipped_level");
+      skipped_level_counter.child(size_t(level)).record(0.0);
+      continue;
+    }
+
+    const Sophus::SE3d before = state.estimate();
+
+    bool more = matchLevel(level, reference, current, result, state);
+
+    const LevelStats& level_stats = cfg.UseFullStatistics ? result.Statistics.Levels.back() : *state.level_stats;
+
+    // the deadline may have stopped the match before the level
+    if(cfg.UseAdaptiveLevels && level_stats.Id == size_t(level))
+      updateLevelSchedule(level, level_stats, itctx_.Iteration, (before.inverse() * state.estimate()).log().lpNorm<Eigen::Infinity>());
+
+    if(!more) break;
+  }
+
+  return finishMatch(result, state);
+}
+
+bool DenseTracker::matchMany(const std::vector<dvo::core::PointSelection*>& references, dvo::core::RgbdImagePyramid& current, ResultVector& results)
+{
+  assert(references.size() == results.size());
+
+  static Timer& match_many_timer = Instrumentation::instance().timer("dense_tracking/match_many");
+  ScopedTimer match_many_scope(match_many_timer);
+
+  const size_t num_problems = references.size();
+
+  current.compute(cfg.getNumLevels());
+  reserveLevelStats(num_problems);
+
+  std::vector<MatchState, Eigen::aligned_allocator<MatchState> > states(num_problems);
+  // problems which skip the finer levels because their deadline is reached
+  std::vector<uint8_t> active(num_problems, 1);
+
+  for(size_t idx = 0; idx < num_problems; ++idx)
+  {
+    if(!cfg.UseInitialEstimate)
+    {
+      results[idx].Transformation.setIdentity();
+    }
+
+    beginMatch(results[idx], scratch_.level_stats[idx], cfg.FirstLevel, states[idx]);
+  }
+
+  for(int level = cfg.FirstLevel; level >= cfg.LastLevel; --level)
+  {
+    for(size_t idx = 0; idx < num_problems; ++idx)
+    {
+      if(active[idx] != 0 && !matchLevel(level, *references[idx], current, results[idx], states[idx]))
+        active[idx] = 0;
+    }
+  }
+
+  bool success = true;
+
+  for(size_t idx = 0; idx < num_problems; ++idx)
+    success = finishMatch(results[idx], states[idx]) && success;
+
+  return success;
+}
+
+size_t DenseTracker::matchHypotheses(dvo::core::PointSelection& reference, dvo::core::RgbdImagePyramid& current, const TransformVector& guesses, dvo::DenseTracker::Result& result)
+{
+  assert(!guesses.empty());
+
+  static Timer& match_hypotheses_timer = Instrumentation::instance().timer("dense_tracking/match_hypotheses");
+  ScopedTimer match_hypotheses_scope(match_hypotheses_timer);
+
+  const size_t num_guesses = guesses.size();
+
+  current.compute(cfg.getNumLevels());
+  reserveLevelStats(num_guesses);
+
+  ResultVector results(num_guesses);
+  std::vector<MatchState, Eigen::aligned_allocator<MatchState> > states(num_guesses);
+  std::vector<uint8_t> active(num_guesses, 1);
+
+  size_t max_constraints = 0;
+
+  for(size_t idx = 0; idx < num_guesses; ++idx)
+  {
+    results[idx].Transformation = guesses[idx];
+
+    beginMatch(results[idx], scratch_.level_stats[idx], cfg.FirstLevel, states[idx]);
+    active[idx] = matchLevel(cfg.FirstLevel, reference, current, results[idx], states[idx]);
+
+    max_constraints = std::max(max_constraints, lastIteration(results[idx], states[idx]).ValidConstraints);
+  }
+
+  size_t best = 0;
+  // negative log likelihoods, lower is better
+  double best_score = std::numeric_limits<double>::max();
+
+  for(size_t idx = 0; idx < num_guesses; ++idx)
+  {
+    const IterationStats& it = lastIteration(results[idx], states[idx]);
+
+    if(it.ValidConstraints == 0 || 2 * it.ValidConstraints < max_constraints) continue;
+
+    double score = (it.TDistributionLogLikelihood + it.PriorLogLikelihood) / double(it.ValidConstraints);
+
+    if(score < best_score)
+    {
+      best = idx;
+      best_score = score;
+    }
+  }
+
+  for(int level = cfg.FirstLevel - 1; level >= cfg.LastLevel && active[best] != 0; --level)
+  {
+    if(!matchLevel(level, reference, current, results[best], states[best])) break;
+  }
+
+  finishMatch(results[best], states[best]);
+  result = results[best];
+
+  return best;
+}
+
+void DenseTracker::beginMatch(dvo::DenseTracker::Result& result, LevelStats& level_stats, int first_level, MatchState& state)
+{
   // our first increment is the given guess
-  Sophus::SE3d inc(result.Transformation.rotation(), result.Transformation.translation());
+  state.inc = Sophus::SE3d(result.Transformation.rotation(), result.Transformation.translation());
+  state.initial = Revertable<Sophus::SE3d>(state.inc);
+  state.estimate = Revertable<Sophus::SE3d>();
+  state.level_stats = &level_stats;
+  state.elapsed = 0.0;
+  state.first_level = first_level;
+
+  if(cfg.UseFullStatistics)
+  {
+    result.Statistics.Levels.clear();
+  }
+}
 
-  Revertable<Sophus::SE3d> initial(inc);
-  Revertable<Sophus::SE3d> estimate;
+bool DenseTracker::matchLevel(int level, dvo::core::PointSelection& reference, dvo::core::RgbdImagePyramid& current, dvo::DenseTracker::Result& result, MatchState& state)
+{
+  Sophus::SE3d& inc = state.inc;
+  Revertable<Sophus::SE3d>& initial = state.initial;
+  Revertable<Sophus::SE3d>& estimate = state.estimate;
 
   bool accept = true;
 
-  //static stopwatch_collection sw_level(5, "l", 100);
-  //static stopwatch_collection sw_it(5, "it@l", 500);
-  //static stopwatch_collection sw_error(5, "err@l", 500);
-  //static stopwatch_collection sw_linsys(5, "linsys@l", 500);
-  //static stopwatch_collection sw_prep(5, "prep@l", 100);
+  itctx_.Level = level;
+
+  static Timer& match_timer = Instrumentation::instance().timer("dense_tracking/match");
+  static Timer& degenerate_counter = match_timer.child("degenerate");
+  static Timer& gpu_fallback_counter = match_timer.child("gpu_fallback");
+  static Timer& warm_scale_counter = match_timer.child("warm_scale");
+
+  const bool use_deadline = cfg.MaxMatchTime > 0.0;
+  const int64_t level_start = Timer::now();
+  bool deadline_reached = false;
+
+  // the deadline never stops the first matched level. a finer level is only worth it if we can afford the iteration
+  // computing the first increment and the one evaluating it
+  if(use_deadline && level != state.first_level)
+  {
+    double remaining = cfg.MaxMatchTime - state.elapsed;
+
+    if(remaining < 2.0 * expectedIterationTime(itctx_.Level))
+    {
+      // the previous level is the last one, so its criterion tells the caller that LastLevel wasn't reached. a rejected
+      // last iteration keeps its criterion, so lastIteration() still skips it, the level id tells it as well
+      LevelStats& previous_level = cfg.UseFullStatistics ? result.Statistics.Levels.back() : *state.level_stats;
+
+      if(previous_level.TerminationCriterion != TerminationCriteria::LogLikelihoodDecreased)
+        previous_level.TerminationCriterion = TerminationCriteria::DeadlineReached;
+
+      return false;
+    }
+  }
 
   if(points_error.size() < reference.getMaximumNumberOfPoints(cfg.LastLevel))
     points_error.resize(reference.getMaximumNumberOfPoints(cfg.LastLevel));
@@ -165,12 +850,34 @@ bool DenseTracker::match(dvo::core::PointSelection& reference, dvo::core::RgbdIm
   if(weights.size() < reference.getMaximumNumberOfPoints(cfg.LastLevel))
     weights.resize(reference.getMaximumNumberOfPoints(cfg.LastLevel));
 
-  std::vector<uint8_t> valid_residuals;
+  std::vector<uint8_t>& valid_residuals = scratch_.valid_residuals;
 
   bool debug = false;
   if(debug)
   {
     reference.debug(true);
+  }
+
+  // the rolling shutter model scales the motion by the time between the image timestamps, so they have to differ
+  const double rolling_shutter_dt = current.timestamp() - reference.getRgbdImagePyramid().timestamp();
+  const bool use_rolling_shutter = cfg.RollingShutterReadoutTime > 0.0 && std::abs(rolling_shutter_dt) > 1e-3 && !debug;
+  dvo::core::RollingShutterTransforms rolling_shutter;
+
+  // the inverse compositional mode needs the valid flags to find the constraints to remove from the precomputed hessian
+  const bool use_ic = cfg.UseInverseCompositional && !debug && !use_rolling_shutter;
+
+  // the MAD scale estimator builds a histogram of the stored residuals of every iteration instead of the iterative
+  // t-distribution scale, so not with the kernels which weight internally or store the residuals elsewhere
+  const bool use_histogram_scale = cfg.UseWeighting && cfg.ScaleEstimatorType == ScaleEstimators::MAD;
+
+  // float constraints summed before they are added in double
+  const size_t block_size = cfg.UseMixedPrecisionSolver ? 1024 : 0;
+
+  // the reference points and the current level are uploaded before the first iteration running on the device
+  bool use_gpu = gpu_ && !debug && !use_ic && !use_rolling_shutter && !use_histogram_scale, gpu_uploaded = false;
+
+  if((debug || use_ic) && valid_residuals.size() < reference.getMaximumNumberOfPoints(cfg.LastLevel))
+  {
     valid_residuals.resize(reference.getMaximumNumberOfPoints(cfg.LastLevel));
   }
   /*
@@ -194,290 +901,527 @@ bool DenseTracker::match(dvo::core::PointSelection& reference, dvo::core::RgbdIm
   cv::imwrite(name2.str(), reference.getRgbdImagePyramid().level(0).rgb);
   */
   Eigen::Vector2f mean;
-  mean.setZero();
   Eigen::Matrix2f /*first_precision,*/ precision;
-  precision.setZero();
 
-  for(itctx_.Level = cfg.FirstLevel; itctx_.Level >= cfg.LastLevel; --itctx_.Level)
+  Timer& level_timer = match_timer.child("level").child(size_t(itctx_.Level));
+  Timer& iteration_timer = level_timer.child("iteration");
+  Timer& error_timer = iteration_timer.child("error");
+  Timer& linsys_timer = iteration_timer.child("linsys");
+  ScopedTimer level_scope(level_timer);
+
+  LevelStats* level_stats_ptr = state.level_stats;
+
+  if(cfg.UseFullStatistics)
   {
     result.Statistics.Levels.push_back(LevelStats());
-    LevelStats& level_stats = result.Statistics.Levels.back();
+    level_stats_ptr = &result.Statistics.Levels.back();
+  }
+
+  LevelStats& level_stats = *level_stats_ptr;
+  level_stats.Iterations.clear();
+
+  mean.setZero();
+  precision.setZero();
+
+  // the first iteration is weighted with the scale of the previous match instead of estimating it from unweighted
+  // residuals
+  const bool warm_scale = cfg.UseWarmStartedScale && level_scale_[itctx_.Level].valid;
+
+  if(warm_scale)
+  {
+    mean = level_scale_[itctx_.Level].mean;
+    precision = level_scale_[itctx_.Level].precision;
+
+    warm_scale_counter.record(0.0);
+  }
+
+  // reset error after every pyramid level? yes because errors from different levels are not comparable
+  itctx_.Iteration = 0;
+  itctx_.Error = std::numeric_limits<double>::max();
 
-    mean.setZero();
-    precision.setZero();
+  RgbdImage& cur = current.level(itctx_.Level);
+  const IntrinsicMatrix& K = cur.camera().intrinsics();
 
-    // reset error after every pyramid level? yes because errors from different levels are not comparable
-    itctx_.Iteration = 0;
-    itctx_.Error = std::numeric_limits<double>::max();
+  Vector8f wcur, wref;
+  // i z idx idy zdx zdy
+  float wcur_id = 0.5f, wref_id = 0.5f, wcur_zd = 1.0f, wref_zd = 0.0f;
 
-    RgbdImage& cur = current.level(itctx_.Level);
-    const IntrinsicMatrix& K = cur.camera().intrinsics();
+  wcur <<  1.0f / 255.0f,  1.0f, wcur_id * K.fx() / 255.0f, wcur_id * K.fy() / 255.0f, wcur_zd * K.fx(), wcur_zd * K.fy(), 0.0f, 0.0f;
+  wref << -1.0f / 255.0f, -1.0f, wref_id * K.fx() / 255.0f, wref_id * K.fy() / 255.0f, wref_zd * K.fx(), wref_zd * K.fy(), 0.0f, 0.0f;
 
-    Vector8f wcur, wref;
-    // i z idx idy zdx zdy
-    float wcur_id = 0.5f, wref_id = 0.5f, wcur_zd = 1.0f, wref_zd = 0.0f;
+  const int64_t prepare_start = Timer::now();
 
-    wcur <<  1.0f / 255.0f,  1.0f, wcur_id * K.fx() / 255.0f, wcur_id * K.fy() / 255.0f, wcur_zd * K.fx(), wcur_zd * K.fy(), 0.0f, 0.0f;
-    wref << -1.0f / 255.0f, -1.0f, wref_id * K.fx() / 255.0f, wref_id * K.fy() / 255.0f, wref_zd * K.fx(), wref_zd * K.fy(), 0.0f, 0.0f;
+  PointSelection::PointIterator first_point, last_point;
+  reference.select(itctx_.Level, K, first_point, last_point);
 
-//    sw_prep[itctx_.Level].start();
+  const bool use_soa = cfg.UseSoaLayout && !debug && !use_ic && !use_rolling_shutter && !use_histogram_scale;
 
+  // only the plain residual kernel reads the half precision acceleration structure
+  const bool use_compact = cfg.UseCompactStorage && !debug && !use_ic && !use_soa && !use_rolling_shutter && !cfg.UseFusedKernel && !use_gpu && dvo::core::hasCompactResidualKernel();
 
-    PointSelection::PointIterator first_point, last_point;
-    reference.select(itctx_.Level, K, first_point, last_point);
+  if(!use_compact || !cur.buildCompactAccelerationStructure())
     cur.buildAccelerationStructure();
+  const PointWithIntensityAndDepthSoa* soa_points = 0;
 
-    level_stats.Id = itctx_.Level;
-    level_stats.MaxValidPixels = reference.getMaximumNumberOfPoints(itctx_.Level);
-    level_stats.ValidPixels = last_point - first_point;
+  if(use_soa)
+    reference.select(itctx_.Level, K, soa_points);
 
-//    sw_prep[itctx_.Level].stopAndPrint();
+  PrecomputedNormalEquationsLeastSquares2d* ic_ls = 0;
 
-    NormalEquationsLeastSquares ls;
-    Matrix6d A;
-    Vector6d x, b;
-    x = inc.log();
+  if(use_ic)
+    reference.select(itctx_.Level, K, ic_ls);
 
-    ComputeResidualsResult compute_residuals_result;
-    compute_residuals_result.first_point_error = points_error.begin();
-    compute_residuals_result.first_residual = residuals.begin();
-    compute_residuals_result.first_valid_flag = valid_residuals.begin();
+  level_stats.Id = itctx_.Level;
+  level_stats.MaxValidPixels = reference.getMaximumNumberOfPoints(itctx_.Level);
+  level_stats.ValidPixels = last_point - first_point;
 
+  level_timer.child("prepare").record(Timer::seconds(Timer::now() - prepare_start));
 
-//    sw_level[itctx_.Level].start();
-    do
-    {
-      level_stats.Iterations.push_back(IterationStats());
-      IterationStats& iteration_stats = level_stats.Iterations.back();
-      iteration_stats.Id = itctx_.Iteration;
+  NormalEquationsLeastSquares ls;
+  Matrix6d A;
+  Vector6d x, b;
+  x = inc.log();
+
+  ComputeResidualsResult compute_residuals_result;
+  compute_residuals_result.first_point_error = points_error.begin();
+  compute_residuals_result.first_residual = residuals.begin();
+  compute_residuals_result.first_valid_flag = valid_residuals.begin();
+
+  do
+  {
+    level_stats.Iterations.push_back(IterationStats());
+    IterationStats& iteration_stats = level_stats.Iterations.back();
+    iteration_stats.Id = itctx_.Iteration;
+
+    const int64_t iteration_start = Timer::now();
+    ScopedTimer iteration_scope(iteration_timer);
 
-//      sw_it[itctx_.Level].start();
+    double total_error = 0.0f;
+    Eigen::Affine3f transformf;
 
-      double total_error = 0.0f;
-//      sw_error[itctx_.Level].start();
-      Eigen::Affine3f transformf;
+      inc = Sophus::SE3d::exp(x);
 
-        inc = Sophus::SE3d::exp(x);
+      if(use_ic)
+      {
+        // the increment was computed on the reference image, so it is applied from the right
+        initial.update() = initial() * estimate() * inc.inverse() * estimate().inverse();
+        estimate.update() = estimate() * inc;
+      }
+      else
+      {
         initial.update() = inc.inverse() * initial();
         estimate.update() = inc * estimate();
+      }
+
+      transformf = estimate().matrix().cast<float>();
 
-        transformf = estimate().matrix().cast<float>();
+      size_t n;
+      float ll;
 
-        if(debug)
+      // the first iteration on a level is unweighted, unless the scale is warm started or estimated from the histogram
+      const bool weighted = warm_scale || use_histogram_scale || !itctx_.IsFirstIterationOnLevel();
+
+      // the fused kernel needs mean and precision of the previous iteration, so it can't run on an unweighted one
+      const bool use_fused = (cfg.UseFusedKernel || use_gpu) && !debug && !use_ic && !use_rolling_shutter && !use_histogram_scale && weighted;
+
+      // the device returns finished normal equations
+      bool ls_finished = false;
+
+      if(use_fused)
+      {
+        ComputeNormalEquationsResult fused_result;
+
+        if(use_gpu)
+        {
+          if(!gpu_uploaded)
+            gpu_uploaded = gpu_->upload(first_point, last_point, cur);
+
+          ls_finished = gpu_uploaded && gpu_->compute(K, transformf, wref, wcur, mean, precision, ls, fused_result);
+
+          if(!ls_finished)
+          {
+            // the rest of the level runs on the cpu
+            gpu_fallback_counter.record(0.0);
+            use_gpu = false;
+          }
+        }
+
+        if(!ls_finished)
         {
-          dvo::core::computeResidualsAndValidFlagsSse(first_point, last_point, cur, K, transformf, wref, wcur, compute_residuals_result);
+          internal::FusedNormalEquationsReduction fused(first_point, cur, K, transformf, wref, wcur, mean, precision);
+          fused.ls.blockSize(block_size);
+
+          if(cfg.UseParallel)
+            tbb::parallel_reduce(tbb::blocked_range<size_t>(0, last_point - first_point, cfg.ParallelGrainSize), fused);
+          else
+            fused(tbb::blocked_range<size_t>(0, last_point - first_point));
+
+          ls = fused.ls;
+          fused_result = fused.result;
+        }
+
+        n = fused_result.ValidConstraints;
+
+        ll = 0.5 * n * std::log(precision.determinant()) - 0.5 * (5.0 + 2.0) * fused_result.LogLikelihoodErrorSum;
+
+        // the new scale is used in the next iteration
+        precision = (fused_result.WeightedScatter / float(n - 2 - 1)).inverse();
+      }
+      else
+      {
+        if(use_soa)
+        {
+          n = dvo::core::computeResidualsSoaSse(*soa_points, cur, K, transformf, wref, wcur, points_error_soa);
         }
         else
         {
-          dvo::core::computeResidualsSse(first_point, last_point, cur, K, transformf, wref, wcur, compute_residuals_result);
+          if(use_rolling_shutter)
+          {
+            rolling_shutter.update(K, Eigen::Affine3d(estimate().matrix()), rolling_shutter_dt, cfg.RollingShutterReadoutTime);
+            dvo::core::computeResidualsRollingShutter(first_point, last_point, cur, rolling_shutter, wref, wcur, compute_residuals_result);
+          }
+          else if(debug || use_ic)
+          {
+            dvo::core::computeResidualsAndValidFlagsSse(first_point, last_point, cur, K, transformf, wref, wcur, compute_residuals_result);
+          }
+          else if(cfg.UseParallel)
+          {
+            // chunks have to be even, the sse kernel processes 2 points at once
+            internal::computeResidualsParallel(first_point, last_point, cur, K, transformf, wref, wcur, compute_residuals_result, (cfg.ParallelGrainSize + 1) & ~1, scratch_.chunk_valid);
+          }
+          else
+          {
+            dvo::core::computeResidualsSse(first_point, last_point, cur, K, transformf, wref, wcur, compute_residuals_result);
+          }
+          n = (compute_residuals_result.last_residual - compute_residuals_result.first_residual);
+        }
+
+        if(use_histogram_scale)
+        {
+          // scale of the residuals of this iteration in one pass, the weights follow from it
+          mean.setZero();
+          precision = dvo::core::computeScaleHistogramSse(compute_residuals_result.first_residual, compute_residuals_result.last_residual).inverse();
         }
-        size_t n = (compute_residuals_result.last_residual - compute_residuals_result.first_residual);
 
-        if(itctx_.IsFirstIterationOnLevel())
+        if(!weighted)
         {
           std::fill(weights.begin(), weights.begin() + n, 1.0f);
         }
+        else if(use_histogram_scale && cfg.InfluenceFuntionType == InfluenceFunctions::Huber)
+        {
+          ll = dvo::core::computeWeightsAndLogLikelihoodHuberSse(compute_residuals_result.first_residual, compute_residuals_result.last_residual, weights.begin(), precision, cfg.InfluenceFunctionParam);
+        }
+        else if(use_soa)
+        {
+          dvo::core::computeWeightsSoaSse(points_error_soa, weights.begin(), mean, precision);
+        }
         else
         {
           dvo::core::computeWeightsSse(compute_residuals_result.first_residual, compute_residuals_result.last_residual, weights.begin(), mean, precision);
         }
 
-        precision = dvo::core::computeScaleSse(compute_residuals_result.first_residual, compute_residuals_result.last_residual, weights.begin(), mean).inverse();
+        if(use_histogram_scale)
+        {
+          if(cfg.InfluenceFuntionType != InfluenceFunctions::Huber)
+            ll = computeCompleteDataLogLikelihood(compute_residuals_result.first_residual, compute_residuals_result.last_residual, weights.begin(), mean, precision);
+        }
+        else if(use_soa)
+        {
+          precision = dvo::core::computeScaleSoaSse(points_error_soa, weights.begin(), mean).inverse();
+          ll = computeCompleteDataLogLikelihoodSoa(points_error_soa, weights.begin(), mean, precision);
+        }
+        else if(cfg.ScaleSampleSize > 0 && n > size_t(cfg.ScaleSampleSize) && weighted)
+        {
+          // the bound of computeScaleSampled needs the t-distribution weights, so not on an unweighted iteration
+          const uint32_t seed = 2654435761u * uint32_t(itctx_.Level * 1000 + itctx_.Iteration + 1);
 
-        float ll = computeCompleteDataLogLikelihood(compute_residuals_result.first_residual, compute_residuals_result.last_residual, weights.begin(), mean, precision);
+          precision = dvo::core::computeScaleSampled(compute_residuals_result.first_residual, compute_residuals_result.last_residual, weights.begin(), mean, cfg.ScaleSampleSize, seed).inverse();
+          ll = dvo::core::computeCompleteDataLogLikelihoodSampled(compute_residuals_result.first_residual, compute_residuals_result.last_residual, precision, cfg.ScaleSampleSize, seed);
+        }
+        else
+        {
+          precision = dvo::core::computeScaleSse(compute_residuals_result.first_residual, compute_residuals_result.last_residual, weights.begin(), mean).inverse();
+          ll = computeCompleteDataLogLikelihood(compute_residuals_result.first_residual, compute_residuals_result.last_residual, weights.begin(), mean, precision);
+        }
+      }
 
-        iteration_stats.ValidConstraints = n;
-        iteration_stats.TDistributionLogLikelihood = -ll;
-        iteration_stats.TDistributionMean = mean.cast<double>();
-        iteration_stats.TDistributionPrecision = precision.cast<double>();
-        iteration_stats.PriorLogLikelihood = cfg.Mu * initial().log().squaredNorm();
+      iteration_stats.ValidConstraints = n;
+      iteration_stats.TDistributionLogLikelihood = -ll;
+      iteration_stats.TDistributionMean = mean.cast<double>();
+      iteration_stats.TDistributionPrecision = precision.cast<double>();
+      iteration_stats.PriorLogLikelihood = cfg.Mu * initial().log().squaredNorm();
 
-        total_error = -ll;//iteration_stats.TDistributionLogLikelihood + iteration_stats.PriorLogLikelihood;
-        //itctx_.Error = total_error;
+      total_error = -ll;//iteration_stats.TDistributionLogLikelihood + iteration_stats.PriorLogLikelihood;
+      //itctx_.Error = total_error;
 
-        if(debug)
-        {
-          /*
-          cv::Mat debug_idx, debug_img, debug_img_scaled, weight_img, weight_img_scaled, rgb_error_img, rgb_error_img_scaled, depth_error_img, depth_error_img_scaled;
+      if(debug)
+      {
+        /*
+        cv::Mat debug_idx, debug_img, debug_img_scaled, weight_img, weight_img_scaled, rgb_error_img, rgb_error_img_scaled, depth_error_img, depth_error_img_scaled;
 
-          reference.getDebugIndex(itctx_.Level, debug_idx);
+        reference.getDebugIndex(itctx_.Level, debug_idx);
 
-          debug_img = cv::Mat::zeros(debug_idx.size(), CV_8UC3);
-          weight_img = cv::Mat::zeros(debug_idx.size(), CV_32FC1);
-          rgb_error_img = cv::Mat::zeros(debug_idx.size(), CV_32FC1);
-          depth_error_img = cv::Mat::zeros(debug_idx.size(), CV_32FC1);
+        debug_img = cv::Mat::zeros(debug_idx.size(), CV_8UC3);
+        weight_img = cv::Mat::zeros(debug_idx.size(), CV_32FC1);
+        rgb_error_img = cv::Mat::zeros(debug_idx.size(), CV_32FC1);
+        depth_error_img = cv::Mat::zeros(debug_idx.size(), CV_32FC1);
 
-          WeightIterator w_it = weights.begin();
-          ResidualIterator r_it = residuals.begin();
+        WeightIterator w_it = weights.begin();
+        ResidualIterator r_it = residuals.begin();
 
 
-          ResidualIterator r_it = compute_residuals_result.first_residual;
-          ValidFlagIterator valid_it = compute_residuals_result.first_valid_flag;
-          uint8_t *point_it = debug_idx.ptr<uint8_t>();
-          float *weight_img_it = weight_img.ptr<float>();
-          float *rgb_error_img_it = rgb_error_img.ptr<float>();
-          float *depth_error_img_it = depth_error_img.ptr<float>();
-          cv::Vec3b* img_it = debug_img.ptr<cv::Vec3b>();
-          cv::Vec3b* img_end = debug_img.ptr<cv::Vec3b>() + debug_img.total();
+        ResidualIterator r_it = compute_residuals_result.first_residual;
+        ValidFlagIterator valid_it = compute_residuals_result.first_valid_flag;
+        uint8_t *point_it = debug_idx.ptr<uint8_t>();
+        float *weight_img_it = weight_img.ptr<float>();
+        float *rgb_error_img_it = rgb_error_img.ptr<float>();
+        float *depth_error_img_it = depth_error_img.ptr<float>();
+        cv::Vec3b* img_it = debug_img.ptr<cv::Vec3b>();
+        cv::Vec3b* img_end = debug_img.ptr<cv::Vec3b>() + debug_img.total();
 
-          for(; img_it != img_end; ++img_it, ++weight_img_it, ++point_it, ++rgb_error_img_it, ++depth_error_img_it)
+        for(; img_it != img_end; ++img_it, ++weight_img_it, ++point_it, ++rgb_error_img_it, ++depth_error_img_it)
+        {
+          if(*point_it == 1)
           {
-            if(*point_it == 1)
+            img_it->val[2] = 255;
+
+            if(*valid_it == 1)
             {
-              img_it->val[2] = 255;
+              img_it->val[1] = 255;
+
+              *rgb_error_img_it = std::abs(r_it->coeff(0));
+              *depth_error_img_it = std::abs(r_it->coeff(1));
 
-              if(*valid_it == 1)
+              if(itctx_.IsFirstIteration())
               {
-                img_it->val[1] = 255;
-
-                *rgb_error_img_it = std::abs(r_it->coeff(0));
-                *depth_error_img_it = std::abs(r_it->coeff(1));
-
-                if(itctx_.IsFirstIteration())
-                {
-                  rgb_max = std::max(rgb_max, *rgb_error_img_it);
-                  depth_max = std::max(depth_max, *depth_error_img_it);
-                }
-                *weight_img_it = *w_it;
-                err_img_it->val[2] = (*r_it)(0);
-                err_img_it->val[1] = (*r_it)(1);
-                *erri_img_it = (*r_it)(0);
-                *errd_img_it = (*r_it)(1);
-                ++w_it;
-                ++r_it;
+                rgb_max = std::max(rgb_max, *rgb_error_img_it);
+                depth_max = std::max(depth_max, *depth_error_img_it);
               }
-
-              ++valid_it;
+              *weight_img_it = *w_it;
+              err_img_it->val[2] = (*r_it)(0);
+              err_img_it->val[1] = (*r_it)(1);
+              *erri_img_it = (*r_it)(0);
+              *errd_img_it = (*r_it)(1);
+              ++w_it;
+              ++r_it;
             }
+
+            ++valid_it;
           }
-          cv::Mat left(video_frame, cv::Rect(0, 0, s.width, s.height));
-          cv::Mat right(video_frame, cv::Rect(s.width, 0, s.width, s.height));
+        }
+        cv::Mat left(video_frame, cv::Rect(0, 0, s.width, s.height));
+        cv::Mat right(video_frame, cv::Rect(s.width, 0, s.width, s.height));
 
-          cv::resize(debug_img, debug_img_scaled, s);
-          cv::resize(weight_img, weight_img_scaled, s);
+        cv::resize(debug_img, debug_img_scaled, s);
+        cv::resize(weight_img, weight_img_scaled, s);
 
-          cv::resize(rgb_error_img / rgb_max, left, left.size());
-          cv::resize(depth_error_img, right, right.size());
+        cv::resize(rgb_error_img / rgb_max, left, left.size());
+        cv::resize(depth_error_img, right, right.size());
 
-          std::stringstream ss;
-          ss << "iteration: " << std::setw(2) << itctx_.Iteration;// << " log likelihood: " << std::setiosflags(std::ios::fixed) << std::setw(7) << std::setprecision(0) << ll;
+        std::stringstream ss;
+        ss << "iteration: " << std::setw(2) << itctx_.Iteration;// << " log likelihood: " << std::setiosflags(std::ios::fixed) << std::setw(7) << std::setprecision(0) << ll;
 
-          cv::putText(video_frame, ss.str(), cv::Point(int(0.05*s.width), int(0.95*s.height)), CV_FONT_HERSHEY_DUPLEX, 0.7, cv::Scalar(1.0), 1, 1, false);
+        cv::putText(video_frame, ss.str(), cv::Point(int(0.05*s.width), int(0.95*s.height)), CV_FONT_HERSHEY_DUPLEX, 0.7, cv::Scalar(1.0), 1, 1, false);
 
-          video_frame.convertTo(video_frame_u8, CV_8UC1, 255.0);
+        video_frame.convertTo(video_frame_u8, CV_8UC1, 255.0);
 
 
-          for(int i = 0; i < 10; ++i)
-            vw << video_frame_u8;
-          */
-          //cv::imshow("points", debug_img_scaled);
-          //cv::imshow("weights", weight_img_scaled);
-          //cv::imshow("error", video_frame);
-          //cv::waitKey(100);
-        }
+        for(int i = 0; i < 10; ++i)
+          vw << video_frame_u8;
+        */
+        //cv::imshow("points", debug_img_scaled);
+        //cv::imshow("weights", weight_img_scaled);
+        //cv::imshow("error", video_frame);
+        //cv::waitKey(100);
+      }
 
-          itctx_.LastError = itctx_.Error;
-          itctx_.Error = total_error;
+        itctx_.LastError = itctx_.Error;
+        itctx_.Error = total_error;
 
-//      sw_error[itctx_.Level].stopAndPrint();
+    error_timer.record(Timer::seconds(Timer::now() - iteration_start));
 
-      // accept the last increment?
-      accept = itctx_.Error < itctx_.LastError;
+    // accept the last increment?
+    accept = itctx_.Error < itctx_.LastError;
 
-      if(!accept)
-      {
-        initial.revert();
-        estimate.revert();
+    if(Trace::enabled())
+    {
+      Trace::Arg args[] = { { "level", double(itctx_.Level) }, { "iteration", double(itctx_.Iteration) }, { "valid_constraints", double(n) }, { "error", total_error }, { "increment", x.lpNorm<Eigen::Infinity>() }, { "accepted", accept ? 1.0 : 0.0 } };
+      Trace::instance().instant("dense_tracking/iteration", args, 6);
+    }
 
-        break;
-      }
+    if(!accept)
+    {
+      initial.revert();
+      estimate.revert();
+
+      break;
+    }
+
+    // now build equation system
+    const int64_t linsys_start = Timer::now();
+
+    if(use_ic)
+    {
+      ic_ls->reset(precision);
 
-      // now build equation system
-//      sw_linsys[itctx_.Level].start();
+      const size_t num_points = last_point - first_point;
+      const size_t num_flags = compute_residuals_result.last_valid_flag - compute_residuals_result.first_valid_flag;
 
-      WeightVectorType::iterator w_it = weights.begin();
+      ValidFlagIterator valid_it = compute_residuals_result.first_valid_flag;
+      ResidualIterator r_it = compute_residuals_result.first_residual;
+      WeightIterator w_it = weights.begin();
 
-      Matrix2x6 J, Jw;
-      Eigen::Vector2f Ji;
-      Vector6 Jz;
-      ls.initialize(1);
-      for(PointIterator e_it = compute_residuals_result.first_point_error; e_it != compute_residuals_result.last_point_error; ++e_it, ++w_it)
+      for(size_t idx = 0; idx < num_points; ++idx)
       {
-        computeJacobianOfProjectionAndTransformation(e_it->getPointVec4f(), Jw);
-        compute3rdRowOfJacobianOfTransformation(e_it->getPointVec4f(), Jz);
+        // the sse kernel skips the last point of an odd number of points
+        if(idx < num_flags && valid_it[idx] != 0)
+        {
+          ic_ls->setResidualForConstraint(idx, *r_it, *w_it);
+          ++r_it;
+          ++w_it;
+        }
+        else
+        {
+          ic_ls->ignoreConstraint(idx);
+        }
+      }
 
-        J.row(0) = e_it->getIntensityDerivativeVec2f().transpose() * Jw;
-        J.row(1) = e_it->getDepthDerivativeVec2f().transpose() * Jw - Jz.transpose();
+      ic_ls->finish();
+
+      ls.A = ic_ls->A;
+      ls.b = ic_ls->b;
+    }
+    else
+    {
+      // normal equations of the fused kernel are already accumulated
+      if(!use_fused)
+      {
+        // the weights of an unweighted iteration are all 1
+        NormalEquationsKernel kernel = normal_equations_kernels_[use_soa][weighted];
 
-        ls.update(J, e_it->getIntensityAndDepthVec2f(), (*w_it) * precision);
+        ls.blockSize(block_size);
+        kernel(compute_residuals_result.first_point_error, use_soa ? &points_error_soa : 0, weights.begin(), precision, n, cfg.ParallelGrainSize, ls);
       }
-      ls.finish();
 
+      if(!ls_finished)
+        ls.finish();
+    }
+
+    if(cfg.UseMixedPrecisionSolver && !use_ic)
+    {
+      A = ls.A_sum + cfg.Mu * Matrix6d::Identity();
+      b = ls.b_sum + cfg.Mu * initial().log();
+    }
+    else
+    {
       A = ls.A.cast<double>() + cfg.Mu * Matrix6d::Identity();
       b = ls.b.cast<double>() + cfg.Mu * initial().log();
+    }
+
+    if(cfg.UseMixedPrecisionSolver)
+    {
+      if(!dvo::core::solveCholesky6x6(A, b, x))
+      {
+        degenerate_counter.record(0.0);
+        dvo::core::solveDegenerate6x6(A, b, x);
+      }
+    }
+    else
+    {
       x = A.ldlt().solve(b);
+    }
+
+    linsys_timer.record(Timer::seconds(Timer::now() - linsys_start));
 
-//      sw_linsys[itctx_.Level].stopAndPrint();
+    iteration_stats.EstimateIncrement = x;
+    iteration_stats.EstimateInformation = A;
 
-      iteration_stats.EstimateIncrement = x;
-      iteration_stats.EstimateInformation = A;
+    itctx_.Iteration++;
+
+    if(use_deadline)
+    {
+      const int64_t now = Timer::now();
+      updateIterationTime(itctx_.Level, Timer::seconds(now - iteration_start));
 
-      itctx_.Iteration++;
-//      sw_it[itctx_.Level].stopAndPrint();
+      deadline_reached = state.elapsed + Timer::seconds(now - level_start) + expectedIterationTime(itctx_.Level) > cfg.MaxMatchTime;
     }
-    while(accept && x.lpNorm<Eigen::Infinity>() > cfg.Precision && !itctx_.IterationsExceeded());
+  }
+  while(accept && x.lpNorm<Eigen::Infinity>() > cfg.Precision && !itctx_.IterationsExceeded() && !deadline_reached);
 
-    if(!accept)
-      level_stats.TerminationCriterion = TerminationCriteria::LogLikelihoodDecreased;
+  if(!accept)
+    level_stats.TerminationCriterion = TerminationCriteria::LogLikelihoodDecreased;
 
-    if(x.lpNorm<Eigen::Infinity>() <= cfg.Precision)
-      level_stats.TerminationCriterion = TerminationCriteria::IncrementTooSmall;
+  if(x.lpNorm<Eigen::Infinity>() <= cfg.Precision)
+    level_stats.TerminationCriterion = TerminationCriteria::IncrementTooSmall;
 
-    if(itctx_.IterationsExceeded())
-      level_stats.TerminationCriterion = TerminationCriteria::IterationsExceeded;
+  if(itctx_.IterationsExceeded())
+    level_stats.TerminationCriterion = TerminationCriteria::IterationsExceeded;
 
-//    sw_level[itctx_.Level].stopAndPrint();
-  }
+  if(deadline_reached && accept && x.lpNorm<Eigen::Infinity>() > cfg.Precision && !itctx_.IterationsExceeded())
+    level_stats.TerminationCriterion = TerminationCriteria::DeadlineReached;
 
-  LevelStats& last_level = result.Statistics.Levels.back();
-  IterationStats& last_iteration = last_level.TerminationCriterion != TerminationCriteria::LogLikelihoodDecreased ? last_level.Iterations[last_level.Iterations.size() - 1] : last_level.Iterations[last_level.Iterations.size() - 2];
+  state.elapsed += Timer::seconds(Timer::now() - level_start);
 
-  result.Transformation = estimate().inverse().matrix();
-  result.Information = last_iteration.EstimateInformation * 0.008 * 0.008;
-  result.LogLikelihood = last_iteration.TDistributionLogLikelihood + last_iteration.PriorLogLikelihood;
+  if(cfg.UseWarmStartedScale)
+  {
+    // the scale of the iteration whose estimate is kept
+    const IterationStats& kept = accept || level_stats.Iterations.size() < 2 ? level_stats.Iterations.back() : level_stats.Iterations[level_stats.Iterations.size() - 2];
+    const double det = kept.TDistributionPrecision.determinant();
 
-  return success;
+    LevelScale& scale = level_scale_[itctx_.Level];
+    scale.valid = kept.ValidConstraints > 6 && std::isfinite(det) && det > 0.0;
+
+    if(scale.valid)
+    {
+      scale.mean = kept.TDistributionMean.cast<float>();
+      scale.precision = kept.TDistributionPrecision.cast<float>();
+    }
+  }
+
+  if(Trace::enabled())
+  {
+    Trace::Arg args[] = { { "level", double(itctx_.Level) }, { "iterations", double(level_stats.Iterations.size()) }, { "valid_pixels", double(level_stats.ValidPixels) }, { "termination_criterion", double(level_stats.TerminationCriterion) } };
+    Trace::instance().instant("dense_tracking/level", args, 4);
+  }
+
+  // no time left for the finer levels
+  return !deadline_reached;
 }
 
-// jacobian computation
-inline void DenseTracker::computeJacobianOfProjectionAndTransformation(const Vector4& p, Matrix2x6& j)
-{
-  NumType z = 1.0f / p(2);
-  NumType z_sqr = 1.0f / (p(2) * p(2));
-
-  j(0, 0) =  z;
-  j(0, 1) =  0.0f;
-  j(0, 2) = -p(0) * z_sqr;
-  j(0, 3) = j(0, 2) * p(1);//j(0, 3) = -p(0) * p(1) * z_sqr;
-  j(0, 4) = 1.0f - j(0, 2) * p(0);//j(0, 4) =  (1.0 + p(0) * p(0) * z_sqr);
-  j(0, 5) = -p(1) * z;
-
-  j(1, 0) =  0.0f;
-  j(1, 1) =  z;
-  j(1, 2) = -p(1) * z_sqr;
-  j(1, 3) = -1.0f + j(1, 2) * p(1); //j(1, 3) = -(1.0 + p(1) * p(1) * z_sqr);
-  j(1, 4) = -j(0, 3); //j(1, 4) =  p(0) * p(1) * z_sqr;
-  j(1, 5) =  p(0) * z;
+const DenseTracker::IterationStats& DenseTracker::lastIteration(const dvo::DenseTracker::Result& result, const MatchState& state) const
+{
+  const LevelStats& last_level = cfg.UseFullStatistics ? result.Statistics.Levels.back() : *state.level_stats;
+
+  return last_level.TerminationCriterion != TerminationCriteria::LogLikelihoodDecreased ? last_level.Iterations[last_level.Iterations.size() - 1] : last_level.Iterations[last_level.Iterations.size() - 2];
 }
 
-inline void DenseTracker::compute3rdRowOfJacobianOfTransformation(const Vector4& p, Vector6& j)
+bool DenseTracker::finishMatch(dvo::DenseTracker::Result& result, MatchState& state)
 {
-  j(0) = 0.0;
-  j(1) = 0.0;
-  j(2) = 1.0;
-  j(3) = p(1);
-  j(4) = -p(0);
-  j(5) = 0.0;
+  bool success = true;
+
+  const Revertable<Sophus::SE3d>& estimate = state.estimate;
+
+  const LevelStats& last_level = cfg.UseFullStatistics ? result.Statistics.Levels.back() : *state.level_stats;
+  const IterationStats& last_iteration = lastIteration(result, state);
+
+  result.Transformation = estimate().inverse().matrix();
+  result.Information = last_iteration.EstimateInformation * 0.008 * 0.008;
+  result.LogLikelihood = last_iteration.TDistributionLogLikelihood + last_iteration.PriorLogLikelihood;
+
+  if(!cfg.UseFullStatistics)
+  {
+    // only keep the last level and its final iteration, reuses the memory of the given result
+    result.Statistics.Levels.resize(1);
+
+    LevelStats& level_stats = result.Statistics.Levels.front();
+    level_stats.Id = last_level.Id;
+    level_stats.MaxValidPixels = last_level.MaxValidPixels;
+    level_stats.ValidPixels = last_level.ValidPixels;
+    level_stats.TerminationCriterion = last_level.TerminationCriterion;
+    level_stats.Iterations.assign(1, last_iteration);
+  }
+
+  return success;
 }
 
 } /* namespace dvo */
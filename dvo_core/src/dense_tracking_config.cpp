@@ -18,6 +18,8 @@
  *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+
 #include <dvo/dense_tracking.h>
 
 namespace dvo
@@ -30,13 +32,31 @@ DenseTracker::Config::Config() :
   Precision(5e-7),
   UseInitialEstimate(false),
   UseWeighting(true),
+  UseParallel(false),
+  ParallelGrainSize(4096),
+  UseSoaLayout(false),
+  UseFusedKernel(false),
+  UseGpu(false),
+  UseInverseCompositional(false),
+  UseMixedPrecisionSolver(false),
+  UseFullStatistics(true),
+  MaxMatchTime(0.0),
+  UseAdaptiveLevels(false),
+  UseCompactStorage(false),
+  RollingShutterReadoutTime(0.0),
   Mu(0),
   InfluenceFuntionType(dvo::core::InfluenceFunctions::TDistribution),
   InfluenceFunctionParam(dvo::core::TDistributionInfluenceFunction::DEFAULT_DOF),
   ScaleEstimatorType(dvo::core::ScaleEstimators::TDistribution),
   ScaleEstimatorParam(dvo::core::TDistributionScaleEstimator::DEFAULT_DOF),
   IntensityDerivativeThreshold(0.0f),
-  DepthDerivativeThreshold(0.0f)
+  DepthDerivativeThreshold(0.0f),
+  MaxPointsPerLevel(0),
+  UseMortonOrder(false),
+  ScaleSampleSize(0),
+  UseWarmStartedScale(false),
+  FinestLevelMaxPixels(0),
+  CoarsestLevelMinPixels(0)
 {
 }
 
@@ -45,6 +65,45 @@ size_t DenseTracker::Config::getNumLevels() const
   return FirstLevel + 1;
 }
 
+void DenseTracker::Config::fitLevels(size_t width, size_t height)
+{
+  int level = 0;
+
+  if(FinestLevelMaxPixels > 0)
+  {
+    while(width * height > size_t(FinestLevelMaxPixels) && width > 1 && height > 1)
+    {
+      width /= 2;
+      height /= 2;
+      level++;
+    }
+
+    LastLevel = level;
+  }
+  else
+  {
+    for(; level < LastLevel; ++level)
+    {
+      width /= 2;
+      height /= 2;
+    }
+  }
+
+  if(CoarsestLevelMinPixels > 0)
+  {
+    while((width / 2) * (height / 2) >= size_t(CoarsestLevelMinPixels))
+    {
+      width /= 2;
+      height /= 2;
+      level++;
+    }
+
+    FirstLevel = level;
+  }
+
+  FirstLevel = std::max(FirstLevel, LastLevel);
+}
+
 bool DenseTracker::Config::UseEstimateSmoothing() const
 {
   return Mu > 1e-6;
@@ -52,7 +111,7 @@ bool DenseTracker::Config::UseEstimateSmoothing() const
 
 bool DenseTracker::Config::IsSane() const
 {
-  return FirstLevel >= LastLevel;
+  return FirstLevel >= LastLevel && ParallelGrainSize > 0 && MaxMatchTime >= 0.0 && RollingShutterReadoutTime >= 0.0 && MaxPointsPerLevel >= 0 && ScaleSampleSize >= 0;
 }
 
 DenseTracker::IterationContext::IterationContext(const Config& cfg) :
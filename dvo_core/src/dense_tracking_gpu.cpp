@@ -0,0 +1,135 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo/dense_tracking_impl.h>
+
+#include <algorithm>
+
+#include "dense_tracking_impl_cuda.h"
+
+namespace dvo
+{
+namespace core
+{
+
+bool GpuNormalEquations::available()
+{
+#ifdef DVO_WITH_CUDA
+  static const bool has_device = gpu::deviceCount() > 0;
+
+  return has_device;
+#else
+  return false;
+#endif
+}
+
+GpuNormalEquations::GpuNormalEquations() :
+    level_(0),
+    upper_bound_u_(0.0f),
+    upper_bound_v_(0.0f)
+{
+#ifdef DVO_WITH_CUDA
+  if(available()) level_ = gpu::createLevel();
+#endif
+}
+
+GpuNormalEquations::~GpuNormalEquations()
+{
+#ifdef DVO_WITH_CUDA
+  gpu::destroyLevel(level_);
+#endif
+}
+
+bool GpuNormalEquations::upload(const PointIterator& first_point, const PointIterator& last_point, const RgbdImage& current)
+{
+#ifdef DVO_WITH_CUDA
+  if(level_ == 0) return false;
+
+  const size_t num_points = last_point - first_point;
+
+  upper_bound_u_ = current.width - 2;
+  upper_bound_v_ = current.height - 2;
+
+  return
+      gpu::uploadPoints(level_, num_points > 0 ? first_point->point.data : 0, num_points) &&
+      gpu::uploadAcceleration(level_, current.acceleration.ptr<float>(), current.acceleration.cols, current.acceleration.rows, current.acceleration.step1());
+#else
+  return false;
+#endif
+}
+
+bool GpuNormalEquations::compute(const IntrinsicMatrix& intrinsics, const Eigen::Affine3f& transform, const Vector8f& reference_weight, const Vector8f& current_weight, const Eigen::Vector2f& mean, const Eigen::Matrix2f& precision, NormalEquationsLeastSquares& ls, ComputeNormalEquationsResult& result)
+{
+#ifdef DVO_WITH_CUDA
+  if(level_ == 0) return false;
+
+  Eigen::Matrix<float, 3, 3> K;
+  K <<
+      intrinsics.fx(), 0, intrinsics.ox(),
+      0, intrinsics.fy(), intrinsics.oy(),
+      0, 0, 1;
+
+  Eigen::Matrix<float, 3, 4, Eigen::RowMajor> KT = K * transform.matrix().block<3, 4>(0, 0);
+
+  gpu::NormalEquationsArgs args;
+  std::copy(KT.data(), KT.data() + 12, args.kt);
+  std::copy(reference_weight.data(), reference_weight.data() + 8, args.reference_weight);
+  std::copy(current_weight.data(), current_weight.data() + 8, args.current_weight);
+
+  args.mean[0] = mean(0);
+  args.mean[1] = mean(1);
+  args.precision[0] = precision(0, 0);
+  args.precision[1] = precision(0, 1);
+  args.precision[2] = precision(1, 1);
+  args.upper_bound_u = upper_bound_u_;
+  args.upper_bound_v = upper_bound_v_;
+
+  gpu::NormalEquationsSums sums;
+
+  if(!gpu::computeNormalEquations(level_, args, sums)) return false;
+
+  size_t idx = 0;
+
+  for(int i = 0; i < 6; ++i)
+  {
+    for(int j = i; j < 6; ++j, ++idx)
+    {
+      ls.A_sum(i, j) = ls.A_sum(j, i) = sums.A[idx];
+    }
+
+    ls.b_sum(i) = sums.b[i];
+  }
+
+  ls.A = ls.A_sum.cast<NumType>();
+  ls.b = ls.b_sum.cast<NumType>();
+  ls.num_constraints = size_t(sums.valid_constraints);
+
+  result.ValidConstraints = size_t(sums.valid_constraints);
+  result.WeightedScatter << sums.scatter[0], sums.scatter[1], sums.scatter[1], sums.scatter[2];
+  result.LogLikelihoodErrorSum = sums.log_likelihood_error_sum;
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+} /* namespace core */
+} /* namespace dvo */
@@ -25,6 +25,16 @@
   #define __SSE3__
 #endif
 
+#include <dvo/util/cpu_features.h>
+
+#include <sophus/se3.hpp>
+
+#include <boost/static_assert.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
 #include <immintrin.h>
 #include <pmmintrin.h>
 
@@ -33,6 +43,55 @@ namespace dvo
 namespace core
 {
 
+// interpolates the current image at the projection of p given by KT and appends its residual, returns false if it is
+// outside the image or the interpolated value isn't valid
+template<typename TMatrix34>
+static inline bool computeResidual(PointWithIntensityAndDepth& p, const TMatrix34& KT, const RgbdImage& current, const Vector8f& reference_weight, const Vector8f& current_weight, ComputeResidualsResult& result)
+{
+  const Eigen::Vector3f transformed_point = KT * p.getPointVec4f();
+
+  float projected_x = transformed_point(0) / transformed_point(2);
+  float projected_y = transformed_point(1) / transformed_point(2);
+
+  if(!current.inImage(projected_x, projected_y) || !current.inImage(projected_x + 1, projected_y + 1)) return false;
+
+  float x0 = std::floor(projected_x);
+  float y0 = std::floor(projected_y);
+
+  float x0w, x1w, y0w, y1w;
+  x1w = projected_x - x0;
+  x0w = 1.0f - x1w;
+  y1w = projected_y - y0;
+  y0w = 1.0f - y1w;
+
+  const float *x0y0_ptr = current.acceleration.ptr<float>(int(y0), int(x0));
+  const float *x0y1_ptr = current.acceleration.ptr<float>(int(y0 + 1), int(x0));
+
+  Vector8f::ConstAlignedMapType x0y0(x0y0_ptr);
+  Vector8f::ConstAlignedMapType x1y0(x0y0_ptr + 8);
+  Vector8f::ConstAlignedMapType x0y1(x0y1_ptr);
+  Vector8f::ConstAlignedMapType x1y1(x0y1_ptr + 8);
+
+  Vector8f interpolated = (x0y0 * x0w + x1y0 * x1w) * y0w + (x0y1 * x0w + x1y1 * x1w) * y1w;
+
+  if(!std::isfinite(interpolated(1)) || !std::isfinite(interpolated(4)) || !std::isfinite(interpolated(5))) return false;
+
+  // funny part: puzzling together depends on fwd. comp. / inverse comp. / esm / additiv / ...
+  // fwd. comp. for now
+  result.last_point_error->getPointVec4f() = p.getPointVec4f();
+
+  Vector8f reference = p.getIntensityAndDepthWithDerivativesVec8f();
+  reference(1) = transformed_point(2);
+
+  result.last_point_error->getIntensityAndDepthWithDerivativesVec8f() = current_weight.cwiseProduct(interpolated) + reference_weight.cwiseProduct(reference);
+  *result.last_residual = result.last_point_error->getIntensityAndDepthVec2f();
+
+  ++result.last_point_error;
+  ++result.last_residual;
+
+  return true;
+}
+
 void computeResiduals(const PointIterator& first_point, const PointIterator& last_point, const RgbdImage& current, const IntrinsicMatrix& intrinsics, const Eigen::Affine3f transform, const Vector8f& reference_weight, const Vector8f& current_weight, ComputeResidualsResult& result)
 {
   result.last_point_error = result.first_point_error;
@@ -44,78 +103,51 @@ void computeResiduals(const PointIterator& first_point, const PointIterator& las
       0, intrinsics.fy(), intrinsics.oy(),
       0, 0, 1;
 
-  //Sophus::Vector6d xi;
-  //xi = Sophus::SE3(transform.rotation().cast<double>(), transform.translation().cast<double>()).log();
-
-
   Eigen::Matrix<float, 3, 4> KT = K * transform.matrix().block<3, 4>(0, 0);
-  Eigen::Vector4f transformed_point;
-  transformed_point.setConstant(1);
-  //transformed_point1.setConstant(1);
-
-  float t = std::numeric_limits<float>::quiet_NaN();
 
   for(PointIterator p_it = first_point; p_it != last_point; ++p_it)
   {
-    // TODO: doesn't work yet
-    //if(t != p_it->intensity_and_depth.time_interpolation)
-    //{
-    //  t = p_it->intensity_and_depth.time_interpolation;
-    //  KT = K * Sophus::SE3::exp(xi + xi * t).matrix().block<3, 4>(0, 0).cast<float>();
-    //}
-
-    //transformed_point = transform * p_it->getPointVec4f();
-
-    //float projected_x = transformed_point(0) * intrinsics.fx() / transformed_point(2) + intrinsics.ox();
-    //float projected_y = transformed_point(1) * intrinsics.fy() / transformed_point(2) + intrinsics.oy();
-
-    transformed_point.head<3>() = KT * p_it->getPointVec4f();
-
-    float projected_x = transformed_point(0) / transformed_point(2);
-    float projected_y = transformed_point(1) / transformed_point(2);
+    computeResidual(*p_it, KT, current, reference_weight, current_weight, result);
+  }
+}
 
-    if(!current.inImage(projected_x, projected_y) || !current.inImage(projected_x + 1, projected_y + 1)) continue;
+void RollingShutterTransforms::update(const IntrinsicMatrix& intrinsics, const Eigen::Affine3d& transform, double dt, double readout_time)
+{
+  Eigen::Matrix3d K;
+  K <<
+      intrinsics.fx(), 0, intrinsics.ox(),
+      0, intrinsics.fy(), intrinsics.oy(),
+      0, 0, 1;
 
-    float x0 = std::floor(projected_x);
-    float y0 = std::floor(projected_y);
+  KT = (K * transform.matrix().block<3, 4>(0, 0)).cast<float>();
 
-    float x0w, x1w, y0w, y1w;
-    x1w = projected_x - x0;
-    x0w = 1.0f - x1w;
-    y1w = projected_y - y0;
-    y0w = 1.0f - y1w;
+  const Sophus::SE3d::Tangent xi = Sophus::SE3d(transform.rotation(), transform.translation()).log();
+  const int half = Buckets / 2;
 
-    const float *x0y0_ptr = current.acceleration.ptr<float>(int(y0), int(x0));
-    const float *x0y1_ptr = current.acceleration.ptr<float>(int(y0 + 1), int(x0));
+  for(int b = 0; b < Buckets; ++b)
+  {
+    // (v - y) / height of the bucket center
+    const double s = 1.0 + double(b - half) / half * readout_time / dt;
 
-    Vector8f::ConstAlignedMapType x0y0(x0y0_ptr);
-    Vector8f::ConstAlignedMapType x1y0(x0y0_ptr + 8);
-    Vector8f::ConstAlignedMapType x0y1(x0y1_ptr);
-    Vector8f::ConstAlignedMapType x1y1(x0y1_ptr + 8);
-    /*
-    Vector8f interpolated =
-        x0y0 * x0w + x1y0 * x1w +
-        x0y1 * x0w + x1y1 * x1w +
-        x0y0 * y0w + x0y1 * y1w +
-        x1y0 * y0w + x1y1 * y1w;
-    interpolated *= 0.25f;
-    */
-    Vector8f interpolated = (x0y0 * x0w + x1y0 * x1w) * y0w + (x0y1 * x0w + x1y1 * x1w) * y1w;
+    BucketKT[b] = (K * Sophus::SE3d::exp(s * xi).matrix().block<3, 4>(0, 0)).cast<float>();
+  }
+}
 
-    if(!std::isfinite(interpolated(1)) || !std::isfinite(interpolated(4)) || !std::isfinite(interpolated(5))) continue;
+void computeResidualsRollingShutter(const PointIterator& first_point, const PointIterator& last_point, const RgbdImage& current, const RollingShutterTransforms& transforms, const Vector8f& reference_weight, const Vector8f& current_weight, ComputeResidualsResult& result)
+{
+  result.last_point_error = result.first_point_error;
+  result.last_residual = result.first_residual;
 
-    // funny part: puzzling together depends on fwd. comp. / inverse comp. / esm / additiv / ...
-    // fwd. comp. for now
-    result.last_point_error->getPointVec4f() = p_it->getPointVec4f(); // transformed_point;
+  const float height = current.height;
 
-    Vector8f reference = p_it->getIntensityAndDepthWithDerivativesVec8f();
-    reference(1) = transformed_point(2);
+  for(PointIterator p_it = first_point; p_it != last_point; ++p_it)
+  {
+    // the row the point would appear in without the rolling shutter selects the transform
+    const Eigen::Vector3f projected = transforms.KT * p_it->getPointVec4f();
 
-    result.last_point_error->getIntensityAndDepthWithDerivativesVec8f() = current_weight.cwiseProduct(interpolated) + reference_weight.cwiseProduct(reference);
-    *result.last_residual = result.last_point_error->getIntensityAndDepthVec2f();
+    if(!(projected(2) > 0.0f)) continue;
 
-    ++result.last_point_error;
-    ++result.last_residual;
+    computeResidual(*p_it, transforms.select(projected(1) / projected(2), height, p_it->intensity_and_depth.time_interpolation), current, reference_weight, current_weight, result);
   }
 }
 
@@ -366,9 +398,99 @@ void computeResidualsSse(const PointIterator& first_point, const PointIterator&
   if(rnd_mode != _MM_ROUND_TOWARD_ZERO) _MM_SET_ROUNDING_MODE(rnd_mode);
 }
 
+namespace internal
+{
+
+// the wide kernels read the points through ResidualKernelPoint
+BOOST_STATIC_ASSERT(sizeof(ResidualKernelPoint) == sizeof(PointWithIntensityAndDepth));
+BOOST_STATIC_ASSERT(offsetof(ResidualKernelPoint, intensity_and_depth) == offsetof(PointWithIntensityAndDepth, intensity_and_depth));
+
+struct ResidualKernelDispatch
+{
+  ComputeResidualsKernel kernel;
+  const char* name;
+
+  ResidualKernelDispatch() :
+    kernel(0),
+    name("sse")
+  {
+    // DVO_SIMD is applied by the feature checks
+    if(dvo::util::hasAvx512())
+    {
+      kernel = &computeResidualsAvx512;
+      name = "avx512";
+    }
+    else if(dvo::util::hasAvx2())
+    {
+      kernel = &computeResidualsAvx2;
+      name = "avx2";
+    }
+  }
+};
+
+// selected once at startup
+static const ResidualKernelDispatch residual_kernel_dispatch;
+
+} /* namespace internal */
+
+const char* getResidualKernelName()
+{
+  return internal::residual_kernel_dispatch.name;
+}
+
+bool hasCompactResidualKernel()
+{
+  return internal::residual_kernel_dispatch.kernel != 0 && dvo::util::hasF16c();
+}
+
 void computeResidualsSse(const PointIterator& first_point, const PointIterator& last_point, const RgbdImage& current, const IntrinsicMatrix& intrinsics, const Eigen::Affine3f transform, const Vector8f& reference_weight, const Vector8f& current_weight, ComputeResidualsResult& result)
 {
-  computeResidualsSse<false>(first_point, last_point, current, intrinsics, transform, reference_weight, current_weight, result);
+  if(internal::residual_kernel_dispatch.kernel == 0 || first_point == last_point)
+  {
+    computeResidualsSse<false>(first_point, last_point, current, intrinsics, transform, reference_weight, current_weight, result);
+    return;
+  }
+
+  Eigen::Matrix<float, 3, 3> K;
+  K <<
+      intrinsics.fx(), 0, intrinsics.ox(),
+      0, intrinsics.fy(), intrinsics.oy(),
+      0, 0, 1;
+
+  Eigen::Matrix<float, 3, 4, Eigen::RowMajor> KT = K * transform.matrix().block<3, 4>(0, 0);
+
+  ResidualKernelArgs args;
+  args.first_point = reinterpret_cast<const ResidualKernelPoint*>(&(*first_point));
+  args.last_point = args.first_point + (last_point - first_point);
+  args.first_point_error = reinterpret_cast<ResidualKernelPoint*>(&(*result.first_point_error));
+  args.first_residual = result.first_residual->data();
+  if(!current.acceleration.empty())
+  {
+    args.acceleration = current.acceleration.ptr<float>();
+    args.acceleration_half = 0;
+    args.acceleration_stride = int(current.acceleration.step1());
+  }
+  else
+  {
+    // only the compact version, see DenseTracker::Config::UseCompactStorage
+    assert(!current.acceleration_half.empty() && hasCompactResidualKernel());
+
+    args.acceleration = 0;
+    args.acceleration_half = current.acceleration_half.ptr<uint16_t>();
+    args.acceleration_stride = int(current.acceleration_half.step1());
+  }
+
+  args.upper_bound_u = current.width - 2;
+  args.upper_bound_v = current.height - 2;
+
+  std::copy(KT.data(), KT.data() + 12, args.kt);
+  std::copy(reference_weight.data(), reference_weight.data() + 8, args.reference_weight);
+  std::copy(current_weight.data(), current_weight.data() + 8, args.current_weight);
+
+  size_t n = internal::residual_kernel_dispatch.kernel(args);
+
+  result.last_point_error = result.first_point_error + n;
+  result.last_residual = result.first_residual + n;
 }
 
 void computeResidualsAndValidFlagsSse(const PointIterator& first_point, const PointIterator& last_point, const RgbdImage& current, const IntrinsicMatrix& intrinsics, const Eigen::Affine3f transform, const Vector8f& reference_weight, const Vector8f& current_weight, ComputeResidualsResult& result)
@@ -376,6 +498,119 @@ void computeResidualsAndValidFlagsSse(const PointIterator& first_point, const Po
   computeResidualsSse<true>(first_point, last_point, current, intrinsics, transform, reference_weight, current_weight, result);
 }
 
+void computeResidualsAndNormalEquationsSse(const PointIterator& first_point, const PointIterator& last_point, const RgbdImage& current, const IntrinsicMatrix& intrinsics, const Eigen::Affine3f transform, const Vector8f& reference_weight, const Vector8f& current_weight, const Eigen::Vector2f& mean, const Eigen::Matrix2f& precision, NormalEquationsLeastSquares& ls, ComputeNormalEquationsResult& result)
+{
+  Eigen::Matrix<float, 3, 3> K;
+  K <<
+      intrinsics.fx(), 0, intrinsics.ox(),
+      0, intrinsics.fy(), intrinsics.oy(),
+      0, 0, 1;
+
+  Eigen::Matrix<float, 3, 4> KT = K * transform.matrix().block<3, 4>(0, 0);
+
+  __m128 kt_r1 = _mm_setr_ps(KT(0, 0), KT(0, 1), KT(0, 2), KT(0, 3));
+  __m128 kt_r2 = _mm_setr_ps(KT(1, 0), KT(1, 1), KT(1, 2), KT(1, 3));
+  __m128 kt_r3 = _mm_setr_ps(KT(2, 0), KT(2, 1), KT(2, 2), KT(2, 3));
+
+  __m128 current_weight_a = _mm_load_ps(current_weight.data());
+  __m128 current_weight_b = _mm_load_ps(current_weight.data() + 4);
+
+  __m128 reference_weight_a = _mm_load_ps(reference_weight.data());
+  __m128 reference_weight_b = _mm_load_ps(reference_weight.data() + 4);
+
+  const float upper_bound_u = current.width - 2, upper_bound_v = current.height - 2;
+
+  const float p00 = precision(0, 0), p01 = precision(0, 1) + precision(1, 0), p11 = precision(1, 1);
+
+  EIGEN_ALIGN16 float uvz[4];
+  EIGEN_ALIGN16 float residual[8];
+
+  Eigen::Vector4f p;
+  Eigen::Vector2f r;
+  Matrix2x6 J, Jw;
+  Vector6 Jz;
+
+  size_t n = 0;
+  float s_ii = 0.0f, s_id = 0.0f, s_dd = 0.0f;
+  double error_sum = 0.0, error_acc = 1.0;
+
+  for(PointIterator p_it = first_point; p_it != last_point; ++p_it)
+  {
+    // transform and project
+    __m128 pt = _mm_load_ps(p_it->point.data);
+    __m128 xy_zz = _mm_hadd_ps(_mm_hadd_ps(_mm_mul_ps(kt_r1, pt), _mm_mul_ps(kt_r2, pt)), _mm_hadd_ps(_mm_mul_ps(kt_r3, pt), _mm_mul_ps(kt_r3, pt)));
+    _mm_store_ps(uvz, xy_zz);
+
+    const float z = uvz[2];
+    const float u = uvz[0] / z, v = uvz[1] / z;
+
+    // NaNs compare false
+    if(!(u >= 0.0f && u <= upper_bound_u && v >= 0.0f && v <= upper_bound_v)) continue;
+
+    const int u0 = int(u), v0 = int(v);
+
+    const float *x0y0_ptr = current.acceleration.ptr<float>(v0, u0);
+    const float *x0y1_ptr = current.acceleration.ptr<float>(v0 + 1, u0);
+
+    __m128 w0u = _mm_set1_ps(1.0f - (u - u0)), w1u = _mm_set1_ps(u - u0);
+    __m128 w0v = _mm_set1_ps(1.0f - (v - v0)), w1v = _mm_set1_ps(v - v0);
+
+    __m128 a = _mm_add_ps(
+        _mm_mul_ps(w0v, _mm_add_ps(_mm_mul_ps(w0u, _mm_load_ps(x0y0_ptr + 0)), _mm_mul_ps(w1u, _mm_load_ps(x0y0_ptr + 8)))),
+        _mm_mul_ps(w1v, _mm_add_ps(_mm_mul_ps(w0u, _mm_load_ps(x0y1_ptr + 0)), _mm_mul_ps(w1u, _mm_load_ps(x0y1_ptr + 8))))
+    );
+    __m128 b = _mm_add_ps(
+        _mm_mul_ps(w0v, _mm_add_ps(_mm_mul_ps(w0u, _mm_load_ps(x0y0_ptr + 4)), _mm_mul_ps(w1u, _mm_load_ps(x0y0_ptr + 12)))),
+        _mm_mul_ps(w1v, _mm_add_ps(_mm_mul_ps(w0u, _mm_load_ps(x0y1_ptr + 4)), _mm_mul_ps(w1u, _mm_load_ps(x0y1_ptr + 12))))
+    );
+
+    // check for NaNs in interpolated Vec8f
+    if(_mm_movemask_ps(_mm_cmpunord_ps(a, b)) != 0) continue;
+
+    // replace the reference image depth value with the transformed one
+    __m128 reference_a = _mm_load_ps(p_it->intensity_and_depth.data);
+    reference_a = _mm_or_ps(_mm_and_ps(BLEND_MASK, _mm_set1_ps(z)), _mm_andnot_ps(BLEND_MASK, reference_a));
+
+    _mm_store_ps(residual + 0, _mm_add_ps(_mm_mul_ps(current_weight_a, a), _mm_mul_ps(reference_weight_a, reference_a)));
+    _mm_store_ps(residual + 4, _mm_add_ps(_mm_mul_ps(current_weight_b, b), _mm_mul_ps(reference_weight_b, _mm_load_ps(p_it->intensity_and_depth.data + 4))));
+
+    r(0) = residual[0];
+    r(1) = residual[1];
+
+    // weight from t-distribution
+    const float di = r(0) - mean(0), dd = r(1) - mean(1);
+    const float w = (2.0f + 5.0f) / (5.0f + p00 * di * di + p01 * di * dd + p11 * dd * dd);
+
+    s_ii += w * di * di;
+    s_id += w * di * dd;
+    s_dd += w * dd * dd;
+
+    error_acc *= (1.0 + 0.2 * (p00 * r(0) * r(0) + p01 * r(0) * r(1) + p11 * r(1) * r(1)));
+
+    if(((n + 1) % 50) == 0)
+    {
+      error_sum += std::log(error_acc);
+      error_acc = 1.0;
+    }
+
+    // jacobian
+    p = p_it->getPointVec4f();
+    DenseTracker::computeJacobianOfProjectionAndTransformation(p, Jw);
+    DenseTracker::compute3rdRowOfJacobianOfTransformation(p, Jz);
+
+    J.row(0) = residual[2] * Jw.row(0) + residual[3] * Jw.row(1);
+    J.row(1) = residual[4] * Jw.row(0) + residual[5] * Jw.row(1) - Jz.transpose();
+
+    ls.update(J, r, w * precision);
+
+    ++n;
+  }
+
+  result.ValidConstraints = n;
+  result.WeightedScatter << s_ii, s_id, s_id, s_dd;
+  // like computeCompleteDataLogLikelihood, the trailing partial product is not included
+  result.LogLikelihoodErrorSum = error_sum;
+}
 
 float computeCompleteDataLogLikelihood(const ResidualIterator& first_residual, const ResidualIterator& last_residual, const WeightIterator& first_weight, const  Eigen::Vector2f& mean, const  Eigen::Matrix2f& precision)
 {
@@ -611,6 +846,226 @@ Eigen::Matrix2f computeScaleSse(const ResidualIterator& first_residual, const Re
   return covariance;
 }
 
+// index in [0, n) from a linear congruential generator, good enough to decorrelate the samples from the raster order
+static inline size_t nextSample(uint32_t& state, const size_t n)
+{
+  state = state * 1664525u + 1013904223u;
+
+  return size_t((uint64_t(state) * n) >> 32);
+}
+
+Eigen::Matrix2f computeScaleSampled(const ResidualIterator& first_residual, const ResidualIterator& last_residual, const WeightIterator& first_weight, const Eigen::Vector2f& mean, const size_t samples, const uint32_t seed)
+{
+  size_t n = (last_residual - first_residual);
+
+  Eigen::Matrix2f covariance;
+  covariance.setZero();
+
+  uint32_t state = seed;
+
+  for(size_t idx = 0; idx < samples; ++idx)
+  {
+    const size_t k = nextSample(state, n);
+
+    covariance += computeScalePart(*(first_weight + k), *(first_residual + k), mean);
+  }
+
+  // sample mean scaled to the sum over all residuals, normalized like computeScale
+  return covariance * (float(n) / float(samples) / float(n - 2 - 1));
+}
+
+float computeCompleteDataLogLikelihoodSampled(const ResidualIterator& first_residual, const ResidualIterator& last_residual, const Eigen::Matrix2f& precision, const size_t samples, const uint32_t seed)
+{
+  size_t n = (last_residual - first_residual);
+  double error_sum = 0.0;
+
+  uint32_t state = seed;
+
+  for(size_t idx = 0; idx < samples; ++idx)
+  {
+    const Eigen::Vector2f& r = *(first_residual + nextSample(state, n));
+
+    error_sum += std::log(1.0 + 0.2 * (r.transpose() * precision * r)(0, 0));
+  }
+
+  return 0.5 * n * std::log(precision.determinant()) - 0.5 * (5.0 + 2.0) * error_sum * (double(n) / double(samples));
+}
+
+// logarithmic bins of the absolute residuals, the exponent and the leading 4 mantissa bits of the float select the bin.
+// 16 bins per octave from 2^-20 to 2^12, smaller and larger residuals are counted in the first and last bin
+static const int HistogramMinExponent = -20, HistogramOctaves = 32, HistogramMantissaBits = 4;
+static const int HistogramBins = HistogramOctaves << HistogramMantissaBits;
+static const int HistogramShift = 23 - HistogramMantissaBits;
+static const int HistogramOffset = (127 + HistogramMinExponent) << HistogramMantissaBits;
+
+static inline float histogramBinLower(const int bin)
+{
+  const uint32_t bits = uint32_t(bin + HistogramOffset) << HistogramShift;
+
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+
+  return value;
+}
+
+static inline int histogramBin(const float r)
+{
+  static const float min_value = histogramBinLower(0), max_value = histogramBinLower(HistogramBins - 1);
+
+  // written so that nan ends up in the last bin
+  float a = std::abs(r);
+  a = a < max_value ? a : max_value;
+  a = a > min_value ? a : min_value;
+
+  uint32_t bits;
+  std::memcpy(&bits, &a, sizeof(bits));
+
+  return int(bits >> HistogramShift) - HistogramOffset;
+}
+
+// linearly interpolated inside the bin with the median
+static float histogramMedian(const uint32_t* counts, const size_t n)
+{
+  const float half = 0.5f * n;
+  size_t cumulative = 0;
+
+  for(int bin = 0; bin < HistogramBins; ++bin)
+  {
+    if(counts[bin] > 0 && float(cumulative + counts[bin]) >= half)
+    {
+      const float lower = histogramBinLower(bin), upper = histogramBinLower(bin + 1);
+
+      return lower + (upper - lower) * std::max(0.0f, half - float(cumulative)) / float(counts[bin]);
+    }
+
+    cumulative += counts[bin];
+  }
+
+  return histogramBinLower(HistogramBins);
+}
+
+Eigen::Matrix2f computeScaleHistogramSse(const ResidualIterator& first_residual, const ResidualIterator& last_residual)
+{
+  // 1 / 0.6745, median absolute deviation to standard deviation of a normal distribution
+  static const float MadNormalizer = 1.4826f;
+
+  const size_t n = (last_residual - first_residual);
+  const ResidualIterator lr = last_residual - (n % 2);
+
+  // intensity bins followed by the depth bins
+  uint32_t counts[2 * HistogramBins];
+  std::fill(counts, counts + 2 * HistogramBins, 0u);
+
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 min_value = _mm_set1_ps(histogramBinLower(0));
+  const __m128 max_value = _mm_set1_ps(histogramBinLower(HistogramBins - 1));
+  const __m128i offset = _mm_setr_epi32(-HistogramOffset, HistogramBins - HistogramOffset, -HistogramOffset, HistogramBins - HistogramOffset);
+
+  EIGEN_ALIGN16 int32_t bins[4];
+
+  for(ResidualIterator err_it = first_residual; err_it != lr; err_it += 2)
+  {
+    __m128 a = _mm_and_ps(_mm_load_ps(err_it->data()), abs_mask);
+
+    // min returns its second operand for nan
+    a = _mm_max_ps(_mm_min_ps(a, max_value), min_value);
+
+    _mm_store_si128((__m128i*) bins, _mm_add_epi32(_mm_srli_epi32(_mm_castps_si128(a), HistogramShift), offset));
+
+    ++counts[bins[0]];
+    ++counts[bins[1]];
+    ++counts[bins[2]];
+    ++counts[bins[3]];
+  }
+
+  for(ResidualIterator err_it = lr; err_it != last_residual; ++err_it)
+  {
+    ++counts[histogramBin((*err_it)(0))];
+    ++counts[HistogramBins + histogramBin((*err_it)(1))];
+  }
+
+  const float sigma_i = MadNormalizer * histogramMedian(counts, n);
+  const float sigma_d = MadNormalizer * histogramMedian(counts + HistogramBins, n);
+
+  Eigen::Matrix2f covariance;
+  covariance << sigma_i * sigma_i, 0.0f, 0.0f, sigma_d * sigma_d;
+
+  return covariance;
+}
+
+static inline float computeHuberWeight(const Eigen::Vector2f& r, const Eigen::Matrix2f& precision, const float k, double& rho)
+{
+  const float d2 = r.transpose() * precision * r;
+  const float d = std::sqrt(d2);
+
+  if(d <= k)
+  {
+    rho += 0.5 * d2;
+    return 1.0f;
+  }
+  else
+  {
+    rho += k * d - 0.5 * k * k;
+    return k / d;
+  }
+}
+
+float computeWeightsAndLogLikelihoodHuberSse(const ResidualIterator& first_residual, const ResidualIterator& last_residual, const WeightIterator& first_weight, const Eigen::Matrix2f& precision, const float k)
+{
+  const size_t n = (last_residual - first_residual);
+  float *w_ptr = &(*first_weight);
+  const ResidualIterator lr = last_residual - (n % 4);
+
+  __m128 prec = _mm_load_ps(precision.data());
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 half = _mm_set1_ps(0.5f);
+  __m128 k4 = _mm_set1_ps(k);
+  __m128 k2 = _mm_set1_ps(k * k);
+  __m128 half_k2 = _mm_set1_ps(0.5f * k * k);
+
+  __m128d rho_acc_lo = _mm_setzero_pd(), rho_acc_hi = _mm_setzero_pd();
+
+  for(ResidualIterator err_it = first_residual; err_it != lr; err_it += 4, w_ptr += 4)
+  {
+    __m128 r1r2 = _mm_load_ps((err_it + 0)->data());
+    __m128 r1r1 = _mm_movelh_ps(r1r2, r1r2);
+    __m128 r2r2 = _mm_movehl_ps(r1r2, r1r2);
+
+    __m128 dist_r1r2 = _mm_mul_ps(_mm_hadd_ps(_mm_mul_ps(r1r1, prec), _mm_mul_ps(r2r2, prec)), r1r2);
+
+    __m128 r3r4 = _mm_load_ps((err_it + 2)->data());
+    __m128 r3r3 = _mm_movelh_ps(r3r4, r3r4);
+    __m128 r4r4 = _mm_movehl_ps(r3r4, r3r4);
+
+    __m128 dist_r3r4 = _mm_mul_ps(_mm_hadd_ps(_mm_mul_ps(r3r3, prec), _mm_mul_ps(r4r4, prec)), r3r4);
+
+    // squared mahalanobis distances of the 4 residuals
+    __m128 d2 = _mm_hadd_ps(dist_r1r2, dist_r3r4);
+    __m128 d = _mm_sqrt_ps(d2);
+
+    // k / 0 is inf, min returns its second operand for nan
+    _mm_store_ps(w_ptr, _mm_min_ps(_mm_div_ps(k4, d), one));
+
+    __m128 inlier = _mm_cmple_ps(d2, k2);
+    __m128 rho = _mm_or_ps(_mm_and_ps(inlier, _mm_mul_ps(half, d2)), _mm_andnot_ps(inlier, _mm_sub_ps(_mm_mul_ps(k4, d), half_k2)));
+
+    rho_acc_lo = _mm_add_pd(rho_acc_lo, _mm_cvtps_pd(rho));
+    rho_acc_hi = _mm_add_pd(rho_acc_hi, _mm_cvtps_pd(_mm_movehl_ps(rho, rho)));
+  }
+
+  EIGEN_ALIGN16 double rho_parts[2];
+  _mm_store_pd(rho_parts, _mm_add_pd(rho_acc_lo, rho_acc_hi));
+
+  double rho_sum = rho_parts[0] + rho_parts[1];
+
+  for(ResidualIterator err_it = lr; err_it != last_residual; ++err_it, ++w_ptr)
+  {
+    *w_ptr = computeHuberWeight(*err_it, precision, k, rho_sum);
+  }
+
+  return 0.5 * n * std::log(precision.determinant()) - rho_sum;
+}
+
 static inline float computeWeight(const Eigen::Vector2f& r, const Eigen::Vector2f& mean, const Eigen::Matrix2f& precision)
 {
   Eigen::Vector2f diff = r - mean;
@@ -0,0 +1,97 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DENSE_TRACKING_IMPL_AVX_H_
+#define DENSE_TRACKING_IMPL_AVX_H_
+
+// shared by the AVX2 and AVX-512 residual kernels, only include from translation units compiled with -mavx2 -mfma -mf16c!
+// only includes the plain data interface, so no Eigen or OpenCV code gets compiled with these flags
+
+#include <dvo/dense_tracking_kernels.h>
+
+#include <immintrin.h>
+
+namespace dvo
+{
+namespace core
+{
+namespace internal
+{
+
+// the 8 channels of one pixel of the acceleration structure
+static inline __m256 loadAcceleration(const float* p)
+{
+  return _mm256_loadu_ps(p);
+}
+
+static inline __m256 loadAcceleration(const uint16_t* p)
+{
+  return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*) p));
+}
+
+// requests both rows of the texels interpolated at (u0 + w1u, v0 + w1v), each row spans two pixels, which may cross a
+// cache line
+template<typename T>
+static inline void prefetchAcceleration(const T* acceleration, const int acceleration_stride, const int u0, const int v0)
+{
+  const char *x0y0_ptr = (const char*) (acceleration + v0 * acceleration_stride + u0 * 8);
+  const char *x0y1_ptr = x0y0_ptr + acceleration_stride * sizeof(T);
+  const int last = 16 * sizeof(T) - 1;
+
+  _mm_prefetch(x0y0_ptr, _MM_HINT_T0);
+  _mm_prefetch(x0y0_ptr + last, _MM_HINT_T0);
+  _mm_prefetch(x0y1_ptr, _MM_HINT_T0);
+  _mm_prefetch(x0y1_ptr + last, _MM_HINT_T0);
+}
+
+// interpolates the acceleration structure at (u, v) and writes the residual for one point, returns false if the interpolated value contains NaNs
+template<typename T>
+static inline bool computeResidualAvx(const T* acceleration, const int acceleration_stride, const ResidualKernelPoint& p, const float z, const int u0, const int v0, const float w1u, const float w1v, const __m256& current_weight, const __m256& reference_weight, ResidualKernelPoint& point_error, float* residual)
+{
+  const T *x0y0_ptr = acceleration + v0 * acceleration_stride + u0 * 8;
+  const T *x0y1_ptr = x0y0_ptr + acceleration_stride;
+
+  const __m256 w0u = _mm256_set1_ps(1.0f - w1u);
+  const __m256 w1u8 = _mm256_set1_ps(w1u);
+
+  __m256 top = _mm256_fmadd_ps(w1u8, loadAcceleration(x0y0_ptr + 8), _mm256_mul_ps(w0u, loadAcceleration(x0y0_ptr)));
+  __m256 bottom = _mm256_fmadd_ps(w1u8, loadAcceleration(x0y1_ptr + 8), _mm256_mul_ps(w0u, loadAcceleration(x0y1_ptr)));
+
+  __m256 interpolated = _mm256_fmadd_ps(_mm256_set1_ps(w1v), bottom, _mm256_mul_ps(_mm256_set1_ps(1.0f - w1v), top));
+
+  if(_mm256_movemask_ps(_mm256_cmp_ps(interpolated, interpolated, _CMP_UNORD_Q)) != 0) return false;
+
+  // replace the reference image depth value with the transformed one
+  __m256 reference = _mm256_loadu_ps(p.intensity_and_depth);
+  reference = _mm256_blend_ps(reference, _mm256_set1_ps(z), 0x02);
+
+  __m256 r = _mm256_fmadd_ps(current_weight, interpolated, _mm256_mul_ps(reference_weight, reference));
+
+  _mm_store_ps(point_error.point, _mm_load_ps(p.point));
+  _mm256_storeu_ps(point_error.intensity_and_depth, r);
+  _mm_storel_pi((__m64 *) residual, _mm256_castps256_ps128(r));
+
+  return true;
+}
+
+} /* namespace internal */
+} /* namespace core */
+} /* namespace dvo */
+#endif /* DENSE_TRACKING_IMPL_AVX_H_ */
@@ -0,0 +1,145 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// compiled with -mavx2 -mfma -mf16c, only called after runtime dispatch in dense_tracking_impl.cpp
+
+#include "dense_tracking_impl_avx.h"
+
+namespace dvo
+{
+namespace core
+{
+
+template<typename T>
+static size_t computeResidualsAvx2Impl(const ResidualKernelArgs& args, const T* acceleration)
+{
+  static const int Lanes = 8;
+  static const int PointStride = sizeof(ResidualKernelPoint) / sizeof(float);
+
+  const __m256 kt00 = _mm256_set1_ps(args.kt[0]), kt01 = _mm256_set1_ps(args.kt[1]), kt02 = _mm256_set1_ps(args.kt[2]), kt03 = _mm256_set1_ps(args.kt[3]);
+  const __m256 kt10 = _mm256_set1_ps(args.kt[4]), kt11 = _mm256_set1_ps(args.kt[5]), kt12 = _mm256_set1_ps(args.kt[6]), kt13 = _mm256_set1_ps(args.kt[7]);
+  const __m256 kt20 = _mm256_set1_ps(args.kt[8]), kt21 = _mm256_set1_ps(args.kt[9]), kt22 = _mm256_set1_ps(args.kt[10]), kt23 = _mm256_set1_ps(args.kt[11]);
+
+  const __m256 current_weight = _mm256_loadu_ps(args.current_weight);
+  const __m256 reference_weight = _mm256_loadu_ps(args.reference_weight);
+
+  const __m256 lower_bound = _mm256_setzero_ps();
+  const __m256 upper_bound_u = _mm256_set1_ps(args.upper_bound_u);
+  const __m256 upper_bound_v = _mm256_set1_ps(args.upper_bound_v);
+
+  const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i offsets = _mm256_mullo_epi32(lane, _mm256_set1_epi32(PointStride));
+
+  // the projections of two blocks, the texels of the next block are prefetched while the current one is interpolated,
+  // so their cache misses overlap with the interpolation instead of stalling it
+  float transformed_z[2][Lanes] __attribute__((aligned(32))), w1u[2][Lanes] __attribute__((aligned(32))), w1v[2][Lanes] __attribute__((aligned(32)));
+  int u0[2][Lanes] __attribute__((aligned(32))), v0[2][Lanes] __attribute__((aligned(32)));
+  const ResidualKernelPoint* block[2] = { 0, 0 };
+  int block_mask[2] = { 0, 0 };
+  int current = 0;
+
+  ResidualKernelPoint* point_error = args.first_point_error;
+  float* residual = args.first_residual;
+
+  for(const ResidualKernelPoint* p = args.first_point;; p += Lanes)
+  {
+    const int next = current ^ 1;
+    block_mask[next] = 0;
+
+    if(p < args.last_point)
+    {
+      const int n = args.last_point - p < Lanes ? int(args.last_point - p) : Lanes;
+
+      // lanes past the end re-read the first point of the block and are masked out below
+      const __m256i idx = n == Lanes ? offsets : _mm256_and_si256(offsets, _mm256_cmpgt_epi32(_mm256_set1_epi32(n), lane));
+      const float* base = p->point;
+
+      __m256 x = _mm256_i32gather_ps(base + 0, idx, 4);
+      __m256 y = _mm256_i32gather_ps(base + 1, idx, 4);
+      __m256 z = _mm256_i32gather_ps(base + 2, idx, 4);
+
+      // transform and project
+      __m256 pu = _mm256_fmadd_ps(kt00, x, _mm256_fmadd_ps(kt01, y, _mm256_fmadd_ps(kt02, z, kt03)));
+      __m256 pv = _mm256_fmadd_ps(kt10, x, _mm256_fmadd_ps(kt11, y, _mm256_fmadd_ps(kt12, z, kt13)));
+      __m256 pz = _mm256_fmadd_ps(kt20, x, _mm256_fmadd_ps(kt21, y, _mm256_fmadd_ps(kt22, z, kt23)));
+
+      __m256 inv_z = _mm256_div_ps(_mm256_set1_ps(1.0f), pz);
+      __m256 u = _mm256_mul_ps(pu, inv_z);
+      __m256 v = _mm256_mul_ps(pv, inv_z);
+
+      // check image bounds, NaNs compare false
+      __m256 in_bounds = _mm256_and_ps(
+          _mm256_and_ps(_mm256_cmp_ps(u, lower_bound, _CMP_GE_OQ), _mm256_cmp_ps(u, upper_bound_u, _CMP_LE_OQ)),
+          _mm256_and_ps(_mm256_cmp_ps(v, lower_bound, _CMP_GE_OQ), _mm256_cmp_ps(v, upper_bound_v, _CMP_LE_OQ))
+      );
+      const int mask = _mm256_movemask_ps(in_bounds) & ((1 << n) - 1);
+
+      if(mask != 0)
+      {
+        // truncation is floor, because we only use non-negative coordinates
+        __m256i ui = _mm256_cvttps_epi32(u);
+        __m256i vi = _mm256_cvttps_epi32(v);
+
+        _mm256_store_si256((__m256i*) u0[next], ui);
+        _mm256_store_si256((__m256i*) v0[next], vi);
+        _mm256_store_ps(w1u[next], _mm256_sub_ps(u, _mm256_cvtepi32_ps(ui)));
+        _mm256_store_ps(w1v[next], _mm256_sub_ps(v, _mm256_cvtepi32_ps(vi)));
+        _mm256_store_ps(transformed_z[next], pz);
+
+        for(int m = mask; m != 0; m &= m - 1)
+        {
+          const int i = __builtin_ctz(m);
+          internal::prefetchAcceleration(acceleration, args.acceleration_stride, u0[next][i], v0[next][i]);
+        }
+      }
+
+      block[next] = p;
+      block_mask[next] = mask;
+    }
+
+    for(int mask = block_mask[current]; mask != 0; mask &= mask - 1)
+    {
+      const int i = __builtin_ctz(mask);
+
+      if(internal::computeResidualAvx(acceleration, args.acceleration_stride, block[current][i], transformed_z[current][i], u0[current][i], v0[current][i], w1u[current][i], w1v[current][i], current_weight, reference_weight, *point_error, residual))
+      {
+        ++point_error;
+        residual += 2;
+      }
+    }
+
+    if(p >= args.last_point) break;
+
+    current = next;
+  }
+
+  return point_error - args.first_point_error;
+}
+
+size_t computeResidualsAvx2(const ResidualKernelArgs& args)
+{
+  if(args.acceleration != 0)
+    return computeResidualsAvx2Impl(args, args.acceleration);
+  else
+    return computeResidualsAvx2Impl(args, args.acceleration_half);
+}
+
+} /* namespace core */
+} /* namespace dvo */
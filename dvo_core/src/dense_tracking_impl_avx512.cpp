@@ -0,0 +1,146 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// compiled with -mavx512f -mavx2 -mfma -mf16c, only called after runtime dispatch in dense_tracking_impl.cpp
+
+#include "dense_tracking_impl_avx.h"
+
+namespace dvo
+{
+namespace core
+{
+
+template<typename T>
+static size_t computeResidualsAvx512Impl(const ResidualKernelArgs& args, const T* acceleration)
+{
+  static const int Lanes = 16;
+  static const int PointStride = sizeof(ResidualKernelPoint) / sizeof(float);
+
+  const __m512 kt00 = _mm512_set1_ps(args.kt[0]), kt01 = _mm512_set1_ps(args.kt[1]), kt02 = _mm512_set1_ps(args.kt[2]), kt03 = _mm512_set1_ps(args.kt[3]);
+  const __m512 kt10 = _mm512_set1_ps(args.kt[4]), kt11 = _mm512_set1_ps(args.kt[5]), kt12 = _mm512_set1_ps(args.kt[6]), kt13 = _mm512_set1_ps(args.kt[7]);
+  const __m512 kt20 = _mm512_set1_ps(args.kt[8]), kt21 = _mm512_set1_ps(args.kt[9]), kt22 = _mm512_set1_ps(args.kt[10]), kt23 = _mm512_set1_ps(args.kt[11]);
+
+  // the interpolation itself works on one Vec8f per point, so it stays 256 bit wide
+  const __m256 current_weight = _mm256_loadu_ps(args.current_weight);
+  const __m256 reference_weight = _mm256_loadu_ps(args.reference_weight);
+
+  const __m512 lower_bound = _mm512_setzero_ps();
+  const __m512 upper_bound_u = _mm512_set1_ps(args.upper_bound_u);
+  const __m512 upper_bound_v = _mm512_set1_ps(args.upper_bound_v);
+
+  const __m512i offsets = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(PointStride));
+
+  // two blocks in flight like in the AVX2 kernel, the texels of the next block are prefetched while the current one
+  // is interpolated
+  float transformed_z[2][Lanes] __attribute__((aligned(64))), w1u[2][Lanes] __attribute__((aligned(64))), w1v[2][Lanes] __attribute__((aligned(64)));
+  int u0[2][Lanes] __attribute__((aligned(64))), v0[2][Lanes] __attribute__((aligned(64)));
+  const ResidualKernelPoint* block[2] = { 0, 0 };
+  unsigned int block_mask[2] = { 0, 0 };
+  int current = 0;
+
+  ResidualKernelPoint* point_error = args.first_point_error;
+  float* residual = args.first_residual;
+
+  for(const ResidualKernelPoint* p = args.first_point;; p += Lanes)
+  {
+    const int next = current ^ 1;
+    block_mask[next] = 0;
+
+    if(p < args.last_point)
+    {
+      const int n = args.last_point - p < Lanes ? int(args.last_point - p) : Lanes;
+      const __mmask16 valid = __mmask16((1u << n) - 1u);
+      const float* base = p->point;
+
+      // masked gathers don't touch memory past the end
+      __m512 x = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), valid, offsets, base + 0, 4);
+      __m512 y = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), valid, offsets, base + 1, 4);
+      __m512 z = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), valid, offsets, base + 2, 4);
+
+      // transform and project
+      __m512 pu = _mm512_fmadd_ps(kt00, x, _mm512_fmadd_ps(kt01, y, _mm512_fmadd_ps(kt02, z, kt03)));
+      __m512 pv = _mm512_fmadd_ps(kt10, x, _mm512_fmadd_ps(kt11, y, _mm512_fmadd_ps(kt12, z, kt13)));
+      __m512 pz = _mm512_fmadd_ps(kt20, x, _mm512_fmadd_ps(kt21, y, _mm512_fmadd_ps(kt22, z, kt23)));
+
+      __m512 inv_z = _mm512_div_ps(_mm512_set1_ps(1.0f), pz);
+      __m512 u = _mm512_mul_ps(pu, inv_z);
+      __m512 v = _mm512_mul_ps(pv, inv_z);
+
+      // check image bounds, NaNs compare false
+      __mmask16 in_bounds = valid;
+      in_bounds = _mm512_mask_cmp_ps_mask(in_bounds, u, lower_bound, _CMP_GE_OQ);
+      in_bounds = _mm512_mask_cmp_ps_mask(in_bounds, u, upper_bound_u, _CMP_LE_OQ);
+      in_bounds = _mm512_mask_cmp_ps_mask(in_bounds, v, lower_bound, _CMP_GE_OQ);
+      in_bounds = _mm512_mask_cmp_ps_mask(in_bounds, v, upper_bound_v, _CMP_LE_OQ);
+
+      const unsigned int mask = in_bounds;
+
+      if(mask != 0)
+      {
+        // truncation is floor, because we only use non-negative coordinates
+        __m512i ui = _mm512_cvttps_epi32(u);
+        __m512i vi = _mm512_cvttps_epi32(v);
+
+        _mm512_store_si512(u0[next], ui);
+        _mm512_store_si512(v0[next], vi);
+        _mm512_store_ps(w1u[next], _mm512_sub_ps(u, _mm512_cvtepi32_ps(ui)));
+        _mm512_store_ps(w1v[next], _mm512_sub_ps(v, _mm512_cvtepi32_ps(vi)));
+        _mm512_store_ps(transformed_z[next], pz);
+
+        for(unsigned int m = mask; m != 0; m &= m - 1)
+        {
+          const int i = __builtin_ctz(m);
+          internal::prefetchAcceleration(acceleration, args.acceleration_stride, u0[next][i], v0[next][i]);
+        }
+      }
+
+      block[next] = p;
+      block_mask[next] = mask;
+    }
+
+    for(unsigned int mask = block_mask[current]; mask != 0; mask &= mask - 1)
+    {
+      const int i = __builtin_ctz(mask);
+
+      if(internal::computeResidualAvx(acceleration, args.acceleration_stride, block[current][i], transformed_z[current][i], u0[current][i], v0[current][i], w1u[current][i], w1v[current][i], current_weight, reference_weight, *point_error, residual))
+      {
+        ++point_error;
+        residual += 2;
+      }
+    }
+
+    if(p >= args.last_point) break;
+
+    current = next;
+  }
+
+  return point_error - args.first_point_error;
+}
+
+size_t computeResidualsAvx512(const ResidualKernelArgs& args)
+{
+  if(args.acceleration != 0)
+    return computeResidualsAvx512Impl(args, args.acceleration);
+  else
+    return computeResidualsAvx512Impl(args, args.acceleration_half);
+}
+
+} /* namespace core */
+} /* namespace dvo */
@@ -0,0 +1,308 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// compiled by nvcc if the library is built with DVO_WITH_CUDA, the host side is in dense_tracking_gpu.cpp
+// mirrors computeResidualsAndNormalEquationsSse, but sums the log likelihood terms directly instead of in products of 50
+
+#include "dense_tracking_impl_cuda.h"
+
+#include <cuda_runtime.h>
+
+namespace dvo
+{
+namespace core
+{
+namespace gpu
+{
+
+static const int PointStride = 12;
+static const int PixelStride = 8;
+
+static const int BlockSize = 256;
+static const int MaxBlocks = 256;
+
+// A, b, scatter, log likelihood and valid constraints, see NormalEquationsSums
+static const int NumSums = sizeof(NormalEquationsSums) / sizeof(double);
+static const int IdxB = 21, IdxScatter = 27, IdxLogLikelihood = 30, IdxValid = 31;
+
+struct DeviceLevel
+{
+  float* points;
+  size_t num_points, points_capacity;
+
+  float* acceleration;
+  size_t acceleration_capacity;
+  int acceleration_stride; // in floats
+
+  double* partial_sums; // NumSums per block
+  double* sums;
+};
+
+__global__ void computeNormalEquationsKernel(const float* points, const int num_points, const float* acceleration, const int acceleration_stride, const NormalEquationsArgs args, double* partial_sums)
+{
+  float sums[NumSums];
+
+#pragma unroll
+  for(int k = 0; k < NumSums; ++k)
+    sums[k] = 0.0f;
+
+  const float p00 = args.precision[0], p01 = args.precision[1], p11 = args.precision[2];
+
+  for(int idx = blockIdx.x * blockDim.x + threadIdx.x; idx < num_points; idx += blockDim.x * gridDim.x)
+  {
+    const float* p = points + idx * PointStride;
+    const float x = p[0], y = p[1], z = p[2];
+
+    // transform and project
+    const float pu = args.kt[0] * x + args.kt[1] * y + args.kt[ 2] * z + args.kt[ 3];
+    const float pv = args.kt[4] * x + args.kt[5] * y + args.kt[ 6] * z + args.kt[ 7];
+    const float pz = args.kt[8] * x + args.kt[9] * y + args.kt[10] * z + args.kt[11];
+
+    const float u = pu / pz, v = pv / pz;
+
+    // NaNs compare false
+    if(!(u >= 0.0f && u <= args.upper_bound_u && v >= 0.0f && v <= args.upper_bound_v)) continue;
+
+    const int u0 = int(u), v0 = int(v);
+    const float w1u = u - u0, w1v = v - v0, w0u = 1.0f - w1u, w0v = 1.0f - w1v;
+
+    const float* x0y0 = acceleration + v0 * acceleration_stride + u0 * PixelStride;
+    const float* x0y1 = x0y0 + acceleration_stride;
+
+    float residual[PixelStride];
+    bool valid = true;
+
+#pragma unroll
+    for(int k = 0; k < PixelStride; ++k)
+    {
+      const float a = w0v * (w0u * x0y0[k] + w1u * x0y0[k + PixelStride]) + w1v * (w0u * x0y1[k] + w1u * x0y1[k + PixelStride]);
+      valid = valid && !isnan(a);
+
+      // the reference depth is replaced with the transformed one
+      const float reference = k == 1 ? pz : p[4 + k];
+      residual[k] = args.current_weight[k] * a + args.reference_weight[k] * reference;
+    }
+
+    if(!valid) continue;
+
+    const float r0 = residual[0], r1 = residual[1];
+
+    // weight from t-distribution
+    const float di = r0 - args.mean[0], dd = r1 - args.mean[1];
+    const float w = (2.0f + 5.0f) / (5.0f + p00 * di * di + 2.0f * p01 * di * dd + p11 * dd * dd);
+
+    sums[IdxScatter + 0] += w * di * di;
+    sums[IdxScatter + 1] += w * di * dd;
+    sums[IdxScatter + 2] += w * dd * dd;
+
+    sums[IdxLogLikelihood] += log1pf(0.2f * (p00 * r0 * r0 + 2.0f * p01 * r0 * r1 + p11 * r1 * r1));
+    sums[IdxValid] += 1.0f;
+
+    // jacobian at the reference point, see DenseTracker::computeJacobianOfProjectionAndTransformation
+    const float zi = 1.0f / z, zi_sqr = zi * zi;
+
+    float jw0[6], jw1[6], jz[6];
+    jw0[0] = zi;
+    jw0[1] = 0.0f;
+    jw0[2] = -x * zi_sqr;
+    jw0[3] = jw0[2] * y;
+    jw0[4] = 1.0f - jw0[2] * x;
+    jw0[5] = -y * zi;
+
+    jw1[0] = 0.0f;
+    jw1[1] = zi;
+    jw1[2] = -y * zi_sqr;
+    jw1[3] = -1.0f + jw1[2] * y;
+    jw1[4] = -jw0[3];
+    jw1[5] = x * zi;
+
+    jz[0] = 0.0f;
+    jz[1] = 0.0f;
+    jz[2] = 1.0f;
+    jz[3] = y;
+    jz[4] = -x;
+    jz[5] = 0.0f;
+
+    float j0[6], j1[6], wj0[6], wj1[6];
+
+    const float w00 = w * p00, w01 = w * p01, w11 = w * p11;
+
+#pragma unroll
+    for(int k = 0; k < 6; ++k)
+    {
+      j0[k] = residual[2] * jw0[k] + residual[3] * jw1[k];
+      j1[k] = residual[4] * jw0[k] + residual[5] * jw1[k] - jz[k];
+
+      wj0[k] = w00 * j0[k] + w01 * j1[k];
+      wj1[k] = w01 * j0[k] + w11 * j1[k];
+    }
+
+    int a_idx = 0;
+
+#pragma unroll
+    for(int i = 0; i < 6; ++i)
+    {
+#pragma unroll
+      for(int j = i; j < 6; ++j, ++a_idx)
+        sums[a_idx] += j0[i] * wj0[j] + j1[i] * wj1[j];
+
+      sums[IdxB + i] -= wj0[i] * r0 + wj1[i] * r1;
+    }
+  }
+
+  // warp, then block reduction, the partial sums of the blocks are added in double
+  __shared__ float warp_sums[BlockSize / 32][NumSums];
+
+  const int lane = threadIdx.x & 31, warp = threadIdx.x >> 5;
+
+#pragma unroll
+  for(int k = 0; k < NumSums; ++k)
+  {
+    float s = sums[k];
+
+    for(int offset = 16; offset > 0; offset >>= 1)
+      s += __shfl_down_sync(0xffffffff, s, offset);
+
+    if(lane == 0) warp_sums[warp][k] = s;
+  }
+
+  __syncthreads();
+
+  if(threadIdx.x < NumSums)
+  {
+    double s = 0.0;
+
+    for(int idx = 0; idx < BlockSize / 32; ++idx)
+      s += warp_sums[idx][threadIdx.x];
+
+    partial_sums[blockIdx.x * NumSums + threadIdx.x] = s;
+  }
+}
+
+__global__ void sumBlocksKernel(const double* partial_sums, const int num_blocks, double* sums)
+{
+  double s = 0.0;
+
+  for(int idx = 0; idx < num_blocks; ++idx)
+    s += partial_sums[idx * NumSums + threadIdx.x];
+
+  sums[threadIdx.x] = s;
+}
+
+// grows the device buffer to at least size bytes, drops its content
+static bool reserve(float*& buffer, size_t& capacity, size_t size)
+{
+  if(capacity >= size) return true;
+
+  cudaFree(buffer);
+  buffer = 0;
+  capacity = 0;
+
+  if(cudaMalloc((void**) &buffer, size) != cudaSuccess) return false;
+
+  capacity = size;
+
+  return true;
+}
+
+int deviceCount()
+{
+  int count = 0;
+
+  if(cudaGetDeviceCount(&count) != cudaSuccess) return 0;
+
+  return count;
+}
+
+DeviceLevel* createLevel()
+{
+  DeviceLevel* level = new DeviceLevel();
+  level->points = 0;
+  level->num_points = 0;
+  level->points_capacity = 0;
+  level->acceleration = 0;
+  level->acceleration_capacity = 0;
+  level->acceleration_stride = 0;
+  level->partial_sums = 0;
+  level->sums = 0;
+
+  if(cudaMalloc((void**) &level->partial_sums, MaxBlocks * NumSums * sizeof(double)) != cudaSuccess || cudaMalloc((void**) &level->sums, NumSums * sizeof(double)) != cudaSuccess)
+  {
+    destroyLevel(level);
+    return 0;
+  }
+
+  return level;
+}
+
+void destroyLevel(DeviceLevel* level)
+{
+  if(level == 0) return;
+
+  cudaFree(level->points);
+  cudaFree(level->acceleration);
+  cudaFree(level->partial_sums);
+  cudaFree(level->sums);
+
+  delete level;
+}
+
+bool uploadPoints(DeviceLevel* level, const float* points, size_t num_points)
+{
+  const size_t size = num_points * PointStride * sizeof(float);
+
+  level->num_points = 0;
+
+  if(!reserve(level->points, level->points_capacity, size)) return false;
+  if(cudaMemcpy(level->points, points, size, cudaMemcpyHostToDevice) != cudaSuccess) return false;
+
+  level->num_points = num_points;
+
+  return true;
+}
+
+bool uploadAcceleration(DeviceLevel* level, const float* acceleration, int width, int height, size_t stride)
+{
+  const size_t row = width * PixelStride * sizeof(float);
+
+  if(!reserve(level->acceleration, level->acceleration_capacity, row * height)) return false;
+  if(cudaMemcpy2D(level->acceleration, row, acceleration, stride * sizeof(float), row, height, cudaMemcpyHostToDevice) != cudaSuccess) return false;
+
+  level->acceleration_stride = width * PixelStride;
+
+  return true;
+}
+
+bool computeNormalEquations(DeviceLevel* level, const NormalEquationsArgs& args, NormalEquationsSums& sums)
+{
+  const int num_points = int(level->num_points);
+  const int num_blocks = num_points > 0 ? min(MaxBlocks, (num_points + BlockSize - 1) / BlockSize) : 1;
+
+  computeNormalEquationsKernel<<<num_blocks, BlockSize>>>(level->points, num_points, level->acceleration, level->acceleration_stride, args, level->partial_sums);
+  sumBlocksKernel<<<1, NumSums>>>(level->partial_sums, num_blocks, level->sums);
+
+  if(cudaGetLastError() != cudaSuccess) return false;
+
+  return cudaMemcpy(&sums, level->sums, sizeof(NormalEquationsSums), cudaMemcpyDeviceToHost) == cudaSuccess;
+}
+
+} /* namespace gpu */
+} /* namespace core */
+} /* namespace dvo */
@@ -0,0 +1,81 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DENSE_TRACKING_IMPL_CUDA_H_
+#define DENSE_TRACKING_IMPL_CUDA_H_
+
+#include <stddef.h>
+
+namespace dvo
+{
+namespace core
+{
+namespace gpu
+{
+
+/**
+ * Plain interface of the CUDA kernels in dense_tracking_impl_cuda.cu. It is also compiled by nvcc, so it mustn't use
+ * Eigen or OpenCV types, see GpuNormalEquations for the host side.
+ */
+
+// device copies of the reference points and the acceleration structure of one level, grow on demand
+struct DeviceLevel;
+
+struct NormalEquationsArgs
+{
+  float kt[12]; // K * T, row major 3x4
+  float reference_weight[8];
+  float current_weight[8];
+
+  float mean[2];
+  float precision[3]; // p00, p01, p11 of the symmetric precision
+
+  float upper_bound_u, upper_bound_v;
+};
+
+// the only data copied back per iteration
+struct NormalEquationsSums
+{
+  double A[21]; // upper triangle, row major
+  double b[6];
+
+  double scatter[3]; // ii, id, dd
+  double log_likelihood_error_sum;
+  double valid_constraints;
+};
+
+// number of usable devices, 0 without driver
+int deviceCount();
+
+DeviceLevel* createLevel();
+void destroyLevel(DeviceLevel* level);
+
+// 12 floats per point in the layout of PointWithIntensityAndDepth
+bool uploadPoints(DeviceLevel* level, const float* points, size_t num_points);
+
+// 8 floats per pixel, stride in floats
+bool uploadAcceleration(DeviceLevel* level, const float* acceleration, int width, int height, size_t stride);
+
+bool computeNormalEquations(DeviceLevel* level, const NormalEquationsArgs& args, NormalEquationsSums& sums);
+
+} /* namespace gpu */
+} /* namespace core */
+} /* namespace dvo */
+#endif /* DENSE_TRACKING_IMPL_CUDA_H_ */
@@ -0,0 +1,270 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo/dense_tracking_impl.h>
+
+#ifdef __CDT_PARSER__
+  #define __SSE3__
+#endif
+
+#include <immintrin.h>
+#include <pmmintrin.h>
+
+namespace dvo
+{
+namespace core
+{
+
+typedef PointWithIntensityAndDepthSoa Soa;
+
+size_t computeResidualsSoaSse(const PointWithIntensityAndDepthSoa& points, const RgbdImage& current, const IntrinsicMatrix& intrinsics, const Eigen::Affine3f transform, const Vector8f& reference_weight, const Vector8f& current_weight, PointWithIntensityAndDepthSoa& points_error)
+{
+  points_error.resize(points.size());
+
+  Eigen::Matrix<float, 3, 3> K;
+  K <<
+      intrinsics.fx(), 0, intrinsics.ox(),
+      0, intrinsics.fy(), intrinsics.oy(),
+      0, 0, 1;
+
+  Eigen::Matrix<float, 3, 4> KT = K * transform.matrix().block<3, 4>(0, 0);
+
+  const __m128 lower_bound = _mm_setzero_ps();
+  const __m128 upper_bound_u = _mm_set1_ps(current.width - 2);
+  const __m128 upper_bound_v = _mm_set1_ps(current.height - 2);
+
+  // reference weights of the channels we keep, the depth channel is replaced by the transformed depth
+  const __m128 rw_i = _mm_set1_ps(reference_weight(0)), rw_z = _mm_set1_ps(reference_weight(1));
+  const __m128 rw_idx = _mm_set1_ps(reference_weight(2)), rw_idy = _mm_set1_ps(reference_weight(3));
+  const __m128 rw_zdx = _mm_set1_ps(reference_weight(4)), rw_zdy = _mm_set1_ps(reference_weight(5));
+
+  const __m128 cw_a = _mm_load_ps(current_weight.data());
+  const __m128 cw_b = _mm_load_ps(current_weight.data() + 4);
+
+  const float *x = points.channel(Soa::X), *y = points.channel(Soa::Y), *z = points.channel(Soa::Z);
+  const float *i = points.channel(Soa::Intensity);
+  const float *idx = points.channel(Soa::IntensityDx), *idy = points.channel(Soa::IntensityDy);
+  const float *zdx = points.channel(Soa::DepthDx), *zdy = points.channel(Soa::DepthDy);
+
+  float *x_out = points_error.channel(Soa::X), *y_out = points_error.channel(Soa::Y), *z_out = points_error.channel(Soa::Z);
+  float *i_out = points_error.channel(Soa::Intensity), *d_out = points_error.channel(Soa::Depth);
+  float *idx_out = points_error.channel(Soa::IntensityDx), *idy_out = points_error.channel(Soa::IntensityDy);
+  float *zdx_out = points_error.channel(Soa::DepthDx), *zdy_out = points_error.channel(Soa::DepthDy);
+
+  EIGEN_ALIGN16 int u0[4], v0[4];
+  EIGEN_ALIGN16 float w1u[4], w1v[4];
+  EIGEN_ALIGN16 float ref[6][4];
+  EIGEN_ALIGN16 float interpolated[8];
+
+  size_t n = 0;
+
+  // the padding is NaN and fails the bounds check, so we can always process 4 points at once
+  for(size_t k = 0; k < points.paddedSize(); k += 4)
+  {
+    __m128 px = _mm_load_ps(x + k), py = _mm_load_ps(y + k), pz = _mm_load_ps(z + k);
+
+    // transform and project
+    __m128 tu = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(KT(0, 0)), px), _mm_mul_ps(_mm_set1_ps(KT(0, 1)), py)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(KT(0, 2)), pz), _mm_set1_ps(KT(0, 3))));
+    __m128 tv = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(KT(1, 0)), px), _mm_mul_ps(_mm_set1_ps(KT(1, 1)), py)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(KT(1, 2)), pz), _mm_set1_ps(KT(1, 3))));
+    __m128 tz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(KT(2, 0)), px), _mm_mul_ps(_mm_set1_ps(KT(2, 1)), py)), _mm_add_ps(_mm_mul_ps(_mm_set1_ps(KT(2, 2)), pz), _mm_set1_ps(KT(2, 3))));
+
+    __m128 inv_z = _mm_div_ps(_mm_set1_ps(1.0f), tz);
+    __m128 u = _mm_mul_ps(tu, inv_z);
+    __m128 v = _mm_mul_ps(tv, inv_z);
+
+    // check image bounds, NaNs compare false
+    int mask = _mm_movemask_ps(_mm_and_ps(
+        _mm_and_ps(_mm_cmpge_ps(u, lower_bound), _mm_cmple_ps(u, upper_bound_u)),
+        _mm_and_ps(_mm_cmpge_ps(v, lower_bound), _mm_cmple_ps(v, upper_bound_v))
+    ));
+
+    if(mask == 0) continue;
+
+    // truncation is floor, because we only use non-negative coordinates
+    __m128i ui = _mm_cvttps_epi32(u), vi = _mm_cvttps_epi32(v);
+
+    _mm_store_si128((__m128i*) u0, ui);
+    _mm_store_si128((__m128i*) v0, vi);
+    _mm_store_ps(w1u, _mm_sub_ps(u, _mm_cvtepi32_ps(ui)));
+    _mm_store_ps(w1v, _mm_sub_ps(v, _mm_cvtepi32_ps(vi)));
+
+    // weighted reference values for all 4 points
+    _mm_store_ps(ref[0], _mm_mul_ps(rw_i, _mm_load_ps(i + k)));
+    _mm_store_ps(ref[1], _mm_mul_ps(rw_z, tz));
+    _mm_store_ps(ref[2], _mm_mul_ps(rw_idx, _mm_load_ps(idx + k)));
+    _mm_store_ps(ref[3], _mm_mul_ps(rw_idy, _mm_load_ps(idy + k)));
+    _mm_store_ps(ref[4], _mm_mul_ps(rw_zdx, _mm_load_ps(zdx + k)));
+    _mm_store_ps(ref[5], _mm_mul_ps(rw_zdy, _mm_load_ps(zdy + k)));
+
+    for(int l = 0; l < 4; ++l)
+    {
+      if((mask & (1 << l)) == 0) continue;
+
+      const float *x0y0_ptr = current.acceleration.ptr<float>(v0[l], u0[l]);
+      const float *x0y1_ptr = current.acceleration.ptr<float>(v0[l] + 1, u0[l]);
+
+      __m128 w0u = _mm_set1_ps(1.0f - w1u[l]), w1u4 = _mm_set1_ps(w1u[l]);
+      __m128 w0v = _mm_set1_ps(1.0f - w1v[l]), w1v4 = _mm_set1_ps(w1v[l]);
+
+      __m128 a = _mm_add_ps(
+          _mm_mul_ps(w0v, _mm_add_ps(_mm_mul_ps(w0u, _mm_load_ps(x0y0_ptr + 0)), _mm_mul_ps(w1u4, _mm_load_ps(x0y0_ptr + 8)))),
+          _mm_mul_ps(w1v4, _mm_add_ps(_mm_mul_ps(w0u, _mm_load_ps(x0y1_ptr + 0)), _mm_mul_ps(w1u4, _mm_load_ps(x0y1_ptr + 8))))
+      );
+      __m128 b = _mm_add_ps(
+          _mm_mul_ps(w0v, _mm_add_ps(_mm_mul_ps(w0u, _mm_load_ps(x0y0_ptr + 4)), _mm_mul_ps(w1u4, _mm_load_ps(x0y0_ptr + 12)))),
+          _mm_mul_ps(w1v4, _mm_add_ps(_mm_mul_ps(w0u, _mm_load_ps(x0y1_ptr + 4)), _mm_mul_ps(w1u4, _mm_load_ps(x0y1_ptr + 12))))
+      );
+
+      // check for NaNs in interpolated Vec8f
+      if(_mm_movemask_ps(_mm_cmpunord_ps(a, b)) != 0) continue;
+
+      _mm_store_ps(interpolated + 0, _mm_mul_ps(cw_a, a));
+      _mm_store_ps(interpolated + 4, _mm_mul_ps(cw_b, b));
+
+      x_out[n] = x[k + l];
+      y_out[n] = y[k + l];
+      z_out[n] = z[k + l];
+
+      i_out[n] = interpolated[0] + ref[0][l];
+      d_out[n] = interpolated[1] + ref[1][l];
+      idx_out[n] = interpolated[2] + ref[2][l];
+      idy_out[n] = interpolated[3] + ref[3][l];
+      zdx_out[n] = interpolated[4] + ref[4][l];
+      zdy_out[n] = interpolated[5] + ref[5][l];
+
+      ++n;
+    }
+  }
+
+  points_error.resize(n);
+
+  return n;
+}
+
+float computeCompleteDataLogLikelihoodSoa(const PointWithIntensityAndDepthSoa& points_error, const WeightIterator& first_weight, const Eigen::Vector2f& mean, const Eigen::Matrix2f& precision)
+{
+  const float *ri = points_error.channel(Soa::Intensity), *rd = points_error.channel(Soa::Depth);
+  const size_t n = points_error.size();
+  const float p00 = precision(0, 0), p01 = precision(0, 1) + precision(1, 0), p11 = precision(1, 1);
+
+  double error_sum = 0.0;
+  double error_acc = 1.0;
+
+  for(size_t k = 0; k < n; ++k)
+  {
+    error_acc *= (1.0 + 0.2 * (p00 * ri[k] * ri[k] + p01 * ri[k] * rd[k] + p11 * rd[k] * rd[k]));
+
+    if(((k + 1) % 50) == 0)
+    {
+      error_sum += std::log(error_acc);
+      error_acc = 1.0;
+    }
+  }
+
+  return 0.5 * n * std::log(precision.determinant()) - 0.5 * (5.0 + 2.0) * error_sum;
+}
+
+Eigen::Matrix2f computeScaleSoaSse(const PointWithIntensityAndDepthSoa& points_error, const WeightIterator& first_weight, const Eigen::Vector2f& mean)
+{
+  const float *ri = points_error.channel(Soa::Intensity), *rd = points_error.channel(Soa::Depth);
+  const float *w = &(*first_weight);
+  const size_t n = points_error.size(), n4 = n - (n % 4);
+
+  const __m128 mean_i = _mm_set1_ps(mean(0)), mean_d = _mm_set1_ps(mean(1));
+  __m128 acc_ii = _mm_setzero_ps(), acc_id = _mm_setzero_ps(), acc_dd = _mm_setzero_ps();
+
+  for(size_t k = 0; k < n4; k += 4)
+  {
+    __m128 wk = _mm_loadu_ps(w + k);
+    __m128 di = _mm_sub_ps(_mm_load_ps(ri + k), mean_i);
+    __m128 dd = _mm_sub_ps(_mm_load_ps(rd + k), mean_d);
+
+    __m128 wdi = _mm_mul_ps(wk, di);
+
+    acc_ii = _mm_add_ps(acc_ii, _mm_mul_ps(wdi, di));
+    acc_id = _mm_add_ps(acc_id, _mm_mul_ps(wdi, dd));
+    acc_dd = _mm_add_ps(acc_dd, _mm_mul_ps(_mm_mul_ps(wk, dd), dd));
+  }
+
+  // horizontal sums
+  __m128 sum = _mm_hadd_ps(_mm_hadd_ps(acc_ii, acc_id), _mm_hadd_ps(acc_dd, acc_dd));
+
+  EIGEN_ALIGN16 float tmp[4];
+  _mm_store_ps(tmp, sum);
+
+  float s_ii = tmp[0], s_id = tmp[1], s_dd = tmp[2];
+
+  for(size_t k = n4; k < n; ++k)
+  {
+    float di = ri[k] - mean(0), dd = rd[k] - mean(1);
+
+    s_ii += w[k] * di * di;
+    s_id += w[k] * di * dd;
+    s_dd += w[k] * dd * dd;
+  }
+
+  float scale = 1.0f / (n - 2 -1);
+
+  Eigen::Matrix2f covariance;
+  covariance(0, 0) = scale * s_ii;
+  covariance(0, 1) = scale * s_id;
+  covariance(1, 0) = scale * s_id;
+  covariance(1, 1) = scale * s_dd;
+
+  return covariance;
+}
+
+void computeWeightsSoaSse(const PointWithIntensityAndDepthSoa& points_error, const WeightIterator& first_weight, const Eigen::Vector2f& mean, const Eigen::Matrix2f& precision)
+{
+  const float *ri = points_error.channel(Soa::Intensity), *rd = points_error.channel(Soa::Depth);
+  float *w = &(*first_weight);
+  const size_t n = points_error.size(), n4 = n - (n % 4);
+
+  const float p00 = precision(0, 0), p01 = precision(0, 1) + precision(1, 0), p11 = precision(1, 1);
+
+  const __m128 mean_i = _mm_set1_ps(mean(0)), mean_d = _mm_set1_ps(mean(1));
+  const __m128 prec_00 = _mm_set1_ps(p00), prec_01 = _mm_set1_ps(p01), prec_11 = _mm_set1_ps(p11);
+  const __m128 five = _mm_set1_ps(5.0f);
+  const __m128 seven = _mm_set1_ps(7.0f);
+
+  for(size_t k = 0; k < n4; k += 4)
+  {
+    __m128 di = _mm_sub_ps(_mm_load_ps(ri + k), mean_i);
+    __m128 dd = _mm_sub_ps(_mm_load_ps(rd + k), mean_d);
+
+    // mahalanobis distance
+    __m128 dist = _mm_add_ps(
+        _mm_mul_ps(di, _mm_add_ps(_mm_mul_ps(prec_00, di), _mm_mul_ps(prec_01, dd))),
+        _mm_mul_ps(prec_11, _mm_mul_ps(dd, dd))
+    );
+
+    _mm_storeu_ps(w + k, _mm_mul_ps(seven, _mm_rcp_ps(_mm_add_ps(five, dist))));
+  }
+
+  for(size_t k = n4; k < n; ++k)
+  {
+    float di = ri[k] - mean(0), dd = rd[k] - mean(1);
+
+    w[k] = (2.0f + 5.0f) / (5.0f + p00 * di * di + p01 * di * dd + p11 * dd * dd);
+  }
+}
+
+} /* namespace core */
+} /* namespace dvo */
@@ -0,0 +1,379 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * ROS-free micro-benchmark of the tracking kernels. Runs on a synthetic frame pair or on two recorded frames:
+ *
+ *   kernel_benchmark [-n repetitions] [-s depth_scale] [rgb0 depth0 rgb1 depth1]
+ *
+ * Recorded frames are 8 bit color or mono images and 16 bit depth images in the TUM RGB-D format, by default
+ * 1 / 5000 metre per unit. Reports the median time per call, ns per point (or pixel) and calls per second.
+ */
+
+#include <dvo/dense_tracking.h>
+#include <dvo/dense_tracking_impl.h>
+#include <dvo/core/math_sse.h>
+#include <dvo/util/instrumentation.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+using namespace dvo;
+using namespace dvo::core;
+using namespace dvo::util;
+
+static const int NumLevels = 4;
+
+static int repetitions = 100;
+
+static void printHeader()
+{
+  std::cout
+    << std::left << std::setw(24) << "kernel"
+    << std::right << std::setw(6) << "level"
+    << std::setw(10) << "points"
+    << std::setw(12) << "p50 [us]"
+    << std::setw(12) << "p99 [us]"
+    << std::setw(12) << "ns/point"
+    << std::setw(12) << "calls/s"
+    << std::endl;
+}
+
+template<typename Function>
+static void run(const std::string& name, int level, size_t points, Function f)
+{
+  Timer timer(name);
+
+  // warm up caches and lazily initialized state
+  for(int idx = 0; idx < std::max(1, repetitions / 10); ++idx)
+    f();
+
+  for(int idx = 0; idx < repetitions; ++idx)
+  {
+    ScopedTimer scope(timer);
+    f();
+  }
+
+  TimerSummary s;
+  timer.summarize(s);
+
+  std::cout
+    << std::left << std::setw(24) << name
+    << std::right << std::setw(6) << level
+    << std::setw(10) << points
+    << std::fixed << std::setprecision(1)
+    << std::setw(12) << s.P50 * 1e6
+    << std::setw(12) << s.P99 * 1e6
+    << std::setprecision(2)
+    << std::setw(12) << (points > 0 ? s.P50 * 1e9 / points : 0.0)
+    << std::setprecision(1)
+    << std::setw(12) << (s.P50 > 0.0 ? 1.0 / s.P50 : 0.0)
+    << std::endl;
+}
+
+// smooth texture and a slanted plane with some steps, so every level has gradients and depth edges
+static void createSyntheticFrame(int width, int height, float shift, cv::Mat& color, cv::Mat& depth)
+{
+  color.create(height, width, CV_8UC1);
+  depth.create(height, width, CV_16UC1);
+
+  for(int y = 0; y < height; ++y)
+  {
+    uint8_t* c = color.ptr<uint8_t>(y);
+    uint16_t* d = depth.ptr<uint16_t>(y);
+
+    for(int x = 0; x < width; ++x)
+    {
+      const float u = x + shift;
+      const float i = 127.5f + 60.0f * std::sin(u * 0.11f) * std::cos(y * 0.07f) + 40.0f * std::sin((u + y) * 0.031f);
+      const float z = 1.5f + 0.001f * u + 0.0005f * y + ((int(u) / 80 + y / 60) % 2) * 0.2f;
+
+      c[x] = uint8_t(std::min(255.0f, std::max(0.0f, i)));
+      // some holes like in real depth images
+      d[x] = ((x * 7 + y * 13) % 97 == 0) ? 0 : uint16_t(z * 5000.0f);
+    }
+  }
+}
+
+struct BuildPyramid
+{
+  RgbdCameraPyramid& camera;
+  const cv::Mat &color, &depth;
+  float depth_scale;
+
+  void operator()() const
+  {
+    RgbdImagePyramidPtr pyramid = camera.create(color, depth, depth_scale, false);
+    pyramid->build(NumLevels);
+  }
+};
+
+struct BuildAccelerationStructure
+{
+  RgbdImage& image;
+
+  void operator()() const
+  {
+    // resets the lazy build flag
+    image.initialize();
+    image.buildAccelerationStructure();
+  }
+};
+
+struct ComputeResiduals
+{
+  PointIterator first_point, last_point;
+  const RgbdImage& current;
+  const IntrinsicMatrix& intrinsics;
+  const Eigen::Affine3f& transform;
+  const Vector8f &wref, &wcur;
+  ComputeResidualsResult& result;
+
+  void operator()() const
+  {
+    computeResidualsSse(first_point, last_point, current, intrinsics, transform, wref, wcur, result);
+  }
+};
+
+struct ComputeWeights
+{
+  const ComputeResidualsResult& result;
+  WeightIterator first_weight;
+  const Eigen::Vector2f& mean;
+  const Eigen::Matrix2f& precision;
+
+  void operator()() const
+  {
+    computeWeightsSse(result.first_residual, result.last_residual, first_weight, mean, precision);
+  }
+};
+
+struct ComputeScale
+{
+  const ComputeResidualsResult& result;
+  WeightIterator first_weight;
+  const Eigen::Vector2f& mean;
+
+  void operator()() const
+  {
+    volatile float s = computeScaleSse(result.first_residual, result.last_residual, first_weight, mean)(0, 0);
+    (void)s;
+  }
+};
+
+struct RankUpdate
+{
+  const std::vector<Eigen::Matrix<float, 2, 6>, Eigen::aligned_allocator<Eigen::Matrix<float, 2, 6> > >& jacobians;
+  const Eigen::Matrix2f& alpha;
+
+  void operator()() const
+  {
+    OptimizedSelfAdjointMatrix6x6f A;
+    A.setZero();
+
+    for(size_t idx = 0; idx < jacobians.size(); ++idx)
+      A.rankUpdate(jacobians[idx], alpha);
+
+    Eigen::Matrix<float, 6, 6> result;
+    A.toEigen(result);
+
+    volatile float s = result(0, 0);
+    (void)s;
+  }
+};
+
+struct Match
+{
+  DenseTracker& tracker;
+  PointSelection& reference;
+  RgbdImagePyramid& current;
+  DenseTracker::Result& result;
+
+  void operator()() const
+  {
+    result.Transformation.setIdentity();
+    tracker.match(reference, current, result);
+  }
+};
+
+static void usage(const char* name)
+{
+  std::cerr << "usage: " << name << " [-n repetitions] [-s depth_scale] [rgb0 depth0 rgb1 depth1]" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+  float depth_scale = 1.0f / 5000.0f;
+  std::vector<std::string> files;
+
+  for(int idx = 1; idx < argc; ++idx)
+  {
+    if(std::strcmp(argv[idx], "-n") == 0 && idx + 1 < argc)
+      repetitions = std::max(1, std::atoi(argv[++idx]));
+    else if(std::strcmp(argv[idx], "-s") == 0 && idx + 1 < argc)
+      depth_scale = float(std::atof(argv[++idx]));
+    else if(argv[idx][0] == '-')
+    {
+      usage(argv[0]);
+      return 1;
+    }
+    else
+      files.push_back(argv[idx]);
+  }
+
+  cv::Mat color[2], depth[2];
+
+  if(files.empty())
+  {
+    createSyntheticFrame(640, 480, 0.0f, color[0], depth[0]);
+    createSyntheticFrame(640, 480, 1.5f, color[1], depth[1]);
+  }
+  else if(files.size() == 4)
+  {
+    for(int idx = 0; idx < 2; ++idx)
+    {
+      color[idx] = cv::imread(files[2 * idx + 0], -1);
+      depth[idx] = cv::imread(files[2 * idx + 1], -1);
+
+      if(color[idx].empty() || depth[idx].type() != CV_16UC1 || color[idx].size() != depth[idx].size())
+      {
+        std::cerr << "can't read '" << files[2 * idx + 0] << "' and '" << files[2 * idx + 1] << "' as 8 bit color and 16 bit depth image of the same size" << std::endl;
+        return 1;
+      }
+    }
+  }
+  else
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  std::cout << (files.empty() ? "synthetic" : "recorded") << " frames " << color[0].cols << "x" << color[0].rows << ", " << repetitions << " repetitions, residual kernel " << getResidualKernelName() << std::endl << std::endl;
+
+  // TUM fr1 intrinsics, good enough for synthetic frames
+  IntrinsicMatrix intrinsics = IntrinsicMatrix::create(517.3f * color[0].cols / 640.0f, 516.5f * color[0].rows / 480.0f, 318.6f * color[0].cols / 640.0f, 255.3f * color[0].rows / 480.0f);
+
+  RgbdCameraPyramid camera(color[0].cols, color[0].rows, intrinsics);
+  camera.build(NumLevels);
+  camera.setPoolSize(4);
+
+  printHeader();
+
+  BuildPyramid build = { camera, color[0], depth[0], depth_scale };
+  run("pyramid build", 0, color[0].total(), build);
+
+  RgbdImagePyramidPtr reference = camera.create(color[0], depth[0], depth_scale, false);
+  RgbdImagePyramidPtr current = camera.create(color[1], depth[1], depth_scale, false);
+  reference->build(NumLevels);
+  current->build(NumLevels);
+
+  DenseTracker::Config cfg = DenseTracker::getDefaultConfig();
+
+  ValidPointAndGradientThresholdPredicate predicate;
+  predicate.intensity_threshold = cfg.IntensityDerivativeThreshold;
+  predicate.depth_threshold = cfg.DepthDerivativeThreshold;
+
+  PointSelection selection(*reference, predicate);
+
+  Eigen::Affine3f transform = Eigen::Affine3f::Identity();
+  transform.translation() << 0.002f, -0.001f, 0.003f;
+
+  const Eigen::Vector2f mean = Eigen::Vector2f::Zero();
+  Eigen::Matrix2f precision;
+  precision << 0.01f, 0.0f, 0.0f, 0.001f;
+
+  for(int level = NumLevels - 1; level >= 0; --level)
+  {
+    RgbdImage& cur = current->level(level);
+    const IntrinsicMatrix& K = cur.camera().intrinsics();
+
+    BuildAccelerationStructure accel = { cur };
+    run("buildAccelerationStructure", level, cur.width * cur.height, accel);
+
+    PointSelection::PointIterator first_point, last_point;
+    selection.select(level, K, first_point, last_point);
+
+    const size_t n = last_point - first_point;
+
+    Vector8f wcur, wref;
+    wcur <<  1.0f / 255.0f,  1.0f, 0.5f * K.fx() / 255.0f, 0.5f * K.fy() / 255.0f, K.fx(), K.fy(), 0.0f, 0.0f;
+    wref << -1.0f / 255.0f, -1.0f, 0.5f * K.fx() / 255.0f, 0.5f * K.fy() / 255.0f, 0.0f, 0.0f, 0.0f, 0.0f;
+
+    PointWithIntensityAndDepth::VectorType points_error(n);
+    DenseTracker::ResidualVectorType residuals(n);
+    DenseTracker::WeightVectorType weights(n);
+    std::vector<uint8_t> valid_flags(n);
+
+    ComputeResidualsResult result;
+    result.first_point_error = points_error.begin();
+    result.first_residual = residuals.begin();
+    result.first_valid_flag = valid_flags.begin();
+
+    ComputeResiduals residual_kernel = { first_point, last_point, cur, K, transform, wref, wcur, result };
+    run("computeResidualsSse", level, n, residual_kernel);
+
+    const size_t valid = result.last_residual - result.first_residual;
+
+    ComputeWeights weight_kernel = { result, weights.begin(), mean, precision };
+    run("computeWeightsSse", level, valid, weight_kernel);
+
+    ComputeScale scale_kernel = { result, weights.begin(), mean };
+    run("computeScaleSse", level, valid, scale_kernel);
+
+    std::vector<Eigen::Matrix<float, 2, 6>, Eigen::aligned_allocator<Eigen::Matrix<float, 2, 6> > > jacobians(valid);
+
+    for(size_t idx = 0; idx < valid; ++idx)
+      jacobians[idx].setRandom();
+
+    RankUpdate rank_update = { jacobians, precision };
+    run("rankUpdate", level, valid, rank_update);
+  }
+
+  std::cout << std::endl;
+  printHeader();
+
+  DenseTracker::Result match_result;
+
+  for(int level = NumLevels - 1; level >= 0; --level)
+  {
+    DenseTracker::Config level_cfg = cfg;
+    level_cfg.FirstLevel = level;
+    level_cfg.LastLevel = level;
+
+    DenseTracker tracker(level_cfg);
+    Match match = { tracker, selection, *current, match_result };
+    run("match (single level)", level, reference->level(level).width * reference->level(level).height, match);
+  }
+
+  // only the full match in the breakdown
+  Instrumentation::instance().reset();
+
+  DenseTracker tracker(cfg);
+  Match match = { tracker, selection, *current, match_result };
+  run("match", cfg.LastLevel, reference->level(cfg.LastLevel).width * reference->level(cfg.LastLevel).height, match);
+
+  std::cout << std::endl << "match breakdown:" << std::endl;
+  Instrumentation::instance().print(std::cout);
+
+  return 0;
+}
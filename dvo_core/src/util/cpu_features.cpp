@@ -0,0 +1,124 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo/util/cpu_features.h>
+
+#include <cpuid.h>
+
+#include <cstdlib>
+#include <string>
+
+namespace dvo
+{
+namespace util
+{
+
+static void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4])
+{
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+}
+
+// checks whether the OS saves the given XCR0 state components on context switch
+static bool isOsSavingState(unsigned int components)
+{
+  unsigned int eax, edx;
+  __asm__ __volatile__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+
+  return (eax & components) == components;
+}
+
+// the widest instruction set DVO_SIMD allows, 0 = sse, 1 = avx2, 2 = avx512
+static int allowedSimd()
+{
+  const char* requested = std::getenv("DVO_SIMD");
+  const std::string simd(requested != 0 ? requested : "");
+
+  if(simd == "sse") return 0;
+  if(simd == "avx" || simd == "avx2") return 1;
+
+  return 2;
+}
+
+static bool detectAvx()
+{
+  unsigned int regs[4];
+  cpuid(1, 0, regs);
+
+  const bool osxsave = (regs[2] & bit_OSXSAVE) != 0, avx = (regs[2] & bit_AVX) != 0;
+  return osxsave && avx && isOsSavingState(0x06);
+}
+
+static bool detectF16c()
+{
+  unsigned int regs[4];
+  cpuid(1, 0, regs);
+
+  return (regs[2] & bit_F16C) != 0 && detectAvx();
+}
+
+static bool detectAvx2()
+{
+  unsigned int regs[4];
+  cpuid(0, 0, regs);
+  if(regs[0] < 7) return false;
+
+  cpuid(1, 0, regs);
+  const bool fma = (regs[2] & bit_FMA) != 0;
+  if(!fma || !detectAvx()) return false;
+
+  cpuid(7, 0, regs);
+  return (regs[1] & bit_AVX2) != 0;
+}
+
+static bool detectAvx512()
+{
+  if(!detectAvx2() || !isOsSavingState(0xe6)) return false;
+
+  unsigned int regs[4];
+  cpuid(7, 0, regs);
+  return (regs[1] & (1u << 16)) != 0; // AVX512F
+}
+
+bool hasAvx()
+{
+  static const bool result = allowedSimd() >= 1 && detectAvx();
+  return result;
+}
+
+bool hasF16c()
+{
+  static const bool result = allowedSimd() >= 1 && detectF16c();
+  return result;
+}
+
+bool hasAvx2()
+{
+  static const bool result = allowedSimd() >= 1 && detectAvx2();
+  return result;
+}
+
+bool hasAvx512()
+{
+  static const bool result = allowedSimd() >= 2 && detectAvx512();
+  return result;
+}
+
+} /* namespace util */
+} /* namespace dvo */
@@ -0,0 +1,281 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo/util/instrumentation.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+#include <opencv2/opencv.hpp>
+
+namespace dvo
+{
+namespace util
+{
+
+// bins with 8 steps per octave, starting at 100ns
+static const double SmallestBinTime = 1e-7;
+static const double BinsPerOctave = 8.0;
+
+Timer::Timer(const std::string& name) :
+    name_(name)
+{
+  resetAll();
+}
+
+Timer::~Timer()
+{
+}
+
+const std::string& Timer::name() const
+{
+  return name_;
+}
+
+void Timer::record(double seconds)
+{
+  const size_t b = bin(seconds);
+
+  tbb::spin_mutex::scoped_lock l(stats_mutex_);
+
+  count_++;
+  total_ += seconds;
+  min_ = std::min(min_, seconds);
+  max_ = std::max(max_, seconds);
+  bins_[b]++;
+}
+
+Timer& Timer::child(const std::string& name)
+{
+  tbb::spin_mutex::scoped_lock l(children_mutex_);
+
+  boost::shared_ptr<Timer>& c = children_[name];
+
+  if(!c)
+  {
+    c.reset(new Timer(name_.empty() ? name : name_ + "/" + name));
+  }
+
+  return *c;
+}
+
+Timer& Timer::child(size_t index)
+{
+  {
+    tbb::spin_mutex::scoped_lock l(children_mutex_);
+
+    if(index < indexed_children_.size() && indexed_children_[index] != 0) return *indexed_children_[index];
+  }
+
+  std::stringstream ss;
+  ss << index;
+
+  Timer& c = child(ss.str());
+
+  tbb::spin_mutex::scoped_lock l(children_mutex_);
+
+  if(index >= indexed_children_.size()) indexed_children_.resize(index + 1, 0);
+  indexed_children_[index] = &c;
+
+  return c;
+}
+
+void Timer::summarize(TimerSummary& summary) const
+{
+  tbb::spin_mutex::scoped_lock l(stats_mutex_);
+
+  summary.Name = name_;
+  summary.Count = count_;
+  summary.Total = total_;
+  summary.Mean = count_ > 0 ? total_ / count_ : 0.0;
+  summary.Min = count_ > 0 ? min_ : 0.0;
+  summary.Max = max_;
+  summary.P50 = percentile(0.5);
+  summary.P90 = percentile(0.9);
+  summary.P99 = percentile(0.99);
+}
+
+void Timer::summarizeAll(std::vector<TimerSummary>& summaries) const
+{
+  TimerSummary summary;
+  summarize(summary);
+
+  if(summary.Count > 0) summaries.push_back(summary);
+
+  tbb::spin_mutex::scoped_lock l(children_mutex_);
+
+  for(std::map<std::string, boost::shared_ptr<Timer> >::const_iterator it = children_.begin(); it != children_.end(); ++it)
+  {
+    it->second->summarizeAll(summaries);
+  }
+}
+
+void Timer::resetAll()
+{
+  {
+    tbb::spin_mutex::scoped_lock l(stats_mutex_);
+
+    count_ = 0;
+    total_ = 0.0;
+    min_ = std::numeric_limits<double>::max();
+    max_ = 0.0;
+    std::fill(bins_, bins_ + NumBins, 0);
+  }
+
+  tbb::spin_mutex::scoped_lock l(children_mutex_);
+
+  for(std::map<std::string, boost::shared_ptr<Timer> >::iterator it = children_.begin(); it != children_.end(); ++it)
+  {
+    it->second->resetAll();
+  }
+}
+
+int64_t Timer::now()
+{
+  return cv::getTickCount();
+}
+
+double Timer::seconds(int64_t ticks)
+{
+  static const double period = 1.0 / cv::getTickFrequency();
+
+  return ticks * period;
+}
+
+size_t Timer::bin(double seconds)
+{
+  if(!(seconds > SmallestBinTime)) return 0;
+
+  double b = std::log(seconds / SmallestBinTime) / std::log(2.0) * BinsPerOctave;
+
+  return std::min(size_t(b), NumBins - 1);
+}
+
+double Timer::binCenter(size_t bin)
+{
+  return SmallestBinTime * std::pow(2.0, (bin + 0.5) / BinsPerOctave);
+}
+
+double Timer::percentile(double p) const
+{
+  if(count_ == 0) return 0.0;
+
+  const double rank = p * count_;
+  double acc = 0.0;
+
+  for(size_t idx = 0; idx < NumBins; ++idx)
+  {
+    acc += bins_[idx];
+
+    if(acc >= rank) return std::max(min_, std::min(max_, binCenter(idx)));
+  }
+
+  return max_;
+}
+
+Instrumentation& Instrumentation::instance()
+{
+  static Instrumentation instance;
+
+  return instance;
+}
+
+Instrumentation::Instrumentation() :
+    root_("")
+{
+}
+
+Timer& Instrumentation::root()
+{
+  return root_;
+}
+
+Timer& Instrumentation::timer(const std::string& path)
+{
+  Timer* t = &root_;
+  size_t begin = 0;
+
+  while(begin < path.size())
+  {
+    size_t end = path.find('/', begin);
+    if(end == std::string::npos) end = path.size();
+
+    if(end > begin) t = &t->child(path.substr(begin, end - begin));
+
+    begin = end + 1;
+  }
+
+  return *t;
+}
+
+void Instrumentation::summarize(std::vector<TimerSummary>& summaries) const
+{
+  root_.summarizeAll(summaries);
+}
+
+void Instrumentation::reset()
+{
+  root_.resetAll();
+}
+
+void Instrumentation::print(std::ostream& out) const
+{
+  std::vector<TimerSummary> summaries;
+  summarize(summaries);
+
+  for(std::vector<TimerSummary>::const_iterator it = summaries.begin(); it != summaries.end(); ++it)
+  {
+    out
+      << it->Name << ": count = " << it->Count
+      << ", mean = " << it->Mean
+      << ", p50 = " << it->P50
+      << ", p90 = " << it->P90
+      << ", p99 = " << it->P99
+      << ", max = " << it->Max
+      << std::endl;
+  }
+}
+
+bool Instrumentation::write(const std::string& file) const
+{
+  std::ofstream out(file.c_str());
+
+  if(!out.good()) return false;
+
+  std::vector<TimerSummary> summaries;
+  summarize(summaries);
+
+  out << "name,count,total,mean,min,max,p50,p90,p99" << std::endl;
+  out << std::setprecision(9);
+
+  for(std::vector<TimerSummary>::const_iterator it = summaries.begin(); it != summaries.end(); ++it)
+  {
+    out << it->Name << "," << it->Count << "," << it->Total << "," << it->Mean << "," << it->Min << "," << it->Max << "," << it->P50 << "," << it->P90 << "," << it->P99 << std::endl;
+  }
+
+  return out.good();
+}
+
+} /* namespace util */
+} /* namespace dvo */
@@ -0,0 +1,256 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// the arena observers are a preview feature on some TBB versions
+#define TBB_PREVIEW_LOCAL_OBSERVER 1
+
+#include <dvo/util/task_arenas.h>
+
+#include <tbb/task_scheduler_observer.h>
+#include <tbb/enumerable_thread_specific.h>
+
+// oneTBB moved the version macros out of the other headers
+#ifdef __has_include
+#if __has_include(<tbb/version.h>)
+#include <tbb/version.h>
+#endif
+#endif
+
+// task arenas appeared in TBB 4.2, observers local to an arena in 4.3
+#if TBB_INTERFACE_VERSION >= 7000
+#define DVO_TBB_TASK_ARENA
+#include <tbb/task_arena.h>
+#else
+#include <tbb/task.h>
+#endif
+
+#if TBB_INTERFACE_VERSION >= 8000
+#define DVO_TBB_LOCAL_OBSERVER
+#endif
+
+#include <boost/scoped_ptr.hpp>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+namespace dvo
+{
+namespace util
+{
+
+namespace internal
+{
+
+#ifdef DVO_TBB_LOCAL_OBSERVER
+
+// pins the workers while they are in the arena, they return to the global scheduler with their previous affinity
+class PinningObserver : public tbb::task_scheduler_observer
+{
+public:
+  PinningObserver(tbb::task_arena& arena, int first_core, int num_cores) :
+    tbb::task_scheduler_observer(arena),
+    first_core_(first_core),
+    num_cores_(num_cores)
+  {
+    observe(true);
+  }
+
+  virtual ~PinningObserver()
+  {
+    observe(false);
+  }
+
+  virtual void on_scheduler_entry(bool is_worker)
+  {
+    if(!is_worker) return;
+
+    const long available = sysconf(_SC_NPROCESSORS_ONLN);
+
+    cpu_set_t cores;
+    CPU_ZERO(&cores);
+
+    for(int idx = 0; idx < num_cores_; ++idx)
+    {
+      CPU_SET(int((first_core_ + idx) % available), &cores);
+    }
+
+    SavedAffinity& saved = saved_.local();
+    saved.valid = pthread_getaffinity_np(pthread_self(), sizeof(saved.cores), &saved.cores) == 0;
+
+    pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores);
+  }
+
+  virtual void on_scheduler_exit(bool is_worker)
+  {
+    if(!is_worker) return;
+
+    SavedAffinity& saved = saved_.local();
+
+    if(saved.valid) pthread_setaffinity_np(pthread_self(), sizeof(saved.cores), &saved.cores);
+
+    saved.valid = false;
+  }
+private:
+  struct SavedAffinity
+  {
+    SavedAffinity() : valid(false) {}
+
+    cpu_set_t cores;
+    bool valid;
+  };
+
+  int first_core_, num_cores_;
+  tbb::enumerable_thread_specific<SavedAffinity> saved_;
+};
+
+#endif
+
+#ifndef DVO_TBB_TASK_ARENA
+
+// runs the function of an enqueued task, the fallback without arenas
+class FunctionTask : public tbb::task
+{
+public:
+  FunctionTask(const boost::function<void()>& f) :
+    f_(f)
+  {
+  }
+
+  virtual tbb::task* execute()
+  {
+    f_();
+
+    return NULL;
+  }
+private:
+  boost::function<void()> f_;
+};
+
+#endif
+
+} /* namespace internal */
+
+struct TaskArenas::Arena
+{
+#ifdef DVO_TBB_TASK_ARENA
+  tbb::task_arena arena;
+#endif
+
+#ifdef DVO_TBB_LOCAL_OBSERVER
+  // declared after the arena, stops observing before the arena goes away
+  boost::scoped_ptr<internal::PinningObserver> observer;
+#endif
+
+  // the visualization only enqueues work, a slot reserved for a submitting thread would never be used
+  Arena(int concurrency, int first_core, bool reserve_caller)
+#ifdef DVO_TBB_TASK_ARENA
+    : arena(concurrency, reserve_caller ? 1 : 0)
+#endif
+  {
+#ifdef DVO_TBB_LOCAL_OBSERVER
+    if(first_core >= 0) observer.reset(new internal::PinningObserver(arena, first_core, concurrency));
+#endif
+  }
+};
+
+TaskArenas& TaskArenas::instance()
+{
+  static TaskArenas instance;
+
+  return instance;
+}
+
+TaskArenas::TaskArenas()
+{
+  for(int idx = 0; idx < NumRoles; ++idx)
+  {
+    concurrency_[idx] = 0;
+    first_core_[idx] = -1;
+  }
+}
+
+void TaskArenas::configure(Role role, int concurrency, int first_core)
+{
+  tbb::spin_mutex::scoped_lock l(arenas_mutex_);
+
+  // reconfiguring with the same values must not throw away a warm arena
+  if(concurrency_[role] == concurrency && first_core_[role] == first_core) return;
+
+  concurrency_[role] = concurrency;
+  first_core_[role] = first_core;
+
+#ifdef DVO_TBB_TASK_ARENA
+  if(concurrency > 0)
+    arenas_[role].reset(new Arena(concurrency, first_core, role != Visualization));
+  else
+    arenas_[role].reset();
+#endif
+}
+
+bool TaskArenas::isolated(Role role) const
+{
+  return arena(role).get() != 0;
+}
+
+void TaskArenas::execute(Role role, const boost::function<void()>& f)
+{
+#ifdef DVO_TBB_TASK_ARENA
+  ArenaPtr a = arena(role);
+
+  if(a)
+  {
+    a->arena.execute(f);
+    return;
+  }
+#endif
+
+  f();
+}
+
+void TaskArenas::enqueue(Role role, const boost::function<void()>& f)
+{
+#ifdef DVO_TBB_TASK_ARENA
+  ArenaPtr a = arena(role);
+
+  if(a)
+  {
+    a->arena.enqueue(f);
+    return;
+  }
+
+  // shares the workers of the global scheduler
+  static tbb::task_arena shared(tbb::task_arena::automatic, 0);
+  shared.enqueue(f);
+#else
+  internal::FunctionTask* t = new(tbb::task::allocate_root()) internal::FunctionTask(f);
+  tbb::task::enqueue(*t);
+#endif
+}
+
+TaskArenas::ArenaPtr TaskArenas::arena(Role role) const
+{
+  tbb::spin_mutex::scoped_lock l(arenas_mutex_);
+
+  return arenas_[role];
+}
+
+} /* namespace util */
+} /* namespace dvo */
@@ -0,0 +1,262 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo/util/trace.h>
+#include <dvo/util/instrumentation.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+#include <tbb/enumerable_thread_specific.h>
+
+#include <xmmintrin.h>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace dvo
+{
+namespace util
+{
+
+struct TraceEvent
+{
+  const char* name;
+
+  // 'X' complete, 'i' instant
+  char phase;
+  int64_t begin, end;
+
+  Trace::Arg args[Trace::MaxArgs];
+  size_t num_args;
+};
+
+struct TraceThreadBuffer
+{
+  TraceThreadBuffer() :
+    tid(int(syscall(SYS_gettid)))
+  {
+  }
+
+  int tid;
+  std::vector<TraceEvent> events;
+};
+
+struct Trace::Buffers
+{
+  tbb::enumerable_thread_specific<TraceThreadBuffer> threads;
+};
+
+static void writeString(std::ostream& out, const char* s)
+{
+  out << '"';
+
+  for(; *s != '\0'; ++s)
+  {
+    if(*s == '"' || *s == '\\') out << '\\';
+    out << *s;
+  }
+
+  out << '"';
+}
+
+tbb::atomic<int> Trace::enabled_;
+
+Trace& Trace::instance()
+{
+  static Trace instance;
+
+  return instance;
+}
+
+Trace::Trace() :
+    buffers_(new Buffers()),
+    max_events_(0),
+    origin_(Timer::now())
+{
+  size_ = 0;
+  dropped_ = 0;
+  recording_ = 0;
+}
+
+Trace::~Trace()
+{
+  enabled_ = 0;
+  delete buffers_;
+}
+
+void Trace::start(size_t max_events)
+{
+  enabled_ = 0;
+
+  for(tbb::enumerable_thread_specific<TraceThreadBuffer>::iterator it = buffers_->threads.begin(); it != buffers_->threads.end(); ++it)
+  {
+    std::vector<TraceEvent>().swap(it->events);
+  }
+
+  size_ = 0;
+  dropped_ = 0;
+  max_events_ = max_events;
+  origin_ = Timer::now();
+
+  enabled_ = 1;
+}
+
+void Trace::stop()
+{
+  // full fence, a recorder either sees the flag cleared or is counted by recording_
+  enabled_.fetch_and_store(0);
+
+  while(recording_ != 0) _mm_pause();
+}
+
+// counts the thread as recording while it is in scope, enabled tells whether recording was still enabled afterwards
+class RecordingScope
+{
+public:
+  RecordingScope(tbb::atomic<int>& recording, const tbb::atomic<int>& enabled) :
+    recording_(recording)
+  {
+    recording_.fetch_and_increment();
+    enabled_ = enabled != 0;
+  }
+
+  ~RecordingScope()
+  {
+    recording_.fetch_and_decrement();
+  }
+
+  bool enabled() const
+  {
+    return enabled_;
+  }
+private:
+  tbb::atomic<int>& recording_;
+  bool enabled_;
+};
+
+void Trace::complete(const char* name, int64_t begin, int64_t end)
+{
+  RecordingScope scope(recording_, enabled_);
+
+  if(!scope.enabled()) return;
+
+  if(size_.fetch_and_increment() >= max_events_)
+  {
+    dropped_++;
+    return;
+  }
+
+  TraceEvent e;
+  e.name = name;
+  e.phase = 'X';
+  e.begin = begin;
+  e.end = end;
+  e.num_args = 0;
+
+  buffers_->threads.local().events.push_back(e);
+}
+
+void Trace::instant(const char* name, const Arg* args, size_t num_args)
+{
+  RecordingScope scope(recording_, enabled_);
+
+  if(!scope.enabled()) return;
+
+  if(size_.fetch_and_increment() >= max_events_)
+  {
+    dropped_++;
+    return;
+  }
+
+  TraceEvent e;
+  e.name = name;
+  e.phase = 'i';
+  e.begin = e.end = Timer::now();
+  e.num_args = std::min(num_args, MaxArgs);
+  std::copy(args, args + e.num_args, e.args);
+
+  buffers_->threads.local().events.push_back(e);
+}
+
+size_t Trace::size() const
+{
+  return std::min(size_t(size_), max_events_);
+}
+
+size_t Trace::dropped() const
+{
+  return dropped_;
+}
+
+bool Trace::write(const std::string& file) const
+{
+  std::ofstream out(file.c_str());
+
+  if(!out.good()) return false;
+
+  const int pid = int(getpid());
+  bool first = true;
+
+  out << "{\"traceEvents\":[" << std::endl;
+  out << std::fixed << std::setprecision(3);
+
+  for(tbb::enumerable_thread_specific<TraceThreadBuffer>::const_iterator it = buffers_->threads.begin(); it != buffers_->threads.end(); ++it)
+  {
+    for(std::vector<TraceEvent>::const_iterator e = it->events.begin(); e != it->events.end(); ++e)
+    {
+      if(!first) out << "," << std::endl;
+      first = false;
+
+      out << "{\"name\":";
+      writeString(out, e->name);
+      out << ",\"ph\":\"" << e->phase << "\",\"pid\":" << pid << ",\"tid\":" << it->tid << ",\"ts\":" << Timer::seconds(e->begin - origin_) * 1e6;
+
+      if(e->phase == 'X') out << ",\"dur\":" << Timer::seconds(e->end - e->begin) * 1e6;
+
+      if(e->phase == 'i') out << ",\"s\":\"t\"";
+
+      if(e->num_args > 0)
+      {
+        out << ",\"args\":{";
+
+        for(size_t idx = 0; idx < e->num_args; ++idx)
+        {
+          if(idx > 0) out << ",";
+          writeString(out, e->args[idx].name);
+          out << ":" << e->args[idx].value;
+        }
+
+        out << "}";
+      }
+
+      out << "}";
+    }
+  }
+
+  out << std::endl << "]}" << std::endl;
+
+  return out.good();
+}
+
+} /* namespace util */
+} /* namespace dvo */
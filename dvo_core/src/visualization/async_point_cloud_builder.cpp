@@ -20,98 +20,191 @@
 
 #include <dvo/visualization/async_point_cloud_builder.h>
 
-#include <tbb/task_scheduler_init.h>
-#include <tbb/task.h>
+#include <algorithm>
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#include <tbb/spin_mutex.h>
+
+#include <dvo/util/task_arenas.h>
+
+#include <xmmintrin.h>
 
 namespace dvo
 {
 namespace visualization
 {
 
-class BuildPointCloudTask : public tbb::task
+// runs in the visualization arena, so building clouds doesn't compete with the tracking
+class BuildPointCloudTask
 {
 public:
   BuildPointCloudTask(const dvo::core::RgbdImage& image, const Eigen::Affine3d& pose, AsyncPointCloudBuilder::DoneCallback& callback) :
-    job_(image, pose),
-    callback_(callback)
+    job_(new AsyncPointCloudBuilder::BuildJob(image, pose)),
+    callback_(&callback)
   {
   }
 
-  virtual ~BuildPointCloudTask()
+  void operator()() const
   {
-  }
-
-  virtual tbb::task* execute()
-  {
-    callback_(job_.build());
-
-    return NULL;
+    (*callback_)(job_->build());
   }
 private:
-  AsyncPointCloudBuilder::BuildJob job_;
-  AsyncPointCloudBuilder::DoneCallback& callback_;
+  boost::shared_ptr<AsyncPointCloudBuilder::BuildJob> job_;
+  AsyncPointCloudBuilder::DoneCallback* callback_;
 };
 
-AsyncPointCloudBuilder::BuildJob::BuildJob(const dvo::core::RgbdImage& image, const Eigen::Affine3d pose) :
-  image(image),
-  pose(pose)
+namespace internal
 {
-}
 
-AsyncPointCloudBuilder::PointCloud::Ptr AsyncPointCloudBuilder::BuildJob::build()
+/**
+ * Recycles the buffers of built clouds, so a new cloud doesn't allocate and fault in its memory again. Never
+ * destroyed, clouds may be released after the static destructors ran.
+ */
+class PointCloudPool
 {
-  if(!cloud_)
+public:
+  static PointCloudPool& instance()
   {
-    image.buildPointCloud();
-    dvo::core::RgbdImage::PointCloud pointcloud = pose.cast<float>() * image.pointcloud;
+    static PointCloudPool* pool = new PointCloudPool();
 
-    cloud_.reset(new AsyncPointCloudBuilder::PointCloud());
-    cloud_->reserve(image.width * image.height);
+    return *pool;
+  }
+
+  AsyncPointCloudBuilder::PointCloud::Ptr acquire()
+  {
+    AsyncPointCloudBuilder::PointCloud* cloud = 0;
 
-    const float* intensity_ptr;
-    if(image.hasRgb())
     {
-      intensity_ptr = image.rgb.ptr<float>();
+      tbb::spin_mutex::scoped_lock l(mutex_);
+
+      if(!free_.empty())
+      {
+        cloud = free_.back();
+        free_.pop_back();
+      }
     }
-    else
+
+    if(cloud == 0) cloud = new AsyncPointCloudBuilder::PointCloud();
+
+    return AsyncPointCloudBuilder::PointCloud::Ptr(cloud, boost::bind(&PointCloudPool::release, this, _1));
+  }
+private:
+  // about the clouds of a few images in flight, the keyframe clouds are held by their build jobs anyway
+  static const size_t MaxSize = 8;
+
+  tbb::spin_mutex mutex_;
+  std::vector<AsyncPointCloudBuilder::PointCloud*> free_;
+
+  void release(AsyncPointCloudBuilder::PointCloud* cloud)
+  {
+    cloud->points.clear();
+    cloud->width = 0;
+    cloud->height = 0;
+
     {
-      intensity_ptr = image.intensity.ptr<float>();
+      tbb::spin_mutex::scoped_lock l(mutex_);
+
+      if(free_.size() < MaxSize)
+      {
+        free_.push_back(cloud);
+        return;
+      }
     }
 
-    int step = image.hasRgb() ? 3 : 1;
+    delete cloud;
+  }
+};
 
-    AsyncPointCloudBuilder::PointCloud::PointType p;
+// transforms and packs the points of every stride-th pixel, the color layout is fixed per call
+template<bool Rgb>
+static void buildPointCloud(const dvo::core::RgbdImage& image, const Eigen::Affine3d& pose, int stride, AsyncPointCloudBuilder::PointCloud::VectorType& points)
+{
+  const Eigen::Matrix4f m = pose.matrix().cast<float>();
 
-    for(int idx = 0; idx < image.width * image.height; ++idx, intensity_ptr += step)
+  // columns of the transformation, the homogeneous coordinate of the points is 1
+  const __m128 c0 = _mm_loadu_ps(m.data() + 0);
+  const __m128 c1 = _mm_loadu_ps(m.data() + 4);
+  const __m128 c2 = _mm_loadu_ps(m.data() + 8);
+  const __m128 c3 = _mm_loadu_ps(m.data() + 12);
+
+  const float* color_base = Rgb ? image.rgb.ptr<float>() : image.intensity.ptr<float>();
+  const int channels = Rgb ? 3 : 1;
+
+  AsyncPointCloudBuilder::PointCloud::PointType p;
+
+  for(int y = 0; y < image.height; y += stride)
+  {
+    for(int x = 0; x < image.width; x += stride)
     {
-      const Eigen::Matrix<float, 4, 1>& col = pointcloud.col(idx);
+      const int idx = y * image.width + x;
+      const float* pt = image.pointcloud.col(idx).data();
 
-      //if(!std::isfinite(col(2)) || image.pointcloud.col(idx)(2) > 2.0) continue;
+      // catches NaN as well
+      if(!(pt[2] > 0.0f)) continue;
 
-      p.x = col(0);
-      p.y = col(1);
-      p.z = col(2);
+      __m128 v = _mm_add_ps(c3, _mm_mul_ps(c0, _mm_set1_ps(pt[0])));
+      v = _mm_add_ps(v, _mm_mul_ps(c1, _mm_set1_ps(pt[1])));
+      v = _mm_add_ps(v, _mm_mul_ps(c2, _mm_set1_ps(pt[2])));
 
-      if(image.hasRgb())
+      // x, y, z and the padding, which is 1 as well
+      _mm_storeu_ps(p.data, v);
+
+      const float* color = color_base + idx * channels;
+
+      if(Rgb)
       {
-          p.b = intensity_ptr[0];
-          p.g = intensity_ptr[1];
-          p.r = intensity_ptr[2];
+        p.b = color[0];
+        p.g = color[1];
+        p.r = color[2];
       }
       else
       {
-          p.r = p.g = p.b = *intensity_ptr;
+        p.r = p.g = p.b = color[0];
       }
 
-      cloud_->push_back(p);
+      points.push_back(p);
     }
   }
+}
+
+} /* namespace internal */
+
+AsyncPointCloudBuilder::BuildJob::BuildJob(const dvo::core::RgbdImage& image, const Eigen::Affine3d pose, int stride) :
+  image(image),
+  pose(pose),
+  stride(std::max(stride, 1))
+{
+}
+
+AsyncPointCloudBuilder::PointCloud::Ptr AsyncPointCloudBuilder::BuildJob::build()
+{
+  if(!cloud_)
+  {
+    image.buildPointCloud();
+
+    cloud_ = internal::PointCloudPool::instance().acquire();
+    cloud_->points.reserve(((image.width + stride - 1) / stride) * ((image.height + stride - 1) / stride));
+
+    if(image.hasRgb())
+    {
+      internal::buildPointCloud<true>(image, pose, stride, cloud_->points);
+    }
+    else
+    {
+      internal::buildPointCloud<false>(image, pose, stride, cloud_->points);
+    }
+
+    cloud_->width = uint32_t(cloud_->points.size());
+    cloud_->height = 1;
+    cloud_->is_dense = true;
+  }
   return cloud_;
 }
 
 AsyncPointCloudBuilder::AsyncPointCloudBuilder()
 {
-  static tbb::task_scheduler_init init(tbb::task_scheduler_init::automatic);
 }
 
 AsyncPointCloudBuilder::~AsyncPointCloudBuilder()
@@ -120,8 +213,7 @@ AsyncPointCloudBuilder::~AsyncPointCloudBuilder()
 
 void AsyncPointCloudBuilder::build(const dvo::core::RgbdImage& image, const Eigen::Affine3d pose)
 {
-  BuildPointCloudTask* t = new( tbb::task::allocate_root() ) BuildPointCloudTask(image, pose, done_);
-  tbb::task::enqueue(*t);
+  dvo::util::TaskArenas::instance().enqueue(dvo::util::TaskArenas::Visualization, BuildPointCloudTask(image, pose, done_));
 }
 
 void AsyncPointCloudBuilder::done(DoneCallback& callback)
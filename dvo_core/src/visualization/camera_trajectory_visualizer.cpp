@@ -79,5 +79,10 @@ void NoopCameraTrajectoryVisualizer::reset()
 {
 }
 
+bool NoopCameraTrajectoryVisualizer::active() const
+{
+  return false;
+}
+
 } /* namespace visualization */
 } /* namespace dvo */
@@ -403,5 +403,10 @@ void PclCameraTrajectoryVisualizer::reset()
   impl_->reset();
 }
 
+bool PclCameraTrajectoryVisualizer::requiresRgb() const
+{
+  return true;
+}
+
 } /* namespace visualization */
 } /* namespace dvo */
@@ -20,8 +20,12 @@
 
 #include <dvo/visualization/point_cloud_aggregator.h>
 
-#include <pcl/filters/approximate_voxel_grid.h>
+#include <cmath>
+#include <map>
+#include <vector>
+
 #include <boost/bind.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/thread/mutex.hpp>
 
 namespace dvo
@@ -29,18 +33,198 @@ namespace dvo
 namespace visualization
 {
 
-typedef std::map<std::string, PointCloudAggregator::PointCloudBuilderCallable> PointCloudMap;
-
 namespace internal
 {
+
+// a cloud is re-integrated if its pose changes by more than this, in meters and radians
+static const double ReintegrationTranslation = 0.01;
+static const double ReintegrationRotation = 0.01;
+
+typedef long long VoxelKey;
+
+// sums of the points in a voxel, averaged for the output
+struct Voxel
+{
+  float x, y, z, r, g, b;
+  size_t count;
+
+  Voxel() : x(0.0f), y(0.0f), z(0.0f), r(0.0f), g(0.0f), b(0.0f), count(0) {}
+
+  void add(const Voxel& other, float sign)
+  {
+    x += sign * other.x;
+    y += sign * other.y;
+    z += sign * other.z;
+    r += sign * other.r;
+    g += sign * other.g;
+    b += sign * other.b;
+    count = sign > 0.0f ? count + other.count : count - other.count;
+  }
+};
+
+typedef boost::unordered_map<VoxelKey, Voxel> VoxelMap;
+
+// the voxels of one cloud, so it can be taken out of the map again
+typedef std::vector<std::pair<VoxelKey, Voxel> > VoxelContribution;
+
+struct CloudEntry
+{
+  PointCloudAggregator::PointCloudBuilderCallable builder;
+
+  // the pose at the last integration, if known
+  Eigen::Affine3d pose;
+  bool has_pose;
+
+  // not integrated yet
+  bool dirty;
+};
+
+typedef std::map<std::string, CloudEntry> CloudMap;
+typedef std::map<std::string, VoxelContribution> ContributionMap;
+
 class PointCloudAggregatorImpl
 {
 public:
-  PointCloudAggregatorImpl() {}
+  PointCloudAggregatorImpl(float leaf_size) : leaf_size_(leaf_size) {}
   ~PointCloudAggregatorImpl() {}
 
-  PointCloudMap clouds_;
+  const float leaf_size_;
+
+  // guards clouds_ and removed_, which are changed by add and remove
   boost::mutex clouds_mutex_;
+  CloudMap clouds_;
+  std::vector<std::string> removed_;
+
+  // guards the map, only used by build
+  boost::mutex map_mutex_;
+  VoxelMap voxels_;
+  ContributionMap contributions_;
+  AsyncPointCloudBuilder::PointCloud::Ptr snapshot_;
+
+  void add(const std::string& name, const PointCloudAggregator::PointCloudBuilderCallable& cloud, const Eigen::Affine3d* pose)
+  {
+    boost::mutex::scoped_lock lock(clouds_mutex_);
+
+    CloudMap::iterator it = clouds_.find(name);
+
+    if(it != clouds_.end() && pose != 0 && it->second.has_pose && !moved(it->second.pose, *pose))
+    {
+      // keep the integrated points, but build the new cloud if the pose changes later on
+      it->second.builder = cloud;
+      return;
+    }
+
+    CloudEntry& e = clouds_[name];
+    e.builder = cloud;
+    e.has_pose = pose != 0;
+    e.dirty = true;
+
+    if(pose != 0) e.pose = *pose;
+  }
+
+  void remove(const std::string& name)
+  {
+    boost::mutex::scoped_lock lock(clouds_mutex_);
+
+    if(clouds_.erase(name) > 0) removed_.push_back(name);
+  }
+
+  static bool moved(const Eigen::Affine3d& a, const Eigen::Affine3d& b)
+  {
+    Eigen::Affine3d diff = a.inverse(Eigen::Isometry) * b;
+
+    return diff.translation().norm() > ReintegrationTranslation || Eigen::AngleAxisd(diff.linear()).angle() > ReintegrationRotation;
+  }
+
+  VoxelKey voxelKey(float x, float y, float z) const
+  {
+    // 21 bits per axis, wraps around after about 20km with 1cm leafs
+    static const VoxelKey Mask = (VoxelKey(1) << 21) - 1;
+
+    const VoxelKey vx = VoxelKey(std::floor(x / leaf_size_));
+    const VoxelKey vy = VoxelKey(std::floor(y / leaf_size_));
+    const VoxelKey vz = VoxelKey(std::floor(z / leaf_size_));
+
+    return ((vx & Mask) << 42) | ((vy & Mask) << 21) | (vz & Mask);
+  }
+
+  void voxelize(const AsyncPointCloudBuilder::PointCloud& cloud, VoxelContribution& contribution) const
+  {
+    VoxelMap voxels;
+
+    for(AsyncPointCloudBuilder::PointCloud::const_iterator it = cloud.begin(); it != cloud.end(); ++it)
+    {
+      if(!std::isfinite(it->x) || !std::isfinite(it->y) || !std::isfinite(it->z)) continue;
+
+      Voxel& v = voxels[voxelKey(it->x, it->y, it->z)];
+      v.x += it->x;
+      v.y += it->y;
+      v.z += it->z;
+      v.r += it->r;
+      v.g += it->g;
+      v.b += it->b;
+      v.count++;
+    }
+
+    contribution.assign(voxels.begin(), voxels.end());
+  }
+
+  void apply(const VoxelContribution& contribution, float sign)
+  {
+    for(VoxelContribution::const_iterator it = contribution.begin(); it != contribution.end(); ++it)
+    {
+      VoxelMap::iterator v = voxels_.find(it->first);
+
+      if(v == voxels_.end())
+      {
+        if(sign > 0.0f) voxels_.insert(*it);
+        continue;
+      }
+
+      v->second.add(it->second, sign);
+
+      if(v->second.count == 0) voxels_.erase(v);
+    }
+  }
+
+  void removeContribution(const std::string& name)
+  {
+    ContributionMap::iterator it = contributions_.find(name);
+
+    if(it == contributions_.end()) return;
+
+    apply(it->second, -1.0f);
+    contributions_.erase(it);
+  }
+
+  void updateSnapshot()
+  {
+    snapshot_.reset(new AsyncPointCloudBuilder::PointCloud);
+
+    if(voxels_.empty())
+    {
+      snapshot_->points.push_back(AsyncPointCloudBuilder::PointCloud::PointType());
+      return;
+    }
+
+    snapshot_->reserve(voxels_.size());
+
+    AsyncPointCloudBuilder::PointCloud::PointType p;
+
+    for(VoxelMap::const_iterator it = voxels_.begin(); it != voxels_.end(); ++it)
+    {
+      const float scale = 1.0f / it->second.count;
+
+      p.x = it->second.x * scale;
+      p.y = it->second.y * scale;
+      p.z = it->second.z * scale;
+      p.r = it->second.r * scale;
+      p.g = it->second.g * scale;
+      p.b = it->second.b * scale;
+
+      snapshot_->push_back(p);
+    }
+  }
 };
 } /* namespace internal */
 
@@ -49,8 +233,8 @@ dvo::visualization::AsyncPointCloudBuilder::PointCloud::Ptr passthroughPointClou
   return cloud;
 }
 
-PointCloudAggregator::PointCloudAggregator() :
-    impl_(new internal::PointCloudAggregatorImpl()) {}
+PointCloudAggregator::PointCloudAggregator(float leaf_size) :
+    impl_(new internal::PointCloudAggregatorImpl(leaf_size)) {}
 PointCloudAggregator::~PointCloudAggregator() {}
 
 void PointCloudAggregator::add(const std::string& name, const dvo::visualization::AsyncPointCloudBuilder::PointCloud::Ptr& cloud)
@@ -61,51 +245,62 @@ void PointCloudAggregator::add(const std::string& name, const dvo::visualization
 
 void PointCloudAggregator::add(const std::string& name, const PointCloudBuilderCallable& cloud)
 {
-  boost::mutex::scoped_lock(impl_->clouds_mutex_);
-  impl_->clouds_[name] = cloud;
+  impl_->add(name, cloud, 0);
+}
+
+void PointCloudAggregator::add(const std::string& name, const PointCloudBuilderCallable& cloud, const Eigen::Affine3d& pose)
+{
+  impl_->add(name, cloud, &pose);
 }
 
 void PointCloudAggregator::remove(const std::string& name)
 {
-  boost::mutex::scoped_lock(impl_->clouds_mutex_);
-  impl_->clouds_.erase(name);
+  impl_->remove(name);
 }
 
 AsyncPointCloudBuilder::PointCloud::Ptr PointCloudAggregator::build()
 {
-  AsyncPointCloudBuilder::PointCloud::Ptr highres_cloud(new AsyncPointCloudBuilder::PointCloud);
-  AsyncPointCloudBuilder::PointCloud::Ptr downsampled_cloud(new AsyncPointCloudBuilder::PointCloud);
+  boost::mutex::scoped_lock map_lock(impl_->map_mutex_);
 
-  PointCloudMap local;
-  {
-    boost::mutex::scoped_lock(impl_->clouds_mutex_);
-    local = impl_->clouds_;
-  }
+  std::vector<std::string> removed;
+  std::vector<std::pair<std::string, PointCloudBuilderCallable> > changed;
 
-  if(local.empty())
   {
-    highres_cloud->points.push_back(AsyncPointCloudBuilder::PointCloud::PointType());
-    return highres_cloud;
-  }
+    boost::mutex::scoped_lock lock(impl_->clouds_mutex_);
 
-  pcl::ApproximateVoxelGrid<AsyncPointCloudBuilder::PointCloud::PointType> vg;
-  vg.setDownsampleAllData(true);
-  vg.setLeafSize(0.01f, 0.01f, 0.01f);
+    removed.swap(impl_->removed_);
 
-  size_t step = std::max(local.size() / size_t(50), size_t(1));
-  size_t k = 0;
-  for(PointCloudMap::iterator it = local.begin(); it != local.end(); ++it, ++k)
-  {
-    if((k % step) == 0)
+    for(internal::CloudMap::iterator it = impl_->clouds_.begin(); it != impl_->clouds_.end(); ++it)
     {
-      (*highres_cloud) += *(it->second());
+      if(!it->second.dirty) continue;
+
+      changed.push_back(std::make_pair(it->first, it->second.builder));
+      it->second.dirty = false;
     }
   }
 
-  vg.setInputCloud(highres_cloud);
-  vg.filter(*downsampled_cloud);
+  if(!removed.empty() || !changed.empty() || !impl_->snapshot_)
+  {
+    for(std::vector<std::string>::iterator it = removed.begin(); it != removed.end(); ++it)
+    {
+      impl_->removeContribution(*it);
+    }
+
+    // the clouds are built here, outside of the lock, so add doesn't block on it
+    for(size_t idx = 0; idx < changed.size(); ++idx)
+    {
+      impl_->removeContribution(changed[idx].first);
+
+      AsyncPointCloudBuilder::PointCloud::Ptr cloud = changed[idx].second();
+
+      if(cloud) impl_->voxelize(*cloud, impl_->contributions_[changed[idx].first]);
+      impl_->apply(impl_->contributions_[changed[idx].first], 1.0f);
+    }
+
+    impl_->updateSnapshot();
+  }
 
-  return downsampled_cloud;
+  return impl_->snapshot_;
 }
 
 } /* namespace visualization */
@@ -23,7 +23,7 @@
 
 #include <dvo/visualization/visualizer.h>
 #include <dvo/util/histogram.h>
-#include "bounded_buffer.h"
+#include <dvo/util/ring_buffer.h>
 
 namespace dvo
 {
@@ -182,12 +182,12 @@ public:
 
     CreateHistogramFunc f(this, name, img, binsize, min, max);
 
-    histogram_queue_.push_front(f);
+    histogram_queue_.pushDropOldest(f);
   }
 
   void internalShow(std::string& name, const cv::MatExpr& img, Visualizer::ImageModifier modifier = Visualizer::ImageModifier())
   {
-    image_queue_.push_front(NamedImage(name, img, modifier));
+    image_queue_.pushDropOldest(NamedImage(name, img, modifier));
   }
 
   bool checkImageSize(std::string& name, const cv::Mat& img)
@@ -211,7 +211,7 @@ public:
 
     while(!shutdown_)
     {
-      if(image_queue_.pop_back(&named_img))
+      if(image_queue_.pop(named_img))
       {
         cv::Mat img;
 
@@ -258,7 +258,7 @@ public:
 
     while(!shutdown_)
     {
-        if(histogram_queue_.pop_back(&create_histogram))
+        if(histogram_queue_.pop(create_histogram))
         {
           create_histogram();
 
@@ -286,8 +286,9 @@ public:
 private:
   bool shutdown_;
 
-  bounded_buffer<NamedImage> image_queue_;
-  bounded_buffer<CreateHistogramFunc> histogram_queue_;
+  // the newest images win, a slow display never holds up the producers
+  dvo::util::RingBuffer<NamedImage> image_queue_;
+  dvo::util::RingBuffer<CreateHistogramFunc> histogram_queue_;
 
   NameSizeMap image_size_lookup_;
   NameSequenceMap image_sequence_lookup_;
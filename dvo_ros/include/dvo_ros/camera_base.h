@@ -31,6 +31,8 @@
 #include <message_filters/synchronizer.h>
 #include <message_filters/sync_policies/approximate_time.h>
 
+#include <dvo_ros/instrumentation_publisher.h>
+
 namespace dvo_ros
 {
 
@@ -54,6 +56,8 @@ protected:
 
   message_filters::Synchronizer<RGBDWithCameraInfoPolicy> synchronizer_;
 
+  InstrumentationPublisher instrumentation_publisher_;
+
   bool isSynchronizedImageStreamRunning();
 
   void startSynchronizedImageStream();
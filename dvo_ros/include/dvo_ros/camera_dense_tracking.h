@@ -45,6 +45,7 @@
 #include <dvo/dense_tracking.h>
 #include <dvo/core/intrinsic_matrix.h>
 #include <dvo/core/rgbd_image.h>
+#include <dvo/util/mailbox.h>
 #include <dvo/visualization/camera_trajectory_visualizer.h>
 
 namespace dvo_ros
@@ -77,8 +78,30 @@ private:
   dvo::visualization::CameraTrajectoryVisualizerInterface* vis_;
 
   bool use_dense_tracking_estimate_;
+
+  // pyramids kept by the camera for reuse, at least reference and current
+  int image_pool_size_;
+
+  // serializes the image callbacks, reconfiguration doesn't take it
   boost::mutex tracker_mutex_;
 
+  /**
+   * A configuration and a tracker already configured with it, prepared by handleConfig() and swapped in by
+   * handleImages() before the next frame, so reconfiguring never blocks tracking.
+   */
+  struct Reconfiguration
+  {
+    dvo::DenseTracker::Config cfg;
+    boost::shared_ptr<dvo::DenseTracker> tracker;
+  };
+
+  dvo::util::Mailbox<Reconfiguration> pending_reconfiguration_;
+
+  // configuration of tracker, only used by handleImages(), tracker_cfg belongs to handleConfig()
+  dvo::DenseTracker::Config active_tracker_cfg_;
+
+  void applyReconfiguration();
+
   bool hasChanged(const sensor_msgs::CameraInfo::ConstPtr& camera_info_msg);
   void reset(const sensor_msgs::CameraInfo::ConstPtr& camera_info_msg);
 
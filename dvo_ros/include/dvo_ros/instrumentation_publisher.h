@@ -0,0 +1,51 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTRUMENTATION_PUBLISHER_H_
+#define INSTRUMENTATION_PUBLISHER_H_
+
+#include <ros/ros.h>
+
+#include <string>
+
+namespace dvo_ros
+{
+
+/**
+ * Periodically publishes the timers of dvo::util::Instrumentation as diagnostic_msgs/DiagnosticArray on
+ * ~instrumentation and optionally writes them to the csv file given in ~instrumentation/file.
+ * A ~instrumentation/publish_period of 0 disables both. If ~instrumentation/trace_file is set, a dvo::util::Trace is
+ * recorded and written to it when the publisher is destroyed.
+ */
+class InstrumentationPublisher
+{
+public:
+  InstrumentationPublisher(ros::NodeHandle& nh_private);
+  ~InstrumentationPublisher();
+private:
+  ros::Publisher publisher_;
+  ros::Timer timer_;
+  std::string file_, trace_file_;
+
+  void publish(const ros::TimerEvent& e);
+};
+
+} /* namespace dvo_ros */
+#endif /* INSTRUMENTATION_PUBLISHER_H_ */
@@ -78,6 +78,21 @@ void updateConfigFromDynamicReconfigure(const dvo_ros::CameraDenseTrackerConfig&
   tracker_cfg.InfluenceFuntionType = influence_function;
   tracker_cfg.InfluenceFunctionParam = config.influence_function_param;
   tracker_cfg.Mu = config.mu;
+  tracker_cfg.UseParallel = config.use_parallel;
+  tracker_cfg.ParallelGrainSize = config.parallel_grain_size;
+  tracker_cfg.UseGpu = config.use_gpu;
+  tracker_cfg.UseInverseCompositional = config.use_inverse_compositional;
+  tracker_cfg.UseMixedPrecisionSolver = config.use_mixed_precision_solver;
+  tracker_cfg.MaxMatchTime = config.max_match_time;
+  tracker_cfg.UseAdaptiveLevels = config.use_adaptive_levels;
+  tracker_cfg.UseCompactStorage = config.use_compact_storage;
+  tracker_cfg.RollingShutterReadoutTime = config.rolling_shutter_readout_time;
+  tracker_cfg.MaxPointsPerLevel = config.max_points_per_level;
+  tracker_cfg.UseMortonOrder = config.use_morton_order;
+  tracker_cfg.ScaleSampleSize = config.scale_sample_size;
+  tracker_cfg.UseWarmStartedScale = config.use_warm_started_scale;
+  tracker_cfg.FinestLevelMaxPixels = config.finest_level_max_pixels;
+  tracker_cfg.CoarsestLevelMinPixels = config.coarsest_level_min_pixels;
   tracker_cfg.IntensityDerivativeThreshold = config.min_intensity_deriv;
   tracker_cfg.DepthDerivativeThreshold = config.min_depth_deriv;
 }
@@ -27,6 +27,8 @@
 #include <tf/transform_listener.h>
 #include <tf_conversions/tf_eigen.h>
 
+#include <dvo/core/depth_filter.h>
+
 
 namespace dvo_ros { namespace util {
 
@@ -57,6 +59,26 @@ static void tryGetTransform(Eigen::Affine3d& result, tf::TransformListener& tl,
   tf::TransformTFToEigen(tmp, result);
 }
 
+// the depth preprocessing of a sensor from the parameters in the namespace of nh, unset ones keep their value
+static void loadDepthFilterConfig(const ros::NodeHandle& nh, dvo::core::DepthFilterConfig& cfg)
+{
+  double min_depth, max_depth, max_depth_jump, sigma_space, sigma_depth;
+
+  nh.param("min_depth", min_depth, double(cfg.MinDepth));
+  nh.param("max_depth", max_depth, double(cfg.MaxDepth));
+  nh.param("max_depth_jump", max_depth_jump, double(cfg.MaxDepthJump));
+  nh.param("bilateral_radius", cfg.BilateralRadius, cfg.BilateralRadius);
+  nh.param("bilateral_sigma_space", sigma_space, double(cfg.BilateralSigmaSpace));
+  nh.param("bilateral_sigma_depth", sigma_depth, double(cfg.BilateralSigmaDepth));
+  nh.param("fill_holes", cfg.FillHoles, cfg.FillHoles);
+
+  cfg.MinDepth = float(min_depth);
+  cfg.MaxDepth = float(max_depth);
+  cfg.MaxDepthJump = float(max_depth_jump);
+  cfg.BilateralSigmaSpace = float(sigma_space);
+  cfg.BilateralSigmaDepth = float(sigma_depth);
+}
+
 } /* namespace util */ } /* namespace dvo_ros */
 
 
@@ -35,6 +35,10 @@ namespace internal
 struct RosCameraTrajectoryVisualizerImpl;
 } /* namespace internal */
 
+/**
+ * Publishes the cameras and trajectories as interactive markers and their clouds on dvo_vis/cloud. Updates are merged
+ * and published from a low priority thread at ~visualization_rate, and only while somebody subscribes.
+ */
 class RosCameraTrajectoryVisualizer : public dvo::visualization::CameraTrajectoryVisualizerInterface
 {
 public:
@@ -46,6 +50,10 @@ public:
 
   virtual void reset();
 
+  virtual bool requiresRgb() const;
+
+  virtual bool active() const;
+
   virtual bool native(void*& native_visualizer);
 private:
   internal::RosCameraTrajectoryVisualizerImpl* impl_;
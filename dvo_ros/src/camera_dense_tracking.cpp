@@ -24,8 +24,7 @@
 #include <tf/transform_broadcaster.h>
 #include <tf_conversions/tf_eigen.h>
 
-#include <dvo/core/surface_pyramid.h>
-#include <dvo/util/stopwatch.h>
+#include <dvo/util/instrumentation.h>
 #include <dvo/visualization/visualizer.h>
 //#include <dvo/visualization/pcl_camera_trajectory_visualizer.h>
 
@@ -49,7 +48,8 @@ CameraDenseTracker::CameraDenseTracker(ros::NodeHandle& nh, ros::NodeHandle& nh_
   frames_since_last_success(0),
   reconfigure_server_(nh_private),
   vis_(new dvo::visualization::NoopCameraTrajectoryVisualizer()),
-  use_dense_tracking_estimate_(false)
+  use_dense_tracking_estimate_(false),
+  active_tracker_cfg_(tracker_cfg)
 {
   ROS_INFO("CameraDenseTracker::ctor(...)");
 
@@ -64,6 +64,9 @@ CameraDenseTracker::CameraDenseTracker(ros::NodeHandle& nh, ros::NodeHandle& nh_
 
   pose_sub_ = nh.subscribe<geometry_msgs::PoseWithCovarianceStamped>("pelican/pose", 1, &CameraDenseTracker::handlePose, this);
 
+  nh_private.param("image_pool_size", image_pool_size_, 4);
+  image_pool_size_ = std::max(image_pool_size_, 2);
+
   latest_absolute_transform_.setIdentity();
   accumulated_transform.setIdentity();
 
@@ -90,9 +93,11 @@ void CameraDenseTracker::reset(const sensor_msgs::CameraInfo::ConstPtr& camera_i
   IntrinsicMatrix intrinsics = IntrinsicMatrix::create(camera_info_msg->P[0], camera_info_msg->P[5], camera_info_msg->P[2], camera_info_msg->P[6]);
 
   camera.reset(new dvo::core::RgbdCameraPyramid(camera_info_msg->width, camera_info_msg->height, intrinsics));
-  camera->build(tracker_cfg.getNumLevels());
+  camera->build(active_tracker_cfg_.getNumLevels());
+  // reference, current and the frames held by the tracker stay referenced, all others are recycled
+  camera->setPoolSize(image_pool_size_);
 
-  tracker.reset(new DenseTracker(tracker_cfg));
+  tracker.reset(new DenseTracker(active_tracker_cfg_));
 
   static RgbdImagePyramid* const __null__ = 0;
 
@@ -142,15 +147,12 @@ void CameraDenseTracker::handleConfig(dvo_ros::CameraDenseTrackerConfig& config,
 
     dvo_ros::util::updateConfigFromDynamicReconfigure(config, tracker_cfg);
 
-    // we are called in the ctor as well, but at this point we don't have a tracker instance
-    if(tracker)
-    {
-      // lock tracker so we don't reconfigure it while it is running
-      boost::mutex::scoped_lock lock(tracker_mutex_);
+    // the tracker is constructed here, on the reconfigure thread, and swapped in at the next frame
+    Reconfiguration r;
+    r.cfg = tracker_cfg;
+    r.tracker.reset(new DenseTracker(tracker_cfg));
 
-      tracker->configure(tracker_cfg);
-      camera->build(tracker_cfg.getNumLevels());
-    }
+    pending_reconfiguration_.post(r);
 
     ROS_INFO_STREAM("reconfigured tracker, config ( " << tracker_cfg << " )");
   }
@@ -173,6 +175,22 @@ void CameraDenseTracker::handleConfig(dvo_ros::CameraDenseTrackerConfig& config,
   }
 }
 
+void CameraDenseTracker::applyReconfiguration()
+{
+  Reconfiguration r;
+
+  if(!pending_reconfiguration_.take(r)) return;
+
+  active_tracker_cfg_ = r.cfg;
+
+  // without a tracker the next frame resets anyway
+  if(tracker)
+  {
+    tracker = r.tracker;
+    camera->build(active_tracker_cfg_.getNumLevels());
+  }
+}
+
 void CameraDenseTracker::handlePose(const geometry_msgs::PoseWithCovarianceStampedConstPtr& pose)
 {
   tf::Transform tmp;
@@ -191,12 +209,15 @@ void CameraDenseTracker::handleImages(
     const sensor_msgs::CameraInfo::ConstPtr& depth_camera_info_msg
 )
 {
-  static stopwatch sw_callback("callback");
-  sw_callback.start();
+  static Timer& callback_timer = Instrumentation::instance().timer("camera_dense_tracker/callback");
+  static Timer& match_timer = callback_timer.child("match");
+  ScopedTimer callback_scope(callback_timer);
 
-  // lock tracker so no one can reconfigure it
   boost::mutex::scoped_lock lock(tracker_mutex_);
 
+  // frame boundary, a new configuration takes effect from here on
+  applyReconfiguration();
+
   // different size of rgb and depth image
   if(depth_camera_info_msg->width != rgb_camera_info_msg->width || depth_camera_info_msg->height != rgb_camera_info_msg->height)
   {
@@ -213,34 +234,14 @@ void CameraDenseTracker::handleImages(
     reset(rgb_camera_info_msg);
   }
 
-  cv::Mat intensity, depth;
+  // shares the message buffers, intensity and depth are converted straight into the pyramid
   cv::Mat rgb_in = cv_bridge::toCvShare(rgb_image_msg)->image;
-
-  if(rgb_in.channels() == 3)
-  {
-    cv::Mat tmp;
-    cv::cvtColor(rgb_in, tmp, CV_BGR2GRAY, 1);
-
-    tmp.convertTo(intensity, CV_32F);
-  }
-  else
-  {
-    rgb_in.convertTo(intensity, CV_32F);
-  }
-
   cv::Mat depth_in = cv_bridge::toCvShare(depth_image_msg)->image;
 
-  if(depth_in.type() == CV_16UC1)
-  {
-    SurfacePyramid::convertRawDepthImageSse(depth_in, depth, 0.001);
-  }
-  else
-  {
-    depth = depth_in;
-  }
-
   reference.swap(current);
-  current = camera->create(intensity, depth);
+  // drop the old reference first, so its pyramid can be recycled
+  current.reset();
+  current = camera->create(rgb_in, depth_in, 0.001f, vis_->requiresRgb());
 
   // time delay compensation TODO: use driver settings instead
   std_msgs::Header h = rgb_image_msg->header;
@@ -263,12 +264,12 @@ void CameraDenseTracker::handleImages(
 
   Eigen::Affine3d transform;
 
-  static stopwatch sw_match("match", 100);
-  sw_match.start();
+  bool success;
 
-  bool success = tracker->match(*reference, *current, transform);
-
-  sw_match.stopAndPrint();
+  {
+    ScopedTimer match_scope(match_timer);
+    success = tracker->match(*reference, *current, transform);
+  }
 
   if(success)
   {
@@ -285,10 +286,13 @@ void CameraDenseTracker::handleImages(
         color(dvo::visualization::Color::red())
         .add(accumulated_transform);
 
-    vis_->camera("current")->
-        color(dvo::visualization::Color::red()).
-        update(current->level(0), accumulated_transform).
-        show();
+    if(vis_->active())
+    {
+      vis_->camera("current")->
+          color(dvo::visualization::Color::red()).
+          update(current->level(0), accumulated_transform).
+          show();
+    }
   }
   else
   {
@@ -304,8 +308,6 @@ void CameraDenseTracker::handleImages(
   {
     publishPose(h, accumulated_transform * from_baselink_to_asus.inverse(), "baselink_estimate");
   }
-
-  sw_callback.stopAndPrint();
 }
 
 void CameraDenseTracker::publishTransform(const std_msgs::Header& header, const Eigen::Affine3d& transform, const std::string frame)
@@ -0,0 +1,116 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo_ros/instrumentation_publisher.h>
+
+#include <dvo/util/instrumentation.h>
+
+#include <diagnostic_msgs/DiagnosticArray.h>
+
+#include <boost/lexical_cast.hpp>
+
+namespace dvo_ros
+{
+
+static void addValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, double value)
+{
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = boost::lexical_cast<std::string>(value);
+
+  status.values.push_back(kv);
+}
+
+InstrumentationPublisher::InstrumentationPublisher(ros::NodeHandle& nh_private)
+{
+  double period;
+
+  nh_private.param("instrumentation/publish_period", period, 1.0);
+  nh_private.param("instrumentation/file", file_, std::string(""));
+  nh_private.param("instrumentation/trace_file", trace_file_, std::string(""));
+
+  if(!trace_file_.empty())
+  {
+    ROS_INFO_STREAM("tracing, writing the trace to '" << trace_file_ << "' on shutdown");
+    dvo::util::Trace::instance().start();
+  }
+
+  if(period <= 0.0) return;
+
+  publisher_ = nh_private.advertise<diagnostic_msgs::DiagnosticArray>("instrumentation", 1);
+  timer_ = nh_private.createTimer(ros::Duration(period), &InstrumentationPublisher::publish, this);
+}
+
+InstrumentationPublisher::~InstrumentationPublisher()
+{
+  timer_.stop();
+
+  if(trace_file_.empty()) return;
+
+  // waits for the threads recording an event, later ones aren't recorded anymore
+  dvo::util::Trace::instance().stop();
+
+  if(!dvo::util::Trace::instance().write(trace_file_))
+  {
+    ROS_WARN_STREAM("failed to write the trace to '" << trace_file_ << "'");
+  }
+  else if(dvo::util::Trace::instance().dropped() > 0)
+  {
+    ROS_WARN_STREAM("trace is incomplete, " << dvo::util::Trace::instance().dropped() << " events were dropped");
+  }
+}
+
+void InstrumentationPublisher::publish(const ros::TimerEvent& e)
+{
+  if(!file_.empty() && !dvo::util::Instrumentation::instance().write(file_))
+  {
+    ROS_WARN_STREAM_ONCE("failed to write instrumentation to '" << file_ << "'");
+  }
+
+  if(publisher_.getNumSubscribers() == 0) return;
+
+  std::vector<dvo::util::TimerSummary> summaries;
+  dvo::util::Instrumentation::instance().summarize(summaries);
+
+  diagnostic_msgs::DiagnosticArray msg;
+  msg.header.stamp = e.current_real;
+  msg.status.reserve(summaries.size());
+
+  for(std::vector<dvo::util::TimerSummary>::const_iterator it = summaries.begin(); it != summaries.end(); ++it)
+  {
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = it->Name;
+    status.hardware_id = "dvo";
+
+    addValue(status, "count", it->Count);
+    addValue(status, "mean", it->Mean);
+    addValue(status, "p50", it->P50);
+    addValue(status, "p90", it->P90);
+    addValue(status, "p99", it->P99);
+    addValue(status, "max", it->Max);
+
+    msg.status.push_back(status);
+  }
+
+  publisher_.publish(msg);
+}
+
+} /* namespace dvo_ros */
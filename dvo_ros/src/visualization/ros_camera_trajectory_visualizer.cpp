@@ -29,9 +29,18 @@
 #include <visualization_msgs/Marker.h>
 #include <visualization_msgs/InteractiveMarker.h>
 #include <visualization_msgs/InteractiveMarkerControl.h>
+#include <visualization_msgs/InteractiveMarkerUpdate.h>
 
 #include <eigen_conversions/eigen_msg.h>
 
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <tbb/mutex.h>
+#include <tbb/spin_mutex.h>
+
+#include <pthread.h>
+
 namespace dvo_ros
 {
 namespace visualization
@@ -42,14 +51,19 @@ namespace internal
 
 using namespace dvo::visualization;
 
+/**
+ * Updates only store the latest state, which flush() sends from the publishing thread of the visualizer.
+ */
 class RosCameraVisualizer : public CameraVisualizer
 {
 public:
-  RosCameraVisualizer(std::string name, interactive_markers::InteractiveMarkerServer& marker_server, dvo::visualization::PointCloudAggregator& point_cloud_aggregator) :
+  RosCameraVisualizer(std::string name, interactive_markers::InteractiveMarkerServer& marker_server, dvo::visualization::PointCloudAggregator& point_cloud_aggregator, int cloud_stride) :
     marker_server_(marker_server),
     point_cloud_aggregator_(point_cloud_aggregator),
+    cloud_stride_(cloud_stride),
     visibility_(ShowCameraAndCloud),
-    user_override_(false)
+    user_override_(false),
+    dirty_(false)
   {
     name_ = name;
     createInteractiveCameraMarker(marker_);
@@ -64,12 +78,14 @@ public:
 
   virtual void show(Option option = ShowCameraAndCloud)
   {
+    tbb::spin_mutex::scoped_lock l(state_mutex_);
+
     if(!user_override_)
     {
       visibility_ = option;
     }
 
-    updateVisualization();
+    dirty_ = true;
   }
 
   virtual void hide()
@@ -79,40 +95,84 @@ public:
 
   virtual CameraVisualizer& update(const dvo::core::RgbdImage& img, const Eigen::Affine3d& pose)
   {
-    // update marker
+    boost::shared_ptr<AsyncPointCloudBuilder::BuildJob> point_cloud_builder(new AsyncPointCloudBuilder::BuildJob(img, pose, cloud_stride_));
+
+    tbb::spin_mutex::scoped_lock l(state_mutex_);
+
     tf::poseEigenToMsg(pose, marker_.pose);
+    updateMarkerColor(marker_);
+    point_cloud_builder_.swap(point_cloud_builder);
+    dirty_ = true;
+
+    return *this;
+  }
+
+  // sends the latest update to the marker server and the point cloud aggregator, the marker server still has to apply it
+  void flush()
+  {
+    visualization_msgs::InteractiveMarker marker;
+    boost::shared_ptr<AsyncPointCloudBuilder::BuildJob> point_cloud_builder;
+    Option visibility;
 
-    visualization_msgs::InteractiveMarker tmp;
-    if(!marker_server_.get(name_, tmp) || hasColorChanged(tmp))
     {
-      updateMarkerColor(marker_);
-      marker_server_.insert(marker_, marker_callback_);
+      tbb::spin_mutex::scoped_lock l(state_mutex_);
+
+      if(!dirty_) return;
+
+      marker = marker_;
+      point_cloud_builder = point_cloud_builder_;
+      visibility = visibility_;
+      dirty_ = false;
     }
-    else
+
+    // nothing to show before the first update
+    if(visibility != ShowNothing && point_cloud_builder)
     {
-      marker_server_.setPose(name_, marker_.pose);
+      visualization_msgs::InteractiveMarker tmp;
+      if(!marker_server_.get(name_, tmp) || hasColorChanged(tmp, marker))
+      {
+        marker_server_.insert(marker, marker_callback_);
+      }
+      else
+      {
+        marker_server_.setPose(name_, marker.pose);
+      }
     }
 
-    //marker_server_.applyChanges();
-    point_cloud_builder_.reset(new AsyncPointCloudBuilder::BuildJob(img, pose));
-
-    return *this;
+    switch(visibility)
+    {
+      case ShowCameraAndCloud:
+        if(point_cloud_builder) point_cloud_aggregator_.add(name(), boost::bind(&AsyncPointCloudBuilder::BuildJob::build, point_cloud_builder), point_cloud_builder->pose);
+        break;
+      case ShowCamera:
+        point_cloud_aggregator_.remove(name());
+        break;
+      default:
+        marker_server_.erase(name_);
+        point_cloud_aggregator_.remove(name());
+        break;
+    }
   }
 private:
   interactive_markers::InteractiveMarkerServer& marker_server_;
-  visualization_msgs::InteractiveMarker marker_;
   interactive_markers::InteractiveMarkerServer::FeedbackCallback marker_callback_;
 
-  boost::shared_ptr<AsyncPointCloudBuilder::BuildJob> point_cloud_builder_;
   dvo::visualization::PointCloudAggregator& point_cloud_aggregator_;
+  int cloud_stride_;
 
+  // guards the state below, which is written by the tracking threads and the marker feedback
+  tbb::spin_mutex state_mutex_;
+  visualization_msgs::InteractiveMarker marker_;
+  boost::shared_ptr<AsyncPointCloudBuilder::BuildJob> point_cloud_builder_;
   Option visibility_;
-  bool user_override_;
+  bool user_override_, dirty_;
 
   void onMarkerFeedback(const visualization_msgs::InteractiveMarkerFeedback::ConstPtr& feedback)
   {
     if(feedback->event_type == visualization_msgs::InteractiveMarkerFeedback::BUTTON_CLICK)
     {
+      tbb::spin_mutex::scoped_lock l(state_mutex_);
+
       user_override_ = true;
       switch(visibility_)
       {
@@ -123,38 +183,20 @@ private:
           visibility_ = ShowCameraAndCloud;
           break;
         default:
-          hide();
           break;
       }
-      updateVisualization();
+      dirty_ = true;
     }
   }
 
-  void updateVisualization()
+  static bool hasColorChanged(const visualization_msgs::InteractiveMarker& m, const visualization_msgs::InteractiveMarker& current)
   {
-    switch(visibility_)
-    {
-      case ShowCameraAndCloud:
-        point_cloud_aggregator_.add(name(), boost::bind(&AsyncPointCloudBuilder::BuildJob::build, point_cloud_builder_));
-        break;
-      case ShowCamera:
-        point_cloud_aggregator_.remove(name());
-        break;
-      default:
-        marker_server_.erase(name_);
-        point_cloud_aggregator_.remove(name());
-        break;
-    }
-
-    marker_server_.applyChanges();
-  }
+    const std_msgs::ColorRGBA& c = current.controls[0].markers[0].color;
 
-  bool hasColorChanged(const visualization_msgs::InteractiveMarker& m)
-  {
     return
-    std::abs(m.controls[0].markers[0].color.r - color().r) > 1e-3 ||
-    std::abs(m.controls[0].markers[0].color.g - color().g) > 1e-3 ||
-    std::abs(m.controls[0].markers[0].color.b - color().b) > 1e-3;
+    std::abs(m.controls[0].markers[0].color.r - c.r) > 1e-3 ||
+    std::abs(m.controls[0].markers[0].color.g - c.g) > 1e-3 ||
+    std::abs(m.controls[0].markers[0].color.b - c.b) > 1e-3;
   }
 
   void createInteractiveCameraMarker(visualization_msgs::InteractiveMarker& marker)
@@ -321,7 +363,8 @@ class RosTrajectoryVisualizer : public TrajectoryVisualizer
 {
 public:
   RosTrajectoryVisualizer(std::string& name, interactive_markers::InteractiveMarkerServer& marker_server) :
-    marker_server_(marker_server)
+    marker_server_(marker_server),
+    dirty_(false)
   {
     createTrajectoryMarker(name, marker_);
   }
@@ -333,23 +376,42 @@ public:
 
   virtual TrajectoryVisualizer& add(const Eigen::Affine3d& pose)
   {
-    updateMarkerColor();
-
     geometry_msgs::Point p;
     p.x = pose.translation()(0);
     p.y = pose.translation()(1);
     p.z = pose.translation()(2);
 
-    marker_.controls[0].markers[0].points.push_back(p);
+    tbb::spin_mutex::scoped_lock l(state_mutex_);
 
-    marker_server_.insert(marker_);
-    marker_server_.applyChanges();
+    updateMarkerColor();
+    marker_.controls[0].markers[0].points.push_back(p);
+    dirty_ = true;
 
     return *this;
   }
+
+  // the marker server still has to apply the change
+  void flush()
+  {
+    visualization_msgs::InteractiveMarker marker;
+
+    {
+      tbb::spin_mutex::scoped_lock l(state_mutex_);
+
+      if(!dirty_) return;
+
+      marker = marker_;
+      dirty_ = false;
+    }
+
+    marker_server_.insert(marker);
+  }
 private:
   interactive_markers::InteractiveMarkerServer& marker_server_;
+
+  tbb::spin_mutex state_mutex_;
   visualization_msgs::InteractiveMarker marker_;
+  bool dirty_;
 
   void createTrajectoryMarker(std::string& name, visualization_msgs::InteractiveMarker& marker)
   {
@@ -377,29 +439,53 @@ private:
 
 struct RosCameraTrajectoryVisualizerImpl
 {
-  typedef std::map<std::string, CameraVisualizer::Ptr> CameraVisualizerMap;
-  typedef std::map<std::string, TrajectoryVisualizer::Ptr> TrajectoryVisualizerMap;
+  typedef boost::shared_ptr<RosCameraVisualizer> RosCameraVisualizerPtr;
+  typedef boost::shared_ptr<RosTrajectoryVisualizer> RosTrajectoryVisualizerPtr;
+  typedef std::map<std::string, RosCameraVisualizerPtr> CameraVisualizerMap;
+  typedef std::map<std::string, RosTrajectoryVisualizerPtr> TrajectoryVisualizerMap;
 
   RosCameraTrajectoryVisualizerImpl(ros::NodeHandle& nh) :
     nh_(nh),
     marker_server_("dvo_vis")
   {
+    ros::NodeHandle nh_private("~");
+
+    // pixels skipped per point of the published cloud, larger strides take the cloud building off the tracking cores
+    nh_private.param("cloud_stride", cloud_stride_, 1);
+
+    // edge length of the voxels of the published cloud in meters, every voxel becomes one point
+    double cloud_leaf_size;
+    nh_private.param("cloud_leaf_size", cloud_leaf_size, 0.01);
+
+    // maximum rate of the marker and cloud updates in Hz, updates in between are merged
+    nh_private.param("visualization_rate", visualization_rate_, 10.0);
+
+    point_cloud_aggregator_.reset(new dvo::visualization::PointCloudAggregator(float(cloud_leaf_size)));
     point_cloud_topic_ = nh_.advertise<AsyncPointCloudBuilder::PointCloud>("dvo_vis/cloud", 1, true);
-    update_timer_ = nh_.createTimer(ros::Duration(0.03), &RosCameraTrajectoryVisualizerImpl::update, this, false, true);
+
+    // the marker server advertised its update topic already, advertising it again shares the publication and tells
+    // whether anybody shows the markers
+    marker_update_topic_ = ros::NodeHandle("dvo_vis").advertise<visualization_msgs::InteractiveMarkerUpdate>("update", 100);
+
+    publish_thread_ = boost::thread(&RosCameraTrajectoryVisualizerImpl::publish, this);
   }
 
   ~RosCameraTrajectoryVisualizerImpl()
   {
+    publish_thread_.interrupt();
+    publish_thread_.join();
   }
 
   CameraVisualizer::Ptr camera(std::string name)
   {
+    tbb::mutex::scoped_lock l(visualizers_mutex_);
+
     CameraVisualizerMap::iterator camera = camera_visualizers_.find(name);
 
     if(camera_visualizers_.end() == camera)
     {
       camera = camera_visualizers_.insert(
-          std::make_pair(name, CameraVisualizer::Ptr(new RosCameraVisualizer(name, marker_server_, point_cloud_aggregator_)))
+          std::make_pair(name, RosCameraVisualizerPtr(new RosCameraVisualizer(name, marker_server_, *point_cloud_aggregator_, cloud_stride_)))
       ).first;
     }
 
@@ -408,12 +494,14 @@ struct RosCameraTrajectoryVisualizerImpl
 
   TrajectoryVisualizer::Ptr trajectory(std::string name)
   {
+    tbb::mutex::scoped_lock l(visualizers_mutex_);
+
     TrajectoryVisualizerMap::iterator trajectory = trajectory_visualizers_.find(name);
 
     if(trajectory_visualizers_.end() == trajectory)
     {
       trajectory = trajectory_visualizers_.insert(
-          std::make_pair(name, TrajectoryVisualizer::Ptr(new RosTrajectoryVisualizer(name, marker_server_)))
+          std::make_pair(name, RosTrajectoryVisualizerPtr(new RosTrajectoryVisualizer(name, marker_server_)))
       ).first;
     }
 
@@ -422,29 +510,101 @@ struct RosCameraTrajectoryVisualizerImpl
 
   void reset()
   {
-    camera_visualizers_.clear();
-    trajectory_visualizers_.clear();
+    CameraVisualizerMap cameras;
+    TrajectoryVisualizerMap trajectories;
+
+    {
+      tbb::mutex::scoped_lock l(visualizers_mutex_);
+
+      cameras.swap(camera_visualizers_);
+      trajectories.swap(trajectory_visualizers_);
+    }
+
+    cameras.clear();
+    trajectories.clear();
     marker_server_.applyChanges();
   }
 
+  bool active() const
+  {
+    return point_cloud_topic_.getNumSubscribers() > 0 || marker_update_topic_.getNumSubscribers() > 0;
+  }
+
   interactive_markers::InteractiveMarkerServer* native()
   {
     return &marker_server_;
   }
 private:
   ros::NodeHandle& nh_;
-  ros::Publisher point_cloud_topic_;
-  ros::Timer update_timer_;
+  ros::Publisher point_cloud_topic_, marker_update_topic_;
   interactive_markers::InteractiveMarkerServer marker_server_;
-  dvo::visualization::PointCloudAggregator point_cloud_aggregator_;
+  boost::scoped_ptr<dvo::visualization::PointCloudAggregator> point_cloud_aggregator_;
+  int cloud_stride_;
+  double visualization_rate_;
+
+  tbb::mutex visualizers_mutex_;
   CameraVisualizerMap camera_visualizers_;
   TrajectoryVisualizerMap trajectory_visualizers_;
 
-  void update(const ros::TimerEvent& e)
+  boost::thread publish_thread_;
+
+  void publish()
   {
+    // the visualization only gets the cores the tracking leaves idle
+#ifdef SCHED_IDLE
+    sched_param param;
+    param.sched_priority = 0;
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+
+    const boost::posix_time::time_duration period = boost::posix_time::microseconds(int64_t(1e6 / std::max(visualization_rate_, 0.1)));
+
+    try
+    {
+      while(true)
+      {
+        boost::this_thread::sleep(period);
+
+        // the updates stay pending until somebody subscribes
+        if(!active()) continue;
+
+        update();
+      }
+    }
+    catch(boost::thread_interrupted& e)
+    {
+    }
+  }
+
+  void update()
+  {
+    std::vector<RosCameraVisualizerPtr> cameras;
+    std::vector<RosTrajectoryVisualizerPtr> trajectories;
+
+    {
+      tbb::mutex::scoped_lock l(visualizers_mutex_);
+
+      cameras.reserve(camera_visualizers_.size());
+      trajectories.reserve(trajectory_visualizers_.size());
+
+      for(CameraVisualizerMap::const_iterator it = camera_visualizers_.begin(); it != camera_visualizers_.end(); ++it)
+        cameras.push_back(it->second);
+
+      for(TrajectoryVisualizerMap::const_iterator it = trajectory_visualizers_.begin(); it != trajectory_visualizers_.end(); ++it)
+        trajectories.push_back(it->second);
+    }
+
+    for(std::vector<RosCameraVisualizerPtr>::const_iterator it = cameras.begin(); it != cameras.end(); ++it)
+      (*it)->flush();
+
+    for(std::vector<RosTrajectoryVisualizerPtr>::const_iterator it = trajectories.begin(); it != trajectories.end(); ++it)
+      (*it)->flush();
+
+    marker_server_.applyChanges();
+
     if(point_cloud_topic_.getNumSubscribers() == 0) return;
 
-    dvo::visualization::AsyncPointCloudBuilder::PointCloud::Ptr cloud = point_cloud_aggregator_.build();
+    dvo::visualization::AsyncPointCloudBuilder::PointCloud::Ptr cloud = point_cloud_aggregator_->build();
     cloud->header.frame_id = "/world";
     cloud->is_dense = true;
     point_cloud_topic_.publish(cloud);
@@ -478,6 +638,17 @@ void RosCameraTrajectoryVisualizer::reset()
   impl_->reset();
 }
 
+bool RosCameraTrajectoryVisualizer::requiresRgb() const
+{
+  // without subscribers the clouds of new frames fall back to the intensity
+  return impl_->active();
+}
+
+bool RosCameraTrajectoryVisualizer::active() const
+{
+  return impl_->active();
+}
+
 bool RosCameraTrajectoryVisualizer::native(void*& native_visualizer)
 {
   native_visualizer = impl_->native();
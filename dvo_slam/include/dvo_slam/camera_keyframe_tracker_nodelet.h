@@ -0,0 +1,48 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CAMERA_KEYFRAME_TRACKER_NODELET_H_
+#define CAMERA_KEYFRAME_TRACKER_NODELET_H_
+
+#include <nodelet/nodelet.h>
+
+#include <dvo_slam/camera_keyframe_tracking.h>
+
+namespace dvo_slam
+{
+
+/**
+ * Runs the CameraKeyframeTracker inside a nodelet manager. Loaded into the same manager as the camera driver the
+ * image messages arrive as shared pointers to the driver's buffers, so they are never serialized or copied on the way
+ * into the pyramid.
+ */
+class CameraKeyframeTrackerNodelet : public nodelet::Nodelet
+{
+private:
+  std::auto_ptr<dvo_slam::CameraKeyframeTracker> tracker_;
+public:
+  CameraKeyframeTrackerNodelet();
+  virtual ~CameraKeyframeTrackerNodelet();
+
+  virtual void onInit();
+};
+
+} /* namespace dvo_slam */
+#endif /* CAMERA_KEYFRAME_TRACKER_NODELET_H_ */
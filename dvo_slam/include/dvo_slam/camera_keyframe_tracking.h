@@ -21,6 +21,8 @@
 #ifndef CAMERA_KEYFRAME_TRACKING_H_
 #define CAMERA_KEYFRAME_TRACKING_H_
 
+#include <deque>
+
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
@@ -31,6 +33,7 @@
 
 #include <sensor_msgs/Image.h>
 #include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/Imu.h>
 #include <geometry_msgs/PoseWithCovarianceStamped.h>
 
 #include <image_transport/image_transport.h>
@@ -46,8 +49,14 @@
 #include <dvo/dense_tracking.h>
 #include <dvo/core/intrinsic_matrix.h>
 #include <dvo/core/rgbd_image.h>
+#include <dvo/util/bounded_queue.h>
+#include <dvo/util/mailbox.h>
 
 #include <dvo_slam/keyframe_tracker.h>
+#include <dvo_slam/load_shedding.h>
+#include <dvo_slam/pose_server.h>
+#include <dvo_slam/remote_backend.h>
+#include <dvo_slam/serialization/map_serializer.h>
 
 namespace dvo_slam
 {
@@ -73,7 +82,7 @@ private:
 
   Eigen::Affine3d accumulated_transform;
 
-  ros::Publisher pose_publisher, graph_publisher;
+  ros::Publisher pose_publisher, extrapolated_pose_publisher, corrected_pose_publisher, graph_publisher, graph_delta_publisher, memory_usage_publisher;
   tf::TransformListener tl;
 
   TrackerReconfigureServer tracker_reconfigure_server_;
@@ -84,10 +93,136 @@ private:
 
   boost::mutex tracker_mutex_;
 
+  /**
+   * A frame travels from handleImages() through the prepare stage, which converts the images and builds the pyramid,
+   * to the track stage, which runs the keyframe tracker, visualization and tf publishing. So frame N+1 is prepared
+   * while frame N is tracked.
+   */
+  struct Frame
+  {
+    sensor_msgs::Image::ConstPtr rgb, depth;
+    sensor_msgs::CameraInfo::ConstPtr rgb_camera_info, depth_camera_info;
+
+    // set by the prepare stage
+    dvo::core::RgbdCameraPyramidPtr camera;
+    dvo::core::RgbdImagePyramidPtr image;
+    // the configuration the pyramid was built for, the track stage switches to it with this frame
+    boost::shared_ptr<const dvo::DenseTracker::Config> tracker_cfg;
+  };
+  typedef dvo::util::BoundedQueue<Frame> FrameQueue;
+
+  FrameQueue prepare_queue_, track_queue_;
+
+  // pyramids kept by the camera for reuse besides the queued frames
+  int image_pool_size_;
+  boost::thread prepare_thread_, track_thread_;
+
+  /**
+   * The reconfigure callbacks only post new configurations, the stages pick them up between two frames. So tuning
+   * parameters never blocks a stage. tracker_cfg, keyframe_tracker_cfg and graph_cfg belong to the callbacks.
+   * camera is only replaced by the prepare stage while it holds tracker_mutex_.
+   */
+  dvo::util::Mailbox<dvo::DenseTracker::Config> pending_tracker_cfg_;
+  boost::shared_ptr<const dvo::DenseTracker::Config> prepare_cfg_, track_cfg_;
+
+  struct SlamConfig
+  {
+    dvo_slam::KeyframeTrackerConfig keyframe_tracker_cfg;
+    dvo_slam::KeyframeGraphConfig graph_cfg;
+  };
+
+  dvo::util::Mailbox<SlamConfig> pending_slam_cfg_;
+  SlamConfig track_slam_cfg_;
+
+  // periodic map snapshots written in the background, only if ~map_snapshot_file is set
+  boost::scoped_ptr<dvo_slam::serialization::AsyncBinarySerializer> snapshot_serializer_;
+  ros::Duration snapshot_interval_;
+  ros::Time last_snapshot_;
+
+  // pose of the last tracked frame, extrapolated to now and published on pose_extrapolated and as
+  // base_link_extrapolated every 1 / ~pose_rate seconds, 0 disables it
+  PoseServer pose_server_;
+  ros::Timer pose_timer_;
+
+  void configurePoseServer(ros::NodeHandle& nh, ros::NodeHandle& nh_private);
+  void handlePoseTimer(const ros::TimerEvent& e);
+
+  // drops frames and degrades the tracking while it can't keep up with the sensor, from the parameters in
+  // ~load_shedding. the track stage applies the degradation whenever its generation changed
+  dvo_slam::LoadShedding load_shedding_;
+  size_t load_shedding_generation_;
+
+  void configureLoadShedding(ros::NodeHandle& nh_private);
+
+  // memory usage published on memory_usage every ~memory_usage_interval seconds while it has subscribers, 0 disables it
+  ros::Duration memory_usage_interval_;
+  ros::Time last_memory_usage_;
+
+  // returns false without publishing if the graph is busy inserting a keyframe
+  bool publishMemoryUsage(const std_msgs::Header& header);
+
+  // poses which moved by more than ~graph_delta_translation or ~graph_delta_rotation are published on graph_delta
+  dvo_slam::PoseDeltaArray graph_delta_msg_;
+  double graph_delta_translation_, graph_delta_rotation_;
+  boost::scoped_ptr<dvo_slam::serialization::DeltaMessageSerializer> graph_delta_serializer_;
+
+  // keyframe selection statistics on tracking_diagnostics, only if ~diagnostics is set
+  dvo_slam::TrackingDiagnostics::Ptr diagnostics_;
+
+  // gyroscope samples on imu, only subscribed if ~use_imu is set. the rotation integrated between two frames is the
+  // rotation prior of the motion prediction
+  ros::Subscriber imu_subscriber_;
+  boost::mutex imu_mutex_;
+  std::deque<sensor_msgs::Imu::ConstPtr> imu_queue_;
+  Eigen::Matrix3d imu_to_camera_;
+  bool has_imu_to_camera_;
+  ros::Time last_frame_stamp_;
+
+  void configureImu(ros::NodeHandle& nh, ros::NodeHandle& nh_private);
+  void handleImu(const sensor_msgs::Imu::ConstPtr& imu_msg);
+
+  // rotation of the camera at to relative to from, false if there are no samples in between or no extrinsics
+  bool integrateImu(const ros::Time& from, const ros::Time& to, const std::string& camera_frame, Eigen::Matrix3d& rotation);
+
+  // pixels excluded from tracking, nonzero is usable. the static mask is loaded from ~static_mask, e.g. for the
+  // robot's own body, the dynamic masks arrive on ~dynamic_mask_topic, e.g. from a person detector, and are matched
+  // to the frames by their stamps
+  cv::Mat static_mask_;
+  ros::Subscriber dynamic_mask_subscriber_;
+  boost::mutex dynamic_mask_mutex_;
+  std::deque<sensor_msgs::Image::ConstPtr> dynamic_mask_queue_;
+  ros::Duration dynamic_mask_tolerance_;
+
+  void configureMasks(ros::NodeHandle& nh, ros::NodeHandle& nh_private);
+  void handleDynamicMask(const sensor_msgs::Image::ConstPtr& mask_msg);
+
+  // mask closest to stamp, false if there is none within the tolerance
+  bool findDynamicMask(const ros::Time& stamp, cv::Mat& mask);
+
+  // local maps go to a keyframe graph in another process if ~remote_backend/enabled is set, the pose corrected by it
+  // is published on pose_corrected
+  dvo_slam::RemoteBackendClient::Ptr remote_backend_;
+
+  void configureRemoteBackend(ros::NodeHandle& nh, ros::NodeHandle& nh_private);
+
+  // depth preprocessing of the camera, from the parameters in ~depth_filter
+  dvo::core::DepthFilterConfig depth_filter_cfg_;
+
+  void configurePipeline(ros::NodeHandle& nh_private);
+  void configureSnapshots(ros::NodeHandle& nh_private);
+
+  void handleMapChanged(dvo_slam::KeyframeGraph& map);
+
+  void prepareFrames();
+  void trackFrames();
+
+  void prepare(Frame& frame);
+  void track(Frame& frame);
+
   bool hasChanged(const sensor_msgs::CameraInfo::ConstPtr& camera_info_msg);
   void reset(const sensor_msgs::CameraInfo::ConstPtr& camera_info_msg);
 
-  void publishTransform(const std_msgs::Header& header, const Eigen::Affine3d& transform, const std::string frame);
+  void publishTransform(const std_msgs::Header& header, const Eigen::Affine3d& transform, const std::string frame, ros::Publisher& publisher);
 public:
   CameraKeyframeTracker(ros::NodeHandle& nh, ros::NodeHandle& nh_private);
   virtual ~CameraKeyframeTracker();
@@ -99,6 +234,9 @@ public:
       const sensor_msgs::CameraInfo::ConstPtr& depth_camera_info_msg
   );
 
+  // pose queries on demand, from any thread
+  const PoseServer& poseServer() const;
+
   void handleTrackerConfig(dvo_ros::CameraDenseTrackerConfig& config, uint32_t level);
   void handleSlamConfig(dvo_slam::KeyframeSlamConfig& config, uint32_t level);
 };
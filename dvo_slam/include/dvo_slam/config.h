@@ -22,11 +22,39 @@
 #define CONFIG_H_
 
 #include <ostream>
+#include <string>
 #include <dvo_slam/KeyframeSlamConfig.h>
 
 namespace dvo_slam
 {
 
+struct GraphOptimizationAlgorithms
+{
+  typedef enum
+  {
+    GaussNewton,
+    LevenbergMarquardt,
+    Dogleg
+    // don't forget to add to dynamic reconfigure!
+  } enum_t;
+
+  static const char* str(enum_t type);
+};
+
+struct GraphLinearSolvers
+{
+  typedef enum
+  {
+    CSparse,
+    Cholmod,
+    Pcg,
+    Dense
+    // don't forget to add to dynamic reconfigure!
+  } enum_t;
+
+  static const char* str(enum_t type);
+};
+
 struct KeyframeTrackerConfig
 {
   bool UseMultiThreading;
@@ -36,6 +64,49 @@ struct KeyframeTrackerConfig
   double MinEntropyRatio;
   double MinEquationSystemConstraintRatio;
 
+  // seed the trackers with a constant velocity prediction of the motion, or the rotation prior if there is one
+  bool UseMotionPrediction;
+
+  // pyramid levels skipped by the next match if the last prediction was closer than the max prediction errors
+  int PredictionSkipLevels;
+  double MaxPredictionTranslationError;
+  double MaxPredictionRotationError;
+
+  // a frame whose mean absolute intensity and depth differences to the previous frame on StationaryLevel are below
+  // these, in 0-255 and meters, is stationary. it isn't tracked nor added to the local map and keeps the previous
+  // pose. 0 disables the detection
+  double StationaryMaxIntensityDifference;
+  double StationaryMaxDepthDifference;
+  int StationaryLevel;
+
+  // frames are tracked against a local model, the keyframe points plus the points of the last LocalModelFrames
+  // accepted frames which the keyframe doesn't cover, so a keyframe lasts longer while the camera moves away from it.
+  // 0 tracks against the keyframe only
+  int LocalModelFrames;
+
+  // if there is no confident motion prediction, the initial estimate of the matches comes from ORB features on
+  // SparseInitializationLevel, see SparseMotionEstimator. it is used if at least SparseInitializationMinInliers matches
+  // agree within SparseInitializationInlierThreshold meters
+  bool UseSparseInitialization;
+  int SparseInitializationLevel;
+  int SparseInitializationFeatures;
+  int SparseInitializationMinInliers;
+  double SparseInitializationInlierThreshold;
+
+  // if the odometry and the keyframe tracking both fail, look the frame up among the keyframes within the search
+  // radius around the last tracked pose and the most similar looking ones, at most max candidates of each, see
+  // KeyframeGraph::relocalize()
+  bool UseRelocalization;
+  double RelocalizationSearchRadius;
+  size_t RelocalizationMaxCandidates;
+
+  // threads of the task arenas for the tracking and for building the visualized point clouds, 0 shares the global
+  // scheduler. with a first core >= 0 the arena workers are pinned to consecutive cores, see dvo::util::TaskArenas
+  int FrontendConcurrency;
+  int FrontendFirstCore;
+  int VisualizationConcurrency;
+  int VisualizationFirstCore;
+
   KeyframeTrackerConfig();
 };
 
@@ -49,10 +120,93 @@ struct KeyframeGraphConfig
   double NewConstraintMinEntropyRatioFine;
   double MinEquationSystemConstraintRatio;
 
+  // cheap pre-filter of the constraint candidates before the dense validation, off validates all of them
+  bool UseConstraintRanking;
+  size_t MaxConstraintCandidates;
+  double MinConstraintFrustumOverlap;
+  double MaxConstraintViewAngle;
+
+  // keyframes found by the appearance index added to the nearby ones, see AppearanceConstraintSearch. nearby keyframes
+  // less similar than MinNearbyAppearanceSimilarity are dropped, -1 keeps all of them
+  size_t MaxAppearanceCandidates;
+  double MinAppearanceSimilarity;
+  double MinNearbyAppearanceSimilarity;
+
+  // validated keyframe pairs are only validated again, e.g., by the final optimization, if the graph moved them
+  // relative to each other by more than this since, in meters and degrees. a negative translation disables the cache
+  double ValidationCacheMaxTranslation;
+  double ValidationCacheMaxRotation;
+
   size_t MinConstraintDistance;
   size_t OptimizationIterations;
   size_t OptimizationFinalIterations;
 
+  // number of most recent keyframes optimized after a new keyframe, 0 optimizes the whole graph
+  size_t OptimizationWindowSize;
+
+  // with a radius > 0 the keyframes are grouped into submaps of at most that radius around their first keyframe and
+  // SubmapMaxKeyframes keyframes. new keyframes only optimize the current and the previous submap, loop closures to
+  // older submaps first align the submaps with a coarse graph over their first keyframes and then optimize everything.
+  // replaces OptimizationWindowSize
+  double SubmapRadius;
+  size_t SubmapMaxKeyframes;
+
+  // keyframes of two sensors of a rig at most this far apart in time are connected by their extrinsics, in seconds,
+  // about a frame
+  double MaxRigTimeOffset;
+
+  // queued local maps inserted before one optimization if the backend falls behind, 0 takes all of them
+  size_t MaxKeyframeBatch;
+
+  // algorithm and linear solver of the graph optimization. the sparse factorizations keep their symbolic analysis
+  // while the structure of the system doesn't change, Cholmod factorizes supernodal with the threads of its BLAS. Pcg
+  // solves with a block Jacobi preconditioned conjugate gradient, at most PcgMaxIterations (-1 for the dimension of
+  // the system) until the residual dropped by PcgTolerance
+  GraphOptimizationAlgorithms::enum_t OptimizationAlgorithm;
+  GraphLinearSolvers::enum_t OptimizationLinearSolver;
+  int PcgMaxIterations;
+  double PcgTolerance;
+
+  // use the idle time of the optimization thread to validate more constraint candidates, RefinementKeyframesPerStep
+  // keyframes at a time, and to optimize the whole graph with RefinementIterations. a new local map preempts it, it
+  // stops after an optimization without new constraints improved the error by less than RefinementMinImprovement
+  bool UseBackgroundRefinement;
+  size_t RefinementKeyframesPerStep;
+  size_t RefinementIterations;
+  double RefinementMinImprovement;
+
+  // replace the odometry frames of each local map by a single keyframe to keyframe edge with their marginal
+  // information, the frame poses are recovered from the keyframes when the trajectory is requested
+  bool MarginalizeOdometry;
+
+  // keyframes keeping their full image pyramid in memory, 0 keeps all. the others are restored on demand from a
+  // compressed copy, which is kept in KeyframeCacheFolder if it isn't empty
+  size_t MaxResidentKeyframes;
+  std::string KeyframeCacheFolder;
+
+  // POSIX shared memory object the keyframe images and poses are exported to for other processes, empty disables it,
+  // see SharedKeyframeStore. SharedStoreLevels levels from SharedStoreFirstLevel on of at most SharedStoreCapacity
+  // keyframes are exported
+  std::string SharedStoreName;
+  size_t SharedStoreCapacity;
+  size_t SharedStoreFirstLevel;
+  size_t SharedStoreLevels;
+
+  // integrate the keyframe depth of pyramid level TsdfLevel into a TsdfMap, see KeyframeGraph::tsdfMap(). keyframes
+  // are integrated again once the optimization moved them more than the reintegration thresholds, in meters and radians
+  bool UseTsdfMap;
+  double TsdfVoxelSize;
+  double TsdfTruncation;
+  double TsdfMaxDepth;
+  size_t TsdfLevel;
+  size_t TsdfStride;
+  double TsdfReintegrationTranslation;
+  double TsdfReintegrationRotation;
+
+  // task arena of the constraint validation and the optimization, same as KeyframeTrackerConfig::FrontendConcurrency
+  int BackendConcurrency;
+  int BackendFirstCore;
+
   KeyframeGraphConfig();
 };
 
@@ -68,7 +222,27 @@ std::basic_ostream<_CharT, _Traits>& operator<<(std::basic_ostream<_CharT, _Trai
     << "MaxTranslationalDistance: " << cfg.MaxTranslationalDistance << " "
     << "MaxRotationalDistance: " << cfg.MaxRotationalDistance << " "
     << "MinEntropyRatio: " << cfg.MinEntropyRatio << " "
-    << "MinEquationSystemConstraintRatio: " << cfg.MinEquationSystemConstraintRatio;
+    << "MinEquationSystemConstraintRatio: " << cfg.MinEquationSystemConstraintRatio << " "
+    << "UseMotionPrediction: " << cfg.UseMotionPrediction << " "
+    << "PredictionSkipLevels: " << cfg.PredictionSkipLevels << " "
+    << "MaxPredictionTranslationError: " << cfg.MaxPredictionTranslationError << " "
+    << "MaxPredictionRotationError: " << cfg.MaxPredictionRotationError << " "
+    << "StationaryMaxIntensityDifference: " << cfg.StationaryMaxIntensityDifference << " "
+    << "StationaryMaxDepthDifference: " << cfg.StationaryMaxDepthDifference << " "
+    << "StationaryLevel: " << cfg.StationaryLevel << " "
+    << "LocalModelFrames: " << cfg.LocalModelFrames << " "
+    << "UseSparseInitialization: " << cfg.UseSparseInitialization << " "
+    << "SparseInitializationLevel: " << cfg.SparseInitializationLevel << " "
+    << "SparseInitializationFeatures: " << cfg.SparseInitializationFeatures << " "
+    << "SparseInitializationMinInliers: " << cfg.SparseInitializationMinInliers << " "
+    << "SparseInitializationInlierThreshold: " << cfg.SparseInitializationInlierThreshold << " "
+    << "UseRelocalization: " << cfg.UseRelocalization << " "
+    << "RelocalizationSearchRadius: " << cfg.RelocalizationSearchRadius << " "
+    << "RelocalizationMaxCandidates: " << cfg.RelocalizationMaxCandidates << " "
+    << "FrontendConcurrency: " << cfg.FrontendConcurrency << " "
+    << "FrontendFirstCore: " << cfg.FrontendFirstCore << " "
+    << "VisualizationConcurrency: " << cfg.VisualizationConcurrency << " "
+    << "VisualizationFirstCore: " << cfg.VisualizationFirstCore;
 
   return out;
 }
@@ -83,9 +257,48 @@ std::basic_ostream<_CharT, _Traits>& operator<<(std::basic_ostream<_CharT, _Trai
     << "NewConstraintMinEntropyRatioCoarse: " << cfg.NewConstraintMinEntropyRatioCoarse << " "
     << "NewConstraintMinEntropyRatioFine: " << cfg.NewConstraintMinEntropyRatioFine << " "
     << "MinEquationSystemConstraintRatio: " << cfg.MinEquationSystemConstraintRatio << " "
+    << "UseConstraintRanking: " << cfg.UseConstraintRanking << " "
+    << "MaxConstraintCandidates: " << cfg.MaxConstraintCandidates << " "
+    << "MinConstraintFrustumOverlap: " << cfg.MinConstraintFrustumOverlap << " "
+    << "MaxConstraintViewAngle: " << cfg.MaxConstraintViewAngle << " "
+    << "MaxAppearanceCandidates: " << cfg.MaxAppearanceCandidates << " "
+    << "MinAppearanceSimilarity: " << cfg.MinAppearanceSimilarity << " "
+    << "MinNearbyAppearanceSimilarity: " << cfg.MinNearbyAppearanceSimilarity << " "
+    << "ValidationCacheMaxTranslation: " << cfg.ValidationCacheMaxTranslation << " "
+    << "ValidationCacheMaxRotation: " << cfg.ValidationCacheMaxRotation << " "
     << "MinConstraintDistance: " << cfg.MinConstraintDistance << " "
     << "OptimizationIterations: " << cfg.OptimizationIterations << " "
-    << "OptimizationFinalIterations: " << cfg.OptimizationFinalIterations;
+    << "OptimizationFinalIterations: " << cfg.OptimizationFinalIterations << " "
+    << "OptimizationWindowSize: " << cfg.OptimizationWindowSize << " "
+    << "SubmapRadius: " << cfg.SubmapRadius << " "
+    << "SubmapMaxKeyframes: " << cfg.SubmapMaxKeyframes << " "
+    << "MaxRigTimeOffset: " << cfg.MaxRigTimeOffset << " "
+    << "MaxKeyframeBatch: " << cfg.MaxKeyframeBatch << " "
+    << "OptimizationAlgorithm: " << dvo_slam::GraphOptimizationAlgorithms::str(cfg.OptimizationAlgorithm) << " "
+    << "OptimizationLinearSolver: " << dvo_slam::GraphLinearSolvers::str(cfg.OptimizationLinearSolver) << " "
+    << "PcgMaxIterations: " << cfg.PcgMaxIterations << " "
+    << "PcgTolerance: " << cfg.PcgTolerance << " "
+    << "UseBackgroundRefinement: " << cfg.UseBackgroundRefinement << " "
+    << "RefinementKeyframesPerStep: " << cfg.RefinementKeyframesPerStep << " "
+    << "RefinementIterations: " << cfg.RefinementIterations << " "
+    << "RefinementMinImprovement: " << cfg.RefinementMinImprovement << " "
+    << "MarginalizeOdometry: " << cfg.MarginalizeOdometry << " "
+    << "MaxResidentKeyframes: " << cfg.MaxResidentKeyframes << " "
+    << "KeyframeCacheFolder: " << cfg.KeyframeCacheFolder << " "
+    << "SharedStoreName: " << cfg.SharedStoreName << " "
+    << "SharedStoreCapacity: " << cfg.SharedStoreCapacity << " "
+    << "SharedStoreFirstLevel: " << cfg.SharedStoreFirstLevel << " "
+    << "SharedStoreLevels: " << cfg.SharedStoreLevels << " "
+    << "UseTsdfMap: " << cfg.UseTsdfMap << " "
+    << "TsdfVoxelSize: " << cfg.TsdfVoxelSize << " "
+    << "TsdfTruncation: " << cfg.TsdfTruncation << " "
+    << "TsdfMaxDepth: " << cfg.TsdfMaxDepth << " "
+    << "TsdfLevel: " << cfg.TsdfLevel << " "
+    << "TsdfStride: " << cfg.TsdfStride << " "
+    << "TsdfReintegrationTranslation: " << cfg.TsdfReintegrationTranslation << " "
+    << "TsdfReintegrationRotation: " << cfg.TsdfReintegrationRotation << " "
+    << "BackendConcurrency: " << cfg.BackendConcurrency << " "
+    << "BackendFirstCore: " << cfg.BackendFirstCore;
 
   return out;
 }
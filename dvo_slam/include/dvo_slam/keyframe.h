@@ -22,6 +22,7 @@
 #define KEYFRAME_H_
 
 #include <dvo/core/rgbd_image.h>
+#include <dvo/core/point_selection.h>
 #include <dvo/util/fluent_interface.h>
 
 #include <dvo_slam/tracking_result_evaluation.h>
@@ -37,10 +38,12 @@ class Keyframe
 {
 public:
 
-  Keyframe() : id_(-1) {};
+  Keyframe() : id_(-1), sensor_(0) {};
   virtual ~Keyframe() {};
 
-  FI_ATTRIBUTE(Keyframe, short, id)
+  FI_ATTRIBUTE(Keyframe, int, id)
+  // index of the camera in a multi camera rig, see LocalMap::setSensor()
+  FI_ATTRIBUTE(Keyframe, int, sensor)
   FI_ATTRIBUTE(Keyframe, dvo::core::RgbdImagePyramid::Ptr, image)
   FI_ATTRIBUTE(Keyframe, Eigen::Affine3d, pose)
   FI_ATTRIBUTE(Keyframe, dvo_slam::TrackingResultEvaluation::ConstPtr, evaluation)
@@ -49,6 +52,34 @@ public:
   {
     return ros::Time(image()->timestamp());
   }
+
+  /**
+   * Creates the point selection of image(), which is shared by all trackers using this keyframe as reference.
+   */
+  void initializePoints(const float& intensity_threshold, const float& depth_threshold, const size_t& max_points_per_level = 0, bool morton_order = false);
+
+  /**
+   * Drops the cached points, e.g., after image() was released or rebuilt. Must not be called while the points are used.
+   */
+  void clearPoints();
+
+  bool hasPoints() const
+  {
+    return points_.get() != 0;
+  }
+
+  /**
+   * Selected points and jacobians of image(), cached across all matches. Safe to use from several threads at once.
+   */
+  dvo::core::PointSelection& points()
+  {
+    assert(points_);
+
+    return *points_;
+  }
+private:
+  dvo::core::ValidPointAndGradientThresholdPredicate predicate_;
+  boost::shared_ptr<dvo::core::PointSelection> points_;
 };
 
 typedef boost::shared_ptr<Keyframe> KeyframePtr;
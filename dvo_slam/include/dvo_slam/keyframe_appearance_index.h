@@ -0,0 +1,86 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KEYFRAME_APPEARANCE_INDEX_H_
+#define KEYFRAME_APPEARANCE_INDEX_H_
+
+#include <dvo_slam/keyframe.h>
+
+#include <boost/unordered_map.hpp>
+
+namespace dvo_slam
+{
+
+/**
+ * Global appearance descriptors of all keyframes for loop closure candidates, which the metric search misses or which
+ * look too different to be worth a dense validation. The descriptor is a small blurred thumbnail of a coarse pyramid
+ * level with zero mean and unit length, the similarity of two keyframes the dot product of their descriptors, i.e.,
+ * their normalized cross correlation. A query scans all descriptors, which takes a few microseconds for thousands
+ * of keyframes. Not thread-safe.
+ */
+class KeyframeAppearanceIndex
+{
+public:
+  static const int DescriptorWidth = 16;
+  static const int DescriptorHeight = 12;
+  static const int DescriptorSize = DescriptorWidth * DescriptorHeight;
+
+  KeyframeAppearanceIndex(size_t level = 3);
+  ~KeyframeAppearanceIndex();
+
+  size_t level() const;
+
+  // pyramid level the descriptors are computed from, only affects keyframes inserted afterwards
+  void level(size_t level);
+
+  // computes the descriptor of the keyframe, its image has to be built up to level()
+  void insert(const KeyframePtr& keyframe);
+
+  void clear();
+
+  size_t size() const;
+
+  // in [-1, 1], 0 if one of the keyframes isn't in the index
+  float similarity(const KeyframePtr& a, const KeyframePtr& b) const;
+
+  // appends at most max_results other keyframes with a similarity of at least min_similarity, most similar first
+  void query(const KeyframePtr& keyframe, size_t max_results, float min_similarity, KeyframeVector& result) const;
+
+  // same for the descriptor of an image, which isn't a keyframe, see computeDescriptor()
+  void query(const float* descriptor, size_t max_results, float min_similarity, KeyframeVector& result) const;
+
+  // writes DescriptorSize floats, all 0 for an image without texture
+  static void computeDescriptor(const cv::Mat& intensity, float* descriptor);
+private:
+  typedef boost::unordered_map<int, size_t> IdMap;
+
+  size_t level_;
+  KeyframeVector keyframes_;
+  std::vector<float> descriptors_;
+  IdMap ids_;
+
+  const float* descriptor(const KeyframePtr& keyframe) const;
+
+  // the keyframe with the excluded id is skipped
+  void queryExcluding(const float* descriptor, int excluded_id, size_t max_results, float min_similarity, KeyframeVector& result) const;
+};
+
+} /* namespace dvo_slam */
+#endif /* KEYFRAME_APPEARANCE_INDEX_H_ */
@@ -0,0 +1,78 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KEYFRAME_CONSTRAINT_RANKING_H_
+#define KEYFRAME_CONSTRAINT_RANKING_H_
+
+#include <dvo_slam/keyframe.h>
+
+namespace dvo_slam
+{
+
+/**
+ * Cheap scoring of loop closure candidates before the dense validation, which runs up to three full matches per
+ * candidate. Candidates looking in a too different direction or with too little frustum overlap are dropped, the rest
+ * is ranked by frustum overlap times coarse photometric consistency and only the best ones are kept.
+ */
+class KeyframeConstraintRanking
+{
+public:
+  KeyframeConstraintRanking();
+  ~KeyframeConstraintRanking();
+
+  // disabled, rank() only drops the keyframe itself and keeps the order
+  void enabled(bool enabled);
+
+  // 0 keeps all candidates passing the tests
+  void maxCandidates(size_t n);
+
+  void minFrustumOverlap(double overlap);
+
+  // maximum angle between the optical axes in degrees
+  void maxViewAngle(double degrees);
+
+  // pyramid level of the photometric test, should be the first level of the validation
+  void level(size_t level);
+
+  // removes rejected candidates and sorts the rest, best first, the keyframe and its predecessor are dropped
+  void rank(const KeyframePtr& keyframe, KeyframeVector& candidates) const;
+
+  // 0 if the candidate is rejected, otherwise in (0, 1]
+  double score(const KeyframePtr& keyframe, const KeyframePtr& candidate) const;
+
+  /**
+   * Fraction of points sampled in the reference frustum, at 1m, 2m and 3m depth, which are visible in the other camera.
+   * relative transforms from the reference into the other camera frame, both cameras have the same intrinsics.
+   */
+  static double frustumOverlap(const Eigen::Affine3d& relative, const dvo::core::RgbdCamera& camera);
+
+  /**
+   * Fraction of the keyframe's selected points on the given level, whose intensity is within a small threshold of the
+   * intensity at their projection into the other image. Uses a fixed subset of at most a few hundred points.
+   */
+  static double photometricConsistency(const Eigen::Affine3d& relative, dvo::core::PointSelection& points, dvo::core::RgbdImage& reference, dvo::core::RgbdImage& other, size_t level);
+private:
+  bool enabled_;
+  size_t max_candidates_, level_;
+  double min_frustum_overlap_, min_view_angle_cos_;
+};
+
+} /* namespace dvo_slam */
+#endif /* KEYFRAME_CONSTRAINT_RANKING_H_ */
@@ -22,6 +22,8 @@
 #define KEYFRAME_CONSTRAINT_SEARCH_H_
 
 #include <dvo_slam/keyframe.h>
+#include <dvo_slam/keyframe_spatial_index.h>
+#include <dvo_slam/keyframe_appearance_index.h>
 
 namespace dvo_slam
 {
@@ -37,8 +39,11 @@ typedef boost::shared_ptr<KeyframeConstraintSearchInterface> KeyframeConstraintS
 class NearestNeighborConstraintSearch : public KeyframeConstraintSearchInterface
 {
 public:
-  NearestNeighborConstraintSearch(float max_distance) :
-    max_distance_(max_distance)
+  // with an index the kd-tree over all keyframes isn't rebuilt for every query, the index has to contain the same
+  // keyframes as passed to findPossibleConstraints
+  NearestNeighborConstraintSearch(float max_distance, const KeyframeSpatialIndex* index = 0) :
+    max_distance_(max_distance),
+    index_(index)
   {};
   virtual ~NearestNeighborConstraintSearch() {};
 
@@ -49,20 +54,61 @@ public:
   virtual void findPossibleConstraints(const KeyframeVector& all, const KeyframePtr& keyframe, KeyframeVector& candidates);
 private:
   float max_distance_;
+  const KeyframeSpatialIndex* index_;
 };
 
 class DriftAwareNearestNeighborConstraintSearch : public KeyframeConstraintSearchInterface
 {
 public:
-  DriftAwareNearestNeighborConstraintSearch(float max_distance, float drift_per_second) :
+  DriftAwareNearestNeighborConstraintSearch(float max_distance, float drift_per_second, const KeyframeSpatialIndex* index = 0) :
     max_distance_(max_distance),
-    drift_per_second_(drift_per_second)
+    drift_per_second_(drift_per_second),
+    index_(index)
   {};
   virtual ~DriftAwareNearestNeighborConstraintSearch() {};
 
   virtual void findPossibleConstraints(const KeyframeVector& all, const KeyframePtr& keyframe, KeyframeVector& candidates);
 private:
   float max_distance_, drift_per_second_;
+  const KeyframeSpatialIndex* index_;
+};
+
+/**
+ * Fuses another search, usually a metric one, with the appearance index. Candidates of the other search looking too
+ * different are dropped before the expensive validation, the most similar keyframes missed by it are added.
+ */
+class AppearanceConstraintSearch : public KeyframeConstraintSearchInterface
+{
+public:
+  // the index has to contain the same keyframes as passed to findPossibleConstraints
+  AppearanceConstraintSearch(const KeyframeConstraintSearchInterfacePtr& search, const KeyframeAppearanceIndex* index) :
+    search_(search),
+    index_(index),
+    max_candidates_(0),
+    min_similarity_(1.0f),
+    min_search_similarity_(-1.0f)
+  {};
+  virtual ~AppearanceConstraintSearch() {};
+
+  // keyframes added, which the other search didn't find, 0 disables the appearance candidates
+  void maxCandidates(size_t n);
+
+  // minimum similarity of the added keyframes
+  void minSimilarity(float s);
+
+  // minimum similarity of the candidates found by the other search, -1 keeps all of them
+  void minSearchSimilarity(float s);
+
+  virtual void findPossibleConstraints(const KeyframeVector& all, const KeyframePtr& keyframe, KeyframeVector& candidates);
+
+  // same as above, but keeps the candidates of the other search and the added similar keyframes apart
+  void findPossibleConstraints(const KeyframeVector& all, const KeyframePtr& keyframe, KeyframeVector& nearby, KeyframeVector& similar);
+private:
+  KeyframeConstraintSearchInterfacePtr search_;
+  const KeyframeAppearanceIndex* index_;
+
+  size_t max_candidates_;
+  float min_similarity_, min_search_similarity_;
 };
 
 } /* namespace dvo_slam */
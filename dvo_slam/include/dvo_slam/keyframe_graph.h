@@ -24,12 +24,18 @@
 #include <dvo_slam/config.h>
 #include <dvo_slam/local_map.h>
 #include <dvo_slam/keyframe.h>
+#include <dvo_slam/map_snapshot.h>
+#include <dvo_slam/memory_usage.h>
+#include <dvo_slam/tsdf_map.h>
+#include <dvo_slam/vertex_table.h>
 
 #include <dvo/dense_tracking.h>
 #include <dvo/visualization/camera_trajectory_visualizer.h>
 
 #include <boost/function.hpp>
 
+#include <map>
+
 namespace dvo_slam
 {
 namespace internal
@@ -41,12 +47,39 @@ typedef boost::scoped_ptr<KeyframeGraphImpl> KeyframeGraphImplPtr;
 
 } /* namespace internal */
 
+/**
+ * Vertices and edges of the graph, which changed since a revision, see KeyframeGraph::changes(). Keyframe vertices
+ * have the keyframe id, odometry vertices negative ids.
+ */
+struct MapChangeSet
+{
+  // revision of the graph, pass it to the next changes() call
+  size_t Revision;
+
+  // the graph was replaced, e.g., by restore(), everything known from earlier revisions is outdated
+  bool Full;
+
+  // added or moved vertices
+  std::vector<int> ChangedVertices, RemovedVertices;
+  std::vector<int> AddedEdges, RemovedEdges;
+
+  void clear()
+  {
+    Full = false;
+    ChangedVertices.clear();
+    RemovedVertices.clear();
+    AddedEdges.clear();
+    RemovedEdges.clear();
+  }
+};
+
 class KeyframeGraph
 {
 public:
   typedef void MapChangedCallbackSignature(KeyframeGraph&);
   typedef boost::function<MapChangedCallbackSignature> MapChangedCallback;
 
+  typedef std::map<ros::Time, Eigen::Isometry3d, std::less<ros::Time>, Eigen::aligned_allocator<std::pair<const ros::Time, Eigen::Isometry3d> > > PoseMap;
 
   KeyframeGraph();
   virtual ~KeyframeGraph();
@@ -57,15 +90,85 @@ public:
 
   void configureValidationTracking(const dvo::DenseTracker::Config& cfg);
 
+  /**
+   * Pose of a sensor in the rig frame, see LocalMap::setSensor(). Keyframes of calibrated sensors taken at about the
+   * same time are connected by their relative pose, other sensors only by validated constraints.
+   */
+  void setSensorExtrinsics(int sensor, const Eigen::Isometry3d& rig_to_sensor);
+
+  // never blocks if KeyframeGraphConfig::UseMultiThreading is set, the local map is queued for the optimization thread.
+  // thread-safe, the local maps of every sensor continue their own chain of keyframes
   void add(const LocalMap::Ptr& keyframe);
 
+  // waits until all queued local maps are inserted
   void finalOptimization();
 
+  // local maps queued for insertion and the time in seconds the oldest of them is waiting
+  size_t queueDepth() const;
+  double queueAge() const;
+
   void addMapChangedCallback(const KeyframeGraph::MapChangedCallback& callback);
 
   const KeyframeVector& keyframes() const;
 
+  // empty unless KeyframeGraphConfig::UseTsdfMap is set, can be queried from any thread
+  const TsdfMap& tsdfMap() const;
+
   const g2o::SparseOptimizer& graph() const;
+
+  // timestamps of the vertices of graph()
+  const VertexTable& vertexTable() const;
+
+  // incremented for every map changed signal
+  size_t revision() const;
+
+  /**
+   * Changes after the given revision up to revision(), so map changed callbacks only have to look at what changed
+   * since they were called last. Pass 0 to get everything.
+   */
+  void changes(size_t since, MapChangeSet& changes) const;
+
+  /**
+   * Poses of all frames by timestamp. The poses of marginalized odometry frames, see
+   * KeyframeGraphConfig::MarginalizeOdometry, are recovered from the current keyframe poses.
+   */
+  void trajectory(PoseMap& poses) const;
+
+  /**
+   * Copies the state of the map. If wait is false and a keyframe is being inserted, nothing is copied and false is
+   * returned. Must not be called from a map changed callback.
+   */
+  bool snapshot(MapSnapshot& snapshot, bool wait = true) const;
+
+  /**
+   * Adds the bytes of the keyframes and of the graph to usage, the other subsystems are not touched. Like snapshot(),
+   * returns false without waiting for a keyframe being inserted if wait is false.
+   */
+  bool memoryUsage(MemoryUsage& usage, bool wait = true) const;
+
+  /**
+   * Replaces the map with the snapshot. The keyframe images are created with the given camera, which has to outlive
+   * them. Must not be called while keyframes are added.
+   */
+  bool restore(const MapSnapshot& snapshot, dvo::core::RgbdCameraPyramid& camera);
+
+  /**
+   * Adds the snapshot of another session or robot, e.g., read with serialization::MapSnapshotReader, to the map. Its
+   * ids are moved behind the ones in use and its poses by the initial alignment into the map frame. Constraints
+   * between the maps are searched near the aligned poses and among the most similar looking keyframes, validated in
+   * parallel like loop closures, and then the joint graph is optimized once. Returns the number of constraints found,
+   * without any the imported map stays at the initial alignment. The camera has to outlive the keyframes.
+   */
+  size_t merge(const MapSnapshot& snapshot, dvo::core::RgbdCameraPyramid& camera, const Eigen::Isometry3d& initial_alignment = Eigen::Isometry3d::Identity());
+
+  /**
+   * Looks up the pose of an image the tracking lost, e.g., after fast motion or occlusion. The keyframes within the
+   * radius around the hint, usually the last tracked pose, and the ones looking most similar, at most max_candidates
+   * of both, are matched in parallel on the coarse validation level, and the best one is refined like a loop closure.
+   * Returns false if none passes the constraint validation thresholds, otherwise pose is the pose of the image in the
+   * map and information the one of the match relative to the keyframe. Blocks while a keyframe is inserted.
+   */
+  bool relocalize(const dvo::core::RgbdImagePyramid::Ptr& image, const Eigen::Affine3d& hint, double radius, size_t max_candidates, Eigen::Affine3d& pose, dvo::core::Matrix6d& information);
 private:
   internal::KeyframeGraphImplPtr impl_;
 };
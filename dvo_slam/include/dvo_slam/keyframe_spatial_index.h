@@ -0,0 +1,87 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KEYFRAME_SPATIAL_INDEX_H_
+#define KEYFRAME_SPATIAL_INDEX_H_
+
+#include <dvo_slam/keyframe.h>
+
+#include <boost/unordered_map.hpp>
+
+namespace dvo_slam
+{
+
+/**
+ * Persistent voxel hash over the keyframe positions, replaces building a kd-tree from all keyframes for every query.
+ * Inserting a keyframe and moving one to its new pose are O(1), a radius search only visits the cells overlapping the
+ * search sphere. Not thread-safe.
+ */
+class KeyframeSpatialIndex
+{
+public:
+  KeyframeSpatialIndex(double cell_size = 1.0);
+  ~KeyframeSpatialIndex();
+
+  double cellSize() const;
+
+  // rehashes all keyframes, the cell size should be close to the usual search radius
+  void cellSize(double size);
+
+  void insert(const KeyframePtr& keyframe);
+
+  // moves the keyframes to their current pose, has to be called after the graph optimization changed them. only the
+  // keyframes inserted from the first one on are moved, e.g., if only they were optimized
+  void update(size_t first = 0);
+
+  void clear();
+
+  size_t size() const;
+
+  // timestamp of the oldest keyframe in the index
+  ros::Time oldestTimestamp() const;
+
+  // appends all keyframes within radius of the position in insertion order
+  void radiusSearch(const Eigen::Vector3d& position, double radius, KeyframeVector& result) const;
+private:
+  typedef long long CellKey;
+  typedef boost::unordered_map<CellKey, std::vector<size_t> > CellMap;
+
+  struct Entry
+  {
+    KeyframePtr keyframe;
+    Eigen::Vector3d position;
+    CellKey cell;
+  };
+
+  double cell_size_;
+  std::vector<Entry> entries_;
+  CellMap cells_;
+
+  ros::Time oldest_timestamp_;
+
+  void cellCoordinates(const Eigen::Vector3d& p, int& x, int& y, int& z) const;
+  CellKey cellKey(int x, int y, int z) const;
+  CellKey cellKey(const Eigen::Vector3d& p) const;
+
+  void removeFromCell(CellKey cell, size_t entry);
+};
+
+} /* namespace dvo_slam */
+#endif /* KEYFRAME_SPATIAL_INDEX_H_ */
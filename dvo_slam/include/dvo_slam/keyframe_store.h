@@ -0,0 +1,125 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef KEYFRAME_STORE_H_
+#define KEYFRAME_STORE_H_
+
+#include <dvo_slam/keyframe.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+namespace dvo_slam
+{
+
+/**
+ * Bounds the memory used by the keyframe images. Only the most recently used keyframes keep their full pyramid, the
+ * others only the coarse levels needed for the candidate ranking. The base level of an evicted keyframe is kept PNG
+ * compressed, in memory or in a cache folder, and the pyramid is rebuilt from it, when acquire() is called before a
+ * validation. Intensity is stored with a precision of 1/256, depth with 0.2mm up to 13m. The rgb image isn't kept, a
+ * restored keyframe has none, which only the visualization of the point clouds uses.
+ *
+ * Not thread-safe, acquire() and trim() must not be called while other threads use the keyframe images.
+ */
+class KeyframeStore
+{
+public:
+  KeyframeStore();
+  ~KeyframeStore();
+
+  // number of keyframes with a full pyramid, 0 keeps all, the newest keyframe is never evicted
+  void maxResident(size_t n);
+
+  // levels from this one on stay in memory
+  void keptLevel(size_t level);
+
+  // number of levels built when a keyframe is restored
+  void numLevels(size_t levels);
+
+  // existing folder for the compressed base images, empty keeps them in memory
+  void cacheFolder(const std::string& folder);
+
+  void add(const KeyframePtr& keyframe);
+
+  // restores the full pyramid if necessary and marks the keyframe as used, false if it couldn't be restored
+  bool acquire(const KeyframePtr& keyframe);
+
+  // same as above, drops the keyframes which couldn't be restored
+  void acquire(KeyframeVector& keyframes);
+
+  // evicts the least recently used keyframes until at most maxResident are left
+  void trim();
+
+  // evicts the keyframe again right away, e.g., after it was restored for a single use. the newest keyframe and the
+  // keyframes of a store keeping all of them stay resident
+  void release(const KeyframePtr& keyframe);
+
+  size_t residentCount() const;
+
+  bool overBudget() const;
+
+  void clear();
+
+  // compressed base images of a keyframe, which was evicted, false if it is resident or unknown
+  bool compressed(int id, cv::Mat& intensity, cv::Mat& depth) const;
+
+  // whether the keyframe has a full pyramid and the bytes of its compressed base images in memory, false if unknown
+  bool usage(int id, bool& resident, size_t& compressed_bytes) const;
+
+  /**
+   * PNG compression of the float base images as used by the store, also for map snapshots. decode() returns images
+   * suitable for dvo::core::RgbdImagePyramid::reset().
+   */
+  static bool encode(const cv::Mat& intensity_float, const cv::Mat& depth_float, std::vector<unsigned char>& intensity, std::vector<unsigned char>& depth);
+  static bool decode(const cv::Mat& intensity, const cv::Mat& depth, cv::Mat& intensity_float, cv::Mat& depth_float);
+private:
+  struct Entry
+  {
+    KeyframePtr keyframe;
+    bool resident;
+    size_t last_use;
+
+    // compressed base level, either in memory or in a file
+    std::vector<unsigned char> intensity, depth;
+    std::string intensity_file, depth_file;
+    bool has_spill;
+  };
+  typedef boost::unordered_map<int, Entry> EntryMap;
+
+  size_t max_resident_, kept_level_, num_levels_, resident_, clock_;
+  std::string folder_;
+  EntryMap entries_;
+  int newest_;
+
+  void evict(Entry& e);
+  bool restore(Entry& e);
+  bool spill(Entry& e);
+
+  // compressed base images of a spilled entry
+  bool load(const Entry& e, cv::Mat& intensity, cv::Mat& depth) const;
+
+  static bool writeFile(const std::string& file, const std::vector<unsigned char>& data);
+  static bool readFile(const std::string& file, cv::Mat& data);
+};
+
+} /* namespace dvo_slam */
+#endif /* KEYFRAME_STORE_H_ */
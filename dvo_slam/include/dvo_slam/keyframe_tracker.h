@@ -25,6 +25,8 @@
 #include <dvo/dense_tracking.h>
 
 #include <dvo_slam/config.h>
+#include <dvo_slam/keyframe_graph.h>
+#include <dvo_slam/tracking_diagnostics.h>
 #include <dvo_slam/serialization/map_serializer_interface.h>
 #include <dvo_slam/visualization/graph_visualizer.h>
 
@@ -33,17 +35,30 @@
 namespace dvo_slam
 {
 
+class RemoteBackendClient;
+
 class KeyframeTracker
 {
 public:
+  typedef boost::function<void (const dvo_slam::LocalMap::Ptr&)> KeyframeCallback;
+
   KeyframeTracker(dvo_slam::visualization::GraphVisualizer* visualizer = 0);
 
+  /**
+   * Tracks one camera of a rig, the local maps are tagged with the sensor index and added to the shared graph. Only one
+   * of the trackers sharing the graph should get the visualizer.
+   */
+  KeyframeTracker(const boost::shared_ptr<dvo_slam::KeyframeGraph>& graph, int sensor, dvo_slam::visualization::GraphVisualizer* visualizer = 0);
+
   const dvo::DenseTracker::Config& trackingConfiguration() const;
   const dvo_slam::KeyframeTrackerConfig& keyframeSelectionConfiguration() const;
   const dvo_slam::KeyframeGraphConfig& mappingConfiguration() const;
 
   void configureTracking(const dvo::DenseTracker::Config& cfg);
 
+  // only the frame to keyframe tracking, e.g. to degrade it for a while, the loop closure validation keeps its config
+  void configureLocalTracking(const dvo::DenseTracker::Config& cfg);
+
   void configureKeyframeSelection(const dvo_slam::KeyframeTrackerConfig& cfg);
 
   void configureMapping(const dvo_slam::KeyframeGraphConfig& cfg);
@@ -53,11 +68,36 @@ public:
 
   void update(const dvo::core::RgbdImagePyramid::Ptr& current, const ros::Time& current_time, Eigen::Affine3d& absolute_transformation);
 
+  // rotation of the next frame relative to the last one, used by the motion prediction of the next update
+  void setRotationPrior(const Eigen::Matrix3d& rotation);
+
   void forceKeyframe();
 
+  // statistics of the keyframe selection for every frame, off by default, set it before the first update
+  void diagnostics(const dvo_slam::TrackingDiagnostics::Ptr& diagnostics);
+
+  /**
+   * Sends the completed local maps to a graph in another process instead of the local graph, which then stays empty
+   * and isn't used for relocalization. Set it before the first update.
+   */
+  void remoteBackend(const boost::shared_ptr<dvo_slam::RemoteBackendClient>& client);
+
   void finish();
 
   void serializeMap(dvo_slam::serialization::MapSerializerInterface& serializer);
+
+  /**
+   * Bytes per subsystem and per keyframe, see MemoryUsage. Has to be called from the thread calling update(). If wait
+   * is false, returns false without waiting for a keyframe being inserted into the graph. Trackers sharing a graph all
+   * report it.
+   */
+  bool memoryUsage(dvo_slam::MemoryUsage& usage, bool wait = true) const;
+
+  // called from the mapping thread whenever the map changed
+  void addMapChangedCallback(const dvo_slam::KeyframeGraph::MapChangedCallback& callback);
+
+  // called from update() whenever a local map is complete and was handed to the graph
+  void addKeyframeCallback(const KeyframeCallback& callback);
 private:
   class Impl;
   boost::shared_ptr<Impl> impl_;
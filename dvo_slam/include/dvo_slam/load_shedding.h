@@ -0,0 +1,138 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOAD_SHEDDING_H_
+#define LOAD_SHEDDING_H_
+
+#include <ostream>
+
+#include <tbb/spin_mutex.h>
+
+#include <dvo/dense_tracking.h>
+
+namespace dvo_slam
+{
+
+struct LoadSheddingConfig
+{
+  bool Enabled;
+
+  // the tracking degrades while the smoothed processing time of a frame exceeds TargetLoad times the time available
+  // for it, and recovers while it stays below RecoverLoad
+  double TargetLoad, RecoverLoad;
+
+  // weight of the newest sample in the moving averages of the processing time and the sensor period
+  double Smoothing;
+
+  // tracked frames to wait after a decision, so the averages reflect it before the next one
+  int HoldFrames;
+
+  // the degradation steps in the order they are taken: track only every n-th frame up to MaxFrameStride, raise
+  // LastLevel by up to MaxLastLevelIncrease levels, cap the iterations per level at MaxIterations
+  int MaxFrameStride;
+  int MaxLastLevelIncrease;
+  int MaxIterations;
+
+  LoadSheddingConfig();
+};
+
+/**
+ * Keeps the tracking up with the sensor. The processing time of every tracked frame is compared against the time
+ * available for it, i.e. the sensor period times the frame stride. While it falls behind, the tracking degrades one
+ * step at a time: first intermediate frames are dropped, then the finest pyramid level is skipped, finally the
+ * iterations are capped. It recovers in the reverse order. The newest frame is always the one tracked, older ones are
+ * dropped by the pipeline queues anyway.
+ *
+ * accept() is called for every arriving frame, update() after every tracked one, possibly from different threads.
+ * Every decision is counted in the "load_shedding/..." timers of the Instrumentation.
+ */
+class LoadShedding
+{
+public:
+  enum Step
+  {
+    None = 0,
+    DropFrames,
+    ReduceLevels,
+    CapIterations
+  };
+
+  LoadShedding();
+
+  void configure(const LoadSheddingConfig& cfg);
+
+  const LoadSheddingConfig& configuration() const;
+
+  // back to full quality, e.g. after a reset of the tracker
+  void reset();
+
+  // whether the frame with the given stamp in seconds should be tracked, also estimates the sensor period
+  bool accept(double stamp);
+
+  // processing time of the last tracked frame in seconds
+  void update(double seconds);
+
+  // changes whenever the tracking configuration has to be degraded differently
+  size_t generation() const;
+
+  // the tracking configuration with the current degradation applied
+  void degrade(const dvo::DenseTracker::Config& cfg, dvo::DenseTracker::Config& degraded) const;
+
+  Step step() const;
+private:
+  LoadSheddingConfig cfg_;
+
+  mutable tbb::spin_mutex mutex_;
+
+  // sensor period, smoothed processing time of the tracked frames, both in seconds
+  double last_stamp_, period_, processing_time_;
+
+  int frame_stride_, frames_since_accepted_, last_level_increase_;
+  bool cap_iterations_;
+  int hold_;
+
+  size_t generation_;
+
+  Step currentStep() const;
+
+  // one step down or up, false if there is none left
+  bool degradeStep();
+  bool recoverStep();
+};
+
+} /* namespace dvo_slam */
+
+template<typename _CharT, typename _Traits>
+std::basic_ostream<_CharT, _Traits>& operator<<(std::basic_ostream<_CharT, _Traits>& out, const dvo_slam::LoadSheddingConfig& cfg)
+{
+  out
+    << "Enabled: " << cfg.Enabled << " "
+    << "TargetLoad: " << cfg.TargetLoad << " "
+    << "RecoverLoad: " << cfg.RecoverLoad << " "
+    << "Smoothing: " << cfg.Smoothing << " "
+    << "HoldFrames: " << cfg.HoldFrames << " "
+    << "MaxFrameStride: " << cfg.MaxFrameStride << " "
+    << "MaxLastLevelIncrease: " << cfg.MaxLastLevelIncrease << " "
+    << "MaxIterations: " << cfg.MaxIterations;
+
+  return out;
+}
+
+#endif /* LOAD_SHEDDING_H_ */
@@ -21,6 +21,11 @@
 #ifndef LOCAL_MAP_H_
 #define LOCAL_MAP_H_
 
+#include <vector>
+
+#include <Eigen/StdVector>
+#include <ros/time.h>
+
 #include <g2o/core/sparse_optimizer.h>
 
 #include <dvo/core/rgbd_image.h>
@@ -40,6 +45,9 @@ public:
   typedef boost::shared_ptr<LocalMap> Ptr;
   typedef boost::shared_ptr<const LocalMap> ConstPtr;
 
+  typedef std::pair<ros::Time, Eigen::Isometry3d> FramePose;
+  typedef std::vector<FramePose, Eigen::aligned_allocator<FramePose> > FramePoseVector;
+
   virtual ~LocalMap();
 
   /**
@@ -58,10 +66,19 @@ public:
 
   g2o::SparseOptimizer& getGraph();
 
+  // timestamp of a vertex of getGraph() by its id in the local map, i.e., before the keyframe graph renumbers it
+  ros::Time getVertexTimestamp(int id) const;
+
   void setEvaluation(dvo_slam::TrackingResultEvaluation::ConstPtr& evaluation);
 
   dvo_slam::TrackingResultEvaluation::ConstPtr getEvaluation();
 
+  /**
+   * Index of the camera which recorded the map, 0 unless several cameras feed the same KeyframeGraph.
+   */
+  void setSensor(int sensor);
+  int getSensor() const;
+
   /**
    * Adds a new RGB-D frame to the map, which becomes the active one.
    */
@@ -78,6 +95,22 @@ public:
   void addKeyframeMeasurement(const dvo::core::AffineTransformd& pose, const dvo::core::Matrix6d& information);
 
   void optimize();
+
+  /**
+   * Summarizes the optimized map by the pose of the current frame relative to the keyframe and its marginal
+   * information. The poses of the other frames relative to the keyframe are appended to frames. Returns false if the
+   * marginal couldn't be computed, then the information of the direct keyframe measurement is used.
+   */
+  bool marginalize(Eigen::Isometry3d& keyframe_to_current, dvo::core::Matrix6d& information, FramePoseVector& frames);
+
+  /**
+   * Releases the frame vertices and edges once the map was merged into the keyframe graph, the keyframe, the current
+   * frame and its pose stay available. No frames or measurements can be added afterwards.
+   */
+  void compact();
+
+  // bytes of the keyframe, the current frame and the frame graph, see MemoryUsage
+  size_t memoryUsage() const;
 private:
   LocalMap(const dvo::core::RgbdImagePyramid::Ptr& keyframe, const dvo::core::AffineTransformd& keyframe_pose);
 
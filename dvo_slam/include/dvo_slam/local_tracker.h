@@ -24,8 +24,11 @@
 #include <dvo/core/rgbd_image.h>
 #include <dvo/dense_tracking.h>
 
+#include <dvo_slam/config.h>
 #include <dvo_slam/local_map.h>
+#include <dvo_slam/memory_usage.h>
 
+#include <boost/function.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/signals2.hpp>
 
@@ -42,33 +45,26 @@ class LocalTracker
 public:
   typedef ::dvo::DenseTracker::Result TrackingResult;
 
-  struct All
-  {
-    typedef bool result_type;
-
-    template<typename InputIterator>
-    bool operator()(InputIterator first, InputIterator last) const
-    {
-      int i = 0;
-      bool result = true;
-      //std::cerr << "votes: ";
-      for(;first != last; ++first)
-      {
-        bool tmp = *first;
-        result = result && tmp;
-
-        //std::cerr << tmp << " ";
-        i++;
-      }
-
-      //std::cerr << std::endl;
-
-      return result;
-    }
-  };
-
-  typedef boost::signals2::signal<bool (const dvo_slam::LocalTracker&, const dvo_slam::LocalTracker::TrackingResult&, const dvo_slam::LocalTracker::TrackingResult&), dvo_slam::LocalTracker::All> AcceptSignal;
-  typedef AcceptSignal::slot_type AcceptCallback;
+  /**
+   * Keyframe selection criterion, returns false if the frame should complete the current local map and start a new one.
+   * Criteria are evaluated in the order they were added and the first rejecting one stops the evaluation, so cheap
+   * criteria should be added first.
+   */
+  typedef boost::function<bool (const dvo_slam::LocalTracker&, const dvo_slam::LocalTracker::TrackingResult&, const dvo_slam::LocalTracker::TrackingResult&)> AcceptCallback;
+
+  /**
+   * Called for every frame before the criteria, in the order they were added, and may correct the results. Returns
+   * false to reject the frame, the remaining filters are still called.
+   */
+  typedef boost::function<bool (const dvo_slam::LocalTracker&, dvo_slam::LocalTracker::TrackingResult&, dvo_slam::LocalTracker::TrackingResult&)> FilterCallback;
+
+  /**
+   * Called when the odometry and the keyframe tracking both lost the camera, with the image and the last tracked pose.
+   * Returns true if it found the image in the map and sets its pose and the information of that estimate, e.g., with
+   * KeyframeGraph::relocalize().
+   */
+  typedef boost::function<bool (const dvo_slam::LocalTracker&, const dvo::core::RgbdImagePyramid::Ptr&, const dvo::core::AffineTransformd&, dvo::core::AffineTransformd&, dvo::core::Matrix6d&)> RelocalizeCallback;
+
   typedef boost::signals2::signal<void (const dvo_slam::LocalTracker&, const dvo_slam::LocalMap::Ptr&, const dvo_slam::LocalTracker::TrackingResult&)> MapInitializedSignal;
   typedef MapInitializedSignal::slot_type MapInitializedCallback;
   typedef boost::signals2::signal<void (const dvo_slam::LocalTracker&, const dvo_slam::LocalMap::Ptr&)> MapCompleteSignal;
@@ -79,6 +75,9 @@ public:
 
   dvo_slam::LocalMap::Ptr getLocalMap() const;
 
+  // adds the bytes of the local map and of the trackers to usage, has to be called from the thread calling update()
+  void memoryUsage(dvo_slam::MemoryUsage& usage) const;
+
   void getCurrentPose(dvo::core::AffineTransformd& pose);
 
   void initNewLocalMap(const dvo::core::RgbdImagePyramid::Ptr& keyframe, const dvo::core::RgbdImagePyramid::Ptr& frame, const dvo::core::AffineTransformd& keyframe_pose = dvo::core::AffineTransformd::Identity());
@@ -87,11 +86,28 @@ public:
 
   void configure(const dvo::DenseTracker::Config& config);
 
+  // the motion prediction options of the keyframe tracker configuration
+  void configurePrediction(const dvo_slam::KeyframeTrackerConfig& config);
+
+  /**
+   * Rotation of the next frame relative to the current one, e.g. integrated from a gyroscope. It replaces the rotation
+   * of the constant velocity prediction in the next update, if Config::UseMotionPrediction is set.
+   */
+  void setRotationPrior(const Eigen::Matrix3d& rotation);
+
+  // frames of a stationary camera, see KeyframeTrackerConfig::StationaryMaxIntensityDifference, are skipped and get
+  // the pose of the last tracked frame
   void update(const dvo::core::RgbdImagePyramid::Ptr& image, dvo::core::AffineTransformd& pose);
 
   void forceCompleteCurrentLocalMap();
 
-  boost::signals2::connection addAcceptCallback(const AcceptCallback& callback);
+  // the name identifies the timer of the callback, "local_tracker/accept/<name>" or "local_tracker/filter/<name>"
+  void addAcceptCallback(const std::string& name, const AcceptCallback& callback);
+  void addFilterCallback(const std::string& name, const FilterCallback& callback);
+
+  // replaces the previous one, an empty callback disables the relocalization
+  void setRelocalizeCallback(const RelocalizeCallback& callback);
+
   boost::signals2::connection addMapInitializedCallback(const MapInitializedCallback& callback);
   boost::signals2::connection addMapCompleteCallback(const MapCompleteCallback& callback);
 private:
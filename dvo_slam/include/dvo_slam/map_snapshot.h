@@ -0,0 +1,120 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAP_SNAPSHOT_H_
+#define MAP_SNAPSHOT_H_
+
+#include <vector>
+
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+#include <opencv2/core/core.hpp>
+
+#include <dvo/core/datatypes.h>
+
+namespace dvo_slam
+{
+
+/**
+ * Copy of the state of a KeyframeGraph, which is enough to restore it, see KeyframeGraph::snapshot() and
+ * KeyframeGraph::restore(). Taking a snapshot only copies poses and shares the keyframes' base images, so the
+ * expensive compression and writing can be done on another thread, see serialization::AsyncBinarySerializer.
+ */
+struct MapSnapshot
+{
+  struct Keyframe
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    int Id;
+    double Timestamp;
+    Eigen::Isometry3d Pose;
+
+    // TrackingResultEvaluation::Type and accumulated values, HasEvaluation is false if the keyframe had none
+    bool HasEvaluation;
+    int EvaluationType;
+    double EvaluationFirst, EvaluationSum, EvaluationCount;
+
+    // base level images, empty if the keyframe was evicted by the KeyframeStore, then the compressed ones are set
+    cv::Mat Intensity, Depth;
+
+    // PNG compressed base images, see KeyframeStore::encode()
+    cv::Mat EncodedIntensity, EncodedDepth;
+  };
+
+  struct Vertex
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    int Id;
+    double Timestamp;
+    Eigen::Isometry3d Pose;
+    bool Fixed;
+  };
+
+  struct Edge
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    int Id, Level, From, To;
+    bool Robust;
+    Eigen::Isometry3d Measurement;
+    dvo::core::Matrix6d Information;
+  };
+
+  struct FramePose
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    double Timestamp;
+    Eigen::Isometry3d Pose;
+  };
+
+  typedef std::vector<FramePose, Eigen::aligned_allocator<FramePose> > FramePoseVector;
+
+  // odometry frames, which were marginalized, see KeyframeGraphConfig::MarginalizeOdometry
+  struct Segment
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    int Begin, End;
+    double BeginTimestamp, EndTimestamp;
+    Eigen::Isometry3d BeginToEnd;
+    FramePoseVector Frames;
+  };
+
+  std::vector<Keyframe, Eigen::aligned_allocator<Keyframe> > Keyframes;
+  std::vector<Vertex, Eigen::aligned_allocator<Vertex> > Vertices;
+  std::vector<Edge, Eigen::aligned_allocator<Edge> > Edges;
+  std::vector<Segment, Eigen::aligned_allocator<Segment> > Segments;
+
+  int NextKeyframeId, NextOdometryVertexId, NextOdometryEdgeId;
+
+  void clear()
+  {
+    Keyframes.clear();
+    Vertices.clear();
+    Edges.clear();
+    Segments.clear();
+  }
+};
+
+} /* namespace dvo_slam */
+#endif /* MAP_SNAPSHOT_H_ */
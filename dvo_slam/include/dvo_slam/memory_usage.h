@@ -0,0 +1,106 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MEMORY_USAGE_H_
+#define MEMORY_USAGE_H_
+
+#include <ostream>
+#include <cstddef>
+#include <vector>
+
+namespace dvo_slam
+{
+
+/**
+ * Bytes held by the parts of the slam system, see KeyframeTracker::memoryUsage(). Images are counted by the buffers of
+ * their cv::Mat headers, so a buffer shared by several images, e.g., the keyframe of the local map which also becomes a
+ * keyframe of the graph, is counted for each of them. g2o vertices and edges are counted by their object size, the
+ * containers of the graph are not included.
+ */
+struct MemoryUsage
+{
+  struct Keyframe
+  {
+    int Id;
+
+    // false if the keyframe store evicted the fine levels
+    bool Resident;
+
+    // image pyramid, selected points and jacobians, compressed base images kept in memory by the keyframe store
+    size_t Pyramid, Points, Compressed;
+  };
+
+  // sums over Keyframes
+  size_t KeyframePyramids, KeyframePoints, KeyframeCompressed;
+
+  size_t GraphVertices, GraphEdges;
+
+  // keyframe, current frame and graph of the local map being tracked
+  size_t LocalMap;
+
+  // point selections and residual buffers of the local trackers
+  size_t Tracker;
+
+  // voxel blocks of the TsdfMap
+  size_t Volume;
+
+  std::vector<Keyframe> Keyframes;
+
+  MemoryUsage()
+  {
+    clear();
+  }
+
+  void clear()
+  {
+    KeyframePyramids = KeyframePoints = KeyframeCompressed = 0;
+    GraphVertices = GraphEdges = 0;
+    LocalMap = Tracker = 0;
+    Volume = 0;
+    Keyframes.clear();
+  }
+
+  size_t total() const
+  {
+    return KeyframePyramids + KeyframePoints + KeyframeCompressed + GraphVertices + GraphEdges + LocalMap + Tracker + Volume;
+  }
+};
+
+} /* namespace dvo_slam */
+
+template<typename _CharT, typename _Traits>
+std::basic_ostream<_CharT, _Traits>& operator<<(std::basic_ostream<_CharT, _Traits>& out, const dvo_slam::MemoryUsage& usage)
+{
+  out
+    << "Keyframes: " << usage.Keyframes.size() << " "
+    << "KeyframePyramids: " << usage.KeyframePyramids << " "
+    << "KeyframePoints: " << usage.KeyframePoints << " "
+    << "KeyframeCompressed: " << usage.KeyframeCompressed << " "
+    << "GraphVertices: " << usage.GraphVertices << " "
+    << "GraphEdges: " << usage.GraphEdges << " "
+    << "LocalMap: " << usage.LocalMap << " "
+    << "Tracker: " << usage.Tracker << " "
+    << "Volume: " << usage.Volume << " "
+    << "Total: " << usage.total();
+
+  return out;
+}
+
+#endif /* MEMORY_USAGE_H_ */
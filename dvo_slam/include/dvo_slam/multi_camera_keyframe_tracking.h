@@ -0,0 +1,178 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MULTI_CAMERA_KEYFRAME_TRACKING_H_
+#define MULTI_CAMERA_KEYFRAME_TRACKING_H_
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <tbb/atomic.h>
+
+#include <ros/ros.h>
+
+#include <tf/transform_listener.h>
+#include <tf/transform_broadcaster.h>
+
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
+
+#include <message_filters/subscriber.h>
+#include <message_filters/synchronizer.h>
+
+#include <Eigen/Geometry>
+
+#include <dynamic_reconfigure/server.h>
+
+#include <dvo_ros/camera_base.h>
+#include <dvo_ros/CameraDenseTrackerConfig.h>
+
+#include <dvo/dense_tracking.h>
+#include <dvo/core/rgbd_image.h>
+#include <dvo/util/bounded_queue.h>
+#include <dvo/util/mailbox.h>
+
+#include <dvo_slam/config.h>
+#include <dvo_slam/keyframe_graph.h>
+#include <dvo_slam/keyframe_tracker.h>
+
+namespace dvo_slam
+{
+
+/**
+ * SLAM front end for a rig of several RGB-D cameras. Every camera in ~cameras, e.g. "camera1 camera2", is subscribed
+ * in its namespace and tracked by its own KeyframeTracker on its own thread. All of them feed one KeyframeGraph.
+ *
+ * The extrinsics are looked up in tf from ~rig_frame to the optical frame of the first image of a camera. When one
+ * camera takes a keyframe, all others take one with their next frame, so the keyframes of the rig are connected by the
+ * calibration and constraints between the cameras are searched like any other loop closure.
+ */
+class MultiCameraKeyframeTracker
+{
+public:
+  MultiCameraKeyframeTracker(ros::NodeHandle& nh, ros::NodeHandle& nh_private);
+  ~MultiCameraKeyframeTracker();
+
+  void handleTrackerConfig(dvo_ros::CameraDenseTrackerConfig& config, uint32_t level);
+  void handleSlamConfig(dvo_slam::KeyframeSlamConfig& config, uint32_t level);
+private:
+  typedef dynamic_reconfigure::Server<dvo_ros::CameraDenseTrackerConfig> TrackerReconfigureServer;
+  typedef dynamic_reconfigure::Server<dvo_slam::KeyframeSlamConfig> SlamReconfigureServer;
+
+  struct Frame
+  {
+    sensor_msgs::Image::ConstPtr rgb, depth;
+    sensor_msgs::CameraInfo::ConstPtr rgb_camera_info;
+  };
+  typedef dvo::util::BoundedQueue<Frame> FrameQueue;
+
+  struct SlamConfig
+  {
+    dvo_slam::KeyframeTrackerConfig keyframe_tracker_cfg;
+    dvo_slam::KeyframeGraphConfig graph_cfg;
+  };
+
+  /**
+   * Everything but the subscription is only used by the thread of the camera.
+   */
+  struct Camera
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Camera(ros::NodeHandle& nh, const std::string& name, int sensor);
+
+    std::string name;
+    int sensor;
+
+    message_filters::Subscriber<sensor_msgs::Image> rgb_image_subscriber, depth_image_subscriber;
+    message_filters::Subscriber<sensor_msgs::CameraInfo> rgb_camera_info_subscriber, depth_camera_info_subscriber;
+    message_filters::Synchronizer<dvo_ros::RGBDWithCameraInfoPolicy> synchronizer;
+
+    FrameQueue queue;
+    boost::thread thread;
+
+    dvo::util::Mailbox<dvo::DenseTracker::Config> pending_tracker_cfg;
+    // only the trackers of the cameras, the shared graph is configured by the reconfigure callbacks
+    dvo::util::Mailbox<dvo_slam::KeyframeTrackerConfig> pending_keyframe_cfg;
+    dvo::DenseTracker::Config tracker_cfg;
+    dvo_slam::KeyframeTrackerConfig keyframe_cfg;
+
+    boost::shared_ptr<dvo_slam::KeyframeTracker> tracker;
+    dvo::core::RgbdCameraPyramidPtr camera;
+    dvo::core::RgbdImagePyramidPtr current, reference;
+
+    // from the parameters in ~<name>/depth_filter
+    dvo::core::DepthFilterConfig depth_filter;
+    uint32_t width, height;
+
+    bool has_extrinsics;
+    Eigen::Affine3d rig_to_camera, pose;
+
+    // the last rig keyframe this camera followed, and whether it forced the keyframe itself
+    size_t rig_keyframe;
+    bool forced;
+  };
+
+  ros::NodeHandle nh_;
+  std::string rig_frame_;
+
+  // pyramids kept by each camera for reuse, at least reference and current
+  int image_pool_size_;
+
+  tf::TransformListener tl_;
+  tf::TransformBroadcaster tb_;
+  ros::Publisher pose_publisher_;
+
+  TrackerReconfigureServer tracker_reconfigure_server_;
+  SlamReconfigureServer slam_reconfigure_server_;
+
+  // belong to the reconfigure callbacks
+  dvo::DenseTracker::Config tracker_cfg_;
+  SlamConfig slam_cfg_;
+
+  boost::shared_ptr<dvo_slam::KeyframeGraph> graph_;
+  std::vector<boost::shared_ptr<Camera> > cameras_;
+
+  // incremented whenever a camera completes a local map on its own
+  tbb::atomic<size_t> rig_keyframe_;
+
+  void handleImages(
+      Camera& camera,
+      const sensor_msgs::Image::ConstPtr& rgb_image_msg,
+      const sensor_msgs::Image::ConstPtr& depth_image_msg,
+      const sensor_msgs::CameraInfo::ConstPtr& rgb_camera_info_msg,
+      const sensor_msgs::CameraInfo::ConstPtr& depth_camera_info_msg
+  );
+
+  void handleKeyframe(Camera& camera);
+
+  void trackFrames(Camera& camera);
+  void track(Camera& camera, const Frame& frame);
+  void initialize(Camera& camera, const Frame& frame);
+
+  void publishTransform(const std_msgs::Header& header, const Eigen::Affine3d& transform, const std::string& frame);
+};
+
+} /* namespace dvo_slam */
+#endif /* MULTI_CAMERA_KEYFRAME_TRACKING_H_ */
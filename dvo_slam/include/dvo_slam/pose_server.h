@@ -0,0 +1,85 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef POSE_SERVER_H_
+#define POSE_SERVER_H_
+
+#include <Eigen/Geometry>
+
+#include <dvo/util/seqlock.h>
+
+namespace dvo_slam
+{
+
+/**
+ * Latest tracked pose for consumers which can't wait for the next frame, e.g. controllers. The tracking thread
+ * updates it with the pose of every frame at its capture time, queries from any thread extrapolate it to the
+ * requested time with the velocity between the last two frames. Queries read a lock-free snapshot, so they never
+ * wait for the tracking.
+ */
+class PoseServer
+{
+public:
+  struct State
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    // capture time of the frame in seconds, false before the first one
+    double Stamp;
+    bool Valid;
+
+    Eigen::Affine3d Pose;
+
+    // twist in the camera frame per second, zero if the last two frames were too far apart
+    Eigen::Matrix<double, 6, 1> Velocity;
+
+    State();
+  };
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  // queries never extrapolate further than max_extrapolation seconds from the last frame
+  explicit PoseServer(double max_extrapolation = 0.1);
+
+  void maxExtrapolation(double seconds);
+  double maxExtrapolation() const;
+
+  // writer side, update() and reset() must not be called concurrently
+  void update(double stamp, const Eigen::Affine3d& pose);
+  void reset();
+
+  // any thread, false before the first update
+  bool query(double stamp, Eigen::Affine3d& pose) const;
+
+  void latest(State& state) const;
+
+  // changes with every update and reset, e.g. to publish only new frames
+  size_t version() const;
+private:
+  dvo::util::Seqlock<State> state_;
+
+  // copy of the writer
+  State last_;
+
+  double max_extrapolation_;
+};
+
+} /* namespace dvo_slam */
+#endif /* POSE_SERVER_H_ */
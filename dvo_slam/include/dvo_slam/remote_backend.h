@@ -0,0 +1,104 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef REMOTE_BACKEND_H_
+#define REMOTE_BACKEND_H_
+
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <Eigen/Geometry>
+
+#include <ros/ros.h>
+
+#include <dvo_slam/keyframe_graph.h>
+#include <dvo_slam/local_map.h>
+
+namespace dvo_slam
+{
+
+namespace internal
+{
+  class RemoteBackendClientImpl;
+  class RemoteBackendServerImpl;
+} /* namespace internal */
+
+/**
+ * Frontend side of a KeyframeGraph running in another process, usually on another machine. Completed local maps are
+ * published as LocalMapPacket on "local_maps" and kept until the backend acknowledges them on "backend_feedback",
+ * unacknowledged ones are sent again after resend_timeout seconds. The feedback carries the correction of the
+ * frontend poses by the optimized graph.
+ *
+ * add() only queues the map, encoding and sending happen on a background thread, so the tracking keeps running while
+ * the backend is slow or unreachable. If more than max_queued_maps maps are waiting, the oldest one is dropped and
+ * the backend continues the chain of the sensor at the next map it receives.
+ */
+class RemoteBackendClient
+{
+public:
+  typedef boost::shared_ptr<RemoteBackendClient> Ptr;
+
+  RemoteBackendClient(ros::NodeHandle& nh, int sensor, size_t max_queued_maps = 64, double resend_timeout = 1.0);
+  ~RemoteBackendClient();
+
+  // the map is encoded on the background thread, so it must not be changed afterwards
+  void add(const LocalMap::Ptr& map);
+
+  /**
+   * Transforms poses of the frontend into the frame of the remote graph, identity until the first feedback. Lock
+   * free, can be called from any thread.
+   */
+  Eigen::Isometry3d correction() const;
+
+  // revision of the remote graph the correction is from, 0 before the first feedback
+  size_t revision() const;
+
+  // true if feedback arrived within the last resend timeout
+  bool connected() const;
+
+  // maps queued or waiting for their acknowledgement, and the ones dropped so far
+  size_t pending() const;
+  size_t dropped() const;
+private:
+  boost::scoped_ptr<internal::RemoteBackendClientImpl> impl_;
+};
+
+/**
+ * Backend side, adds the local maps of any number of RemoteBackendClients to the graph. Packets are reordered by
+ * their sequence number per sensor. A missing one is waited for up to gap_timeout seconds, or until max_reordered
+ * later packets arrived, then it is skipped. The keyframes get num_levels pyramid levels, which has to cover the
+ * validation and constraint trackers of the graph. The server registers a map changed callback, so it has to live as
+ * long as the graph.
+ */
+class RemoteBackendServer
+{
+public:
+  RemoteBackendServer(ros::NodeHandle& nh, const boost::shared_ptr<KeyframeGraph>& graph, size_t num_levels, double gap_timeout = 5.0, size_t max_reordered = 32);
+  ~RemoteBackendServer();
+
+  // local maps added to the graph so far and the ones lost to gaps or decoding errors
+  size_t received() const;
+  size_t skipped() const;
+private:
+  boost::scoped_ptr<internal::RemoteBackendServerImpl> impl_;
+};
+
+} /* namespace dvo_slam */
+#endif /* REMOTE_BACKEND_H_ */
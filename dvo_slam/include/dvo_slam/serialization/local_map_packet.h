@@ -0,0 +1,89 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOCAL_MAP_PACKET_H_
+#define LOCAL_MAP_PACKET_H_
+
+#include <vector>
+
+#include <stdint.h>
+
+#include <dvo_slam/local_map.h>
+
+namespace dvo_slam
+{
+namespace serialization
+{
+
+/**
+ * Compact binary encoding of a completed LocalMap, which a frontend sends to a remote KeyframeGraph. All values are
+ * little endian and unaligned:
+ *
+ *   header | camera | evaluation | intensity PNG | depth PNG | frames
+ *
+ * Only the keyframe pose is stored in double precision. Every frame stores its time offset to the keyframe in
+ * microseconds, its measurements as translation and quaternion vector in float, and the upper triangle of their
+ * information. The keyframe measurement is relative to the one of the previous frame, so the values stay small and
+ * the receiver sums them up in double precision. The version has to be incremented whenever the encoding changes.
+ */
+static const char LocalMapPacketMagic[4] = { 'D', 'V', 'O', 'L' };
+static const uint16_t LocalMapPacketVersion = 1;
+
+struct LocalMapPacketInfo
+{
+  int32_t Sensor;
+  uint32_t Sequence;
+  double KeyframeTimestamp;
+
+  // pose of the keyframe in the frame of the sender
+  Eigen::Isometry3d KeyframePose;
+
+  uint32_t NumFrames;
+
+  size_t Size;
+};
+
+/**
+ * Appends the encoding of the map to packet. The map has to be complete, i.e., every frame has a keyframe
+ * measurement, and not yet compacted. Returns false otherwise or if the images can't be compressed.
+ */
+bool encodeLocalMapPacket(const LocalMap::Ptr& map, uint32_t sequence, std::vector<uint8_t>& packet);
+
+/**
+ * Reads the header of a packet without decoding the images.
+ */
+bool decodeLocalMapPacketInfo(const uint8_t* data, size_t size, LocalMapPacketInfo& info);
+
+/**
+ * Recreates the local map of a packet, the keyframe has num_levels levels. The other frames only carry their
+ * timestamp, which is all the keyframe graph uses of them. The images of the keyframe reference camera, so it has to
+ * outlive the map.
+ */
+bool decodeLocalMapPacket(const uint8_t* data, size_t size, dvo::core::RgbdCameraPyramid& camera, size_t num_levels, LocalMap::Ptr& map, LocalMapPacketInfo& info);
+
+/**
+ * Intrinsics of the keyframe camera stored in a packet, so the receiver can set up the camera passed to
+ * decodeLocalMapPacket().
+ */
+bool decodeLocalMapPacketCamera(const uint8_t* data, size_t size, size_t& width, size_t& height, dvo::core::IntrinsicMatrix& intrinsics);
+
+} /* namespace serialization */
+} /* namespace dvo_slam */
+#endif /* LOCAL_MAP_PACKET_H_ */
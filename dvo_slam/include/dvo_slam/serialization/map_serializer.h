@@ -22,9 +22,17 @@
 #define MAP_SERIALIZER_H_
 
 #include <iostream>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+#include <tbb/concurrent_queue.h>
+#include <tbb/tbb_thread.h>
 
 #include <dvo_slam/serialization/map_serializer_interface.h>
 #include <dvo_slam/PoseStampedArray.h>
+#include <dvo_slam/PoseDeltaArray.h>
+
+#include <boost/unordered_map.hpp>
 
 namespace dvo_slam
 {
@@ -89,6 +97,66 @@ private:
   dvo_slam::PoseStampedArray& msg_;
 };
 
+/**
+ * Fills msg with the poses, which changed since the last call, see KeyframeGraph::changes(). Poses moving less than
+ * the thresholds, in metres and radians, since they were sent last are left out, so keep one instance per receiver.
+ */
+class DeltaMessageSerializer : public MapSerializerInterface
+{
+public:
+  DeltaMessageSerializer(dvo_slam::PoseDeltaArray& msg, double translation_threshold = 0.01, double rotation_threshold = 0.01);
+  virtual ~DeltaMessageSerializer();
+
+  virtual void serialize(const dvo_slam::KeyframeGraph& map);
+private:
+  typedef boost::unordered_map<int, Eigen::Isometry3d, boost::hash<int>, std::equal_to<int>, Eigen::aligned_allocator<std::pair<const int, Eigen::Isometry3d> > > PoseMap;
+
+  dvo_slam::PoseDeltaArray& msg_;
+  double translation_threshold_, rotation_threshold_;
+
+  size_t revision_;
+  dvo_slam::MapChangeSet changes_;
+
+  // last sent pose of every vertex
+  PoseMap sent_;
+};
+
+/**
+ * Writes a binary snapshot of the map, which can be loaded with MapSnapshotReader and KeyframeGraph::restore().
+ */
+class BinarySerializer : public MapSerializerInterface
+{
+public:
+  BinarySerializer(const std::string& file);
+  virtual ~BinarySerializer();
+
+  virtual void serialize(const dvo_slam::KeyframeGraph& map);
+private:
+  std::string file_;
+};
+
+/**
+ * Like BinarySerializer, but only the snapshot is taken on the calling thread, the images are compressed and written
+ * by a background thread. Instead of blocking, serialize() skips the snapshot if the previous one is still pending or
+ * a keyframe is being inserted.
+ */
+class AsyncBinarySerializer : public MapSerializerInterface
+{
+public:
+  AsyncBinarySerializer(const std::string& file);
+  virtual ~AsyncBinarySerializer();
+
+  virtual void serialize(const dvo_slam::KeyframeGraph& map);
+private:
+  typedef boost::shared_ptr<dvo_slam::MapSnapshot> MapSnapshotPtr;
+
+  std::string file_;
+  tbb::concurrent_bounded_queue<MapSnapshotPtr> queue_;
+  tbb::tbb_thread thread_;
+
+  void write();
+};
+
 } /* namespace serialization */
 } /* namespace dvo_slam */
 #endif /* MAP_SERIALIZER_H_ */
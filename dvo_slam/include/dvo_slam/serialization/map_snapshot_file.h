@@ -0,0 +1,151 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MAP_SNAPSHOT_FILE_H_
+#define MAP_SNAPSHOT_FILE_H_
+
+#include <string>
+
+#include <stdint.h>
+
+#include <dvo_slam/map_snapshot.h>
+
+namespace dvo_slam
+{
+namespace serialization
+{
+
+/**
+ * Binary MapSnapshot file, all values are little endian and tables start at SnapshotAlignment byte boundaries:
+ *
+ *   SnapshotHeader | PNG images ... | SnapshotKeyframe[] | SnapshotVertex[] | SnapshotEdge[] | SnapshotSegment[] | SnapshotFrame[]
+ *
+ * The version has to be incremented whenever one of the records changes.
+ */
+static const char SnapshotMagic[8] = { 'D', 'V', 'O', 'M', 'A', 'P', '\0', '\0' };
+static const uint32_t SnapshotVersion = 1;
+static const uint64_t SnapshotAlignment = 16;
+
+struct SnapshotHeader
+{
+  char Magic[8];
+  uint32_t Version;
+
+  int32_t NextKeyframeId, NextOdometryVertexId, NextOdometryEdgeId;
+
+  uint32_t NumKeyframes, NumVertices, NumEdges, NumSegments, NumFrames;
+  uint64_t KeyframeOffset, VertexOffset, EdgeOffset, SegmentOffset, FrameOffset;
+};
+
+struct SnapshotPose
+{
+  double Translation[3];
+
+  // x, y, z, w
+  double Rotation[4];
+};
+
+struct SnapshotKeyframe
+{
+  int32_t Id;
+
+  // TrackingResultEvaluation::Type, -1 if the keyframe has no evaluation
+  int32_t EvaluationType;
+
+  double Timestamp;
+  SnapshotPose Pose;
+  double EvaluationFirst, EvaluationSum, EvaluationCount;
+
+  uint64_t IntensityOffset, IntensitySize, DepthOffset, DepthSize;
+};
+
+struct SnapshotVertex
+{
+  int32_t Id;
+  uint32_t Fixed;
+
+  double Timestamp;
+  SnapshotPose Pose;
+};
+
+struct SnapshotEdge
+{
+  int32_t Id, Level, From, To;
+  uint32_t Robust, Reserved;
+
+  SnapshotPose Measurement;
+
+  // row major
+  double Information[36];
+};
+
+struct SnapshotSegment
+{
+  int32_t Begin, End;
+
+  // range in the SnapshotFrame table
+  uint32_t FirstFrame, NumFrames;
+
+  double BeginTimestamp, EndTimestamp;
+  SnapshotPose BeginToEnd;
+};
+
+struct SnapshotFrame
+{
+  double Timestamp;
+  SnapshotPose Pose;
+};
+
+/**
+ * Compresses the images and writes the snapshot. The file is replaced atomically, so a crash while writing leaves the
+ * previous snapshot intact.
+ */
+bool writeMapSnapshot(const dvo_slam::MapSnapshot& snapshot, const std::string& file);
+
+/**
+ * Memory maps a snapshot file. Opening only validates the header and the tables. The compressed images returned by
+ * read() point into the mapping, so they are only valid while the reader exists.
+ */
+class MapSnapshotReader
+{
+public:
+  MapSnapshotReader(const std::string& file);
+  ~MapSnapshotReader();
+
+  bool good() const;
+
+  bool read(dvo_slam::MapSnapshot& snapshot) const;
+private:
+  const char* data_;
+  size_t size_;
+
+  const SnapshotHeader* header_;
+
+  MapSnapshotReader(const MapSnapshotReader&);
+  MapSnapshotReader& operator=(const MapSnapshotReader&);
+
+  bool validate();
+  bool contains(uint64_t offset, uint64_t size) const;
+  void unmap();
+};
+
+} /* namespace serialization */
+} /* namespace dvo_slam */
+#endif /* MAP_SNAPSHOT_FILE_H_ */
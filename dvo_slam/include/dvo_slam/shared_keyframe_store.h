@@ -0,0 +1,157 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHARED_KEYFRAME_STORE_H_
+#define SHARED_KEYFRAME_STORE_H_
+
+#include <dvo_slam/keyframe.h>
+
+#include <string>
+
+#include <stdint.h>
+
+#include <boost/unordered_map.hpp>
+#include <opencv2/core/core.hpp>
+
+namespace dvo_slam
+{
+
+namespace internal
+{
+struct SharedStoreHeader;
+} /* namespace internal */
+
+/**
+ * Keyframes of the graph in a POSIX shared memory object, so other processes, e.g., visualization, map export or
+ * planning, can map them read-only without copying or serializing anything in the SLAM process. Every keyframe gets
+ * a slot with a compact pyramid, intensity in 8 bit and depth in 16 bit fixed point with 0.2mm, of the levels from
+ * firstLevel() on, and its pose. The images of a slot are written once before the slot is published, the poses are
+ * rewritten after every optimization under a seqlock per slot, see dvo::util::Seqlock.
+ *
+ * Written by KeyframeGraph on its optimization thread, see KeyframeGraphConfig::SharedStoreName, and read with
+ * SharedKeyframeView. The object is created with the size of the first keyframe, keyframes of other sizes and the ones
+ * beyond the capacity aren't exported.
+ */
+class SharedKeyframeStore
+{
+public:
+  SharedKeyframeStore();
+  ~SharedKeyframeStore();
+
+  // name of the shared memory object, e.g., "/dvo_slam_keyframes", empty disables the store. a change recreates it
+  // with the next keyframe
+  void configure(const std::string& name, size_t capacity, size_t first_level, size_t num_levels);
+
+  bool enabled() const;
+
+  // writes the images and pose of the keyframe into the next free slot, false if it isn't exported
+  bool add(const KeyframePtr& keyframe);
+
+  // exports the keyframes which aren't yet and rewrites the poses of all, bumps the revision readers poll
+  void update(const KeyframeVector& keyframes);
+
+  // drops all slots, e.g., after the graph was replaced. the object is recreated with the next keyframe, so readers
+  // still using images of the old one see it as stale instead of the images being overwritten
+  void clear();
+
+  size_t size() const;
+private:
+  SharedKeyframeStore(const SharedKeyframeStore&);
+  SharedKeyframeStore& operator=(const SharedKeyframeStore&);
+
+  std::string name_;
+  size_t capacity_, first_level_, num_levels_;
+
+  // generation of the next object, counts the clear() calls
+  uint64_t generation_;
+
+  char* data_;
+  size_t bytes_;
+  internal::SharedStoreHeader* header_;
+
+  // slot of each keyframe id, which add() was called for
+  boost::unordered_map<int, size_t> slots_;
+
+  bool create(const KeyframePtr& keyframe);
+  void unmap();
+};
+
+/**
+ * Read-only mapping of a SharedKeyframeStore in another process. Reads never block the writer: poses are copied under
+ * the seqlock of their slot, images are views into the mapping, which stay valid until the view is closed, also after
+ * the writer closed or recreated the store.
+ */
+class SharedKeyframeView
+{
+public:
+  struct Keyframe
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    int Id, Sensor;
+    double Timestamp;
+    Eigen::Affine3d Pose;
+  };
+
+  // depth images hold the depth in meters times DepthScale, 0 is invalid
+  static const float DepthScale;
+
+  SharedKeyframeView();
+  ~SharedKeyframeView();
+
+  // false if there is no store with this name or it was written by an incompatible version
+  bool open(const std::string& name);
+  void close();
+
+  bool good() const;
+
+  // the writer closed or recreated the store, which has to be opened again to see new keyframes
+  bool stale() const;
+
+  // published slots, the first ones of a generation never move
+  size_t size() const;
+
+  // changes whenever poses or keyframes were written, e.g., to redraw only after changes
+  uint64_t revision() const;
+
+  // changes with every clear() of the writer, which recreates the store, see stale()
+  uint64_t generation() const;
+
+  size_t firstLevel() const;
+  size_t numLevels() const;
+
+  // false if the slot isn't published or the writer died while storing its pose
+  bool keyframe(size_t slot, Keyframe& keyframe) const;
+
+  // level counted from firstLevel(), CV_8UC1 intensity and CV_16UC1 depth without copying
+  bool images(size_t slot, size_t level, cv::Mat& intensity, cv::Mat& depth) const;
+private:
+  SharedKeyframeView(const SharedKeyframeView&);
+  SharedKeyframeView& operator=(const SharedKeyframeView&);
+
+  const char* data_;
+  size_t bytes_;
+  const internal::SharedStoreHeader* header_;
+
+  void unmap();
+};
+
+} /* namespace dvo_slam */
+#endif /* SHARED_KEYFRAME_STORE_H_ */
@@ -0,0 +1,93 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPARSE_MOTION_ESTIMATOR_H_
+#define SPARSE_MOTION_ESTIMATOR_H_
+
+#include <dvo/core/datatypes.h>
+#include <dvo/core/rgbd_image.h>
+
+#include <vector>
+
+#include <stdint.h>
+
+#include <opencv2/core/core.hpp>
+
+namespace dvo_slam
+{
+
+/**
+ * Coarse motion between two frames from ORB features on one pyramid level, the initial estimate of the dense matches
+ * if there is no motion prior or it was wrong, e.g., during fast motion, where the dense matches need many iterations
+ * on the coarse levels or fail. Features with valid depth are back-projected, matched by their descriptors with a
+ * cross check, and the rigid motion is found by RANSAC over minimal sets of three 3D-3D matches and refined on the
+ * inliers. The features of the last current frame are kept, so a frame which becomes the reference isn't detected
+ * again. Not thread-safe.
+ */
+class SparseMotionEstimator
+{
+public:
+  SparseMotionEstimator();
+  ~SparseMotionEstimator();
+
+  // inlier_threshold is the distance in meters between matched points for a match to support a motion, which needs
+  // at least min_inliers supporting matches
+  void configure(size_t level, int max_features, int min_inliers, float inlier_threshold, int iterations);
+
+  size_t level() const;
+
+  /**
+   * Motion of the current frame relative to the reference, i.e., the pose of the current frame in the reference frame
+   * like dvo::DenseTracker::match() returns it. Both have to be built up to level(). False if too few matches agree.
+   */
+  bool estimate(dvo::core::RgbdImagePyramid& reference, dvo::core::RgbdImagePyramid& current, dvo::core::AffineTransformd& motion);
+
+  // supporting matches of the last estimate
+  size_t inliers() const;
+
+  // forgets the kept features
+  void reset();
+private:
+  struct Features
+  {
+    const dvo::core::RgbdImagePyramid* image;
+    uint64_t revision;
+
+    // back-projected keypoints with valid depth and their descriptors, one row per point
+    std::vector<Eigen::Vector3f> points;
+    cv::Mat descriptors;
+  };
+
+  size_t level_;
+  int max_features_, min_inliers_, iterations_;
+  float inlier_threshold_;
+
+  Features reference_, current_;
+  size_t inliers_;
+
+  void detect(dvo::core::RgbdImagePyramid& image, Features& features) const;
+
+  static bool holds(const Features& features, const dvo::core::RgbdImagePyramid& image);
+
+  size_t countInliers(const std::vector<Eigen::Vector3f>& reference, const std::vector<Eigen::Vector3f>& current, const Eigen::Affine3f& motion, std::vector<size_t>* inliers) const;
+};
+
+} /* namespace dvo_slam */
+#endif /* SPARSE_MOTION_ESTIMATOR_H_ */
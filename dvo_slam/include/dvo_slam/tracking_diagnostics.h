@@ -0,0 +1,64 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TRACKING_DIAGNOSTICS_H_
+#define TRACKING_DIAGNOSTICS_H_
+
+#include <ros/ros.h>
+
+#include <tbb/spin_mutex.h>
+
+#include <dvo_slam/local_tracker.h>
+
+namespace dvo_slam
+{
+
+/**
+ * Aggregates statistics of the keyframe selection and publishes them as one KeyframeTrackingDiagnostics message per
+ * period on the "tracking_diagnostics" topic. Nothing is computed while the topic has no subscribers.
+ */
+class TrackingDiagnostics
+{
+public:
+  typedef boost::shared_ptr<TrackingDiagnostics> Ptr;
+
+  // rate of the messages in Hz
+  TrackingDiagnostics(ros::NodeHandle& nh, double rate = 1.0);
+  ~TrackingDiagnostics();
+
+  bool active() const;
+
+  // called from the tracking thread for every frame, entropy_ratio is the one the keyframe selection compared
+  void add(const LocalTracker::TrackingResult& r_odometry, const LocalTracker::TrackingResult& r_keyframe, double entropy_ratio);
+private:
+  ros::Publisher publisher_;
+  ros::Timer timer_;
+
+  tbb::spin_mutex sums_mutex_;
+  size_t frames_;
+  double odometry_nll_, keyframe_nll_, entropy_ratio_, odometry_kappa_, keyframe_kappa_, min_entropy_ratio_;
+
+  void reset();
+
+  void publish(const ros::TimerEvent& e);
+};
+
+} /* namespace dvo_slam */
+#endif /* TRACKING_DIAGNOSTICS_H_ */
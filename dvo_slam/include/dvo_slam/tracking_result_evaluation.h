@@ -34,8 +34,25 @@ public:
   typedef boost::shared_ptr<TrackingResultEvaluation> Ptr;
   typedef boost::shared_ptr<const TrackingResultEvaluation> ConstPtr;
 
+  enum Type
+  {
+    LogLikelihood,
+    NormalizedLogLikelihood,
+    EntropyRatio
+  };
+
+  /**
+   * Recreates an evaluation from its accumulated values, e.g., when a map is restored.
+   */
+  static Ptr create(Type type, double first, double sum, double count);
+
   virtual ~TrackingResultEvaluation() {};
 
+  virtual Type type() const = 0;
+
+  // accumulated values, see create()
+  void state(double& first, double& sum, double& count) const;
+
   virtual void add(const dvo::DenseTracker::Result& r);
 
   virtual double ratioWithFirst(const dvo::DenseTracker::Result& r) const;
@@ -54,7 +71,9 @@ class LogLikelihoodTrackingResultEvaluation : public TrackingResultEvaluation
 {
 public:
   LogLikelihoodTrackingResultEvaluation(const dvo::DenseTracker::Result& r) : TrackingResultEvaluation(value(r)) {};
+  explicit LogLikelihoodTrackingResultEvaluation(double first) : TrackingResultEvaluation(first) {};
   virtual ~LogLikelihoodTrackingResultEvaluation() {};
+  virtual Type type() const { return LogLikelihood; };
   virtual double value(const dvo::DenseTracker::Result& r) const;
 };
 
@@ -62,7 +81,9 @@ class NormalizedLogLikelihoodTrackingResultEvaluation : public TrackingResultEva
 {
 public:
   NormalizedLogLikelihoodTrackingResultEvaluation(const dvo::DenseTracker::Result& r) : TrackingResultEvaluation(value(r)) {};
+  explicit NormalizedLogLikelihoodTrackingResultEvaluation(double first) : TrackingResultEvaluation(first) {};
   virtual ~NormalizedLogLikelihoodTrackingResultEvaluation() {};
+  virtual Type type() const { return NormalizedLogLikelihood; };
   virtual double value(const dvo::DenseTracker::Result& r) const;
 };
 
@@ -71,7 +92,9 @@ class EntropyRatioTrackingResultEvaluation : public TrackingResultEvaluation
 {
 public:
   EntropyRatioTrackingResultEvaluation(const dvo::DenseTracker::Result& r) : TrackingResultEvaluation(value(r)) {};
+  explicit EntropyRatioTrackingResultEvaluation(double first) : TrackingResultEvaluation(first) {};
   virtual ~EntropyRatioTrackingResultEvaluation() {};
+  virtual Type type() const { return EntropyRatio; };
   virtual double value(const dvo::DenseTracker::Result& r) const;
 };
 
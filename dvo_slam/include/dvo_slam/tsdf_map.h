@@ -0,0 +1,146 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TSDF_MAP_H_
+#define TSDF_MAP_H_
+
+#include <dvo/core/rgbd_image.h>
+
+#include <vector>
+
+#include <stdint.h>
+
+#include <boost/unordered_map.hpp>
+#include <Eigen/Geometry>
+#include <tbb/mutex.h>
+
+namespace dvo_slam
+{
+
+/**
+ * Hashed truncated signed distance volume of the keyframe depth images, a dense map whose size grows with the observed
+ * surfaces instead of the number of keyframes like the accumulated point clouds. Voxels are allocated in blocks of 8^3
+ * close to the measured depth only. A keyframe is integrated with its pose and moved by integrating it again with a
+ * new one, which first takes its measurements out with the old pose, so the volume follows the graph optimization.
+ * Only the poses are kept per keyframe, the images have to be passed in again for a move.
+ *
+ * Thread-safe, queries wait for the integration of at most one image.
+ */
+class TsdfMap
+{
+public:
+  struct Point
+  {
+    Eigen::Vector3f Position, Normal;
+    float Intensity, Weight;
+  };
+  typedef std::vector<Point> PointVector;
+
+  TsdfMap();
+  ~TsdfMap();
+
+  // images are integrated from the given pyramid level with every stride-th pixel, depth beyond max_depth is skipped.
+  // a change drops the volume, the keyframes have to be integrated again
+  void configure(double voxel_size, double truncation, double max_depth, size_t level, size_t stride);
+
+  size_t level() const;
+
+  /**
+   * Adds the depth of the image to the volume as measurement of the keyframe with the given id. A previous measurement
+   * of the id is taken out with its pose and this image, which therefore has to be the same one.
+   */
+  void integrate(int id, dvo::core::RgbdImagePyramid& image, const Eigen::Affine3d& pose);
+
+  // takes the measurement of the keyframe out again
+  void remove(int id, dvo::core::RgbdImagePyramid& image);
+
+  bool contains(int id) const;
+
+  // whether the keyframe is integrated with a pose further than the thresholds, in meters and radians, from pose
+  bool moved(int id, const Eigen::Affine3d& pose, double translation, double rotation) const;
+
+  void clear();
+
+  bool empty() const;
+
+  /**
+   * Surface points, where the distance changes its sign between neighbouring voxels, inside the region. Only voxels
+   * with at least min_weight measurements are used. Returns the number of points added.
+   */
+  size_t extract(const Eigen::AlignedBox3f& region, PointVector& points, float min_weight = 1.0f) const;
+
+  // signed distance in meters of the voxel containing the point, positive in front of the surface. false if the voxel
+  // wasn't observed
+  bool distance(const Eigen::Vector3f& point, float& distance) const;
+
+  size_t blockCount() const;
+
+  size_t memoryUsage() const;
+private:
+  TsdfMap(const TsdfMap&);
+  TsdfMap& operator=(const TsdfMap&);
+
+  static const int BlockSize = 8;
+  static const int BlockVoxels = BlockSize * BlockSize * BlockSize;
+
+  struct Voxel
+  {
+    // truncated to [-1, 1]
+    float distance, weight, intensity;
+  };
+
+  struct Block
+  {
+    Voxel voxels[BlockVoxels];
+
+    // voxels with a weight
+    int observed;
+  };
+  typedef boost::unordered_map<uint64_t, Block> BlockMap;
+
+  struct Entry
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Eigen::Affine3d pose;
+  };
+  typedef boost::unordered_map<int, Entry*> EntryMap;
+
+  float voxel_size_, truncation_, max_depth_;
+  size_t level_, stride_;
+
+  BlockMap blocks_;
+  EntryMap entries_;
+
+  mutable tbb::mutex mutex_;
+
+  // adds (sign 1) or takes out (sign -1) the measurements of the image, mutex_ has to be held
+  void update(const dvo::core::RgbdImage& image, const Eigen::Affine3d& pose, float sign);
+
+  // mutex_ has to be held
+  void clearUnlocked();
+
+  const Voxel* find(int x, int y, int z) const;
+
+  static uint64_t key(int x, int y, int z);
+};
+
+} /* namespace dvo_slam */
+#endif /* TSDF_MAP_H_ */
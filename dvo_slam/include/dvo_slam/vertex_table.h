@@ -0,0 +1,91 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VERTEX_TABLE_H_
+#define VERTEX_TABLE_H_
+
+#include <ros/time.h>
+
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace dvo_slam
+{
+
+/**
+ * Per vertex data of the keyframe graph, stored next to the g2o graph instead of in the user data of the vertices.
+ * Keyframe vertices have positive ids and odometry vertices negative ones, both are allocated densely, so the entries
+ * are kept in two arrays indexed by the absolute id, next to an index sorted by timestamp. Not thread-safe.
+ */
+class VertexTable
+{
+public:
+  struct Entry
+  {
+    ros::Time timestamp;
+
+    // submap of a keyframe vertex, -1 for odometry vertices
+    int submap;
+
+    bool used;
+
+    Entry() : submap(-1), used(false) {}
+  };
+
+  // pairs of timestamp and vertex id
+  typedef std::set<std::pair<ros::Time, int> > TimestampIndex;
+
+  VertexTable();
+  ~VertexTable();
+
+  // adds the vertex or updates its timestamp
+  void insert(int id, const ros::Time& timestamp);
+
+  void remove(int id);
+
+  // moves the entry, e.g., when an odometry vertex becomes a keyframe vertex
+  void changeId(int from, int to);
+
+  void submap(int id, int submap);
+
+  void clear();
+
+  size_t size() const;
+
+  // 0 if the vertex isn't in the table
+  const Entry* find(int id) const;
+
+  // zero time if the vertex isn't in the table
+  ros::Time timestamp(int id) const;
+
+  // all vertices sorted by timestamp
+  const TimestampIndex& byTimestamp() const;
+private:
+  std::vector<Entry> keyframes_, odometry_;
+  TimestampIndex by_timestamp_;
+  size_t size_;
+
+  Entry* entry(int id);
+  Entry& allocate(int id);
+};
+
+} /* namespace dvo_slam */
+#endif /* VERTEX_TABLE_H_ */
@@ -0,0 +1,45 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo_slam/camera_keyframe_tracker_nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+PLUGINLIB_DECLARE_CLASS(dvo_slam, camera_keyframe_tracker, dvo_slam::CameraKeyframeTrackerNodelet, nodelet::Nodelet)
+
+namespace dvo_slam
+{
+
+CameraKeyframeTrackerNodelet::CameraKeyframeTrackerNodelet()
+{
+}
+
+CameraKeyframeTrackerNodelet::~CameraKeyframeTrackerNodelet()
+{
+}
+
+void CameraKeyframeTrackerNodelet::onInit()
+{
+  // the image callback only enqueues, prepare and track stages run on the tracker's own threads
+  tracker_.reset(new dvo_slam::CameraKeyframeTracker(getMTNodeHandle(), getMTPrivateNodeHandle()));
+
+  NODELET_INFO("started camera_keyframe_tracker nodelet...");
+}
+
+} /* namespace dvo_slam */
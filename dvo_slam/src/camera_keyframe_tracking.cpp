@@ -20,21 +20,23 @@
 
 #include <boost/bind.hpp>
 #include <cv_bridge/cv_bridge.h>
+#include <opencv2/highgui/highgui.hpp>
 
 #include <tf/transform_broadcaster.h>
 #include <tf_conversions/tf_eigen.h>
 
 #include <geometry_msgs/PoseWithCovarianceStamped.h>
 
-#include <dvo/core/surface_pyramid.h>
 #include <dvo/dense_tracking.h>
-#include <dvo/util/stopwatch.h>
+#include <dvo/util/instrumentation.h>
+#include <dvo/util/task_arenas.h>
 #include <dvo/visualization/visualizer.h>
 //#include <dvo/visualization/pcl_camera_trajectory_visualizer.h>
 
 #include <dvo_slam/config.h>
 #include <dvo_slam/camera_keyframe_tracking.h>
 
+#include <dvo_slam/MemoryUsageReport.h>
 #include <dvo_slam/PoseStampedArray.h>
 #include <dvo_slam/serialization/map_serializer.h>
 
@@ -58,12 +60,35 @@ CameraKeyframeTracker::CameraKeyframeTracker(ros::NodeHandle& nh, ros::NodeHandl
   slam_reconfigure_server_(ros::NodeHandle(nh_private, "slam")),
   tracker_cfg(dvo::DenseTracker::getDefaultConfig()),
   vis_(new dvo_ros::visualization::RosCameraTrajectoryVisualizer(nh_)),
-  graph_vis_(new dvo_slam::visualization::GraphVisualizer(*vis_))
+  graph_vis_(new dvo_slam::visualization::GraphVisualizer(*vis_)),
+  prepare_cfg_(new dvo::DenseTracker::Config(tracker_cfg)),
+  load_shedding_generation_(0),
+  has_imu_to_camera_(false)
 {
   ROS_INFO("CameraDenseTracker::ctor(...)");
 
   pose_publisher = nh.advertise<geometry_msgs::PoseWithCovarianceStamped>("pose", 1);
+  extrapolated_pose_publisher = nh.advertise<geometry_msgs::PoseWithCovarianceStamped>("pose_extrapolated", 1);
   graph_publisher = nh.advertise<dvo_slam::PoseStampedArray>("graph", 1);
+  graph_delta_publisher = nh.advertise<dvo_slam::PoseDeltaArray>("graph_delta", 10);
+  memory_usage_publisher = nh.advertise<dvo_slam::MemoryUsageReport>("memory_usage", 1);
+
+  nh_private.param("graph_delta_translation", graph_delta_translation_, 0.01);
+  nh_private.param("graph_delta_rotation", graph_delta_rotation_, 0.01);
+
+  double memory_usage_interval;
+  nh_private.param("memory_usage_interval", memory_usage_interval, 5.0);
+  memory_usage_interval_ = ros::Duration(std::max(memory_usage_interval, 0.0));
+
+  nh_private.param("image_pool_size", image_pool_size_, 4);
+  image_pool_size_ = std::max(image_pool_size_, 2);
+
+  bool diagnostics;
+  double diagnostics_rate;
+  nh_private.param("diagnostics", diagnostics, false);
+  nh_private.param("diagnostics_rate", diagnostics_rate, 1.0);
+
+  if(diagnostics) diagnostics_.reset(new dvo_slam::TrackingDiagnostics(nh, diagnostics_rate));
 
   TrackerReconfigureServer::CallbackType tracker_reconfigure_server_callback = boost::bind(&CameraKeyframeTracker::handleTrackerConfig, this, _1, _2);
   tracker_reconfigure_server_.setCallback(tracker_reconfigure_server_callback);
@@ -78,14 +103,311 @@ CameraKeyframeTracker::CameraKeyframeTracker(ros::NodeHandle& nh, ros::NodeHandl
     .useExternalWaitKey(false)
     .save(false)
   ;
+
+  configurePipeline(nh_private);
+  configureSnapshots(nh_private);
+  configureLoadShedding(nh_private);
+  configurePoseServer(nh, nh_private);
+  configureImu(nh, nh_private);
+  configureMasks(nh, nh_private);
+  configureRemoteBackend(nh, nh_private);
+
+  dvo_ros::util::loadDepthFilterConfig(ros::NodeHandle(nh_private, "depth_filter"), depth_filter_cfg_);
+
+  prepare_thread_ = boost::thread(&CameraKeyframeTracker::prepareFrames, this);
+  track_thread_ = boost::thread(&CameraKeyframeTracker::trackFrames, this);
 }
 
 CameraKeyframeTracker::~CameraKeyframeTracker()
 {
+  prepare_queue_.shutdown();
+  track_queue_.shutdown();
+
+  prepare_thread_.join();
+  track_thread_.join();
+
   delete vis_;
   delete graph_vis_;
 }
 
+void CameraKeyframeTracker::configurePipeline(ros::NodeHandle& nh_private)
+{
+  ros::NodeHandle nh_pipeline(nh_private, "pipeline");
+
+  int prepare_queue_size, track_queue_size;
+  std::string prepare_drop_policy, track_drop_policy;
+
+  // by default only the most recent frames are kept, so a slow tracker doesn't accumulate latency
+  nh_pipeline.param("prepare_queue_size", prepare_queue_size, 2);
+  nh_pipeline.param("prepare_drop_policy", prepare_drop_policy, std::string("drop_oldest"));
+  nh_pipeline.param("track_queue_size", track_queue_size, 1);
+  nh_pipeline.param("track_drop_policy", track_drop_policy, std::string("drop_oldest"));
+
+  FrameQueue::DropPolicy prepare_policy, track_policy;
+
+  if(!FrameQueue::parseDropPolicy(prepare_drop_policy, prepare_policy))
+  {
+    ROS_WARN_STREAM("unknown prepare_drop_policy '" << prepare_drop_policy << "', using drop_oldest");
+    prepare_policy = FrameQueue::DropOldest;
+  }
+
+  if(!FrameQueue::parseDropPolicy(track_drop_policy, track_policy))
+  {
+    ROS_WARN_STREAM("unknown track_drop_policy '" << track_drop_policy << "', using drop_oldest");
+    track_policy = FrameQueue::DropOldest;
+  }
+
+  prepare_queue_.configure(std::max(prepare_queue_size, 1), prepare_policy);
+  track_queue_.configure(std::max(track_queue_size, 1), track_policy);
+}
+
+void CameraKeyframeTracker::configureSnapshots(ros::NodeHandle& nh_private)
+{
+  std::string file;
+  double interval;
+
+  nh_private.param("map_snapshot_file", file, std::string(""));
+  nh_private.param("map_snapshot_interval", interval, 30.0);
+
+  if(file.empty()) return;
+
+  ROS_INFO_STREAM("writing map snapshots to '" << file << "' every " << interval << "s");
+
+  snapshot_serializer_.reset(new dvo_slam::serialization::AsyncBinarySerializer(file));
+  snapshot_interval_ = ros::Duration(std::max(interval, 1.0));
+}
+
+void CameraKeyframeTracker::configureLoadShedding(ros::NodeHandle& nh_private)
+{
+  ros::NodeHandle nh_load_shedding(nh_private, "load_shedding");
+
+  LoadSheddingConfig cfg;
+
+  nh_load_shedding.param("enabled", cfg.Enabled, cfg.Enabled);
+  nh_load_shedding.param("target_load", cfg.TargetLoad, cfg.TargetLoad);
+  nh_load_shedding.param("recover_load", cfg.RecoverLoad, cfg.RecoverLoad);
+  nh_load_shedding.param("smoothing", cfg.Smoothing, cfg.Smoothing);
+  nh_load_shedding.param("hold_frames", cfg.HoldFrames, cfg.HoldFrames);
+  nh_load_shedding.param("max_frame_stride", cfg.MaxFrameStride, cfg.MaxFrameStride);
+  nh_load_shedding.param("max_last_level_increase", cfg.MaxLastLevelIncrease, cfg.MaxLastLevelIncrease);
+  nh_load_shedding.param("max_iterations", cfg.MaxIterations, cfg.MaxIterations);
+
+  if(cfg.Enabled) ROS_INFO_STREAM("load shedding ( " << cfg << " )");
+
+  load_shedding_.configure(cfg);
+}
+
+void CameraKeyframeTracker::configurePoseServer(ros::NodeHandle& nh, ros::NodeHandle& nh_private)
+{
+  double rate, max_extrapolation;
+
+  nh_private.param("pose_rate", rate, 0.0);
+  nh_private.param("pose_max_extrapolation", max_extrapolation, 0.1);
+
+  pose_server_.maxExtrapolation(max_extrapolation);
+
+  if(rate <= 0.0) return;
+
+  ROS_INFO_STREAM("publishing extrapolated poses at " << rate << "Hz");
+
+  pose_timer_ = nh.createTimer(ros::Duration(1.0 / rate), &CameraKeyframeTracker::handlePoseTimer, this);
+}
+
+void CameraKeyframeTracker::configureRemoteBackend(ros::NodeHandle& nh, ros::NodeHandle& nh_private)
+{
+  ros::NodeHandle nh_remote(nh_private, "remote_backend");
+
+  bool enabled;
+  int max_queued_maps;
+  double resend_timeout;
+
+  nh_remote.param("enabled", enabled, false);
+  nh_remote.param("max_queued_maps", max_queued_maps, 64);
+  nh_remote.param("resend_timeout", resend_timeout, 1.0);
+
+  if(!enabled) return;
+
+  ROS_INFO_STREAM("sending local maps to a remote backend, keeping up to " << max_queued_maps << " of them");
+
+  remote_backend_.reset(new dvo_slam::RemoteBackendClient(nh, 0, size_t(std::max(max_queued_maps, 1)), resend_timeout));
+  corrected_pose_publisher = nh.advertise<geometry_msgs::PoseWithCovarianceStamped>("pose_corrected", 1);
+}
+
+void CameraKeyframeTracker::handlePoseTimer(const ros::TimerEvent& e)
+{
+  std_msgs::Header h;
+  h.stamp = e.current_real;
+
+  Eigen::Affine3d pose;
+
+  if(pose_server_.query(h.stamp.toSec(), pose))
+  {
+    publishTransform(h, pose, "base_link_extrapolated", extrapolated_pose_publisher);
+  }
+}
+
+const PoseServer& CameraKeyframeTracker::poseServer() const
+{
+  return pose_server_;
+}
+
+void CameraKeyframeTracker::configureImu(ros::NodeHandle& nh, ros::NodeHandle& nh_private)
+{
+  bool use_imu;
+  nh_private.param("use_imu", use_imu, false);
+
+  if(!use_imu) return;
+
+  ROS_INFO("using the imu rotation as motion prior, enable use_motion_prediction in the slam config");
+
+  imu_subscriber_ = nh.subscribe("imu", 100, &CameraKeyframeTracker::handleImu, this);
+}
+
+void CameraKeyframeTracker::handleImu(const sensor_msgs::Imu::ConstPtr& imu_msg)
+{
+  boost::mutex::scoped_lock lock(imu_mutex_);
+
+  imu_queue_.push_back(imu_msg);
+
+  // about 10s at 100Hz, in case no frames arrive
+  while(imu_queue_.size() > 1000) imu_queue_.pop_front();
+}
+
+void CameraKeyframeTracker::configureMasks(ros::NodeHandle& nh, ros::NodeHandle& nh_private)
+{
+  std::string static_mask, dynamic_mask_topic;
+  double dynamic_mask_tolerance;
+
+  nh_private.param("static_mask", static_mask, std::string(""));
+  nh_private.param("dynamic_mask_topic", dynamic_mask_topic, std::string(""));
+  nh_private.param("dynamic_mask_tolerance", dynamic_mask_tolerance, 0.02);
+
+  dynamic_mask_tolerance_ = ros::Duration(dynamic_mask_tolerance);
+
+  if(!static_mask.empty())
+  {
+    static_mask_ = cv::imread(static_mask, CV_LOAD_IMAGE_GRAYSCALE);
+
+    if(static_mask_.empty())
+      ROS_WARN_STREAM("can't read static mask '" << static_mask << "'");
+    else
+      ROS_INFO_STREAM("using static mask '" << static_mask << "'");
+  }
+
+  if(!dynamic_mask_topic.empty())
+  {
+    ROS_INFO_STREAM("using dynamic masks from '" << dynamic_mask_topic << "'");
+
+    dynamic_mask_subscriber_ = nh.subscribe(dynamic_mask_topic, 10, &CameraKeyframeTracker::handleDynamicMask, this);
+  }
+}
+
+void CameraKeyframeTracker::handleDynamicMask(const sensor_msgs::Image::ConstPtr& mask_msg)
+{
+  boost::mutex::scoped_lock lock(dynamic_mask_mutex_);
+
+  dynamic_mask_queue_.push_back(mask_msg);
+
+  // a few frames of latency, older masks wouldn't match anymore
+  while(dynamic_mask_queue_.size() > 8) dynamic_mask_queue_.pop_front();
+}
+
+bool CameraKeyframeTracker::findDynamicMask(const ros::Time& stamp, cv::Mat& mask)
+{
+  sensor_msgs::Image::ConstPtr best;
+
+  {
+    boost::mutex::scoped_lock lock(dynamic_mask_mutex_);
+
+    ros::Duration best_distance = dynamic_mask_tolerance_;
+
+    for(std::deque<sensor_msgs::Image::ConstPtr>::const_iterator it = dynamic_mask_queue_.begin(); it != dynamic_mask_queue_.end(); ++it)
+    {
+      ros::Duration distance = (*it)->header.stamp > stamp ? (*it)->header.stamp - stamp : stamp - (*it)->header.stamp;
+
+      if(distance <= best_distance)
+      {
+        best = *it;
+        best_distance = distance;
+      }
+    }
+  }
+
+  if(!best) return false;
+
+  try
+  {
+    // the frame keeps the mask, so it must not share the message buffer
+    mask = cv_bridge::toCvShare(best, "mono8")->image.clone();
+  }
+  catch(cv_bridge::Exception& e)
+  {
+    ROS_WARN_STREAM_THROTTLE(5.0, "can't convert dynamic mask: " << e.what());
+    return false;
+  }
+
+  return true;
+}
+
+bool CameraKeyframeTracker::integrateImu(const ros::Time& from, const ros::Time& to, const std::string& camera_frame, Eigen::Matrix3d& rotation)
+{
+  boost::mutex::scoped_lock lock(imu_mutex_);
+
+  // samples before the previous one are not needed anymore
+  while(imu_queue_.size() > 1 && imu_queue_[1]->header.stamp <= from) imu_queue_.pop_front();
+
+  if(imu_queue_.empty()) return false;
+
+  if(!has_imu_to_camera_)
+  {
+    tf::StampedTransform imu_to_camera;
+
+    try
+    {
+      tl.lookupTransform(camera_frame, imu_queue_.front()->header.frame_id, ros::Time(0), imu_to_camera);
+    }
+    catch(tf::TransformException& e)
+    {
+      ROS_WARN_STREAM_THROTTLE(5.0, "no transform from imu to camera: " << e.what());
+      return false;
+    }
+
+    Eigen::Affine3d t;
+    tf::TransformTFToEigen(imu_to_camera, t);
+
+    imu_to_camera_ = t.linear();
+    has_imu_to_camera_ = true;
+  }
+
+  // zero order hold of the angular velocity, body rates compose from the right
+  Eigen::Matrix3d imu_rotation = Eigen::Matrix3d::Identity();
+  size_t num_samples = 0;
+
+  for(size_t idx = 0; idx < imu_queue_.size(); ++idx)
+  {
+    const ros::Time begin = std::max(from, imu_queue_[idx]->header.stamp);
+    const ros::Time end = idx + 1 < imu_queue_.size() ? std::min(to, imu_queue_[idx + 1]->header.stamp) : to;
+
+    if(end <= begin) continue;
+
+    const geometry_msgs::Vector3& w = imu_queue_[idx]->angular_velocity;
+    Eigen::Vector3d omega(w.x, w.y, w.z);
+
+    const double angle = omega.norm() * (end - begin).toSec();
+
+    if(angle > 0.0) imu_rotation = imu_rotation * Eigen::AngleAxisd(angle, omega.normalized()).toRotationMatrix();
+
+    if(imu_queue_[idx]->header.stamp >= from) num_samples++;
+  }
+
+  // the last sample before the frame has to be recent, otherwise we would extrapolate a stale rate
+  if(num_samples == 0 || to - imu_queue_.back()->header.stamp > ros::Duration(0.05)) return false;
+
+  rotation = imu_to_camera_ * imu_rotation * imu_to_camera_.transpose();
+
+  return true;
+}
+
 bool CameraKeyframeTracker::hasChanged(const sensor_msgs::CameraInfo::ConstPtr& camera_info_msg)
 {
   return width != camera_info_msg->width || height != camera_info_msg->height;
@@ -96,12 +418,36 @@ void CameraKeyframeTracker::reset(const sensor_msgs::CameraInfo::ConstPtr& camer
   //intrinsics = IntrinsicMatrix::create(camera_info_msg->K[0], camera_info_msg->K[4], camera_info_msg->K[2], camera_info_msg->K[5]);
   intrinsics = IntrinsicMatrix::create(camera_info_msg->P[0], camera_info_msg->P[5], camera_info_msg->P[2], camera_info_msg->P[6]);
   camera.reset(new dvo::core::RgbdCameraPyramid(camera_info_msg->width, camera_info_msg->height, intrinsics));
-  camera->build(tracker_cfg.getNumLevels());
+  camera->build(prepare_cfg_->getNumLevels());
+  camera->setDepthFilter(depth_filter_cfg_);
+
+  if(!static_mask_.empty())
+  {
+    if(static_mask_.cols == int(camera_info_msg->width) && static_mask_.rows == int(camera_info_msg->height))
+      camera->setMask(static_mask_);
+    else
+      ROS_WARN("static mask size doesn't match the camera, ignoring it!");
+  }
+
+  // reference, current, the frames held by the tracker and the queued frames stay referenced, all others are recycled
+  camera->setPoolSize(image_pool_size_ + prepare_queue_.capacity() + track_queue_.capacity());
 
   keyframe_tracker.reset(new KeyframeTracker(graph_vis_));
-  keyframe_tracker->configureTracking(tracker_cfg);
-  keyframe_tracker->configureKeyframeSelection(keyframe_tracker_cfg);
-  keyframe_tracker->configureMapping(graph_cfg);
+  keyframe_tracker->addMapChangedCallback(boost::bind(&CameraKeyframeTracker::handleMapChanged, this, _1));
+  keyframe_tracker->diagnostics(diagnostics_);
+  keyframe_tracker->remoteBackend(remote_backend_);
+
+  // the new tracker starts at full quality
+  load_shedding_.reset();
+  pose_server_.reset();
+
+  // a new map, receivers start over with the first delta
+  graph_delta_serializer_.reset(new dvo_slam::serialization::DeltaMessageSerializer(graph_delta_msg_, graph_delta_translation_, graph_delta_rotation_));
+  // called by the prepare stage, but the track stage waits for tracker_mutex_
+  track_cfg_ = prepare_cfg_;
+  keyframe_tracker->configureTracking(*track_cfg_);
+  keyframe_tracker->configureKeyframeSelection(track_slam_cfg_.keyframe_tracker_cfg);
+  keyframe_tracker->configureMapping(track_slam_cfg_.graph_cfg);
 
   static RgbdImagePyramid* const __null__ = 0;
 
@@ -149,15 +495,8 @@ void CameraKeyframeTracker::handleTrackerConfig(dvo_ros::CameraDenseTrackerConfi
 
     dvo_ros::util::updateConfigFromDynamicReconfigure(config, tracker_cfg);
 
-    // we are called in the ctor as well, but at this point we don't have a tracker instance
-    if(keyframe_tracker)
-    {
-      // lock tracker so we don't reconfigure it while it is running
-      boost::mutex::scoped_lock lock(tracker_mutex_);
-
-      keyframe_tracker->configureTracking(tracker_cfg);
-      camera->build(tracker_cfg.getNumLevels());
-    }
+    // the prepare stage takes it with the next frame and hands it on to the track stage
+    pending_tracker_cfg_.post(tracker_cfg);
 
     //ROS_INFO_STREAM("reconfigured tracker, config ( " << tracker_cfg << " )");
   }
@@ -169,30 +508,45 @@ void CameraKeyframeTracker::handleSlamConfig(dvo_slam::KeyframeSlamConfig& confi
 {
   dvo_slam::updateConfigFromDynamicReconfigure(config, keyframe_tracker_cfg, graph_cfg);
 
-  if(keyframe_tracker)
+  SlamConfig slam_cfg;
+  slam_cfg.keyframe_tracker_cfg = keyframe_tracker_cfg;
+  slam_cfg.graph_cfg = graph_cfg;
+
+  pending_slam_cfg_.post(slam_cfg);
+
+  // the final optimization is an explicit request, so it is fine to wait for the current frame
+  if(config.graph_opt_final)
   {
     boost::mutex::scoped_lock lock(tracker_mutex_);
 
-    keyframe_tracker->configureKeyframeSelection(keyframe_tracker_cfg);
-    keyframe_tracker->configureMapping(graph_cfg);
+    config.graph_opt_final = false;
 
-    if(config.graph_opt_final)
-    {
-      config.graph_opt_final = false;
-      keyframe_tracker->finish();
+    // we are called in the ctor as well, but at this point we don't have a tracker instance
+    if(!keyframe_tracker) return;
 
-      dvo_slam::PoseStampedArray msg;
-      dvo_slam::serialization::MessageSerializer serializer(msg);
+    keyframe_tracker->finish();
 
-      keyframe_tracker->serializeMap(serializer);
+    dvo_slam::PoseStampedArray msg;
+    dvo_slam::serialization::MessageSerializer serializer(msg);
 
-      graph_publisher.publish(msg);
-    }
+    keyframe_tracker->serializeMap(serializer);
+
+    graph_publisher.publish(msg);
   }
 
   //ROS_INFO_STREAM("reconfigured SLAM system, frontend config ( " << keyframe_tracker_cfg << " ), backend config  ( " << graph_cfg << " )");
 }
 
+void CameraKeyframeTracker::handleMapChanged(dvo_slam::KeyframeGraph& map)
+{
+  graph_delta_serializer_->serialize(map);
+
+  if(graph_delta_msg_.full || !graph_delta_msg_.ids.empty() || !graph_delta_msg_.removed_ids.empty())
+  {
+    graph_delta_publisher.publish(graph_delta_msg_);
+  }
+}
+
 void CameraKeyframeTracker::handleImages(
     const sensor_msgs::Image::ConstPtr& rgb_image_msg,
     const sensor_msgs::Image::ConstPtr& depth_image_msg,
@@ -200,12 +554,6 @@ void CameraKeyframeTracker::handleImages(
     const sensor_msgs::CameraInfo::ConstPtr& depth_camera_info_msg
 )
 {
-  static stopwatch sw_callback("callback");
-  sw_callback.start();
-
-  // lock tracker so no one can reconfigure it
-  boost::mutex::scoped_lock lock(tracker_mutex_);
-
   // different size of rgb and depth image
   if(depth_camera_info_msg->width != rgb_camera_info_msg->width || depth_camera_info_msg->height != rgb_camera_info_msg->height)
   {
@@ -214,86 +562,274 @@ void CameraKeyframeTracker::handleImages(
     return;
   }
 
-  // something has changed
-  if(hasChanged(rgb_camera_info_msg))
+  if(!load_shedding_.accept(rgb_image_msg->header.stamp.toSec()))
   {
-    ROS_WARN("RGB image size has changed, resetting tracker!");
+    ROS_DEBUG("dropped frame by load shedding");
+
+    return;
+  }
+
+  Frame frame;
+  frame.rgb = rgb_image_msg;
+  frame.depth = depth_image_msg;
+  frame.rgb_camera_info = rgb_camera_info_msg;
+  frame.depth_camera_info = depth_camera_info_msg;
+
+  if(!prepare_queue_.push(frame))
+  {
+    ROS_DEBUG("dropped frame in prepare queue");
+  }
+}
+
+void CameraKeyframeTracker::prepareFrames()
+{
+  Frame frame;
+
+  while(prepare_queue_.pop(frame))
+  {
+    // the pyramid construction is frontend work as well
+    dvo::util::TaskArenas::instance().execute(dvo::util::TaskArenas::Frontend, boost::bind(&CameraKeyframeTracker::prepare, this, boost::ref(frame)));
+
+    if(!track_queue_.push(frame))
+    {
+      ROS_DEBUG("dropped frame in track queue");
+    }
+
+    // don't keep the pyramid alive, so it can be recycled
+    frame = Frame();
+  }
+}
+
+void CameraKeyframeTracker::trackFrames()
+{
+  Frame frame;
+
+  while(track_queue_.pop(frame))
+  {
+    const int64_t begin = Timer::now();
+
+    track(frame);
 
-    reset(rgb_camera_info_msg);
+    load_shedding_.update(Timer::seconds(Timer::now() - begin));
+
+    frame = Frame();
   }
+}
+
+void CameraKeyframeTracker::prepare(Frame& frame)
+{
+  static Timer& prepare_timer = Instrumentation::instance().timer("camera_keyframe_tracker/prepare");
+  ScopedTimer prepare_scope(prepare_timer);
 
-  cv::Mat intensity, depth;
-  cv::Mat rgb_in = cv_bridge::toCvShare(rgb_image_msg)->image;
+  // frame boundary of the prepare stage
+  dvo::DenseTracker::Config cfg;
 
-  if(rgb_in.channels() == 3)
+  if(pending_tracker_cfg_.take(cfg))
   {
-    cv::Mat tmp;
-    cv::cvtColor(rgb_in, tmp, CV_BGR2GRAY, 1);
+    cfg.fitLevels(frame.rgb_camera_info->width, frame.rgb_camera_info->height);
+    prepare_cfg_.reset(new dvo::DenseTracker::Config(cfg));
 
-    tmp.convertTo(intensity, CV_32F);
+    if(camera)
+    {
+      // the track stage reads the camera levels while it holds tracker_mutex_
+      boost::mutex::scoped_lock lock(tracker_mutex_);
+
+      camera->build(prepare_cfg_->getNumLevels());
+    }
+  }
+
+  // something has changed
+  if(hasChanged(frame.rgb_camera_info))
+  {
+    ROS_WARN("RGB image size has changed, resetting tracker!");
+
+    // levels chosen by their pixel counts change with the size
+    cfg = *prepare_cfg_;
+    cfg.fitLevels(frame.rgb_camera_info->width, frame.rgb_camera_info->height);
+    prepare_cfg_.reset(new dvo::DenseTracker::Config(cfg));
+
+    // lock tracker so no one can reconfigure it
+    boost::mutex::scoped_lock lock(tracker_mutex_);
+
+    reset(frame.rgb_camera_info);
+
+    // these frames have the old size
+    track_queue_.clear();
   }
-  else
+
+  // shares the message buffers, intensity and depth are converted straight into the pyramid
+  cv::Mat rgb_in = cv_bridge::toCvShare(frame.rgb)->image;
+  cv::Mat depth_in = cv_bridge::toCvShare(frame.depth)->image;
+
+  frame.camera = camera;
+  frame.tracker_cfg = prepare_cfg_;
+  frame.image = camera->create(rgb_in, depth_in, 0.001f, vis_->requiresRgb());
+
+  cv::Mat dynamic_mask;
+
+  if(dynamic_mask_subscriber_ && findDynamicMask(frame.rgb->header.stamp, dynamic_mask))
   {
-    rgb_in.convertTo(intensity, CV_32F);
+    if(dynamic_mask.size() == rgb_in.size())
+      frame.image->setMask(dynamic_mask);
+    else
+      ROS_WARN_THROTTLE(5.0, "dynamic mask size doesn't match the frame, ignoring it!");
   }
 
-  cv::Mat depth_in = cv_bridge::toCvShare(depth_image_msg)->image;
+  frame.image->build(prepare_cfg_->getNumLevels());
 
-  if(depth_in.type() == CV_16UC1)
+  // the trackers would build them on demand, but here it overlaps with tracking the previous frame. the point
+  // selection doesn't need the dense point clouds
+  for(int idx = prepare_cfg_->LastLevel; idx <= prepare_cfg_->FirstLevel; ++idx)
   {
-    SurfacePyramid::convertRawDepthImageSse(depth_in, depth, 0.001);
+    frame.image->level(idx).buildAccelerationStructure();
   }
-  else
+}
+
+void CameraKeyframeTracker::track(Frame& frame)
+{
+  static Timer& track_timer = Instrumentation::instance().timer("camera_keyframe_tracker/track");
+  static Timer& match_timer = track_timer.child("match");
+  ScopedTimer track_scope(track_timer);
+
+  // lock tracker so no one can reconfigure it
+  boost::mutex::scoped_lock lock(tracker_mutex_);
+
+  // prepared before a reset
+  if(frame.camera != camera) return;
+
+  // frame boundary of the track stage, the tracking configuration changes together with the pyramids built for it
+  bool reconfigured = false;
+
+  if(frame.tracker_cfg != track_cfg_)
   {
-    depth = depth_in;
+    track_cfg_ = frame.tracker_cfg;
+    keyframe_tracker->configureTracking(*track_cfg_);
+
+    reconfigured = true;
   }
 
-  reference.swap(current);
-  current = camera->create(intensity, depth);
+  // the degradation applies to the frame to keyframe tracking only, on top of the current config
+  if(reconfigured || load_shedding_.generation() != load_shedding_generation_)
+  {
+    load_shedding_generation_ = load_shedding_.generation();
+
+    dvo::DenseTracker::Config degraded;
+    load_shedding_.degrade(*track_cfg_, degraded);
 
-  if(rgb_in.channels() == 3)
+    keyframe_tracker->configureLocalTracking(degraded);
+  }
+
+  if(pending_slam_cfg_.take(track_slam_cfg_))
   {
-    rgb_in.convertTo(current->level(0).rgb, CV_32FC3);
+    keyframe_tracker->configureKeyframeSelection(track_slam_cfg_.keyframe_tracker_cfg);
+    keyframe_tracker->configureMapping(track_slam_cfg_.graph_cfg);
   }
 
+  reference.swap(current);
+  current = frame.image;
+
   // time delay compensation TODO: use driver settings instead
-  std_msgs::Header h = rgb_image_msg->header;
+  std_msgs::Header h = frame.rgb->header;
   //h.stamp -= ros::Duration(0.05);
 
-  static Eigen::Affine3d first;
+  if(imu_subscriber_)
+  {
+    Eigen::Matrix3d rotation;
+
+    if(reference && integrateImu(last_frame_stamp_, h.stamp, frame.rgb->header.frame_id, rotation))
+    {
+      keyframe_tracker->setRotationPrior(rotation);
+    }
+
+    last_frame_stamp_ = h.stamp;
+  }
 
   if(!reference)
   {
     accumulated_transform.setIdentity();
     keyframe_tracker->init(accumulated_transform);
+    pose_server_.update(h.stamp.toSec(), accumulated_transform);
 
     return;
   }
 
-  Eigen::Affine3d transform, last_transform;
-
-  static stopwatch sw_match("match", 100);
-  sw_match.start();
-
-  keyframe_tracker->update(current, h.stamp, accumulated_transform);
+  {
+    ScopedTimer match_scope(match_timer);
+    keyframe_tracker->update(current, h.stamp, accumulated_transform);
+  }
 
-  sw_match.stopAndPrint();
+  // before anything else, the pose is on its way while the frame is visualized
+  pose_server_.update(h.stamp.toSec(), accumulated_transform);
 
   //vis_->trajectory("estimate")->
   //    color(dvo::visualization::Color::red())
   //    .add(accumulated_transform);
 
-  vis_->camera("current")->
-      color(dvo::visualization::Color::red()).
-      update(current->level(0), accumulated_transform).
-      show(dvo::visualization::CameraVisualizer::ShowCamera);
+  if(vis_->active())
+  {
+    vis_->camera("current")->
+        color(dvo::visualization::Color::red()).
+        update(current->level(0), accumulated_transform).
+        show(dvo::visualization::CameraVisualizer::ShowCamera);
+  }
+
+  publishTransform(h, accumulated_transform, "base_link_estimate", pose_publisher);
+
+  if(remote_backend_)
+  {
+    Eigen::Affine3d corrected(remote_backend_->correction().matrix());
+    corrected = corrected * accumulated_transform;
+
+    publishTransform(h, corrected, "base_link_corrected", corrected_pose_publisher);
+  }
+
+  // only copies the map, it is written by the serializer's thread
+  if(snapshot_serializer_ && h.stamp - last_snapshot_ > snapshot_interval_)
+  {
+    keyframe_tracker->serializeMap(*snapshot_serializer_);
+    last_snapshot_ = h.stamp;
+  }
+
+  // doesn't wait for the backend, if it is busy the report is tried again with the next frame
+  if(!memory_usage_interval_.isZero() && h.stamp - last_memory_usage_ > memory_usage_interval_ && memory_usage_publisher.getNumSubscribers() > 0 && publishMemoryUsage(h))
+  {
+    last_memory_usage_ = h.stamp;
+  }
+}
+
+bool CameraKeyframeTracker::publishMemoryUsage(const std_msgs::Header& header)
+{
+  dvo_slam::MemoryUsage usage;
+
+  if(!keyframe_tracker->memoryUsage(usage, false)) return false;
+
+  dvo_slam::MemoryUsageReportPtr msg(new dvo_slam::MemoryUsageReport());
+  msg->header.stamp = header.stamp;
+  msg->keyframe_pyramids = usage.KeyframePyramids;
+  msg->keyframe_points = usage.KeyframePoints;
+  msg->keyframe_compressed = usage.KeyframeCompressed;
+  msg->graph_vertices = usage.GraphVertices;
+  msg->graph_edges = usage.GraphEdges;
+  msg->local_map = usage.LocalMap;
+  msg->tracker = usage.Tracker;
+  msg->volume = usage.Volume;
+  msg->total = usage.total();
+
+  for(std::vector<dvo_slam::MemoryUsage::Keyframe>::const_iterator it = usage.Keyframes.begin(); it != usage.Keyframes.end(); ++it)
+  {
+    msg->keyframe_ids.push_back(it->Id);
+    msg->keyframe_resident.push_back(it->Resident);
+    msg->keyframe_pyramid.push_back(it->Pyramid);
+    msg->keyframe_point.push_back(it->Points);
+    msg->keyframe_compressed_images.push_back(it->Compressed);
+  }
 
-  publishTransform(h, accumulated_transform, "base_link_estimate");
+  memory_usage_publisher.publish(msg);
 
-  sw_callback.stopAndPrint();
+  return true;
 }
 
-void CameraKeyframeTracker::publishTransform(const std_msgs::Header& header, const Eigen::Affine3d& transform, const std::string frame)
+void CameraKeyframeTracker::publishTransform(const std_msgs::Header& header, const Eigen::Affine3d& transform, const std::string frame, ros::Publisher& publisher)
 {
   static tf::TransformBroadcaster tb;
 
@@ -312,7 +848,7 @@ void CameraKeyframeTracker::publishTransform(const std_msgs::Header& header, con
   pose_msg.header.frame_id = frame;
   pose_msg.header.stamp = header.stamp;
 
-  pose_publisher.publish(pose_msg);
+  publisher.publish(pose_msg);
 }
 
 } /* namespace dvo_slam */
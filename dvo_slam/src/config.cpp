@@ -18,18 +18,77 @@
  *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cassert>
 #include <limits>
 #include <dvo_slam/config.h>
 
 namespace dvo_slam
 {
 
+const char* GraphOptimizationAlgorithms::str(enum_t type)
+{
+  switch(type)
+  {
+    case GraphOptimizationAlgorithms::GaussNewton:
+      return "GaussNewton";
+    case GraphOptimizationAlgorithms::LevenbergMarquardt:
+      return "LevenbergMarquardt";
+    case GraphOptimizationAlgorithms::Dogleg:
+      return "Dogleg";
+    default:
+      break;
+  }
+  assert(false && "Unknown graph optimization algorithm type!");
+
+  return "";
+}
+
+const char* GraphLinearSolvers::str(enum_t type)
+{
+  switch(type)
+  {
+    case GraphLinearSolvers::CSparse:
+      return "CSparse";
+    case GraphLinearSolvers::Cholmod:
+      return "Cholmod";
+    case GraphLinearSolvers::Pcg:
+      return "Pcg";
+    case GraphLinearSolvers::Dense:
+      return "Dense";
+    default:
+      break;
+  }
+  assert(false && "Unknown graph linear solver type!");
+
+  return "";
+}
+
 KeyframeTrackerConfig::KeyframeTrackerConfig() :
   UseMultiThreading(true),
   MaxTranslationalDistance(0.2),
   MaxRotationalDistance(std::numeric_limits<double>::max()),
   MinEntropyRatio(0.91),
-  MinEquationSystemConstraintRatio(0.33)
+  MinEquationSystemConstraintRatio(0.33),
+  UseMotionPrediction(false),
+  PredictionSkipLevels(1),
+  MaxPredictionTranslationError(0.005),
+  MaxPredictionRotationError(0.01),
+  StationaryMaxIntensityDifference(0.0),
+  StationaryMaxDepthDifference(0.005),
+  StationaryLevel(3),
+  LocalModelFrames(0),
+  UseSparseInitialization(false),
+  SparseInitializationLevel(1),
+  SparseInitializationFeatures(300),
+  SparseInitializationMinInliers(15),
+  SparseInitializationInlierThreshold(0.05),
+  UseRelocalization(false),
+  RelocalizationSearchRadius(1.0),
+  RelocalizationMaxCandidates(4),
+  FrontendConcurrency(0),
+  FrontendFirstCore(-1),
+  VisualizationConcurrency(0),
+  VisualizationFirstCore(-1)
 {
 }
 
@@ -40,9 +99,46 @@ KeyframeGraphConfig::KeyframeGraphConfig() :
     NewConstraintMinEntropyRatioCoarse(0.7),
     NewConstraintMinEntropyRatioFine(0.9),
     MinEquationSystemConstraintRatio(0.2),
+    UseConstraintRanking(false),
+    MaxConstraintCandidates(8),
+    MinConstraintFrustumOverlap(0.3),
+    MaxConstraintViewAngle(90.0),
+    MaxAppearanceCandidates(2),
+    MinAppearanceSimilarity(0.8),
+    MinNearbyAppearanceSimilarity(-1.0),
+    ValidationCacheMaxTranslation(0.05),
+    ValidationCacheMaxRotation(3.0),
     MinConstraintDistance(0),
     OptimizationIterations(20),
-    OptimizationFinalIterations(5000)
+    OptimizationFinalIterations(5000),
+    OptimizationWindowSize(0),
+    SubmapRadius(0.0),
+    SubmapMaxKeyframes(50),
+    MaxRigTimeOffset(0.04),
+    MaxKeyframeBatch(4),
+    OptimizationAlgorithm(GraphOptimizationAlgorithms::Dogleg),
+    OptimizationLinearSolver(GraphLinearSolvers::CSparse),
+    PcgMaxIterations(-1),
+    PcgTolerance(1e-6),
+    UseBackgroundRefinement(false),
+    RefinementKeyframesPerStep(4),
+    RefinementIterations(10),
+    RefinementMinImprovement(1e-3),
+    MarginalizeOdometry(false),
+    MaxResidentKeyframes(0),
+    SharedStoreCapacity(1024),
+    SharedStoreFirstLevel(1),
+    SharedStoreLevels(3),
+    UseTsdfMap(false),
+    TsdfVoxelSize(0.02),
+    TsdfTruncation(0.08),
+    TsdfMaxDepth(4.0),
+    TsdfLevel(1),
+    TsdfStride(1),
+    TsdfReintegrationTranslation(0.02),
+    TsdfReintegrationRotation(0.02),
+    BackendConcurrency(0),
+    BackendFirstCore(-1)
 {
 }
 
@@ -53,16 +149,75 @@ void updateConfigFromDynamicReconfigure(const KeyframeSlamConfig& cfg, KeyframeT
   frontend_cfg.MinEntropyRatio = cfg.min_entropy_ratio;
   frontend_cfg.MinEquationSystemConstraintRatio = cfg.min_eq_sys_constraint_ratio;
   frontend_cfg.UseMultiThreading = cfg.use_multithreading;
+  frontend_cfg.UseMotionPrediction = cfg.use_motion_prediction;
+  frontend_cfg.PredictionSkipLevels = cfg.prediction_skip_levels;
+  frontend_cfg.MaxPredictionTranslationError = cfg.max_prediction_translation_error;
+  frontend_cfg.MaxPredictionRotationError = cfg.max_prediction_rotation_error;
+  frontend_cfg.StationaryMaxIntensityDifference = cfg.stationary_max_intensity_difference;
+  frontend_cfg.StationaryMaxDepthDifference = cfg.stationary_max_depth_difference;
+  frontend_cfg.StationaryLevel = cfg.stationary_level;
+  frontend_cfg.LocalModelFrames = cfg.local_model_frames;
+  frontend_cfg.UseSparseInitialization = cfg.sparse_initialization;
+  frontend_cfg.SparseInitializationLevel = cfg.sparse_initialization_level;
+  frontend_cfg.SparseInitializationFeatures = cfg.sparse_initialization_features;
+  frontend_cfg.SparseInitializationMinInliers = cfg.sparse_initialization_min_inliers;
+  frontend_cfg.SparseInitializationInlierThreshold = cfg.sparse_initialization_inlier_threshold;
+  frontend_cfg.UseRelocalization = cfg.use_relocalization;
+  frontend_cfg.RelocalizationSearchRadius = cfg.relocalization_search_radius;
+  frontend_cfg.RelocalizationMaxCandidates = cfg.relocalization_max_candidates;
+  frontend_cfg.FrontendConcurrency = cfg.frontend_concurrency;
+  frontend_cfg.FrontendFirstCore = cfg.frontend_first_core;
+  frontend_cfg.VisualizationConcurrency = cfg.visualization_concurrency;
+  frontend_cfg.VisualizationFirstCore = cfg.visualization_first_core;
 
   backend_cfg.MinConstraintDistance = cfg.graph_opt_min_distance;
   backend_cfg.OptimizationIterations = cfg.graph_opt_iterations;
   backend_cfg.OptimizationFinalIterations = cfg.graph_opt_final_iterations;
+  backend_cfg.OptimizationWindowSize = cfg.graph_opt_window;
+  backend_cfg.SubmapRadius = cfg.graph_submap_radius;
+  backend_cfg.SubmapMaxKeyframes = cfg.graph_submap_max_keyframes;
+  backend_cfg.MaxRigTimeOffset = cfg.graph_rig_max_time_offset;
+  backend_cfg.MaxKeyframeBatch = cfg.graph_max_keyframe_batch;
+  backend_cfg.OptimizationAlgorithm = GraphOptimizationAlgorithms::enum_t(cfg.graph_opt_algorithm);
+  backend_cfg.OptimizationLinearSolver = GraphLinearSolvers::enum_t(cfg.graph_opt_linear_solver);
+  backend_cfg.PcgMaxIterations = cfg.graph_opt_pcg_max_iterations;
+  backend_cfg.PcgTolerance = cfg.graph_opt_pcg_tolerance;
+  backend_cfg.UseBackgroundRefinement = cfg.graph_refinement;
+  backend_cfg.RefinementKeyframesPerStep = cfg.graph_refinement_keyframes_per_step;
+  backend_cfg.RefinementIterations = cfg.graph_refinement_iterations;
+  backend_cfg.RefinementMinImprovement = cfg.graph_refinement_min_improvement;
+  backend_cfg.MarginalizeOdometry = cfg.graph_marginalize_odometry;
+  backend_cfg.MaxResidentKeyframes = cfg.keyframe_max_resident;
+  backend_cfg.KeyframeCacheFolder = cfg.keyframe_cache_folder;
+  backend_cfg.SharedStoreName = cfg.shared_store_name;
+  backend_cfg.SharedStoreCapacity = cfg.shared_store_capacity;
+  backend_cfg.SharedStoreFirstLevel = cfg.shared_store_first_level;
+  backend_cfg.SharedStoreLevels = cfg.shared_store_levels;
+  backend_cfg.UseTsdfMap = cfg.tsdf_map;
+  backend_cfg.TsdfVoxelSize = cfg.tsdf_voxel_size;
+  backend_cfg.TsdfTruncation = cfg.tsdf_truncation;
+  backend_cfg.TsdfMaxDepth = cfg.tsdf_max_depth;
+  backend_cfg.TsdfLevel = cfg.tsdf_level;
+  backend_cfg.TsdfStride = cfg.tsdf_stride;
+  backend_cfg.TsdfReintegrationTranslation = cfg.tsdf_reintegration_translation;
+  backend_cfg.TsdfReintegrationRotation = cfg.tsdf_reintegration_rotation;
   backend_cfg.NewConstraintSearchRadius = cfg.constraint_search_radius;
   backend_cfg.NewConstraintMinEntropyRatioCoarse = cfg.constraint_min_entropy_ratio_coarse;
   backend_cfg.NewConstraintMinEntropyRatioFine = cfg.constraint_min_entropy_ratio_fine;
   backend_cfg.UseRobustKernel = cfg.graph_opt_robust;
   backend_cfg.MinEquationSystemConstraintRatio = cfg.constraint_min_eq_sys_constraint_ratio;
+  backend_cfg.UseConstraintRanking = cfg.use_constraint_ranking;
+  backend_cfg.MaxConstraintCandidates = cfg.constraint_max_candidates;
+  backend_cfg.MinConstraintFrustumOverlap = cfg.constraint_min_frustum_overlap;
+  backend_cfg.MaxConstraintViewAngle = cfg.constraint_max_view_angle;
+  backend_cfg.MaxAppearanceCandidates = cfg.constraint_max_appearance_candidates;
+  backend_cfg.MinAppearanceSimilarity = cfg.constraint_min_appearance_similarity;
+  backend_cfg.MinNearbyAppearanceSimilarity = cfg.constraint_min_nearby_appearance_similarity;
+  backend_cfg.ValidationCacheMaxTranslation = cfg.constraint_validation_cache_max_translation;
+  backend_cfg.ValidationCacheMaxRotation = cfg.constraint_validation_cache_max_rotation;
   backend_cfg.UseMultiThreading = cfg.use_multithreading;
+  backend_cfg.BackendConcurrency = cfg.backend_concurrency;
+  backend_cfg.BackendFirstCore = cfg.backend_first_core;
 }
 } /* namespace dvo_slam */
 
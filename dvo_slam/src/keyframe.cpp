@@ -23,4 +23,26 @@
 namespace dvo_slam
 {
 
+void Keyframe::initializePoints(const float& intensity_threshold, const float& depth_threshold, const size_t& max_points_per_level, bool morton_order)
+{
+  predicate_.intensity_threshold = intensity_threshold;
+  predicate_.depth_threshold = depth_threshold;
+
+  points_.reset(new dvo::core::PointSelection(*image(), predicate_));
+  points_->maxPointsPerLevel(max_points_per_level);
+  points_->mortonOrder(morton_order);
+}
+
+void Keyframe::clearPoints()
+{
+  if(!points_) return;
+
+  size_t max_points_per_level = points_->maxPointsPerLevel();
+  bool morton_order = points_->mortonOrder();
+
+  points_.reset(new dvo::core::PointSelection(*image(), predicate_));
+  points_->maxPointsPerLevel(max_points_per_level);
+  points_->mortonOrder(morton_order);
+}
+
 } /* namespace dvo_slam */
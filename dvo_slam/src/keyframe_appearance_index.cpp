@@ -0,0 +1,182 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo_slam/keyframe_appearance_index.h>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <Eigen/Core>
+
+#include <algorithm>
+#include <cmath>
+
+namespace dvo_slam
+{
+
+typedef Eigen::Map<const Eigen::Matrix<float, KeyframeAppearanceIndex::DescriptorSize, 1> > ConstDescriptorMap;
+typedef Eigen::Map<Eigen::Matrix<float, KeyframeAppearanceIndex::DescriptorSize, 1> > DescriptorMap;
+
+struct ScoredKeyframe
+{
+  float similarity;
+  size_t index;
+
+  bool operator<(const ScoredKeyframe& other) const
+  {
+    return similarity > other.similarity || (similarity == other.similarity && index < other.index);
+  }
+};
+
+KeyframeAppearanceIndex::KeyframeAppearanceIndex(size_t level) :
+    level_(level)
+{
+}
+
+KeyframeAppearanceIndex::~KeyframeAppearanceIndex()
+{
+}
+
+size_t KeyframeAppearanceIndex::level() const
+{
+  return level_;
+}
+
+void KeyframeAppearanceIndex::level(size_t level)
+{
+  level_ = level;
+}
+
+void KeyframeAppearanceIndex::insert(const KeyframePtr& keyframe)
+{
+  std::pair<IdMap::iterator, bool> r = ids_.insert(std::make_pair(int(keyframe->id()), keyframes_.size()));
+
+  // a keyframe inserted again gets a new descriptor
+  if(r.second)
+  {
+    keyframes_.push_back(keyframe);
+    descriptors_.resize(descriptors_.size() + DescriptorSize);
+  }
+  else
+  {
+    keyframes_[r.first->second] = keyframe;
+  }
+
+  computeDescriptor(keyframe->image()->level(level_).intensity, &descriptors_[r.first->second * DescriptorSize]);
+}
+
+void KeyframeAppearanceIndex::clear()
+{
+  keyframes_.clear();
+  descriptors_.clear();
+  ids_.clear();
+}
+
+size_t KeyframeAppearanceIndex::size() const
+{
+  return keyframes_.size();
+}
+
+float KeyframeAppearanceIndex::similarity(const KeyframePtr& a, const KeyframePtr& b) const
+{
+  const float *da = descriptor(a), *db = descriptor(b);
+
+  if(da == 0 || db == 0) return 0.0f;
+
+  return ConstDescriptorMap(da).dot(ConstDescriptorMap(db));
+}
+
+void KeyframeAppearanceIndex::query(const KeyframePtr& keyframe, size_t max_results, float min_similarity, KeyframeVector& result) const
+{
+  const float* d = descriptor(keyframe);
+
+  if(d == 0) return;
+
+  queryExcluding(d, keyframe->id(), max_results, min_similarity, result);
+}
+
+void KeyframeAppearanceIndex::query(const float* descriptor, size_t max_results, float min_similarity, KeyframeVector& result) const
+{
+  // keyframe ids start at 1
+  queryExcluding(descriptor, 0, max_results, min_similarity, result);
+}
+
+void KeyframeAppearanceIndex::queryExcluding(const float* d, int excluded_id, size_t max_results, float min_similarity, KeyframeVector& result) const
+{
+  if(max_results == 0) return;
+
+  ConstDescriptorMap query(d);
+  std::vector<ScoredKeyframe> scored;
+
+  for(size_t idx = 0; idx < keyframes_.size(); ++idx)
+  {
+    if(keyframes_[idx]->id() == excluded_id) continue;
+
+    ScoredKeyframe s;
+    s.similarity = query.dot(ConstDescriptorMap(&descriptors_[idx * DescriptorSize]));
+    s.index = idx;
+
+    if(s.similarity >= min_similarity) scored.push_back(s);
+  }
+
+  if(scored.size() > max_results)
+  {
+    std::partial_sort(scored.begin(), scored.begin() + max_results, scored.end());
+    scored.resize(max_results);
+  }
+  else
+  {
+    std::sort(scored.begin(), scored.end());
+  }
+
+  for(std::vector<ScoredKeyframe>::const_iterator it = scored.begin(); it != scored.end(); ++it)
+  {
+    result.push_back(keyframes_[it->index]);
+  }
+}
+
+void KeyframeAppearanceIndex::computeDescriptor(const cv::Mat& intensity, float* descriptor)
+{
+  cv::Mat thumbnail(DescriptorHeight, DescriptorWidth, CV_32FC1, descriptor);
+
+  // area averaging removes most of the noise, the blur makes the descriptor tolerate shifts of about a thumbnail pixel
+  cv::Mat resized;
+  cv::resize(intensity, resized, thumbnail.size(), 0, 0, cv::INTER_AREA);
+  resized.convertTo(resized, CV_32F);
+  cv::GaussianBlur(resized, thumbnail, cv::Size(3, 3), 0.75, 0.75, cv::BORDER_REPLICATE);
+
+  DescriptorMap d(descriptor);
+  d.array() -= d.mean();
+
+  float norm = d.norm();
+
+  if(norm > 1e-3f)
+    d /= norm;
+  else
+    d.setZero();
+}
+
+const float* KeyframeAppearanceIndex::descriptor(const KeyframePtr& keyframe) const
+{
+  IdMap::const_iterator it = ids_.find(keyframe->id());
+
+  return it != ids_.end() ? &descriptors_[it->second * DescriptorSize] : 0;
+}
+
+} /* namespace dvo_slam */
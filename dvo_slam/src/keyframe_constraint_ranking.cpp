@@ -0,0 +1,207 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo_slam/keyframe_constraint_ranking.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace dvo_slam
+{
+
+// sampling density of the frustum and photometric tests
+static const int FrustumSamplesPerAxis = 5;
+static const size_t MaxPhotometricSamples = 400;
+
+// on the 0..255 intensity scale
+static const float PhotometricInlierThreshold = 20.0f;
+
+struct ScoredCandidate
+{
+  double score;
+  size_t order;
+  KeyframePtr keyframe;
+
+  bool operator<(const ScoredCandidate& other) const
+  {
+    return score > other.score || (score == other.score && order < other.order);
+  }
+};
+
+KeyframeConstraintRanking::KeyframeConstraintRanking() :
+    enabled_(true),
+    max_candidates_(0),
+    level_(3),
+    min_frustum_overlap_(0.0),
+    min_view_angle_cos_(-1.0)
+{
+}
+
+KeyframeConstraintRanking::~KeyframeConstraintRanking()
+{
+}
+
+void KeyframeConstraintRanking::enabled(bool enabled)
+{
+  enabled_ = enabled;
+}
+
+void KeyframeConstraintRanking::maxCandidates(size_t n)
+{
+  max_candidates_ = n;
+}
+
+void KeyframeConstraintRanking::minFrustumOverlap(double overlap)
+{
+  min_frustum_overlap_ = overlap;
+}
+
+void KeyframeConstraintRanking::maxViewAngle(double degrees)
+{
+  min_view_angle_cos_ = std::cos(std::min(180.0, std::max(0.0, degrees)) / 180.0 * M_PI);
+}
+
+void KeyframeConstraintRanking::level(size_t level)
+{
+  level_ = level;
+}
+
+void KeyframeConstraintRanking::rank(const KeyframePtr& keyframe, KeyframeVector& candidates) const
+{
+  if(!enabled_)
+  {
+    candidates.erase(std::remove(candidates.begin(), candidates.end(), keyframe), candidates.end());
+    return;
+  }
+
+  std::vector<ScoredCandidate> scored;
+  scored.reserve(candidates.size());
+
+  for(KeyframeVector::const_iterator it = candidates.begin(); it != candidates.end(); ++it)
+  {
+    // the graph filters out keyframes, which are connected already
+    if(*it == keyframe) continue;
+
+    ScoredCandidate c;
+    c.score = score(keyframe, *it);
+    c.order = scored.size();
+    c.keyframe = *it;
+
+    if(c.score > 0.0) scored.push_back(c);
+  }
+
+  std::sort(scored.begin(), scored.end());
+
+  if(max_candidates_ > 0 && scored.size() > max_candidates_) scored.resize(max_candidates_);
+
+  candidates.clear();
+
+  for(std::vector<ScoredCandidate>::const_iterator it = scored.begin(); it != scored.end(); ++it)
+  {
+    candidates.push_back(it->keyframe);
+  }
+}
+
+double KeyframeConstraintRanking::score(const KeyframePtr& keyframe, const KeyframePtr& candidate) const
+{
+  // cheapest test first
+  double view_angle_cos = keyframe->pose().rotation().col(2).dot(candidate->pose().rotation().col(2));
+
+  if(view_angle_cos < min_view_angle_cos_) return 0.0;
+
+  Eigen::Affine3d relative = candidate->pose().inverse() * keyframe->pose();
+
+  double overlap = frustumOverlap(relative, keyframe->image()->level(0).camera());
+
+  if(overlap <= 0.0 || overlap < min_frustum_overlap_) return 0.0;
+
+  double consistency = photometricConsistency(relative, keyframe->points(), keyframe->image()->level(level_), candidate->image()->level(level_), level_);
+
+  return overlap * consistency;
+}
+
+double KeyframeConstraintRanking::frustumOverlap(const Eigen::Affine3d& relative, const dvo::core::RgbdCamera& camera)
+{
+  const dvo::core::IntrinsicMatrix& k = camera.intrinsics();
+  const double w = camera.width(), h = camera.height();
+
+  int visible = 0, total = 0;
+
+  for(int d = 1; d <= 3; ++d)
+    for(int y = 0; y < FrustumSamplesPerAxis; ++y)
+      for(int x = 0; x < FrustumSamplesPerAxis; ++x)
+      {
+        double u = (x + 0.5) / FrustumSamplesPerAxis * w, v = (y + 0.5) / FrustumSamplesPerAxis * h;
+
+        Eigen::Vector3d p((u - k.ox()) / k.fx() * d, (v - k.oy()) / k.fy() * d, d);
+        Eigen::Vector3d q = relative * p;
+
+        total++;
+
+        if(q(2) <= 0.0) continue;
+
+        double u2 = q(0) / q(2) * k.fx() + k.ox(), v2 = q(1) / q(2) * k.fy() + k.oy();
+
+        if(u2 >= 0.0 && u2 < w && v2 >= 0.0 && v2 < h) visible++;
+      }
+
+  return double(visible) / double(total);
+}
+
+double KeyframeConstraintRanking::photometricConsistency(const Eigen::Affine3d& relative, dvo::core::PointSelection& points, dvo::core::RgbdImage& reference, dvo::core::RgbdImage& other, size_t level)
+{
+  const dvo::core::PointWithIntensityAndDepthSoa* soa;
+  points.select(level, reference.camera().intrinsics(), soa);
+
+  if(soa->size() == 0) return 0.0;
+
+  const float *px = soa->channel(dvo::core::PointWithIntensityAndDepthSoa::X);
+  const float *py = soa->channel(dvo::core::PointWithIntensityAndDepthSoa::Y);
+  const float *pz = soa->channel(dvo::core::PointWithIntensityAndDepthSoa::Z);
+  const float *pi = soa->channel(dvo::core::PointWithIntensityAndDepthSoa::Intensity);
+
+  const dvo::core::IntrinsicMatrix& k = other.camera().intrinsics();
+  const Eigen::Affine3f t = relative.cast<float>();
+  const int w = other.intensity.cols, h = other.intensity.rows;
+
+  const size_t step = std::max<size_t>(1, soa->size() / MaxPhotometricSamples);
+  int inliers = 0, total = 0;
+
+  for(size_t idx = 0; idx < soa->size(); idx += step)
+  {
+    total++;
+
+    Eigen::Vector3f q = t * Eigen::Vector3f(px[idx], py[idx], pz[idx]);
+
+    if(!(q(2) > 0.0f)) continue;
+
+    int u = int(q(0) / q(2) * k.fx() + k.ox() + 0.5f), v = int(q(1) / q(2) * k.fy() + k.oy() + 0.5f);
+
+    if(u < 0 || u >= w || v < 0 || v >= h) continue;
+
+    float i = other.intensity.at<dvo::core::IntensityType>(v, u);
+
+    if(std::abs(i - pi[idx]) < PhotometricInlierThreshold) inliers++;
+  }
+
+  return double(inliers) / double(total);
+}
+
+} /* namespace dvo_slam */
@@ -25,6 +25,10 @@
 
 #include <ros/time.h>
 
+#include <algorithm>
+
+#include <boost/unordered_set.hpp>
+
 namespace dvo_slam
 {
 
@@ -40,6 +44,12 @@ void NearestNeighborConstraintSearch::maxDistance(const float& d)
 
 void NearestNeighborConstraintSearch::findPossibleConstraints(const KeyframeVector& all, const KeyframePtr& keyframe, KeyframeVector& candidates)
 {
+  if(index_ != 0)
+  {
+    index_->radiusSearch(keyframe->pose().translation(), max_distance_, candidates);
+    return;
+  }
+
   pcl::PointXYZ search_point;
   search_point.x = keyframe->pose().translation()(0);
   search_point.y = keyframe->pose().translation()(1);
@@ -73,6 +83,32 @@ void NearestNeighborConstraintSearch::findPossibleConstraints(const KeyframeVect
 
 void DriftAwareNearestNeighborConstraintSearch::findPossibleConstraints(const KeyframeVector& all, const KeyframePtr& keyframe, KeyframeVector& candidates)
 {
+  if(index_ != 0)
+  {
+    // the drift moves keyframes at most time_diff * drift_per_second closer, so query with the largest possible shift
+    // and apply the exact criterion to the few keyframes found
+    const Eigen::Vector3d search_point = keyframe->pose().translation();
+    const float max_drift = std::max(0.0f, (float)(keyframe->timestamp() - index_->oldestTimestamp()).toSec() * drift_per_second_);
+
+    KeyframeVector found;
+    index_->radiusSearch(search_point, max_distance_ + max_drift, found);
+
+    for(KeyframeVector::const_iterator it = found.begin(); it != found.end(); ++it)
+    {
+      if(keyframe->id() == (*it)->id()) continue;
+
+      float time_diff = (float)(keyframe->timestamp() - (*it)->timestamp()).toSec();
+      float drift_distance = time_diff * drift_per_second_;
+      float distance = (float)(search_point - (*it)->pose().translation()).norm();
+
+      if(distance >= drift_distance) distance -= drift_distance;
+
+      if(distance <= max_distance_) candidates.push_back(*it);
+    }
+
+    return;
+  }
+
   pcl::PointXYZ search_point;
   search_point.x = keyframe->pose().translation()(0);
   search_point.y = keyframe->pose().translation()(1);
@@ -128,4 +164,59 @@ void DriftAwareNearestNeighborConstraintSearch::findPossibleConstraints(const Ke
   }
 }
 
+void AppearanceConstraintSearch::maxCandidates(size_t n)
+{
+  max_candidates_ = n;
+}
+
+void AppearanceConstraintSearch::minSimilarity(float s)
+{
+  min_similarity_ = s;
+}
+
+void AppearanceConstraintSearch::minSearchSimilarity(float s)
+{
+  min_search_similarity_ = s;
+}
+
+void AppearanceConstraintSearch::findPossibleConstraints(const KeyframeVector& all, const KeyframePtr& keyframe, KeyframeVector& candidates)
+{
+  KeyframeVector similar;
+  findPossibleConstraints(all, keyframe, candidates, similar);
+
+  candidates.insert(candidates.end(), similar.begin(), similar.end());
+}
+
+void AppearanceConstraintSearch::findPossibleConstraints(const KeyframeVector& all, const KeyframePtr& keyframe, KeyframeVector& nearby, KeyframeVector& similar)
+{
+  KeyframeVector found;
+  search_->findPossibleConstraints(all, keyframe, found);
+
+  boost::unordered_set<int> ids;
+
+  for(KeyframeVector::const_iterator it = found.begin(); it != found.end(); ++it)
+  {
+    ids.insert((*it)->id());
+
+    if(min_search_similarity_ <= -1.0f || index_->similarity(keyframe, *it) >= min_search_similarity_) nearby.push_back(*it);
+  }
+
+  if(max_candidates_ == 0) return;
+
+  // the nearby keyframes usually are the most similar ones, so ask for enough to get max_candidates_ new ones
+  KeyframeVector queried;
+  index_->query(keyframe, max_candidates_ + found.size(), min_similarity_, queried);
+
+  size_t added = 0;
+
+  for(KeyframeVector::const_iterator it = queried.begin(); it != queried.end() && added < max_candidates_; ++it)
+  {
+    if(ids.insert((*it)->id()).second)
+    {
+      similar.push_back(*it);
+      added++;
+    }
+  }
+}
+
 } /* namespace dvo_slam */
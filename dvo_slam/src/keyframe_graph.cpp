@@ -20,20 +20,40 @@
 
 #include <dvo_slam/keyframe_graph.h>
 #include <dvo_slam/keyframe_constraint_search.h>
+#include <dvo_slam/keyframe_appearance_index.h>
+#include <dvo_slam/keyframe_constraint_ranking.h>
+#include <dvo_slam/keyframe_store.h>
+#include <dvo_slam/shared_keyframe_store.h>
+#include <dvo_slam/map_snapshot.h>
 #include <dvo_slam/local_tracker.h>
 #include <dvo_slam/timestamped.h>
+#include <dvo_slam/tsdf_map.h>
+#include <dvo_slam/vertex_table.h>
 
 #include <dvo/dense_tracking.h>
-#include <dvo/util/stopwatch.h>
+#include <dvo/util/instrumentation.h>
+#include <dvo/util/ring_buffer.h>
+#include <dvo/util/task_arenas.h>
+
+#include <algorithm>
+#include <deque>
+#include <set>
 
-#include <tbb/concurrent_queue.h>
 #include <tbb/tbb_thread.h>
 #include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
 #include <tbb/parallel_reduce.h>
 #include <tbb/enumerable_thread_specific.h>
 #include <tbb/mutex.h>
+#include <tbb/spin_mutex.h>
+#include <tbb/atomic.h>
 
 #include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/unordered_set.hpp>
 #include <boost/signals2.hpp>
 
 #include <Eigen/Core>
@@ -43,6 +63,7 @@
 #include <g2o/solvers/dense/linear_solver_dense.h>
 #include <g2o/solvers/pcg/linear_solver_pcg.h>
 #include <g2o/solvers/csparse/linear_solver_csparse.h>
+#include <g2o/solvers/cholmod/linear_solver_cholmod.h>
 #include <g2o/core/block_solver.h>
 #include <g2o/core/solver.h>
 #include <g2o/core/optimization_algorithm_levenberg.h>
@@ -51,6 +72,7 @@
 #include <g2o/core/robust_kernel_impl.h>
 
 #include <g2o/core/estimate_propagator.h>
+#include <g2o/core/hyper_graph_action.h>
 
 #include <g2o/types/slam3d/vertex_se3.h>
 #include <g2o/types/slam3d/edge_se3.h>
@@ -65,6 +87,19 @@ namespace dvo_slam
 namespace internal
 {
 
+// the parallel algorithms bound to their arguments, for running them in the backend arena
+template<typename Range, typename Body>
+static void parallelFor(const Range& range, const Body& body)
+{
+  tbb::parallel_for(range, body);
+}
+
+template<typename Range, typename Body>
+static void parallelReduce(const Range& range, Body& body)
+{
+  tbb::parallel_reduce(range, body);
+}
+
 static Eigen::Isometry3d toIsometry(const Eigen::Affine3d& pose)
 {
   Eigen::Isometry3d p(pose.rotation());
@@ -81,532 +116,2641 @@ static Eigen::Affine3d toAffine(const Eigen::Isometry3d& pose)
   return p;
 }
 
-static inline int combine(const short& left, const short& right)
+/**
+ * Linear solver of the graph optimization, which records the time of every solve. g2o resets the linear solver at the
+ * start of every optimize() call, which throws the symbolic factorization of the sparse solvers away. Here it is only
+ * reset once a system with other blocks is solved, so optimizations continuing on the same structure, e.g., the
+ * rounds of optimizeAndPruneOutliers(), reuse it.
+ */
+template<typename MatrixType, typename Solver>
+class GraphLinearSolver : public Solver
 {
-  int lower, upper;
-
-  if(left < right)
-  {
-    lower = right;
-    upper = left;
-  }
-  else
+public:
+  GraphLinearSolver() :
+    structure_(0)
   {
-    lower = left;
-    upper = right;
   }
 
-  return upper << 16 | lower;
-}
-
-class KeyframeGraphImpl
-{
-public:
-  friend class ::dvo_slam::KeyframeGraph;
-
-  KeyframeGraphImpl() :
-    optimization_thread_shutdown_(false),
-    optimization_thread_(boost::bind(&KeyframeGraphImpl::execOptimization, this)),
-    next_keyframe_id_(1),
-    next_odometry_vertex_id_(-1),
-    next_odometry_edge_id_(-1),
-    validation_tracker_pool_(boost::bind(boost::make_shared<dvo::DenseTracker>))
+  virtual ~GraphLinearSolver()
   {
-    // g2o setup
-    keyframegraph_.setAlgorithm(
-        new g2o::OptimizationAlgorithmDogleg(
-            new BlockSolver(
-                new LinearSolver()
-    )));
-    keyframegraph_.setVerbose(false);
-
-    configure(cfg_);
   }
 
-  ~KeyframeGraphImpl()
+  virtual bool init()
   {
-    optimization_thread_shutdown_ = true;
-    new_keyframes_.push(LocalMap::Ptr());
-    optimization_thread_.join();
+    return true;
   }
 
-  void configure(const dvo_slam::KeyframeGraphConfig& cfg)
+  virtual bool solve(const g2o::SparseBlockMatrix<MatrixType>& A, double* x, double* b)
   {
-    cfg_ = cfg;
+    static dvo::util::Timer& solve_timer = dvo::util::Instrumentation::instance().timer("keyframe_graph/optimize/linear_solve");
+    static dvo::util::Timer& analysis_counter = solve_timer.child("analysis");
 
-    if(!constraint_search_)
-      constraint_search_.reset(new NearestNeighborConstraintSearch(cfg_.NewConstraintSearchRadius));
-  }
+    dvo::util::ScopedTimer solve_scope(solve_timer);
 
-  void add(const LocalMap::Ptr& keyframe)
-  {
-    if(cfg_.UseMultiThreading)
-    {
-      new_keyframes_.push(keyframe);
-    }
-    else
+    const size_t s = structure(A);
+
+    if(s != structure_)
     {
-      // wait until queue is empty
-      tbb::mutex::scoped_lock l(queue_empty_sync_);
+      analysis_counter.record(0.0);
 
-      newKeyframe(keyframe);
+      Solver::init();
+      structure_ = s;
     }
+
+    return Solver::solve(A, x, b);
   }
+private:
+  size_t structure_;
 
-  g2o::OptimizableGraph::Vertex* findNextVertex(g2o::OptimizableGraph::Vertex *v)
+  // hash of the positions and the storage of the blocks, the solvers keep pointers to the blocks of the system
+  static size_t structure(const g2o::SparseBlockMatrix<MatrixType>& A)
   {
-    g2o::OptimizableGraph::Vertex *other = 0, *closest = 0;
-
-    ros::Time ts = dynamic_cast<Timestamped*>(v->userData())->timestamp;
+    size_t seed = 0;
+    boost::hash_combine(seed, A.rows());
+    boost::hash_combine(seed, A.cols());
 
-    for(g2o::OptimizableGraph::EdgeSet::iterator e_it = v->edges().begin(); e_it != v->edges().end(); ++e_it)
+    for(size_t c = 0; c < A.blockCols().size(); ++c)
     {
-      other = dynamic_cast<g2o::OptimizableGraph::Vertex*>((*e_it)->vertex(0) != v ? (*e_it)->vertex(0) : (*e_it)->vertex(1));
+      boost::hash_combine(seed, A.blockCols()[c].size());
 
-      if(dynamic_cast<Timestamped*>(other->userData())->timestamp < ts) continue;
-
-      if(closest != 0)
-      {
-        if(dynamic_cast<Timestamped*>(other->userData())->timestamp < dynamic_cast<Timestamped*>(closest->userData())->timestamp)
-        {
-          closest = other;
-        }
-      }
-      else
+      for(typename g2o::SparseBlockMatrix<MatrixType>::IntBlockMap::const_iterator it = A.blockCols()[c].begin(); it != A.blockCols()[c].end(); ++it)
       {
-        closest = other;
+        boost::hash_combine(seed, it->first);
+        boost::hash_combine(seed, static_cast<const void*>(it->second));
       }
     }
 
-    return closest;
+    return seed;
   }
+};
 
-  bool hasEdge(g2o::OptimizableGraph::Vertex const*v, int edge_id)
-  {
-    bool result = false;
+// the algorithm owns the block solver, which owns the linear solver
+static g2o::OptimizationAlgorithm* createOptimizationAlgorithm(const dvo_slam::KeyframeGraphConfig& cfg)
+{
+  typedef g2o::BlockSolver_6_3 BlockSolver;
+  typedef BlockSolver::PoseMatrixType PoseMatrixType;
 
-    for(g2o::OptimizableGraph::EdgeSet::const_iterator e_it = v->edges().begin(); e_it != v->edges().end() && !result; ++e_it)
+  BlockSolver::LinearSolverType* linear_solver = 0;
+
+  switch(cfg.OptimizationLinearSolver)
+  {
+    case GraphLinearSolvers::Cholmod:
+      linear_solver = new GraphLinearSolver<PoseMatrixType, g2o::LinearSolverCholmod<PoseMatrixType> >();
+      break;
+    case GraphLinearSolvers::Pcg:
     {
-      result = (*e_it)->id() == edge_id;
-    }
+      GraphLinearSolver<PoseMatrixType, g2o::LinearSolverPCG<PoseMatrixType> >* pcg = new GraphLinearSolver<PoseMatrixType, g2o::LinearSolverPCG<PoseMatrixType> >();
+      pcg->setMaxIterations(cfg.PcgMaxIterations);
+      pcg->setTolerance(cfg.PcgTolerance);
+      pcg->setAbsoluteTolerance(false);
 
-    return result;
+      linear_solver = pcg;
+      break;
+    }
+    case GraphLinearSolvers::Dense:
+      linear_solver = new GraphLinearSolver<PoseMatrixType, g2o::LinearSolverDense<PoseMatrixType> >();
+      break;
+    case GraphLinearSolvers::CSparse:
+    default:
+      linear_solver = new GraphLinearSolver<PoseMatrixType, g2o::LinearSolverCSparse<PoseMatrixType> >();
+      break;
   }
 
-  void finalOptimization()
+  BlockSolver* solver = new BlockSolver(linear_solver);
+
+  switch(cfg.OptimizationAlgorithm)
   {
-    tbb::mutex::scoped_lock l;
-    std::cerr << "final optimization, waiting for all keyframes";
-    while(!l.try_acquire(queue_empty_sync_))
-    {
-      std::cerr << ".";
-      tbb::this_tbb_thread::sleep(tbb::tick_count::interval_t(0.1));
-    }
-    std::cerr << std::endl;
+    case GraphOptimizationAlgorithms::GaussNewton:
+      return new g2o::OptimizationAlgorithmGaussNewton(solver);
+    case GraphOptimizationAlgorithms::LevenbergMarquardt:
+      return new g2o::OptimizationAlgorithmLevenberg(solver);
+    case GraphOptimizationAlgorithms::Dogleg:
+    default:
+      return new g2o::OptimizationAlgorithmDogleg(solver);
+  }
+}
 
-    std::cerr << keyframes_.size() << " keyframes" << std::endl;
+// key of the unordered pair of vertex ids in the edge index
+static inline uint64_t edgeKey(int left, int right)
+{
+  if(left > right) std::swap(left, right);
 
-    for(KeyframeVector::iterator it = keyframes_.begin(); it != keyframes_.end(); ++it)
-    {
-      ConstraintVector constraints;
-      KeyframeVector constraint_candidates, filtered_constraint_candidates;
-      constraint_search_->findPossibleConstraints(keyframes_, *it, constraint_candidates);
+  return uint64_t(uint32_t(left)) << 32 | uint64_t(uint32_t(right));
+}
 
-      for(KeyframeVector::iterator cc_it = constraint_candidates.begin(); cc_it != constraint_candidates.end(); ++cc_it)
-      {
-        int edge_id = combine((*cc_it)->id() , (*it)->id());
-        bool exists = std::abs((*cc_it)->id() - (*it)->id()) <= 1; // odometry constraint or self constraint
+/**
+ * Odometry frames of a local map, which were replaced by a single edge between its keyframe and the next one.
+ */
+struct MarginalizedSegment
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-        exists = exists || hasEdge(keyframegraph_.vertex((*it)->id()), edge_id) || hasEdge(keyframegraph_.vertex((*cc_it)->id()), edge_id);
+  g2o::VertexSE3 *begin, *end;
+  ros::Time begin_timestamp, end_timestamp;
 
-        if(!exists)
-        {
-          filtered_constraint_candidates.push_back(*cc_it);
-        }
-      }
+  // poses relative to begin at the time of marginalization
+  Eigen::Isometry3d begin_to_end;
+  LocalMap::FramePoseVector frames;
+};
 
-      // validate constraints
-      validateKeyframeConstraintsParallel(filtered_constraint_candidates, *it, constraints);
+typedef std::vector<MarginalizedSegment, Eigen::aligned_allocator<MarginalizedSegment> > MarginalizedSegmentVector;
 
-      // update graph
-      insertNewKeyframeConstraints(*it, constraints);
-      std::cerr << constraints.size() << " additional constraints" << std::endl;
-    }
+/**
+ * Outcome of the dense validation of a keyframe pair, by edgeKey(). Relative is the pose of the keyframe with the
+ * smaller id relative to the other one, as estimated when the pair was validated.
+ */
+struct ValidationOutcome
+{
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
 
-    // include all edges in the optimization
-    for(g2o::OptimizableGraph::EdgeSet::iterator e_it = keyframegraph_.edges().begin(); e_it != keyframegraph_.edges().end(); ++e_it)
-    {
-      g2o::EdgeSE3* e = (g2o::EdgeSE3*) (*e_it);
-      e->setLevel(0);
-    }
+  Eigen::Isometry3d Relative;
+  bool Accepted;
+  double EntropyRatio, ConstraintRatio;
+};
 
-    std::cerr << "optimizing..." << std::endl;
-    for(int idx = 0; idx < 10; ++idx)
-    {
-      keyframegraph_.setVerbose(true);
-      keyframegraph_.initializeOptimization();
-      keyframegraph_.optimize(cfg_.OptimizationFinalIterations / 10);
-      removeOutlierConstraints(0.1);
-    }
-    std::cerr << "done" << std::endl;
+typedef std::map<uint64_t, ValidationOutcome, std::less<uint64_t>, Eigen::aligned_allocator<std::pair<const uint64_t, ValidationOutcome> > > ValidationOutcomeMap;
 
-    // update keyframe database
-    updateKeyframePosesFromGraph();
+/**
+ * The local maps of every sensor form their own chain. The current frame vertex of the last local map of a chain
+ * becomes the keyframe vertex of the next one.
+ */
+struct SensorChain
+{
+  SensorChain() :
+    last_keyframe_id(0),
+    tail_vertex_id(0),
+    has_extrinsics(false)
+  {
+  }
 
-    map_changed_(*me_);
+  // 0 before the first keyframe of the chain
+  int last_keyframe_id, tail_vertex_id;
 
-    ROS_WARN_STREAM("created validation tracker instances: " << validation_tracker_pool_.size());
+  bool has_extrinsics;
+  Eigen::Isometry3d rig_to_sensor;
+};
 
-    std::cerr << keyframes_.size() << " keyframes" << std::endl;
-  }
+typedef std::vector<SensorChain, Eigen::aligned_allocator<SensorChain> > SensorChainVector;
 
-  void optimizeInterKeyframePoses()
-  {
-    for(KeyframeVector::iterator it = keyframes_.begin(); it != (keyframes_.end() - 1); ++it)
-    {
-      g2o::OptimizableGraph::VertexSet inter_keyframe_vertices;
+// keyframes moved in the TsdfMap by one update, each may have to be restored from the keyframe store
+static const size_t TsdfMaxMovesPerUpdate = 8;
 
-      g2o::OptimizableGraph::Vertex *v1 = keyframegraph_.vertex((*it)->id());
-      g2o::OptimizableGraph::Vertex *v2 = keyframegraph_.vertex((*(it + 1))->id());
+// rounds of the joint optimization after KeyframeGraph::merge(), the lock is released in between
+static const int MergeOptimizationRounds = 10;
 
-      v1->setFixed(true);
-      v2->setFixed(true);
+// the extrinsics are calibrated, but the keyframes of two unsynchronized cameras are taken up to a frame apart
+static const double RigInformation = 1.0 / (0.01 * 0.01);
 
-      inter_keyframe_vertices.insert(v1);
-      inter_keyframe_vertices.insert(v2);
+// scales the motion delta by s in [0, 1]
+static Eigen::Isometry3d interpolate(const Eigen::Isometry3d& delta, double s)
+{
+  Eigen::Isometry3d result(Eigen::Quaterniond::Identity().slerp(s, Eigen::Quaterniond(delta.rotation())));
+  result.translation() = s * delta.translation();
 
-      for(g2o::OptimizableGraph::EdgeSet::iterator edge_it = v1->edges().begin(); edge_it != v1->edges().end(); ++edge_it)
-      {
-        g2o::HyperGraph::Vertex *candidate = 0;
-        if((*edge_it)->vertex(0)->id() == v1->id())
-        {
-          candidate = (*edge_it)->vertex(1);
-        }
+  return result;
+}
 
-        if((*edge_it)->vertex(1)->id() == v1->id())
-        {
-          candidate = (*edge_it)->vertex(0);
-        }
+/**
+ * How the ids and poses of a snapshot are mapped into the graph. restore() takes the snapshot as it is, merge() moves
+ * it behind the ids in use and into the frame of the map.
+ */
+struct SnapshotMapping
+{
+  SnapshotMapping() :
+    keyframe_offset(0),
+    odometry_offset(0),
+    alignment(Eigen::Isometry3d::Identity()),
+    renumber_edges(false)
+  {
+  }
 
-        if(candidate != 0 && candidate->id() < 0)
-        {
-          inter_keyframe_vertices.insert(candidate);
-        }
-      }
+  // added to the positive keyframe and the negative odometry vertex ids
+  int keyframe_offset, odometry_offset;
 
-      keyframegraph_.setVerbose(false);
-      keyframegraph_.initializeOptimization(inter_keyframe_vertices, 2);
-      keyframegraph_.optimize(20);
-    }
+  // from the snapshot into the map frame
+  Eigen::Isometry3d alignment;
+
+  // the edges get new ids instead of keeping those from the snapshot
+  bool renumber_edges;
+
+  int vertex(int id) const
+  {
+    return id > 0 ? id + keyframe_offset : id + odometry_offset;
   }
+};
 
-private:
-  typedef g2o::BlockSolver_6_3 BlockSolver;
-  typedef g2o::LinearSolverCSparse<BlockSolver::PoseMatrixType> LinearSolver;
+// last change of a vertex or an edge
+struct ChangeStamp
+{
+  size_t revision;
+  bool removed;
+};
 
-  typedef std::vector<std::pair<KeyframePtr, LocalTracker::TrackingResult> > ConstraintVector;
-  typedef tbb::enumerable_thread_specific<boost::shared_ptr<dvo::DenseTracker> > DenseTrackerPool;
+typedef boost::unordered_map<int, ChangeStamp> ChangeStampMap;
 
-  void execOptimization()
+// a vertex or an edge stamped in a revision, the log is ordered by revision
+struct ChangeLogEntry
+{
+  size_t revision;
+  int id;
+  bool vertex;
+};
+
+typedef std::vector<ChangeLogEntry> ChangeLog;
+
+static bool isBeforeRevision(const ChangeLogEntry& entry, size_t revision)
+{
+  return entry.revision < revision;
+}
+
+// copies the preemption requested by another thread to the plain flag g2o polls, after every iteration
+struct PreemptionAction : public g2o::HyperGraphAction
+{
+  PreemptionAction(const tbb::atomic<bool>& requested, bool& stop) : requested(requested), stop(stop) {}
+
+  virtual g2o::HyperGraphAction* operator()(const g2o::HyperGraph* graph, g2o::HyperGraphAction::Parameters* parameters = 0)
   {
-    static dvo::util::stopwatch sw_nkf("new_kf", 10);
+    stop = requested;
+    return this;
+  }
 
-    bool is_locked = false;
+  const tbb::atomic<bool>& requested;
+  bool& stop;
+};
 
-    while(!optimization_thread_shutdown_)
-    {
-      LocalMap::Ptr new_keyframe;
+/**
+ * Hand-off of the completed local maps from the tracking thread to the optimization thread. push() doesn't take a lock
+ * and only waits if MaxCapacity maps are queued, the consumer takes everything which accumulated, so a backend that
+ * falls behind inserts several keyframes per optimization instead of stalling the frontend.
+ */
+class LocalMapQueue
+{
+public:
+  static const size_t MaxCapacity = 1024;
+
+  LocalMapQueue() :
+    items_(MaxCapacity)
+  {
+    max_batch_ = 1;
+    oldest_ = 0;
+    pushed_ = 0;
+    taken_ = 0;
+    finished_ = 0;
+  }
 
-      new_keyframes_.pop(new_keyframe);
+  // maps taken by one pop(), 0 takes all
+  void maxBatch(size_t max_batch)
+  {
+    max_batch_ = max_batch;
+  }
 
-      if(new_keyframe)
-      {
-        if(!is_locked)
-        {
-          queue_empty_sync_.lock();
-          is_locked = true;
-        }
+  void push(const LocalMap::Ptr& map)
+  {
+    const int64_t now = dvo::util::Timer::now();
 
-        sw_nkf.start();
-        newKeyframe(new_keyframe);
-        sw_nkf.stopAndPrint();
+    // counted before the push, so waitIdle() never sees a queued map it doesn't wait for
+    ++pushed_;
 
-        if(is_locked && new_keyframes_.empty())
-        {
-          queue_empty_sync_.unlock();
-          is_locked = false;
-        }
-      }
+    if(!items_.push(Item(map, now)))
+    {
+      --pushed_;
+      return;
     }
+
+    oldest_.compare_and_swap(now, 0);
   }
 
-  void newKeyframe(const LocalMap::Ptr& map)
+  // blocks until maps are available and takes at most maxBatch() of them, returns false after shutdown()
+  bool pop(std::vector<LocalMap::Ptr>& batch)
   {
-    tbb::mutex::scoped_lock l(new_keyframe_sync_);
+    batch.clear();
 
-    static dvo::util::stopwatch
-      sw_constraint("constraint_search", 50),
-      sw_validation("constraint_validation", 50),
-      sw_insert("constraint_insert", 50),
-      sw_opt("constraint_optimization", 50)
-    ;
+    Item item;
 
-    KeyframeVector constraint_candidates;
-    ConstraintVector constraints;
+    if(!items_.pop(item)) return false;
 
-    // insert keyframe into data structures
-    KeyframePtr keyframe = insertNewKeyframe(map);
+    take(item, batch);
 
-    // early abort
-    if(keyframes_.size() == 1) return;
+    return true;
+  }
 
-    sw_constraint.start();
-    // find possible constraints
-    constraint_search_->findPossibleConstraints(keyframes_, keyframe, constraint_candidates);
-    sw_constraint.stopAndPrint();
-    //std::cerr << "constraints to validate: " << constraint_candidates.size() << std::endl;
+  // same without blocking, returns false if no map is queued
+  bool tryPop(std::vector<LocalMap::Ptr>& batch)
+  {
+    batch.clear();
 
-    sw_validation.start();
-    // validate constraints
-    validateKeyframeConstraintsParallel(constraint_candidates, keyframe, constraints);
+    Item item;
 
-    ROS_WARN_STREAM("adding " << constraints.size() << " new constraints");
+    if(!items_.tryPop(item)) return false;
 
-    sw_validation.stopAndPrint();
-    sw_insert.start();
-    // update graph
-    int max_distance = insertNewKeyframeConstraints(keyframe, constraints);
-    sw_insert.stopAndPrint();
+    take(item, batch);
 
-    if(max_distance >= cfg_.MinConstraintDistance)
-    {
-      sw_opt.start();
-      // optimize
-      keyframegraph_.initializeOptimization();
-      keyframegraph_.optimize(cfg_.OptimizationIterations / 2);
+    return true;
+  }
 
-      removeOutlierConstraints(0.1, 10);
+  bool isShutdown() const
+  {
+    return items_.isShutdown();
+  }
 
-      keyframegraph_.initializeOptimization();
-      keyframegraph_.optimize(cfg_.OptimizationIterations / 2);
+  // the batch of the last pop() is inserted
+  void done()
+  {
+    boost::mutex::scoped_lock lock(idle_mutex_);
 
-      //// update keyframe database
-      updateKeyframePosesFromGraph();
+    finished_ += taken_;
+    taken_ = 0;
 
-      sw_opt.stopAndPrint();
-    }
+    if(finished_ == pushed_) idle_.notify_all();
+  }
 
-    map_changed_(*me_);
+  // blocks until all pushed maps are inserted
+  void waitIdle()
+  {
+    boost::mutex::scoped_lock lock(idle_mutex_);
+
+    // a map stays pending from push() until the done() after its insertion, the timeout covers a push racing with done()
+    while(finished_ != pushed_ && !items_.isShutdown()) idle_.timed_wait(lock, boost::posix_time::milliseconds(10));
   }
 
-  /*
-  static void match(dvo::DenseTracker& t, const KeyframePtr& keyframe, const KeyframePtr& constraint, TrackingResult& r)
+  size_t depth() const
   {
-    t.match(*(keyframe->image()), *(constraint->image()), r.Tr);
-    t.getInformationEstimate(r.Information);
-    r.Context = &t.itctx_;
+    return items_.size();
   }
-   */
-  struct ValidateKeyframeConstraintReduction
+
+  // approximate, seconds the oldest queued map waits
+  double age() const
   {
-    const dvo_slam::KeyframeGraphConfig& config;
-    DenseTrackerPool& trackers;
-    const dvo::DenseTracker::Config &simple_config, &final_config;
-    const KeyframePtr& keyframe;
-    ConstraintVector proposals;
+    const int64_t oldest = oldest_;
 
-    ValidateKeyframeConstraintReduction(const dvo_slam::KeyframeGraphConfig& config, DenseTrackerPool& trackers, const dvo::DenseTracker::Config &simple_config, const dvo::DenseTracker::Config& final_config, const KeyframePtr& keyframe) :
-      config(config),
-      trackers(trackers),
-      simple_config(simple_config),
-      final_config(final_config),
-      keyframe(keyframe)
-    {
-    }
+    return oldest == 0 || items_.empty() ? 0.0 : dvo::util::Timer::seconds(dvo::util::Timer::now() - oldest);
+  }
 
-    ValidateKeyframeConstraintReduction(ValidateKeyframeConstraintReduction& other, tbb::split) :
-      config(other.config),
-      trackers(other.trackers),
-      simple_config(other.simple_config),
-      final_config(other.final_config),
-      keyframe(other.keyframe)
-    {
-    }
+  void shutdown()
+  {
+    items_.shutdown();
+    items_.clear();
 
-    void operator()(const tbb::blocked_range<KeyframeVector::const_iterator>& r)
-    {
-      for(KeyframeVector::const_iterator it = r.begin(); it != r.end(); ++it)
-      {
-        const KeyframePtr& constraint = (*it);
-        Eigen::Affine3d transform_proposal;
+    boost::mutex::scoped_lock lock(idle_mutex_);
+    idle_.notify_all();
+  }
+private:
+  typedef std::pair<LocalMap::Ptr, int64_t> Item;
 
-        if(constraint == keyframe) continue;
-        if(constraint->id() == (keyframe->id() - 1)) continue;
+  dvo::util::RingBuffer<Item> items_;
+  tbb::atomic<size_t> max_batch_;
+  tbb::atomic<int64_t> oldest_;
+  tbb::atomic<size_t> pushed_, taken_, finished_;
 
-        // TODO: move to KeyframeConstraintSearch
-        //double angle = keyframe->pose().rotation().col(2).head<3>().dot(constraint->pose().rotation().col(2).head<3>());
-        //if(angle < 0) continue;
+  boost::mutex idle_mutex_;
+  boost::condition_variable idle_;
 
-        double simple_threshold = config.NewConstraintMinEntropyRatioCoarse, final_threshold = config.NewConstraintMinEntropyRatioFine, simple_constraint_threshold = config.MinEquationSystemConstraintRatio, final_constraint_threshold = config.MinEquationSystemConstraintRatio;
-        double ratio_identity, ratio_relative, ratio_final, constraint_ratio_identity, constraint_ratio_relative, constraint_ratio_final;
+  void take(Item& item, std::vector<LocalMap::Ptr>& batch)
+  {
+    static dvo::util::Timer& age_timer = dvo::util::Instrumentation::instance().timer("keyframe_graph/queue/age");
+    static dvo::util::Timer& coalesced_counter = dvo::util::Instrumentation::instance().timer("keyframe_graph/queue/coalesced");
 
-        LocalTracker::TrackingResult r_identity, r_relative, *r_final = 0;
-        DenseTrackerPool::reference t = trackers.local();
-        t->configure(simple_config);
+    const int64_t now = dvo::util::Timer::now();
+    const size_t max_batch = max_batch_;
 
-        r_identity.Transformation.setIdentity();
-        t->match(*keyframe->image(), *constraint->image(), r_identity);
-        constraint_ratio_identity = double(r_identity.Statistics.Levels.back().Iterations.back().ValidConstraints) / double(r_identity.Statistics.Levels.back().ValidPixels);
-        ratio_identity = std::min(keyframe->evaluation()->ratioWithAverage(r_identity), constraint->evaluation()->ratioWithAverage(r_identity)); //std::log(r_identity.Information.determinant()) / std::max(keyframe->avgDivergenceFromFim(), constraint->avgDivergenceFromFim());
-        ratio_identity = std::isfinite(ratio_identity) ? ratio_identity : 0.0;
+    do
+    {
+      age_timer.record(dvo::util::Timer::seconds(now - item.second));
+      batch.push_back(item.first);
+    }
+    while((max_batch == 0 || batch.size() < max_batch) && items_.tryPop(item));
 
-        r_relative.Transformation = constraint->pose().inverse() * keyframe->pose();
-        t->match(*keyframe->image(), *constraint->image(), r_relative);
-        constraint_ratio_relative = double(r_relative.Statistics.Levels.back().Iterations.back().ValidConstraints) / double(r_relative.Statistics.Levels.back().ValidPixels);
-        ratio_relative = std::min(keyframe->evaluation()->ratioWithAverage(r_relative), constraint->evaluation()->ratioWithAverage(r_relative));//std::log(r_relative.Information.determinant()) / std::max(keyframe->avgDivergenceFromFim(), constraint->avgDivergenceFromFim());
-        ratio_relative = std::isfinite(ratio_relative) ? ratio_relative : 0.0;
+    for(size_t idx = 1; idx < batch.size(); ++idx) coalesced_counter.record(0.0);
 
-        if(ratio_identity > simple_threshold || ratio_relative > simple_threshold)
-        {
-          if(ratio_identity > ratio_relative)
-          {
-            if(constraint_ratio_identity > simple_constraint_threshold)
-            {
-              r_final = &r_identity;
-            }
-          }
-          else
-          {
-            if(constraint_ratio_relative > simple_constraint_threshold)
-            {
-              r_final = &r_relative;
-            }
-          }
+    taken_ += batch.size();
+
+    // the remaining maps were pushed after the last one we took, a push in between sets it again
+    oldest_ = 0;
+    if(!items_.empty()) oldest_.compare_and_swap(item.second, 0);
+  }
+};
+
+class KeyframeGraphImpl
+{
+public:
+  friend class ::dvo_slam::KeyframeGraph;
+
+  KeyframeGraphImpl() :
+    refinement_cursor_(0),
+    refinement_constraints_(0),
+    refinement_stop_(false),
+    refinement_preemption_(refinement_preempted_, refinement_stop_),
+    optimization_thread_(boost::bind(&KeyframeGraphImpl::execOptimization, this)),
+    spanning_closure_(false),
+    next_keyframe_id_(1),
+    next_odometry_vertex_id_(-1),
+    next_odometry_edge_id_(-1),
+    next_keyframe_edge_id_(1),
+    revision_(0),
+    full_revision_(0),
+    validation_tracker_generation_(1),
+    validation_tracker_pool_(&ValidationTrackers::create)
+  {
+    reset_validation_outcomes_ = false;
+    tsdf_pending_ = false;
+    refinement_preempted_ = false;
+
+    // g2o setup
+    configureOptimizationAlgorithm();
+    keyframegraph_.setVerbose(false);
+
+    configure(cfg_);
+  }
+
+  ~KeyframeGraphImpl()
+  {
+    new_keyframes_.shutdown();
+    optimization_thread_.join();
+  }
+
+  void configure(const dvo_slam::KeyframeGraphConfig& cfg)
+  {
+    const bool algorithm_changed = cfg.OptimizationAlgorithm != cfg_.OptimizationAlgorithm || cfg.OptimizationLinearSolver != cfg_.OptimizationLinearSolver || cfg.PcgMaxIterations != cfg_.PcgMaxIterations || cfg.PcgTolerance != cfg_.PcgTolerance;
+
+    cfg_ = cfg;
+
+    if(algorithm_changed) configureOptimizationAlgorithm();
+
+    // the validation thresholds may have changed
+    reset_validation_outcomes_ = true;
+
+    if(!constraint_search_)
+    {
+      keyframe_index_.cellSize(cfg_.NewConstraintSearchRadius);
+      appearance_search_.reset(new AppearanceConstraintSearch(KeyframeConstraintSearchInterfacePtr(new NearestNeighborConstraintSearch(cfg_.NewConstraintSearchRadius, &keyframe_index_)), &appearance_index_));
+      constraint_search_ = appearance_search_;
+    }
+
+    appearance_search_->maxCandidates(cfg_.MaxAppearanceCandidates);
+    appearance_search_->minSimilarity(cfg_.MinAppearanceSimilarity);
+    appearance_search_->minSearchSimilarity(cfg_.MinNearbyAppearanceSimilarity);
+
+    constraint_ranking_.enabled(cfg_.UseConstraintRanking);
+    constraint_ranking_.maxCandidates(cfg_.MaxConstraintCandidates);
+    constraint_ranking_.minFrustumOverlap(cfg_.MinConstraintFrustumOverlap);
+    constraint_ranking_.maxViewAngle(cfg_.MaxConstraintViewAngle);
+
+    keyframe_store_.maxResident(cfg_.MaxResidentKeyframes);
+    keyframe_store_.cacheFolder(cfg_.KeyframeCacheFolder);
+
+    new_keyframes_.maxBatch(cfg_.MaxKeyframeBatch);
+
+    dvo::util::TaskArenas::instance().configure(dvo::util::TaskArenas::Backend, cfg_.BackendConcurrency, cfg_.BackendFirstCore);
+  }
+
+  // replaces the algorithm of the graph, waits for a running optimization
+  void configureOptimizationAlgorithm()
+  {
+    tbb::mutex::scoped_lock l(new_keyframe_sync_);
+
+    g2o::OptimizationAlgorithm* previous = keyframegraph_.solver();
+    keyframegraph_.setAlgorithm(createOptimizationAlgorithm(cfg_));
+
+    // the optimizer doesn't own the algorithms it used before
+    delete previous;
+  }
+
+  void add(const LocalMap::Ptr& keyframe)
+  {
+    // stops a running background refinement, see refineStep()
+    refinement_preempted_ = true;
+
+    if(cfg_.UseMultiThreading)
+    {
+      new_keyframes_.push(keyframe);
+    }
+    else
+    {
+      // keep the insertion order if multi-threading was just switched off
+      new_keyframes_.waitIdle();
+
+      newKeyframes(std::vector<LocalMap::Ptr>(1, keyframe));
+    }
+  }
+
+  bool hasEdge(int id1, int id2) const
+  {
+    return keyframe_edges_.count(edgeKey(id1, id2)) > 0;
+  }
+
+  // keyframe to keyframe edges have to be added to the index, edges to or between odometry vertices are ignored
+  void indexEdge(g2o::HyperGraph::Edge* e)
+  {
+    if(e->vertices().size() != 2 || e->vertex(0)->id() <= 0 || e->vertex(1)->id() <= 0) return;
+
+    keyframe_edges_[edgeKey(e->vertex(0)->id(), e->vertex(1)->id())] = e;
+  }
+
+  void unindexEdge(g2o::HyperGraph::Edge* e)
+  {
+    if(e->vertices().size() != 2) return;
+
+    EdgeIndex::iterator it = keyframe_edges_.find(edgeKey(e->vertex(0)->id(), e->vertex(1)->id()));
+
+    if(it != keyframe_edges_.end() && it->second == e) keyframe_edges_.erase(it);
+  }
+
+  bool snapshot(MapSnapshot& snapshot, bool wait)
+  {
+    tbb::mutex::scoped_lock l;
+
+    if(wait)
+    {
+      l.acquire(new_keyframe_sync_);
+    }
+    else if(!l.try_acquire(new_keyframe_sync_))
+    {
+      return false;
+    }
+
+    snapshot.clear();
+
+    for(KeyframeVector::const_iterator it = keyframes_.begin(); it != keyframes_.end(); ++it)
+    {
+      MapSnapshot::Keyframe k;
+      k.Id = (*it)->id();
+      k.Timestamp = (*it)->timestamp().toSec();
+      k.Pose = toIsometry((*it)->pose());
+      k.HasEvaluation = (*it)->evaluation();
+
+      if(k.HasEvaluation)
+      {
+        k.EvaluationType = (*it)->evaluation()->type();
+        (*it)->evaluation()->state(k.EvaluationFirst, k.EvaluationSum, k.EvaluationCount);
+      }
+
+      // the base images are never changed, so sharing them is enough
+      const dvo::core::RgbdImage& base = (*it)->image()->level(0);
+
+      if(base.hasIntensity() && base.hasDepth())
+      {
+        k.Intensity = base.intensity;
+        k.Depth = base.depth;
+      }
+      else if(!keyframe_store_.compressed(k.Id, k.EncodedIntensity, k.EncodedDepth))
+      {
+        ROS_WARN_STREAM("keyframe " << k.Id << " has no images, skipping it in the snapshot");
+        continue;
+      }
+
+      snapshot.Keyframes.push_back(k);
+    }
+
+    for(g2o::OptimizableGraph::VertexIDMap::const_iterator it = keyframegraph_.vertices().begin(); it != keyframegraph_.vertices().end(); ++it)
+    {
+      g2o::VertexSE3 *v = (g2o::VertexSE3 *) it->second;
+      const VertexTable::Entry* t = vertex_table_.find(v->id());
+
+      MapSnapshot::Vertex sv;
+      sv.Id = v->id();
+      sv.Timestamp = t != 0 ? t->timestamp.toSec() : 0.0;
+      sv.Pose = v->estimate();
+      sv.Fixed = v->fixed();
+
+      snapshot.Vertices.push_back(sv);
+    }
+
+    for(g2o::HyperGraph::EdgeSet::const_iterator it = keyframegraph_.edges().begin(); it != keyframegraph_.edges().end(); ++it)
+    {
+      g2o::EdgeSE3 *e = (g2o::EdgeSE3 *) (*it);
+
+      MapSnapshot::Edge se;
+      se.Id = e->id();
+      se.Level = e->level();
+      se.From = e->vertex(0)->id();
+      se.To = e->vertex(1)->id();
+      se.Robust = e->robustKernel() != 0;
+      se.Measurement = e->measurement();
+      se.Information = e->information();
+
+      snapshot.Edges.push_back(se);
+    }
+
+    for(MarginalizedSegmentVector::const_iterator it = marginalized_segments_.begin(); it != marginalized_segments_.end(); ++it)
+    {
+      MapSnapshot::Segment ss;
+      ss.Begin = it->begin->id();
+      ss.End = it->end->id();
+      ss.BeginTimestamp = it->begin_timestamp.toSec();
+      ss.EndTimestamp = it->end_timestamp.toSec();
+      ss.BeginToEnd = it->begin_to_end;
+
+      for(LocalMap::FramePoseVector::const_iterator f = it->frames.begin(); f != it->frames.end(); ++f)
+      {
+        MapSnapshot::FramePose sf;
+        sf.Timestamp = f->first.toSec();
+        sf.Pose = f->second;
+
+        ss.Frames.push_back(sf);
+      }
+
+      snapshot.Segments.push_back(ss);
+    }
+
+    snapshot.NextKeyframeId = next_keyframe_id_;
+    // the tail of the first chain, as long as there was only one chain it was the next odometry vertex id
+    snapshot.NextOdometryVertexId = !chains_.empty() && chains_[0].tail_vertex_id != 0 ? chains_[0].tail_vertex_id : next_odometry_vertex_id_;
+    snapshot.NextOdometryEdgeId = next_odometry_edge_id_;
+
+    return true;
+  }
+
+  bool memoryUsage(MemoryUsage& usage, bool wait)
+  {
+    tbb::mutex::scoped_lock l;
+
+    if(wait)
+    {
+      l.acquire(new_keyframe_sync_);
+    }
+    else if(!l.try_acquire(new_keyframe_sync_))
+    {
+      return false;
+    }
+
+    for(KeyframeVector::const_iterator it = keyframes_.begin(); it != keyframes_.end(); ++it)
+    {
+      MemoryUsage::Keyframe k;
+      k.Id = (*it)->id();
+      k.Pyramid = (*it)->image()->memoryUsage();
+      k.Points = (*it)->hasPoints() ? (*it)->points().memoryUsage() : 0;
+
+      if(!keyframe_store_.usage(k.Id, k.Resident, k.Compressed))
+      {
+        k.Resident = true;
+        k.Compressed = 0;
+      }
+
+      usage.KeyframePyramids += k.Pyramid;
+      usage.KeyframePoints += k.Points;
+      usage.KeyframeCompressed += k.Compressed;
+      usage.Keyframes.push_back(k);
+    }
+
+    usage.GraphVertices += keyframegraph_.vertices().size() * sizeof(g2o::VertexSE3);
+    usage.GraphEdges += keyframegraph_.edges().size() * sizeof(g2o::EdgeSE3);
+    usage.Volume += tsdf_map_.memoryUsage();
+
+    return true;
+  }
+
+  bool restore(const MapSnapshot& snapshot, dvo::core::RgbdCameraPyramid& camera)
+  {
+    static dvo::util::Timer& restore_timer = dvo::util::Instrumentation::instance().timer("keyframe_graph/restore");
+    dvo::util::ScopedTimer restore_scope(restore_timer);
+
+    {
+      tbb::mutex::scoped_lock l(new_keyframe_sync_);
+
+      releaseWindowAnchors();
+      keyframegraph_.clear();
+      keyframe_edges_.clear();
+      vertex_table_.clear();
+      validation_outcomes_.clear();
+      keyframes_.clear();
+      keyframe_index_.clear();
+      appearance_index_.clear();
+      submaps_.clear();
+      keyframe_store_.clear();
+      shared_store_.clear();
+      tsdf_map_.clear();
+      marginalized_segments_.clear();
+
+      KeyframeVector inserted;
+      insertSnapshot(snapshot, camera, SnapshotMapping(), inserted);
+
+      next_keyframe_id_ = snapshot.NextKeyframeId;
+      next_odometry_vertex_id_ = snapshot.NextOdometryVertexId;
+      next_odometry_edge_id_ = snapshot.NextOdometryEdgeId;
+      next_keyframe_edge_id_ = 1;
+
+      for(g2o::HyperGraph::EdgeSet::const_iterator e_it = keyframegraph_.edges().begin(); e_it != keyframegraph_.edges().end(); ++e_it)
+      {
+        next_keyframe_edge_id_ = std::max(next_keyframe_edge_id_, (*e_it)->id() + 1);
+      }
+
+      // only the chain of the first sensor is continued, the others start over and are linked by their extrinsics
+      resetChains();
+
+      if(!keyframes_.empty())
+      {
+        g2o::OptimizableGraph::Vertex* last_kv = keyframegraph_.vertex(next_keyframe_id_ - 1);
+
+        if(last_kv != 0 && std::find_if(last_kv->edges().begin(), last_kv->edges().end(), FindEdge(next_keyframe_id_ - 1, next_odometry_vertex_id_)) != last_kv->edges().end())
+        {
+          chains_[0].last_keyframe_id = next_keyframe_id_ - 1;
+          chains_[0].tail_vertex_id = next_odometry_vertex_id_;
         }
 
-        if(r_final != 0)
+        for(g2o::OptimizableGraph::VertexIDMap::const_iterator it = keyframegraph_.vertices().begin(); it != keyframegraph_.vertices().end(); ++it)
         {
-          if(r_final->isNaN())
+          next_odometry_vertex_id_ = std::min(next_odometry_vertex_id_, it->first);
+        }
+
+        next_odometry_vertex_id_ -= 1;
+      }
+
+      keyframe_store_.trim();
+
+      resetChanges();
+    }
+
+    commitChanges();
+    map_changed_(*me_);
+
+    return !keyframes_.empty() || snapshot.Keyframes.empty();
+  }
+
+  /**
+   * Adds the snapshot of another session to the map, see KeyframeGraph::merge(). Returns the number of validated
+   * constraints between the two maps.
+   */
+  size_t merge(const MapSnapshot& snapshot, dvo::core::RgbdCameraPyramid& camera, const Eigen::Isometry3d& alignment)
+  {
+    static dvo::util::Timer& merge_timer = dvo::util::Instrumentation::instance().timer("keyframe_graph/merge");
+    dvo::util::ScopedTimer merge_scope(merge_timer);
+
+    size_t num_candidates = 0, num_constraints = 0;
+    bool joint = false;
+
+    {
+      tbb::mutex::scoped_lock l(new_keyframe_sync_);
+
+      releaseWindowAnchors();
+
+      const bool empty = keyframegraph_.vertices().empty();
+      const int first_imported_id = next_keyframe_id_;
+
+      SnapshotMapping m;
+      m.keyframe_offset = next_keyframe_id_ - 1;
+      m.odometry_offset = next_odometry_vertex_id_ + 1;
+      m.alignment = alignment;
+      m.renumber_edges = true;
+
+      KeyframeVector imported;
+      insertSnapshot(snapshot, camera, m, imported);
+
+      next_keyframe_id_ = std::max(next_keyframe_id_, snapshot.NextKeyframeId + m.keyframe_offset);
+
+      for(size_t idx = 0; idx < snapshot.Vertices.size(); ++idx)
+      {
+        if(snapshot.Vertices[idx].Id < 0) next_odometry_vertex_id_ = std::min(next_odometry_vertex_id_, m.vertex(snapshot.Vertices[idx].Id) - 1);
+      }
+
+      // the poses of the imported keyframes are only as good as the alignment, so the spatial candidates are
+      // ranked as usual, but the most similar looking keyframes of the map are validated regardless of their pose.
+      // the validation also tries the identity, which fits keyframes looking alike
+      boost::unordered_set<uint64_t> taken;
+      KeyframePairVector pairs;
+
+      for(KeyframeVector::iterator it = imported.begin(); it != imported.end(); ++it)
+      {
+        KeyframeVector constraint_candidates, filtered_constraint_candidates, similar;
+        // the similar keyframes of the search are part of the query below, which isn't ranked either
+        appearance_search_->findPossibleConstraints(keyframes_, *it, constraint_candidates, similar);
+        similar.clear();
+
+        for(KeyframeVector::iterator cc_it = constraint_candidates.begin(); cc_it != constraint_candidates.end(); ++cc_it)
+        {
+          if((*cc_it)->id() < first_imported_id) filtered_constraint_candidates.push_back(*cc_it);
+        }
+
+        constraint_ranking_.rank(*it, filtered_constraint_candidates);
+
+        appearance_index_.query(*it, keyframes_.size(), float(cfg_.MinAppearanceSimilarity), similar);
+
+        size_t num_similar = 0;
+
+        for(KeyframeVector::iterator cc_it = similar.begin(); cc_it != similar.end() && num_similar < cfg_.MaxAppearanceCandidates; ++cc_it)
+        {
+          if((*cc_it)->id() >= first_imported_id) continue;
+
+          filtered_constraint_candidates.push_back(*cc_it);
+          num_similar++;
+        }
+
+        for(KeyframeVector::iterator cc_it = filtered_constraint_candidates.begin(); cc_it != filtered_constraint_candidates.end(); ++cc_it)
+        {
+          // a keyframe which couldn't be restored has no full pyramid to validate with
+          if(taken.insert(edgeKey((*cc_it)->id(), (*it)->id())).second && keyframe_store_.acquire(*it) && keyframe_store_.acquire(*cc_it))
           {
-            ROS_ERROR("NAN in LoopClosure!");
-            continue;
+            pairs.push_back(KeyframePair(*it, *cc_it));
           }
+        }
+
+        if(keyframe_store_.overBudget() || it + 1 == imported.end())
+        {
+          num_candidates += pairs.size();
+          num_constraints += validateAndInsertKeyframePairs(pairs);
+          pairs.clear();
+
+          keyframe_store_.trim();
+        }
+      }
+
+      ROS_INFO_STREAM("merged " << imported.size() << " keyframes, " << num_candidates << " constraint candidates, " << num_constraints << " constraints between the maps");
+
+      joint = num_constraints > 0 && !empty;
+
+      if(joint)
+      {
+        // the map keeps its gauge, the imported one is placed by the constraints
+        for(size_t idx = 0; idx < snapshot.Vertices.size(); ++idx)
+        {
+          if(!snapshot.Vertices[idx].Fixed) continue;
+
+          g2o::OptimizableGraph::Vertex* v = keyframegraph_.vertex(m.vertex(snapshot.Vertices[idx].Id));
+          if(v != 0) v->setFixed(false);
+        }
+      }
+      else if(!empty)
+      {
+        ROS_WARN("no constraints between the maps, keeping the imported map at the initial alignment");
+      }
+
+      keyframe_store_.trim();
+    }
+
+    // the joint optimization runs in rounds, each holds the lock only for its iterations, so new keyframes are
+    // inserted in between. the outliers of the new constraints are removed after every round
+    for(int round = 0; joint && round < MergeOptimizationRounds; ++round)
+    {
+      tbb::mutex::scoped_lock l(new_keyframe_sync_);
+
+      optimizeAllLevels(cfg_.OptimizationFinalIterations / MergeOptimizationRounds);
+
+      for(g2o::OptimizableGraph::VertexIDMap::iterator v_it = keyframegraph_.vertices().begin(); v_it != keyframegraph_.vertices().end(); ++v_it)
+      {
+        stamp(vertex_changes_, v_it->first, false);
+      }
+
+      updateKeyframePosesFromGraph();
+    }
+
+    commitChanges();
+    map_changed_(*me_);
+
+    return num_constraints;
+  }
+
+  bool relocalize(const dvo::core::RgbdImagePyramid::Ptr& image, const Eigen::Affine3d& hint, double radius, size_t max_candidates, Eigen::Affine3d& pose, dvo::core::Matrix6d& information)
+  {
+    static dvo::util::Timer& relocalize_timer = dvo::util::Instrumentation::instance().timer("keyframe_graph/relocalize");
+
+    // only the counts are meaningful
+    static dvo::util::Timer& failed_counter = relocalize_timer.child("failed");
+
+    dvo::util::ScopedTimer relocalize_scope(relocalize_timer);
+
+    tbb::mutex::scoped_lock l(new_keyframe_sync_);
+
+    // the keyframes nearest to the last known pose and the most similar looking ones anywhere in the map, the
+    // camera may have moved arbitrarily while it was lost
+    KeyframeVector candidates, similar;
+
+    keyframe_index_.radiusSearch(hint.translation(), radius, candidates);
+    std::sort(candidates.begin(), candidates.end(), CloserTo(hint.translation()));
+
+    if(candidates.size() > max_candidates) candidates.resize(max_candidates);
+
+    // the candidates are matched in parallel, so all levels they need are built up front
+    image->build(std::max(appearance_index_.level() + 1, std::max(validation_tracker_cfg_.getNumLevels(), std::max(constraint_coarse_tracker_cfg_.getNumLevels(), constraint_fine_tracker_cfg_.getNumLevels()))));
+
+    std::vector<float> descriptor(KeyframeAppearanceIndex::DescriptorSize);
+    KeyframeAppearanceIndex::computeDescriptor(image->level(appearance_index_.level()).intensity, &descriptor[0]);
+
+    appearance_index_.query(&descriptor[0], max_candidates, float(cfg_.MinAppearanceSimilarity), similar);
+
+    for(KeyframeVector::iterator it = similar.begin(); it != similar.end(); ++it)
+    {
+      if(std::find(candidates.begin(), candidates.end(), *it) == candidates.end()) candidates.push_back(*it);
+    }
+
+    if(candidates.empty())
+    {
+      failed_counter.record(0.0);
+      return false;
+    }
+
+    // drops the ones which couldn't be restored
+    keyframe_store_.acquire(candidates);
+
+    if(candidates.empty())
+    {
+      failed_counter.record(0.0);
+      return false;
+    }
+
+    RelocalizationCandidateVector matches(candidates.size());
+
+    for(size_t idx = 0; idx < candidates.size(); ++idx)
+    {
+      matches[idx].Keyframe = candidates[idx];
+    }
+
+    size_t grain_size = cfg_.UseMultiThreading ? 1 : matches.size();
+
+    // the frontend waits for the result, so the candidates are matched by its workers
+    dvo::util::TaskArenas::instance().execute(dvo::util::TaskArenas::Frontend, boost::bind(
+        &parallelFor<tbb::blocked_range<size_t>, MatchRelocalizationCandidates>,
+        tbb::blocked_range<size_t>(0, matches.size(), grain_size), MatchRelocalizationCandidates(validation_tracker_pool_, validation_tracker_generation_, validation_tracker_cfg_, constraint_coarse_tracker_cfg_, constraint_fine_tracker_cfg_, *image, hint, matches)
+    ));
+
+    RelocalizationCandidate* best = 0;
+
+    for(RelocalizationCandidateVector::iterator it = matches.begin(); it != matches.end(); ++it)
+    {
+      if(it->EntropyRatio > cfg_.NewConstraintMinEntropyRatioCoarse && it->ConstraintRatio > cfg_.MinEquationSystemConstraintRatio && (best == 0 || it->EntropyRatio > best->EntropyRatio)) best = &(*it);
+    }
+
+    bool found = false;
+
+    if(best != 0)
+    {
+      // only the best candidate is tracked on the finer levels, like a constraint in the validation
+      ValidationTrackers& t = localValidationTrackers(validation_tracker_pool_, validation_tracker_generation_, validation_tracker_cfg_, constraint_coarse_tracker_cfg_, constraint_fine_tracker_cfg_, best->Keyframe);
+      LocalTracker::TrackingResult& r = best->Result;
+
+      r.Transformation = r.Transformation.inverse();
+
+      t.coarse.match(best->Keyframe->points(), *image, r);
+
+      if(!r.isNaN() && constraint_fine_tracker_cfg_.FirstLevel >= constraint_fine_tracker_cfg_.LastLevel)
+      {
+        // the coarse match returned the inverse of its estimate
+        r.Transformation = r.Transformation.inverse();
+
+        t.fine.match(best->Keyframe->points(), *image, r);
+      }
+
+      found = !r.isNaN() && relocalizationEntropyRatio(best->Keyframe, r) > cfg_.NewConstraintMinEntropyRatioFine && ValidateKeyframeConstraintReduction::constraintRatio(r) > cfg_.MinEquationSystemConstraintRatio;
+
+      if(found)
+      {
+        pose = best->Keyframe->pose() * r.Transformation;
+        information = r.Information;
+
+        ROS_INFO_STREAM("relocalized at keyframe " << best->Keyframe->id() << " out of " << matches.size() << " candidates");
+      }
+    }
+
+    if(!found) failed_counter.record(0.0);
+
+    keyframe_store_.trim();
+
+    return found;
+  }
+
+  /**
+   * Adds the vertices, edges, keyframes and segments of the snapshot to the graph, with the ids and poses mapped by m.
+   * The new keyframes are appended to inserted. Elements referencing something missing are skipped.
+   */
+  void insertSnapshot(const MapSnapshot& snapshot, dvo::core::RgbdCameraPyramid& camera, const SnapshotMapping& m, KeyframeVector& inserted)
+  {
+    for(size_t idx = 0; idx < snapshot.Vertices.size(); ++idx)
+    {
+      const MapSnapshot::Vertex& sv = snapshot.Vertices[idx];
+
+      g2o::VertexSE3* v = new g2o::VertexSE3();
+      v->setId(m.vertex(sv.Id));
+      v->setEstimate(m.alignment * sv.Pose);
+      v->setFixed(sv.Fixed);
+      if(sv.Timestamp > 0.0) v->setUserData(new dvo_slam::Timestamped(ros::Time(sv.Timestamp)));
+
+      keyframegraph_.addVertex(v);
+      if(sv.Timestamp > 0.0) vertex_table_.insert(v->id(), ros::Time(sv.Timestamp));
+      stamp(vertex_changes_, v->id(), false);
+    }
+
+    for(size_t idx = 0; idx < snapshot.Edges.size(); ++idx)
+    {
+      const MapSnapshot::Edge& se = snapshot.Edges[idx];
+
+      g2o::OptimizableGraph::Vertex *from = (g2o::OptimizableGraph::Vertex*) keyframegraph_.vertex(m.vertex(se.From)), *to = (g2o::OptimizableGraph::Vertex*) keyframegraph_.vertex(m.vertex(se.To));
+
+      if(from == 0 || to == 0)
+      {
+        ROS_WARN_STREAM("snapshot edge " << se.Id << " references missing vertices, skipping it");
+        continue;
+      }
+
+      g2o::EdgeSE3* e = new g2o::EdgeSE3();
+      e->setId(!m.renumber_edges ? se.Id : se.Id > 0 ? next_keyframe_edge_id_++ : next_odometry_edge_id_--);
+      e->setLevel(se.Level);
+      e->resize(2);
+      e->setVertex(0, from);
+      e->setVertex(1, to);
+      e->setMeasurement(se.Measurement);
+      e->setInformation(se.Information);
+      if(se.Robust) e->setRobustKernel(createRobustKernel());
+
+      keyframegraph_.addEdge(e);
+      indexEdge(e);
+      stamp(edge_changes_, e->id(), false);
+    }
+
+    size_t num_levels = std::max(validation_tracker_cfg_.getNumLevels(), constraint_tracker_cfg_.getNumLevels());
+    camera.build(num_levels);
+
+    for(size_t idx = 0; idx < snapshot.Keyframes.size(); ++idx)
+    {
+      const MapSnapshot::Keyframe& k = snapshot.Keyframes[idx];
+
+      cv::Mat intensity = k.Intensity, depth = k.Depth;
+
+      if((intensity.empty() || depth.empty()) && !KeyframeStore::decode(k.EncodedIntensity, k.EncodedDepth, intensity, depth))
+      {
+        ROS_WARN_STREAM("failed to decode images of snapshot keyframe " << k.Id << ", skipping it");
+        continue;
+      }
+
+      if(keyframegraph_.vertex(m.vertex(k.Id)) == 0)
+      {
+        ROS_WARN_STREAM("snapshot keyframe " << k.Id << " has no vertex, skipping it");
+        continue;
+      }
+
+      dvo::core::RgbdImagePyramid::Ptr image(new dvo::core::RgbdImagePyramid(camera, intensity, depth));
+      image->level(0).timestamp = k.Timestamp;
+      image->build(num_levels);
+
+      dvo_slam::TrackingResultEvaluation::ConstPtr evaluation;
+      if(k.HasEvaluation) evaluation = dvo_slam::TrackingResultEvaluation::create(dvo_slam::TrackingResultEvaluation::Type(k.EvaluationType), k.EvaluationFirst, k.EvaluationSum, k.EvaluationCount);
+
+      KeyframePtr keyframe(new Keyframe());
+      keyframe->
+        id(m.vertex(k.Id))
+        .image(image)
+        .pose(toAffine(m.alignment * k.Pose))
+        .evaluation(evaluation);
+      keyframe->initializePoints(constraint_tracker_cfg_.IntensityDerivativeThreshold, constraint_tracker_cfg_.DepthDerivativeThreshold, constraint_tracker_cfg_.MaxPointsPerLevel, constraint_tracker_cfg_.UseMortonOrder);
+
+      keyframes_.push_back(keyframe);
+      inserted.push_back(keyframe);
+      keyframe_index_.insert(keyframe);
+      appearance_index_.insert(keyframe);
+      keyframe_store_.add(keyframe);
+      assignSubmap(keyframe);
+    }
+
+    for(size_t idx = 0; idx < snapshot.Segments.size(); ++idx)
+    {
+      const MapSnapshot::Segment& ss = snapshot.Segments[idx];
+
+      MarginalizedSegment segment;
+      segment.begin = (g2o::VertexSE3*) keyframegraph_.vertex(m.vertex(ss.Begin));
+      segment.end = (g2o::VertexSE3*) keyframegraph_.vertex(m.vertex(ss.End));
+
+      if(segment.begin == 0 || segment.end == 0) continue;
+
+      segment.begin_timestamp = ros::Time(ss.BeginTimestamp);
+      segment.end_timestamp = ros::Time(ss.EndTimestamp);
+      segment.begin_to_end = ss.BeginToEnd;
+
+      for(MapSnapshot::FramePoseVector::const_iterator f = ss.Frames.begin(); f != ss.Frames.end(); ++f)
+      {
+        segment.frames.push_back(LocalMap::FramePose(ros::Time(f->Timestamp), f->Pose));
+      }
+
+      marginalized_segments_.push_back(segment);
+    }
+  }
+
+  void finalOptimization()
+  {
+    std::cerr << "final optimization, waiting for " << new_keyframes_.depth() << " queued keyframes" << std::endl;
+    new_keyframes_.waitIdle();
+
+    tbb::mutex::scoped_lock l(new_keyframe_sync_);
+
+    std::cerr << keyframes_.size() << " keyframes" << std::endl;
+
+    // keyframe pairs taken as candidates, by edgeKey()
+    boost::unordered_set<uint64_t> taken;
+
+    // flatten the candidates of all keyframes into one list, every pair only once. if the keyframe store runs out of
+    // budget, the list is validated in several batches
+    KeyframePairVector pairs;
+    size_t num_candidates = 0, num_constraints = 0;
+
+    for(KeyframeVector::iterator it = keyframes_.begin(); it != keyframes_.end(); ++it)
+    {
+      collectConstraintCandidates(*it, taken, pairs);
+
+      if(keyframe_store_.overBudget() || it + 1 == keyframes_.end())
+      {
+        num_candidates += pairs.size();
+        num_constraints += validateAndInsertKeyframePairs(pairs);
+        pairs.clear();
+
+        keyframe_store_.trim();
+      }
+    }
+
+    std::cerr << num_candidates << " constraint candidates, " << num_constraints << " additional constraints" << std::endl;
+
+    // include all edges in the optimization
+    for(g2o::OptimizableGraph::EdgeSet::iterator e_it = keyframegraph_.edges().begin(); e_it != keyframegraph_.edges().end(); ++e_it)
+    {
+      g2o::EdgeSE3* e = (g2o::EdgeSE3*) (*e_it);
+      e->setLevel(0);
+    }
+
+    std::cerr << "optimizing..." << std::endl;
+    keyframegraph_.setVerbose(true);
+    optimizeAndPruneOutliers(10, cfg_.OptimizationFinalIterations / 10);
+    std::cerr << "done" << std::endl;
+
+    // the odometry vertices took part, too
+    for(g2o::OptimizableGraph::VertexIDMap::iterator v_it = keyframegraph_.vertices().begin(); v_it != keyframegraph_.vertices().end(); ++v_it)
+    {
+      stamp(vertex_changes_, v_it->first, false);
+    }
+
+    // update keyframe database
+    updateKeyframePosesFromGraph();
+
+    commitChanges();
+    map_changed_(*me_);
+
+    ROS_WARN_STREAM("created validation tracker instances: " << validation_tracker_pool_.size());
+
+    std::cerr << keyframes_.size() << " keyframes" << std::endl;
+  }
+
+  void optimizeInterKeyframePoses()
+  {
+    if(keyframes_.size() < 2) return;
+
+    if(cfg_.UseMultiThreading)
+    {
+      optimizeInterKeyframePosesParallel();
+      return;
+    }
+
+    for(KeyframeVector::iterator it = keyframes_.begin(); it != (keyframes_.end() - 1); ++it)
+    {
+      g2o::OptimizableGraph::VertexSet inter_keyframe_vertices;
+
+      g2o::OptimizableGraph::Vertex *v1 = keyframegraph_.vertex((*it)->id());
+      g2o::OptimizableGraph::Vertex *v2 = keyframegraph_.vertex((*(it + 1))->id());
+
+      v1->setFixed(true);
+      v2->setFixed(true);
+
+      inter_keyframe_vertices.insert(v1);
+      inter_keyframe_vertices.insert(v2);
+
+      for(g2o::OptimizableGraph::EdgeSet::iterator edge_it = v1->edges().begin(); edge_it != v1->edges().end(); ++edge_it)
+      {
+        g2o::HyperGraph::Vertex *candidate = 0;
+        if((*edge_it)->vertex(0)->id() == v1->id())
+        {
+          candidate = (*edge_it)->vertex(1);
+        }
+
+        if((*edge_it)->vertex(1)->id() == v1->id())
+        {
+          candidate = (*edge_it)->vertex(0);
+        }
+
+        if(candidate != 0 && candidate->id() < 0)
+        {
+          inter_keyframe_vertices.insert(candidate);
+        }
+      }
+
+      keyframegraph_.setVerbose(false);
+      keyframegraph_.initializeOptimization(inter_keyframe_vertices, 2);
+      optimizeGraph(20);
+
+      for(g2o::OptimizableGraph::VertexSet::iterator v_it = inter_keyframe_vertices.begin(); v_it != inter_keyframe_vertices.end(); ++v_it)
+      {
+        if((*v_it)->id() < 0) stamp(vertex_changes_, (*v_it)->id(), false);
+      }
+    }
+  }
+
+  /**
+   * Same as the serial version, but every segment between two consecutive keyframes is copied into its own small graph
+   * and solved concurrently. The shared graph is only read while solving, the estimates are written back afterwards.
+   */
+  void optimizeInterKeyframePosesParallel()
+  {
+    std::vector<VertexEstimateVector> estimates(keyframes_.size() - 1);
+
+    dvo::util::TaskArenas::instance().execute(dvo::util::TaskArenas::Backend, boost::bind(
+        &parallelFor<tbb::blocked_range<size_t>, OptimizeInterKeyframeSegments>,
+        tbb::blocked_range<size_t>(0, estimates.size()), OptimizeInterKeyframeSegments(keyframegraph_, keyframes_, estimates, vertex_table_)
+    ));
+
+    for(std::vector<VertexEstimateVector>::const_iterator it = estimates.begin(); it != estimates.end(); ++it)
+    {
+      for(VertexEstimateVector::const_iterator v_it = it->begin(); v_it != it->end(); ++v_it)
+      {
+        v_it->first->setEstimate(v_it->second);
+        stamp(vertex_changes_, v_it->first->id(), false);
+      }
+    }
+  }
+
+private:
+  typedef g2o::BlockSolver_6_3 BlockSolver;
+  typedef g2o::LinearSolverCSparse<BlockSolver::PoseMatrixType> LinearSolver;
+
+  typedef std::vector<std::pair<KeyframePtr, LocalTracker::TrackingResult> > ConstraintVector;
+
+  typedef std::pair<KeyframePtr, KeyframePtr> KeyframePair;
+  typedef std::vector<KeyframePair> KeyframePairVector;
+  typedef std::vector<std::pair<KeyframePair, LocalTracker::TrackingResult> > PairConstraintVector;
+
+  // copies the candidates, which aren't the keyframe itself, connected, taken or validated before, to filtered
+  void filterConstraintCandidates(const KeyframePtr& keyframe, const boost::unordered_set<uint64_t>& taken, const KeyframeVector& candidates, KeyframeVector& filtered)
+  {
+    for(KeyframeVector::const_iterator cc_it = candidates.begin(); cc_it != candidates.end(); ++cc_it)
+    {
+      // self constraint, an odometry or rig edge connects them already, or they were validated before
+      bool exists = (*cc_it)->id() == keyframe->id() || hasEdge((*cc_it)->id(), keyframe->id()) || taken.count(edgeKey((*cc_it)->id(), keyframe->id())) > 0 || validatedBefore(keyframe, *cc_it);
+
+      if(!exists)
+      {
+        filtered.push_back(*cc_it);
+      }
+    }
+  }
+
+  // appends the ranked candidates of the keyframe, which aren't connected or validated yet, to pairs and acquires them
+  void collectConstraintCandidates(const KeyframePtr& keyframe, boost::unordered_set<uint64_t>& taken, KeyframePairVector& pairs)
+  {
+    KeyframeVector constraint_candidates, similar_candidates, filtered_constraint_candidates, filtered_similar_candidates;
+    appearance_search_->findPossibleConstraints(keyframes_, keyframe, constraint_candidates, similar_candidates);
+
+    filterConstraintCandidates(keyframe, taken, constraint_candidates, filtered_constraint_candidates);
+    filterConstraintCandidates(keyframe, taken, similar_candidates, filtered_similar_candidates);
+
+    // the ranking judges the candidates by their poses, which are off if the similar keyframes close a loop
+    constraint_ranking_.rank(keyframe, filtered_constraint_candidates);
+    filtered_constraint_candidates.insert(filtered_constraint_candidates.end(), filtered_similar_candidates.begin(), filtered_similar_candidates.end());
+
+    for(KeyframeVector::iterator cc_it = filtered_constraint_candidates.begin(); cc_it != filtered_constraint_candidates.end(); ++cc_it)
+    {
+      // marks the pair as taken, so the reverse direction isn't validated again. a keyframe which couldn't be restored
+      // has no full pyramid to validate with
+      if(taken.insert(edgeKey((*cc_it)->id(), keyframe->id())).second && keyframe_store_.acquire(keyframe) && keyframe_store_.acquire(*cc_it))
+      {
+        pairs.push_back(KeyframePair(keyframe, *cc_it));
+      }
+    }
+  }
+
+  // verdict of the validation of every pair, the ratios are the ones of the last stage it reached
+  struct PairOutcome
+  {
+    KeyframePair Pair;
+    bool Accepted;
+    double EntropyRatio, ConstraintRatio;
+  };
+  typedef std::vector<PairOutcome> PairOutcomeVector;
+
+  /**
+   * The trackers of one thread for the stages of the constraint validation, each keeps its configuration and buffers
+   * across pairs, but no per match history. They are reconfigured only if the validation configs changed since, see
+   * configureValidationTracking().
+   */
+  struct ValidationTrackers
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    dvo::DenseTracker hypotheses, coarse, fine;
+    size_t generation;
+
+    ValidationTrackers() :
+      generation(0)
+    {
+    }
+
+    static boost::shared_ptr<ValidationTrackers> create()
+    {
+      return boost::shared_ptr<ValidationTrackers>(new ValidationTrackers());
+    }
+  };
+  typedef tbb::enumerable_thread_specific<boost::shared_ptr<ValidationTrackers> > ValidationTrackerPool;
+
+  // configures the trackers of this thread if they are from an older generation, and sizes their buffers for the
+  // finest level the keyframe is tracked on
+  static ValidationTrackers& localValidationTrackers(ValidationTrackerPool& trackers, size_t generation, const dvo::DenseTracker::Config& simple_config, const dvo::DenseTracker::Config& final_coarse_config, const dvo::DenseTracker::Config& final_fine_config, const KeyframePtr& keyframe)
+  {
+    ValidationTrackers& t = *trackers.local();
+
+    if(t.generation == generation) return t;
+
+    t.hypotheses.configure(simple_config);
+    t.coarse.configure(final_coarse_config);
+    t.fine.configure(final_fine_config);
+
+    const int last_level = std::min(simple_config.LastLevel, std::min(final_coarse_config.LastLevel, final_fine_config.LastLevel));
+    const size_t max_points = keyframe->points().getMaximumNumberOfPoints(last_level);
+
+    // matchHypotheses tracks the pose from the graph and the identity
+    t.hypotheses.reserve(max_points, 2);
+    t.coarse.reserve(max_points);
+    t.fine.reserve(max_points);
+
+    t.generation = generation;
+
+    return t;
+  }
+
+  typedef std::pair<g2o::VertexSE3*, Eigen::Isometry3d> VertexEstimate;
+  typedef std::vector<VertexEstimate, Eigen::aligned_allocator<VertexEstimate> > VertexEstimateVector;
+
+  struct OptimizeInterKeyframeSegments
+  {
+    g2o::SparseOptimizer& graph;
+    const KeyframeVector& keyframes;
+    std::vector<VertexEstimateVector>& estimates;
+
+    const VertexTable& vertex_table;
+
+    OptimizeInterKeyframeSegments(g2o::SparseOptimizer& graph, const KeyframeVector& keyframes, std::vector<VertexEstimateVector>& estimates, const VertexTable& vertex_table) :
+      graph(graph),
+      keyframes(keyframes),
+      estimates(estimates),
+      vertex_table(vertex_table)
+    {
+    }
+
+    void operator()(const tbb::blocked_range<size_t>& r) const
+    {
+      for(size_t idx = r.begin(); idx != r.end(); ++idx)
+      {
+        optimizeSegment(keyframes[idx], keyframes[idx + 1], estimates[idx]);
+      }
+    }
+
+    static g2o::VertexSE3* copyVertex(g2o::SparseOptimizer& segment, const g2o::HyperGraph::Vertex* v, bool fixed)
+    {
+      g2o::VertexSE3* copy = new g2o::VertexSE3();
+      copy->setId(v->id());
+      copy->setEstimate(static_cast<const g2o::VertexSE3*>(v)->estimate());
+      copy->setFixed(fixed);
+
+      segment.addVertex(copy);
+
+      return copy;
+    }
+
+    // odometry vertices connected to the first keyframe, with both keyframes fixed
+    void optimizeSegment(const KeyframePtr& k1, const KeyframePtr& k2, VertexEstimateVector& result) const
+    {
+      g2o::HyperGraph::Vertex *v1 = graph.vertex(k1->id()), *v2 = graph.vertex(k2->id());
+
+      g2o::SparseOptimizer segment;
+      segment.setAlgorithm(
+          new g2o::OptimizationAlgorithmDogleg(
+              new BlockSolver(
+                  new LinearSolver()
+      )));
+      segment.setVerbose(false);
+
+      std::vector<g2o::HyperGraph::Vertex*> originals;
+
+      copyVertex(segment, v1, true);
+      copyVertex(segment, v2, true);
+
+      for(g2o::HyperGraph::EdgeSet::const_iterator e_it = v1->edges().begin(); e_it != v1->edges().end(); ++e_it)
+      {
+        for(size_t idx = 0; idx < (*e_it)->vertices().size(); ++idx)
+        {
+          g2o::HyperGraph::Vertex* candidate = (*e_it)->vertex(idx);
+
+          if(candidate->id() < 0 && segment.vertex(candidate->id()) == 0)
+          {
+            copyVertex(segment, candidate, false);
+            originals.push_back(candidate);
+          }
+        }
+      }
+
+      if(originals.empty()) return;
+
+      // odometry and keyframe edges between the copied vertices
+      std::set<g2o::HyperGraph::Edge*> copied_edges;
+
+      for(std::vector<g2o::HyperGraph::Vertex*>::const_iterator v_it = originals.begin(); v_it != originals.end(); ++v_it)
+      {
+        for(g2o::HyperGraph::EdgeSet::const_iterator e_it = (*v_it)->edges().begin(); e_it != (*v_it)->edges().end(); ++e_it)
+        {
+          g2o::EdgeSE3* e = static_cast<g2o::EdgeSE3*>(*e_it);
+
+          if(e->vertices().size() != 2 || !copied_edges.insert(e).second) continue;
+
+          g2o::OptimizableGraph::Vertex *a = segment.vertex(e->vertex(0)->id()), *b = segment.vertex(e->vertex(1)->id());
+
+          if(a == 0 || b == 0) continue;
+
+          g2o::EdgeSE3* copy = new g2o::EdgeSE3();
+          copy->setId(e->id());
+          copy->setMeasurement(e->measurement());
+          copy->setInformation(e->information());
+          copy->resize(2);
+          copy->setVertex(0, a);
+          copy->setVertex(1, b);
+
+          segment.addEdge(copy);
+        }
+      }
+
+      segment.initializeOptimization();
+      segment.optimize(20);
+
+      // the last odometry vertex of the previous segment is also connected to the first keyframe, it is written back
+      // by the previous segment, so every vertex has exactly one writer
+      ros::Time begin = k1->timestamp();
+
+      for(std::vector<g2o::HyperGraph::Vertex*>::const_iterator v_it = originals.begin(); v_it != originals.end(); ++v_it)
+      {
+        const VertexTable::Entry* t = vertex_table.find((*v_it)->id());
+
+        if(t != 0 && t->timestamp < begin) continue;
+
+        result.push_back(VertexEstimate(static_cast<g2o::VertexSE3*>(*v_it), static_cast<g2o::VertexSE3*>(segment.vertex((*v_it)->id()))->estimate()));
+      }
+    }
+  };
+
+  void execOptimization()
+  {
+    static dvo::util::Timer& new_keyframe_timer = dvo::util::Instrumentation::instance().timer("keyframe_graph/new_keyframe");
+
+    std::vector<LocalMap::Ptr> batch;
+
+    // refinement work is left since the last keyframe
+    bool refine = false;
+
+    while(!new_keyframes_.isShutdown())
+    {
+      const bool refine_idle = refine && cfg_.UseBackgroundRefinement && cfg_.UseMultiThreading;
+      const bool idle_work = refine_idle || tsdf_pending_;
+
+      if(idle_work ? !new_keyframes_.tryPop(batch) : !new_keyframes_.pop(batch))
+      {
+        // the volume catches up with the moved keyframes first
+        if(tsdf_pending_)
+        {
+          tbb::mutex::scoped_lock l(new_keyframe_sync_);
+          updateTsdfMap();
+        }
+        else if(refine_idle)
+        {
+          refine = refineStep();
+        }
+
+        continue;
+      }
+
+      refinement_preempted_ = false;
+
+      {
+        dvo::util::ScopedTimer new_keyframe_scope(new_keyframe_timer);
+        newKeyframes(batch);
+      }
+
+      new_keyframes_.done();
+
+      refine = true;
+    }
+  }
+
+  /**
+   * One bounded step of the background refinement, while no local map is queued. The steps first validate the
+   * candidates of RefinementKeyframesPerStep keyframes at a time, like finalOptimization(), then optimize the whole
+   * graph. A local map pushed by add() stops the search after the current keyframe and the optimization after the
+   * current iteration. Returns false if the optimization converged without new constraints, i.e., there is nothing
+   * left to do until the next keyframe.
+   */
+  bool refineStep()
+  {
+    static dvo::util::Timer& refinement_timer = dvo::util::Instrumentation::instance().timer("keyframe_graph/refinement");
+    static dvo::util::Timer
+      &search_timer = refinement_timer.child("search"),
+      &optimization_timer = refinement_timer.child("optimization"),
+      &preempted_counter = refinement_timer.child("preempted")
+    ;
+
+    size_t keyframes_per_step;
+    bool searching;
+
+    {
+      tbb::mutex::scoped_lock l(new_keyframe_sync_);
+
+      if(keyframes_.size() < 2) return false;
+
+      keyframes_per_step = std::max<size_t>(cfg_.RefinementKeyframesPerStep, 1);
+      searching = refinement_cursor_ < keyframes_.size();
+    }
+
+    if(searching)
+    {
+      dvo::util::ScopedTimer search_scope(search_timer);
+
+      boost::unordered_set<uint64_t> taken;
+
+      // the lock is released between the keyframes, a queued local map ends the step early
+      for(size_t n = 0; n < keyframes_per_step && !refinement_preempted_; ++n)
+      {
+        tbb::mutex::scoped_lock l(new_keyframe_sync_);
+
+        if(refinement_cursor_ >= keyframes_.size()) break;
+
+        KeyframePairVector pairs;
+        collectConstraintCandidates(keyframes_[refinement_cursor_], taken, pairs);
+        ++refinement_cursor_;
+
+        refinement_constraints_ += validateAndInsertKeyframePairs(pairs);
+        keyframe_store_.trim();
+      }
+
+      return true;
+    }
+
+    tbb::mutex::scoped_lock l(new_keyframe_sync_);
+
+    dvo::util::ScopedTimer optimization_scope(optimization_timer);
+
+    std::vector<g2o::EdgeSE3*> outliers;
+
+    initializeOptimization(false, 0);
+    keyframegraph_.computeActiveErrors();
+    const double chi2_before = keyframegraph_.activeChi2();
+
+    refinement_stop_ = refinement_preempted_;
+    keyframegraph_.setForceStopFlag(&refinement_stop_);
+    keyframegraph_.addPostIterationAction(&refinement_preemption_);
+
+    optimizeGraph(cfg_.RefinementIterations / 2);
+    disableOutlierConstraints(0.1, 10, outliers);
+    optimizeGraph(cfg_.RefinementIterations - cfg_.RefinementIterations / 2, true);
+
+    keyframegraph_.setForceStopFlag(0);
+    keyframegraph_.removePostIterationAction(&refinement_preemption_);
+
+    removeConstraints(outliers);
+
+    keyframegraph_.computeActiveErrors();
+    const double chi2_after = keyframegraph_.activeChi2();
+
+    const bool preempted = refinement_preempted_;
+    if(preempted) preempted_counter.record(0.0);
+
+    updateKeyframePosesFromGraph();
+
+    commitChanges();
+    map_changed_(*me_);
+
+    const bool converged = refinement_constraints_ == 0 && outliers.empty() && chi2_before - chi2_after <= cfg_.RefinementMinImprovement * chi2_before;
+
+    // the next pass starts over, the candidate search depends on the refined poses
+    refinement_cursor_ = 0;
+    refinement_constraints_ = 0;
+
+    return preempted || !converged;
+  }
+
+  // inserts the keyframes with their constraints and optimizes once for all of them
+  void newKeyframes(const std::vector<LocalMap::Ptr>& maps)
+  {
+    tbb::mutex::scoped_lock l(new_keyframe_sync_);
+
+    static dvo::util::Timer& new_keyframe_timer = dvo::util::Instrumentation::instance().timer("keyframe_graph/new_keyframe");
+    static dvo::util::Timer& optimization_timer = new_keyframe_timer.child("optimization");
+
+    int max_distance = -1;
+    const size_t first_new = keyframes_.size();
+
+    spanning_closure_ = false;
+
+    for(std::vector<LocalMap::Ptr>::const_iterator it = maps.begin(); it != maps.end(); ++it)
+    {
+      int distance = insertKeyframe(*it);
+
+      // later keyframes of the batch are closer to the end of the optimization window
+      if(distance >= 0) max_distance = std::max(max_distance, distance + int(maps.end() - it - 1));
+    }
+
+    if(max_distance >= 0 && size_t(max_distance) >= cfg_.MinConstraintDistance)
+    {
+      dvo::util::ScopedTimer optimization_scope(optimization_timer);
+
+      // loop closures reaching out of the window have to be propagated through the whole graph
+      bool windowed;
+      size_t window_begin;
+
+      if(cfg_.SubmapRadius > 0.0)
+      {
+        windowed = !spanning_closure_;
+        window_begin = std::min(first_new, submaps_.size() > 1 ? submaps_[submaps_.size() - 2].first : 0);
+
+        if(!windowed) alignSubmaps();
+      }
+      else
+      {
+        windowed = cfg_.OptimizationWindowSize > 0 && size_t(max_distance) < cfg_.OptimizationWindowSize;
+        window_begin = keyframes_.size() > cfg_.OptimizationWindowSize ? keyframes_.size() - cfg_.OptimizationWindowSize : 0;
+      }
+
+      if(window_begin == 0) windowed = false;
+
+      // optimize
+      // the second half continues on the same active set without the worst outliers of the first one
+      std::vector<g2o::EdgeSE3*> outliers;
+
+      initializeOptimization(windowed, window_begin);
+      optimizeGraph(cfg_.OptimizationIterations / 2);
+
+      disableOutlierConstraints(0.1, 10, outliers);
+
+      optimizeGraph(cfg_.OptimizationIterations / 2, true);
+
+      releaseWindowAnchors();
+      removeConstraints(outliers);
+
+      //// update keyframe database, the keyframes outside of the window didn't move
+      updateKeyframePosesFromGraph(windowed ? window_begin : 0);
+    }
+
+    keyframe_store_.trim();
+
+    if(max_distance < 0) return;
+
+    commitChanges();
+    map_changed_(*me_);
+  }
+
+  // inserts the keyframe and its validated constraints, returns the largest keyframe distance of them or -1 for the
+  // first keyframe
+  int insertKeyframe(const LocalMap::Ptr& map)
+  {
+    static dvo::util::Timer& new_keyframe_timer = dvo::util::Instrumentation::instance().timer("keyframe_graph/new_keyframe");
+    static dvo::util::Timer
+      &constraint_search_timer = new_keyframe_timer.child("constraint_search"),
+      &constraint_ranking_timer = new_keyframe_timer.child("constraint_ranking"),
+      &constraint_validation_timer = new_keyframe_timer.child("constraint_validation"),
+      &constraint_insert_timer = new_keyframe_timer.child("constraint_insert")
+    ;
+
+    KeyframeVector constraint_candidates, similar_candidates;
+    ConstraintVector constraints;
+
+    // insert keyframe into data structures
+    KeyframePtr keyframe = insertNewKeyframe(map);
+
+    // early abort
+    if(keyframes_.size() == 1) return -1;
+
+    {
+      dvo::util::ScopedTimer constraint_search_scope(constraint_search_timer);
+      // find possible constraints
+      appearance_search_->findPossibleConstraints(keyframes_, keyframe, constraint_candidates, similar_candidates);
+
+      // the odometry predecessor in the chain of the sensor and rig neighbors are connected already
+      for(KeyframeVector::iterator it = constraint_candidates.begin(); it != constraint_candidates.end();)
+      {
+        if(hasEdge((*it)->id(), keyframe->id()))
+          it = constraint_candidates.erase(it);
+        else
+          ++it;
+      }
+
+      for(KeyframeVector::iterator it = similar_candidates.begin(); it != similar_candidates.end();)
+      {
+        if(hasEdge((*it)->id(), keyframe->id()))
+          it = similar_candidates.erase(it);
+        else
+          ++it;
+      }
+    }
+
+    {
+      dvo::util::ScopedTimer constraint_ranking_scope(constraint_ranking_timer);
+      // only validate the most promising candidates, the similar keyframes may close a loop, so their poses are off
+      constraint_ranking_.rank(keyframe, constraint_candidates);
+      constraint_candidates.insert(constraint_candidates.end(), similar_candidates.begin(), similar_candidates.end());
+    }
+
+    // the ranking only needs the coarse levels, the validation all of them, the ones which couldn't be restored are dropped
+    keyframe_store_.acquire(constraint_candidates);
+    //std::cerr << "constraints to validate: " << constraint_candidates.size() << std::endl;
+
+    {
+      dvo::util::ScopedTimer constraint_validation_scope(constraint_validation_timer);
+      // validate constraints
+      validateKeyframeConstraintsParallel(constraint_candidates, keyframe, constraints);
+    }
+
+    ROS_WARN_STREAM("adding " << constraints.size() << " new constraints");
+
+    dvo::util::ScopedTimer constraint_insert_scope(constraint_insert_timer);
+    // update graph
+    return insertNewKeyframeConstraints(keyframe, constraints);
+  }
+
+  /*
+  static void match(dvo::DenseTracker& t, const KeyframePtr& keyframe, const KeyframePtr& constraint, TrackingResult& r)
+  {
+    t.match(*(keyframe->image()), *(constraint->image()), r.Tr);
+    t.getInformationEstimate(r.Information);
+    r.Context = &t.itctx_;
+  }
+   */
+  struct ValidateKeyframeConstraintReduction
+  {
+    const dvo_slam::KeyframeGraphConfig& config;
+    ValidationTrackerPool& trackers;
+    size_t generation;
+    const dvo::DenseTracker::Config &simple_config, &final_coarse_config, &final_fine_config;
+    PairConstraintVector proposals;
+    PairOutcomeVector outcomes;
+
+    ValidateKeyframeConstraintReduction(const dvo_slam::KeyframeGraphConfig& config, ValidationTrackerPool& trackers, size_t generation, const dvo::DenseTracker::Config &simple_config, const dvo::DenseTracker::Config& final_coarse_config, const dvo::DenseTracker::Config& final_fine_config) :
+      config(config),
+      trackers(trackers),
+      generation(generation),
+      simple_config(simple_config),
+      final_coarse_config(final_coarse_config),
+      final_fine_config(final_fine_config)
+    {
+    }
+
+    ValidateKeyframeConstraintReduction(ValidateKeyframeConstraintReduction& other, tbb::split) :
+      config(other.config),
+      trackers(other.trackers),
+      generation(other.generation),
+      simple_config(other.simple_config),
+      final_coarse_config(other.final_coarse_config),
+      final_fine_config(other.final_fine_config)
+    {
+    }
+
+    ValidationTrackers& localTrackers(const KeyframePtr& keyframe)
+    {
+      return localValidationTrackers(trackers, generation, simple_config, final_coarse_config, final_fine_config, keyframe);
+    }
+
+    void outcome(const KeyframePair& pair, bool accepted, double entropy_ratio, double constraint_ratio)
+    {
+      PairOutcome o;
+      o.Pair = pair;
+      o.Accepted = accepted;
+      o.EntropyRatio = entropy_ratio;
+      o.ConstraintRatio = constraint_ratio;
+
+      outcomes.push_back(o);
+    }
+
+    static double constraintRatio(const LocalTracker::TrackingResult& r)
+    {
+      return double(r.Statistics.Levels.back().Iterations.back().ValidConstraints) / double(r.Statistics.Levels.back().ValidPixels);
+    }
+
+    static double entropyRatio(const KeyframePtr& keyframe, const KeyframePtr& constraint, const LocalTracker::TrackingResult& r)
+    {
+      double ratio = std::min(keyframe->evaluation()->ratioWithAverage(r), constraint->evaluation()->ratioWithAverage(r)); //std::log(r.Information.determinant()) / std::max(keyframe->avgDivergenceFromFim(), constraint->avgDivergenceFromFim());
+
+      return std::isfinite(ratio) ? ratio : 0.0;
+    }
+
+    void operator()(const tbb::blocked_range<KeyframePairVector::const_iterator>& r)
+    {
+      static dvo::util::Timer& validation_timer = dvo::util::Instrumentation::instance().timer("keyframe_graph/validation");
+      static dvo::util::Timer& range_timer = validation_timer.child("range");
+
+      // only the count is meaningful
+      static dvo::util::Timer& coarse_rejected = validation_timer.child("coarse_rejected");
+
+      // the ranges show up on the trace timeline of the worker which validated them
+      dvo::util::ScopedTimer range_scope(range_timer);
+
+      for(KeyframePairVector::const_iterator it = r.begin(); it != r.end(); ++it)
+      {
+        const KeyframePtr& keyframe = it->first;
+        const KeyframePtr& constraint = it->second;
+        Eigen::Affine3d transform_proposal;
+
+        // keyframes connected by odometry or rig edges are filtered out before
+        if(constraint == keyframe) continue;
+
+        // TODO: move to KeyframeConstraintSearch
+        //double angle = keyframe->pose().rotation().col(2).head<3>().dot(constraint->pose().rotation().col(2).head<3>());
+        //if(angle < 0) continue;
+
+        double simple_threshold = config.NewConstraintMinEntropyRatioCoarse, final_threshold = config.NewConstraintMinEntropyRatioFine, simple_constraint_threshold = config.MinEquationSystemConstraintRatio, final_constraint_threshold = config.MinEquationSystemConstraintRatio;
+        double ratio_final, constraint_ratio_final;
+
+        LocalTracker::TrackingResult r_hypothesis, *r_final = 0;
+        ValidationTrackers& t = localTrackers(keyframe);
+
+        // the relative pose from the graph and the identity compete on the coarsest level, only the better one is
+        // tracked on the finer levels
+        dvo::DenseTracker::TransformVector guesses(2);
+        guesses[0] = constraint->pose().inverse() * keyframe->pose();
+        guesses[1].setIdentity();
+
+        t.hypotheses.matchHypotheses(keyframe->points(), *constraint->image(), guesses, r_hypothesis);
+
+        if(entropyRatio(keyframe, constraint, r_hypothesis) > simple_threshold && constraintRatio(r_hypothesis) > simple_constraint_threshold)
+        {
+          r_final = &r_hypothesis;
+        }
+        else
+        {
+          outcome(*it, false, entropyRatio(keyframe, constraint, r_hypothesis), constraintRatio(r_hypothesis));
+        }
+
+        if(r_final != 0)
+        {
+          if(r_final->isNaN())
+          {
+            ROS_ERROR("NAN in LoopClosure!");
+            outcome(*it, false, 0.0, 0.0);
+            continue;
+          }
+
+          r_final->Transformation = r_final->Transformation.inverse();
+
+          // coarsest level of the final match first, the finer levels are only worth it if it isn't hopeless already
+          t.coarse.match(keyframe->points(), *constraint->image(), *r_final);
+
+          if(final_fine_config.FirstLevel >= final_fine_config.LastLevel)
+          {
+            if(r_final->isNaN() || entropyRatio(keyframe, constraint, *r_final) < simple_threshold || constraintRatio(*r_final) < final_constraint_threshold)
+            {
+              coarse_rejected.record(0.0);
+              outcome(*it, false, r_final->isNaN() ? 0.0 : entropyRatio(keyframe, constraint, *r_final), r_final->isNaN() ? 0.0 : constraintRatio(*r_final));
+              continue;
+            }
+
+            // the coarse match returned the inverse of its estimate
+            r_final->Transformation = r_final->Transformation.inverse();
+
+            t.fine.match(keyframe->points(), *constraint->image(), *r_final);
+          }
+
+          constraint_ratio_final = constraintRatio(*r_final);
+          ratio_final = entropyRatio(keyframe, constraint, *r_final);
+
+          const bool accepted = ratio_final > final_threshold && constraint_ratio_final > final_constraint_threshold;
+
+          if(accepted)
+          {
+            r_final->Statistics.Levels.clear();
+            proposals.push_back(std::make_pair(*it, *r_final));
+          }
+
+          outcome(*it, accepted, ratio_final, constraint_ratio_final);
+        }
+      }
+    }
+
+    void join(ValidateKeyframeConstraintReduction& other)
+    {
+      proposals.insert(proposals.end(), other.proposals.begin(), other.proposals.end());
+      outcomes.insert(outcomes.end(), other.outcomes.begin(), other.outcomes.end());
+    }
+  };
+
+  // orders keyframes by their distance to a position
+  struct CloserTo
+  {
+    Eigen::Vector3d position;
+
+    CloserTo(const Eigen::Vector3d& position) :
+      position(position)
+    {
+    }
+
+    bool operator()(const KeyframePtr& a, const KeyframePtr& b) const
+    {
+      return (a->pose().translation() - position).squaredNorm() < (b->pose().translation() - position).squaredNorm();
+    }
+  };
+
+  struct RelocalizationCandidate
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    KeyframePtr Keyframe;
+    LocalTracker::TrackingResult Result;
+    double EntropyRatio, ConstraintRatio;
+
+    RelocalizationCandidate() :
+      EntropyRatio(0.0),
+      ConstraintRatio(0.0)
+    {
+    }
+  };
+  typedef std::vector<RelocalizationCandidate, Eigen::aligned_allocator<RelocalizationCandidate> > RelocalizationCandidateVector;
+
+  // there is no second keyframe, so only the evaluation of the candidate counts
+  static double relocalizationEntropyRatio(const KeyframePtr& keyframe, const LocalTracker::TrackingResult& r)
+  {
+    double ratio = keyframe->evaluation()->ratioWithAverage(r);
+
+    return std::isfinite(ratio) ? ratio : 0.0;
+  }
+
+  /**
+   * Matches the image of a lost frame against each candidate keyframe on the coarsest level of the validation. The
+   * pose relative to the last known one and the identity compete as initial guesses.
+   */
+  struct MatchRelocalizationCandidates
+  {
+    ValidationTrackerPool& trackers;
+    size_t generation;
+    const dvo::DenseTracker::Config &simple_config, &final_coarse_config, &final_fine_config;
+    dvo::core::RgbdImagePyramid& image;
+    const Eigen::Affine3d& hint;
+    RelocalizationCandidateVector& candidates;
+
+    MatchRelocalizationCandidates(ValidationTrackerPool& trackers, size_t generation, const dvo::DenseTracker::Config &simple_config, const dvo::DenseTracker::Config& final_coarse_config, const dvo::DenseTracker::Config& final_fine_config, dvo::core::RgbdImagePyramid& image, const Eigen::Affine3d& hint, RelocalizationCandidateVector& candidates) :
+      trackers(trackers),
+      generation(generation),
+      simple_config(simple_config),
+      final_coarse_config(final_coarse_config),
+      final_fine_config(final_fine_config),
+      image(image),
+      hint(hint),
+      candidates(candidates)
+    {
+    }
+
+    void operator()(const tbb::blocked_range<size_t>& r) const
+    {
+      for(size_t idx = r.begin(); idx != r.end(); ++idx)
+      {
+        RelocalizationCandidate& c = candidates[idx];
+        ValidationTrackers& t = localValidationTrackers(trackers, generation, simple_config, final_coarse_config, final_fine_config, c.Keyframe);
+
+        dvo::DenseTracker::TransformVector guesses(2);
+        guesses[0] = hint.inverse() * c.Keyframe->pose();
+        guesses[1].setIdentity();
+
+        t.hypotheses.matchHypotheses(c.Keyframe->points(), image, guesses, c.Result);
+
+        if(c.Result.isNaN()) continue;
+
+        c.EntropyRatio = relocalizationEntropyRatio(c.Keyframe, c.Result);
+        c.ConstraintRatio = ValidateKeyframeConstraintReduction::constraintRatio(c.Result);
+      }
+    }
+  };
+
+  void validateKeyframeConstraintsParallel(const KeyframeVector& constraint_candidates, const KeyframePtr& keyframe, ConstraintVector& constraints)
+  {
+    KeyframePairVector pairs;
+    PairConstraintVector proposals;
+
+    for(KeyframeVector::const_iterator it = constraint_candidates.begin(); it != constraint_candidates.end(); ++it)
+    {
+      pairs.push_back(KeyframePair(keyframe, *it));
+    }
+
+    validateKeyframePairsParallel(pairs, proposals);
+
+    constraints.clear();
+
+    for(PairConstraintVector::const_iterator it = proposals.begin(); it != proposals.end(); ++it)
+    {
+      constraints.push_back(std::make_pair(it->first.second, it->second));
+    }
+  }
+
+  // returns the number of inserted constraints
+  size_t validateAndInsertKeyframePairs(const KeyframePairVector& pairs)
+  {
+    PairConstraintVector constraints;
+    validateKeyframePairsParallel(pairs, constraints);
+
+    for(PairConstraintVector::const_iterator it = constraints.begin(); it != constraints.end(); ++it)
+    {
+      insertConstraint(it->first.first, it->first.second, it->second.Transformation, it->second.Information);
+    }
+
+    return constraints.size();
+  }
+
+  /**
+   * Validates the constraint candidate (second) of every keyframe (first), the accepted ones keep their order. Pairs
+   * whose outcome is known, see validatedBefore(), are skipped, the outcomes of the others are remembered.
+   */
+  void validateKeyframePairsParallel(const KeyframePairVector& pairs, PairConstraintVector& constraints)
+  {
+    static dvo::util::Timer& cached_counter = dvo::util::Instrumentation::instance().timer("keyframe_graph/validation/cached");
+
+    // configure() runs on other threads, so only this one touches the map
+    if(reset_validation_outcomes_.compare_and_swap(false, true)) validation_outcomes_.clear();
+
+    KeyframePairVector uncached;
+    uncached.reserve(pairs.size());
+
+    for(KeyframePairVector::const_iterator it = pairs.begin(); it != pairs.end(); ++it)
+    {
+      if(validatedBefore(it->first, it->second))
+        cached_counter.record(0.0);
+      else
+        uncached.push_back(*it);
+    }
+
+    ValidateKeyframeConstraintReduction body(cfg_, validation_tracker_pool_, validation_tracker_generation_, validation_tracker_cfg_, constraint_coarse_tracker_cfg_, constraint_fine_tracker_cfg_);
+
+    size_t grain_size = cfg_.UseMultiThreading ? 1 : std::max<size_t>(1, uncached.size());
+
+    typedef tbb::blocked_range<KeyframePairVector::const_iterator> PairRange;
+
+    dvo::util::TaskArenas::instance().execute(dvo::util::TaskArenas::Backend, boost::bind(
+        &parallelReduce<PairRange, ValidateKeyframeConstraintReduction>,
+        PairRange(uncached.begin(), uncached.end(), grain_size), boost::ref(body)
+    ));
+
+    constraints.swap(body.proposals);
+
+    if(cfg_.ValidationCacheMaxTranslation < 0.0) return;
+
+    for(PairOutcomeVector::const_iterator it = body.outcomes.begin(); it != body.outcomes.end(); ++it)
+    {
+      ValidationOutcome& o = validation_outcomes_[edgeKey(it->Pair.first->id(), it->Pair.second->id())];
+      o.Relative = relativePose(it->Pair.first, it->Pair.second);
+      o.Accepted = it->Accepted;
+      o.EntropyRatio = it->EntropyRatio;
+      o.ConstraintRatio = it->ConstraintRatio;
+    }
+  }
+
+  // pose of the keyframe with the smaller id relative to the other one
+  static Eigen::Isometry3d relativePose(const KeyframePtr& a, const KeyframePtr& b)
+  {
+    return a->id() < b->id() ? toIsometry(b->pose().inverse() * a->pose()) : toIsometry(a->pose().inverse() * b->pose());
+  }
+
+  /**
+   * Whether the pair was validated before while the graph estimated about the same relative pose, see
+   * KeyframeGraphConfig::ValidationCacheMaxTranslation. Validating it again would give the same outcome, accepted
+   * pairs are either connected already or their edge was pruned as an outlier.
+   */
+  bool validatedBefore(const KeyframePtr& a, const KeyframePtr& b) const
+  {
+    if(cfg_.ValidationCacheMaxTranslation < 0.0 || reset_validation_outcomes_) return false;
+
+    ValidationOutcomeMap::const_iterator it = validation_outcomes_.find(edgeKey(a->id(), b->id()));
+
+    if(it == validation_outcomes_.end()) return false;
+
+    Eigen::Isometry3d change = it->second.Relative.inverse() * relativePose(a, b);
+
+    return change.translation().norm() <= cfg_.ValidationCacheMaxTranslation && Eigen::AngleAxisd(change.rotation()).angle() <= cfg_.ValidationCacheMaxRotation * M_PI / 180.0;
+  }
+
+  int insertNewKeyframeConstraints(const KeyframePtr& keyframe, const ConstraintVector& constraints)
+  {
+    int inserted = 0;
+    int max_distance = 0;
+
+    for(ConstraintVector::const_iterator it = constraints.begin(); it != constraints.end(); ++it)
+    {
+      //Eigen::Affine3d relative;
+      const KeyframePtr& constraint = it->first;
+
+      int distance = keyframe->id() - constraint->id();
+
+      // constraints to the previous submap are anchored by the window, older ones close a loop
+      if(submap(constraint) + 1 < submap(keyframe)) spanning_closure_ = true;
+
+      // connected keyframes were filtered out before the validation
+      assert(!hasEdge(constraint->id(), keyframe->id()));
+
+      inserted++;
+      insertConstraint(keyframe, constraint, it->second.Transformation, it->second.Information);
+
+      max_distance = std::max(max_distance, distance);
+    }
+    //std::cerr << "new constraints " << inserted << "/" << constraints.size() << std::endl;
+
+    return max_distance;
+  }
+
+  void insertConstraint(const KeyframePtr& keyframe, const KeyframePtr& constraint, const Eigen::Affine3d& relative, const g2o::EdgeSE3::InformationType& information)
+  {
+    int edge_id = next_keyframe_edge_id_++;
+
+    g2o::EdgeSE3* e = new g2o::EdgeSE3();
+    e->setId(edge_id);
+    e->setMeasurement(toIsometry(relative));
+    e->setRobustKernel(createRobustKernel());
+    e->setInformation(information);
+    e->resize(2);
+    e->setVertex(0, keyframegraph_.vertex(keyframe->id()));
+    e->setVertex(1, keyframegraph_.vertex(constraint->id()));
+
+    keyframegraph_.addEdge(e);
+    indexEdge(e);
+    stamp(edge_changes_, edge_id, false);
+  }
+
+  /**
+   * Picks the outliers among the robust edges of the last optimization, whose errors the optimizer computed already,
+   * so neither the inactive part of the graph is visited nor are errors evaluated again. The n_max outliers with the
+   * lowest weight below weight_threshold, all if n_max < 0, lose their information and are appended to disabled. The
+   * active set of the optimizer stays valid and further iterations ignore them, until removeConstraints() removes
+   * them from the graph.
+   */
+  size_t disableOutlierConstraints(double weight_threshold, int n_max, std::vector<g2o::EdgeSE3*>& disabled)
+  {
+    std::vector<std::pair<double, g2o::EdgeSE3*> > candidate_edges;
+
+    const g2o::SparseOptimizer::EdgeContainer& active = keyframegraph_.activeEdges();
+
+    for(g2o::SparseOptimizer::EdgeContainer::const_iterator it = active.begin(); it != active.end(); ++it)
+    {
+      if((*it)->robustKernel() == 0) continue;
+
+      Eigen::Vector3d rho;
+      (*it)->robustKernel()->robustify((*it)->chi2(), rho);
+
+      if(rho[1] < weight_threshold)
+      {
+        candidate_edges.push_back(std::make_pair(rho[1], static_cast<g2o::EdgeSE3*>(*it)));
+      }
+    }
+
+    std::sort(candidate_edges.begin(), candidate_edges.end());
+
+    if(n_max >= 0 && candidate_edges.size() > size_t(n_max)) candidate_edges.resize(n_max);
+
+    for(size_t idx = 0; idx < candidate_edges.size(); ++idx)
+    {
+      // zero error and contribution to the hessian, the disabled edge is never picked again
+      candidate_edges[idx].second->setInformation(g2o::EdgeSE3::InformationType::Zero());
+      disabled.push_back(candidate_edges[idx].second);
+    }
+
+    return candidate_edges.size();
+  }
+
+  // removes the edges from the graph, the next optimization has to initialize the active set again
+  void removeConstraints(const std::vector<g2o::EdgeSE3*>& edges)
+  {
+    for(std::vector<g2o::EdgeSE3*>::const_iterator it = edges.begin(); it != edges.end(); ++it)
+    {
+      stamp(edge_changes_, (*it)->id(), true);
+      unindexEdge(*it);
+      keyframegraph_.removeEdge(*it);
+    }
+
+    if(!edges.empty())
+      std::cerr << "removed: "  << edges.size() << " edges" << std::endl;
+  }
+
+  /**
+   * Runs the iterations on the active set of the graph and times the call. If continued is set, the active set and the
+   * structure of the graph didn't change since the last call, only estimates or informations, so the structure of the
+   * system and the symbolic factorization are kept.
+   */
+  int optimizeGraph(int iterations, bool continued = false)
+  {
+    static dvo::util::Timer& optimize_timer = dvo::util::Instrumentation::instance().timer("keyframe_graph/optimize");
+    dvo::util::ScopedTimer optimize_scope(optimize_timer);
+
+    return keyframegraph_.optimize(iterations, continued);
+  }
+
+  /**
+   * Optimizes the whole graph in rounds, after every round the outliers are disabled, see disableOutlierConstraints(),
+   * instead of initializing the optimization again. They are removed at the end.
+   */
+  void optimizeAndPruneOutliers(int rounds, int iterations_per_round)
+  {
+    std::vector<g2o::EdgeSE3*> outliers;
+
+    keyframegraph_.initializeOptimization();
+
+    for(int idx = 0; idx < rounds; ++idx)
+    {
+      optimizeGraph(iterations_per_round, idx > 0);
+      disableOutlierConstraints(0.1, -1, outliers);
+    }
+
+    removeConstraints(outliers);
+  }
+
+  /**
+   * One round of optimizeAndPruneOutliers() over the whole graph, including the odometry edges, which aren't on level
+   * 0. Their levels are restored afterwards, so the following windowed optimizations skip them again.
+   */
+  void optimizeAllLevels(int iterations)
+  {
+    std::vector<std::pair<g2o::OptimizableGraph::Edge*, int> > levels;
+
+    for(g2o::OptimizableGraph::EdgeSet::iterator e_it = keyframegraph_.edges().begin(); e_it != keyframegraph_.edges().end(); ++e_it)
+    {
+      g2o::OptimizableGraph::Edge* e = static_cast<g2o::OptimizableGraph::Edge*>(*e_it);
+
+      if(e->level() == 0) continue;
+
+      levels.push_back(std::make_pair(e, e->level()));
+      e->setLevel(0);
+    }
+
+    std::vector<g2o::EdgeSE3*> outliers;
+
+    releaseWindowAnchors();
+    keyframegraph_.initializeOptimization();
+
+    optimizeGraph(iterations);
+    disableOutlierConstraints(0.1, -1, outliers);
+
+    // before the outliers are removed, which may include some of these edges
+    for(size_t idx = 0; idx < levels.size(); ++idx)
+      levels[idx].first->setLevel(levels[idx].second);
+
+    removeConstraints(outliers);
+  }
+
+  /**
+   * Either activates the whole graph, or only the keyframes from keyframes_[window_begin] on. In the latter case the
+   * keyframes connected to the window from outside are temporarily fixed to anchor it, so the cost of the optimization
+   * doesn't grow with the map. The anchors are released by releaseWindowAnchors().
+   */
+  void initializeOptimization(bool windowed, size_t window_begin)
+  {
+    releaseWindowAnchors();
+
+    if(!windowed || window_begin == 0 || window_begin >= keyframes_.size())
+    {
+      keyframegraph_.initializeOptimization();
+      return;
+    }
+
+    g2o::HyperGraph::VertexSet window, active;
+
+    for(KeyframeVector::const_iterator it = keyframes_.begin() + window_begin; it != keyframes_.end(); ++it)
+    {
+      window.insert(keyframegraph_.vertex((*it)->id()));
+    }
+
+    active = window;
+
+    for(g2o::HyperGraph::VertexSet::const_iterator v_it = window.begin(); v_it != window.end(); ++v_it)
+    {
+      for(g2o::HyperGraph::EdgeSet::const_iterator e_it = (*v_it)->edges().begin(); e_it != (*v_it)->edges().end(); ++e_it)
+      {
+        g2o::OptimizableGraph::Edge* e = static_cast<g2o::OptimizableGraph::Edge*>(*e_it);
+
+        if(e->level() != 0) continue;
+
+        for(size_t idx = 0; idx < e->vertices().size(); ++idx)
+        {
+          g2o::OptimizableGraph::Vertex* v = static_cast<g2o::OptimizableGraph::Vertex*>(e->vertex(idx));
+
+          if(!active.insert(v).second) continue;
+
+          if(!v->fixed())
+          {
+            v->setFixed(true);
+            window_anchors_.push_back(v);
+          }
+        }
+      }
+    }
+
+    keyframegraph_.initializeOptimization(active, 0);
+  }
+
+  void releaseWindowAnchors()
+  {
+    for(std::vector<g2o::OptimizableGraph::Vertex*>::iterator it = window_anchors_.begin(); it != window_anchors_.end(); ++it)
+    {
+      (*it)->setFixed(false);
+    }
+
+    window_anchors_.clear();
+  }
+
+  void stamp(ChangeStampMap& changes, int id, bool removed)
+  {
+    tbb::spin_mutex::scoped_lock l(changes_mutex_);
+
+    ChangeStamp& c = changes[id];
+
+    // an id changed several times within a revision is logged once
+    if(c.revision != revision_ + 1)
+    {
+      ChangeLogEntry entry;
+      entry.revision = revision_ + 1;
+      entry.id = id;
+      entry.vertex = &changes == &vertex_changes_;
+
+      change_log_.push_back(entry);
+    }
+
+    c.revision = revision_ + 1;
+    c.removed = removed;
+  }
+
+  // whether the entry is the last change of its id, guarded by changes_mutex_
+  bool isLatestChange(const ChangeLogEntry& entry) const
+  {
+    const ChangeStampMap& changes = entry.vertex ? vertex_changes_ : edge_changes_;
+    ChangeStampMap::const_iterator it = changes.find(entry.id);
+
+    return it != changes.end() && it->second.revision == entry.revision;
+  }
+
+  // makes the stamped changes visible as a new revision, called before every map changed signal
+  void commitChanges()
+  {
+    {
+      tbb::spin_mutex::scoped_lock l(changes_mutex_);
+
+      revision_ += 1;
+
+      // drops the entries of ids which changed again since, so the log stays proportional to the number of ids
+      if(change_log_.size() > 2 * (vertex_changes_.size() + edge_changes_.size()))
+      {
+        ChangeLog latest;
+        latest.reserve(vertex_changes_.size() + edge_changes_.size());
+
+        for(ChangeLog::const_iterator it = change_log_.begin(); it != change_log_.end(); ++it)
+        {
+          if(isLatestChange(*it)) latest.push_back(*it);
+        }
+
+        change_log_.swap(latest);
+      }
+    }
+
+    // only the thread changing the graph writes the shared store, so a new configuration is applied here
+    shared_store_.configure(cfg_.SharedStoreName, cfg_.SharedStoreCapacity, cfg_.SharedStoreFirstLevel, cfg_.SharedStoreLevels);
+    shared_store_.update(keyframes_);
+
+    updateTsdfMap();
+  }
+
+  /**
+   * Integrates new keyframes into the volume and moves the ones the optimization moved further than the thresholds. At
+   * most TsdfMaxMovesPerUpdate keyframes are moved, after a loop closure the others follow in the next updates, or on
+   * the optimization thread while it is idle.
+   */
+  void updateTsdfMap()
+  {
+    tsdf_pending_ = false;
+
+    if(!cfg_.UseTsdfMap)
+    {
+      if(!tsdf_map_.empty()) tsdf_map_.clear();
+      return;
+    }
+
+    static dvo::util::Timer& tsdf_timer = dvo::util::Instrumentation::instance().timer("keyframe_graph/tsdf_map");
+    dvo::util::ScopedTimer t(tsdf_timer);
+
+    // the coarsest validation level is never evicted by the keyframe store
+    tsdf_map_.configure(cfg_.TsdfVoxelSize, cfg_.TsdfTruncation, cfg_.TsdfMaxDepth, std::min<size_t>(cfg_.TsdfLevel, validation_tracker_cfg_.FirstLevel), cfg_.TsdfStride);
+
+    const size_t level = tsdf_map_.level();
+    size_t moves = 0;
+
+    for(KeyframeVector::iterator it = keyframes_.begin(); it != keyframes_.end(); ++it)
+    {
+      const KeyframePtr& keyframe = *it;
+      const bool contained = tsdf_map_.contains(keyframe->id());
+
+      if(contained && !tsdf_map_.moved(keyframe->id(), keyframe->pose(), cfg_.TsdfReintegrationTranslation, cfg_.TsdfReintegrationRotation)) continue;
+
+      if(contained && moves >= TsdfMaxMovesPerUpdate)
+      {
+        tsdf_pending_ = true;
+        continue;
+      }
+
+      // evicted keyframes are restored for the integration only, so the volume doesn't bring the map back into memory
+      const bool evicted = keyframe->image()->level(level).depth.empty();
+
+      if(evicted && !keyframe_store_.acquire(keyframe)) continue;
+
+      tsdf_map_.integrate(keyframe->id(), *keyframe->image(), keyframe->pose());
+
+      if(evicted) keyframe_store_.release(keyframe);
+
+      if(contained) moves++;
+    }
+  }
+
+  // forgets the history, e.g., after the graph was replaced, all current vertices and edges become changes
+  void resetChanges()
+  {
+    tbb::spin_mutex::scoped_lock l(changes_mutex_);
+
+    vertex_changes_.clear();
+    edge_changes_.clear();
+    change_log_.clear();
+    full_revision_ = revision_ + 1;
+
+    ChangeStamp c;
+    c.revision = full_revision_;
+    c.removed = false;
 
-          t->configure(final_config);
-          r_final->Transformation = r_final->Transformation.inverse();
-          t->match(*keyframe->image(), *constraint->image(), *r_final);
-          constraint_ratio_final = double(r_final->Statistics.Levels.back().Iterations.back().ValidConstraints) / double(r_final->Statistics.Levels.back().ValidPixels);
+    ChangeLogEntry entry;
+    entry.revision = full_revision_;
 
-          ratio_final = std::min(keyframe->evaluation()->ratioWithAverage(*r_final), constraint->evaluation()->ratioWithAverage(*r_final)); //std::log(r_final->Information.determinant()) / std::max(keyframe->avgDivergenceFromFim(), constraint->avgDivergenceFromFim());
-          ratio_final = std::isfinite(ratio_final) ? ratio_final : 0.0;
+    entry.vertex = true;
 
-          if(ratio_final > final_threshold && constraint_ratio_final > final_constraint_threshold)
-          {
-            r_final->Statistics.Levels.clear();
-            proposals.push_back(std::make_pair(constraint, *r_final));
-          }
-        }
-      }
+    for(g2o::OptimizableGraph::VertexIDMap::iterator it = keyframegraph_.vertices().begin(); it != keyframegraph_.vertices().end(); ++it)
+    {
+      vertex_changes_[it->first] = c;
+
+      entry.id = it->first;
+      change_log_.push_back(entry);
     }
 
-    void join(ValidateKeyframeConstraintReduction& other)
+    entry.vertex = false;
+
+    for(g2o::HyperGraph::EdgeSet::iterator it = keyframegraph_.edges().begin(); it != keyframegraph_.edges().end(); ++it)
     {
-      proposals.insert(proposals.end(), other.proposals.begin(), other.proposals.end());
+      edge_changes_[(*it)->id()] = c;
+
+      entry.id = (*it)->id();
+      change_log_.push_back(entry);
     }
-  };
+  }
 
-  void validateKeyframeConstraintsParallel(const KeyframeVector& constraint_candidates, const KeyframePtr& keyframe, ConstraintVector& constraints)
+  size_t revision()
+  {
+    tbb::spin_mutex::scoped_lock l(changes_mutex_);
+
+    return revision_;
+  }
+
+  void changes(size_t since, MapChangeSet& changes)
   {
-    ValidateKeyframeConstraintReduction body(cfg_, validation_tracker_pool_, validation_tracker_cfg_, constraint_tracker_cfg_, keyframe);
+    tbb::spin_mutex::scoped_lock l(changes_mutex_);
+
+    changes.clear();
+    changes.Revision = revision_;
+    changes.Full = since < full_revision_;
 
-    size_t grain_size = cfg_.UseMultiThreading ? 1 : constraint_candidates.size();
+    // only the entries after since are visited, an id which changed again later is reported by its last entry
+    for(ChangeLog::const_iterator it = std::lower_bound(change_log_.begin(), change_log_.end(), since + 1, &isBeforeRevision); it != change_log_.end(); ++it)
+    {
+      const ChangeStampMap& stamps = it->vertex ? vertex_changes_ : edge_changes_;
+      ChangeStampMap::const_iterator stamp = stamps.find(it->id);
+
+      if(stamp == stamps.end() || stamp->second.revision != it->revision) continue;
 
-    tbb::parallel_reduce(tbb::blocked_range<KeyframeVector::const_iterator>(constraint_candidates.begin(), constraint_candidates.end(), grain_size), body);
+      const bool removed = stamp->second.removed;
 
-    constraints.assign(body.proposals.begin(), body.proposals.end());
+      if(it->vertex)
+        (removed ? changes.RemovedVertices : changes.ChangedVertices).push_back(it->id);
+      else
+        (removed ? changes.RemovedEdges : changes.AddedEdges).push_back(it->id);
+    }
   }
 
-  int insertNewKeyframeConstraints(const KeyframePtr& keyframe, const ConstraintVector& constraints)
+  void updateKeyframePosesFromGraph(size_t first = 0)
   {
-    int inserted = 0;
-    int max_distance = 0;
-
-    for(ConstraintVector::const_iterator it = constraints.begin(); it != constraints.end(); ++it)
+    for(KeyframeVector::iterator it = keyframes_.begin() + std::min(first, keyframes_.size()); it != keyframes_.end(); ++it)
     {
-      //Eigen::Affine3d relative;
-      const KeyframePtr& constraint = it->first;
+      const KeyframePtr& keyframe = *it;
 
-      int distance = keyframe->id() - constraint->id();
-      bool odometry_constraint = std::abs(distance) == 1;
+      g2o::VertexSE3* vertex = (g2o::VertexSE3*) keyframegraph_.vertex(keyframe->id());
 
-      assert(!odometry_constraint);
+      Eigen::Affine3d pose = toAffine(vertex->estimate());
 
-      inserted++;
-      insertConstraint(keyframe, constraint, it->second.Transformation, it->second.Information);
+      if(!(pose.matrix() == keyframe->pose().matrix())) stamp(vertex_changes_, keyframe->id(), false);
 
-      max_distance = std::max(max_distance, distance);
+      keyframe->pose(pose);
     }
-    //std::cerr << "new constraints " << inserted << "/" << constraints.size() << std::endl;
 
-    return max_distance;
+    keyframe_index_.update(first);
   }
 
-  void insertConstraint(const KeyframePtr& keyframe, const KeyframePtr& constraint, const Eigen::Affine3d& relative, const g2o::EdgeSE3::InformationType& information)
+  int submap(const KeyframePtr& keyframe) const
   {
-    int edge_id = combine(constraint->id(), keyframe->id());
+    const VertexTable::Entry* e = vertex_table_.find(keyframe->id());
 
-    g2o::EdgeSE3* e = new g2o::EdgeSE3();
-    e->setId(edge_id);
-    e->setMeasurement(toIsometry(relative));
-    e->setRobustKernel(createRobustKernel());
-    e->setInformation(information);
-    e->resize(2);
-    e->setVertex(0, keyframegraph_.vertex(keyframe->id()));
-    e->setVertex(1, keyframegraph_.vertex(constraint->id()));
+    return e != 0 ? e->submap : -1;
+  }
 
-    keyframegraph_.addEdge(e);
+  // appends the keyframe to the last submap, or starts a new one if it is too far from its first keyframe or full
+  void assignSubmap(const KeyframePtr& keyframe)
+  {
+    bool create = submaps_.empty();
+
+    if(!create && cfg_.SubmapRadius > 0.0)
+    {
+      const Submap& s = submaps_.back();
+      const g2o::VertexSE3* anchor = static_cast<g2o::VertexSE3*>(keyframegraph_.vertex(s.anchor));
+
+      create = anchor == 0 || (anchor->estimate().translation() - keyframe->pose().translation()).norm() > cfg_.SubmapRadius || keyframes_.size() - s.first > cfg_.SubmapMaxKeyframes;
+    }
+
+    if(create)
+    {
+      Submap s;
+      s.first = keyframes_.size() - 1;
+      s.anchor = keyframe->id();
+
+      submaps_.push_back(s);
+    }
+
+    vertex_table_.submap(keyframe->id(), int(submaps_.size()) - 1);
   }
 
-  void removeOutlierConstraints(double weight_threshold, int n_max = -1)
+  /**
+   * Moves every submap rigidly, so the edges between submaps agree, by optimizing a coarse graph with one vertex per
+   * submap at its anchor keyframe. The relative poses within a submap are kept, so the full optimization following a
+   * loop closure starts close to its solution. Odometry vertices move with the latest keyframe before them.
+   */
+  void alignSubmaps()
   {
-    int n_removed = 0;
+    static dvo::util::Timer& align_timer = dvo::util::Instrumentation::instance().timer("keyframe_graph/align_submaps");
+
+    if(submaps_.size() < 2) return;
+
+    dvo::util::ScopedTimer align_scope(align_timer);
+
+    g2o::SparseOptimizer coarse;
+    coarse.setAlgorithm(new g2o::OptimizationAlgorithmLevenberg(new BlockSolver(new LinearSolver())));
+    coarse.setVerbose(false);
 
-    std::map<double, g2o::EdgeSE3*> candidate_edges;
+    std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d> > anchors(submaps_.size());
 
-    for (g2o::HyperGraph::EdgeSet::iterator it = keyframegraph_.edges().begin(); it != keyframegraph_.edges().end(); ++it)
+    for(size_t idx = 0; idx < submaps_.size(); ++idx)
     {
-      g2o::EdgeSE3* e = dynamic_cast<g2o::EdgeSE3*>(*it);
+      anchors[idx] = static_cast<g2o::VertexSE3*>(keyframegraph_.vertex(submaps_[idx].anchor))->estimate();
 
-      if(e->robustKernel() == 0) continue;
+      g2o::VertexSE3* v = new g2o::VertexSE3();
+      v->setId(int(idx));
+      v->setEstimate(anchors[idx]);
+      v->setFixed(idx == 0);
+      coarse.addVertex(v);
+    }
 
-      Eigen::Vector3d rho;
-      e->robustKernel()->robustify(e->chi2(), rho);
+    size_t num_edges = 0;
 
-      if(rho[1] < weight_threshold)
-      {
-        candidate_edges.insert(std::map<double, g2o::EdgeSE3*>::value_type(rho[1], e));
-      }
+    for(EdgeIndex::const_iterator it = keyframe_edges_.begin(); it != keyframe_edges_.end(); ++it)
+    {
+      const g2o::EdgeSE3* e = static_cast<const g2o::EdgeSE3*>(it->second);
+      const VertexTable::Entry *a = vertex_table_.find(e->vertex(0)->id()), *b = vertex_table_.find(e->vertex(1)->id());
+
+      if(a == 0 || b == 0 || a->submap < 0 || b->submap < 0 || a->submap == b->submap) continue;
+
+      const Eigen::Isometry3d& xa = static_cast<const g2o::VertexSE3*>(e->vertex(0))->estimate();
+      const Eigen::Isometry3d& xb = static_cast<const g2o::VertexSE3*>(e->vertex(1))->estimate();
+
+      // the measurement between the keyframes, moved to the anchors through their current poses in the submaps
+      g2o::EdgeSE3* ce = new g2o::EdgeSE3();
+      ce->resize(2);
+      ce->setVertex(0, coarse.vertex(a->submap));
+      ce->setVertex(1, coarse.vertex(b->submap));
+      ce->setMeasurement(anchors[a->submap].inverse() * xa * e->measurement() * xb.inverse() * anchors[b->submap]);
+      ce->setInformation(e->information());
+      if(e->robustKernel() != 0) ce->setRobustKernel(createRobustKernel());
+      coarse.addEdge(ce);
+
+      num_edges++;
     }
 
-    for(std::map<double, g2o::EdgeSE3*>::iterator it = candidate_edges.begin(); it != candidate_edges.end() && (n_removed < n_max || n_max < 0); ++it)
+    if(num_edges == 0) return;
+
+    coarse.initializeOptimization();
+    coarse.optimize(10);
+
+    std::vector<Eigen::Isometry3d, Eigen::aligned_allocator<Eigen::Isometry3d> > corrections(submaps_.size());
+
+    for(size_t idx = 0; idx < submaps_.size(); ++idx)
     {
-      keyframegraph_.removeEdge(it->second);
-      ++n_removed;
+      corrections[idx] = static_cast<g2o::VertexSE3*>(coarse.vertex(int(idx)))->estimate() * anchors[idx].inverse();
     }
 
-    if(n_removed > 0)
-      std::cerr << "removed: "  << n_removed << " edges" << std::endl;
-  }
+    int current = -1;
 
-  void updateKeyframePosesFromGraph()
-  {
-    for(KeyframeVector::iterator it = keyframes_.begin(); it != keyframes_.end(); ++it)
+    for(VertexTable::TimestampIndex::const_iterator it = vertex_table_.byTimestamp().begin(); it != vertex_table_.byTimestamp().end(); ++it)
     {
-      const KeyframePtr& keyframe = *it;
+      const VertexTable::Entry* e = vertex_table_.find(it->second);
 
-      g2o::VertexSE3* vertex = (g2o::VertexSE3*) keyframegraph_.vertex(keyframe->id());
+      if(e->submap >= 0) current = e->submap;
+      if(current < 0) continue;
+
+      g2o::VertexSE3* v = static_cast<g2o::VertexSE3*>(keyframegraph_.vertex(it->second));
+
+      if(v == 0 || v->fixed()) continue;
 
-      keyframe->pose(toAffine(vertex->estimate()));
+      v->setEstimate(corrections[current] * v->estimate());
     }
   }
 
@@ -624,7 +2768,8 @@ private:
     }
   };
 
-  void addGraph(g2o::OptimizableGraph* g)
+  // timestamps are the ones of the vertices by their new id
+  void addGraph(g2o::OptimizableGraph* g, const std::map<int, ros::Time>& timestamps)
   {
     for (g2o::HyperGraph::VertexIDMap::iterator it=g->vertices().begin(); it!=g->vertices().end(); ++it)
     {
@@ -638,9 +2783,14 @@ private:
       v2->setMarginalized(v1->marginalized());
       v2->setUserData(v1->userData());
       v1->setUserData(0);
+      // the local map timestamps all of its vertices
+      std::map<int, ros::Time>::const_iterator t = timestamps.find(v2->id());
+      assert(t != timestamps.end());
+      vertex_table_.insert(v2->id(), t->second);
       //v2->edges().clear();
       v2->setHessianIndex(-1);
       keyframegraph_.addVertex(v2);
+      stamp(vertex_changes_, v2->id(), false);
     }
     for (g2o::HyperGraph::EdgeSet::iterator it=g->edges().begin(); it!=g->edges().end(); ++it)
     {
@@ -660,16 +2810,183 @@ private:
         en->setVertex(cnt++, v);
       }
       keyframegraph_.addEdge(en);
+      stamp(edge_changes_, en->id(), false);
+    }
+  }
+
+  /**
+   * Adds only the keyframe and the current frame of the local map to our graph, using the same ids as addGraph. They
+   * are connected by an odometry edge with the marginal information of all measurements in the local map.
+   */
+  void addMarginalizedGraph(const LocalMap::Ptr& m, int keyframe_vertex_id, int current_vertex_id)
+  {
+    Eigen::Isometry3d keyframe_to_current;
+    dvo::core::Matrix6d information;
+
+    MarginalizedSegment segment;
+
+    if(!m->marginalize(keyframe_to_current, information, segment.frames))
+    {
+      ROS_WARN("marginalization of local map failed, using direct keyframe measurement");
+    }
+
+    Eigen::Isometry3d current_pose = toIsometry(m->getCurrentFramePose());
+
+    // only the first keyframe of a chain isn't the current frame of the previous local map
+    g2o::VertexSE3* kv = (g2o::VertexSE3*) keyframegraph_.vertex(keyframe_vertex_id);
+
+    if(kv == 0)
+    {
+      kv = new g2o::VertexSE3();
+      kv->setId(keyframe_vertex_id);
+      kv->setEstimate(current_pose * keyframe_to_current.inverse());
+      kv->setUserData(new dvo_slam::Timestamped(ros::Time(m->getKeyframe()->timestamp())));
+      keyframegraph_.addVertex(kv);
+      vertex_table_.insert(kv->id(), ros::Time(m->getKeyframe()->timestamp()));
+      stamp(vertex_changes_, kv->id(), false);
+    }
+
+    g2o::VertexSE3* cv = new g2o::VertexSE3();
+    cv->setId(current_vertex_id);
+    cv->setEstimate(current_pose);
+    cv->setUserData(new dvo_slam::Timestamped(ros::Time(m->getCurrentFrame()->timestamp())));
+    keyframegraph_.addVertex(cv);
+    vertex_table_.insert(cv->id(), ros::Time(m->getCurrentFrame()->timestamp()));
+    stamp(vertex_changes_, cv->id(), false);
+
+    g2o::EdgeSE3* e = new g2o::EdgeSE3();
+    e->setId(next_odometry_edge_id_--);
+    e->setLevel(2);
+    e->resize(2);
+    e->setVertex(0, kv);
+    e->setVertex(1, cv);
+    e->setMeasurement(keyframe_to_current);
+    e->setInformation(information);
+    keyframegraph_.addEdge(e);
+    stamp(edge_changes_, e->id(), false);
+
+    segment.begin = kv;
+    segment.end = cv;
+    segment.begin_timestamp = ros::Time(m->getKeyframe()->timestamp());
+    segment.end_timestamp = ros::Time(m->getCurrentFrame()->timestamp());
+    segment.begin_to_end = keyframe_to_current;
+
+    marginalized_segments_.push_back(segment);
+  }
+
+  /**
+   * The frames of a segment keep their pose relative to its first keyframe, the part of the correction, which moved
+   * the end keyframe relative to the first one since the marginalization, is distributed over them by their timestamp.
+   */
+  void trajectory(KeyframeGraph::PoseMap& poses) const
+  {
+    for(g2o::OptimizableGraph::VertexIDMap::const_iterator it = keyframegraph_.vertices().begin(); it != keyframegraph_.vertices().end(); ++it)
+    {
+      g2o::VertexSE3 *v = (g2o::VertexSE3 *) it->second;
+
+      const VertexTable::Entry* t = vertex_table_.find(v->id());
+
+      assert(t != 0);
+
+      poses[t->timestamp] = v->estimate();
+    }
+
+    for(MarginalizedSegmentVector::const_iterator it = marginalized_segments_.begin(); it != marginalized_segments_.end(); ++it)
+    {
+      const Eigen::Isometry3d& begin = it->begin->estimate();
+      Eigen::Isometry3d correction = (begin * it->begin_to_end).inverse() * it->end->estimate();
+
+      double duration = (it->end_timestamp - it->begin_timestamp).toSec();
+
+      for(LocalMap::FramePoseVector::const_iterator f = it->frames.begin(); f != it->frames.end(); ++f)
+      {
+        double s = duration > 0.0 ? std::max(0.0, std::min(1.0, (f->first - it->begin_timestamp).toSec() / duration)) : 1.0;
+
+        poses[f->first] = begin * f->second * interpolate(correction, s);
+      }
+    }
+  }
+
+  SensorChain& chain(int sensor)
+  {
+    assert(sensor >= 0);
+
+    if(size_t(sensor) >= chains_.size()) chains_.resize(sensor + 1);
+
+    return chains_[sensor];
+  }
+
+  void resetChains()
+  {
+    SensorChainVector chains(std::max(size_t(1), chains_.size()));
+
+    // the calibration outlives the map
+    for(size_t idx = 0; idx < chains_.size(); ++idx)
+    {
+      chains[idx].has_extrinsics = chains_[idx].has_extrinsics;
+      chains[idx].rig_to_sensor = chains_[idx].rig_to_sensor;
+    }
+
+    chains_.swap(chains);
+  }
+
+  void setSensorExtrinsics(int sensor, const Eigen::Isometry3d& rig_to_sensor)
+  {
+    tbb::mutex::scoped_lock l(new_keyframe_sync_);
+
+    SensorChain& c = chain(sensor);
+    c.has_extrinsics = true;
+    c.rig_to_sensor = rig_to_sensor;
+  }
+
+  /**
+   * Connects the keyframe to the keyframes of the other sensors of the rig, which were taken at about the same time,
+   * with the relative pose of the sensors. Returns false if there is none.
+   */
+  bool insertRigConstraints(const KeyframePtr& keyframe)
+  {
+    const SensorChain& c = chains_[keyframe->sensor()];
+
+    if(!c.has_extrinsics) return false;
+
+    bool inserted = false;
+
+    // the keyframes of one rig keyframe are inserted close to each other
+    for(KeyframeVector::reverse_iterator it = keyframes_.rbegin(); it != keyframes_.rend() && it - keyframes_.rbegin() < ptrdiff_t(4 * chains_.size()); ++it)
+    {
+      const KeyframePtr& other = *it;
+
+      if(other == keyframe || other->sensor() == keyframe->sensor() || !chains_[other->sensor()].has_extrinsics) continue;
+      if(std::abs((other->timestamp() - keyframe->timestamp()).toSec()) > cfg_.MaxRigTimeOffset) continue;
+
+      int edge_id = next_keyframe_edge_id_++;
+
+      g2o::EdgeSE3* e = new g2o::EdgeSE3();
+      e->setId(edge_id);
+      e->resize(2);
+      e->setVertex(0, keyframegraph_.vertex(other->id()));
+      e->setVertex(1, keyframegraph_.vertex(keyframe->id()));
+      e->setMeasurement(chains_[other->sensor()].rig_to_sensor.inverse() * c.rig_to_sensor);
+      e->setInformation(g2o::EdgeSE3::InformationType::Identity() * RigInformation);
+      keyframegraph_.addEdge(e);
+      indexEdge(e);
+      stamp(edge_changes_, edge_id, false);
+
+      inserted = true;
     }
+
+    return inserted;
   }
 
   KeyframePtr insertNewKeyframe(const LocalMap::Ptr& m)
   {
+    SensorChain& c = chain(m->getSensor());
+
     // update keyframe pose, because its probably different from the one, which was used during local map initialization
-    if(!keyframes_.empty())
+    if(c.last_keyframe_id != 0)
     {
-      g2o::VertexSE3* last_kv = (g2o::VertexSE3*) keyframegraph_.vertex(next_keyframe_id_ - 1);
-      g2o::OptimizableGraph::EdgeSet::iterator e = std::find_if(last_kv->edges().begin(), last_kv->edges().end(), FindEdge(next_keyframe_id_ - 1, next_odometry_vertex_id_));
+      g2o::VertexSE3* last_kv = (g2o::VertexSE3*) keyframegraph_.vertex(c.last_keyframe_id);
+      g2o::OptimizableGraph::EdgeSet::iterator e = std::find_if(last_kv->edges().begin(), last_kv->edges().end(), FindEdge(c.last_keyframe_id, c.tail_vertex_id));
 
       assert(e != last_kv->edges().end());
 
@@ -683,59 +3000,125 @@ private:
 
     int max_id = g.vertices().size();
 
-    g2o::OptimizableGraph::VertexIDMap vertices = g.vertices();
-    for(g2o::OptimizableGraph::VertexIDMap::iterator v_it = vertices.begin(); v_it != vertices.end(); ++v_it)
-    {
-      g.changeId(v_it->second, next_odometry_vertex_id_ - (v_it->second->id() - 1));
-    }
+    // the keyframe vertex continues the chain, the other vertices of the local map get the next free ids
+    int keyframe_vertex_id = c.tail_vertex_id != 0 ? c.tail_vertex_id : next_odometry_vertex_id_--;
+    int first_vertex_id = next_odometry_vertex_id_;
+    int current_vertex_id = first_vertex_id - (max_id - 2);
 
-    for(g2o::OptimizableGraph::EdgeSet::iterator e_it = g.edges().begin(); e_it != g.edges().end(); ++e_it)
+    next_odometry_vertex_id_ -= max_id - 1;
+
+    if(cfg_.MarginalizeOdometry)
     {
-      g2o::EdgeSE3* e = (g2o::EdgeSE3*) (*e_it);
-      e->setId(next_odometry_edge_id_--);
-      e->setLevel(2);
+      addMarginalizedGraph(m, keyframe_vertex_id, current_vertex_id);
     }
+    else
+    {
+      std::map<int, ros::Time> timestamps;
 
-    addGraph(&g);
+      g2o::OptimizableGraph::VertexIDMap vertices = g.vertices();
+      for(g2o::OptimizableGraph::VertexIDMap::iterator v_it = vertices.begin(); v_it != vertices.end(); ++v_it)
+      {
+        int id = v_it->second->id();
+        int new_id = id == 1 ? keyframe_vertex_id : first_vertex_id - (id - 2);
 
-    // get last odometry vertex from global graph, which will become new keyframe vertex
-    g2o::VertexSE3* kv = (g2o::VertexSE3*) keyframegraph_.vertex(next_odometry_vertex_id_);
-    assert(kv != 0);
-    assert(keyframegraph_.changeId(kv, next_keyframe_id_));
+        timestamps[new_id] = m->getVertexTimestamp(id);
+        g.changeId(v_it->second, new_id);
+      }
 
-    if(!keyframes_.empty())
-    {
-      g2o::VertexSE3* kv = (g2o::VertexSE3*) keyframegraph_.vertex(next_keyframe_id_);
+      for(g2o::OptimizableGraph::EdgeSet::iterator e_it = g.edges().begin(); e_it != g.edges().end(); ++e_it)
+      {
+        g2o::EdgeSE3* e = (g2o::EdgeSE3*) (*e_it);
+        e->setId(next_odometry_edge_id_--);
+        e->setLevel(2);
+      }
+
+      addGraph(&g, timestamps);
+    }
 
+    // the odometry vertex at the end of the chain becomes the new keyframe vertex
+    g2o::VertexSE3* kv = (g2o::VertexSE3*) keyframegraph_.vertex(keyframe_vertex_id);
+    assert(kv != 0);
+    stamp(vertex_changes_, kv->id(), true);
+    vertex_table_.changeId(kv->id(), next_keyframe_id_);
+    bool changed = keyframegraph_.changeId(kv, next_keyframe_id_);
+    assert(changed);
+    (void)changed;
+    stamp(vertex_changes_, next_keyframe_id_, false);
+
+    if(c.last_keyframe_id != 0)
+    {
       // find the odometry edge, which connects the old keyframe vertex with the new keyframe vertex
-      g2o::OptimizableGraph::EdgeSet::iterator ke = std::find_if(kv->edges().begin(), kv->edges().end(), FindEdge(next_keyframe_id_ - 1, next_keyframe_id_));
+      g2o::OptimizableGraph::EdgeSet::iterator ke = std::find_if(kv->edges().begin(), kv->edges().end(), FindEdge(c.last_keyframe_id, next_keyframe_id_));
 
       assert(ke != kv->edges().end());
 
       // promote odometry edge to keyframe edge
       g2o::OptimizableGraph::Edge* e = (g2o::OptimizableGraph::Edge*) (*ke);
-      e->setId(combine(next_keyframe_id_ - 1, next_keyframe_id_));
+      stamp(edge_changes_, e->id(), true);
+      e->setId(next_keyframe_edge_id_++);
+      stamp(edge_changes_, e->id(), false);
       e->setLevel(0);
-    }
-    else
-    {
-      kv->setFixed(true);
+      indexEdge(e);
     }
 
     // create keyframe
     KeyframePtr keyframe(new Keyframe());
     keyframe->
       id(next_keyframe_id_)
+      .sensor(m->getSensor())
       .image(m->getKeyframe())
       .pose(toAffine(kv->estimate()))
       .evaluation(m->getEvaluation());
+    keyframe->initializePoints(constraint_tracker_cfg_.IntensityDerivativeThreshold, constraint_tracker_cfg_.DepthDerivativeThreshold, constraint_tracker_cfg_.MaxPointsPerLevel, constraint_tracker_cfg_.UseMortonOrder);
 
     kv->setUserData(new dvo_slam::Timestamped(keyframe->timestamp()));
+    vertex_table_.insert(kv->id(), keyframe->timestamp());
 
     keyframes_.push_back(keyframe);
+    keyframe_index_.insert(keyframe);
+    appearance_index_.insert(keyframe);
+    keyframe_store_.add(keyframe);
+    assignSubmap(keyframe);
+
+    // while all levels are resident, the later trim() of a batch may evict them
+    shared_store_.add(keyframe);
+
+    // the first keyframe of the first chain fixes the map, the first keyframes of the other chains are tied to it by
+    // the rig, without a rig they stay where their tracker started
+    if(!insertRigConstraints(keyframe) && c.last_keyframe_id == 0)
+    {
+      kv->setFixed(true);
+    }
+
+    // everything needed from the local map was copied into our graph, and the levels finer than the validation
+    // trackers use are only needed for the visualization, so their derived buffers are rebuilt if it asks for them
+    m->compact();
+
+    for(int level = 0; level < std::min(validation_tracker_cfg_.LastLevel, constraint_tracker_cfg_.LastLevel); ++level)
+    {
+      keyframe->image()->level(level).releaseDerived();
+    }
+
+    // the trackers of the graph interpolate the keyframe from the half precision acceleration structure, the float one
+    // is only needed once more to select its points
+    if(validation_tracker_cfg_.UseCompactStorage)
+    {
+      const int last_level = std::max(validation_tracker_cfg_.FirstLevel, constraint_tracker_cfg_.FirstLevel);
+
+      for(int level = std::min(validation_tracker_cfg_.LastLevel, constraint_tracker_cfg_.LastLevel); level <= last_level; ++level)
+      {
+        dvo::core::RgbdImage& img = keyframe->image()->level(level);
+
+        dvo::core::PointSelection::PointIterator first_point, last_point;
+        keyframe->points().select(level, img.camera().intrinsics(), first_point, last_point);
+
+        img.compactAccelerationStructure();
+      }
+    }
+
+    c.last_keyframe_id = next_keyframe_id_;
+    c.tail_vertex_id = current_vertex_id;
 
-    // increment ids
-    next_odometry_vertex_id_ -= max_id - 1;
     next_keyframe_id_ += 1;
 
     return keyframe;
@@ -751,6 +3134,13 @@ private:
     constraint_tracker_cfg_.Mu = cfg.Mu;
     constraint_tracker_cfg_.IntensityDerivativeThreshold = cfg.IntensityDerivativeThreshold;
     constraint_tracker_cfg_.DepthDerivativeThreshold = cfg.DepthDerivativeThreshold;
+    constraint_tracker_cfg_.MaxPointsPerLevel = cfg.MaxPointsPerLevel;
+    constraint_tracker_cfg_.UseMortonOrder = cfg.UseMortonOrder;
+    constraint_tracker_cfg_.UseFullStatistics = false;
+    constraint_tracker_cfg_.UseCompactStorage = cfg.UseCompactStorage;
+    // a pooled tracker matches unrelated pairs one after the other, so a level or scale history would mix them
+    constraint_tracker_cfg_.UseAdaptiveLevels = false;
+    constraint_tracker_cfg_.UseWarmStartedScale = false;
 
     validation_tracker_cfg_ = dvo::DenseTracker::getDefaultConfig();
     validation_tracker_cfg_.FirstLevel = 3;
@@ -760,6 +3150,28 @@ private:
     validation_tracker_cfg_.Mu = cfg.Mu;
     validation_tracker_cfg_.IntensityDerivativeThreshold = cfg.IntensityDerivativeThreshold;
     validation_tracker_cfg_.DepthDerivativeThreshold = cfg.DepthDerivativeThreshold;
+    validation_tracker_cfg_.MaxPointsPerLevel = cfg.MaxPointsPerLevel;
+    validation_tracker_cfg_.UseMortonOrder = cfg.UseMortonOrder;
+    validation_tracker_cfg_.UseFullStatistics = false;
+    validation_tracker_cfg_.UseCompactStorage = cfg.UseCompactStorage;
+    validation_tracker_cfg_.UseAdaptiveLevels = false;
+    validation_tracker_cfg_.UseWarmStartedScale = false;
+
+    constraint_coarse_tracker_cfg_ = constraint_tracker_cfg_;
+    constraint_coarse_tracker_cfg_.LastLevel = constraint_tracker_cfg_.FirstLevel;
+
+    constraint_fine_tracker_cfg_ = constraint_tracker_cfg_;
+    constraint_fine_tracker_cfg_.FirstLevel = constraint_tracker_cfg_.FirstLevel - 1;
+
+    constraint_ranking_.level(validation_tracker_cfg_.FirstLevel);
+    appearance_index_.level(validation_tracker_cfg_.FirstLevel);
+
+    // the validation trackers pick the new configs up on their next use
+    validation_tracker_generation_++;
+    reset_validation_outcomes_ = true;
+
+    keyframe_store_.keptLevel(validation_tracker_cfg_.FirstLevel);
+    keyframe_store_.numLevels(std::max(validation_tracker_cfg_.getNumLevels(), constraint_tracker_cfg_.getNumLevels()));
   }
 
   g2o::RobustKernel* createRobustKernel()
@@ -778,21 +3190,89 @@ private:
   }
 
   KeyframePtr active_;
-  tbb::concurrent_bounded_queue<LocalMap::Ptr> new_keyframes_;
-  bool optimization_thread_shutdown_;
+  LocalMapQueue new_keyframes_;
+
+  // background refinement state, owned by the optimization thread except for the flag set by add(). g2o polls a plain
+  // bool to stop between iterations, which only the optimization thread writes, see PreemptionAction
+  size_t refinement_cursor_, refinement_constraints_;
+  tbb::atomic<bool> refinement_preempted_;
+  bool refinement_stop_;
+  internal::PreemptionAction refinement_preemption_;
+
   tbb::tbb_thread optimization_thread_;
-  tbb::mutex new_keyframe_sync_, queue_empty_sync_;
+  tbb::mutex new_keyframe_sync_;
   KeyframeConstraintSearchInterfacePtr constraint_search_;
+  boost::shared_ptr<AppearanceConstraintSearch> appearance_search_;
+  KeyframeConstraintRanking constraint_ranking_;
+  KeyframeStore keyframe_store_;
+
+  // export of the keyframes to other processes, written by commitChanges()
+  SharedKeyframeStore shared_store_;
+
+  // volumetric map of the keyframes, updated by commitChanges(). pending if moved keyframes are left for later updates
+  TsdfMap tsdf_map_;
+  tbb::atomic<bool> tsdf_pending_;
+
+  // keyframes outside of the optimization window, which were fixed by initializeOptimization(true)
+  std::vector<g2o::OptimizableGraph::Vertex*> window_anchors_;
   KeyframeVector keyframes_;
-  short next_keyframe_id_;
+  KeyframeSpatialIndex keyframe_index_;
+  KeyframeAppearanceIndex appearance_index_;
+
+  // timestamps, keyframes and segments of the graph vertices, the vertices keep their Timestamped user data for other
+  // users of graph()
+  VertexTable vertex_table_;
+
+  // consecutive ranges of keyframes_, see KeyframeGraphConfig::SubmapRadius
+  struct Submap
+  {
+    // index in keyframes_ and id of the first keyframe
+    size_t first;
+    int anchor;
+  };
+
+  std::vector<Submap> submaps_;
+
+  // a constraint of the current batch reaches beyond the previous submap
+  bool spanning_closure_;
+
+  // odometry frames replaced by addMarginalizedGraph, which have to be recovered for the trajectory
+  MarginalizedSegmentVector marginalized_segments_;
+  int next_keyframe_id_;
+
+  // next free odometry vertex id, counting down
   int next_odometry_vertex_id_, next_odometry_edge_id_;
 
+  // odometry edges count down from -1, keyframe edges up from 1
+  int next_keyframe_edge_id_;
+
+  // keyframe to keyframe edges by edgeKey() of their vertices, replaces scanning the edges of a vertex
+  typedef boost::unordered_map<uint64_t, g2o::HyperGraph::Edge*> EdgeIndex;
+  EdgeIndex keyframe_edges_;
+  SensorChainVector chains_;
+
+  // revision of the last change of every vertex and edge id and the log of the changes per revision, so changes()
+  // only visits the ones since the requested revision, guarded by changes_mutex_
+  tbb::spin_mutex changes_mutex_;
+  ChangeStampMap vertex_changes_, edge_changes_;
+  ChangeLog change_log_;
+  size_t revision_, full_revision_;
+
   g2o::SparseOptimizer keyframegraph_;
   dvo::DenseTracker::Config validation_tracker_cfg_, constraint_tracker_cfg_;
 
+  // constraint_tracker_cfg_ split into its first level and the remaining ones for the early rejection
+  dvo::DenseTracker::Config constraint_coarse_tracker_cfg_, constraint_fine_tracker_cfg_;
+
   dvo_slam::KeyframeGraphConfig cfg_;
 
-  DenseTrackerPool validation_tracker_pool_;
+  size_t validation_tracker_generation_;
+
+  // outcomes of earlier validations, dropped by the next validation once reset_validation_outcomes_ is set, which
+  // happens whenever the validation is configured
+  ValidationOutcomeMap validation_outcomes_;
+  tbb::atomic<bool> reset_validation_outcomes_;
+  ValidationTrackerPool validation_tracker_pool_;
 
   KeyframeGraph* me_;
 
@@ -826,6 +3306,11 @@ void KeyframeGraph::configureValidationTracking(const dvo::DenseTracker::Config&
   impl_->configureValidationTracking(cfg);
 }
 
+void KeyframeGraph::setSensorExtrinsics(int sensor, const Eigen::Isometry3d& rig_to_sensor)
+{
+  impl_->setSensorExtrinsics(sensor, rig_to_sensor);
+}
+
 void KeyframeGraph::add(const LocalMap::Ptr& keyframe)
 {
   impl_->add(keyframe);
@@ -837,6 +3322,16 @@ void KeyframeGraph::finalOptimization()
 }
 
 
+size_t KeyframeGraph::queueDepth() const
+{
+  return impl_->new_keyframes_.depth();
+}
+
+double KeyframeGraph::queueAge() const
+{
+  return impl_->new_keyframes_.age();
+}
+
 void KeyframeGraph::addMapChangedCallback(const KeyframeGraph::MapChangedCallback& callback)
 {
   impl_->map_changed_.connect(callback);
@@ -847,9 +3342,59 @@ const g2o::SparseOptimizer& KeyframeGraph::graph() const
   return impl_->keyframegraph_;
 }
 
+const VertexTable& KeyframeGraph::vertexTable() const
+{
+  return impl_->vertex_table_;
+}
+
 const KeyframeVector& KeyframeGraph::keyframes() const
 {
   return impl_->keyframes_;
 }
 
+const TsdfMap& KeyframeGraph::tsdfMap() const
+{
+  return impl_->tsdf_map_;
+}
+
+void KeyframeGraph::trajectory(PoseMap& poses) const
+{
+  impl_->trajectory(poses);
+}
+
+size_t KeyframeGraph::revision() const
+{
+  return impl_->revision();
+}
+
+void KeyframeGraph::changes(size_t since, MapChangeSet& changes) const
+{
+  impl_->changes(since, changes);
+}
+
+bool KeyframeGraph::snapshot(MapSnapshot& snapshot, bool wait) const
+{
+  return impl_->snapshot(snapshot, wait);
+}
+
+bool KeyframeGraph::memoryUsage(MemoryUsage& usage, bool wait) const
+{
+  return impl_->memoryUsage(usage, wait);
+}
+
+bool KeyframeGraph::restore(const MapSnapshot& snapshot, dvo::core::RgbdCameraPyramid& camera)
+{
+  return impl_->restore(snapshot, camera);
+}
+
+size_t KeyframeGraph::merge(const MapSnapshot& snapshot, dvo::core::RgbdCameraPyramid& camera, const Eigen::Isometry3d& initial_alignment)
+{
+  return impl_->merge(snapshot, camera, initial_alignment);
+}
+
+bool KeyframeGraph::relocalize(const dvo::core::RgbdImagePyramid::Ptr& image, const Eigen::Affine3d& hint, double radius, size_t max_candidates, Eigen::Affine3d& pose, dvo::core::Matrix6d& information)
+{
+  return impl_->relocalize(image, hint, radius, max_candidates, pose, information);
+}
+
 } /* namespace dvo_slam */
@@ -0,0 +1,174 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo_slam/keyframe_spatial_index.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace dvo_slam
+{
+
+KeyframeSpatialIndex::KeyframeSpatialIndex(double cell_size) :
+    cell_size_(cell_size > 0.0 ? cell_size : 1.0)
+{
+}
+
+KeyframeSpatialIndex::~KeyframeSpatialIndex()
+{
+}
+
+double KeyframeSpatialIndex::cellSize() const
+{
+  return cell_size_;
+}
+
+void KeyframeSpatialIndex::cellSize(double size)
+{
+  if(size <= 0.0 || size == cell_size_) return;
+
+  cell_size_ = size;
+  cells_.clear();
+
+  for(size_t idx = 0; idx < entries_.size(); ++idx)
+  {
+    entries_[idx].cell = cellKey(entries_[idx].position);
+    cells_[entries_[idx].cell].push_back(idx);
+  }
+}
+
+void KeyframeSpatialIndex::insert(const KeyframePtr& keyframe)
+{
+  Entry e;
+  e.keyframe = keyframe;
+  e.position = keyframe->pose().translation();
+  e.cell = cellKey(e.position);
+
+  if(entries_.empty() || keyframe->timestamp() < oldest_timestamp_) oldest_timestamp_ = keyframe->timestamp();
+
+  cells_[e.cell].push_back(entries_.size());
+  entries_.push_back(e);
+}
+
+void KeyframeSpatialIndex::update(size_t first)
+{
+  for(size_t idx = first; idx < entries_.size(); ++idx)
+  {
+    Entry& e = entries_[idx];
+
+    e.position = e.keyframe->pose().translation();
+
+    CellKey cell = cellKey(e.position);
+
+    // most keyframes only move a little and stay in their cell
+    if(cell == e.cell) continue;
+
+    removeFromCell(e.cell, idx);
+    cells_[cell].push_back(idx);
+    e.cell = cell;
+  }
+}
+
+void KeyframeSpatialIndex::clear()
+{
+  entries_.clear();
+  cells_.clear();
+}
+
+size_t KeyframeSpatialIndex::size() const
+{
+  return entries_.size();
+}
+
+ros::Time KeyframeSpatialIndex::oldestTimestamp() const
+{
+  return oldest_timestamp_;
+}
+
+void KeyframeSpatialIndex::radiusSearch(const Eigen::Vector3d& position, double radius, KeyframeVector& result) const
+{
+  if(entries_.empty() || radius < 0.0) return;
+
+  int x0, y0, z0, x1, y1, z1;
+  cellCoordinates(position - Eigen::Vector3d::Constant(radius), x0, y0, z0);
+  cellCoordinates(position + Eigen::Vector3d::Constant(radius), x1, y1, z1);
+
+  const double radius_sqr = radius * radius;
+  std::vector<size_t> found;
+
+  for(int z = z0; z <= z1; ++z)
+    for(int y = y0; y <= y1; ++y)
+      for(int x = x0; x <= x1; ++x)
+      {
+        CellMap::const_iterator cell = cells_.find(cellKey(x, y, z));
+
+        if(cell == cells_.end()) continue;
+
+        for(std::vector<size_t>::const_iterator it = cell->second.begin(); it != cell->second.end(); ++it)
+        {
+          if((entries_[*it].position - position).squaredNorm() <= radius_sqr) found.push_back(*it);
+        }
+      }
+
+  // same order as the keyframes were added, independent of the hashing
+  std::sort(found.begin(), found.end());
+
+  for(std::vector<size_t>::const_iterator it = found.begin(); it != found.end(); ++it)
+  {
+    result.push_back(entries_[*it].keyframe);
+  }
+}
+
+void KeyframeSpatialIndex::cellCoordinates(const Eigen::Vector3d& p, int& x, int& y, int& z) const
+{
+  x = int(std::floor(p(0) / cell_size_));
+  y = int(std::floor(p(1) / cell_size_));
+  z = int(std::floor(p(2) / cell_size_));
+}
+
+KeyframeSpatialIndex::CellKey KeyframeSpatialIndex::cellKey(int x, int y, int z) const
+{
+  // 21 bits per coordinate
+  static const CellKey Mask = (CellKey(1) << 21) - 1;
+
+  return ((CellKey(x) & Mask) << 42) | ((CellKey(y) & Mask) << 21) | (CellKey(z) & Mask);
+}
+
+KeyframeSpatialIndex::CellKey KeyframeSpatialIndex::cellKey(const Eigen::Vector3d& p) const
+{
+  int x, y, z;
+  cellCoordinates(p, x, y, z);
+
+  return cellKey(x, y, z);
+}
+
+void KeyframeSpatialIndex::removeFromCell(CellKey cell, size_t entry)
+{
+  CellMap::iterator it = cells_.find(cell);
+
+  if(it == cells_.end()) return;
+
+  std::vector<size_t>& entries = it->second;
+  entries.erase(std::remove(entries.begin(), entries.end(), entry), entries.end());
+
+  if(entries.empty()) cells_.erase(it);
+}
+
+} /* namespace dvo_slam */
@@ -0,0 +1,339 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo_slam/keyframe_store.h>
+
+#include <dvo/util/instrumentation.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <ros/console.h>
+
+namespace dvo_slam
+{
+
+// fixed point scales of the compressed base images
+static const float IntensityScale = 256.0f;
+static const float DepthScale = 5000.0f;
+
+KeyframeStore::KeyframeStore() :
+    max_resident_(0),
+    kept_level_(3),
+    num_levels_(4),
+    resident_(0),
+    clock_(0),
+    newest_(-1)
+{
+}
+
+KeyframeStore::~KeyframeStore()
+{
+  clear();
+}
+
+void KeyframeStore::maxResident(size_t n)
+{
+  max_resident_ = n;
+}
+
+void KeyframeStore::keptLevel(size_t level)
+{
+  kept_level_ = level;
+}
+
+void KeyframeStore::numLevels(size_t levels)
+{
+  num_levels_ = levels;
+}
+
+void KeyframeStore::cacheFolder(const std::string& folder)
+{
+  folder_ = folder;
+}
+
+void KeyframeStore::add(const KeyframePtr& keyframe)
+{
+  Entry& e = entries_[keyframe->id()];
+  e.keyframe = keyframe;
+  e.resident = true;
+  e.last_use = ++clock_;
+  e.has_spill = false;
+
+  resident_++;
+  newest_ = keyframe->id();
+}
+
+bool KeyframeStore::acquire(const KeyframePtr& keyframe)
+{
+  EntryMap::iterator it = entries_.find(keyframe->id());
+
+  if(it == entries_.end()) return true;
+
+  if(!it->second.resident && !restore(it->second)) return false;
+
+  it->second.last_use = ++clock_;
+
+  return true;
+}
+
+void KeyframeStore::acquire(KeyframeVector& keyframes)
+{
+  for(KeyframeVector::iterator it = keyframes.begin(); it != keyframes.end();)
+  {
+    if(acquire(*it))
+      ++it;
+    else
+      it = keyframes.erase(it);
+  }
+}
+
+void KeyframeStore::trim()
+{
+  if(!overBudget()) return;
+
+  std::vector<std::pair<size_t, int> > candidates;
+
+  for(EntryMap::const_iterator it = entries_.begin(); it != entries_.end(); ++it)
+  {
+    if(it->second.resident && it->first != newest_) candidates.push_back(std::make_pair(it->second.last_use, it->first));
+  }
+
+  std::sort(candidates.begin(), candidates.end());
+
+  for(std::vector<std::pair<size_t, int> >::const_iterator it = candidates.begin(); it != candidates.end() && overBudget(); ++it)
+  {
+    evict(entries_[it->second]);
+  }
+}
+
+void KeyframeStore::release(const KeyframePtr& keyframe)
+{
+  EntryMap::iterator it = entries_.find(keyframe->id());
+
+  if(max_resident_ == 0 || it == entries_.end() || !it->second.resident || it->first == newest_) return;
+
+  evict(it->second);
+}
+
+size_t KeyframeStore::residentCount() const
+{
+  return resident_;
+}
+
+bool KeyframeStore::overBudget() const
+{
+  return max_resident_ > 0 && resident_ > max_resident_;
+}
+
+void KeyframeStore::clear()
+{
+  for(EntryMap::iterator it = entries_.begin(); it != entries_.end(); ++it)
+  {
+    if(!it->second.intensity_file.empty()) std::remove(it->second.intensity_file.c_str());
+    if(!it->second.depth_file.empty()) std::remove(it->second.depth_file.c_str());
+  }
+
+  entries_.clear();
+  resident_ = 0;
+  newest_ = -1;
+}
+
+bool KeyframeStore::compressed(int id, cv::Mat& intensity, cv::Mat& depth) const
+{
+  EntryMap::const_iterator it = entries_.find(id);
+
+  if(it == entries_.end() || it->second.resident || !it->second.has_spill) return false;
+
+  if(!load(it->second, intensity, depth)) return false;
+
+  // load() shares the buffers of the entry
+  intensity = intensity.clone();
+  depth = depth.clone();
+
+  return true;
+}
+
+bool KeyframeStore::usage(int id, bool& resident, size_t& compressed_bytes) const
+{
+  EntryMap::const_iterator it = entries_.find(id);
+
+  if(it == entries_.end()) return false;
+
+  resident = it->second.resident;
+  compressed_bytes = it->second.intensity.capacity() + it->second.depth.capacity();
+
+  return true;
+}
+
+bool KeyframeStore::encode(const cv::Mat& intensity_float, const cv::Mat& depth_float, std::vector<unsigned char>& intensity, std::vector<unsigned char>& depth)
+{
+  if(intensity_float.empty() || depth_float.empty()) return false;
+
+  cv::Mat intensity_fixed, depth_fixed;
+  intensity_float.convertTo(intensity_fixed, CV_16UC1, IntensityScale);
+  // NaN becomes 0
+  depth_float.convertTo(depth_fixed, CV_16UC1, DepthScale);
+
+  std::vector<int> params;
+  params.push_back(CV_IMWRITE_PNG_COMPRESSION);
+  params.push_back(1);
+
+  return cv::imencode(".png", intensity_fixed, intensity, params) && cv::imencode(".png", depth_fixed, depth, params);
+}
+
+bool KeyframeStore::decode(const cv::Mat& intensity, const cv::Mat& depth, cv::Mat& intensity_float, cv::Mat& depth_float)
+{
+  cv::Mat intensity_fixed = cv::imdecode(intensity, CV_LOAD_IMAGE_UNCHANGED);
+  cv::Mat depth_fixed = cv::imdecode(depth, CV_LOAD_IMAGE_UNCHANGED);
+
+  if(intensity_fixed.empty() || depth_fixed.empty() || intensity_fixed.size() != depth_fixed.size()) return false;
+
+  intensity_fixed.convertTo(intensity_float, cv::DataType<dvo::core::IntensityType>::type, 1.0 / IntensityScale);
+  depth_fixed.convertTo(depth_float, cv::DataType<dvo::core::DepthType>::type, 1.0 / DepthScale);
+  depth_float.setTo(dvo::core::InvalidDepth, depth_fixed == 0);
+
+  return true;
+}
+
+bool KeyframeStore::load(const Entry& e, cv::Mat& intensity, cv::Mat& depth) const
+{
+  if(folder_.empty())
+  {
+    if(e.intensity.empty() || e.depth.empty()) return false;
+
+    intensity = cv::Mat(1, e.intensity.size(), CV_8UC1, const_cast<unsigned char*>(&e.intensity[0]));
+    depth = cv::Mat(1, e.depth.size(), CV_8UC1, const_cast<unsigned char*>(&e.depth[0]));
+
+    return true;
+  }
+
+  return readFile(e.intensity_file, intensity) && readFile(e.depth_file, depth);
+}
+
+bool KeyframeStore::writeFile(const std::string& file, const std::vector<unsigned char>& data)
+{
+  std::ofstream out(file.c_str(), std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&data[0]), data.size());
+
+  return out.good();
+}
+
+bool KeyframeStore::readFile(const std::string& file, cv::Mat& data)
+{
+  std::ifstream in(file.c_str(), std::ios::binary | std::ios::ate);
+
+  if(!in.good()) return false;
+
+  std::streamsize size = in.tellg();
+
+  if(size <= 0) return false;
+
+  data.create(1, size, CV_8UC1);
+  in.seekg(0);
+  in.read(data.ptr<char>(), size);
+
+  return in.good();
+}
+
+void KeyframeStore::evict(Entry& e)
+{
+  static dvo::util::Timer& evict_timer = dvo::util::Instrumentation::instance().timer("keyframe_store/evict");
+  dvo::util::ScopedTimer evict_scope(evict_timer);
+
+  // the base images don't change, so they only have to be compressed once
+  if(!e.has_spill && !spill(e)) return;
+
+  e.keyframe->clearPoints();
+  e.keyframe->image()->release(kept_level_);
+  e.resident = false;
+
+  resident_--;
+}
+
+bool KeyframeStore::spill(Entry& e)
+{
+  const dvo::core::RgbdImage& base = e.keyframe->image()->level(0);
+
+  if(!base.hasIntensity() || !base.hasDepth()) return false;
+
+  if(folder_.empty())
+  {
+    if(!encode(base.intensity, base.depth, e.intensity, e.depth)) return false;
+  }
+  else
+  {
+    std::vector<unsigned char> intensity, depth;
+
+    if(!encode(base.intensity, base.depth, intensity, depth)) return false;
+
+    std::stringstream prefix;
+    prefix << folder_ << "/keyframe_" << e.keyframe->id();
+
+    e.intensity_file = prefix.str() + "_intensity.png";
+    e.depth_file = prefix.str() + "_depth.png";
+
+    if(!writeFile(e.intensity_file, intensity) || !writeFile(e.depth_file, depth))
+    {
+      ROS_ERROR_STREAM("failed to write keyframe cache " << prefix.str() << ", keeping keyframe in memory");
+      e.intensity_file.clear();
+      e.depth_file.clear();
+      return false;
+    }
+  }
+
+  e.has_spill = true;
+
+  return true;
+}
+
+bool KeyframeStore::restore(Entry& e)
+{
+  static dvo::util::Timer& restore_timer = dvo::util::Instrumentation::instance().timer("keyframe_store/restore");
+  dvo::util::ScopedTimer restore_scope(restore_timer);
+
+  cv::Mat intensity, depth, intensity_float, depth_float;
+
+  if(!load(e, intensity, depth) || !decode(intensity, depth, intensity_float, depth_float))
+  {
+    ROS_ERROR_STREAM("failed to restore keyframe " << e.keyframe->id());
+    return false;
+  }
+
+  dvo::core::RgbdImagePyramid& pyramid = *e.keyframe->image();
+  double timestamp = pyramid.level(0).timestamp;
+
+  pyramid.reset(intensity_float, depth_float);
+  pyramid.level(0).timestamp = timestamp;
+  pyramid.build(num_levels_);
+
+  e.keyframe->clearPoints();
+  e.resident = true;
+
+  resident_++;
+
+  return true;
+}
+
+} /* namespace dvo_slam */
@@ -20,20 +20,23 @@
 
 #include <Eigen/Core>
 #include <Eigen/Geometry>
-#include <Eigen/Eigenvalues>
 
 #include <ros/ros.h>
-#include <std_msgs/Float64.h>
 
 #include <dvo_slam/keyframe_tracker.h>
 #include <dvo_slam/keyframe_graph.h>
 #include <dvo_slam/local_tracker.h>
+#include <dvo_slam/remote_backend.h>
 #include <dvo_slam/tracking_result_evaluation.h>
+#include <dvo_slam/tracking_diagnostics.h>
 #include <dvo_slam/serialization/map_serializer.h>
 
+#include <dvo/util/task_arenas.h>
+
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics.hpp>
 #include <boost/accumulators/statistics/rolling_mean.hpp>
+#include <boost/make_shared.hpp>
 
 
 namespace dvo_slam
@@ -41,41 +44,39 @@ namespace dvo_slam
 
 class KeyframeTracker::Impl
 {
-  ros::NodeHandle nh_;
-  ros::Publisher ll_keyframe_pub_, ll_odometry_pub_, cn_odometry_pub_, cn_keyframe_pub_, de_odometry_pub_, de_keyframe_pub_, md_pub_;
-
   dvo_slam::visualization::GraphVisualizer* visualizer_;
 public:
   friend class ::dvo_slam::KeyframeTracker;
 
-  Impl(dvo_slam::visualization::GraphVisualizer* visualizer) :
+  Impl(const boost::shared_ptr<KeyframeGraph>& graph, int sensor, dvo_slam::visualization::GraphVisualizer* visualizer) :
     visualizer_(visualizer),
-    graph_(),
+    graph_(graph),
+    sensor_(sensor),
     lt_()
   {
     if(visualizer_ != 0)
     {
-      graph_.addMapChangedCallback(boost::bind(&KeyframeTracker::Impl::onGlobalMapChangedUpdateVisualization, this, _1));
+      graph_->addMapChangedCallback(boost::bind(&KeyframeTracker::Impl::onGlobalMapChangedUpdateVisualization, this, _1));
     }
 
     lt_.addMapInitializedCallback(boost::bind(&KeyframeTracker::Impl::onMapInitialized, this, _1, _2, _3));
     lt_.addMapCompleteCallback(boost::bind(&KeyframeTracker::Impl::onMapComplete, this, _1, _2));
-    lt_.addAcceptCallback(boost::bind(&KeyframeTracker::Impl::onAcceptCriterionTrackingResultEvaluation, this, _1, _2, _3));
-    lt_.addAcceptCallback(boost::bind(&KeyframeTracker::Impl::onAcceptCriterionEstimateDivergence, this, _1, _2, _3));
-    //lt_.addAcceptCallback(boost::bind(&KeyframeTracker::Impl::onAcceptCriterionEntropyRatio, this, _1, _2, _3));
-    lt_.addAcceptCallback(boost::bind(&KeyframeTracker::Impl::onAcceptCriterionDistance, this, _1, _2, _3));
-    lt_.addAcceptCallback(boost::bind(&KeyframeTracker::Impl::onAcceptCriterionConstraintRatio, this, _1, _2, _3));
-    lt_.addAcceptCallback(boost::bind(&KeyframeTracker::Impl::onAcceptCriterionConditionNumber, this, _1, _2, _3));
-
-    ll_keyframe_pub_ = nh_.advertise<std_msgs::Float64>("/ll/keyframe", 1);
-    ll_odometry_pub_ = nh_.advertise<std_msgs::Float64>("/ll/odometry", 1);
-    cn_keyframe_pub_ = nh_.advertise<std_msgs::Float64>("/cn/keyframe", 1);
-    cn_odometry_pub_ = nh_.advertise<std_msgs::Float64>("/cn/odometry", 1);
-    de_keyframe_pub_ = nh_.advertise<std_msgs::Float64>("/de/keyframe", 1);
-    de_odometry_pub_ = nh_.advertise<std_msgs::Float64>("/de/odometry", 1);
-    md_pub_ = nh_.advertise<std_msgs::Float64>("/md", 1);
+    lt_.addFilterCallback("estimate_divergence", boost::bind(&KeyframeTracker::Impl::onFilterEstimateDivergence, this, _1, _2, _3));
+    lt_.addFilterCallback("diagnostics", boost::bind(&KeyframeTracker::Impl::onFilterDiagnostics, this, _1, _2, _3));
+    lt_.setRelocalizeCallback(boost::bind(&KeyframeTracker::Impl::onRelocalize, this, _1, _2, _3, _4, _5));
+
+    // cheapest first, the entropy ratio needs the determinant of the information matrix
+    lt_.addAcceptCallback("distance", boost::bind(&KeyframeTracker::Impl::onAcceptCriterionDistance, this, _1, _2, _3));
+    lt_.addAcceptCallback("constraint_ratio", boost::bind(&KeyframeTracker::Impl::onAcceptCriterionConstraintRatio, this, _1, _2, _3));
+    lt_.addAcceptCallback("entropy_ratio", boost::bind(&KeyframeTracker::Impl::onAcceptCriterionTrackingResultEvaluation, this, _1, _2, _3));
   }
 
+  // optional, see KeyframeTracker::diagnostics()
+  dvo_slam::TrackingDiagnostics::Ptr diagnostics_;
+
+  // optional, see KeyframeTracker::remoteBackend()
+  boost::shared_ptr<dvo_slam::RemoteBackendClient> remote_;
+
 
   dvo_slam::TrackingResultEvaluation::Ptr evaluation;
   dvo::core::AffineTransformd last_transform_to_keyframe_;
@@ -96,37 +97,46 @@ public:
   {
     dvo_slam::TrackingResultEvaluation::ConstPtr const_evaluation(evaluation);
     m->setEvaluation(const_evaluation);
-    graph_.add(m);
+    m->setSensor(sensor_);
+
+    if(remote_)
+      remote_->add(m);
+    else
+      graph_->add(m);
   }
 
-  bool onAcceptCriterionTrackingResultEvaluation(const LocalTracker& lt, const LocalTracker::TrackingResult& r_odometry, const LocalTracker::TrackingResult& r_keyframe)
+  bool onRelocalize(const LocalTracker& lt, const dvo::core::RgbdImagePyramid::Ptr& image, const dvo::core::AffineTransformd& last_pose, dvo::core::AffineTransformd& pose, dvo::core::Matrix6d& information)
   {
-    std_msgs::Float64 m1, m2, m3;
-    m1.data = -r_odometry.LogLikelihood;
-    m2.data = -r_keyframe.LogLikelihood;
-    m3.data = evaluation->ratioWithFirst(r_keyframe);
+    if(!cfg_.UseRelocalization) return false;
+
+    return graph_->relocalize(image, last_pose, cfg_.RelocalizationSearchRadius, cfg_.RelocalizationMaxCandidates, pose, information);
+  }
 
-    bool accept = m3.data > cfg_.MinEntropyRatio;
+  bool onAcceptCriterionTrackingResultEvaluation(const LocalTracker& lt, const LocalTracker::TrackingResult& r_odometry, const LocalTracker::TrackingResult& r_keyframe)
+  {
+    bool accept = evaluation->ratioWithFirst(r_keyframe) > cfg_.MinEntropyRatio;
 
     if(accept)
       evaluation->add(r_keyframe);
 
-    ll_odometry_pub_.publish(m1);
-    ll_keyframe_pub_.publish(m3);
-
     return accept;
   }
 
-  bool onAcceptCriterionEstimateDivergence(const LocalTracker& lt, const LocalTracker::TrackingResult& r_odometry, const LocalTracker::TrackingResult& r_keyframe)
+  // a filter, so it sees every frame
+  bool onFilterDiagnostics(const LocalTracker& lt, LocalTracker::TrackingResult& r_odometry, LocalTracker::TrackingResult& r_keyframe)
+  {
+    if(diagnostics_ && diagnostics_->active()) diagnostics_->add(r_odometry, r_keyframe, evaluation->ratioWithFirst(r_keyframe));
+
+    return true;
+  }
+
+  // replaces diverged estimates, the new local map is initialized with the odometry of a rejected frame
+  bool onFilterEstimateDivergence(const LocalTracker& lt, LocalTracker::TrackingResult& r_odometry, LocalTracker::TrackingResult& r_keyframe)
   {
     //std::cerr << "----->test "  << r_keyframe.Pose.translation().norm() << " " << r_odometry.Pose.translation().norm() << std::endl;
 
     //dvo::core::AffineTransformd diff = last_transform_to_keyframe_.inverse() * r_keyframe.Pose;
 
-    std_msgs::Float64 md;
-    //md.data = diff.translation().norm();
-    //md_pub_.publish(md);
-
     bool reject1 = r_odometry.Transformation.translation().norm() > 0.1 || r_keyframe.Transformation.translation().norm() > 1.5 * cfg_.MaxTranslationalDistance;
 
 
@@ -135,18 +145,13 @@ public:
     if(reject1)
     {
       std::cerr << "od before modify: "<< r_odometry.Transformation.translation().norm() << std::endl;
-      Eigen::Affine3d& p = const_cast<Eigen::Affine3d&>(r_odometry.Transformation);
-      p.setIdentity();
-      std::cerr << "od after modify: "<< r_odometry.Transformation.translation().norm() << std::endl;
+      r_odometry.Transformation.setIdentity();
 
-      dvo::core::Matrix6d& information = const_cast<dvo::core::Matrix6d&>(r_odometry.Information);
-      information.setIdentity();
-      information *= 0.008 * 0.008;
+      r_odometry.Information.setIdentity();
+      r_odometry.Information *= 0.008 * 0.008;
 
       std::cerr << "kf before modify: "<< r_keyframe.Transformation.translation().norm() << std::endl;
-      Eigen::Affine3d& p2 = const_cast<Eigen::Affine3d&>(r_keyframe.Transformation);
-      p2 = last_transform_to_keyframe_;
-      std::cerr << "kf after modify: "<< r_keyframe.Transformation.translation().norm() << std::endl;
+      r_keyframe.Transformation = last_transform_to_keyframe_;
     }
 
     last_transform_to_keyframe_ = r_keyframe.Transformation;
@@ -164,31 +169,6 @@ public:
     return (double(r_keyframe.Statistics.Levels.back().Iterations.back().ValidConstraints) / double(r_keyframe.Statistics.Levels.back().ValidPixels)) > cfg_.MinEquationSystemConstraintRatio;
   }
 
-  bool onAcceptCriterionConditionNumber(const LocalTracker& lt, const LocalTracker::TrackingResult& r_odometry, const LocalTracker::TrackingResult& r_keyframe)
-  {
-    std_msgs::Float64 kappa_odometry, kappa_keyframe, de_odometry, de_keyframe;
-    Eigen::Matrix<double, 6, 1> eigenvalues;
-    Eigen::SelfAdjointEigenSolver<dvo::core::Matrix6d> eigensolver1(r_odometry.Information);
-    eigenvalues = eigensolver1.eigenvalues();
-
-    kappa_odometry.data = std::abs(eigenvalues(5) / eigenvalues(0));
-    //de_odometry.data = r_odometry.Context->Mean.sum();
-
-    Eigen::SelfAdjointEigenSolver<dvo::core::Matrix6d> eigensolver2(r_keyframe.Information);
-    eigenvalues = eigensolver2.eigenvalues();
-
-    kappa_keyframe.data = std::abs(eigenvalues(5) / eigenvalues(0));
-    //de_keyframe.data = r_keyframe.Context->Mean.sum();
-
-    cn_odometry_pub_.publish(kappa_odometry);
-    cn_keyframe_pub_.publish(kappa_keyframe);
-
-    //de_odometry_pub_.publish(de_odometry);
-    //de_keyframe_pub_.publish(de_keyframe);
-
-    return true;
-  }
-
   void onGlobalMapChangedUpdateVisualization(KeyframeGraph& map)
   {
     visualizer_->visualize(map);
@@ -228,11 +208,12 @@ public:
 
   void finish()
   {
-    graph_.finalOptimization();
+    graph_->finalOptimization();
   }
 
 private:
-  KeyframeGraph graph_;
+  boost::shared_ptr<KeyframeGraph> graph_;
+  int sensor_;
   LocalTracker lt_;
   Eigen::Affine3d initial_transformation_, relative_transformation_, last_absolute_transformation_;
   dvo::core::RgbdImagePyramid::Ptr previous_;
@@ -241,24 +222,38 @@ private:
 };
 
 KeyframeTracker::KeyframeTracker(dvo_slam::visualization::GraphVisualizer* visualizer) :
-  impl_(new KeyframeTracker::Impl(visualizer))
+  impl_(new KeyframeTracker::Impl(boost::make_shared<KeyframeGraph>(), 0, visualizer))
+{
+}
+
+KeyframeTracker::KeyframeTracker(const boost::shared_ptr<KeyframeGraph>& graph, int sensor, dvo_slam::visualization::GraphVisualizer* visualizer) :
+  impl_(new KeyframeTracker::Impl(graph, sensor, visualizer))
 {
 }
 
 void KeyframeTracker::configureTracking(const dvo::DenseTracker::Config& cfg)
 {
-  impl_->graph_.configureValidationTracking(cfg);
+  impl_->graph_->configureValidationTracking(cfg);
+  impl_->lt_.configure(cfg);
+}
+
+void KeyframeTracker::configureLocalTracking(const dvo::DenseTracker::Config& cfg)
+{
   impl_->lt_.configure(cfg);
 }
 
 void KeyframeTracker::configureKeyframeSelection(const dvo_slam::KeyframeTrackerConfig& cfg)
 {
   impl_->cfg_ = cfg;
+  impl_->lt_.configurePrediction(cfg);
+
+  dvo::util::TaskArenas::instance().configure(dvo::util::TaskArenas::Frontend, cfg.FrontendConcurrency, cfg.FrontendFirstCore);
+  dvo::util::TaskArenas::instance().configure(dvo::util::TaskArenas::Visualization, cfg.VisualizationConcurrency, cfg.VisualizationFirstCore);
 }
 
 void KeyframeTracker::configureMapping(const dvo_slam::KeyframeGraphConfig& cfg)
 {
-  impl_->graph_.configure(cfg);
+  impl_->graph_->configure(cfg);
 }
 
 const dvo::DenseTracker::Config& KeyframeTracker::trackingConfiguration() const
@@ -273,7 +268,7 @@ const dvo_slam::KeyframeTrackerConfig& KeyframeTracker::keyframeSelectionConfigu
 
 const dvo_slam::KeyframeGraphConfig& KeyframeTracker::mappingConfiguration() const
 {
-  return impl_->graph_.configuration();
+  return impl_->graph_->configuration();
 }
 
 void KeyframeTracker::init()
@@ -291,11 +286,26 @@ void KeyframeTracker::update(const dvo::core::RgbdImagePyramid::Ptr& current, co
   impl_->update(current, current_time, absolute_transformation);
 }
 
+void KeyframeTracker::setRotationPrior(const Eigen::Matrix3d& rotation)
+{
+  impl_->lt_.setRotationPrior(rotation);
+}
+
 void KeyframeTracker::forceKeyframe()
 {
   impl_->forceKeyframe();
 }
 
+void KeyframeTracker::diagnostics(const dvo_slam::TrackingDiagnostics::Ptr& diagnostics)
+{
+  impl_->diagnostics_ = diagnostics;
+}
+
+void KeyframeTracker::remoteBackend(const boost::shared_ptr<dvo_slam::RemoteBackendClient>& client)
+{
+  impl_->remote_ = client;
+}
+
 void KeyframeTracker::finish()
 {
   impl_->finish();
@@ -303,7 +313,28 @@ void KeyframeTracker::finish()
 
 void KeyframeTracker::serializeMap(dvo_slam::serialization::MapSerializerInterface& serializer)
 {
-  serializer.serialize(impl_->graph_);
+  serializer.serialize(*impl_->graph_);
+}
+
+bool KeyframeTracker::memoryUsage(dvo_slam::MemoryUsage& usage, bool wait) const
+{
+  usage.clear();
+
+  if(!impl_->graph_->memoryUsage(usage, wait)) return false;
+
+  impl_->lt_.memoryUsage(usage);
+
+  return true;
+}
+
+void KeyframeTracker::addMapChangedCallback(const dvo_slam::KeyframeGraph::MapChangedCallback& callback)
+{
+  impl_->graph_->addMapChangedCallback(callback);
+}
+
+void KeyframeTracker::addKeyframeCallback(const KeyframeCallback& callback)
+{
+  impl_->lt_.addMapCompleteCallback(boost::bind(callback, _2));
 }
 
 } /* namespace dvo_slam */
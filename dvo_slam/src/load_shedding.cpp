@@ -0,0 +1,249 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <ros/console.h>
+
+#include <dvo/util/instrumentation.h>
+
+#include <dvo_slam/load_shedding.h>
+
+namespace dvo_slam
+{
+
+LoadSheddingConfig::LoadSheddingConfig() :
+    Enabled(false),
+    TargetLoad(0.9),
+    RecoverLoad(0.6),
+    Smoothing(0.1),
+    HoldFrames(15),
+    MaxFrameStride(2),
+    MaxLastLevelIncrease(1),
+    MaxIterations(10)
+{
+}
+
+LoadShedding::LoadShedding() :
+    last_stamp_(0.0),
+    period_(0.0),
+    generation_(0)
+{
+  reset();
+}
+
+void LoadShedding::configure(const LoadSheddingConfig& cfg)
+{
+  {
+    tbb::spin_mutex::scoped_lock l(mutex_);
+    cfg_ = cfg;
+  }
+
+  // the degradation may be beyond the new limits
+  reset();
+}
+
+const LoadSheddingConfig& LoadShedding::configuration() const
+{
+  return cfg_;
+}
+
+void LoadShedding::reset()
+{
+  tbb::spin_mutex::scoped_lock l(mutex_);
+
+  processing_time_ = 0.0;
+  frame_stride_ = 1;
+  frames_since_accepted_ = 0;
+  last_level_increase_ = 0;
+  cap_iterations_ = false;
+  hold_ = 0;
+
+  generation_++;
+}
+
+bool LoadShedding::accept(double stamp)
+{
+  static dvo::util::Timer& dropped = dvo::util::Instrumentation::instance().timer("load_shedding/dropped");
+
+  tbb::spin_mutex::scoped_lock l(mutex_);
+
+  const double dt = stamp - last_stamp_;
+
+  // longer gaps are pauses of the sensor, not its period
+  if(last_stamp_ > 0.0 && dt > 0.0 && dt < 1.0)
+  {
+    period_ = period_ > 0.0 ? (1.0 - cfg_.Smoothing) * period_ + cfg_.Smoothing * dt : dt;
+  }
+
+  last_stamp_ = stamp;
+
+  if(!cfg_.Enabled || frame_stride_ <= 1) return true;
+
+  if(++frames_since_accepted_ >= frame_stride_)
+  {
+    frames_since_accepted_ = 0;
+    return true;
+  }
+
+  dropped.record(0.0);
+
+  return false;
+}
+
+void LoadShedding::update(double seconds)
+{
+  static dvo::util::Timer& recovered = dvo::util::Instrumentation::instance().timer("load_shedding/recover");
+
+  tbb::spin_mutex::scoped_lock l(mutex_);
+
+  if(!cfg_.Enabled) return;
+
+  processing_time_ = processing_time_ > 0.0 ? (1.0 - cfg_.Smoothing) * processing_time_ + cfg_.Smoothing * seconds : seconds;
+
+  if(hold_ > 0)
+  {
+    hold_--;
+    return;
+  }
+
+  if(period_ <= 0.0) return;
+
+  const double load = processing_time_ / (period_ * frame_stride_);
+
+  if(load > cfg_.TargetLoad)
+  {
+    if(degradeStep()) hold_ = cfg_.HoldFrames;
+
+    return;
+  }
+
+  // tracking every frame again halves the time available, so that has to fit as well. a finer level or more
+  // iterations take an unknown amount of time, the hold gives the average time to show it
+  const Step s = currentStep();
+  const double recovered_load = s == DropFrames ? processing_time_ / (period_ * (frame_stride_ - 1)) : load;
+
+  if(s != None && recovered_load < cfg_.RecoverLoad && recoverStep())
+  {
+    recovered.record(0.0);
+    hold_ = cfg_.HoldFrames;
+
+    ROS_INFO_STREAM("load shedding: recovered to step " << currentStep() << ", load " << load);
+  }
+}
+
+size_t LoadShedding::generation() const
+{
+  tbb::spin_mutex::scoped_lock l(mutex_);
+
+  return generation_;
+}
+
+void LoadShedding::degrade(const dvo::DenseTracker::Config& cfg, dvo::DenseTracker::Config& degraded) const
+{
+  tbb::spin_mutex::scoped_lock l(mutex_);
+
+  degraded = cfg;
+
+  if(last_level_increase_ > 0)
+    degraded.LastLevel = std::min(cfg.LastLevel + last_level_increase_, cfg.FirstLevel);
+
+  if(cap_iterations_)
+    degraded.MaxIterationsPerLevel = std::min(cfg.MaxIterationsPerLevel, std::max(cfg_.MaxIterations, 1));
+}
+
+LoadShedding::Step LoadShedding::step() const
+{
+  tbb::spin_mutex::scoped_lock l(mutex_);
+
+  return currentStep();
+}
+
+LoadShedding::Step LoadShedding::currentStep() const
+{
+  if(cap_iterations_) return CapIterations;
+  if(last_level_increase_ > 0) return ReduceLevels;
+  if(frame_stride_ > 1) return DropFrames;
+
+  return None;
+}
+
+bool LoadShedding::degradeStep()
+{
+  static dvo::util::Timer& drop_frames = dvo::util::Instrumentation::instance().timer("load_shedding/drop_frames");
+  static dvo::util::Timer& reduce_levels = dvo::util::Instrumentation::instance().timer("load_shedding/reduce_levels");
+  static dvo::util::Timer& cap_iterations = dvo::util::Instrumentation::instance().timer("load_shedding/cap_iterations");
+
+  if(frame_stride_ < cfg_.MaxFrameStride)
+  {
+    frame_stride_++;
+    frames_since_accepted_ = 0;
+    drop_frames.record(0.0);
+
+    ROS_INFO_STREAM("load shedding: tracking every " << frame_stride_ << ". frame, " << processing_time_ << "s per frame at a period of " << period_ << "s");
+    return true;
+  }
+
+  if(last_level_increase_ < cfg_.MaxLastLevelIncrease)
+  {
+    last_level_increase_++;
+    generation_++;
+    reduce_levels.record(0.0);
+
+    ROS_INFO_STREAM("load shedding: skipping " << last_level_increase_ << " finest level(s), " << processing_time_ << "s per frame");
+    return true;
+  }
+
+  if(!cap_iterations_ && cfg_.MaxIterations > 0)
+  {
+    cap_iterations_ = true;
+    generation_++;
+    cap_iterations.record(0.0);
+
+    ROS_INFO_STREAM("load shedding: capping iterations at " << cfg_.MaxIterations << ", " << processing_time_ << "s per frame");
+    return true;
+  }
+
+  ROS_WARN_STREAM_THROTTLE(5.0, "load shedding: can't keep up, " << processing_time_ << "s per frame at a period of " << period_ << "s");
+  return false;
+}
+
+bool LoadShedding::recoverStep()
+{
+  switch(currentStep())
+  {
+  case CapIterations:
+    cap_iterations_ = false;
+    generation_++;
+    return true;
+  case ReduceLevels:
+    last_level_increase_--;
+    generation_++;
+    return true;
+  case DropFrames:
+    frame_stride_--;
+    frames_since_accepted_ = 0;
+    return true;
+  default:
+    return false;
+  }
+}
+
+} /* namespace dvo_slam */
@@ -22,8 +22,10 @@
 #include <dvo_slam/timestamped.h>
 
 #include <g2o/core/sparse_optimizer.h>
+#include <g2o/core/jacobian_workspace.h>
 #include <g2o/core/solver.h>
 #include <g2o/core/block_solver.h>
+#include <g2o/core/sparse_block_matrix.h>
 #include <g2o/core/optimization_algorithm_levenberg.h>
 #include <g2o/solvers/dense/linear_solver_dense.h>
 #include <g2o/solvers/csparse/linear_solver_csparse.h>
@@ -32,6 +34,8 @@
 #include <g2o/types/slam3d/edge_se3.h>
 #include <g2o/types/slam3d/edge_se3_offset.h>
 
+#include <Eigen/Cholesky>
+
 namespace dvo_slam
 {
 
@@ -56,6 +60,8 @@ static Eigen::Affine3d toAffine(const Eigen::Isometry3d& pose)
 
 struct LocalMapImpl
 {
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
   typedef g2o::BlockSolver_6_3 BlockSolver;
   typedef g2o::LinearSolverCSparse<BlockSolver::PoseMatrixType> LinearSolver;
   dvo::core::RgbdImagePyramid::Ptr keyframe_, current_;
@@ -64,24 +70,47 @@ struct LocalMapImpl
   g2o::SparseOptimizer graph_;
   int max_vertex_id_, max_edge_id_;
 
+  // by vertex id, the vertices also carry them as Timestamped user data for the keyframe graph
+  std::vector<ros::Time> timestamps_;
+
   dvo_slam::TrackingResultEvaluation::ConstPtr evaluation_;
 
+  int sensor_;
+
+  // pose of the current frame after compact()
+  Eigen::Isometry3d compacted_current_pose_;
+
+  typedef std::vector<dvo::core::Matrix6d, Eigen::aligned_allocator<dvo::core::Matrix6d> > Matrix6dVector;
+  typedef std::vector<dvo::core::Vector6d, Eigen::aligned_allocator<dvo::core::Vector6d> > Vector6dVector;
+  typedef std::vector<Eigen::LLT<dvo::core::Matrix6d>, Eigen::aligned_allocator<Eigen::LLT<dvo::core::Matrix6d> > > FactorizationVector;
+
+  /**
+   * State of the chain solver, see optimizeChain(). The free vertices are ordered by id, block k belongs to the vertex
+   * with id k + 2. Diagonal holds the diagonal blocks of the normal equations, Coupling the blocks between vertex k and
+   * k + 1, which only odometry edges fill.
+   */
+  std::vector<g2o::VertexSE3*> chain_vertices_;
+  std::vector<g2o::EdgeSE3*> chain_edges_;
+  g2o::JacobianWorkspace chain_workspace_;
+  Matrix6dVector chain_diagonal_, chain_coupling_, chain_schur_;
+  Vector6dVector chain_gradient_, chain_rhs_, chain_update_;
+  FactorizationVector chain_factorizations_;
+
+  // information of the current frame relative to the keyframe from the last chain solve, valid if has_chain_marginal_
+  dvo::core::Matrix6d chain_marginal_;
+  bool has_chain_marginal_;
+
   LocalMapImpl(const dvo::core::RgbdImagePyramid::Ptr& keyframe, const dvo::core::AffineTransformd& keyframe_pose) :
     keyframe_(keyframe),
     keyframe_vertex_(0),
     previous_vertex_(0),
     current_vertex_(0),
     max_vertex_id_(1),
-    max_edge_id_(1)
+    max_edge_id_(1),
+    sensor_(0),
+    compacted_current_pose_(Eigen::Isometry3d::Identity()),
+    has_chain_marginal_(false)
   {
-    // g2o setup
-    graph_.setAlgorithm(
-        new g2o::OptimizationAlgorithmLevenberg(
-            new BlockSolver(
-                new LinearSolver()
-            )
-        )
-    );
     graph_.setVerbose(false);
 
     keyframe_vertex_ = addFrameVertex(ros::Time(keyframe->timestamp()));
@@ -95,6 +124,9 @@ struct LocalMapImpl
     frame_vertex->setId(max_vertex_id_++);
     frame_vertex->setUserData(new Timestamped(timestamp));
 
+    timestamps_.resize(max_vertex_id_);
+    timestamps_[frame_vertex->id()] = timestamp;
+
     graph_.addVertex(frame_vertex);
 
     return frame_vertex;
@@ -116,6 +148,223 @@ struct LocalMapImpl
 
     return edge;
   }
+
+  // the general g2o solver is only set up if the map doesn't have the structure chainStructure() expects
+  void initializeAlgorithm()
+  {
+    if(graph_.algorithm() != 0) return;
+
+    graph_.setAlgorithm(
+        new g2o::OptimizationAlgorithmLevenberg(
+            new BlockSolver(
+                new LinearSolver()
+            )
+        )
+    );
+  }
+
+  /**
+   * True if the only fixed vertex is the keyframe and every edge either connects the keyframe to a frame, or a frame
+   * to the next one, which are all maps built by the LocalTracker. Collects the free vertices and all edges.
+   */
+  bool chainStructure()
+  {
+    const int n = int(graph_.vertices().size());
+
+    chain_vertices_.clear();
+    chain_edges_.clear();
+
+    if(n < 2 || keyframe_vertex_ == 0 || keyframe_vertex_->id() != 1 || !keyframe_vertex_->fixed()) return false;
+
+    for(int id = 2; id <= n; ++id)
+    {
+      g2o::VertexSE3* v = static_cast<g2o::VertexSE3*>(graph_.vertex(id));
+
+      if(v == 0 || v->fixed()) return false;
+
+      chain_vertices_.push_back(v);
+    }
+
+    for(g2o::HyperGraph::EdgeSet::iterator it = graph_.edges().begin(); it != graph_.edges().end(); ++it)
+    {
+      g2o::EdgeSE3* e = static_cast<g2o::EdgeSE3*>(*it);
+
+      if(e->vertices().size() != 2 || e->robustKernel() != 0 || e->level() != 0) return false;
+
+      const int from = e->vertex(0)->id(), to = e->vertex(1)->id();
+
+      if(from != 1 && to != from + 1) return false;
+
+      chain_edges_.push_back(e);
+      chain_workspace_.updateSize(e);
+    }
+
+    chain_workspace_.allocate();
+
+    return true;
+  }
+
+  // builds the block tridiagonal normal equations at the current estimates, returns the chi2
+  double linearizeChain()
+  {
+    const size_t m = chain_vertices_.size();
+
+    chain_diagonal_.assign(m, dvo::core::Matrix6d::Zero());
+    chain_coupling_.assign(m, dvo::core::Matrix6d::Zero());
+    chain_gradient_.assign(m, dvo::core::Vector6d::Zero());
+
+    double chi2 = 0.0;
+
+    for(std::vector<g2o::EdgeSE3*>::const_iterator it = chain_edges_.begin(); it != chain_edges_.end(); ++it)
+    {
+      g2o::EdgeSE3* e = *it;
+
+      e->computeError();
+      e->linearizeOplus(chain_workspace_);
+
+      chi2 += e->chi2();
+
+      const int from = e->vertex(0)->id(), to = e->vertex(1)->id();
+      const dvo::core::Matrix6d jt_omega = e->jacobianOplusXj().transpose() * e->information();
+
+      chain_diagonal_[to - 2] += jt_omega * e->jacobianOplusXj();
+      chain_gradient_[to - 2] += jt_omega * e->error();
+
+      if(from == 1) continue;
+
+      const dvo::core::Matrix6d it_omega = e->jacobianOplusXi().transpose() * e->information();
+
+      chain_diagonal_[from - 2] += it_omega * e->jacobianOplusXi();
+      chain_coupling_[from - 2] += it_omega * e->jacobianOplusXj();
+      chain_gradient_[from - 2] += it_omega * e->error();
+    }
+
+    return chi2;
+  }
+
+  /**
+   * Solves (H + lambda I) dx = -b by block tridiagonal elimination, linear in the number of frames. The last Schur
+   * complement is the information of the last vertex with all others marginalized. Returns false if a block isn't
+   * positive definite.
+   */
+  bool solveChain(double lambda)
+  {
+    const size_t m = chain_vertices_.size();
+
+    chain_schur_.resize(m);
+    chain_rhs_.resize(m);
+    chain_update_.resize(m);
+    chain_factorizations_.resize(m);
+
+    for(size_t k = 0; k < m; ++k)
+    {
+      chain_schur_[k] = chain_diagonal_[k];
+      chain_schur_[k].diagonal().array() += lambda;
+      chain_rhs_[k] = -chain_gradient_[k];
+
+      if(k > 0)
+      {
+        // L = U^T S^-1 of the previous block
+        const dvo::core::Matrix6d lt = chain_factorizations_[k - 1].solve(chain_coupling_[k - 1]);
+
+        chain_schur_[k] -= chain_coupling_[k - 1].transpose() * lt;
+        chain_rhs_[k] -= lt.transpose() * chain_rhs_[k - 1];
+      }
+
+      chain_factorizations_[k].compute(chain_schur_[k]);
+
+      if(chain_factorizations_[k].info() != Eigen::Success) return false;
+    }
+
+    for(size_t k = m; k-- > 0;)
+    {
+      dvo::core::Vector6d r = chain_rhs_[k];
+
+      if(k + 1 < m) r -= chain_coupling_[k] * chain_update_[k + 1];
+
+      chain_update_[k] = chain_factorizations_[k].solve(r);
+    }
+
+    return true;
+  }
+
+  double chainChi2()
+  {
+    double chi2 = 0.0;
+
+    for(std::vector<g2o::EdgeSE3*>::const_iterator it = chain_edges_.begin(); it != chain_edges_.end(); ++it)
+    {
+      (*it)->computeError();
+      chi2 += (*it)->chi2();
+    }
+
+    return chi2;
+  }
+
+  /**
+   * Levenberg-Marquardt on the chain structure without the sparse optimizer, its block solver and CSparse. The
+   * initial estimates are the keyframe measurements, which are already set by the local tracker.
+   */
+  void optimizeChain(int iterations)
+  {
+    double chi2 = linearizeChain(), lambda = -1.0;
+
+    for(int iteration = 0; iteration < iterations; ++iteration)
+    {
+      if(lambda < 0.0)
+      {
+        double max_diagonal = 0.0;
+
+        for(size_t k = 0; k < chain_diagonal_.size(); ++k)
+        {
+          max_diagonal = std::max(max_diagonal, chain_diagonal_[k].diagonal().maxCoeff());
+        }
+
+        lambda = 1e-5 * max_diagonal;
+      }
+
+      bool accepted = false;
+      double new_chi2 = chi2;
+
+      for(int attempt = 0; attempt < 10 && !accepted; ++attempt)
+      {
+        if(solveChain(lambda))
+        {
+          for(size_t k = 0; k < chain_vertices_.size(); ++k)
+          {
+            chain_vertices_[k]->push();
+            chain_vertices_[k]->oplus(chain_update_[k].data());
+          }
+
+          new_chi2 = chainChi2();
+          accepted = new_chi2 < chi2;
+
+          for(size_t k = 0; k < chain_vertices_.size(); ++k)
+          {
+            if(accepted)
+              chain_vertices_[k]->discardTop();
+            else
+              chain_vertices_[k]->pop();
+          }
+        }
+
+        lambda = accepted ? lambda / 3.0 : lambda * 4.0;
+      }
+
+      if(!accepted) break;
+
+      const bool converged = chi2 - new_chi2 < 1e-9 * chi2;
+
+      chi2 = linearizeChain();
+
+      if(converged) break;
+    }
+
+    // marginal of the current frame from the undamped system at the final estimate
+    has_chain_marginal_ = current_vertex_ == chain_vertices_.back() && solveChain(0.0);
+
+    if(has_chain_marginal_) chain_marginal_ = chain_schur_.back();
+  }
 };
 
 } /* namespace internal */
@@ -152,6 +401,8 @@ void LocalMap::getCurrentFramePose(dvo::core::AffineTransformd& current_pose)
 
 void LocalMap::setKeyframePose(const dvo::core::AffineTransformd& keyframe_pose)
 {
+  assert(impl_->keyframe_vertex_ != 0);
+
   impl_->keyframe_vertex_->setEstimate(internal::toIsometry(keyframe_pose));
 
   g2o::OptimizableGraph::EdgeSet& edges = impl_->keyframe_vertex_->edges();
@@ -169,7 +420,7 @@ void LocalMap::setKeyframePose(const dvo::core::AffineTransformd& keyframe_pose)
 
 dvo::core::AffineTransformd LocalMap::getCurrentFramePose()
 {
-  return internal::toAffine(impl_->current_vertex_->estimate());
+  return internal::toAffine(impl_->current_vertex_ != 0 ? impl_->current_vertex_->estimate() : impl_->compacted_current_pose_);
 }
 
 g2o::SparseOptimizer& LocalMap::getGraph()
@@ -177,6 +428,13 @@ g2o::SparseOptimizer& LocalMap::getGraph()
   return impl_->graph_;
 }
 
+ros::Time LocalMap::getVertexTimestamp(int id) const
+{
+  assert(id > 0 && size_t(id) < impl_->timestamps_.size());
+
+  return impl_->timestamps_[id];
+}
+
 void LocalMap::setEvaluation(dvo_slam::TrackingResultEvaluation::ConstPtr& evaluation)
 {
   impl_->evaluation_ = evaluation;
@@ -187,8 +445,20 @@ dvo_slam::TrackingResultEvaluation::ConstPtr LocalMap::getEvaluation()
   return impl_->evaluation_;
 }
 
+void LocalMap::setSensor(int sensor)
+{
+  impl_->sensor_ = sensor;
+}
+
+int LocalMap::getSensor() const
+{
+  return impl_->sensor_;
+}
+
 void LocalMap::addFrame(const dvo::core::RgbdImagePyramid::Ptr& frame)
 {
+  assert(impl_->keyframe_vertex_ != 0);
+
   impl_->current_ = frame;
   impl_->previous_vertex_ = impl_->current_vertex_;
   impl_->current_vertex_ = impl_->addFrameVertex(ros::Time(frame->timestamp()));
@@ -205,11 +475,105 @@ void LocalMap::addKeyframeMeasurement(const dvo::core::AffineTransformd& pose, c
   impl_->current_vertex_->setEstimate(impl_->keyframe_vertex_->estimate() * internal::toIsometry(pose));
 }
 
+void LocalMap::compact()
+{
+  if(impl_->keyframe_vertex_ == 0) return;
+
+  if(impl_->current_vertex_ != 0) impl_->compacted_current_pose_ = impl_->current_vertex_->estimate();
+
+  impl_->graph_.clear();
+
+  impl_->keyframe_vertex_ = 0;
+  impl_->previous_vertex_ = 0;
+  impl_->current_vertex_ = 0;
+}
+
+size_t LocalMap::memoryUsage() const
+{
+  size_t bytes = impl_->keyframe_->memoryUsage();
+
+  if(impl_->current_ && impl_->current_ != impl_->keyframe_) bytes += impl_->current_->memoryUsage();
+
+  bytes += impl_->graph_.vertices().size() * sizeof(g2o::VertexSE3);
+  bytes += impl_->graph_.edges().size() * sizeof(g2o::EdgeSE3);
+  bytes += impl_->timestamps_.capacity() * sizeof(ros::Time);
+
+  return bytes;
+}
+
 void LocalMap::optimize()
 {
+  impl_->has_chain_marginal_ = false;
+
+  if(impl_->chainStructure())
+  {
+    impl_->optimizeChain(50);
+    return;
+  }
+
+  impl_->initializeAlgorithm();
   impl_->graph_.initializeOptimization();
   impl_->graph_.computeInitialGuess();
   impl_->graph_.optimize(50);
 }
 
+bool LocalMap::marginalize(Eigen::Isometry3d& keyframe_to_current, dvo::core::Matrix6d& information, FramePoseVector& frames)
+{
+  assert(impl_->keyframe_vertex_ != 0 && impl_->current_vertex_ != 0);
+
+  Eigen::Isometry3d keyframe_inverse = impl_->keyframe_vertex_->estimate().inverse();
+  keyframe_to_current = keyframe_inverse * impl_->current_vertex_->estimate();
+
+  for(g2o::OptimizableGraph::VertexIDMap::iterator it = impl_->graph_.vertices().begin(); it != impl_->graph_.vertices().end(); ++it)
+  {
+    g2o::VertexSE3 *v = (g2o::VertexSE3*)it->second;
+
+    if(v == impl_->keyframe_vertex_ || v == impl_->current_vertex_) continue;
+
+    assert(v->id() > 0 && size_t(v->id()) < impl_->timestamps_.size());
+
+    frames.push_back(FramePose(impl_->timestamps_[v->id()], keyframe_inverse * v->estimate()));
+  }
+
+  // the keyframe vertex is fixed, so the marginal covariance of the current frame, taken from the system of the last
+  // iteration, is the one of its pose relative to the keyframe
+  if(impl_->has_chain_marginal_)
+  {
+    information = impl_->chain_marginal_;
+    return true;
+  }
+
+  impl_->initializeAlgorithm();
+
+  g2o::SparseBlockMatrix<Eigen::MatrixXd> covariances;
+  int idx = impl_->current_vertex_->hessianIndex();
+
+  if(idx >= 0 && impl_->graph_.computeMarginals(covariances, impl_->current_vertex_))
+  {
+    Eigen::MatrixXd *covariance = covariances.block(idx, idx);
+
+    if(covariance != 0 && covariance->rows() == 6 && covariance->cols() == 6)
+    {
+      Eigen::FullPivLU<dvo::core::Matrix6d> lu(*covariance);
+
+      if(lu.isInvertible())
+      {
+        information = lu.inverse();
+        return true;
+      }
+    }
+  }
+
+  g2o::OptimizableGraph::EdgeSet& edges = impl_->keyframe_vertex_->edges();
+
+  for(g2o::OptimizableGraph::EdgeSet::iterator it = edges.begin(); it != edges.end(); ++it)
+  {
+    g2o::EdgeSE3 *e = (g2o::EdgeSE3*)(*it);
+
+    if(e->vertex(1) == impl_->current_vertex_) information = e->information();
+  }
+
+  return false;
+}
+
 } /* namespace dvo_slam */
@@ -19,11 +19,20 @@
  */
 
 #include <dvo_slam/local_tracker.h>
+#include <dvo_slam/sparse_motion_estimator.h>
 
 #include <dvo/core/point_selection.h>
 #include <dvo/core/point_selection_predicates.h>
 
-#include <dvo/util/stopwatch.h>
+#include <dvo/util/instrumentation.h>
+#include <dvo/util/task_arenas.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <vector>
+
+#include <sophus/se3.hpp>
 
 #include <tbb/parallel_invoke.h>
 #include <tbb/tbb_thread.h>
@@ -42,8 +51,13 @@ struct LocalTrackerImpl
 {
   friend class LocalTracker;
 
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW;
+
   DenseTrackerPtr keyframe_tracker_, odometry_tracker_;
 
+  // as given to configure, the trackers get UseInitialEstimate set if the motion is predicted
+  dvo::DenseTracker::Config cfg_;
+
   dvo::core::ValidPointAndGradientThresholdPredicate predicate;
 
   dvo::core::AffineTransformd last_keyframe_pose_;
@@ -52,13 +66,262 @@ struct LocalTrackerImpl
 
   bool force_;
 
-  LocalTracker::AcceptSignal accept_;
+  bool use_prediction_;
+  int prediction_skip_levels_;
+  double max_prediction_translation_error_, max_prediction_rotation_error_;
+
+  // motion of the current frame relative to the previous one and the time in between, if has_velocity_ is set
+  dvo::core::AffineTransformd last_motion_;
+  double last_motion_dt_;
+  bool has_velocity_;
+
+  // the last prediction was within the max prediction errors, so the next match can skip coarse levels
+  bool confident_;
+
+  // only used by the next update
+  Eigen::Matrix3d rotation_prior_;
+  bool has_rotation_prior_;
+
+  // see KeyframeTrackerConfig::StationaryMaxIntensityDifference
+  double stationary_max_intensity_difference_, stationary_max_depth_difference_;
+  int stationary_level_;
+
+  // see KeyframeTrackerConfig::LocalModelFrames. the points every accepted frame added to the keyframe points, per
+  // level and oldest first
+  typedef std::vector<dvo::core::PointSelection::PointVector> LevelPointVectors;
+
+  size_t local_model_frames_;
+  std::deque<LevelPointVectors> local_model_;
+  dvo::core::PointSelection::PointVector local_model_points_;
+
+  // see KeyframeTrackerConfig::UseSparseInitialization
+  bool use_sparse_initialization_;
+  SparseMotionEstimator sparse_;
+
+  template<typename Callback>
+  struct NamedCallback
+  {
+    Callback callback;
+    dvo::util::Timer* timer;
+  };
+
+  typedef std::vector<NamedCallback<LocalTracker::FilterCallback> > FilterVector;
+  typedef std::vector<NamedCallback<LocalTracker::AcceptCallback> > AcceptCriterionVector;
+
+  FilterVector filters_;
+  AcceptCriterionVector accept_criteria_;
   LocalTracker::MapInitializedSignal map_initialized_;
   LocalTracker::MapCompleteSignal map_complete_;
+  LocalTracker::RelocalizeCallback relocalize_;
+
+  // all filters run, the criteria stop at the first rejection and are skipped if the frame is rejected already
+  bool accept(const LocalTracker& lt, LocalTracker::TrackingResult& r_odometry, LocalTracker::TrackingResult& r_keyframe, bool rejected)
+  {
+    bool accepted = !rejected;
+
+    for(FilterVector::const_iterator it = filters_.begin(); it != filters_.end(); ++it)
+    {
+      dvo::util::ScopedTimer filter_scope(*it->timer);
+      accepted = it->callback(lt, r_odometry, r_keyframe) && accepted;
+    }
+
+    for(AcceptCriterionVector::const_iterator it = accept_criteria_.begin(); accepted && it != accept_criteria_.end(); ++it)
+    {
+      dvo::util::ScopedTimer accept_scope(*it->timer);
+      accepted = it->callback(lt, r_odometry, r_keyframe);
+    }
+
+    return accepted;
+  }
+
+  static void match(const DenseTrackerPtr& tracker, const PointSelectionPtr& ref, const dvo::core::RgbdImagePyramid::Ptr& cur, LocalTracker::TrackingResult* r, int first_level)
+  {
+    tracker->match(*ref, *cur, *r, first_level);
+  }
+
+  // both matches, in the frontend arena so the backend can't take their workers
+  static void matchBoth(const boost::function<void()>& keyframe, const boost::function<void()>& odometry)
+  {
+    tbb::parallel_invoke(keyframe, odometry);
+  }
+
+  void configureTrackers()
+  {
+    dvo::DenseTracker::Config cfg = cfg_;
+    cfg.UseInitialEstimate = cfg.UseInitialEstimate || use_prediction_ || use_sparse_initialization_;
+
+    keyframe_tracker_->configure(cfg);
+    odometry_tracker_->configure(cfg);
+  }
+
+  void resetPrediction()
+  {
+    has_velocity_ = false;
+    confident_ = false;
+    has_rotation_prior_ = false;
+  }
+
+  // motion of the next frame relative to the current one, dt seconds later. returns false if there is no prediction
+  bool predict(double dt, dvo::core::AffineTransformd& motion) const
+  {
+    if(!use_prediction_ || !(has_velocity_ || has_rotation_prior_)) return false;
+
+    motion.setIdentity();
+
+    if(has_velocity_)
+    {
+      motion = last_motion_;
+
+      // frames may have been dropped, so scale the twist to the time between the frames
+      if(dt > 0.0 && last_motion_dt_ > 0.0 && dt != last_motion_dt_)
+      {
+        Sophus::SE3d m(last_motion_.linear(), last_motion_.translation());
+        m = Sophus::SE3d::exp(m.log() * (dt / last_motion_dt_));
+
+        motion.linear() = m.rotationMatrix();
+        motion.translation() = m.translation();
+      }
+    }
+
+    if(has_rotation_prior_)
+    {
+      motion.linear() = rotation_prior_;
+    }
+
+    return true;
+  }
+
+  // compares the mean absolute intensity difference and the one of the depths valid in both frames on one coarse level
+  // with the thresholds, which takes a few microseconds
+  bool stationary(dvo::core::RgbdImagePyramid& previous, dvo::core::RgbdImagePyramid& current) const
+  {
+    if(!(stationary_max_intensity_difference_ > 0.0)) return false;
+
+    const size_t level = size_t(std::max(0, std::min(stationary_level_, int(cfg_.getNumLevels()) - 1)));
+
+    const dvo::core::RgbdImage &p = previous.level(level), &c = current.level(level);
+
+    if(p.intensity.size() != c.intensity.size() || p.depth.size() != c.depth.size()) return false;
+
+    double intensity_sum = 0.0, depth_sum = 0.0;
+    size_t depth_n = 0;
+
+    for(int y = 0; y < c.intensity.rows; ++y)
+    {
+      const dvo::core::IntensityType *pi = p.intensity.ptr<dvo::core::IntensityType>(y), *ci = c.intensity.ptr<dvo::core::IntensityType>(y);
+      const dvo::core::DepthType *pd = p.depth.ptr<dvo::core::DepthType>(y), *cd = c.depth.ptr<dvo::core::DepthType>(y);
+
+      for(int x = 0; x < c.intensity.cols; ++x)
+      {
+        intensity_sum += std::abs(ci[x] - pi[x]);
+
+        // nan compares false
+        if(pd[x] > 0.0f && cd[x] > 0.0f)
+        {
+          depth_sum += std::abs(cd[x] - pd[x]);
+          depth_n++;
+        }
+      }
+    }
+
+    const size_t n = c.intensity.total();
+
+    return n > 0 && intensity_sum < stationary_max_intensity_difference_ * n && (depth_n == 0 || depth_sum < stationary_max_depth_difference_ * depth_n);
+  }
+
+  /**
+   * Moves the points of the last odometry reference, whose pose relative to the keyframe is given, into the keyframe
+   * and adds the ones the keyframe doesn't cover, i.e., which project outside of it or onto pixels without depth, to
+   * the keyframe points. The derivatives of the points stay the ones of their frame, which is close to the keyframe.
+   * Has to be called after the matches.
+   */
+  void extendLocalModel(dvo::core::RgbdImagePyramid& keyframe, const dvo::core::AffineTransformd& keyframe_to_frame)
+  {
+    static dvo::util::Timer& local_model_timer = dvo::util::Instrumentation::instance().timer("local_tracker/update/local_model");
+    dvo::util::ScopedTimer local_model_scope(local_model_timer);
+
+    const Eigen::Affine3f transform = keyframe_to_frame.cast<float>();
+    dvo::core::RgbdImagePyramid& frame = active_frame_points_->getRgbdImagePyramid();
+
+    local_model_.push_back(LevelPointVectors(size_t(cfg_.FirstLevel) + 1));
+
+    for(int level = cfg_.LastLevel; level <= cfg_.FirstLevel; ++level)
+    {
+      const dvo::core::RgbdImage& k = keyframe.level(level);
+      const dvo::core::IntrinsicMatrix& intrinsics = k.camera().intrinsics();
+      const float fx = intrinsics.fx(), fy = intrinsics.fy(), ox = intrinsics.ox(), oy = intrinsics.oy();
+
+      dvo::core::PointSelection::PointIterator first_point, last_point;
+      active_frame_points_->select(level, frame.level(level).camera().intrinsics(), first_point, last_point);
+
+      dvo::core::PointSelection::PointVector& added = local_model_.back()[level];
+      added.reserve(last_point - first_point);
+
+      for(dvo::core::PointSelection::PointIterator it = first_point; it != last_point; ++it)
+      {
+        const Eigen::Vector3f p = transform * Eigen::Vector3f(it->point.x, it->point.y, it->point.z);
+
+        if(!(p.z() > 0.0f)) continue;
+
+        const float u = fx * p.x() / p.z() + ox, v = fy * p.y() / p.z() + oy;
+        const int x = int(u + 0.5f), y = int(v + 0.5f);
+
+        // nan compares false
+        if(u >= 0.0f && v >= 0.0f && x < k.depth.cols && y < k.depth.rows && k.depth.at<dvo::core::DepthType>(y, x) > 0.0f) continue;
+
+        added.push_back(*it);
+
+        dvo::core::PointWithIntensityAndDepth& q = added.back();
+        q.point.x = p.x();
+        q.point.y = p.y();
+        q.point.z = p.z();
+        q.intensity_and_depth.z = p.z();
+        q.intensity_and_depth.time_interpolation = v / float(k.depth.rows);
+      }
+    }
+
+    while(local_model_.size() > local_model_frames_) local_model_.pop_front();
+
+    for(int level = cfg_.LastLevel; level <= cfg_.FirstLevel; ++level)
+    {
+      local_model_points_.clear();
+
+      for(std::deque<LevelPointVectors>::const_iterator it = local_model_.begin(); it != local_model_.end(); ++it)
+      {
+        if(size_t(level) < it->size()) local_model_points_.insert(local_model_points_.end(), (*it)[level].begin(), (*it)[level].end());
+      }
+
+      keyframe_points_->setAdditionalPoints(level, local_model_points_);
+    }
+  }
 
-  static void match(const DenseTrackerPtr& tracker, const PointSelectionPtr& ref, const dvo::core::RgbdImagePyramid::Ptr& cur, LocalTracker::TrackingResult* r)
+  size_t localModelMemoryUsage() const
   {
-    tracker->match(*ref, *cur, *r);
+    size_t bytes = local_model_points_.capacity() * sizeof(dvo::core::PointWithIntensityAndDepth);
+
+    for(std::deque<LevelPointVectors>::const_iterator it = local_model_.begin(); it != local_model_.end(); ++it)
+      for(LevelPointVectors::const_iterator level = it->begin(); level != it->end(); ++level)
+        bytes += level->capacity() * sizeof(dvo::core::PointWithIntensityAndDepth);
+
+    return bytes;
+  }
+
+  void updatePrediction(bool predicted, const dvo::core::AffineTransformd& prediction, const LocalTracker::TrackingResult& r_odometry, double dt)
+  {
+    has_velocity_ = !r_odometry.isNaN();
+    confident_ = false;
+
+    if(!has_velocity_) return;
+
+    last_motion_ = r_odometry.Transformation;
+    last_motion_dt_ = dt;
+
+    if(predicted)
+    {
+      dvo::core::AffineTransformd error = prediction.inverse(Eigen::Isometry) * r_odometry.Transformation;
+
+      confident_ = error.translation().norm() < max_prediction_translation_error_ && Eigen::AngleAxisd(error.linear()).angle() < max_prediction_rotation_error_;
+    }
   }
 };
 } /* namespace internal */
@@ -68,8 +331,19 @@ LocalTracker::LocalTracker() :
 {
   impl_->keyframe_tracker_.reset(new dvo::DenseTracker());
   impl_->odometry_tracker_.reset(new dvo::DenseTracker());
+  impl_->cfg_ = impl_->odometry_tracker_->configuration();
   impl_->last_keyframe_pose_.setIdentity();
   impl_->force_ = false;
+  impl_->use_prediction_ = false;
+  impl_->prediction_skip_levels_ = 0;
+  impl_->max_prediction_translation_error_ = 0.0;
+  impl_->max_prediction_rotation_error_ = 0.0;
+  impl_->stationary_max_intensity_difference_ = 0.0;
+  impl_->stationary_max_depth_difference_ = 0.0;
+  impl_->stationary_level_ = 0;
+  impl_->local_model_frames_ = 0;
+  impl_->use_sparse_initialization_ = false;
+  impl_->resetPrediction();
   impl_->keyframe_points_.reset(new dvo::core::PointSelection(impl_->predicate));
   impl_->active_frame_points_.reset(new dvo::core::PointSelection(impl_->predicate));
 }
@@ -83,14 +357,39 @@ dvo_slam::LocalMap::Ptr LocalTracker::getLocalMap() const
   return local_map_;
 }
 
+void LocalTracker::memoryUsage(dvo_slam::MemoryUsage& usage) const
+{
+  if(local_map_) usage.LocalMap += local_map_->memoryUsage();
+
+  usage.Tracker += impl_->keyframe_tracker_->memoryUsage() + impl_->odometry_tracker_->memoryUsage();
+
+  if(impl_->keyframe_points_) usage.Tracker += impl_->keyframe_points_->memoryUsage();
+  if(impl_->active_frame_points_) usage.Tracker += impl_->active_frame_points_->memoryUsage();
+
+  usage.Tracker += impl_->localModelMemoryUsage();
+}
+
 void LocalTracker::getCurrentPose(dvo::core::AffineTransformd& pose)
 {
   local_map_->getCurrentFramePose(pose);
 }
 
-boost::signals2::connection LocalTracker::addAcceptCallback(const AcceptCallback& callback)
+void LocalTracker::addAcceptCallback(const std::string& name, const AcceptCallback& callback)
+{
+  internal::LocalTrackerImpl::NamedCallback<AcceptCallback> c;
+  c.callback = callback;
+  c.timer = &dvo::util::Instrumentation::instance().timer("local_tracker/accept").child(name);
+
+  impl_->accept_criteria_.push_back(c);
+}
+
+void LocalTracker::addFilterCallback(const std::string& name, const FilterCallback& callback)
 {
-  return impl_->accept_.connect(callback);
+  internal::LocalTrackerImpl::NamedCallback<FilterCallback> c;
+  c.callback = callback;
+  c.timer = &dvo::util::Instrumentation::instance().timer("local_tracker/filter").child(name);
+
+  impl_->filters_.push_back(c);
 }
 
 boost::signals2::connection LocalTracker::addMapCompleteCallback(const MapCompleteCallback& callback)
@@ -105,29 +404,82 @@ boost::signals2::connection LocalTracker::addMapInitializedCallback(const MapIni
 
 const dvo::DenseTracker::Config& LocalTracker::configuration() const
 {
-  return impl_->odometry_tracker_->configuration();
+  return impl_->cfg_;
 }
 
 void LocalTracker::configure(const dvo::DenseTracker::Config& config)
 {
-  impl_->keyframe_tracker_->configure(config);
-  impl_->odometry_tracker_->configure(config);
+  impl_->cfg_ = config;
+  impl_->configureTrackers();
 
   if(impl_->predicate.intensity_threshold != config.IntensityDerivativeThreshold || impl_->predicate.depth_threshold != config.DepthDerivativeThreshold)
   {
     impl_->predicate.intensity_threshold = config.IntensityDerivativeThreshold;
     impl_->predicate.depth_threshold = config.DepthDerivativeThreshold;
 
-    if(local_map_)
-    {
-      impl_->keyframe_points_->setRgbdImagePyramid(*local_map_->getKeyframe());
-    }
+    impl_->keyframe_points_->invalidate();
+    impl_->active_frame_points_->invalidate();
+  }
+
+  impl_->keyframe_points_->maxPointsPerLevel(config.MaxPointsPerLevel);
+  impl_->active_frame_points_->maxPointsPerLevel(config.MaxPointsPerLevel);
+  impl_->keyframe_points_->mortonOrder(config.UseMortonOrder);
+  impl_->active_frame_points_->mortonOrder(config.UseMortonOrder);
+}
+
+void LocalTracker::configurePrediction(const dvo_slam::KeyframeTrackerConfig& config)
+{
+  impl_->prediction_skip_levels_ = std::max(config.PredictionSkipLevels, 0);
+  impl_->max_prediction_translation_error_ = config.MaxPredictionTranslationError;
+  impl_->max_prediction_rotation_error_ = config.MaxPredictionRotationError;
+  impl_->stationary_max_intensity_difference_ = config.StationaryMaxIntensityDifference;
+  impl_->stationary_max_depth_difference_ = config.StationaryMaxDepthDifference;
+  impl_->stationary_level_ = config.StationaryLevel;
+
+  const size_t local_model_frames = size_t(std::max(config.LocalModelFrames, 0));
+
+  // the points already added to the keyframe go with a new selection
+  if(local_model_frames == 0 && !impl_->local_model_.empty())
+  {
+    impl_->local_model_.clear();
+    impl_->keyframe_points_->invalidate();
+  }
+
+  impl_->local_model_frames_ = local_model_frames;
+
+  impl_->sparse_.configure(size_t(std::max(config.SparseInitializationLevel, 0)), config.SparseInitializationFeatures, config.SparseInitializationMinInliers, float(config.SparseInitializationInlierThreshold), 100);
+
+  if(impl_->use_sparse_initialization_ != config.UseSparseInitialization)
+  {
+    impl_->use_sparse_initialization_ = config.UseSparseInitialization;
+    impl_->configureTrackers();
+    impl_->sparse_.reset();
+  }
+
+  if(impl_->use_prediction_ != config.UseMotionPrediction)
+  {
+    impl_->use_prediction_ = config.UseMotionPrediction;
+    impl_->configureTrackers();
+    impl_->resetPrediction();
   }
 }
+
+void LocalTracker::setRotationPrior(const Eigen::Matrix3d& rotation)
+{
+  impl_->rotation_prior_ = rotation;
+  impl_->has_rotation_prior_ = true;
+}
+
+void LocalTracker::setRelocalizeCallback(const RelocalizeCallback& callback)
+{
+  impl_->relocalize_ = callback;
+}
+
 void LocalTracker::initNewLocalMap(const dvo::core::RgbdImagePyramid::Ptr& keyframe, const dvo::core::RgbdImagePyramid::Ptr& frame, const dvo::core::AffineTransformd& keyframe_pose)
 {
   impl_->keyframe_points_->setRgbdImagePyramid(*keyframe);
   impl_->active_frame_points_->setRgbdImagePyramid(*frame);
+  impl_->local_model_.clear();
 
   TrackingResult r_odometry;
   r_odometry.Transformation.setIdentity();
@@ -135,6 +487,9 @@ void LocalTracker::initNewLocalMap(const dvo::core::RgbdImagePyramid::Ptr& keyfr
   impl_->odometry_tracker_->match(*(impl_->keyframe_points_), *frame, r_odometry);
   impl_->last_keyframe_pose_ = r_odometry.Transformation;
 
+  // the first frames carry no velocity
+  impl_->resetPrediction();
+
   initNewLocalMap(keyframe, frame, r_odometry, keyframe_pose);
 }
 
@@ -156,41 +511,109 @@ void LocalTracker::initNewLocalMap(const dvo::core::RgbdImagePyramid::Ptr& keyfr
 
 void LocalTracker::update(const dvo::core::RgbdImagePyramid::Ptr& image, dvo::core::AffineTransformd& pose)
 {
-  static dvo::util::stopwatch sw_prepare("prepare",100), sw_match("m", 100);
-  sw_prepare.start();
-  // prepare image
-  const dvo::DenseTracker::Config& config = impl_->keyframe_tracker_->configuration();
-  image->build(config.getNumLevels());
+  static dvo::util::Timer& update_timer = dvo::util::Instrumentation::instance().timer("local_tracker/update");
+  static dvo::util::Timer& prepare_timer = update_timer.child("prepare");
+  static dvo::util::Timer& match_timer = update_timer.child("match");
+  static dvo::util::Timer& skipped_levels_counter = update_timer.child("skipped_levels");
+  static dvo::util::Timer& stationary_counter = update_timer.child("stationary");
+  static dvo::util::Timer& sparse_timer = update_timer.child("sparse_initialization");
+  static dvo::util::Timer& sparse_estimated_counter = sparse_timer.child("estimated");
+  static dvo::util::Timer& relocalize_timer = update_timer.child("relocalize");
+  static dvo::util::Timer& relocalized_counter = relocalize_timer.child("relocalized");
+
+  dvo::util::ScopedTimer update_scope(update_timer);
 
-  for(int idx = config.LastLevel; idx <= config.FirstLevel; ++idx)
   {
-    image->level(idx).buildPointCloud();
-    image->level(idx).buildAccelerationStructure();
+    dvo::util::ScopedTimer prepare_scope(prepare_timer);
+
+    // prepare image
+    const dvo::DenseTracker::Config& config = impl_->keyframe_tracker_->configuration();
+    // point clouds and acceleration structures are built on demand by the trackers
+    image->build(config.getNumLevels());
+  }
+
+  // a parked camera only costs the comparison. nothing is added to the local map, so the graph gets no vertices, and
+  // the next frame is matched against the last tracked one
+  if(!impl_->force_ && impl_->stationary(*local_map_->getCurrentFrame(), *image))
+  {
+    stationary_counter.record(0.0);
+
+    // the motion before the stop isn't extrapolated over it
+    if(impl_->has_velocity_) impl_->last_motion_.setIdentity();
+    impl_->confident_ = false;
+    impl_->has_rotation_prior_ = false;
+
+    local_map_->getCurrentFramePose(pose);
+    return;
   }
-  sw_prepare.stopAndPrint();
 
   TrackingResult r_odometry, r_keyframe;
   r_odometry.Transformation.setIdentity();
   r_keyframe.Transformation = impl_->last_keyframe_pose_.inverse(Eigen::Isometry);
 
-  // recycle, so we can reuse the allocated memory
+  const double dt = image->level(0).timestamp - local_map_->getCurrentFrame()->level(0).timestamp;
+  int first_level = impl_->cfg_.FirstLevel;
+
+  dvo::core::AffineTransformd prediction;
+  const bool predicted = impl_->predict(dt, prediction);
+
+  if(predicted)
+  {
+    // the initial guesses are the inverse of the results
+    r_odometry.Transformation = prediction.inverse(Eigen::Isometry);
+    r_keyframe.Transformation = (impl_->last_keyframe_pose_ * prediction).inverse(Eigen::Isometry);
+
+    if(impl_->confident_ && impl_->prediction_skip_levels_ > 0)
+    {
+      first_level = std::max(impl_->cfg_.LastLevel, first_level - impl_->prediction_skip_levels_);
+      skipped_levels_counter.record(0.0);
+    }
+  }
+
+  impl_->has_rotation_prior_ = false;
+
+  // an accurate prediction is cheaper and better than the features, which help whenever the motion is unknown
+  if(impl_->use_sparse_initialization_ && !(predicted && impl_->confident_))
+  {
+    dvo::util::ScopedTimer sparse_scope(sparse_timer);
+
+    dvo::core::AffineTransformd motion;
+
+    if(impl_->sparse_.level() <= size_t(impl_->cfg_.FirstLevel) && impl_->sparse_.estimate(*local_map_->getCurrentFrame(), *image, motion))
+    {
+      sparse_estimated_counter.record(0.0);
+
+      r_odometry.Transformation = motion.inverse(Eigen::Isometry);
+      r_keyframe.Transformation = (impl_->last_keyframe_pose_ * motion).inverse(Eigen::Isometry);
+    }
+  }
+
+  // recycle, so we can reuse the allocated memory. the points of a frame are selected once, when it becomes the
+  // reference of the odometry, and move on to the keyframe with the swap below
   impl_->active_frame_points_->setRgbdImagePyramid(*local_map_->getCurrentFrame());
 
   // TODO: fix me!
-  boost::function<void()> h1 = boost::bind(&internal::LocalTrackerImpl::match, impl_->keyframe_tracker_, impl_->keyframe_points_, image, &r_keyframe);
-  boost::function<void()> h2 = boost::bind(&internal::LocalTrackerImpl::match, impl_->odometry_tracker_, impl_->active_frame_points_, image,  &r_odometry);
+  boost::function<void()> h1 = boost::bind(&internal::LocalTrackerImpl::match, impl_->keyframe_tracker_, impl_->keyframe_points_, image, &r_keyframe, first_level);
+  boost::function<void()> h2 = boost::bind(&internal::LocalTrackerImpl::match, impl_->odometry_tracker_, impl_->active_frame_points_, image,  &r_odometry, first_level);
 
-  sw_match.start();
-  tbb::parallel_invoke(h1, h2);
-  sw_match.stopAndPrint();
+  {
+    dvo::util::ScopedTimer match_scope(match_timer);
+    dvo::util::TaskArenas::instance().execute(dvo::util::TaskArenas::Frontend, boost::bind(&internal::LocalTrackerImpl::matchBoth, h1, h2));
+  }
 
   ROS_WARN_COND(r_odometry.isNaN(), "NAN in Odometry");
   ROS_WARN_COND(r_keyframe.isNaN(), "NAN in Keyframe");
 
+  const bool lost = r_odometry.isNaN() && r_keyframe.isNaN();
+
   impl_->force_ = impl_->force_ || r_odometry.isNaN() || r_keyframe.isNaN();
+  impl_->updatePrediction(predicted, prediction, r_odometry, dt);
 
-  if(impl_->accept_(*this, r_odometry, r_keyframe) && !impl_->force_)
+  if(impl_->accept(*this, r_odometry, r_keyframe, impl_->force_))
   {
+    // the odometry reference of this match is the frame accepted last
+    if(impl_->local_model_frames_ > 0) impl_->extendLocalModel(*local_map_->getKeyframe(), impl_->last_keyframe_pose_);
+
     local_map_->addFrame(image);
     local_map_->addOdometryMeasurement(r_odometry.Transformation, r_odometry.Information);
     local_map_->addKeyframeMeasurement(r_keyframe.Transformation, r_keyframe.Information);
@@ -200,13 +623,34 @@ void LocalTracker::update(const dvo::core::RgbdImagePyramid::Ptr& image, dvo::co
   else
   {
     impl_->force_ = false;
+    // a new keyframe is matched on all levels first
+    impl_->confident_ = false;
     impl_->keyframe_points_.swap(impl_->active_frame_points_);
+    impl_->local_model_.clear();
 
     dvo_slam::LocalMap::Ptr old_map = local_map_;
     dvo::core::AffineTransformd old_pose = old_map->getCurrentFramePose();
     impl_->map_complete_(*this, old_map);
 
-    // TODO: if we have a tracking failure in odometry and in keyframe this initialization makes no sense
+    // without a match the frame would start the new local map at the old pose. the relocalized pose becomes its first
+    // odometry measurement instead, so the chain of local maps stays connected, and once the frame is a keyframe the
+    // constraint search of the graph links it to the keyframe it was found at
+    if(lost && impl_->relocalize_)
+    {
+      dvo::util::ScopedTimer relocalize_scope(relocalize_timer);
+
+      dvo::core::AffineTransformd relocalized_pose;
+      dvo::core::Matrix6d information;
+
+      if(impl_->relocalize_(*this, image, old_pose, relocalized_pose, information))
+      {
+        relocalized_counter.record(0.0);
+
+        r_odometry.Transformation = old_pose.inverse(Eigen::Isometry) * relocalized_pose;
+        r_odometry.Information = information;
+      }
+    }
+
     initNewLocalMap(old_map->getCurrentFrame(), image, r_odometry, old_pose);
 
     impl_->last_keyframe_pose_ = r_odometry.Transformation;
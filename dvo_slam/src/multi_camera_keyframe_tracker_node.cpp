@@ -0,0 +1,40 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ros/ros.h>
+#include <ros/console.h>
+
+#include <dvo_slam/multi_camera_keyframe_tracking.h>
+
+int main(int argc, char **argv) {
+    ros::init(argc, argv, "multi_camera_keyframe_tracker");
+
+    ros::NodeHandle nh;
+    ros::NodeHandle nh_private("~");
+
+    dvo_slam::MultiCameraKeyframeTracker tracker(nh, nh_private);
+
+    ROS_INFO("started multi_camera_keyframe_tracker...");
+
+    // the image callbacks only enqueue, every camera is tracked on its own thread
+    ros::spin();
+
+    return 0;
+}
@@ -0,0 +1,367 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sstream>
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <cv_bridge/cv_bridge.h>
+
+#include <tf_conversions/tf_eigen.h>
+
+#include <geometry_msgs/PoseWithCovarianceStamped.h>
+
+#include <dvo/util/instrumentation.h>
+
+#include <dvo_slam/multi_camera_keyframe_tracking.h>
+
+#include <dvo_ros/util/configtools.h>
+#include <dvo_ros/util/util.h>
+
+namespace dvo_slam
+{
+
+using namespace dvo;
+using namespace dvo::core;
+using namespace dvo::util;
+
+MultiCameraKeyframeTracker::Camera::Camera(ros::NodeHandle& nh, const std::string& name, int sensor) :
+  name(name),
+  sensor(sensor),
+  rgb_image_subscriber(nh, name + "/rgb/image_rect", 1),
+  depth_image_subscriber(nh, name + "/depth_registered/image_rect_raw", 1),
+  rgb_camera_info_subscriber(nh, name + "/rgb/camera_info", 1),
+  depth_camera_info_subscriber(nh, name + "/depth_registered/camera_info", 1),
+  synchronizer(dvo_ros::RGBDWithCameraInfoPolicy(5), rgb_image_subscriber, depth_image_subscriber, rgb_camera_info_subscriber, depth_camera_info_subscriber),
+  queue(1),
+  tracker_cfg(dvo::DenseTracker::getDefaultConfig()),
+  width(0),
+  height(0),
+  has_extrinsics(false),
+  rig_to_camera(Eigen::Affine3d::Identity()),
+  pose(Eigen::Affine3d::Identity()),
+  rig_keyframe(0),
+  forced(false)
+{
+}
+
+MultiCameraKeyframeTracker::MultiCameraKeyframeTracker(ros::NodeHandle& nh, ros::NodeHandle& nh_private) :
+  nh_(nh),
+  tracker_reconfigure_server_(ros::NodeHandle(nh_private, "tracking")),
+  slam_reconfigure_server_(ros::NodeHandle(nh_private, "slam")),
+  tracker_cfg_(dvo::DenseTracker::getDefaultConfig()),
+  graph_(new dvo_slam::KeyframeGraph())
+{
+  rig_keyframe_ = 0;
+
+  std::string cameras;
+  nh_private.param("cameras", cameras, std::string("camera"));
+  nh_private.param("rig_frame", rig_frame_, std::string("base_link"));
+  nh_private.param("image_pool_size", image_pool_size_, 4);
+  image_pool_size_ = std::max(image_pool_size_, 2);
+
+  pose_publisher_ = nh.advertise<geometry_msgs::PoseWithCovarianceStamped>("pose", 1);
+
+  std::istringstream names(cameras);
+  std::string name;
+
+  while(names >> name)
+  {
+    cameras_.push_back(boost::make_shared<Camera>(boost::ref(nh_), name, int(cameras_.size())));
+
+    dvo_ros::util::loadDepthFilterConfig(ros::NodeHandle(nh_private, name + "/depth_filter"), cameras_.back()->depth_filter);
+  }
+
+  if(cameras_.empty()) ROS_ERROR("no cameras in ~cameras!");
+
+  // the callbacks are called by setCallback() and post the initial configuration to all cameras
+  TrackerReconfigureServer::CallbackType tracker_reconfigure_server_callback = boost::bind(&MultiCameraKeyframeTracker::handleTrackerConfig, this, _1, _2);
+  tracker_reconfigure_server_.setCallback(tracker_reconfigure_server_callback);
+
+  SlamReconfigureServer::CallbackType slam_reconfigure_server_callback = boost::bind(&MultiCameraKeyframeTracker::handleSlamConfig, this, _1, _2);
+  slam_reconfigure_server_.setCallback(slam_reconfigure_server_callback);
+
+  for(size_t idx = 0; idx < cameras_.size(); ++idx)
+  {
+    Camera& c = *cameras_[idx];
+
+    c.synchronizer.registerCallback(boost::bind(&MultiCameraKeyframeTracker::handleImages, this, boost::ref(c), _1, _2, _3, _4));
+    c.thread = boost::thread(&MultiCameraKeyframeTracker::trackFrames, this, boost::ref(c));
+  }
+
+  ROS_INFO_STREAM("tracking " << cameras_.size() << " cameras in the rig frame " << rig_frame_);
+}
+
+MultiCameraKeyframeTracker::~MultiCameraKeyframeTracker()
+{
+  for(size_t idx = 0; idx < cameras_.size(); ++idx)
+  {
+    cameras_[idx]->queue.shutdown();
+  }
+
+  for(size_t idx = 0; idx < cameras_.size(); ++idx)
+  {
+    cameras_[idx]->thread.join();
+  }
+
+  graph_->finalOptimization();
+}
+
+void MultiCameraKeyframeTracker::handleTrackerConfig(dvo_ros::CameraDenseTrackerConfig& config, uint32_t level)
+{
+  if(level == 0) return;
+
+  if(level & dvo_ros::CameraDenseTracker_ConfigParam)
+  {
+    // fix config, so we don't die by accident
+    if(config.coarsest_level < config.finest_level)
+    {
+      config.finest_level = config.coarsest_level;
+    }
+
+    dvo_ros::util::updateConfigFromDynamicReconfigure(config, tracker_cfg_);
+
+    // the graph is shared, so only we configure it, the cameras configure their own trackers
+    graph_->configureValidationTracking(tracker_cfg_);
+
+    for(size_t idx = 0; idx < cameras_.size(); ++idx)
+    {
+      cameras_[idx]->pending_tracker_cfg.post(tracker_cfg_);
+    }
+  }
+}
+
+void MultiCameraKeyframeTracker::handleSlamConfig(dvo_slam::KeyframeSlamConfig& config, uint32_t level)
+{
+  dvo_slam::updateConfigFromDynamicReconfigure(config, slam_cfg_.keyframe_tracker_cfg, slam_cfg_.graph_cfg);
+
+  graph_->configure(slam_cfg_.graph_cfg);
+
+  for(size_t idx = 0; idx < cameras_.size(); ++idx)
+  {
+    cameras_[idx]->pending_keyframe_cfg.post(slam_cfg_.keyframe_tracker_cfg);
+  }
+
+  if(config.graph_opt_final)
+  {
+    config.graph_opt_final = false;
+    graph_->finalOptimization();
+  }
+}
+
+void MultiCameraKeyframeTracker::handleImages(
+    Camera& camera,
+    const sensor_msgs::Image::ConstPtr& rgb_image_msg,
+    const sensor_msgs::Image::ConstPtr& depth_image_msg,
+    const sensor_msgs::CameraInfo::ConstPtr& rgb_camera_info_msg,
+    const sensor_msgs::CameraInfo::ConstPtr& depth_camera_info_msg
+)
+{
+  if(depth_camera_info_msg->width != rgb_camera_info_msg->width || depth_camera_info_msg->height != rgb_camera_info_msg->height)
+  {
+    ROS_WARN_STREAM("RGB and depth image of " << camera.name << " have different size!");
+
+    return;
+  }
+
+  Frame frame;
+  frame.rgb = rgb_image_msg;
+  frame.depth = depth_image_msg;
+  frame.rgb_camera_info = rgb_camera_info_msg;
+
+  // a camera which can't keep up only drops its own frames
+  if(!camera.queue.push(frame))
+  {
+    ROS_DEBUG_STREAM("dropped frame of " << camera.name);
+  }
+}
+
+void MultiCameraKeyframeTracker::handleKeyframe(Camera& camera)
+{
+  // a keyframe this camera was forced to take follows the rig keyframe of another camera
+  if(camera.forced)
+  {
+    camera.forced = false;
+    return;
+  }
+
+  camera.rig_keyframe = ++rig_keyframe_;
+}
+
+void MultiCameraKeyframeTracker::trackFrames(Camera& camera)
+{
+  Frame frame;
+
+  while(camera.queue.pop(frame))
+  {
+    track(camera, frame);
+
+    frame = Frame();
+  }
+}
+
+void MultiCameraKeyframeTracker::initialize(Camera& camera, const Frame& frame)
+{
+  IntrinsicMatrix intrinsics = IntrinsicMatrix::create(frame.rgb_camera_info->P[0], frame.rgb_camera_info->P[5], frame.rgb_camera_info->P[2], frame.rgb_camera_info->P[6]);
+
+  camera.camera.reset(new dvo::core::RgbdCameraPyramid(frame.rgb_camera_info->width, frame.rgb_camera_info->height, intrinsics));
+  camera.camera->build(camera.tracker_cfg.getNumLevels());
+  camera.camera->setPoolSize(image_pool_size_);
+  camera.camera->setDepthFilter(camera.depth_filter);
+
+  if(!camera.has_extrinsics)
+  {
+    tf::StampedTransform rig_to_camera;
+
+    try
+    {
+      // the rig is rigid, so the latest transform is as good as any
+      tl_.waitForTransform(rig_frame_, frame.rgb->header.frame_id, ros::Time(0), ros::Duration(5.0));
+      tl_.lookupTransform(rig_frame_, frame.rgb->header.frame_id, ros::Time(0), rig_to_camera);
+
+      tf::TransformTFToEigen(rig_to_camera, camera.rig_to_camera);
+      camera.has_extrinsics = true;
+
+      Eigen::Isometry3d extrinsics(camera.rig_to_camera.rotation());
+      extrinsics.translation() = camera.rig_to_camera.translation();
+
+      graph_->setSensorExtrinsics(camera.sensor, extrinsics);
+    }
+    catch(tf::TransformException& e)
+    {
+      ROS_WARN_STREAM("no extrinsics for " << camera.name << ", its keyframes aren't tied to the rig: " << e.what());
+    }
+  }
+
+  camera.tracker.reset(new KeyframeTracker(graph_, camera.sensor));
+  camera.tracker->addKeyframeCallback(boost::bind(&MultiCameraKeyframeTracker::handleKeyframe, this, boost::ref(camera)));
+  camera.tracker->configureLocalTracking(camera.tracker_cfg);
+  camera.tracker->configureKeyframeSelection(camera.keyframe_cfg);
+
+  static RgbdImagePyramid* const __null__ = 0;
+
+  camera.reference.reset(__null__);
+  camera.current.reset(__null__);
+
+  camera.width = frame.rgb_camera_info->width;
+  camera.height = frame.rgb_camera_info->height;
+}
+
+void MultiCameraKeyframeTracker::track(Camera& camera, const Frame& frame)
+{
+  static Timer& track_timer = Instrumentation::instance().timer("multi_camera_keyframe_tracker/track");
+  ScopedTimer track_scope(track_timer.child(size_t(camera.sensor)));
+
+  // the chain of the camera in the graph can't continue with another image size
+  if(camera.tracker && (camera.width != frame.rgb_camera_info->width || camera.height != frame.rgb_camera_info->height))
+  {
+    ROS_WARN_STREAM_THROTTLE(1.0, "image size of " << camera.name << " has changed, dropping its frames!");
+
+    return;
+  }
+
+  // frame boundary, configurations posted since the last frame take effect from here on
+  bool reconfigure_tracking = camera.pending_tracker_cfg.take(camera.tracker_cfg);
+  bool reconfigure_keyframes = camera.pending_keyframe_cfg.take(camera.keyframe_cfg);
+
+  // levels chosen by their pixel counts depend on the image size of the camera
+  if(reconfigure_tracking || !camera.tracker) camera.tracker_cfg.fitLevels(frame.rgb_camera_info->width, frame.rgb_camera_info->height);
+
+  if(!camera.tracker)
+  {
+    initialize(camera, frame);
+  }
+  else
+  {
+    if(reconfigure_tracking)
+    {
+      camera.tracker->configureLocalTracking(camera.tracker_cfg);
+      camera.camera->build(camera.tracker_cfg.getNumLevels());
+    }
+
+    if(reconfigure_keyframes)
+    {
+      camera.tracker->configureKeyframeSelection(camera.keyframe_cfg);
+    }
+  }
+
+  // shares the message buffers, intensity and depth are converted straight into the pyramid
+  cv::Mat rgb_in = cv_bridge::toCvShare(frame.rgb)->image;
+  cv::Mat depth_in = cv_bridge::toCvShare(frame.depth)->image;
+
+  camera.reference.swap(camera.current);
+  // drop the old reference first, so its pyramid can be recycled
+  camera.current.reset();
+  camera.current = camera.camera->create(rgb_in, depth_in, 0.001f, false);
+  camera.current->build(camera.tracker_cfg.getNumLevels());
+
+  // all trackers start with the rig at the origin, so their estimates share one world frame
+  if(!camera.reference)
+  {
+    camera.pose = camera.rig_to_camera;
+    camera.tracker->init(camera.pose);
+
+    return;
+  }
+
+  // follow a keyframe, which another camera of the rig took since our last frame
+  size_t rig_keyframe = rig_keyframe_;
+
+  if(rig_keyframe != camera.rig_keyframe)
+  {
+    camera.rig_keyframe = rig_keyframe;
+    camera.forced = true;
+    camera.tracker->forceKeyframe();
+  }
+
+  camera.tracker->update(camera.current, frame.rgb->header.stamp, camera.pose);
+
+  publishTransform(frame.rgb->header, camera.pose, camera.name + "_estimate");
+
+  // the first camera publishes the pose of the rig
+  if(camera.sensor == 0 && camera.has_extrinsics)
+  {
+    publishTransform(frame.rgb->header, camera.pose * camera.rig_to_camera.inverse(), rig_frame_ + "_estimate");
+  }
+}
+
+void MultiCameraKeyframeTracker::publishTransform(const std_msgs::Header& header, const Eigen::Affine3d& transform, const std::string& frame)
+{
+  tf::StampedTransform tf_transform;
+  tf_transform.frame_id_ = "world";
+  tf_transform.child_frame_id_ = frame;
+  tf_transform.stamp_ = header.stamp;
+
+  tf::TransformEigenToTF(transform, tf_transform);
+
+  tb_.sendTransform(tf_transform);
+
+  if(frame != rig_frame_ + "_estimate") return;
+
+  geometry_msgs::PoseWithCovarianceStamped pose_msg;
+
+  tf::poseTFToMsg(tf_transform, pose_msg.pose.pose);
+  pose_msg.header.frame_id = frame;
+  pose_msg.header.stamp = header.stamp;
+
+  pose_publisher_.publish(pose_msg);
+}
+
+} /* namespace dvo_slam */
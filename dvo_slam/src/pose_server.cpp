@@ -0,0 +1,111 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+
+#include <sophus/se3.hpp>
+
+#include <dvo_slam/pose_server.h>
+
+namespace dvo_slam
+{
+
+// frames further apart don't give a useful velocity, e.g. after the sensor paused
+static const double MaxVelocityInterval = 0.5;
+
+PoseServer::State::State() :
+    Stamp(0.0),
+    Valid(false),
+    Pose(Eigen::Affine3d::Identity()),
+    Velocity(Eigen::Matrix<double, 6, 1>::Zero())
+{
+}
+
+PoseServer::PoseServer(double max_extrapolation) :
+    max_extrapolation_(max_extrapolation)
+{
+}
+
+void PoseServer::maxExtrapolation(double seconds)
+{
+  max_extrapolation_ = std::max(seconds, 0.0);
+}
+
+double PoseServer::maxExtrapolation() const
+{
+  return max_extrapolation_;
+}
+
+void PoseServer::update(double stamp, const Eigen::Affine3d& pose)
+{
+  State next;
+  next.Stamp = stamp;
+  next.Valid = true;
+  next.Pose = pose;
+
+  const double dt = stamp - last_.Stamp;
+
+  if(last_.Valid && dt > 0.0 && dt < MaxVelocityInterval)
+  {
+    Eigen::Affine3d motion = last_.Pose.inverse() * pose;
+    next.Velocity = Sophus::SE3d(motion.rotation(), motion.translation()).log() / dt;
+  }
+
+  last_ = next;
+  state_.store(next);
+}
+
+void PoseServer::reset()
+{
+  last_ = State();
+  state_.store(last_);
+}
+
+bool PoseServer::query(double stamp, Eigen::Affine3d& pose) const
+{
+  State s;
+  state_.load(s);
+
+  if(!s.Valid) return false;
+
+  const double dt = std::max(-max_extrapolation_, std::min(stamp - s.Stamp, max_extrapolation_));
+
+  Sophus::SE3d m = Sophus::SE3d::exp(s.Velocity * dt);
+
+  Eigen::Affine3d motion = Eigen::Affine3d::Identity();
+  motion.linear() = m.rotationMatrix();
+  motion.translation() = m.translation();
+
+  pose = s.Pose * motion;
+
+  return true;
+}
+
+void PoseServer::latest(State& state) const
+{
+  state_.load(state);
+}
+
+size_t PoseServer::version() const
+{
+  return state_.version();
+}
+
+} /* namespace dvo_slam */
@@ -0,0 +1,636 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo_slam/remote_backend.h>
+#include <dvo_slam/serialization/local_map_packet.h>
+
+#include <dvo_slam/LocalMapPacket.h>
+#include <dvo_slam/RemoteBackendFeedback.h>
+
+#include <dvo/util/instrumentation.h>
+#include <dvo/util/seqlock.h>
+
+#include <deque>
+#include <map>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace dvo_slam
+{
+
+namespace internal
+{
+
+static void toPoseMsg(const Eigen::Isometry3d& pose, geometry_msgs::Pose& msg)
+{
+  Eigen::Quaterniond q(pose.rotation());
+
+  msg.position.x = pose.translation()(0);
+  msg.position.y = pose.translation()(1);
+  msg.position.z = pose.translation()(2);
+  msg.orientation.w = q.w();
+  msg.orientation.x = q.x();
+  msg.orientation.y = q.y();
+  msg.orientation.z = q.z();
+}
+
+static Eigen::Isometry3d fromPoseMsg(const geometry_msgs::Pose& msg)
+{
+  Eigen::Isometry3d pose(Eigen::Quaterniond(msg.orientation.w, msg.orientation.x, msg.orientation.y, msg.orientation.z).normalized());
+  pose.translation() = Eigen::Vector3d(msg.position.x, msg.position.y, msg.position.z);
+
+  return pose;
+}
+
+class RemoteBackendClientImpl
+{
+public:
+  struct Correction
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Eigen::Isometry3d Pose;
+    size_t Revision;
+
+    // wall time of the feedback in seconds, 0 before the first one
+    double Stamp;
+  };
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+  RemoteBackendClientImpl(ros::NodeHandle& nh, int sensor, size_t max_queued_maps, double resend_timeout) :
+    sensor_(sensor),
+    max_queued_maps_(std::max(max_queued_maps, size_t(1))),
+    resend_timeout_(resend_timeout),
+    next_sequence_(0),
+    dropped_(0),
+    shutdown_(false)
+  {
+    Correction c;
+    c.Pose.setIdentity();
+    c.Revision = 0;
+    c.Stamp = 0.0;
+    correction_.store(c);
+
+    publisher_ = nh.advertise<dvo_slam::LocalMapPacket>("local_maps", 16);
+    subscriber_ = nh.subscribe("backend_feedback", 16, &RemoteBackendClientImpl::handleFeedback, this);
+
+    thread_ = boost::thread(&RemoteBackendClientImpl::sendMaps, this);
+  }
+
+  ~RemoteBackendClientImpl()
+  {
+    subscriber_.shutdown();
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      shutdown_ = true;
+    }
+    wake_.notify_all();
+
+    thread_.join();
+  }
+
+  void add(const LocalMap::Ptr& map)
+  {
+    static dvo::util::Timer& dropped_counter = dvo::util::Instrumentation::instance().timer("remote_backend/client").child("dropped");
+
+    boost::mutex::scoped_lock lock(mutex_);
+
+    Queued q;
+    q.Sequence = next_sequence_++;
+    q.Map = map;
+    queued_.push_back(q);
+
+    // the oldest map goes first, the sent ones are older than the queued ones
+    if(queued_.size() + outbox_.size() > max_queued_maps_)
+    {
+      if(!outbox_.empty())
+        outbox_.pop_front();
+      else
+        queued_.pop_front();
+
+      ++dropped_;
+      dropped_counter.record(0.0);
+
+      ROS_WARN_STREAM("remote backend of sensor " << sensor_ << " is not keeping up, dropped a local map");
+    }
+
+    wake_.notify_one();
+  }
+
+  void correction(Correction& c) const
+  {
+    correction_.load(c);
+  }
+
+  bool connected() const
+  {
+    Correction c;
+    correction_.load(c);
+
+    return c.Stamp > 0.0 && ros::WallTime::now().toSec() - c.Stamp < resend_timeout_;
+  }
+
+  size_t pending() const
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    return queued_.size() + outbox_.size();
+  }
+
+  size_t dropped() const
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    return dropped_;
+  }
+private:
+  struct Queued
+  {
+    uint32_t Sequence;
+    LocalMap::Ptr Map;
+  };
+
+  struct Outgoing
+  {
+    uint32_t Sequence;
+    dvo_slam::LocalMapPacketPtr Packet;
+    ros::WallTime Sent;
+  };
+
+  int sensor_;
+  size_t max_queued_maps_;
+  double resend_timeout_;
+
+  ros::Publisher publisher_;
+  ros::Subscriber subscriber_;
+
+  mutable boost::mutex mutex_;
+  boost::condition_variable wake_;
+
+  // waiting for the encoding and sent but not yet acknowledged, mutex_ has to be held
+  std::deque<Queued> queued_;
+  std::deque<Outgoing> outbox_;
+  uint32_t next_sequence_;
+  size_t dropped_;
+  bool shutdown_;
+
+  // only written by the feedback callback
+  dvo::util::Seqlock<Correction> correction_;
+
+  boost::thread thread_;
+
+  void sendMaps()
+  {
+    static dvo::util::Timer& send_timer = dvo::util::Instrumentation::instance().timer("remote_backend/client");
+    static dvo::util::Timer& resend_counter = send_timer.child("resent");
+    static dvo::util::Timer& failed_counter = send_timer.child("failed");
+
+    const boost::posix_time::milliseconds poll(std::max(int(resend_timeout_ * 250.0), 10));
+
+    for(;;)
+    {
+      std::deque<Queued> maps;
+
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        if(!shutdown_ && queued_.empty()) wake_.timed_wait(lock, poll);
+        if(shutdown_) break;
+
+        maps.swap(queued_);
+      }
+
+      for(std::deque<Queued>::iterator it = maps.begin(); it != maps.end(); ++it)
+      {
+        dvo::util::ScopedTimer send_scope(send_timer);
+
+        dvo_slam::LocalMapPacketPtr packet(new dvo_slam::LocalMapPacket());
+        packet->header.stamp = ros::Time(it->Map->getKeyframe()->timestamp());
+        packet->sensor = sensor_;
+        packet->sequence = it->Sequence;
+
+        // the backend skips the sequence number once later packets arrive
+        if(!serialization::encodeLocalMapPacket(it->Map, it->Sequence, packet->data))
+        {
+          failed_counter.record(0.0);
+          ROS_WARN_STREAM("failed to encode local map " << it->Sequence << " of sensor " << sensor_);
+          continue;
+        }
+
+        Outgoing o;
+        o.Sequence = it->Sequence;
+        o.Packet = packet;
+        o.Sent = ros::WallTime::now();
+
+        publisher_.publish(dvo_slam::LocalMapPacketConstPtr(packet));
+
+        boost::mutex::scoped_lock lock(mutex_);
+        outbox_.push_back(o);
+
+        // add() doesn't see the maps while they are encoded
+        while(outbox_.size() + queued_.size() > max_queued_maps_)
+        {
+          outbox_.pop_front();
+          ++dropped_;
+        }
+      }
+
+      // nothing to resend to while the backend is unreachable, everything goes out again once it subscribes
+      if(publisher_.getNumSubscribers() == 0) continue;
+
+      std::vector<dvo_slam::LocalMapPacketPtr> resend;
+
+      {
+        boost::mutex::scoped_lock lock(mutex_);
+
+        const ros::WallTime now = ros::WallTime::now();
+
+        for(std::deque<Outgoing>::iterator it = outbox_.begin(); it != outbox_.end(); ++it)
+        {
+          if((now - it->Sent).toSec() < resend_timeout_) continue;
+
+          it->Sent = now;
+          resend.push_back(it->Packet);
+        }
+      }
+
+      for(std::vector<dvo_slam::LocalMapPacketPtr>::iterator it = resend.begin(); it != resend.end(); ++it)
+      {
+        resend_counter.record(0.0);
+        publisher_.publish(dvo_slam::LocalMapPacketConstPtr(*it));
+      }
+    }
+  }
+
+  void handleFeedback(const dvo_slam::RemoteBackendFeedbackConstPtr& msg)
+  {
+    if(msg->sensor != sensor_) return;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      // sequence numbers wrap around after 2^32 maps
+      while(!outbox_.empty() && int32_t(msg->acknowledged - outbox_.front().Sequence) >= 0) outbox_.pop_front();
+    }
+
+    Correction c;
+    c.Pose = fromPoseMsg(msg->correction);
+    c.Revision = msg->revision;
+    c.Stamp = ros::WallTime::now().toSec();
+    correction_.store(c);
+  }
+};
+
+class RemoteBackendServerImpl
+{
+public:
+  RemoteBackendServerImpl(ros::NodeHandle& nh, const boost::shared_ptr<KeyframeGraph>& graph, size_t num_levels, double gap_timeout, size_t max_reordered) :
+    graph_(graph),
+    num_levels_(num_levels),
+    gap_timeout_(gap_timeout),
+    max_reordered_(std::max(max_reordered, size_t(1))),
+    received_(0),
+    skipped_(0)
+  {
+    publisher_ = nh.advertise<dvo_slam::RemoteBackendFeedback>("backend_feedback", 16);
+    subscriber_ = nh.subscribe("local_maps", 64, &RemoteBackendServerImpl::handlePacket, this);
+
+    graph_->addMapChangedCallback(boost::bind(&RemoteBackendServerImpl::handleMapChanged, this, _1));
+  }
+
+  ~RemoteBackendServerImpl()
+  {
+    subscriber_.shutdown();
+  }
+
+  size_t received() const
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    return received_;
+  }
+
+  size_t skipped() const
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+
+    return skipped_;
+  }
+private:
+  typedef std::map<uint32_t, dvo_slam::LocalMapPacketConstPtr> PacketMap;
+  typedef std::map<double, Eigen::Isometry3d, std::less<double>, Eigen::aligned_allocator<std::pair<const double, Eigen::Isometry3d> > > PoseMap;
+
+  struct Sensor
+  {
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    Sensor() :
+      next(0),
+      started(false)
+    {
+    }
+
+    uint32_t next;
+    bool started;
+
+    // packets after a missing one, and since when the missing one is waited for
+    PacketMap reordered;
+    ros::WallTime gap_since;
+
+    // the images of the keyframes reference it, so a camera is only replaced, never destroyed
+    boost::shared_ptr<dvo::core::RgbdCameraPyramid> camera;
+
+    // keyframe poses of the frontend by timestamp, for the correction
+    PoseMap sent_poses;
+
+    Eigen::Isometry3d correction;
+    size_t revision;
+  };
+
+  typedef std::map<int, Sensor, std::less<int>, Eigen::aligned_allocator<std::pair<const int, Sensor> > > SensorMap;
+
+  boost::shared_ptr<KeyframeGraph> graph_;
+  size_t num_levels_;
+  double gap_timeout_;
+  size_t max_reordered_;
+
+  ros::Publisher publisher_;
+  ros::Subscriber subscriber_;
+
+  mutable boost::mutex mutex_;
+  SensorMap sensors_;
+  std::vector<boost::shared_ptr<dvo::core::RgbdCameraPyramid> > cameras_;
+  size_t received_, skipped_;
+
+  void handlePacket(const dvo_slam::LocalMapPacketConstPtr& msg)
+  {
+    static dvo::util::Timer& receive_timer = dvo::util::Instrumentation::instance().timer("remote_backend/server");
+    static dvo::util::Timer& duplicate_counter = receive_timer.child("duplicate");
+    static dvo::util::Timer& skipped_counter = receive_timer.child("skipped");
+
+    std::vector<LocalMap::Ptr> maps;
+    dvo_slam::RemoteBackendFeedback feedback;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      Sensor& s = sensors_[msg->sensor];
+
+      // every client numbers its maps from 0, so an early packet arriving late isn't taken for a duplicate. if the
+      // first ones were dropped, e.g., by a server started later, the gap timeout continues the chain
+      if(!s.started)
+      {
+        s.started = true;
+        s.correction.setIdentity();
+        s.revision = 0;
+      }
+
+      if(int32_t(msg->sequence - s.next) < 0)
+      {
+        // resent because the acknowledgement got lost, it is repeated below
+        duplicate_counter.record(0.0);
+      }
+      else
+      {
+        s.reordered[msg->sequence] = msg;
+      }
+
+      drain(s, maps);
+
+      if(!s.reordered.empty())
+      {
+        const ros::WallTime now = ros::WallTime::now();
+
+        if(s.gap_since.isZero()) s.gap_since = now;
+
+        if((now - s.gap_since).toSec() > gap_timeout_ || s.reordered.size() > max_reordered_)
+        {
+          const uint32_t first = s.reordered.begin()->first;
+
+          ROS_WARN_STREAM("local maps " << s.next << " to " << (first - 1) << " of sensor " << msg->sensor << " are missing, continuing the chain at " << first);
+
+          skipped_ += first - s.next;
+          skipped_counter.record(0.0);
+          s.next = first;
+
+          drain(s, maps);
+        }
+      }
+
+      feedbackMessage(msg->sensor, s, feedback);
+    }
+
+    // outside of the lock, the map changed callback takes it from the mapping thread
+    for(std::vector<LocalMap::Ptr>::iterator it = maps.begin(); it != maps.end(); ++it)
+    {
+      graph_->add(*it);
+    }
+
+    publisher_.publish(feedback);
+  }
+
+  // decodes the consecutive packets starting at the next expected one, mutex_ has to be held
+  void drain(Sensor& s, std::vector<LocalMap::Ptr>& maps)
+  {
+    while(!s.reordered.empty() && s.reordered.begin()->first == s.next)
+    {
+      LocalMap::Ptr map = decode(s, *s.reordered.begin()->second);
+
+      if(map)
+      {
+        maps.push_back(map);
+        ++received_;
+      }
+      else
+      {
+        ++skipped_;
+      }
+
+      s.reordered.erase(s.reordered.begin());
+      ++s.next;
+    }
+
+    if(s.reordered.empty()) s.gap_since = ros::WallTime();
+  }
+
+  LocalMap::Ptr decode(Sensor& s, const dvo_slam::LocalMapPacket& msg)
+  {
+    LocalMap::Ptr map;
+
+    const uint8_t* data = msg.data.empty() ? 0 : &msg.data[0];
+
+    size_t width, height;
+    dvo::core::IntrinsicMatrix intrinsics;
+
+    if(!serialization::decodeLocalMapPacketCamera(data, msg.data.size(), width, height, intrinsics))
+    {
+      ROS_WARN_STREAM("invalid local map packet " << msg.sequence << " of sensor " << msg.sensor << ", skipping it");
+      return map;
+    }
+
+    if(!s.camera || s.camera->level(0).width() != width || s.camera->level(0).height() != height || !s.camera->level(0).intrinsics().data.isApprox(intrinsics.data))
+    {
+      s.camera.reset(new dvo::core::RgbdCameraPyramid(width, height, intrinsics));
+      cameras_.push_back(s.camera);
+    }
+
+    serialization::LocalMapPacketInfo info;
+
+    if(!serialization::decodeLocalMapPacket(data, msg.data.size(), *s.camera, num_levels_, map, info))
+    {
+      ROS_WARN_STREAM("failed to decode local map packet " << msg.sequence << " of sensor " << msg.sensor << ", skipping it");
+      return LocalMap::Ptr();
+    }
+
+    s.sent_poses[info.KeyframeTimestamp] = info.KeyframePose;
+
+    // the correction is computed from the latest keyframes, older ones are not needed anymore
+    while(s.sent_poses.size() > 2 * max_reordered_) s.sent_poses.erase(s.sent_poses.begin());
+
+    return map;
+  }
+
+  // mutex_ has to be held
+  void feedbackMessage(int sensor, const Sensor& s, dvo_slam::RemoteBackendFeedback& msg) const
+  {
+    msg.header.stamp = ros::Time::now();
+    msg.sensor = sensor;
+    msg.acknowledged = s.next - 1;
+    msg.revision = s.revision;
+    toPoseMsg(s.correction, msg.correction);
+  }
+
+  /**
+   * The newest keyframe of every sensor which still has its frontend pose gives the correction, it maps the frontend
+   * pose of the keyframe onto the optimized one.
+   */
+  void handleMapChanged(KeyframeGraph& graph)
+  {
+    std::vector<dvo_slam::RemoteBackendFeedback> feedback;
+
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      for(SensorMap::iterator it = sensors_.begin(); it != sensors_.end(); ++it)
+      {
+        Sensor& s = it->second;
+
+        const KeyframeVector& keyframes = graph.keyframes();
+
+        for(KeyframeVector::const_reverse_iterator kf = keyframes.rbegin(); kf != keyframes.rend(); ++kf)
+        {
+          if((*kf)->sensor() != it->first) continue;
+
+          PoseMap::const_iterator sent = s.sent_poses.find((*kf)->image()->timestamp());
+
+          if(sent == s.sent_poses.end()) continue;
+
+          Eigen::Isometry3d pose((*kf)->pose().rotation());
+          pose.translation() = (*kf)->pose().translation();
+
+          s.correction = pose * sent->second.inverse();
+          s.revision = graph.revision();
+
+          feedback.push_back(dvo_slam::RemoteBackendFeedback());
+          feedbackMessage(it->first, s, feedback.back());
+          break;
+        }
+      }
+    }
+
+    for(std::vector<dvo_slam::RemoteBackendFeedback>::iterator it = feedback.begin(); it != feedback.end(); ++it)
+    {
+      publisher_.publish(*it);
+    }
+  }
+};
+
+} /* namespace internal */
+
+RemoteBackendClient::RemoteBackendClient(ros::NodeHandle& nh, int sensor, size_t max_queued_maps, double resend_timeout) :
+    impl_(new internal::RemoteBackendClientImpl(nh, sensor, max_queued_maps, resend_timeout))
+{
+}
+
+RemoteBackendClient::~RemoteBackendClient()
+{
+}
+
+void RemoteBackendClient::add(const LocalMap::Ptr& map)
+{
+  impl_->add(map);
+}
+
+Eigen::Isometry3d RemoteBackendClient::correction() const
+{
+  internal::RemoteBackendClientImpl::Correction c;
+  impl_->correction(c);
+
+  return c.Pose;
+}
+
+size_t RemoteBackendClient::revision() const
+{
+  internal::RemoteBackendClientImpl::Correction c;
+  impl_->correction(c);
+
+  return c.Revision;
+}
+
+bool RemoteBackendClient::connected() const
+{
+  return impl_->connected();
+}
+
+size_t RemoteBackendClient::pending() const
+{
+  return impl_->pending();
+}
+
+size_t RemoteBackendClient::dropped() const
+{
+  return impl_->dropped();
+}
+
+RemoteBackendServer::RemoteBackendServer(ros::NodeHandle& nh, const boost::shared_ptr<KeyframeGraph>& graph, size_t num_levels, double gap_timeout, size_t max_reordered) :
+    impl_(new internal::RemoteBackendServerImpl(nh, graph, num_levels, gap_timeout, max_reordered))
+{
+}
+
+RemoteBackendServer::~RemoteBackendServer()
+{
+}
+
+size_t RemoteBackendServer::received() const
+{
+  return impl_->received();
+}
+
+size_t RemoteBackendServer::skipped() const
+{
+  return impl_->skipped();
+}
+
+} /* namespace dvo_slam */
@@ -0,0 +1,152 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ros/ros.h>
+#include <ros/console.h>
+
+#include <boost/bind.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <dynamic_reconfigure/server.h>
+
+#include <dvo_ros/CameraDenseTrackerConfig.h>
+#include <dvo_ros/util/configtools.h>
+
+#include <dvo_slam/config.h>
+#include <dvo_slam/keyframe_graph.h>
+#include <dvo_slam/remote_backend.h>
+#include <dvo_slam/KeyframeSlamConfig.h>
+#include <dvo_slam/PoseDeltaArray.h>
+#include <dvo_slam/serialization/map_serializer.h>
+
+/**
+ * Keyframe graph for camera_keyframe_tracker nodes running with ~remote_backend/enabled, the optimized poses are
+ * published on graph_delta like by the trackers themselves.
+ */
+class RemoteBackendNode
+{
+public:
+  RemoteBackendNode(ros::NodeHandle& nh, ros::NodeHandle& nh_private) :
+    tracker_reconfigure_server_(ros::NodeHandle(nh_private, "tracking")),
+    slam_reconfigure_server_(ros::NodeHandle(nh_private, "slam")),
+    graph_(new dvo_slam::KeyframeGraph()),
+    tracker_cfg_(dvo::DenseTracker::getDefaultConfig()),
+    num_levels_(0)
+  {
+    double graph_delta_translation, graph_delta_rotation, gap_timeout;
+    int max_reordered;
+
+    nh_private.param("graph_delta_translation", graph_delta_translation, 0.01);
+    nh_private.param("graph_delta_rotation", graph_delta_rotation, 0.01);
+    nh_private.param("gap_timeout", gap_timeout, 5.0);
+    nh_private.param("max_reordered", max_reordered, 32);
+
+    graph_delta_publisher_ = nh.advertise<dvo_slam::PoseDeltaArray>("graph_delta", 10);
+    graph_delta_serializer_.reset(new dvo_slam::serialization::DeltaMessageSerializer(graph_delta_msg_, graph_delta_translation, graph_delta_rotation));
+    graph_->addMapChangedCallback(boost::bind(&RemoteBackendNode::handleMapChanged, this, _1));
+
+    // both call back immediately, so the graph is configured before the first map arrives
+    tracker_reconfigure_server_.setCallback(boost::bind(&RemoteBackendNode::handleTrackerConfig, this, _1, _2));
+    slam_reconfigure_server_.setCallback(boost::bind(&RemoteBackendNode::handleSlamConfig, this, _1, _2));
+
+    num_levels_ = tracker_cfg_.getNumLevels();
+    server_.reset(new dvo_slam::RemoteBackendServer(nh, graph_, num_levels_, gap_timeout, size_t(std::max(max_reordered, 1))));
+  }
+
+  ~RemoteBackendNode()
+  {
+    graph_->finalOptimization();
+  }
+private:
+  typedef dynamic_reconfigure::Server<dvo_ros::CameraDenseTrackerConfig> TrackerReconfigureServer;
+  typedef dynamic_reconfigure::Server<dvo_slam::KeyframeSlamConfig> SlamReconfigureServer;
+
+  TrackerReconfigureServer tracker_reconfigure_server_;
+  SlamReconfigureServer slam_reconfigure_server_;
+
+  boost::shared_ptr<dvo_slam::KeyframeGraph> graph_;
+  boost::scoped_ptr<dvo_slam::RemoteBackendServer> server_;
+  size_t num_levels_;
+
+  dvo::DenseTracker::Config tracker_cfg_;
+  dvo_slam::KeyframeTrackerConfig keyframe_tracker_cfg_;
+  dvo_slam::KeyframeGraphConfig graph_cfg_;
+
+  ros::Publisher graph_delta_publisher_;
+  dvo_slam::PoseDeltaArray graph_delta_msg_;
+  boost::scoped_ptr<dvo_slam::serialization::DeltaMessageSerializer> graph_delta_serializer_;
+
+  void handleTrackerConfig(dvo_ros::CameraDenseTrackerConfig& config, uint32_t level)
+  {
+    if(config.coarsest_level < config.finest_level)
+    {
+      config.finest_level = config.coarsest_level;
+    }
+
+    dvo_ros::util::updateConfigFromDynamicReconfigure(config, tracker_cfg_);
+
+    // the pyramid levels of the keyframes are fixed once the server is running
+    if(server_ && tracker_cfg_.getNumLevels() > num_levels_)
+    {
+      ROS_WARN_STREAM("the keyframes only have the " << num_levels_ << " levels of the initial tracking configuration");
+    }
+
+    graph_->configureValidationTracking(tracker_cfg_);
+  }
+
+  void handleSlamConfig(dvo_slam::KeyframeSlamConfig& config, uint32_t level)
+  {
+    dvo_slam::updateConfigFromDynamicReconfigure(config, keyframe_tracker_cfg_, graph_cfg_);
+
+    graph_->configure(graph_cfg_);
+
+    if(config.graph_opt_final)
+    {
+      config.graph_opt_final = false;
+      graph_->finalOptimization();
+    }
+  }
+
+  void handleMapChanged(dvo_slam::KeyframeGraph& map)
+  {
+    graph_delta_serializer_->serialize(map);
+
+    if(graph_delta_msg_.full || !graph_delta_msg_.ids.empty() || !graph_delta_msg_.removed_ids.empty())
+    {
+      graph_delta_publisher_.publish(graph_delta_msg_);
+    }
+  }
+};
+
+int main(int argc, char **argv) {
+    ros::init(argc, argv, "remote_backend");
+
+    ros::NodeHandle nh;
+    ros::NodeHandle nh_private("~");
+
+    RemoteBackendNode node(nh, nh_private);
+
+    ROS_INFO("started remote_backend...");
+
+    // the local maps are decoded by the subscriber callbacks, the graph optimizes on its own thread
+    ros::spin();
+
+    return 0;
+}
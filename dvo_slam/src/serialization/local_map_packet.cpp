@@ -0,0 +1,492 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo_slam/serialization/local_map_packet.h>
+#include <dvo_slam/keyframe_store.h>
+#include <dvo_slam/timestamped.h>
+
+#include <dvo/util/instrumentation.h>
+
+#include <g2o/types/slam3d/vertex_se3.h>
+#include <g2o/types/slam3d/edge_se3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace dvo_slam
+{
+namespace serialization
+{
+
+namespace internal
+{
+
+enum PacketFlags
+{
+  HasEvaluation = 1
+};
+
+enum FrameFlags
+{
+  HasOdometryMeasurement = 1
+};
+
+class PacketWriter
+{
+public:
+  PacketWriter(std::vector<uint8_t>& out) :
+    out_(out)
+  {
+  }
+
+  template<typename T>
+  void put(const T& value)
+  {
+    const size_t offset = out_.size();
+    out_.resize(offset + sizeof(T));
+    std::memcpy(&out_[offset], &value, sizeof(T));
+  }
+
+  void putBlob(const std::vector<unsigned char>& blob)
+  {
+    put<uint32_t>(uint32_t(blob.size()));
+    out_.insert(out_.end(), blob.begin(), blob.end());
+  }
+
+  void putPose(const Eigen::Isometry3d& pose)
+  {
+    Eigen::Quaterniond q(pose.rotation());
+
+    for(int i = 0; i < 3; ++i) put<double>(pose.translation()(i));
+
+    put<double>(q.x());
+    put<double>(q.y());
+    put<double>(q.z());
+    put<double>(q.w());
+  }
+
+  // the sign of the quaternion is chosen so w >= 0, which lets the reader recover it
+  void putRelativePose(const Eigen::Isometry3d& pose)
+  {
+    Eigen::Quaterniond q(pose.rotation());
+    q.normalize();
+
+    if(q.w() < 0.0) q.coeffs() = -q.coeffs();
+
+    for(int i = 0; i < 3; ++i) put<float>(float(pose.translation()(i)));
+
+    put<float>(float(q.x()));
+    put<float>(float(q.y()));
+    put<float>(float(q.z()));
+  }
+
+  void putInformation(const dvo::core::Matrix6d& information)
+  {
+    for(int row = 0; row < 6; ++row)
+      for(int col = row; col < 6; ++col)
+        put<float>(float(information(row, col)));
+  }
+private:
+  std::vector<uint8_t>& out_;
+};
+
+class PacketReader
+{
+public:
+  PacketReader(const uint8_t* data, size_t size) :
+    data_(data),
+    size_(size),
+    offset_(0),
+    good_(data != 0)
+  {
+  }
+
+  bool good() const
+  {
+    return good_;
+  }
+
+  size_t offset() const
+  {
+    return offset_;
+  }
+
+  template<typename T>
+  bool get(T& value)
+  {
+    if(!contains(sizeof(T))) return false;
+
+    std::memcpy(&value, data_ + offset_, sizeof(T));
+    offset_ += sizeof(T);
+
+    return true;
+  }
+
+  // the blob points into the packet
+  bool getBlob(cv::Mat& blob)
+  {
+    uint32_t size;
+
+    if(!get(size) || size == 0 || !contains(size)) return false;
+
+    blob = cv::Mat(1, int(size), CV_8UC1, const_cast<uint8_t*>(data_ + offset_));
+    offset_ += size;
+
+    return true;
+  }
+
+  bool skip(size_t size)
+  {
+    if(!contains(size)) return false;
+
+    offset_ += size;
+
+    return true;
+  }
+
+  bool getPose(Eigen::Isometry3d& pose)
+  {
+    double t[3], q[4];
+
+    for(int i = 0; i < 3; ++i) get(t[i]);
+    for(int i = 0; i < 4; ++i) get(q[i]);
+
+    if(!good_) return false;
+
+    pose = Eigen::Isometry3d(Eigen::Quaterniond(q[3], q[0], q[1], q[2]).normalized());
+    pose.translation() = Eigen::Vector3d(t[0], t[1], t[2]);
+
+    return true;
+  }
+
+  bool getRelativePose(Eigen::Isometry3d& pose)
+  {
+    float v[6];
+
+    for(int i = 0; i < 6; ++i) get(v[i]);
+
+    if(!good_) return false;
+
+    const double x = v[3], y = v[4], z = v[5];
+    const double w = std::sqrt(std::max(0.0, 1.0 - x * x - y * y - z * z));
+
+    pose = Eigen::Isometry3d(Eigen::Quaterniond(w, x, y, z).normalized());
+    pose.translation() = Eigen::Vector3d(v[0], v[1], v[2]);
+
+    return true;
+  }
+
+  bool getInformation(dvo::core::Matrix6d& information)
+  {
+    for(int row = 0; row < 6; ++row)
+      for(int col = row; col < 6; ++col)
+      {
+        float value = 0.0f;
+        get(value);
+
+        information(row, col) = information(col, row) = value;
+      }
+
+    return good_;
+  }
+private:
+  const uint8_t* data_;
+  size_t size_, offset_;
+  bool good_;
+
+  bool contains(size_t size)
+  {
+    good_ = good_ && size <= size_ - offset_;
+
+    return good_;
+  }
+};
+
+static Eigen::Affine3d toAffine(const Eigen::Isometry3d& pose)
+{
+  Eigen::Affine3d p(pose.rotation());
+  p.translation() = pose.translation();
+
+  return p;
+}
+
+// up to and including the camera
+static bool readHeader(PacketReader& reader, LocalMapPacketInfo& info, uint16_t& flags, size_t& width, size_t& height, dvo::core::IntrinsicMatrix& intrinsics)
+{
+  char magic[4];
+  uint16_t version;
+
+  for(int i = 0; i < 4; ++i) reader.get(magic[i]);
+  reader.get(version);
+
+  if(!reader.good() || std::memcmp(magic, LocalMapPacketMagic, sizeof(magic)) != 0 || version != LocalMapPacketVersion) return false;
+
+  reader.get(flags);
+  reader.get(info.Sensor);
+  reader.get(info.Sequence);
+  reader.get(info.KeyframeTimestamp);
+  reader.getPose(info.KeyframePose);
+  reader.get(info.NumFrames);
+
+  uint16_t w, h;
+  float fx, fy, ox, oy;
+
+  reader.get(w);
+  reader.get(h);
+  reader.get(fx);
+  reader.get(fy);
+  reader.get(ox);
+  reader.get(oy);
+
+  if(!reader.good() || w == 0 || h == 0) return false;
+
+  width = w;
+  height = h;
+  intrinsics = dvo::core::IntrinsicMatrix::create(fx, fy, ox, oy);
+
+  return true;
+}
+
+} /* namespace internal */
+
+bool encodeLocalMapPacket(const LocalMap::Ptr& map, uint32_t sequence, std::vector<uint8_t>& packet)
+{
+  static dvo::util::Timer& encode_timer = dvo::util::Instrumentation::instance().timer("local_map_packet/encode");
+  dvo::util::ScopedTimer encode_scope(encode_timer);
+
+  g2o::SparseOptimizer& graph = map->getGraph();
+  g2o::VertexSE3* keyframe_vertex = static_cast<g2o::VertexSE3*>(graph.vertex(1));
+
+  if(keyframe_vertex == 0) return false;
+
+  // the frames have consecutive ids starting at 2, see LocalMap::addFrame
+  const int num_frames = int(graph.vertices().size()) - 1;
+
+  std::vector<g2o::EdgeSE3*> keyframe_edges(num_frames, 0), odometry_edges(num_frames, 0);
+  std::vector<ros::Time> timestamps(num_frames);
+
+  for(int idx = 0; idx < num_frames; ++idx)
+  {
+    g2o::VertexSE3* v = static_cast<g2o::VertexSE3*>(graph.vertex(idx + 2));
+    Timestamped* t = v != 0 ? dynamic_cast<Timestamped*>(v->userData()) : 0;
+
+    if(t == 0) return false;
+
+    timestamps[idx] = t->timestamp;
+
+    for(g2o::HyperGraph::EdgeSet::iterator it = v->edges().begin(); it != v->edges().end(); ++it)
+    {
+      g2o::EdgeSE3* e = static_cast<g2o::EdgeSE3*>(*it);
+
+      if(e->vertex(1) != v) continue;
+
+      if(e->vertex(0) == keyframe_vertex)
+        keyframe_edges[idx] = e;
+      else
+        odometry_edges[idx] = e;
+    }
+
+    if(keyframe_edges[idx] == 0) return false;
+  }
+
+  dvo::core::RgbdImage& keyframe = map->getKeyframe()->level(0);
+
+  std::vector<unsigned char> intensity, depth;
+
+  if(!KeyframeStore::encode(keyframe.intensity, keyframe.depth, intensity, depth)) return false;
+
+  dvo_slam::TrackingResultEvaluation::ConstPtr evaluation = map->getEvaluation();
+
+  internal::PacketWriter writer(packet);
+
+  for(int i = 0; i < 4; ++i) writer.put<char>(LocalMapPacketMagic[i]);
+  writer.put<uint16_t>(LocalMapPacketVersion);
+  writer.put<uint16_t>(evaluation ? uint16_t(internal::HasEvaluation) : uint16_t(0));
+  writer.put<int32_t>(map->getSensor());
+  writer.put<uint32_t>(sequence);
+  writer.put<double>(keyframe.timestamp);
+  writer.putPose(keyframe_vertex->estimate());
+  writer.put<uint32_t>(uint32_t(num_frames));
+
+  const dvo::core::IntrinsicMatrix& k = keyframe.camera().intrinsics();
+
+  writer.put<uint16_t>(uint16_t(keyframe.camera().width()));
+  writer.put<uint16_t>(uint16_t(keyframe.camera().height()));
+  writer.put<float>(k.fx());
+  writer.put<float>(k.fy());
+  writer.put<float>(k.ox());
+  writer.put<float>(k.oy());
+
+  if(evaluation)
+  {
+    double first, sum, count;
+    evaluation->state(first, sum, count);
+
+    writer.put<int32_t>(int32_t(evaluation->type()));
+    writer.put<double>(first);
+    writer.put<double>(sum);
+    writer.put<double>(count);
+  }
+
+  writer.putBlob(intensity);
+  writer.putBlob(depth);
+
+  Eigen::Isometry3d previous = Eigen::Isometry3d::Identity();
+
+  for(int idx = 0; idx < num_frames; ++idx)
+  {
+    const double dt = (timestamps[idx] - ros::Time(keyframe.timestamp)).toSec();
+
+    writer.put<int32_t>(int32_t(std::floor(dt * 1e6 + 0.5)));
+    writer.put<uint8_t>(odometry_edges[idx] != 0 ? uint8_t(internal::HasOdometryMeasurement) : uint8_t(0));
+
+    const Eigen::Isometry3d& keyframe_measurement = keyframe_edges[idx]->measurement();
+
+    writer.putRelativePose(previous.inverse() * keyframe_measurement);
+    writer.putInformation(keyframe_edges[idx]->information());
+
+    previous = keyframe_measurement;
+
+    if(odometry_edges[idx] != 0)
+    {
+      writer.putRelativePose(odometry_edges[idx]->measurement());
+      writer.putInformation(odometry_edges[idx]->information());
+    }
+  }
+
+  return true;
+}
+
+bool decodeLocalMapPacketInfo(const uint8_t* data, size_t size, LocalMapPacketInfo& info)
+{
+  internal::PacketReader reader(data, size);
+
+  uint16_t flags;
+  size_t width, height;
+  dvo::core::IntrinsicMatrix intrinsics;
+
+  info.Size = size;
+
+  return internal::readHeader(reader, info, flags, width, height, intrinsics);
+}
+
+bool decodeLocalMapPacketCamera(const uint8_t* data, size_t size, size_t& width, size_t& height, dvo::core::IntrinsicMatrix& intrinsics)
+{
+  internal::PacketReader reader(data, size);
+
+  LocalMapPacketInfo info;
+  uint16_t flags;
+
+  return internal::readHeader(reader, info, flags, width, height, intrinsics);
+}
+
+bool decodeLocalMapPacket(const uint8_t* data, size_t size, dvo::core::RgbdCameraPyramid& camera, size_t num_levels, LocalMap::Ptr& map, LocalMapPacketInfo& info)
+{
+  static dvo::util::Timer& decode_timer = dvo::util::Instrumentation::instance().timer("local_map_packet/decode");
+  dvo::util::ScopedTimer decode_scope(decode_timer);
+
+  internal::PacketReader reader(data, size);
+
+  uint16_t flags;
+  size_t width, height;
+  dvo::core::IntrinsicMatrix intrinsics;
+
+  info.Size = size;
+
+  if(!internal::readHeader(reader, info, flags, width, height, intrinsics)) return false;
+
+  dvo_slam::TrackingResultEvaluation::ConstPtr evaluation;
+
+  if(flags & internal::HasEvaluation)
+  {
+    int32_t type;
+    double first, sum, count;
+
+    reader.get(type);
+    reader.get(first);
+    reader.get(sum);
+    reader.get(count);
+
+    if(!reader.good() || type < 0 || type > int32_t(dvo_slam::TrackingResultEvaluation::EntropyRatio)) return false;
+
+    evaluation = dvo_slam::TrackingResultEvaluation::create(dvo_slam::TrackingResultEvaluation::Type(type), first, sum, count);
+  }
+
+  cv::Mat encoded_intensity, encoded_depth, intensity, depth;
+
+  if(!reader.getBlob(encoded_intensity) || !reader.getBlob(encoded_depth)) return false;
+  if(!KeyframeStore::decode(encoded_intensity, encoded_depth, intensity, depth)) return false;
+  if(size_t(intensity.cols) != width || size_t(intensity.rows) != height) return false;
+
+  camera.build(num_levels);
+
+  dvo::core::RgbdImagePyramid::Ptr keyframe(new dvo::core::RgbdImagePyramid(camera, intensity, depth));
+  keyframe->level(0).timestamp = info.KeyframeTimestamp;
+  keyframe->build(num_levels);
+
+  LocalMap::Ptr result = LocalMap::create(keyframe, internal::toAffine(info.KeyframePose));
+  result->setSensor(info.Sensor);
+  result->setEvaluation(evaluation);
+
+  Eigen::Isometry3d keyframe_measurement = Eigen::Isometry3d::Identity();
+
+  for(uint32_t idx = 0; idx < info.NumFrames; ++idx)
+  {
+    int32_t dt;
+    uint8_t frame_flags;
+    Eigen::Isometry3d delta, odometry;
+    dvo::core::Matrix6d keyframe_information, odometry_information;
+
+    reader.get(dt);
+    reader.get(frame_flags);
+    reader.getRelativePose(delta);
+    reader.getInformation(keyframe_information);
+
+    if((frame_flags & internal::HasOdometryMeasurement) != 0)
+    {
+      reader.getRelativePose(odometry);
+      reader.getInformation(odometry_information);
+    }
+
+    // the first frame is only connected to the keyframe
+    if(!reader.good() || (idx > 0) != ((frame_flags & internal::HasOdometryMeasurement) != 0)) return false;
+
+    keyframe_measurement = keyframe_measurement * delta;
+
+    dvo::core::RgbdImagePyramid::Ptr frame(new dvo::core::RgbdImagePyramid(camera));
+    frame->level(0).timestamp = info.KeyframeTimestamp + dt * 1e-6;
+
+    result->addFrame(frame);
+
+    if(idx > 0) result->addOdometryMeasurement(internal::toAffine(odometry), odometry_information);
+
+    result->addKeyframeMeasurement(internal::toAffine(keyframe_measurement), keyframe_information);
+  }
+
+  if(info.NumFrames == 0 || reader.offset() != size) return false;
+
+  map = result;
+
+  return true;
+}
+
+} /* namespace serialization */
+} /* namespace dvo_slam */
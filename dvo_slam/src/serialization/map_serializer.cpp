@@ -19,11 +19,15 @@
  */
 
 #include <dvo_slam/serialization/map_serializer.h>
+#include <dvo_slam/serialization/map_snapshot_file.h>
 
 #include <g2o/core/sparse_optimizer.h>
 #include <g2o/types/slam3d/vertex_se3.h>
 #include <g2o/types/slam3d/edge_se3.h>
-#include <dvo_slam/timestamped.h>
+
+#include <dvo/util/instrumentation.h>
+
+#include <boost/bind.hpp>
 
 namespace dvo_slam
 {
@@ -43,20 +47,10 @@ TrajectorySerializer::~TrajectorySerializer()
 
 void TrajectorySerializer::serialize(const dvo_slam::KeyframeGraph& map)
 {
-  std::map<ros::Time, Eigen::Isometry3d> poses;
-
-  for (g2o::OptimizableGraph::VertexIDMap::const_iterator it = map.graph().vertices().begin(); it != map.graph().vertices().end(); ++it)
-  {
-    g2o::VertexSE3 *v = (g2o::VertexSE3 *) it->second;
-
-    Timestamped *t = dynamic_cast<Timestamped *>(v->userData());
-
-    assert(t != 0);
-
-    poses[t->timestamp] = v->estimate();
-  }
+  dvo_slam::KeyframeGraph::PoseMap poses;
+  map.trajectory(poses);
 
-  for (std::map<ros::Time, Eigen::Isometry3d>::iterator it = poses.begin(); it != poses.end(); ++it)
+  for (dvo_slam::KeyframeGraph::PoseMap::iterator it = poses.begin(); it != poses.end(); ++it)
   {
     Eigen::Quaterniond q(it->second.rotation());
 
@@ -109,7 +103,7 @@ void MessageSerializer::serialize(const dvo_slam::KeyframeGraph& map)
   {
     g2o::VertexSE3 *v = (g2o::VertexSE3 *) it->second;
 
-    Timestamped *t = dynamic_cast<Timestamped *>(v->userData());
+    const VertexTable::Entry* t = map.vertexTable().find(v->id());
 
     assert(t != 0);
 
@@ -130,5 +124,146 @@ void MessageSerializer::serialize(const dvo_slam::KeyframeGraph& map)
   }
 }
 
+DeltaMessageSerializer::DeltaMessageSerializer(dvo_slam::PoseDeltaArray& msg, double translation_threshold, double rotation_threshold) :
+    msg_(msg),
+    translation_threshold_(translation_threshold),
+    rotation_threshold_(rotation_threshold),
+    revision_(0)
+{
+}
+
+DeltaMessageSerializer::~DeltaMessageSerializer()
+{
+}
+
+void DeltaMessageSerializer::serialize(const dvo_slam::KeyframeGraph& map)
+{
+  map.changes(revision_, changes_);
+  revision_ = changes_.Revision;
+
+  msg_.revision = changes_.Revision;
+  msg_.full = changes_.Full;
+  msg_.ids.clear();
+  msg_.poses.clear();
+  msg_.removed_ids.clear();
+
+  if(changes_.Full) sent_.clear();
+
+  for(std::vector<int>::const_iterator it = changes_.RemovedVertices.begin(); it != changes_.RemovedVertices.end(); ++it)
+  {
+    if(sent_.erase(*it) > 0) msg_.removed_ids.push_back(*it);
+  }
+
+  geometry_msgs::PoseStamped pose;
+
+  for(std::vector<int>::const_iterator it = changes_.ChangedVertices.begin(); it != changes_.ChangedVertices.end(); ++it)
+  {
+    g2o::VertexSE3 *v = (g2o::VertexSE3 *) map.graph().vertex(*it);
+
+    if(v == 0) continue;
+
+    const Eigen::Isometry3d& p = v->estimate();
+
+    PoseMap::iterator sent = sent_.find(*it);
+
+    if(sent != sent_.end())
+    {
+      Eigen::Isometry3d delta = sent->second.inverse() * p;
+
+      if(delta.translation().norm() < translation_threshold_ && Eigen::AngleAxisd(delta.rotation()).angle() < rotation_threshold_) continue;
+
+      sent->second = p;
+    }
+    else
+    {
+      sent_.insert(PoseMap::value_type(*it, p));
+    }
+
+    Eigen::Quaterniond q(p.rotation());
+
+    pose.header.stamp = map.vertexTable().timestamp(*it);
+    pose.pose.position.x = p.translation()(0);
+    pose.pose.position.y = p.translation()(1);
+    pose.pose.position.z = p.translation()(2);
+
+    pose.pose.orientation.w = q.w();
+    pose.pose.orientation.x = q.x();
+    pose.pose.orientation.y = q.y();
+    pose.pose.orientation.z = q.z();
+
+    msg_.ids.push_back(*it);
+    msg_.poses.push_back(pose);
+  }
+}
+
+BinarySerializer::BinarySerializer(const std::string& file) :
+    file_(file)
+{
+}
+
+BinarySerializer::~BinarySerializer()
+{
+}
+
+void BinarySerializer::serialize(const dvo_slam::KeyframeGraph& map)
+{
+  dvo_slam::MapSnapshot snapshot;
+
+  if(map.snapshot(snapshot)) writeMapSnapshot(snapshot, file_);
+}
+
+AsyncBinarySerializer::AsyncBinarySerializer(const std::string& file) :
+    file_(file),
+    thread_(boost::bind(&AsyncBinarySerializer::write, this))
+{
+}
+
+AsyncBinarySerializer::~AsyncBinarySerializer()
+{
+  // an empty snapshot stops the thread after the pending one was written
+  queue_.push(MapSnapshotPtr());
+  thread_.join();
+}
+
+void AsyncBinarySerializer::serialize(const dvo_slam::KeyframeGraph& map)
+{
+  static dvo::util::Timer& skipped_timer = dvo::util::Instrumentation::instance().timer("map_snapshot/skipped");
+
+  // the previous snapshot wasn't picked up yet
+  if(queue_.size() > 0)
+  {
+    skipped_timer.record(0.0);
+    return;
+  }
+
+  MapSnapshotPtr snapshot(new dvo_slam::MapSnapshot());
+
+  if(map.snapshot(*snapshot, false))
+  {
+    queue_.push(snapshot);
+  }
+  else
+  {
+    skipped_timer.record(0.0);
+  }
+}
+
+void AsyncBinarySerializer::write()
+{
+  MapSnapshotPtr snapshot;
+
+  while(true)
+  {
+    queue_.pop(snapshot);
+
+    if(!snapshot) break;
+
+    writeMapSnapshot(*snapshot, file_);
+
+    // release the shared images before waiting for the next one
+    snapshot.reset();
+  }
+}
+
 } /* namespace serialization */
 } /* namespace dvo_slam */
@@ -0,0 +1,471 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo_slam/serialization/map_snapshot_file.h>
+#include <dvo_slam/keyframe_store.h>
+
+#include <dvo/util/instrumentation.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ros/console.h>
+
+namespace dvo_slam
+{
+namespace serialization
+{
+
+static void toSnapshotPose(const Eigen::Isometry3d& pose, SnapshotPose& result)
+{
+  Eigen::Quaterniond q(pose.rotation());
+
+  result.Translation[0] = pose.translation()(0);
+  result.Translation[1] = pose.translation()(1);
+  result.Translation[2] = pose.translation()(2);
+  result.Rotation[0] = q.x();
+  result.Rotation[1] = q.y();
+  result.Rotation[2] = q.z();
+  result.Rotation[3] = q.w();
+}
+
+static Eigen::Isometry3d fromSnapshotPose(const SnapshotPose& pose)
+{
+  Eigen::Isometry3d result(Eigen::Quaterniond(pose.Rotation[3], pose.Rotation[0], pose.Rotation[1], pose.Rotation[2]).normalized());
+  result.translation() = Eigen::Vector3d(pose.Translation[0], pose.Translation[1], pose.Translation[2]);
+
+  return result;
+}
+
+namespace internal
+{
+
+class SnapshotWriter
+{
+public:
+  SnapshotWriter(const std::string& file) :
+    out_(file.c_str(), std::ios::binary | std::ios::trunc),
+    offset_(0)
+  {
+  }
+
+  bool good() const
+  {
+    return out_.good();
+  }
+
+  template<typename T>
+  uint64_t writeTable(const std::vector<T>& table)
+  {
+    align();
+
+    const uint64_t offset = offset_;
+    if(!table.empty()) write(reinterpret_cast<const char*>(&table[0]), table.size() * sizeof(T));
+
+    return offset;
+  }
+
+  uint64_t writeBlob(const unsigned char* data, size_t size)
+  {
+    align();
+
+    const uint64_t offset = offset_;
+    write(reinterpret_cast<const char*>(data), size);
+
+    return offset;
+  }
+
+  void write(const char* data, size_t size)
+  {
+    out_.write(data, size);
+    offset_ += size;
+  }
+
+  void rewriteHeader(const SnapshotHeader& header)
+  {
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  }
+
+  bool close()
+  {
+    out_.flush();
+    const bool ok = out_.good();
+    out_.close();
+
+    return ok;
+  }
+private:
+  std::ofstream out_;
+  uint64_t offset_;
+
+  void align()
+  {
+    static const char zeros[SnapshotAlignment] = { 0 };
+
+    size_t padding = (SnapshotAlignment - offset_ % SnapshotAlignment) % SnapshotAlignment;
+    write(zeros, padding);
+  }
+};
+
+} /* namespace internal */
+
+bool writeMapSnapshot(const dvo_slam::MapSnapshot& snapshot, const std::string& file)
+{
+  static dvo::util::Timer& write_timer = dvo::util::Instrumentation::instance().timer("map_snapshot/write");
+  dvo::util::ScopedTimer write_scope(write_timer);
+
+  const std::string tmp_file = file + ".tmp";
+
+  internal::SnapshotWriter out(tmp_file);
+
+  if(!out.good())
+  {
+    ROS_ERROR_STREAM("failed to open map snapshot " << tmp_file);
+    return false;
+  }
+
+  SnapshotHeader header;
+  std::memset(&header, 0, sizeof(header));
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  std::vector<SnapshotKeyframe> keyframes;
+  std::vector<SnapshotVertex> vertices;
+  std::vector<SnapshotEdge> edges;
+  std::vector<SnapshotSegment> segments;
+  std::vector<SnapshotFrame> frames;
+
+  std::vector<unsigned char> intensity, depth;
+
+  for(size_t idx = 0; idx < snapshot.Keyframes.size(); ++idx)
+  {
+    const dvo_slam::MapSnapshot::Keyframe& k = snapshot.Keyframes[idx];
+
+    SnapshotKeyframe sk;
+    std::memset(&sk, 0, sizeof(sk));
+    sk.Id = k.Id;
+    sk.EvaluationType = k.HasEvaluation ? k.EvaluationType : -1;
+    sk.Timestamp = k.Timestamp;
+    toSnapshotPose(k.Pose, sk.Pose);
+    sk.EvaluationFirst = k.EvaluationFirst;
+    sk.EvaluationSum = k.EvaluationSum;
+    sk.EvaluationCount = k.EvaluationCount;
+
+    if(!k.Intensity.empty() && !k.Depth.empty())
+    {
+      if(!dvo_slam::KeyframeStore::encode(k.Intensity, k.Depth, intensity, depth))
+      {
+        ROS_WARN_STREAM("failed to compress images of keyframe " << k.Id << ", skipping it in the snapshot");
+        continue;
+      }
+
+      sk.IntensityOffset = out.writeBlob(&intensity[0], intensity.size());
+      sk.IntensitySize = intensity.size();
+      sk.DepthOffset = out.writeBlob(&depth[0], depth.size());
+      sk.DepthSize = depth.size();
+    }
+    else
+    {
+      sk.IntensityOffset = out.writeBlob(k.EncodedIntensity.ptr<unsigned char>(), k.EncodedIntensity.total());
+      sk.IntensitySize = k.EncodedIntensity.total();
+      sk.DepthOffset = out.writeBlob(k.EncodedDepth.ptr<unsigned char>(), k.EncodedDepth.total());
+      sk.DepthSize = k.EncodedDepth.total();
+    }
+
+    keyframes.push_back(sk);
+  }
+
+  for(size_t idx = 0; idx < snapshot.Vertices.size(); ++idx)
+  {
+    const dvo_slam::MapSnapshot::Vertex& v = snapshot.Vertices[idx];
+
+    SnapshotVertex sv;
+    std::memset(&sv, 0, sizeof(sv));
+    sv.Id = v.Id;
+    sv.Fixed = v.Fixed;
+    sv.Timestamp = v.Timestamp;
+    toSnapshotPose(v.Pose, sv.Pose);
+
+    vertices.push_back(sv);
+  }
+
+  for(size_t idx = 0; idx < snapshot.Edges.size(); ++idx)
+  {
+    const dvo_slam::MapSnapshot::Edge& e = snapshot.Edges[idx];
+
+    SnapshotEdge se;
+    std::memset(&se, 0, sizeof(se));
+    se.Id = e.Id;
+    se.Level = e.Level;
+    se.From = e.From;
+    se.To = e.To;
+    se.Robust = e.Robust;
+    toSnapshotPose(e.Measurement, se.Measurement);
+
+    for(int row = 0; row < 6; ++row)
+      for(int col = 0; col < 6; ++col)
+        se.Information[row * 6 + col] = e.Information(row, col);
+
+    edges.push_back(se);
+  }
+
+  for(size_t idx = 0; idx < snapshot.Segments.size(); ++idx)
+  {
+    const dvo_slam::MapSnapshot::Segment& s = snapshot.Segments[idx];
+
+    SnapshotSegment ss;
+    std::memset(&ss, 0, sizeof(ss));
+    ss.Begin = s.Begin;
+    ss.End = s.End;
+    ss.FirstFrame = frames.size();
+    ss.NumFrames = s.Frames.size();
+    ss.BeginTimestamp = s.BeginTimestamp;
+    ss.EndTimestamp = s.EndTimestamp;
+    toSnapshotPose(s.BeginToEnd, ss.BeginToEnd);
+
+    for(dvo_slam::MapSnapshot::FramePoseVector::const_iterator it = s.Frames.begin(); it != s.Frames.end(); ++it)
+    {
+      SnapshotFrame sf;
+      sf.Timestamp = it->Timestamp;
+      toSnapshotPose(it->Pose, sf.Pose);
+
+      frames.push_back(sf);
+    }
+
+    segments.push_back(ss);
+  }
+
+  std::memcpy(header.Magic, SnapshotMagic, sizeof(SnapshotMagic));
+  header.Version = SnapshotVersion;
+  header.NextKeyframeId = snapshot.NextKeyframeId;
+  header.NextOdometryVertexId = snapshot.NextOdometryVertexId;
+  header.NextOdometryEdgeId = snapshot.NextOdometryEdgeId;
+  header.NumKeyframes = keyframes.size();
+  header.NumVertices = vertices.size();
+  header.NumEdges = edges.size();
+  header.NumSegments = segments.size();
+  header.NumFrames = frames.size();
+  header.KeyframeOffset = out.writeTable(keyframes);
+  header.VertexOffset = out.writeTable(vertices);
+  header.EdgeOffset = out.writeTable(edges);
+  header.SegmentOffset = out.writeTable(segments);
+  header.FrameOffset = out.writeTable(frames);
+
+  out.rewriteHeader(header);
+
+  if(!out.close() || std::rename(tmp_file.c_str(), file.c_str()) != 0)
+  {
+    ROS_ERROR_STREAM("failed to write map snapshot " << file);
+    std::remove(tmp_file.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+MapSnapshotReader::MapSnapshotReader(const std::string& file) :
+    data_(0),
+    size_(0),
+    header_(0)
+{
+  int fd = ::open(file.c_str(), O_RDONLY);
+
+  if(fd < 0) return;
+
+  struct stat s;
+
+  if(::fstat(fd, &s) == 0 && size_t(s.st_size) >= sizeof(SnapshotHeader))
+  {
+    void* data = ::mmap(0, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    if(data != MAP_FAILED)
+    {
+      data_ = static_cast<const char*>(data);
+      size_ = s.st_size;
+    }
+  }
+
+  ::close(fd);
+
+  if(data_ == 0 || !validate())
+  {
+    unmap();
+    return;
+  }
+
+  // all of it is needed by a restore
+  ::madvise(const_cast<char*>(data_), size_, MADV_WILLNEED);
+}
+
+MapSnapshotReader::~MapSnapshotReader()
+{
+  unmap();
+}
+
+bool MapSnapshotReader::good() const
+{
+  return data_ != 0;
+}
+
+bool MapSnapshotReader::read(dvo_slam::MapSnapshot& snapshot) const
+{
+  if(!good()) return false;
+
+  static dvo::util::Timer& read_timer = dvo::util::Instrumentation::instance().timer("map_snapshot/read");
+  dvo::util::ScopedTimer read_scope(read_timer);
+
+  snapshot.clear();
+
+  const SnapshotKeyframe* keyframes = reinterpret_cast<const SnapshotKeyframe*>(data_ + header_->KeyframeOffset);
+  const SnapshotVertex* vertices = reinterpret_cast<const SnapshotVertex*>(data_ + header_->VertexOffset);
+  const SnapshotEdge* edges = reinterpret_cast<const SnapshotEdge*>(data_ + header_->EdgeOffset);
+  const SnapshotSegment* segments = reinterpret_cast<const SnapshotSegment*>(data_ + header_->SegmentOffset);
+  const SnapshotFrame* frames = reinterpret_cast<const SnapshotFrame*>(data_ + header_->FrameOffset);
+
+  snapshot.Keyframes.resize(header_->NumKeyframes);
+
+  for(size_t idx = 0; idx < header_->NumKeyframes; ++idx)
+  {
+    const SnapshotKeyframe& sk = keyframes[idx];
+    dvo_slam::MapSnapshot::Keyframe& k = snapshot.Keyframes[idx];
+
+    k.Id = sk.Id;
+    k.Timestamp = sk.Timestamp;
+    k.Pose = fromSnapshotPose(sk.Pose);
+    k.HasEvaluation = sk.EvaluationType >= 0;
+    k.EvaluationType = sk.EvaluationType;
+    k.EvaluationFirst = sk.EvaluationFirst;
+    k.EvaluationSum = sk.EvaluationSum;
+    k.EvaluationCount = sk.EvaluationCount;
+
+    // no copy, the images are decoded straight from the mapping
+    k.EncodedIntensity = cv::Mat(1, sk.IntensitySize, CV_8UC1, const_cast<char*>(data_ + sk.IntensityOffset));
+    k.EncodedDepth = cv::Mat(1, sk.DepthSize, CV_8UC1, const_cast<char*>(data_ + sk.DepthOffset));
+  }
+
+  snapshot.Vertices.resize(header_->NumVertices);
+
+  for(size_t idx = 0; idx < header_->NumVertices; ++idx)
+  {
+    const SnapshotVertex& sv = vertices[idx];
+    dvo_slam::MapSnapshot::Vertex& v = snapshot.Vertices[idx];
+
+    v.Id = sv.Id;
+    v.Timestamp = sv.Timestamp;
+    v.Pose = fromSnapshotPose(sv.Pose);
+    v.Fixed = sv.Fixed != 0;
+  }
+
+  snapshot.Edges.resize(header_->NumEdges);
+
+  for(size_t idx = 0; idx < header_->NumEdges; ++idx)
+  {
+    const SnapshotEdge& se = edges[idx];
+    dvo_slam::MapSnapshot::Edge& e = snapshot.Edges[idx];
+
+    e.Id = se.Id;
+    e.Level = se.Level;
+    e.From = se.From;
+    e.To = se.To;
+    e.Robust = se.Robust != 0;
+    e.Measurement = fromSnapshotPose(se.Measurement);
+    e.Information = Eigen::Map<const Eigen::Matrix<double, 6, 6, Eigen::RowMajor> >(se.Information);
+  }
+
+  snapshot.Segments.resize(header_->NumSegments);
+
+  for(size_t idx = 0; idx < header_->NumSegments; ++idx)
+  {
+    const SnapshotSegment& ss = segments[idx];
+    dvo_slam::MapSnapshot::Segment& s = snapshot.Segments[idx];
+
+    s.Begin = ss.Begin;
+    s.End = ss.End;
+    s.BeginTimestamp = ss.BeginTimestamp;
+    s.EndTimestamp = ss.EndTimestamp;
+    s.BeginToEnd = fromSnapshotPose(ss.BeginToEnd);
+    s.Frames.resize(ss.NumFrames);
+
+    for(size_t f = 0; f < ss.NumFrames; ++f)
+    {
+      s.Frames[f].Timestamp = frames[ss.FirstFrame + f].Timestamp;
+      s.Frames[f].Pose = fromSnapshotPose(frames[ss.FirstFrame + f].Pose);
+    }
+  }
+
+  snapshot.NextKeyframeId = header_->NextKeyframeId;
+  snapshot.NextOdometryVertexId = header_->NextOdometryVertexId;
+  snapshot.NextOdometryEdgeId = header_->NextOdometryEdgeId;
+
+  return true;
+}
+
+bool MapSnapshotReader::contains(uint64_t offset, uint64_t size) const
+{
+  return offset <= size_ && size <= size_ - offset;
+}
+
+bool MapSnapshotReader::validate()
+{
+  header_ = reinterpret_cast<const SnapshotHeader*>(data_);
+
+  if(std::memcmp(header_->Magic, SnapshotMagic, sizeof(SnapshotMagic)) != 0 || header_->Version != SnapshotVersion) return false;
+
+  if(!contains(header_->KeyframeOffset, uint64_t(header_->NumKeyframes) * sizeof(SnapshotKeyframe)) ||
+      !contains(header_->VertexOffset, uint64_t(header_->NumVertices) * sizeof(SnapshotVertex)) ||
+      !contains(header_->EdgeOffset, uint64_t(header_->NumEdges) * sizeof(SnapshotEdge)) ||
+      !contains(header_->SegmentOffset, uint64_t(header_->NumSegments) * sizeof(SnapshotSegment)) ||
+      !contains(header_->FrameOffset, uint64_t(header_->NumFrames) * sizeof(SnapshotFrame))) return false;
+
+  const SnapshotKeyframe* keyframes = reinterpret_cast<const SnapshotKeyframe*>(data_ + header_->KeyframeOffset);
+
+  for(size_t idx = 0; idx < header_->NumKeyframes; ++idx)
+  {
+    if(!contains(keyframes[idx].IntensityOffset, keyframes[idx].IntensitySize) || !contains(keyframes[idx].DepthOffset, keyframes[idx].DepthSize)) return false;
+  }
+
+  const SnapshotSegment* segments = reinterpret_cast<const SnapshotSegment*>(data_ + header_->SegmentOffset);
+
+  for(size_t idx = 0; idx < header_->NumSegments; ++idx)
+  {
+    if(uint64_t(segments[idx].FirstFrame) + segments[idx].NumFrames > header_->NumFrames) return false;
+  }
+
+  return true;
+}
+
+void MapSnapshotReader::unmap()
+{
+  if(data_ != 0) ::munmap(const_cast<char*>(data_), size_);
+
+  data_ = 0;
+  size_ = 0;
+  header_ = 0;
+}
+
+} /* namespace serialization */
+} /* namespace dvo_slam */
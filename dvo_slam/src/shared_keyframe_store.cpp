@@ -0,0 +1,496 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo_slam/shared_keyframe_store.h>
+
+#include <dvo/util/instrumentation.h>
+#include <dvo/util/seqlock.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <ros/console.h>
+
+namespace dvo_slam
+{
+
+namespace internal
+{
+
+// "dvok", and the version of the layout below
+static const uint32_t SharedStoreMagic = 0x64766f6b;
+static const uint32_t SharedStoreLayout = 1;
+
+static const size_t SharedStoreMaxLevels = 6;
+
+// images start on cache lines
+static const size_t SharedStoreAlignment = 64;
+
+struct SharedPose
+{
+  int32_t Id, Sensor;
+  double Timestamp;
+
+  // column major 4x4 matrix
+  double Pose[16];
+};
+
+typedef dvo::util::Seqlock<SharedPose> SharedSlot;
+
+struct SharedLevel
+{
+  uint32_t Width, Height;
+
+  // offsets in the images of a slot
+  uint64_t IntensityOffset, DepthOffset;
+};
+
+struct SharedStoreHeader
+{
+  // Magic is written last, a reader doesn't accept the store before
+  uint32_t Magic, Layout;
+  uint32_t Capacity, FirstLevel, NumLevels;
+  SharedLevel Levels[SharedStoreMaxLevels];
+
+  // offsets in the mapping of the slot array and the images, which take ImageBytes per slot
+  uint64_t SlotsOffset, ImagesOffset, ImageBytes;
+
+  // published slots, a slot is complete before it is counted
+  tbb::atomic<uint32_t> Size;
+  tbb::atomic<uint64_t> Revision, Generation;
+  tbb::atomic<uint32_t> Closed;
+};
+
+// slot of keyframes which can't be exported, so they aren't tried again
+static const size_t NotExported = size_t(-1);
+
+// a pose store takes well below a microsecond, a writer still storing after this many attempts died
+static const size_t SharedStoreMaxLoadAttempts = 1 << 16;
+
+static inline size_t align(size_t bytes)
+{
+  return (bytes + SharedStoreAlignment - 1) & ~(SharedStoreAlignment - 1);
+}
+
+} /* namespace internal */
+
+using namespace internal;
+
+// same fixed point as the compressed images of the KeyframeStore
+const float SharedKeyframeView::DepthScale = 5000.0f;
+
+static inline const SharedSlot& slotAt(const char* data, const SharedStoreHeader* header, size_t slot)
+{
+  return reinterpret_cast<const SharedSlot*>(data + header->SlotsOffset)[slot];
+}
+
+static inline const char* imagesAt(const char* data, const SharedStoreHeader* header, size_t slot)
+{
+  return data + header->ImagesOffset + slot * header->ImageBytes;
+}
+
+SharedKeyframeStore::SharedKeyframeStore() :
+    capacity_(0),
+    first_level_(0),
+    num_levels_(0),
+    generation_(0),
+    data_(0),
+    bytes_(0),
+    header_(0)
+{
+}
+
+SharedKeyframeStore::~SharedKeyframeStore()
+{
+  unmap();
+}
+
+void SharedKeyframeStore::configure(const std::string& name, size_t capacity, size_t first_level, size_t num_levels)
+{
+  num_levels = std::max<size_t>(1, std::min(num_levels, SharedStoreMaxLevels));
+
+  if(name == name_ && capacity == capacity_ && first_level == first_level_ && num_levels == num_levels_) return;
+
+  unmap();
+  slots_.clear();
+
+  name_ = name;
+  capacity_ = capacity;
+  first_level_ = first_level;
+  num_levels_ = num_levels;
+}
+
+bool SharedKeyframeStore::enabled() const
+{
+  return !name_.empty() && capacity_ > 0;
+}
+
+bool SharedKeyframeStore::create(const KeyframePtr& keyframe)
+{
+  dvo::core::RgbdImagePyramid& image = *keyframe->image();
+  image.build(first_level_ + num_levels_);
+
+  SharedLevel levels[SharedStoreMaxLevels];
+  size_t image_bytes = 0;
+
+  for(size_t idx = 0; idx < num_levels_; ++idx)
+  {
+    const dvo::core::RgbdImage& level = image.level(first_level_ + idx);
+
+    if(level.intensity.empty()) return false;
+
+    levels[idx].Width = level.intensity.cols;
+    levels[idx].Height = level.intensity.rows;
+
+    const size_t pixels = size_t(level.intensity.cols) * level.intensity.rows;
+
+    levels[idx].IntensityOffset = image_bytes;
+    image_bytes += align(pixels * sizeof(uint8_t));
+    levels[idx].DepthOffset = image_bytes;
+    image_bytes += align(pixels * sizeof(uint16_t));
+  }
+
+  const size_t slots_offset = align(sizeof(SharedStoreHeader));
+  const size_t images_offset = slots_offset + align(capacity_ * sizeof(SharedSlot));
+  const size_t bytes = images_offset + capacity_ * image_bytes;
+
+  // readers of a previous store keep their mapping until they notice it was closed
+  ::shm_unlink(name_.c_str());
+
+  int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+
+  if(fd < 0)
+  {
+    ROS_WARN_STREAM("can't create the shared keyframe store '" << name_ << "', disabling it");
+    name_.clear();
+    return false;
+  }
+
+  void* data = MAP_FAILED;
+
+  if(::ftruncate(fd, bytes) == 0)
+  {
+    data = ::mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+
+  ::close(fd);
+
+  if(data == MAP_FAILED)
+  {
+    ROS_WARN_STREAM("can't map " << bytes << " bytes of the shared keyframe store '" << name_ << "', disabling it");
+    ::shm_unlink(name_.c_str());
+    name_.clear();
+    return false;
+  }
+
+  data_ = static_cast<char*>(data);
+  bytes_ = bytes;
+
+  // the object is zero filled, only the pages of written slots get memory
+  header_ = new (data_) SharedStoreHeader();
+  header_->Layout = SharedStoreLayout;
+  header_->Capacity = capacity_;
+  header_->FirstLevel = first_level_;
+  header_->NumLevels = num_levels_;
+  std::copy(levels, levels + num_levels_, header_->Levels);
+  header_->SlotsOffset = slots_offset;
+  header_->ImagesOffset = images_offset;
+  header_->ImageBytes = image_bytes;
+  header_->Size = 0;
+  header_->Revision = 0;
+  header_->Generation = generation_;
+  header_->Closed = 0;
+
+  for(size_t idx = 0; idx < capacity_; ++idx)
+  {
+    new (data_ + slots_offset + idx * sizeof(SharedSlot)) SharedSlot();
+  }
+
+  tbb::atomic_fence();
+  header_->Magic = SharedStoreMagic;
+
+  ROS_INFO_STREAM("shared keyframe store '" << name_ << "' for " << capacity_ << " keyframes, " << (bytes >> 20) << " MB");
+
+  return true;
+}
+
+static void storePose(char* data, SharedStoreHeader* header, size_t slot, const KeyframePtr& keyframe)
+{
+  SharedPose p;
+  p.Id = keyframe->id();
+  p.Sensor = keyframe->sensor();
+  p.Timestamp = keyframe->image()->timestamp();
+
+  const Eigen::Matrix4d pose = keyframe->pose().matrix();
+  std::copy(pose.data(), pose.data() + 16, p.Pose);
+
+  const_cast<SharedSlot&>(slotAt(data, header, slot)).store(p);
+}
+
+bool SharedKeyframeStore::add(const KeyframePtr& keyframe)
+{
+  static dvo::util::Timer& add_timer = dvo::util::Instrumentation::instance().timer("keyframe_graph/shared_store/add");
+  static dvo::util::Timer
+    &full_counter = add_timer.child("full"),
+    &skipped_counter = add_timer.child("skipped")
+  ;
+
+  if(!enabled()) return false;
+
+  boost::unordered_map<int, size_t>::const_iterator existing = slots_.find(keyframe->id());
+
+  if(existing != slots_.end()) return existing->second != NotExported;
+
+  if(header_ == 0 && !create(keyframe)) return false;
+
+  const size_t slot = header_->Size;
+
+  if(slot >= capacity_)
+  {
+    full_counter.record(0.0);
+    slots_[keyframe->id()] = NotExported;
+    return false;
+  }
+
+  dvo::util::ScopedTimer add_scope(add_timer);
+
+  // evicted keyframes only keep their coarse levels, build() doesn't restore the finer ones
+  dvo::core::RgbdImagePyramid& image = *keyframe->image();
+  image.build(first_level_ + num_levels_);
+
+  char* images = data_ + header_->ImagesOffset + slot * header_->ImageBytes;
+
+  for(size_t idx = 0; idx < num_levels_; ++idx)
+  {
+    const dvo::core::RgbdImage& level = image.level(first_level_ + idx);
+    const SharedLevel& l = header_->Levels[idx];
+
+    if(level.intensity.empty() || size_t(level.intensity.cols) != l.Width || size_t(level.intensity.rows) != l.Height)
+    {
+      skipped_counter.record(0.0);
+      slots_[keyframe->id()] = NotExported;
+      return false;
+    }
+  }
+
+  for(size_t idx = 0; idx < num_levels_; ++idx)
+  {
+    const dvo::core::RgbdImage& level = image.level(first_level_ + idx);
+    const SharedLevel& l = header_->Levels[idx];
+
+    // convertTo writes into the slot, because type and size match, nan depth saturates to 0
+    cv::Mat intensity(l.Height, l.Width, CV_8UC1, images + l.IntensityOffset);
+    cv::Mat depth(l.Height, l.Width, CV_16UC1, images + l.DepthOffset);
+
+    level.intensity.convertTo(intensity, CV_8U);
+    level.depth.convertTo(depth, CV_16U, SharedKeyframeView::DepthScale);
+  }
+
+  storePose(data_, header_, slot, keyframe);
+  slots_[keyframe->id()] = slot;
+
+  // publishes the slot, the increment is a full fence
+  header_->Size.fetch_and_increment();
+  header_->Revision.fetch_and_increment();
+
+  return true;
+}
+
+void SharedKeyframeStore::update(const KeyframeVector& keyframes)
+{
+  if(!enabled()) return;
+
+  for(KeyframeVector::const_iterator it = keyframes.begin(); it != keyframes.end(); ++it)
+  {
+    boost::unordered_map<int, size_t>::const_iterator slot = slots_.find((*it)->id());
+
+    if(slot == slots_.end())
+      add(*it);
+    else if(slot->second != NotExported)
+      storePose(data_, header_, slot->second, *it);
+  }
+
+  if(header_ != 0) header_->Revision.fetch_and_increment();
+}
+
+void SharedKeyframeStore::clear()
+{
+  slots_.clear();
+
+  if(header_ == 0) return;
+
+  // readers may still use views of the images, so the slots are never rewritten
+  unmap();
+  generation_++;
+}
+
+size_t SharedKeyframeStore::size() const
+{
+  return header_ != 0 ? size_t(header_->Size) : 0;
+}
+
+void SharedKeyframeStore::unmap()
+{
+  if(data_ == 0) return;
+
+  header_->Closed = 1;
+
+  ::munmap(data_, bytes_);
+  ::shm_unlink(name_.c_str());
+
+  data_ = 0;
+  bytes_ = 0;
+  header_ = 0;
+}
+
+SharedKeyframeView::SharedKeyframeView() :
+    data_(0),
+    bytes_(0),
+    header_(0)
+{
+}
+
+SharedKeyframeView::~SharedKeyframeView()
+{
+  unmap();
+}
+
+bool SharedKeyframeView::open(const std::string& name)
+{
+  unmap();
+
+  int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+
+  if(fd < 0) return false;
+
+  struct stat s;
+
+  if(::fstat(fd, &s) == 0 && size_t(s.st_size) >= sizeof(SharedStoreHeader))
+  {
+    void* data = ::mmap(0, s.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    if(data != MAP_FAILED)
+    {
+      data_ = static_cast<const char*>(data);
+      bytes_ = s.st_size;
+    }
+  }
+
+  ::close(fd);
+
+  if(data_ == 0) return false;
+
+  header_ = reinterpret_cast<const SharedStoreHeader*>(data_);
+
+  const bool valid = header_->Magic == SharedStoreMagic && header_->Layout == SharedStoreLayout && header_->NumLevels <= SharedStoreMaxLevels &&
+      header_->ImagesOffset + header_->Capacity * header_->ImageBytes <= bytes_;
+
+  if(!valid) unmap();
+
+  return valid;
+}
+
+void SharedKeyframeView::close()
+{
+  unmap();
+}
+
+bool SharedKeyframeView::good() const
+{
+  return header_ != 0;
+}
+
+bool SharedKeyframeView::stale() const
+{
+  return header_ == 0 || header_->Closed != 0;
+}
+
+size_t SharedKeyframeView::size() const
+{
+  return header_ != 0 ? std::min<size_t>(header_->Size, header_->Capacity) : 0;
+}
+
+uint64_t SharedKeyframeView::revision() const
+{
+  return header_ != 0 ? uint64_t(header_->Revision) : 0;
+}
+
+uint64_t SharedKeyframeView::generation() const
+{
+  return header_ != 0 ? uint64_t(header_->Generation) : 0;
+}
+
+size_t SharedKeyframeView::firstLevel() const
+{
+  return header_ != 0 ? header_->FirstLevel : 0;
+}
+
+size_t SharedKeyframeView::numLevels() const
+{
+  return header_ != 0 ? header_->NumLevels : 0;
+}
+
+bool SharedKeyframeView::keyframe(size_t slot, Keyframe& keyframe) const
+{
+  if(slot >= size()) return false;
+
+  SharedPose p;
+
+  if(!slotAt(data_, header_, slot).tryLoad(p, SharedStoreMaxLoadAttempts)) return false;
+
+  keyframe.Id = p.Id;
+  keyframe.Sensor = p.Sensor;
+  keyframe.Timestamp = p.Timestamp;
+  keyframe.Pose.matrix() = Eigen::Map<const Eigen::Matrix4d>(p.Pose);
+
+  return true;
+}
+
+bool SharedKeyframeView::images(size_t slot, size_t level, cv::Mat& intensity, cv::Mat& depth) const
+{
+  if(slot >= size() || level >= numLevels()) return false;
+
+  const SharedLevel& l = header_->Levels[level];
+  char* images = const_cast<char*>(imagesAt(data_, header_, slot));
+
+  intensity = cv::Mat(l.Height, l.Width, CV_8UC1, images + l.IntensityOffset);
+  depth = cv::Mat(l.Height, l.Width, CV_16UC1, images + l.DepthOffset);
+
+  return true;
+}
+
+void SharedKeyframeView::unmap()
+{
+  if(data_ == 0) return;
+
+  ::munmap(const_cast<char*>(data_), bytes_);
+
+  data_ = 0;
+  bytes_ = 0;
+  header_ = 0;
+}
+
+} /* namespace dvo_slam */
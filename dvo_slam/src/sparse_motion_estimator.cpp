@@ -0,0 +1,269 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo_slam/sparse_motion_estimator.h>
+
+#include <dvo/util/instrumentation.h>
+
+#include <opencv2/features2d/features2d.hpp>
+
+#include <Eigen/Geometry>
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/random/mersenne_twister.hpp>
+
+namespace dvo_slam
+{
+
+SparseMotionEstimator::SparseMotionEstimator() :
+    level_(1),
+    max_features_(300),
+    min_inliers_(15),
+    iterations_(100),
+    inlier_threshold_(0.05f),
+    inliers_(0)
+{
+  reset();
+}
+
+SparseMotionEstimator::~SparseMotionEstimator()
+{
+}
+
+void SparseMotionEstimator::configure(size_t level, int max_features, int min_inliers, float inlier_threshold, int iterations)
+{
+  if(level != level_ || max_features != max_features_) reset();
+
+  level_ = level;
+  max_features_ = std::max(max_features, 1);
+  min_inliers_ = std::max(min_inliers, 3);
+  inlier_threshold_ = inlier_threshold;
+  iterations_ = std::max(iterations, 1);
+}
+
+size_t SparseMotionEstimator::level() const
+{
+  return level_;
+}
+
+size_t SparseMotionEstimator::inliers() const
+{
+  return inliers_;
+}
+
+void SparseMotionEstimator::reset()
+{
+  reference_.image = current_.image = 0;
+  reference_.revision = current_.revision = 0;
+  reference_.points.clear();
+  current_.points.clear();
+  reference_.descriptors.release();
+  current_.descriptors.release();
+}
+
+bool SparseMotionEstimator::holds(const Features& features, const dvo::core::RgbdImagePyramid& image)
+{
+  return features.image == &image && features.revision == image.revision();
+}
+
+bool SparseMotionEstimator::estimate(dvo::core::RgbdImagePyramid& reference, dvo::core::RgbdImagePyramid& current, dvo::core::AffineTransformd& motion)
+{
+  static dvo::util::Timer& estimate_timer = dvo::util::Instrumentation::instance().timer("sparse_motion_estimator/estimate");
+  static dvo::util::Timer& detect_timer = estimate_timer.child("detect");
+  static dvo::util::Timer& ransac_timer = estimate_timer.child("ransac");
+
+  dvo::util::ScopedTimer estimate_scope(estimate_timer);
+
+  inliers_ = 0;
+
+  {
+    dvo::util::ScopedTimer detect_scope(detect_timer);
+
+    // usually the reference is the current frame of the last call
+    if(holds(current_, reference))
+    {
+      std::swap(reference_, current_);
+    }
+    else if(!holds(reference_, reference))
+    {
+      detect(reference, reference_);
+    }
+
+    detect(current, current_);
+  }
+
+  if(reference_.points.size() < size_t(min_inliers_) || current_.points.size() < size_t(min_inliers_)) return false;
+
+  std::vector<cv::DMatch> matches;
+  cv::BFMatcher matcher(cv::NORM_HAMMING, true);
+  matcher.match(current_.descriptors, reference_.descriptors, matches);
+
+  if(matches.size() < size_t(min_inliers_)) return false;
+
+  dvo::util::ScopedTimer ransac_scope(ransac_timer);
+
+  std::vector<Eigen::Vector3f> r, c;
+  r.reserve(matches.size());
+  c.reserve(matches.size());
+
+  for(std::vector<cv::DMatch>::const_iterator it = matches.begin(); it != matches.end(); ++it)
+  {
+    r.push_back(reference_.points[it->trainIdx]);
+    c.push_back(current_.points[it->queryIdx]);
+  }
+
+  // fixed seed, so the same frames give the same motion
+  boost::mt19937 rng(42);
+
+  const float min_extent = 2.0f * inlier_threshold_;
+  Eigen::Affine3f best;
+  size_t best_inliers = 0;
+
+  for(int i = 0; i < iterations_; ++i)
+  {
+    size_t s[3];
+    s[0] = rng() % r.size();
+    s[1] = rng() % r.size();
+    s[2] = rng() % r.size();
+
+    if(s[0] == s[1] || s[0] == s[2] || s[1] == s[2]) continue;
+
+    // a rigid motion keeps the distances, which rejects most samples with a wrong match before solving
+    bool consistent = true;
+
+    for(int a = 0; a < 3 && consistent; ++a)
+    {
+      const int b = (a + 1) % 3;
+      const float dr = (r[s[a]] - r[s[b]]).norm(), dc = (c[s[a]] - c[s[b]]).norm();
+
+      consistent = std::abs(dr - dc) < min_extent && dr > min_extent;
+    }
+
+    if(!consistent) continue;
+
+    Eigen::Matrix3f src, dst;
+
+    for(int a = 0; a < 3; ++a)
+    {
+      src.col(a) = c[s[a]];
+      dst.col(a) = r[s[a]];
+    }
+
+    // nearly collinear points don't determine the rotation around their line
+    if((dst.col(1) - dst.col(0)).cross(dst.col(2) - dst.col(0)).norm() < min_extent * min_extent) continue;
+
+    Eigen::Affine3f candidate(Eigen::umeyama(src, dst, false));
+
+    const size_t n = countInliers(r, c, candidate, 0);
+
+    if(n > best_inliers)
+    {
+      best_inliers = n;
+      best = candidate;
+    }
+  }
+
+  if(best_inliers < size_t(min_inliers_)) return false;
+
+  // refine on all inliers of the best sample
+  std::vector<size_t> inliers;
+  countInliers(r, c, best, &inliers);
+
+  Eigen::Matrix3Xf src(3, inliers.size()), dst(3, inliers.size());
+
+  for(size_t i = 0; i < inliers.size(); ++i)
+  {
+    src.col(i) = c[inliers[i]];
+    dst.col(i) = r[inliers[i]];
+  }
+
+  Eigen::Affine3f refined(Eigen::umeyama(src, dst, false));
+
+  inliers_ = countInliers(r, c, refined, 0);
+
+  if(inliers_ < size_t(min_inliers_)) return false;
+
+  motion = refined.cast<double>();
+
+  return true;
+}
+
+void SparseMotionEstimator::detect(dvo::core::RgbdImagePyramid& image, Features& features) const
+{
+  const dvo::core::RgbdImage& level = image.level(level_);
+  const dvo::core::IntrinsicMatrix& intrinsics = level.camera().intrinsics();
+  const float fx = intrinsics.fx(), fy = intrinsics.fy(), ox = intrinsics.ox(), oy = intrinsics.oy();
+
+  features.image = &image;
+  features.revision = image.revision();
+  features.points.clear();
+
+  cv::Mat intensity;
+  level.intensity.convertTo(intensity, CV_8U);
+
+  std::vector<cv::KeyPoint> keypoints;
+  cv::Mat descriptors;
+
+  // a smaller patch and fewer scales than the defaults suit the coarse levels
+  cv::ORB orb(max_features_, 1.2f, 3, 15, 0, 2, cv::ORB::HARRIS_SCORE, 15);
+  orb(intensity, cv::Mat(), keypoints, descriptors);
+
+  features.descriptors.create(int(keypoints.size()), descriptors.cols, descriptors.type());
+  features.points.reserve(keypoints.size());
+
+  for(size_t i = 0; i < keypoints.size(); ++i)
+  {
+    const int x = int(keypoints[i].pt.x + 0.5f), y = int(keypoints[i].pt.y + 0.5f);
+
+    if(x < 0 || y < 0 || x >= level.depth.cols || y >= level.depth.rows) continue;
+
+    const float depth = level.depth.at<dvo::core::DepthType>(y, x);
+
+    // nan compares false
+    if(!(depth > 0.0f)) continue;
+
+    cv::Mat row = features.descriptors.row(int(features.points.size()));
+    descriptors.row(int(i)).copyTo(row);
+
+    features.points.push_back(Eigen::Vector3f((keypoints[i].pt.x - ox) / fx * depth, (keypoints[i].pt.y - oy) / fy * depth, depth));
+  }
+
+  features.descriptors = features.descriptors.rowRange(0, int(features.points.size()));
+}
+
+size_t SparseMotionEstimator::countInliers(const std::vector<Eigen::Vector3f>& reference, const std::vector<Eigen::Vector3f>& current, const Eigen::Affine3f& motion, std::vector<size_t>* inliers) const
+{
+  const float threshold = inlier_threshold_ * inlier_threshold_;
+  size_t n = 0;
+
+  for(size_t i = 0; i < reference.size(); ++i)
+  {
+    if((motion * current[i] - reference[i]).squaredNorm() >= threshold) continue;
+
+    n++;
+    if(inliers != 0) inliers->push_back(i);
+  }
+
+  return n;
+}
+
+} /* namespace dvo_slam */
@@ -0,0 +1,108 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo_slam/tracking_diagnostics.h>
+#include <dvo_slam/KeyframeTrackingDiagnostics.h>
+
+#include <Eigen/Eigenvalues>
+
+#include <limits>
+
+namespace dvo_slam
+{
+
+// ratio of the largest and smallest eigenvalue of the information matrix
+static double conditionNumber(const dvo::core::Matrix6d& information)
+{
+  Eigen::SelfAdjointEigenSolver<dvo::core::Matrix6d> eigensolver(information, Eigen::EigenvaluesOnly);
+
+  return std::abs(eigensolver.eigenvalues()(5) / eigensolver.eigenvalues()(0));
+}
+
+TrackingDiagnostics::TrackingDiagnostics(ros::NodeHandle& nh, double rate)
+{
+  reset();
+
+  publisher_ = nh.advertise<dvo_slam::KeyframeTrackingDiagnostics>("tracking_diagnostics", 1);
+  timer_ = nh.createTimer(ros::Duration(1.0 / std::max(rate, 1e-3)), &TrackingDiagnostics::publish, this);
+}
+
+TrackingDiagnostics::~TrackingDiagnostics()
+{
+  timer_.stop();
+}
+
+bool TrackingDiagnostics::active() const
+{
+  return publisher_.getNumSubscribers() > 0;
+}
+
+void TrackingDiagnostics::add(const LocalTracker::TrackingResult& r_odometry, const LocalTracker::TrackingResult& r_keyframe, double entropy_ratio)
+{
+  if(!active()) return;
+
+  double odometry_kappa = conditionNumber(r_odometry.Information);
+  double keyframe_kappa = conditionNumber(r_keyframe.Information);
+
+  tbb::spin_mutex::scoped_lock l(sums_mutex_);
+
+  frames_++;
+  odometry_nll_ -= r_odometry.LogLikelihood;
+  keyframe_nll_ -= r_keyframe.LogLikelihood;
+  entropy_ratio_ += entropy_ratio;
+  odometry_kappa_ += odometry_kappa;
+  keyframe_kappa_ += keyframe_kappa;
+  min_entropy_ratio_ = std::min(min_entropy_ratio_, entropy_ratio);
+}
+
+void TrackingDiagnostics::reset()
+{
+  frames_ = 0;
+  odometry_nll_ = keyframe_nll_ = entropy_ratio_ = odometry_kappa_ = keyframe_kappa_ = 0.0;
+  min_entropy_ratio_ = std::numeric_limits<double>::max();
+}
+
+void TrackingDiagnostics::publish(const ros::TimerEvent& e)
+{
+  dvo_slam::KeyframeTrackingDiagnostics::Ptr msg(new dvo_slam::KeyframeTrackingDiagnostics());
+
+  {
+    tbb::spin_mutex::scoped_lock l(sums_mutex_);
+
+    if(frames_ == 0) return;
+
+    double normalizer = 1.0 / frames_;
+
+    msg->frames = frames_;
+    msg->odometry_negative_log_likelihood = odometry_nll_ * normalizer;
+    msg->keyframe_negative_log_likelihood = keyframe_nll_ * normalizer;
+    msg->entropy_ratio = entropy_ratio_ * normalizer;
+    msg->odometry_condition_number = odometry_kappa_ * normalizer;
+    msg->keyframe_condition_number = keyframe_kappa_ * normalizer;
+    msg->min_entropy_ratio = min_entropy_ratio_;
+
+    reset();
+  }
+
+  msg->header.stamp = e.current_real;
+  publisher_.publish(msg);
+}
+
+} /* namespace dvo_slam */
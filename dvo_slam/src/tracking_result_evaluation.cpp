@@ -23,6 +23,38 @@
 namespace dvo_slam
 {
 
+TrackingResultEvaluation::Ptr TrackingResultEvaluation::create(Type type, double first, double sum, double count)
+{
+  TrackingResultEvaluation::Ptr result;
+
+  switch(type)
+  {
+  case LogLikelihood:
+    result.reset(new LogLikelihoodTrackingResultEvaluation(first));
+    break;
+  case NormalizedLogLikelihood:
+    result.reset(new NormalizedLogLikelihoodTrackingResultEvaluation(first));
+    break;
+  case EntropyRatio:
+    result.reset(new EntropyRatioTrackingResultEvaluation(first));
+    break;
+  default:
+    return result;
+  }
+
+  result->average_ = sum;
+  result->n_ = count;
+
+  return result;
+}
+
+void TrackingResultEvaluation::state(double& first, double& sum, double& count) const
+{
+  first = first_;
+  sum = average_;
+  count = n_;
+}
+
 void TrackingResultEvaluation::add(const dvo::DenseTracker::Result& r)
 {
   average_ += value(r);
@@ -0,0 +1,397 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo_slam/tsdf_map.h>
+
+#include <dvo/util/instrumentation.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace dvo_slam
+{
+
+namespace internal
+{
+
+static const int KeyBits = 21;
+static const uint64_t KeyMask = (uint64_t(1) << KeyBits) - 1;
+static const int KeyOffset = 1 << (KeyBits - 1);
+
+static inline int floorDiv(int value, int divisor)
+{
+  return (value >= 0 ? value : value - (divisor - 1)) / divisor;
+}
+
+} /* namespace internal */
+
+TsdfMap::TsdfMap() :
+    voxel_size_(0.02f),
+    truncation_(0.08f),
+    max_depth_(4.0f),
+    level_(1),
+    stride_(1)
+{
+}
+
+TsdfMap::~TsdfMap()
+{
+  clearUnlocked();
+}
+
+void TsdfMap::configure(double voxel_size, double truncation, double max_depth, size_t level, size_t stride)
+{
+  tbb::mutex::scoped_lock l(mutex_);
+
+  stride = std::max(stride, size_t(1));
+
+  if(float(voxel_size) == voxel_size_ && float(truncation) == truncation_ && float(max_depth) == max_depth_ && level == level_ && stride == stride_) return;
+
+  clearUnlocked();
+
+  voxel_size_ = float(voxel_size);
+  truncation_ = std::max(float(truncation), voxel_size_);
+  max_depth_ = float(max_depth);
+  level_ = level;
+  stride_ = stride;
+}
+
+size_t TsdfMap::level() const
+{
+  tbb::mutex::scoped_lock l(mutex_);
+
+  return level_;
+}
+
+void TsdfMap::integrate(int id, dvo::core::RgbdImagePyramid& image, const Eigen::Affine3d& pose)
+{
+  static dvo::util::Timer& integrate_timer = dvo::util::Instrumentation::instance().timer("tsdf_map/integrate");
+  dvo::util::ScopedTimer t(integrate_timer);
+
+  tbb::mutex::scoped_lock l(mutex_);
+
+  const dvo::core::RgbdImage& level = image.level(level_);
+
+  EntryMap::iterator it = entries_.find(id);
+
+  if(it != entries_.end())
+  {
+    update(level, it->second->pose, -1.0f);
+  }
+  else
+  {
+    it = entries_.insert(std::make_pair(id, new Entry())).first;
+  }
+
+  update(level, pose, 1.0f);
+  it->second->pose = pose;
+}
+
+void TsdfMap::remove(int id, dvo::core::RgbdImagePyramid& image)
+{
+  tbb::mutex::scoped_lock l(mutex_);
+
+  EntryMap::iterator it = entries_.find(id);
+
+  if(it == entries_.end()) return;
+
+  update(image.level(level_), it->second->pose, -1.0f);
+
+  delete it->second;
+  entries_.erase(it);
+}
+
+bool TsdfMap::contains(int id) const
+{
+  tbb::mutex::scoped_lock l(mutex_);
+
+  return entries_.find(id) != entries_.end();
+}
+
+bool TsdfMap::moved(int id, const Eigen::Affine3d& pose, double translation, double rotation) const
+{
+  tbb::mutex::scoped_lock l(mutex_);
+
+  EntryMap::const_iterator it = entries_.find(id);
+
+  if(it == entries_.end()) return false;
+
+  Eigen::Affine3d delta = it->second->pose.inverse() * pose;
+
+  return delta.translation().norm() > translation || Eigen::AngleAxisd(delta.rotation()).angle() > rotation;
+}
+
+void TsdfMap::clear()
+{
+  tbb::mutex::scoped_lock l(mutex_);
+
+  clearUnlocked();
+}
+
+bool TsdfMap::empty() const
+{
+  tbb::mutex::scoped_lock l(mutex_);
+
+  return entries_.empty();
+}
+
+void TsdfMap::clearUnlocked()
+{
+  for(EntryMap::iterator it = entries_.begin(); it != entries_.end(); ++it)
+    delete it->second;
+
+  entries_.clear();
+  blocks_.clear();
+}
+
+void TsdfMap::update(const dvo::core::RgbdImage& image, const Eigen::Affine3d& pose, float sign)
+{
+  const dvo::core::IntrinsicMatrix& intrinsics = image.camera().intrinsics();
+  const float fx = intrinsics.fx(), fy = intrinsics.fy(), ox = intrinsics.ox(), oy = intrinsics.oy();
+
+  const Eigen::Affine3f camera_to_world = pose.cast<float>();
+  const Eigen::Affine3f world_to_camera = camera_to_world.inverse();
+
+  // samples along the ray one voxel apart, covering the truncation band around the measured depth
+  const int half_band = std::max(1, int(std::ceil(truncation_ / voxel_size_)));
+  const bool has_intensity = image.hasIntensity();
+
+  std::vector<uint64_t> emptied;
+
+  Block* block = 0;
+  uint64_t block_key = 0;
+
+  for(int y = 0; y < image.depth.rows; y += int(stride_))
+  {
+    const float* depth_row = image.depth.ptr<float>(y);
+    const float* intensity_row = has_intensity ? image.intensity.ptr<float>(y) : 0;
+
+    for(int x = 0; x < image.depth.cols; x += int(stride_))
+    {
+      const float depth = depth_row[x];
+
+      // also skips nan
+      if(!(depth > 0.0f) || depth > max_depth_) continue;
+
+      const Eigen::Vector3f ray((x - ox) / fx, (y - oy) / fy, 1.0f);
+      const float intensity = has_intensity ? intensity_row[x] : 0.0f;
+
+      for(int i = -half_band; i <= half_band; ++i)
+      {
+        const float z = depth + i * voxel_size_;
+
+        if(z <= 0.0f) continue;
+
+        const Eigen::Vector3f p = camera_to_world * (ray * z);
+        const int vx = int(std::floor(p.x() / voxel_size_)), vy = int(std::floor(p.y() / voxel_size_)), vz = int(std::floor(p.z() / voxel_size_));
+
+        // projective distance of the voxel center, so every sample of a voxel gets the same value for the same pose
+        const Eigen::Vector3f center = (Eigen::Vector3i(vx, vy, vz).cast<float>() + Eigen::Vector3f::Constant(0.5f)) * voxel_size_;
+        const float sdf = depth - (world_to_camera * center).z();
+
+        if(sdf < -truncation_) continue;
+
+        const float tsdf = std::min(1.0f, sdf / truncation_);
+
+        const int bx = internal::floorDiv(vx, BlockSize), by = internal::floorDiv(vy, BlockSize), bz = internal::floorDiv(vz, BlockSize);
+        const uint64_t k = key(bx, by, bz);
+
+        if(block == 0 || k != block_key)
+        {
+          if(sign > 0.0f)
+          {
+            block = &blocks_[k];
+          }
+          else
+          {
+            BlockMap::iterator it = blocks_.find(k);
+            block = it != blocks_.end() ? &it->second : 0;
+          }
+
+          block_key = k;
+
+          if(block == 0) continue;
+        }
+
+        Voxel& v = block->voxels[((vz - bz * BlockSize) * BlockSize + (vy - by * BlockSize)) * BlockSize + (vx - bx * BlockSize)];
+
+        const float weight = v.weight + sign;
+
+        // weights count measurements, so the last one taken out leaves the voxel empty
+        if(weight < 0.5f)
+        {
+          if(v.weight > 0.0f && --block->observed == 0) emptied.push_back(k);
+
+          v.distance = v.weight = v.intensity = 0.0f;
+          continue;
+        }
+
+        if(v.weight == 0.0f) ++block->observed;
+
+        v.distance = (v.distance * v.weight + sign * tsdf) / weight;
+        v.intensity = (v.intensity * v.weight + sign * intensity) / weight;
+        v.weight = weight;
+      }
+    }
+  }
+
+  for(std::vector<uint64_t>::const_iterator it = emptied.begin(); it != emptied.end(); ++it)
+  {
+    BlockMap::iterator b = blocks_.find(*it);
+
+    if(b != blocks_.end() && b->second.observed == 0) blocks_.erase(b);
+  }
+}
+
+size_t TsdfMap::extract(const Eigen::AlignedBox3f& region, PointVector& points, float min_weight) const
+{
+  static dvo::util::Timer& extract_timer = dvo::util::Instrumentation::instance().timer("tsdf_map/extract");
+  dvo::util::ScopedTimer t(extract_timer);
+
+  tbb::mutex::scoped_lock l(mutex_);
+
+  const size_t before = points.size();
+  const float block_extent = voxel_size_ * BlockSize;
+  const int offsets[3] = { 1, BlockSize, BlockSize * BlockSize };
+
+  for(BlockMap::const_iterator it = blocks_.begin(); it != blocks_.end(); ++it)
+  {
+    const int b[3] = {
+        int((it->first >> (2 * internal::KeyBits)) & internal::KeyMask) - internal::KeyOffset,
+        int((it->first >> internal::KeyBits) & internal::KeyMask) - internal::KeyOffset,
+        int(it->first & internal::KeyMask) - internal::KeyOffset
+    };
+
+    const Eigen::Vector3f origin(b[0] * block_extent, b[1] * block_extent, b[2] * block_extent);
+
+    if(Eigen::AlignedBox3f(origin, origin + Eigen::Vector3f::Constant(block_extent)).intersection(region).isEmpty()) continue;
+
+    const Block& block = it->second;
+
+    for(int lz = 0; lz < BlockSize; ++lz)
+      for(int ly = 0; ly < BlockSize; ++ly)
+        for(int lx = 0; lx < BlockSize; ++lx)
+        {
+          const int idx = (lz * BlockSize + ly) * BlockSize + lx;
+          const Voxel& v = block.voxels[idx];
+
+          if(v.weight < min_weight || std::abs(v.distance) >= 1.0f) continue;
+
+          const int local[3] = { lx, ly, lz };
+          const int voxel[3] = { b[0] * BlockSize + lx, b[1] * BlockSize + ly, b[2] * BlockSize + lz };
+
+          // neighbours in positive direction, zero crossings towards negative ones are found from the other side
+          const Voxel* neighbours[3];
+          Eigen::Vector3f gradient(0.0f, 0.0f, 0.0f);
+
+          for(int a = 0; a < 3; ++a)
+          {
+            if(local[a] + 1 < BlockSize)
+            {
+              neighbours[a] = &block.voxels[idx + offsets[a]];
+            }
+            else
+            {
+              neighbours[a] = find(voxel[0] + (a == 0), voxel[1] + (a == 1), voxel[2] + (a == 2));
+            }
+
+            if(neighbours[a] != 0 && (neighbours[a]->weight < min_weight || std::abs(neighbours[a]->distance) >= 1.0f)) neighbours[a] = 0;
+
+            if(neighbours[a] != 0) gradient(a) = neighbours[a]->distance - v.distance;
+          }
+
+          const float gradient_norm = gradient.norm();
+          const Eigen::Vector3f center = (Eigen::Vector3i(voxel[0], voxel[1], voxel[2]).cast<float>() + Eigen::Vector3f::Constant(0.5f)) * voxel_size_;
+
+          for(int a = 0; a < 3; ++a)
+          {
+            const Voxel* n = neighbours[a];
+
+            if(n == 0 || (v.distance < 0.0f) == (n->distance < 0.0f)) continue;
+
+            const float s = v.distance / (v.distance - n->distance);
+
+            Point p;
+            p.Position = center;
+            p.Position(a) += s * voxel_size_;
+
+            if(!region.contains(p.Position)) continue;
+
+            // distances grow towards the cameras, so the gradient is the outward normal
+            p.Normal = gradient_norm > 0.0f ? Eigen::Vector3f(gradient / gradient_norm) : Eigen::Vector3f::Zero();
+            p.Intensity = v.intensity + s * (n->intensity - v.intensity);
+            p.Weight = std::min(v.weight, n->weight);
+
+            points.push_back(p);
+          }
+        }
+  }
+
+  return points.size() - before;
+}
+
+bool TsdfMap::distance(const Eigen::Vector3f& point, float& distance) const
+{
+  tbb::mutex::scoped_lock l(mutex_);
+
+  const Voxel* v = find(int(std::floor(point.x() / voxel_size_)), int(std::floor(point.y() / voxel_size_)), int(std::floor(point.z() / voxel_size_)));
+
+  if(v == 0 || v->weight == 0.0f) return false;
+
+  distance = v->distance * truncation_;
+
+  return true;
+}
+
+size_t TsdfMap::blockCount() const
+{
+  tbb::mutex::scoped_lock l(mutex_);
+
+  return blocks_.size();
+}
+
+size_t TsdfMap::memoryUsage() const
+{
+  tbb::mutex::scoped_lock l(mutex_);
+
+  // nodes with their next pointer and hash, and the bucket arrays
+  return blocks_.size() * (sizeof(BlockMap::value_type) + 2 * sizeof(void*)) + blocks_.bucket_count() * sizeof(void*)
+      + entries_.size() * (sizeof(Entry) + sizeof(EntryMap::value_type) + 2 * sizeof(void*)) + entries_.bucket_count() * sizeof(void*);
+}
+
+const TsdfMap::Voxel* TsdfMap::find(int x, int y, int z) const
+{
+  const int bx = internal::floorDiv(x, BlockSize), by = internal::floorDiv(y, BlockSize), bz = internal::floorDiv(z, BlockSize);
+
+  BlockMap::const_iterator it = blocks_.find(key(bx, by, bz));
+
+  if(it == blocks_.end()) return 0;
+
+  return &it->second.voxels[((z - bz * BlockSize) * BlockSize + (y - by * BlockSize)) * BlockSize + (x - bx * BlockSize)];
+}
+
+uint64_t TsdfMap::key(int x, int y, int z)
+{
+  return ((uint64_t(x + internal::KeyOffset) & internal::KeyMask) << (2 * internal::KeyBits))
+      | ((uint64_t(y + internal::KeyOffset) & internal::KeyMask) << internal::KeyBits)
+      | (uint64_t(z + internal::KeyOffset) & internal::KeyMask);
+}
+
+} /* namespace dvo_slam */
@@ -0,0 +1,135 @@
+/**
+ *  This file is part of dvo.
+ *
+ *  Copyright 2013 Christian Kerl <christian.kerl@in.tum.de> (Technical University of Munich)
+ *  For more information see <http://vision.in.tum.de/data/software/dvo>.
+ *
+ *  dvo is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  dvo is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with dvo.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dvo_slam/vertex_table.h>
+
+#include <algorithm>
+
+namespace dvo_slam
+{
+
+VertexTable::VertexTable() :
+    size_(0)
+{
+}
+
+VertexTable::~VertexTable()
+{
+}
+
+void VertexTable::insert(int id, const ros::Time& timestamp)
+{
+  Entry& e = allocate(id);
+
+  if(e.used)
+  {
+    by_timestamp_.erase(std::make_pair(e.timestamp, id));
+  }
+  else
+  {
+    e.used = true;
+    size_++;
+  }
+
+  e.timestamp = timestamp;
+  by_timestamp_.insert(std::make_pair(timestamp, id));
+}
+
+void VertexTable::remove(int id)
+{
+  Entry* e = entry(id);
+
+  if(e == 0) return;
+
+  by_timestamp_.erase(std::make_pair(e->timestamp, id));
+  *e = Entry();
+  size_--;
+}
+
+void VertexTable::changeId(int from, int to)
+{
+  Entry* e = entry(from);
+
+  if(e == 0 || from == to) return;
+
+  Entry moved = *e;
+  remove(from);
+
+  insert(to, moved.timestamp);
+
+  entry(to)->submap = moved.submap;
+}
+
+void VertexTable::submap(int id, int submap)
+{
+  Entry* e = entry(id);
+
+  if(e != 0) e->submap = submap;
+}
+
+void VertexTable::clear()
+{
+  keyframes_.clear();
+  odometry_.clear();
+  by_timestamp_.clear();
+  size_ = 0;
+}
+
+size_t VertexTable::size() const
+{
+  return size_;
+}
+
+const VertexTable::Entry* VertexTable::find(int id) const
+{
+  return const_cast<VertexTable*>(this)->entry(id);
+}
+
+ros::Time VertexTable::timestamp(int id) const
+{
+  const Entry* e = find(id);
+
+  return e != 0 ? e->timestamp : ros::Time();
+}
+
+const VertexTable::TimestampIndex& VertexTable::byTimestamp() const
+{
+  return by_timestamp_;
+}
+
+VertexTable::Entry* VertexTable::entry(int id)
+{
+  const size_t idx = size_t(id >= 0 ? id : -id);
+  std::vector<Entry>& entries = id >= 0 ? keyframes_ : odometry_;
+
+  return idx < entries.size() && entries[idx].used ? &entries[idx] : 0;
+}
+
+VertexTable::Entry& VertexTable::allocate(int id)
+{
+  const size_t idx = size_t(id >= 0 ? id : -id);
+  std::vector<Entry>& entries = id >= 0 ? keyframes_ : odometry_;
+
+  if(idx >= entries.size()) entries.resize(std::max(idx + 1, entries.size() * 2));
+
+  return entries[idx];
+}
+
+} /* namespace dvo_slam */
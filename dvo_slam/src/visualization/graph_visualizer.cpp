@@ -22,6 +22,8 @@
 
 #include <interactive_markers/interactive_marker_server.h>
 
+#include <boost/unordered_set.hpp>
+
 #include <g2o/types/slam3d/vertex_se3.h>
 #include <g2o/types/slam3d/edge_se3.h>
 
@@ -39,10 +41,17 @@ private:
   dvo_ros::visualization::RosCameraTrajectoryVisualizer& visualizer_;
   interactive_markers::InteractiveMarkerServer* marker_server_;
 
+  size_t revision_;
+  dvo_slam::MapChangeSet changes_;
+
+  // changed keyframes, which couldn't be shown yet
+  boost::unordered_set<int> pending_;
+
 public:
   GraphVisualizerImpl(dvo_ros::visualization::RosCameraTrajectoryVisualizer& visualizer) :
     visualizer_(visualizer),
-    marker_server_(0)
+    marker_server_(0),
+    revision_(0)
   {
     void* native_visualizer;
     if(visualizer_.native(native_visualizer))
@@ -59,10 +68,34 @@ public:
   {
     if(marker_server_ == 0) return;
 
+    // without subscribers the revision isn't advanced, so everything changed meanwhile is shown once somebody subscribes
+    if(!visualizer_.active()) return;
+
+    // only the cameras of moved keyframes are sent again, their point clouds are the expensive part
+    map.changes(revision_, changes_);
+    revision_ = changes_.Revision;
+
+    if(changes_.Full) pending_.clear();
+
+    // odometry vertices aren't shown
+    for(std::vector<int>::const_iterator it = changes_.ChangedVertices.begin(); it != changes_.ChangedVertices.end(); ++it)
+    {
+      if(*it >= 0) pending_.insert(*it);
+    }
+
+    if(pending_.empty() && changes_.AddedEdges.empty() && changes_.RemovedEdges.empty() && !changes_.Full) return;
+
     for(KeyframeVector::const_iterator it = map.keyframes().begin(); it != map.keyframes().end(); ++it)
     {
       const KeyframePtr& keyframe = *it;
 
+      if(!changes_.Full && pending_.count(keyframe->id()) == 0) continue;
+
+      // evicted by the keyframe store, stays pending until it is restored
+      if(!keyframe->image()->level(0).hasIntensity()) continue;
+
+      pending_.erase(keyframe->id());
+
       std::stringstream id;
       id << "keyframe_" << keyframe->id();
 
@@ -244,8 +277,8 @@ public:
       marker.name = std::string("constraints");
       marker.controls.push_back(control);
 
+      // applied by the publishing thread of the visualizer
       marker_server_->insert(marker);
-      marker_server_->applyChanges();
 
   }
 };